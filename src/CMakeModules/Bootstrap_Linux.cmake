@@ -91,6 +91,9 @@ ELSEIF (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
     add_definitions(-DTBB_USE_GLIBCXX_VERSION=${TBB_USE_GLIBCXX_VERSION})
 ENDIF ()
 
+# Observers of a single arena, used to keep the workers of pinned channels on their cpus
+add_definitions(-DTBB_PREVIEW_LOCAL_OBSERVER=1)
+
 IF (POLICY CMP0045)
 	CMAKE_POLICY (SET CMP0045 OLD)
 ENDIF ()
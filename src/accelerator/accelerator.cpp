@@ -1,36 +1,93 @@
 #include "accelerator.h"
 
+#include "cpu/image/image_mixer.h"
 #include "ogl/image/image_mixer.h"
+#include "ogl/image/image_shader.h"
 #include "ogl/util/device.h"
+#include "ogl/util/shader.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
 
 #include <boost/property_tree/ptree.hpp>
 
 #include <core/mixer/image/image_mixer.h>
 
+#include <future>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace accelerator {
 
 struct accelerator::impl
 {
-    std::shared_ptr<ogl::device> ogl_device_;
+    struct ogl_device
+    {
+        std::shared_ptr<ogl::device>                                  device;
+        std::shared_future<std::vector<std::shared_ptr<ogl::shader>>> shaders;
+        bool                                                          failed = false;
+    };
+
+    const std::wstring        mode_;
+    std::map<int, ogl_device> ogl_devices_;
+
+    impl()
+        : mode_(env::properties().get(L"configuration.accelerator", L"auto"))
+    {
+        if (mode_ != L"auto" && mode_ != L"ogl" && mode_ != L"cpu") {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid accelerator: " + mode_));
+        }
+    }
 
-    impl() {}
+    ~impl()
+    {
+        for (auto& entry : ogl_devices_) {
+            if (entry.second.device) {
+                entry.second.shaders.wait();
+            }
+        }
+    }
 
-    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id)
+    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id, bool half_float, int device_index)
     {
-        return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(get_device()), channel_id);
+        auto device = get_device(device_index);
+        if (!device) {
+            return std::make_unique<cpu::image_mixer>(channel_id);
+        }
+        return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(device), channel_id, half_float);
     }
 
-    std::shared_ptr<ogl::device> get_device()
+    // Null if channels are mixed on the cpu, as configured or, in auto mode, because the device couldn't be created.
+    std::shared_ptr<ogl::device> get_device(int index = 0)
     {
-        if (!ogl_device_) {
-            ogl_device_ = std::make_shared<ogl::device>();
+        if (mode_ == L"cpu") {
+            return nullptr;
+        }
+
+        auto& entry = ogl_devices_[index];
+        if (!entry.device && !entry.failed) {
+            try {
+                entry.device = std::make_shared<ogl::device>(index);
+            } catch (...) {
+                if (mode_ != L"auto") {
+                    throw;
+                }
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(warning) << L"Failed to create OpenGL device " << index
+                                    << L", channels on it are mixed on the cpu.";
+                entry.failed = true;
+                return nullptr;
+            }
+
+            // Compiled ahead of the first frames, which would otherwise wait for every new variant.
+            entry.shaders = ogl::warm_up_shaders(spl::make_shared_ptr(entry.device)).share();
         }
 
-        return ogl_device_;
+        return entry.device;
     }
 };
 
@@ -41,9 +98,9 @@ accelerator::accelerator()
 
 accelerator::~accelerator() {}
 
-std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(int channel_id)
+std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(int channel_id, bool half_float, int device_index)
 {
-    return impl_->create_image_mixer(channel_id);
+    return impl_->create_image_mixer(channel_id, half_float, device_index);
 }
 
 std::shared_ptr<accelerator_device> accelerator::get_device() const
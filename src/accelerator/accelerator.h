@@ -26,8 +26,11 @@ class accelerator
 
     accelerator& operator=(accelerator&) = delete;
 
-    std::unique_ptr<caspar::core::image_mixer> create_image_mixer(int channel_id);
+    // Channels on different devices are mixed on contexts and threads of their own.
+    std::unique_ptr<caspar::core::image_mixer>
+    create_image_mixer(int channel_id, bool half_float = false, int device_index = 0);
 
+    // Returns the first device, or null if channels are mixed on the cpu.
     std::shared_ptr<accelerator_device> get_device() const;
 
   private:
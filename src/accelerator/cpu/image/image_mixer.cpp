@@ -0,0 +1,913 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_mixer.h"
+
+#include <common/array.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/any.hpp>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+namespace {
+
+// Rows drawn by each task.
+const int BAND_HEIGHT = 16;
+
+const double epsilon = 0.001;
+
+// A bgra image with premultiplied alpha, whose rows run bottom up if linesize is negative.
+struct image_view
+{
+    const std::uint8_t* data     = nullptr;
+    int                 width    = 0;
+    int                 height   = 0;
+    std::ptrdiff_t      linesize = 0;
+
+    const std::uint8_t* row(int y) const { return data + y * linesize; }
+};
+
+// The image of a frame as drawn, which refers to the frame's own data if it is bgra already.
+struct decoded_image
+{
+    std::vector<std::uint8_t> data;
+    image_view                view;
+};
+
+struct item
+{
+    core::pixel_format_desc               pix_desc = core::pixel_format::invalid;
+    std::shared_ptr<const decoded_image>  image;
+    core::image_transform                 transform;
+};
+
+struct layer
+{
+    std::vector<layer> sublayers;
+    std::vector<item>  items;
+    core::blend_mode   blend_mode;
+
+    explicit layer(core::blend_mode blend_mode)
+        : blend_mode(blend_mode)
+    {
+    }
+};
+
+// What isn't drawn is logged once for each kind.
+void log_unsupported(const std::wstring& what)
+{
+    static std::mutex              mutex;
+    static std::set<std::wstring> logged;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (logged.insert(what).second) {
+        CASPAR_LOG(warning) << L"[cpu::image_mixer] " << what << L" is not supported and is left out.";
+    }
+}
+
+std::uint8_t clamp8(int value) { return static_cast<std::uint8_t>(std::min(255, std::max(0, value))); }
+
+// a * b / 255, rounded.
+std::uint32_t mul255(std::uint32_t a, std::uint32_t b)
+{
+    const auto t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// The 8 most significant bits of sample n of a row.
+int sample8(const std::uint8_t* row, int n, core::color_depth depth)
+{
+    switch (depth) {
+        case core::color_depth::bit8:
+            return row[n];
+        case core::color_depth::bit10:
+            return reinterpret_cast<const std::uint16_t*>(row)[n] >> 2;
+        default:
+            return reinterpret_cast<const std::uint16_t*>(row)[n] >> 8;
+    }
+}
+
+// The limited range matrices of the image shader in 8.8 fixed point, bt.601 up to 700 lines and bt.709 above.
+struct yuv_matrix
+{
+    int y;
+    int rv;
+    int gu;
+    int gv;
+    int bu;
+};
+
+const yuv_matrix BT601 = {298, 409, 100, 208, 517};
+const yuv_matrix BT709 = {298, 459, 55, 137, 541};
+
+void yuv_to_bgra(const yuv_matrix& m, int y, int u, int v, int a, std::uint8_t* dest)
+{
+    const auto c = (y - 16) * m.y + 128;
+    const auto d = u - 128;
+    const auto e = v - 128;
+    dest[0]      = clamp8((c + m.bu * d) >> 8);
+    dest[1]      = clamp8((c - m.gu * d - m.gv * e) >> 8);
+    dest[2]      = clamp8((c + m.rv * e) >> 8);
+    dest[3]      = static_cast<std::uint8_t>(a);
+}
+
+bool is_supported(const core::pixel_format_desc& desc)
+{
+    if (desc.planes.empty()) {
+        return false;
+    }
+
+    const auto is_8bit = [](const core::pixel_format_desc::plane& p) { return p.depth == core::color_depth::bit8; };
+    const auto depth8  = std::all_of(desc.planes.begin(), desc.planes.end(), is_8bit);
+
+    switch (desc.format) {
+        case core::pixel_format::gray:
+        case core::pixel_format::luma:
+            return true;
+        case core::pixel_format::ycbcr:
+            return desc.planes.size() >= 3;
+        case core::pixel_format::ycbcra:
+            return desc.planes.size() >= 4;
+        case core::pixel_format::nv12:
+            return desc.planes.size() >= 2 && depth8;
+        case core::pixel_format::bgra:
+        case core::pixel_format::rgba:
+        case core::pixel_format::argb:
+        case core::pixel_format::abgr:
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb:
+        case core::pixel_format::uyvy:
+            return depth8;
+        default:
+            return false;
+    }
+}
+
+// Converts row y of a frame to bgra.
+void decode_row(const core::const_frame& frame, int y, int width, std::uint8_t* dest)
+{
+    const auto& desc   = frame.pixel_format_desc();
+    const auto& p0     = desc.planes[0];
+    const auto  row    = [&](int n, int line) { return frame.image_data(n).data() + line * desc.planes[n].linesize; };
+    const auto& matrix = p0.height > 700 ? BT709 : BT601;
+
+    switch (desc.format) {
+        case core::pixel_format::gray:
+        case core::pixel_format::luma: {
+            const auto src  = row(0, y);
+            const auto luma = desc.format == core::pixel_format::luma;
+            for (int x = 0; x < width; ++x) {
+                auto value = sample8(src, x, p0.depth);
+                value      = luma ? clamp8((value - 16) * 255 / 219) : value;
+                dest[x * 4 + 0] = dest[x * 4 + 1] = dest[x * 4 + 2] = static_cast<std::uint8_t>(value);
+                dest[x * 4 + 3]                                     = 255;
+            }
+            break;
+        }
+        case core::pixel_format::bgra:
+        case core::pixel_format::rgba:
+        case core::pixel_format::argb:
+        case core::pixel_format::abgr:
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb: {
+            // The byte offsets of b, g, r and a, and the size of a pixel. An offset of -1 for a is opaque.
+            std::array<int, 5> layout;
+            switch (desc.format) {
+                case core::pixel_format::rgba:
+                    layout = {{2, 1, 0, 3, 4}};
+                    break;
+                case core::pixel_format::argb:
+                    layout = {{3, 2, 1, 0, 4}};
+                    break;
+                case core::pixel_format::abgr:
+                    layout = {{1, 2, 3, 0, 4}};
+                    break;
+                case core::pixel_format::bgr:
+                    layout = {{0, 1, 2, -1, 3}};
+                    break;
+                case core::pixel_format::rgb:
+                    layout = {{2, 1, 0, -1, 3}};
+                    break;
+                default:
+                    layout = {{0, 1, 2, 3, 4}};
+                    break;
+            }
+            const auto src    = row(0, y);
+            const auto stride = layout[4];
+            for (int x = 0; x < width; ++x) {
+                const auto pixel = src + x * stride;
+                dest[x * 4 + 0]  = pixel[layout[0]];
+                dest[x * 4 + 1]  = pixel[layout[1]];
+                dest[x * 4 + 2]  = pixel[layout[2]];
+                dest[x * 4 + 3]  = layout[3] < 0 ? 255 : pixel[layout[3]];
+            }
+            break;
+        }
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra: {
+            const auto& p1    = desc.planes[1];
+            const auto& p2    = desc.planes[2];
+            const auto  alpha = desc.format == core::pixel_format::ycbcra;
+            const auto  cy    = y * p1.height / p0.height;
+            const auto  ys    = row(0, y);
+            const auto  us    = row(1, cy);
+            const auto  vs    = row(2, y * p2.height / p0.height);
+            const auto  as    = alpha ? row(3, y * desc.planes[3].height / p0.height) : nullptr;
+            for (int x = 0; x < width; ++x) {
+                const auto cx = x * p1.width / p0.width;
+                yuv_to_bgra(matrix,
+                            sample8(ys, x, p0.depth),
+                            sample8(us, cx, p1.depth),
+                            sample8(vs, x * p2.width / p0.width, p2.depth),
+                            alpha ? sample8(as, x * desc.planes[3].width / p0.width, desc.planes[3].depth) : 255,
+                            dest + x * 4);
+            }
+            break;
+        }
+        case core::pixel_format::nv12: {
+            const auto& p1 = desc.planes[1];
+            const auto  ys = row(0, y);
+            const auto  uv = row(1, y * p1.height / p0.height);
+            for (int x = 0; x < width; ++x) {
+                const auto cx = x * p1.width / p0.width;
+                yuv_to_bgra(matrix, ys[x], uv[cx * 2], uv[cx * 2 + 1], 255, dest + x * 4);
+            }
+            break;
+        }
+        case core::pixel_format::uyvy: {
+            const auto src = row(0, y);
+            for (int x = 0; x < width; ++x) {
+                const auto texel = src + x / 2 * 4;
+                yuv_to_bgra(matrix, texel[x % 2 == 0 ? 1 : 3], texel[0], texel[2], 255, dest + x * 4);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+std::shared_ptr<const decoded_image> decode(const core::const_frame& frame)
+{
+    const auto& desc  = frame.pixel_format_desc();
+    const auto& p0    = desc.planes[0];
+    const auto  width = desc.format == core::pixel_format::uyvy ? p0.width * 2 : p0.width;
+
+    auto image         = std::make_shared<decoded_image>();
+    image->view.width  = width;
+    image->view.height = p0.height;
+
+    if (desc.format == core::pixel_format::bgra) {
+        image->view.data     = frame.image_data(0).data();
+        image->view.linesize = p0.linesize;
+    } else {
+        image->data.resize(static_cast<std::size_t>(width) * p0.height * 4);
+        tbb::parallel_for(tbb::blocked_range<int>(0, p0.height, BAND_HEIGHT), [&](const tbb::blocked_range<int>& r) {
+            for (int y = r.begin(); y < r.end(); ++y) {
+                decode_row(frame, y, width, image->data.data() + static_cast<std::size_t>(y) * width * 4);
+            }
+        });
+        image->view.data     = image->data.data();
+        image->view.linesize = static_cast<std::ptrdiff_t>(width) * 4;
+    }
+
+    if (desc.bottom_up) {
+        image->view.data += (p0.height - 1) * image->view.linesize;
+        image->view.linesize = -image->view.linesize;
+    }
+
+    return image;
+}
+
+// Where an item is drawn, mirroring the vertex transform of the image kernel. Maps pixels of the target to
+// normalized texture coordinates, which are sampled within the crop.
+struct placement
+{
+    double u0, ux, uy;
+    double v0, vx, vy;
+
+    double crop_u0, crop_u1, crop_v0, crop_v1;
+
+    int x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+
+    // Whether each pixel of the target takes exactly one pixel of the image.
+    bool exact = false;
+    int  offset_x = 0, offset_y = 0;
+};
+
+bool place(const core::image_transform& t, const image_view& image, int width, int height, double aspect, placement& p)
+{
+    const auto sx = t.fill_scale[0];
+    const auto sy = t.fill_scale[1];
+    if (std::abs(sx) < 1e-9 || std::abs(sy) < 1e-9) {
+        return false;
+    }
+
+    const auto c  = std::cos(t.angle);
+    const auto s  = std::sin(t.angle);
+    const auto tx = t.fill_translation[0];
+    const auto ty = t.fill_translation[1];
+
+    // Texture coordinates of the normalized target coordinates X and Y.
+    const auto u_x = c / sx;
+    const auto u_y = s / (aspect * sx);
+    const auto u_c = t.anchor[0] - (c * tx + s * ty / aspect) / sx;
+    const auto v_x = -s * aspect / sy;
+    const auto v_y = c / sy;
+    const auto v_c = t.anchor[1] + (s * tx * aspect - c * ty) / sy;
+
+    // At the centers of the target's pixels.
+    p.ux = u_x / width;
+    p.uy = u_y / height;
+    p.u0 = u_c + p.ux * 0.5 + p.uy * 0.5;
+    p.vx = v_x / width;
+    p.vy = v_y / height;
+    p.v0 = v_c + p.vx * 0.5 + p.vy * 0.5;
+
+    p.crop_u0 = std::max(0.0, std::min(t.crop.ul[0], t.crop.lr[0]));
+    p.crop_u1 = std::min(1.0, std::max(t.crop.ul[0], t.crop.lr[0]));
+    p.crop_v0 = std::max(0.0, std::min(t.crop.ul[1], t.crop.lr[1]));
+    p.crop_v1 = std::min(1.0, std::max(t.crop.ul[1], t.crop.lr[1]));
+    if (p.crop_u1 <= p.crop_u0 || p.crop_v1 <= p.crop_v0) {
+        return false;
+    }
+
+    // The bounds of the cropped quad on the target, within the clip.
+    double min_x = 1e9, max_x = -1e9, min_y = 1e9, max_y = -1e9;
+    for (auto u : {p.crop_u0, p.crop_u1}) {
+        for (auto v : {p.crop_v0, p.crop_v1}) {
+            const auto ox = (u - t.anchor[0]) * sx;
+            const auto oy = (v - t.anchor[1]) * sy / aspect;
+            const auto x  = ox * c - oy * s + tx;
+            const auto y  = (ox * s + oy * c) * aspect + ty;
+            min_x         = std::min(min_x, x);
+            max_x         = std::max(max_x, x);
+            min_y         = std::min(min_y, y);
+            max_y         = std::max(max_y, y);
+        }
+    }
+
+    const auto clip_x0 = t.clip_translation[0];
+    const auto clip_y0 = t.clip_translation[1];
+    const auto clip_x1 = clip_x0 + t.clip_scale[0];
+    const auto clip_y1 = clip_y0 + t.clip_scale[1];
+
+    p.x0 = std::max(0, static_cast<int>(std::floor(std::max(min_x, clip_x0) * width)));
+    p.x1 = std::min(width, static_cast<int>(std::ceil(std::min(max_x, clip_x1) * width)));
+    p.y0 = std::max(0, static_cast<int>(std::floor(std::max(min_y, clip_y0) * height)));
+    p.y1 = std::min(height, static_cast<int>(std::ceil(std::min(max_y, clip_y1) * height)));
+    if (p.x1 <= p.x0 || p.y1 <= p.y0) {
+        return false;
+    }
+
+    // Straight copies of pixels, e.g. of a clip of the channel's size, aren't filtered.
+    const auto step_x = p.ux * image.width;
+    const auto step_y = p.vy * image.height;
+    const auto fx     = p.u0 * image.width - 0.5;
+    const auto fy     = p.v0 * image.height - 0.5;
+    p.offset_x        = static_cast<int>(std::lround(fx));
+    p.offset_y        = static_cast<int>(std::lround(fy));
+    p.exact = std::abs(step_x - 1.0) < 1e-6 && std::abs(step_y - 1.0) < 1e-6 && std::abs(p.uy) < 1e-12 &&
+              std::abs(p.vx) < 1e-12 && std::abs(fx - p.offset_x) < 1e-3 && std::abs(fy - p.offset_y) < 1e-3;
+
+    return true;
+}
+
+// Samples row y of the target from the image into dest, transparent where the image isn't drawn.
+void sample_row(const image_view& image, const placement& p, int y, int x0, int x1, std::uint8_t* dest)
+{
+    std::memset(dest, 0, static_cast<std::size_t>(x1 - x0) * 4);
+
+    if (p.exact) {
+        const auto sy = y + p.offset_y;
+        if (sy < 0 || sy >= image.height) {
+            return;
+        }
+        const auto cu0 = static_cast<int>(std::ceil(p.crop_u0 * image.width - 0.5));
+        const auto cu1 = static_cast<int>(std::floor(p.crop_u1 * image.width - 0.5));
+        const auto cv  = (sy + 0.5) / image.height;
+        if (cv < p.crop_v0 || cv > p.crop_v1) {
+            return;
+        }
+        const auto begin = std::max(x0, std::max(0, cu0) - p.offset_x);
+        const auto end   = std::min(x1, std::min(image.width - 1, cu1) - p.offset_x + 1);
+        if (end > begin) {
+            std::memcpy(dest + (begin - x0) * 4,
+                        image.row(sy) + (begin + p.offset_x) * 4,
+                        static_cast<std::size_t>(end - begin) * 4);
+        }
+        return;
+    }
+
+    const auto w = image.width;
+    const auto h = image.height;
+
+    auto u = p.u0 + p.ux * x0 + p.uy * y;
+    auto v = p.v0 + p.vx * x0 + p.vy * y;
+    for (int x = x0; x < x1; ++x, u += p.ux, v += p.vx) {
+        if (u < p.crop_u0 || u > p.crop_u1 || v < p.crop_v0 || v > p.crop_v1) {
+            continue;
+        }
+
+        // Bilinear, with 8 bits of fraction and the edges repeated.
+        const auto fx = static_cast<int>(std::floor((u * w - 0.5) * 256.0));
+        const auto fy = static_cast<int>(std::floor((v * h - 0.5) * 256.0));
+        const auto ix = fx >> 8;
+        const auto iy = fy >> 8;
+        const auto ax = static_cast<std::uint32_t>(fx & 255);
+        const auto ay = static_cast<std::uint32_t>(fy & 255);
+
+        const auto x_0 = std::min(std::max(ix, 0), w - 1);
+        const auto x_1 = std::min(std::max(ix + 1, 0), w - 1);
+        const auto r0  = image.row(std::min(std::max(iy, 0), h - 1));
+        const auto r1  = image.row(std::min(std::max(iy + 1, 0), h - 1));
+
+        const auto out = dest + (x - x0) * 4;
+        for (int n = 0; n < 4; ++n) {
+            const auto top    = r0[x_0 * 4 + n] * (256 - ax) + r0[x_1 * 4 + n] * ax;
+            const auto bottom = r1[x_0 * 4 + n] * (256 - ax) + r1[x_1 * 4 + n] * ax;
+            out[n]            = static_cast<std::uint8_t>((top * (256 - ay) + bottom * ay + 32768) >> 16);
+        }
+    }
+}
+
+enum class target_kind
+{
+    over, // normal blend onto bgra
+    add,  // added onto the bgra mix buffer
+    key,  // onto a single channel key
+};
+
+// The images that a layer is drawn on, keys and mixes are only allocated when items need them.
+struct buffers
+{
+    int                       width  = 0;
+    int                       height = 0;
+    std::vector<std::uint8_t> local_key;
+    std::vector<std::uint8_t> local_mix;
+};
+
+// Draws an item onto target with the keys that apply to it, in bands of rows in parallel.
+void draw_item(const item&         item,
+               std::uint8_t*       target,
+               target_kind         kind,
+               const std::uint8_t* local_key,
+               const std::uint8_t* layer_key,
+               int                 width,
+               int                 height,
+               double              aspect)
+{
+    const auto& t     = item.transform;
+    const auto& image = item.image->view;
+
+    placement p;
+    if (!place(t, image, width, height, aspect, p)) {
+        return;
+    }
+
+    // Keys are drawn opaque, as by the image shader.
+    const auto alpha   = t.is_key ? 1.0 : std::min(1.0, std::max(0.0, t.opacity));
+    const auto opacity = static_cast<std::uint32_t>(std::lround(alpha * 256.0));
+    const auto invert  = t.invert;
+
+    tbb::parallel_for(tbb::blocked_range<int>(p.y0, p.y1, BAND_HEIGHT), [&](const tbb::blocked_range<int>& r) {
+        std::vector<std::uint8_t> row(static_cast<std::size_t>(p.x1 - p.x0) * 4);
+        const auto                count = p.x1 - p.x0;
+
+        for (int y = r.begin(); y < r.end(); ++y) {
+            sample_row(image, p, y, p.x0, p.x1, row.data());
+
+            auto src = row.data();
+            if (opacity < 256) {
+                for (int n = 0; n < count * 4; ++n) {
+                    src[n] = static_cast<std::uint8_t>(src[n] * opacity >> 8);
+                }
+            }
+            if (invert) {
+                for (int n = 0; n < count * 4; ++n) {
+                    src[n] = static_cast<std::uint8_t>(255 - src[n]);
+                }
+            }
+
+            const auto offset = static_cast<std::size_t>(y) * width + p.x0;
+            for (auto key : {local_key, layer_key}) {
+                if (key) {
+                    const auto k = key + offset;
+                    for (int n = 0; n < count; ++n) {
+                        for (int c = 0; c < 4; ++c) {
+                            src[n * 4 + c] = static_cast<std::uint8_t>(mul255(src[n * 4 + c], k[n]));
+                        }
+                    }
+                }
+            }
+
+            switch (kind) {
+                case target_kind::over: {
+                    const auto dest = target + offset * 4;
+                    for (int n = 0; n < count; ++n) {
+                        const auto inverse = 255 - src[n * 4 + 3];
+                        for (int c = 0; c < 4; ++c) {
+                            dest[n * 4 + c] =
+                                static_cast<std::uint8_t>(src[n * 4 + c] + mul255(dest[n * 4 + c], inverse));
+                        }
+                    }
+                    break;
+                }
+                case target_kind::add: {
+                    const auto dest = target + offset * 4;
+                    for (int n = 0; n < count * 4; ++n) {
+                        dest[n] = static_cast<std::uint8_t>(std::min(255, dest[n] + src[n]));
+                    }
+                    break;
+                }
+                case target_kind::key: {
+                    // Like the gpu, the key is the red channel of the item, blended over.
+                    const auto dest = target + offset;
+                    for (int n = 0; n < count; ++n) {
+                        dest[n] = static_cast<std::uint8_t>(src[n * 4 + 2] + mul255(dest[n], 255 - src[n * 4 + 3]));
+                    }
+                    break;
+                }
+            }
+        }
+    });
+}
+
+// Blends a bgra buffer of the target's size over it.
+void draw_buffer(const std::vector<std::uint8_t>& source, std::uint8_t* target, int width, int height)
+{
+    tbb::parallel_for(tbb::blocked_range<int>(0, height, BAND_HEIGHT), [&](const tbb::blocked_range<int>& r) {
+        for (int y = r.begin(); y < r.end(); ++y) {
+            const auto src  = source.data() + static_cast<std::size_t>(y) * width * 4;
+            const auto dest = target + static_cast<std::size_t>(y) * width * 4;
+            for (int n = 0; n < width; ++n) {
+                const auto inverse = 255 - src[n * 4 + 3];
+                for (int c = 0; c < 4; ++c) {
+                    dest[n * 4 + c] = static_cast<std::uint8_t>(src[n * 4 + c] + mul255(dest[n * 4 + c], inverse));
+                }
+            }
+        }
+    });
+}
+
+// Draws layers in the order of the gpu mixer's image_renderer: each layer after its sublayers, a key item keys the
+// next item that isn't one, and the keys left at the end of a layer key the items of the next layer.
+class image_renderer
+{
+    const int width_;
+    const int height_;
+    const double aspect_;
+
+  public:
+    image_renderer(const core::video_format_desc& format_desc)
+        : width_(format_desc.width)
+        , height_(format_desc.height)
+        , aspect_(static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height))
+    {
+    }
+
+    void draw(std::uint8_t* target, std::vector<layer>& layers) const
+    {
+        std::vector<std::uint8_t> layer_key;
+        for (auto& layer : layers) {
+            draw(target, layer.sublayers);
+            draw(target, layer, layer_key);
+        }
+    }
+
+  private:
+    std::size_t pixels() const { return static_cast<std::size_t>(width_) * height_; }
+
+    void draw(std::uint8_t* target, layer& layer, std::vector<std::uint8_t>& layer_key) const
+    {
+        if (layer.items.empty()) {
+            return;
+        }
+        if (layer.blend_mode != core::blend_mode::normal) {
+            log_unsupported(L"Blend mode " + std::to_wstring(static_cast<int>(layer.blend_mode)));
+        }
+
+        std::vector<std::uint8_t> local_key;
+        std::vector<std::uint8_t> local_mix;
+
+        const auto key = [](const std::vector<std::uint8_t>& buffer) {
+            return buffer.empty() ? nullptr : buffer.data();
+        };
+
+        for (auto& item : layer.items) {
+            const auto& t = item.transform;
+            if (t.is_key) {
+                if (local_key.empty()) {
+                    local_key.resize(pixels(), 0);
+                }
+                draw_item(item, local_key.data(), target_kind::key, nullptr, nullptr, width_, height_, aspect_);
+            } else if (t.is_mix) {
+                if (local_mix.empty()) {
+                    local_mix.resize(pixels() * 4, 0);
+                }
+                draw_item(
+                    item, local_mix.data(), target_kind::add, key(local_key), key(layer_key), width_, height_, aspect_);
+                local_key.clear();
+            } else {
+                if (!local_mix.empty()) {
+                    draw_buffer(local_mix, target, width_, height_);
+                    local_mix.clear();
+                }
+                draw_item(item, target, target_kind::over, key(local_key), key(layer_key), width_, height_, aspect_);
+                local_key.clear();
+            }
+        }
+
+        if (!local_mix.empty()) {
+            draw_buffer(local_mix, target, width_, height_);
+        }
+
+        layer_key = std::move(local_key);
+    }
+};
+
+} // namespace
+
+struct image_mixer::impl
+    : public core::frame_factory
+    , public std::enable_shared_from_this<impl>
+{
+    const int                          channel_id_;
+    std::vector<core::image_transform> transform_stack_;
+    std::vector<layer>                 layers_; // layer/stream/items
+    std::vector<layer*>                layer_stack_;
+    int                                items_        = 0;
+    int                                culled_items_ = 0;
+    core::image_mixer::render_stats    stats_;
+
+    // Targets are reused once the frames that were rendered to them are released.
+    std::mutex                                              pool_mutex_;
+    std::vector<std::shared_ptr<std::vector<std::uint8_t>>> pool_;
+
+    executor executor_;
+
+  public:
+    explicit impl(int channel_id)
+        : channel_id_(channel_id)
+        , transform_stack_(1)
+        , executor_(L"cpu image mixer " + std::to_wstring(channel_id))
+    {
+        CASPAR_LOG(info) << L"Initialized CPU Image Mixer for channel " << channel_id;
+    }
+
+    void push(const core::frame_transform& transform)
+    {
+        auto previous_layer_depth = transform_stack_.back().layer_depth;
+        transform_stack_.push_back(transform_stack_.back() * transform.image_transform);
+        auto new_layer_depth = transform_stack_.back().layer_depth;
+
+        if (previous_layer_depth < new_layer_depth) {
+            layer new_layer(transform_stack_.back().blend_mode);
+
+            if (layer_stack_.empty()) {
+                layers_.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layers_.back());
+            } else {
+                layer_stack_.back()->sublayers.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layer_stack_.back()->sublayers.back());
+            }
+        }
+    }
+
+    void visit(const core::const_frame& frame)
+    {
+        const auto& desc = frame.pixel_format_desc();
+        if (desc.format == core::pixel_format::invalid || desc.planes.empty()) {
+            return;
+        }
+
+        ++items_;
+
+        item item;
+        item.pix_desc  = desc;
+        item.transform = transform_stack_.back();
+
+        const auto& t = item.transform;
+        if (!t.is_key && (t.opacity < epsilon || t.fill_scale[0] == 0.0 || t.fill_scale[1] == 0.0)) {
+            ++culled_items_;
+            return;
+        }
+
+        if (!is_supported(desc)) {
+            log_unsupported(L"Pixel format " + std::to_wstring(static_cast<int>(desc.format)));
+            return;
+        }
+        if (frame.geometry() != core::frame_geometry::get_default()) {
+            log_unsupported(L"Custom geometry");
+        }
+        if (t.field_mode != core::field_mode::progressive) {
+            log_unsupported(L"Deinterlacing");
+        }
+        if (t.chroma.enable) {
+            log_unsupported(L"Chroma key");
+        }
+
+        // Frames which are shown more than once, e.g. stills and paused clips, are only converted the first time.
+        auto memo  = frame.memoize(this, [&]() -> boost::any { return decode(frame); });
+        item.image = boost::any_cast<std::shared_ptr<const decoded_image>>(memo);
+
+        layer_stack_.back()->items.push_back(std::move(item));
+    }
+
+    void pop()
+    {
+        transform_stack_.pop_back();
+        layer_stack_.resize(transform_stack_.back().layer_depth);
+    }
+
+    std::shared_ptr<std::vector<std::uint8_t>> get_target(std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (auto& buffer : pool_) {
+            if (buffer.use_count() == 1 && buffer->size() == size) {
+                return buffer;
+            }
+        }
+        pool_.erase(std::remove_if(pool_.begin(),
+                                   pool_.end(),
+                                   [](const std::shared_ptr<std::vector<std::uint8_t>>& buffer) {
+                                       return buffer.use_count() == 1;
+                                   }),
+                    pool_.end());
+        pool_.push_back(std::make_shared<std::vector<std::uint8_t>>(size));
+        return pool_.back();
+    }
+
+    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
+    {
+        auto layers = std::move(layers_);
+        layers_.clear();
+
+        stats_.items        = items_;
+        stats_.culled_items = culled_items_;
+        items_              = 0;
+        culled_items_       = 0;
+
+        if (layers.empty()) {
+            static const std::vector<uint8_t> buffer(4096 * 4096 * 4, 0);
+            return make_ready_future(array<const std::uint8_t>(buffer.data(), format_desc.size, true));
+        }
+
+        auto self = shared_from_this();
+        return executor_.begin_invoke([self, layers = std::move(layers), format_desc]() mutable {
+            auto target = self->get_target(format_desc.size);
+            std::fill(target->begin(), target->end(), static_cast<std::uint8_t>(0));
+
+            image_renderer(format_desc).draw(target->data(), layers);
+
+            return array<const std::uint8_t>(target->data(), target->size(), std::move(target));
+        });
+    }
+
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes) {
+            image_data.push_back(array<std::uint8_t>(plane.size));
+        }
+        return core::mutable_frame(tag, std::move(image_data), array<int32_t>{}, desc);
+    }
+
+    // The image of previous is copied, so that only the dirty regions need to be written.
+    core::mutable_frame create_frame(const void*                      tag,
+                                     const core::pixel_format_desc&   desc,
+                                     const core::const_frame&         previous,
+                                     std::vector<core::image_region>& dirty) override
+    {
+        auto frame = create_frame(tag, desc);
+
+        if (!previous || previous.pixel_format_desc() != desc) {
+            dirty.clear();
+            for (auto& plane : desc.planes) {
+                dirty.push_back(core::image_region{0, 0, plane.width, plane.height});
+            }
+            return frame;
+        }
+
+        for (std::size_t n = 0; n < desc.planes.size(); ++n) {
+            std::memcpy(frame.image_data(n).data(), previous.image_data(n).data(), desc.planes[n].size);
+        }
+
+        const auto&                     plane = desc.planes[0];
+        std::vector<core::image_region> regions;
+        for (auto region : dirty) {
+            const auto x0 = std::max(region.x, 0);
+            const auto y0 = std::max(region.y, 0);
+            const auto x1 = std::min(region.x + region.width, plane.width);
+            const auto y1 = std::min(region.y + region.height, plane.height);
+            if (x1 > x0 && y1 > y0) {
+                regions.push_back(core::image_region{x0, y0, x1 - x0, y1 - y0});
+            }
+        }
+        dirty = std::move(regions);
+
+        return frame;
+    }
+
+#ifdef WIN32
+    core::const_frame import_d3d_texture(const void*                                tag,
+                                         const std::shared_ptr<d3d::d3d_texture2d>& d3d_texture) override
+    {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("d3d textures need the OpenGL image mixer."));
+    }
+#endif
+};
+
+image_mixer::image_mixer(int channel_id)
+    : impl_(std::make_shared<impl>(channel_id))
+{
+}
+image_mixer::~image_mixer() {}
+void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
+void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
+void image_mixer::pop() { impl_->pop(); }
+std::future<array<const std::uint8_t>> image_mixer::operator()(const core::video_format_desc& format_desc)
+{
+    return impl_->render(format_desc);
+}
+std::vector<std::future<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& formats)
+{
+    if (!formats.empty()) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported conversion format."));
+    }
+    std::vector<std::future<array<const std::uint8_t>>> result;
+    result.push_back(impl_->render(format_desc));
+    return result;
+}
+std::vector<std::future<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc&              format_desc,
+                        const std::vector<core::pixel_format_desc>& formats,
+                        bool                                        readback,
+                        boost::any&                                 texture)
+{
+    return (*this)(format_desc, formats);
+}
+core::image_mixer::render_stats image_mixer::stats() const { return impl_->stats_; }
+bool image_mixer::is_convertible(const core::pixel_format_desc& desc) const { return false; }
+core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
+{
+    return impl_->create_frame(tag, desc);
+}
+core::mutable_frame image_mixer::create_frame(const void*                      tag,
+                                              const core::pixel_format_desc&   desc,
+                                              const core::const_frame&         previous,
+                                              std::vector<core::image_region>& dirty)
+{
+    return impl_->create_frame(tag, desc, previous, dirty);
+}
+
+#ifdef WIN32
+core::const_frame image_mixer::import_d3d_texture(const void*                                tag,
+                                                  const std::shared_ptr<d3d::d3d_texture2d>& d3d_texture)
+{
+    return impl_->import_d3d_texture(tag, d3d_texture);
+}
+#endif
+}}} // namespace caspar::accelerator::cpu
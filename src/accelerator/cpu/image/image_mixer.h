@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/array.h>
+#include <common/memory.h>
+
+#include <core/frame/frame.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/video_format.h>
+
+#include <future>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// Mixes on the cpu, for servers without an OpenGL 4.5 device. Frames are drawn with their opacity, fill, crop, clip,
+// rotation, keys and mixes, in bands of rows in parallel, in 8 bit bgra with premultiplied alpha. Blend modes other
+// than normal, levels, contrast, saturation, brightness, chroma keys, perspective, custom geometry, deinterlacing
+// and block compressed and v210 frames are left to the gpu mixer, such items are drawn without them or, for the
+// pixel formats, not at all. Rendered frames can't be converted to other formats.
+class image_mixer final : public core::image_mixer
+{
+  public:
+    explicit image_mixer(int channel_id);
+    image_mixer(const image_mixer&) = delete;
+
+    ~image_mixer();
+
+    image_mixer& operator=(const image_mixer&) = delete;
+
+    std::future<array<const std::uint8_t>> operator()(const core::video_format_desc& format_desc) override;
+    std::vector<std::future<array<const std::uint8_t>>>
+                        operator()(const core::video_format_desc&              format_desc,
+                                   const std::vector<core::pixel_format_desc>& formats) override;
+    std::vector<std::future<array<const std::uint8_t>>>
+                        operator()(const core::video_format_desc&              format_desc,
+                                   const std::vector<core::pixel_format_desc>& formats,
+                                   bool                                        readback,
+                                   boost::any&                                 texture) override;
+    bool                is_convertible(const core::pixel_format_desc& desc) const override;
+    render_stats        stats() const override;
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    core::mutable_frame create_frame(const void*                      tag,
+                                     const core::pixel_format_desc&   desc,
+                                     const core::const_frame&         previous,
+                                     std::vector<core::image_region>& dirty) override;
+#ifdef WIN32
+    core::const_frame import_d3d_texture(const void*                                tag,
+                                         const std::shared_ptr<d3d::d3d_texture2d>& d3d_texture) override;
+#endif
+
+    // core::image_mixer
+
+    void push(const core::frame_transform& frame) override;
+    void visit(const core::const_frame& frame) override;
+    void pop() override;
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::cpu
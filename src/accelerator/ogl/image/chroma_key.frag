@@ -0,0 +1,187 @@
+#version 450
+in vec4 TexCoord;
+in vec4 TexCoord2;
+out vec4 fragColor;
+
+// The passes of chroma_keyer, which keys a decoded bgra image. The colours are keyed as they are stored, in the
+// same order as the chroma key of the image shader did.
+const int lut_pass     = 0; // the matte of every colour, into the lookup texture
+const int matte_pass   = 1; // the matte of the image at half its size
+const int compose_pass = 2; // the image with its spill suppressed, premultiplied by the upsampled matte
+
+uniform int			pass;
+uniform bool		use_lut;
+
+uniform sampler2D	source;
+uniform sampler2D	matte;
+uniform sampler2D	lut;
+
+uniform bool		chroma_show_mask;
+uniform float		chroma_target_hue;
+uniform float		chroma_hue_width;
+uniform float		chroma_min_saturation;
+uniform float		chroma_min_brightness;
+uniform float		chroma_softness;
+uniform float		chroma_spill_suppress;
+uniform float		chroma_spill_suppress_saturation;
+
+// The lookup texture holds 64 levels of each component, as 8 by 8 tiles of 64 by 64 red and green levels, one tile
+// per level of blue.
+const float lut_levels = 64.0;
+const float lut_tiles  = 8.0;
+
+// Chroma keying
+// Author: Tim Eves <timseves@googlemail.com>
+//
+// This implements the Chroma key algorithm described in the paper:
+//      'Software Chroma Keying in an Imersive Virtual Environment'
+//      by F. van den Bergh & V. Lalioti
+// but as a pixel shader algorithm.
+//
+
+// This allows us to implement the paper's alphaMap curve in software
+// rather than a largeish array
+float alpha_map(float d)
+{
+    return 1.0 - smoothstep(1.0, chroma_softness, d);
+}
+
+// http://stackoverflow.com/questions/15095909/from-rgb-to-hsv-in-opengl-glsl
+vec3 rgb2hsv(vec3 c)
+{
+    vec4 K = vec4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
+    vec4 p = mix(vec4(c.bg, K.wz), vec4(c.gb, K.xy), step(c.b, c.g));
+    vec4 q = mix(vec4(p.xyw, c.r), vec4(c.r, p.yzx), step(p.x, c.r));
+
+    float d = q.x - min(q.w, q.y);
+    float e = 1.0e-10;
+    return vec3(abs(q.z + (q.w - q.y) / (6.0 * d + e)), d / (q.x + e), q.x);
+}
+
+// From the same page
+vec3 hsv2rgb(vec3 c)
+{
+    vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
+    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
+    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
+}
+
+float AngleDiff(float angle1, float angle2)
+{
+    return 0.5 - abs(abs(angle1 - angle2) - 0.5);
+}
+
+float AngleDiffDirectional(float angle1, float angle2)
+{
+    float diff = angle1 - angle2;
+
+    return diff < -0.5
+            ? diff + 1.0
+            : (diff > 0.5 ? diff - 1.0 : diff);
+}
+
+float Distance(float actual, float target)
+{
+    return min(0.0, target - actual);
+}
+
+float ColorDistance(vec3 hsv)
+{
+    float hueDiff					= AngleDiff(hsv.x, chroma_target_hue) * 2;
+    float saturationDiff			= Distance(hsv.y, chroma_min_saturation);
+    float brightnessDiff			= Distance(hsv.z, chroma_min_brightness);
+
+    float saturationBrightnessScore	= max(brightnessDiff, saturationDiff);
+    float hueScore					= hueDiff - chroma_hue_width;
+
+    return -hueScore * saturationBrightnessScore;
+}
+
+vec3 supress_spill(vec3 c)
+{
+    float hue		= c.x;
+    float diff		= AngleDiffDirectional(hue, chroma_target_hue);
+    float distance	= abs(diff) / chroma_spill_suppress;
+
+    if (distance < 1)
+    {
+        c.x = diff < 0
+                ? chroma_target_hue - chroma_spill_suppress
+                : chroma_target_hue + chroma_spill_suppress;
+        c.y *= min(1.0, distance + chroma_spill_suppress_saturation);
+    }
+
+    return c;
+}
+
+float get_alpha(vec3 rgb)
+{
+    return alpha_map(ColorDistance(rgb2hsv(rgb)) * -2.0 + 1.0);
+}
+
+vec2 get_lut_coords(vec2 rg, float tile)
+{
+    vec2 cell = vec2(mod(tile, lut_tiles), floor(tile / lut_tiles));
+    return (cell * lut_levels + rg * (lut_levels - 1.0) + 0.5) / (lut_levels * lut_tiles);
+}
+
+// Red and green are interpolated by the sampler, blue between the two closest tiles.
+float get_lut_alpha(vec3 rgb)
+{
+    float blue  = clamp(rgb.b, 0.0, 1.0) * (lut_levels - 1.0);
+    float tile0 = floor(blue);
+    float tile1 = min(tile0 + 1.0, lut_levels - 1.0);
+    vec2  rg    = clamp(rgb.rg, 0.0, 1.0);
+
+    return mix(texture(lut, get_lut_coords(rg, tile0)).r, texture(lut, get_lut_coords(rg, tile1)).r, blue - tile0);
+}
+
+// Joint bilateral upsampling: each of the four closest matte texels is weighted by its distance and by how much
+// the image it was keyed from looks like the pixel, so that edges stay where the pixels change.
+float get_upsampled_alpha(vec3 rgb)
+{
+    vec2 size = vec2(textureSize(matte, 0));
+    vec2 pos  = TexCoord.st * size - 0.5;
+    vec2 base = floor(pos);
+    vec2 f    = pos - base;
+
+    float sum    = 0.0;
+    float weight = 0.0;
+    float linear = 0.0;
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            vec2  offset   = vec2(x, y);
+            vec2  coords   = (base + offset + 0.5) / size;
+            vec2  distance = mix(1.0 - f, f, offset);
+            float alpha    = texture(matte, coords).r;
+            // Sampled at the centre of a matte texel the source averages the pixels it was keyed from.
+            vec3  guide    = texture(source, coords).rgb;
+            vec3  d        = guide - rgb;
+            float w        = distance.x * distance.y * exp(-dot(d, d) * 50.0);
+
+            sum    += alpha * w;
+            weight += w;
+            linear += alpha * distance.x * distance.y;
+        }
+    }
+    return weight > 1.0e-4 ? sum / weight : linear;
+}
+
+void main()
+{
+    if (pass == lut_pass) {
+        vec2  texel = floor(TexCoord.st * lut_levels * lut_tiles);
+        vec2  cell  = floor(texel / lut_levels);
+        vec2  rg    = (texel - cell * lut_levels) / (lut_levels - 1.0);
+        float b     = (cell.y * lut_tiles + cell.x) / (lut_levels - 1.0);
+        fragColor   = vec4(get_alpha(vec3(rg, b)), 0.0, 0.0, 1.0);
+    } else if (pass == matte_pass) {
+        vec3 rgb  = texture(source, TexCoord.st).rgb;
+        fragColor = vec4(use_lut ? get_lut_alpha(rgb) : get_alpha(rgb), 0.0, 0.0, 1.0);
+    } else {
+        vec3  rgb        = texture(source, TexCoord.st).rgb;
+        float alpha      = get_upsampled_alpha(rgb);
+        vec4  suppressed = vec4(hsv2rgb(supress_spill(rgb2hsv(rgb))), 1.0) * alpha;
+        fragColor        = chroma_show_mask ? vec4(alpha, alpha, alpha, 1.0) : suppressed;
+    }
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "chroma_keyer.h"
+
+#include "image_shader.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/env.h>
+#include <common/gl/gl_check.h>
+
+#include <core/frame/geometry.h>
+
+#include <GL/glew.h>
+
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+enum class pass
+{
+    lut = 0,
+    matte,
+    compose
+};
+
+// See the lookup texture of chroma_key.frag.
+const int lut_size = 512;
+
+} // namespace
+
+struct chroma_keyer::impl
+{
+    spl::shared_ptr<device> ogl_;
+    spl::shared_ptr<shader> shader_;
+    GLuint                  vao_;
+    GLuint                  vbo_;
+
+    const bool               use_lut_ = env::properties().get(L"configuration.ogl.chroma-lut", false);
+    std::shared_ptr<texture> lut_;
+    core::chroma             lut_chroma_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+        , shader_(ogl_->dispatch_sync([&] { return get_chroma_key_shader(ogl); }))
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glGenVertexArrays(1, &vao_));
+            GL(glGenBuffers(1, &vbo_));
+
+            std::vector<core::frame_geometry::coord> coords{{0.0, 0.0, 0.0, 0.0},
+                                                            {1.0, 0.0, 1.0, 0.0},
+                                                            {1.0, 1.0, 1.0, 1.0},
+                                                            {0.0, 0.0, 0.0, 0.0},
+                                                            {1.0, 1.0, 1.0, 1.0},
+                                                            {0.0, 1.0, 0.0, 1.0}};
+
+            GL(glBindVertexArray(vao_));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+            GL(glBufferData(GL_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords.size(),
+                            coords.data(),
+                            GL_STATIC_DRAW));
+
+            auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+
+            // See the attribute locations of convert.vert.
+            GL(glEnableVertexAttribArray(0));
+            GL(glEnableVertexAttribArray(1));
+            GL(glVertexAttribPointer(0, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+            GL(glVertexAttribPointer(1, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+
+            GL(glBindVertexArray(0));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glDeleteVertexArrays(1, &vao_));
+            GL(glDeleteBuffers(1, &vbo_));
+        });
+    }
+
+    void draw(pass pass, texture& target)
+    {
+        shader_->set("pass", static_cast<int>(pass));
+
+        GL(glViewport(0, 0, target.width(), target.height()));
+        target.attach();
+
+        GL(glDrawArrays(GL_TRIANGLES, 0, 6));
+    }
+
+    std::shared_ptr<texture> key(const std::shared_ptr<texture>& source, const core::chroma& chroma)
+    {
+        shader_->use();
+        shader_->set("source", 0);
+        shader_->set("matte", 1);
+        shader_->set("lut", 2);
+        shader_->set("use_lut", use_lut_);
+
+        shader_->set("chroma_show_mask", chroma.show_mask);
+        shader_->set("chroma_target_hue", chroma.target_hue / 360.0);
+        shader_->set("chroma_hue_width", chroma.hue_width);
+        shader_->set("chroma_min_saturation", chroma.min_saturation);
+        shader_->set("chroma_min_brightness", chroma.min_brightness);
+        shader_->set("chroma_softness", 1.0 + chroma.softness);
+        shader_->set("chroma_spill_suppress", chroma.spill_suppress / 360.0);
+        shader_->set("chroma_spill_suppress_saturation", chroma.spill_suppress_saturation);
+
+        GL(glDisable(GL_BLEND));
+        GL(glDisable(GL_SCISSOR_TEST));
+        GL(glDisable(GL_DEPTH_TEST));
+
+        GL(glBindVertexArray(vao_));
+
+        // The lookup texture only changes with the key colour.
+        if (use_lut_ && (!lut_ || lut_chroma_ != chroma)) {
+            lut_        = ogl_->create_texture(lut_size, lut_size, 1);
+            lut_chroma_ = chroma;
+            draw(pass::lut, *lut_);
+        }
+        if (use_lut_) {
+            lut_->bind(2);
+        }
+
+        source->bind(0);
+
+        auto matte = ogl_->create_texture((source->width() + 1) / 2, (source->height() + 1) / 2, 1);
+        draw(pass::matte, *matte);
+
+        matte->bind(1);
+
+        auto result =
+            ogl_->create_texture(source->width(), source->height(), 4, source->depth(), source->half_float());
+        draw(pass::compose, *result);
+
+        GL(glBindVertexArray(0));
+
+        return result;
+    }
+};
+
+chroma_keyer::chroma_keyer(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+chroma_keyer::~chroma_keyer() {}
+std::shared_ptr<texture> chroma_keyer::key(const std::shared_ptr<texture>& source, const core::chroma& chroma)
+{
+    return impl_->key(source, chroma);
+}
+
+}}} // namespace caspar::accelerator::ogl
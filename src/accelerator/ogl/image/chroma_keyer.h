@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/frame_transform.h>
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Chroma keys images in passes of their own instead of in the image shader. The matte is computed at half the size
+// of the image, optionally from a lookup texture of every colour instead of from the hue, saturation and brightness
+// of each pixel, and is upsampled along the edges of the image when the spill is suppressed at full size.
+class chroma_keyer final
+{
+    chroma_keyer(const chroma_keyer&);
+    chroma_keyer& operator=(const chroma_keyer&);
+
+  public:
+    explicit chroma_keyer(const spl::shared_ptr<class device>& ogl);
+    ~chroma_keyer();
+
+    // Returns source, a bgra image, keyed and premultiplied by its matte. Must be called on the device thread.
+    std::shared_ptr<class texture> key(const std::shared_ptr<class texture>& source, const core::chroma& chroma);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
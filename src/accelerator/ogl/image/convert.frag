@@ -0,0 +1,114 @@
+#version 450
+in vec4 TexCoord;
+in vec4 TexCoord2;
+out vec4 fragColor;
+
+uniform sampler2D	source;
+uniform int			component;
+uniform float		code_scale;
+uniform float		code_max;
+uniform float		output_scale;
+uniform sampler2D	previous;
+uniform int			previous_line;
+
+// BT.709 limited range, see image_converter.h for the component numbering.
+
+float get_luma(vec3 rgb)
+{
+	return (16.0 + 219.0 * dot(rgb, vec3(0.2126, 0.7152, 0.0722))) * code_scale;
+}
+
+vec2 get_chroma(vec3 rgb)
+{
+	float cb = dot(rgb, vec3(-0.114572, -0.385428, 0.5));
+	float cr = dot(rgb, vec3(0.5, -0.454153, -0.045847));
+	return (128.0 + 224.0 * vec2(cb, cr)) * code_scale;
+}
+
+// Packed formats are written as 32 bit little endian words, read back in bgra order.
+vec4 pack_word(uint word)
+{
+	return vec4((word >> 16) & 255u, (word >> 8) & 255u, word & 255u, word >> 24) / 255.0;
+}
+
+vec4 get_pixel(int x)
+{
+	ivec2 size = textureSize(source, 0);
+	return texelFetch(source, ivec2(clamp(x, 0, size.x - 1), int(gl_FragCoord.y)), 0);
+}
+
+// Luma of pixel x and chroma of the pair of pixels starting at x, as integer codes.
+uint get_y(int x)
+{
+	return uint(floor(get_luma(get_pixel(x).rgb) + 0.5));
+}
+
+uvec2 get_cbcr(int x)
+{
+	vec3 rgb = (get_pixel(x).rgb + get_pixel(x + 1).rgb) * 0.5;
+	return uvec2(floor(get_chroma(rgb) + 0.5));
+}
+
+vec4 get_uyvy()
+{
+	int   x    = int(gl_FragCoord.x) * 2;
+	uvec2 cbcr = get_cbcr(x);
+	return pack_word(cbcr.x | (get_y(x) << 8) | (cbcr.y << 16) | (get_y(x + 1) << 24));
+}
+
+// Each group of four words holds six pixels: Cb0 Y0 Cr0, Y1 Cb2 Y2, Cr2 Y3 Cb4, Y4 Cr4 Y5.
+vec4 get_v210()
+{
+	int word = int(gl_FragCoord.x) % 4;
+	int x    = int(gl_FragCoord.x) / 4 * 6;
+
+	uint a, b, c;
+	if (word == 0) {
+		uvec2 cbcr = get_cbcr(x);
+		a = cbcr.x; b = get_y(x); c = cbcr.y;
+	} else if (word == 1) {
+		a = get_y(x + 1); b = get_cbcr(x + 2).x; c = get_y(x + 2);
+	} else if (word == 2) {
+		a = get_cbcr(x + 2).y; b = get_y(x + 3); c = get_cbcr(x + 4).x;
+	} else {
+		a = get_y(x + 4); b = get_cbcr(x + 4).y; c = get_y(x + 5);
+	}
+	return pack_word(a | (b << 10) | (c << 20));
+}
+
+void main()
+{
+	// Copies bgra texels, with the rows of every second line starting at previous_line taken from previous.
+	if (component == 8) {
+		ivec2 pos = ivec2(gl_FragCoord.xy);
+		fragColor = pos.y % 2 == previous_line ? texelFetch(previous, pos, 0) : texelFetch(source, pos, 0);
+		return;
+	}
+	if (component == 6) {
+		fragColor = get_uyvy();
+		return;
+	}
+	if (component == 7) {
+		fragColor = get_v210();
+		return;
+	}
+
+	vec4 rgba = texture(source, TexCoord.st);
+
+	// Chroma planes are smaller than the source, so linear filtering averages the pixels they cover.
+	vec4 code = vec4(0.0);
+	if (component == 0)
+		code.r = get_luma(rgba.rgb);
+	else if (component == 1)
+		code.r = get_chroma(rgba.rgb).x;
+	else if (component == 2)
+		code.r = get_chroma(rgba.rgb).y;
+	else if (component == 3)
+		code.r = rgba.a * code_max;
+	else if (component == 4)
+		code.rg = get_chroma(rgba.rgb);
+	else if (component == 5)
+		code = vec4(rgba.a * code_max);
+
+	fragColor = floor(code + 0.5) * output_scale;
+}
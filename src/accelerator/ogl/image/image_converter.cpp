@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image_converter.h"
+
+#include "image_shader.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/gl/gl_check.h>
+
+#include <core/frame/geometry.h>
+
+#include <GL/glew.h>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+int get_component(const core::pixel_format_desc& desc, int plane)
+{
+    if (desc.format == core::pixel_format::nv12) {
+        return plane == 0 ? 0 : 4;
+    }
+    switch (desc.format) {
+        case core::pixel_format::luma:
+            return 5;
+        case core::pixel_format::uyvy:
+            return plane == 0 ? 6 : 3;
+        case core::pixel_format::v210:
+            return 7;
+        case core::pixel_format::bgra:
+            return 8;
+        default:
+            return plane;
+    }
+}
+
+int get_stride(int component)
+{
+    switch (component) {
+        case 4:
+            return 2;
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+} // namespace
+
+struct image_converter::impl
+{
+    spl::shared_ptr<device> ogl_;
+    spl::shared_ptr<shader> shader_;
+    GLuint                  vao_;
+    GLuint                  vbo_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+        , shader_(ogl_->dispatch_sync([&] { return get_convert_shader(ogl); }))
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glGenVertexArrays(1, &vao_));
+            GL(glGenBuffers(1, &vbo_));
+
+            std::vector<core::frame_geometry::coord> coords{{0.0, 0.0, 0.0, 0.0},
+                                                            {1.0, 0.0, 1.0, 0.0},
+                                                            {1.0, 1.0, 1.0, 1.0},
+                                                            {0.0, 0.0, 0.0, 0.0},
+                                                            {1.0, 1.0, 1.0, 1.0},
+                                                            {0.0, 1.0, 0.0, 1.0}};
+
+            GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+            GL(glBufferData(GL_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords.size(),
+                            coords.data(),
+                            GL_STATIC_DRAW));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glDeleteVertexArrays(1, &vao_));
+            GL(glDeleteBuffers(1, &vbo_));
+        });
+    }
+
+    std::vector<std::shared_ptr<texture>> convert(const std::shared_ptr<texture>& source,
+                                                  const core::pixel_format_desc&  desc,
+                                                  const std::shared_ptr<texture>& previous)
+    {
+        std::vector<std::shared_ptr<texture>> result;
+
+        const auto woven = desc.woven_line >= 0 && previous && previous->width() == source->width() &&
+                           previous->height() == source->height();
+
+        shader_->use();
+        shader_->set("source", 0);
+        shader_->set("previous", 1);
+
+        GL(glDisable(GL_BLEND));
+        GL(glDisable(GL_SCISSOR_TEST));
+        GL(glDisable(GL_DEPTH_TEST));
+
+        GL(glBindVertexArray(vao_));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+
+        auto stride  = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+        auto vtx_loc = shader_->get_attrib_location("Position");
+        auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+
+        GL(glEnableVertexAttribArray(vtx_loc));
+        GL(glEnableVertexAttribArray(tex_loc));
+        GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+        GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+
+        // The fields are woven at the depth of the source before the planes are converted from them, except for
+        // bgra which is woven as it is copied.
+        auto input = source;
+        if (woven) {
+            previous->bind(1);
+            if (desc.format != core::pixel_format::bgra) {
+                input = ogl_->create_texture(source->width(), source->height(), 4, 1, source->half_float());
+
+                source->bind(0);
+                shader_->set("component", 8);
+                shader_->set("previous_line", desc.woven_line);
+
+                GL(glViewport(0, 0, input->width(), input->height()));
+                input->attach();
+
+                GL(glDrawArrays(GL_TRIANGLES, 0, 6));
+            }
+        }
+        input->bind(0);
+        shader_->set("previous_line", woven && desc.format == core::pixel_format::bgra ? desc.woven_line : -1);
+
+        for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+            const auto& plane = desc.planes[n];
+
+            auto target =
+                ogl_->create_texture(plane.width, plane.height, plane.stride, core::bytes_per_sample(plane.depth));
+
+            const auto ten_bit = plane.depth != core::color_depth::bit8 || desc.format == core::pixel_format::v210;
+
+            shader_->set("component", get_component(desc, n));
+            shader_->set("code_scale", ten_bit ? 4.0 : 1.0);
+            shader_->set("code_max", ten_bit ? 1023.0 : 255.0);
+            switch (plane.depth) {
+                case core::color_depth::bit8:
+                    shader_->set("output_scale", 1.0 / 255.0);
+                    break;
+                case core::color_depth::bit10:
+                    shader_->set("output_scale", 1.0 / 65535.0);
+                    break;
+                case core::color_depth::bit16:
+                    shader_->set("output_scale", 64.0 / 65535.0);
+                    break;
+            }
+
+            GL(glViewport(0, 0, plane.width, plane.height));
+            target->attach();
+
+            GL(glDrawArrays(GL_TRIANGLES, 0, 6));
+
+            result.push_back(std::move(target));
+        }
+
+        GL(glDisableVertexAttribArray(vtx_loc));
+        GL(glDisableVertexAttribArray(tex_loc));
+
+        GL(glBindVertexArray(0));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+        return result;
+    }
+};
+
+image_converter::image_converter(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+image_converter::~image_converter() {}
+
+bool image_converter::is_supported(const core::pixel_format_desc& desc)
+{
+    std::size_t nb_planes = 0;
+    switch (desc.format) {
+        case core::pixel_format::ycbcr:
+            nb_planes = 3;
+            break;
+        case core::pixel_format::ycbcra:
+            nb_planes = 4;
+            break;
+        case core::pixel_format::nv12:
+            nb_planes = 2;
+            break;
+        case core::pixel_format::luma:
+        case core::pixel_format::bgra:
+            nb_planes = 1;
+            break;
+        case core::pixel_format::uyvy:
+            // Optionally followed by an alpha plane, as in the uyva of ndi.
+            nb_planes = desc.planes.size() == 2 ? 2 : 1;
+            break;
+        case core::pixel_format::v210:
+            // Codes are packed into 8 bit texels.
+            if (desc.planes.size() != 1 || desc.planes[0].depth != core::color_depth::bit8) {
+                return false;
+            }
+            nb_planes = 1;
+            break;
+        default:
+            return false;
+    }
+
+    if (desc.planes.size() != nb_planes) {
+        return false;
+    }
+
+    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+        const auto& plane = desc.planes[n];
+        if (plane.width <= 0 || plane.height <= 0 || plane.stride != get_stride(get_component(desc, n))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::vector<std::shared_ptr<texture>> image_converter::convert(const std::shared_ptr<texture>& source,
+                                                               const core::pixel_format_desc&  desc,
+                                                               const std::shared_ptr<texture>& previous)
+{
+    return impl_->convert(source, desc, previous);
+}
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Converts rendered BGRA textures to planar YUV on the GPU, one draw per output plane. Supports ycbcr, ycbcra and
+// nv12 descriptions with any chroma subsampling and 8, 10 or 16 (P010 style) bit planes, as well as luma with a
+// single plane of stride 4, which is the key signal with alpha in every channel, and the packed uyvy and v210
+// formats of video cards. uyvy may be followed by an 8 bit alpha plane, as in the uyva of NDI. Plane components are
+// numbered 0 Y, 1 Cb, 2 Cr, 3 A, 4 interleaved CbCr, 5 key, 6 uyvy and 7 v210. bgra with a single plane of stride 4
+// is copied as component 8, which also weaves fields for descriptions with a woven_line.
+class image_converter final
+{
+    image_converter(const image_converter&);
+    image_converter& operator=(const image_converter&);
+
+  public:
+    explicit image_converter(const spl::shared_ptr<class device>& ogl);
+    ~image_converter();
+
+    static bool is_supported(const core::pixel_format_desc& desc);
+
+    // Must be called on the device thread. previous is the texture mixed at the tick before, which the fields of
+    // woven descriptions are taken from. Descriptions are converted unwoven without it.
+    std::vector<std::shared_ptr<class texture>> convert(const std::shared_ptr<class texture>& source,
+                                                        const core::pixel_format_desc&        desc,
+                                                        const std::shared_ptr<class texture>& previous = nullptr);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
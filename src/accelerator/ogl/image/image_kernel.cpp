@@ -20,6 +20,8 @@
  */
 #include "image_kernel.h"
 
+#include "chroma_keyer.h"
+
 #include "image_shader.h"
 
 #include "../util/device.h"
@@ -27,18 +29,25 @@
 #include "../util/texture.h"
 
 #include <common/assert.h>
+#include <common/env.h>
 #include <common/gl/gl_check.h>
 
 #include <core/frame/frame_transform.h>
 #include <core/frame/pixel_format.h>
 
 #include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -94,7 +103,7 @@ bool is_left_of_screen(double x) { return x < 0.0; }
 
 bool is_right_of_screen(double x) { return x > 1.0; }
 
-bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
+bool is_outside_screen(const std::array<core::frame_geometry::coord, 4>& coords)
 {
     auto x_coords =
         coords | boost::adaptors::transformed([](const core::frame_geometry::coord& c) { return c.vertex_x; });
@@ -106,126 +115,406 @@ bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
            boost::algorithm::all_of(y_coords, &is_above_screen) || boost::algorithm::all_of(y_coords, &is_below_screen);
 }
 
+// The scale an item is drawn at, as the number of target pixels per texel along the axis that is shrunk the least.
+double get_scale(const std::array<core::frame_geometry::coord, 4>& coords,
+                 const texture&                                     source,
+                 const texture&                                     target)
+{
+    auto vertex_x = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.vertex_x < b.vertex_x; });
+    auto vertex_y = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.vertex_y < b.vertex_y; });
+    auto texture_x = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.texture_x < b.texture_x; });
+    auto texture_y = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.texture_y < b.texture_y; });
+
+    auto texels_x = std::abs(texture_x.second->texture_x - texture_x.first->texture_x) * source.width();
+    auto texels_y = std::abs(texture_y.second->texture_y - texture_y.first->texture_y) * source.height();
+    if (texels_x <= 0.0 || texels_y <= 0.0) {
+        return 1.0;
+    }
+
+    auto pixels_x = (vertex_x.second->vertex_x - vertex_x.first->vertex_x) * target.width();
+    auto pixels_y = (vertex_y.second->vertex_y - vertex_y.first->vertex_y) * target.height();
+
+    return std::max(pixels_x / texels_x, pixels_y / texels_y);
+}
+
+// The transform of an item as shader.vert applies it, for the corners of its quad. Only used to cull items that are
+// off screen and to pick mipmaps, the vertices are transformed on the gpu.
+struct vertex_transform
+{
+    std::array<double, 2>                crop_ul;
+    std::array<double, 2>                crop_lr;
+    std::array<double, 2>                crop_scale;
+    std::array<std::array<double, 2>, 4> perspective;
+    std::array<double, 2>                anchor;
+    std::array<double, 2>                fill_scale;
+    std::array<double, 2>                fill_translation;
+    double                               angle;
+    double                               aspect_ratio;
+    bool                                 bottom_up;
+
+    core::frame_geometry::coord operator()(core::frame_geometry::coord coord, int corner) const
+    {
+        auto texture_x = std::min(std::max(coord.texture_x, crop_ul[0]), crop_lr[0]);
+        auto texture_y = std::min(std::max(coord.texture_y, crop_ul[1]), crop_lr[1]);
+        coord.vertex_x += (texture_x - coord.texture_x) * crop_scale[0];
+        coord.vertex_y += (texture_y - coord.texture_y) * crop_scale[1];
+        coord.texture_x = texture_x;
+        coord.texture_y = bottom_up ? 1.0 - texture_y : texture_y;
+
+        coord.vertex_x += perspective[corner][0];
+        coord.vertex_y += perspective[corner][1];
+
+        auto orig_x    = (coord.vertex_x - anchor[0]) * fill_scale[0];
+        auto orig_y    = (coord.vertex_y - anchor[1]) * fill_scale[1] / aspect_ratio;
+        coord.vertex_x = orig_x * std::cos(angle) - orig_y * std::sin(angle) + fill_translation[0];
+        coord.vertex_y = (orig_x * std::sin(angle) + orig_y * std::cos(angle)) * aspect_ratio + fill_translation[1];
+
+        return coord;
+    }
+};
+
+// Vertex units per texture unit of a quad, so that cropping its texture moves its vertices with it. The default
+// geometry maps them one to one.
+std::array<double, 2> get_crop_scale(const std::vector<core::frame_geometry::coord>& coords)
+{
+    auto vertex_x = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.vertex_x < b.vertex_x; });
+    auto vertex_y = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.vertex_y < b.vertex_y; });
+    auto texture_x = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.texture_x < b.texture_x; });
+    auto texture_y = std::minmax_element(
+        coords.begin(), coords.end(), [](const auto& a, const auto& b) { return a.texture_y < b.texture_y; });
+
+    auto scale = [](double vertices, double texels) { return texels > 0.0 ? vertices / texels : 1.0; };
+
+    return {{scale(vertex_x.second->vertex_x - vertex_x.first->vertex_x,
+                   texture_x.second->texture_x - texture_x.first->texture_x),
+             scale(vertex_y.second->vertex_y - vertex_y.first->vertex_y,
+                   texture_y.second->texture_y - texture_y.first->texture_y)}};
+}
+
+// The quad that bounds a mesh, in vertex and in texture space, in the corner order of a quad.
+std::array<core::frame_geometry::coord, 4> get_bounds(const std::vector<core::frame_geometry::coord>& coords)
+{
+    core::frame_geometry::coord min = coords.front();
+    core::frame_geometry::coord max = coords.front();
+    for (const auto& coord : coords) {
+        min.vertex_x  = std::min(min.vertex_x, coord.vertex_x);
+        min.vertex_y  = std::min(min.vertex_y, coord.vertex_y);
+        min.texture_x = std::min(min.texture_x, coord.texture_x);
+        min.texture_y = std::min(min.texture_y, coord.texture_y);
+        max.vertex_x  = std::max(max.vertex_x, coord.vertex_x);
+        max.vertex_y  = std::max(max.vertex_y, coord.vertex_y);
+        max.texture_x = std::max(max.texture_x, coord.texture_x);
+        max.texture_y = std::max(max.texture_y, coord.texture_y);
+    }
+
+    return {{{min.vertex_x, min.vertex_y, min.texture_x, min.texture_y},
+             {max.vertex_x, min.vertex_y, max.texture_x, min.texture_y},
+             {max.vertex_x, max.vertex_y, max.texture_x, max.texture_y},
+             {min.vertex_x, max.vertex_y, min.texture_x, max.texture_y}}};
+}
+
+// The quad's two triangles, drawn from the default geometry at vertex 0 or the item's own at vertex 4.
+const std::array<GLubyte, 6> QUAD_INDICES = {{0, 1, 2, 0, 2, 3}};
+
+const GLint CUSTOM_BASE_VERTEX = 4;
+
 struct image_kernel::impl
 {
-    spl::shared_ptr<device> ogl_;
-    spl::shared_ptr<shader> shader_;
-    GLuint                  vao_;
-    GLuint                  vbo_;
+    spl::shared_ptr<device>                                 ogl_;
+    std::map<image_shader_variant, std::shared_ptr<shader>> shaders_;
+    GLuint                                                  vao_;
+    GLuint                                                  vbo_;
+    GLuint                                                  ebo_;
+    GLuint                                                  mesh_vao_;
+    GLuint                                                  mesh_vbo_;
+    GLuint                                                  mesh_ebo_;
+
+    // Mipmaps of the textures that are still alive, so that a frame that is shown again, e.g. a multiview tile that
+    // is refreshed at a reduced rate, doesn't get its mipmaps generated again.
+    std::vector<std::pair<std::weak_ptr<texture>, std::shared_ptr<texture>>> mipmaps_;
+
+    // Keyed images of the textures that are still alive, with what they were keyed with.
+    struct keyed_image
+    {
+        std::weak_ptr<texture>   source;
+        core::field_mode         field_mode;
+        core::chroma             chroma;
+        std::shared_ptr<texture> image;
+    };
+
+    chroma_keyer             keyer_;
+    std::vector<keyed_image> keyed_;
 
     explicit impl(const spl::shared_ptr<device>& ogl)
         : ogl_(ogl)
-        , shader_(ogl_->dispatch_sync([&] { return get_image_shader(ogl); }))
+        , keyer_(ogl)
     {
         ogl_->dispatch_sync([&] {
+            // The vertex layout is the same for every draw, and every variant of the shader, so it is only set up
+            // once.
             GL(glGenVertexArrays(1, &vao_));
             GL(glGenBuffers(1, &vbo_));
+            GL(glGenBuffers(1, &ebo_));
+            GL(glGenVertexArrays(1, &mesh_vao_));
+            GL(glGenBuffers(1, &mesh_vbo_));
+            GL(glGenBuffers(1, &mesh_ebo_));
+
+            auto set_layout = [] {
+                auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+
+                // See the attribute locations of shader.vert.
+                GL(glEnableVertexAttribArray(0));
+                GL(glEnableVertexAttribArray(1));
+
+                GL(glVertexAttribPointer(0, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+                GL(glVertexAttribPointer(1, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+            };
+
+            GL(glBindVertexArray(vao_));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+            GL(glBufferData(GL_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord) * 8),
+                            nullptr,
+                            GL_DYNAMIC_DRAW));
+
+            // The default geometry, which almost every item is drawn with, is only uploaded once.
+            const auto& default_coords = core::frame_geometry::get_default().data();
+            GL(glBufferSubData(GL_ARRAY_BUFFER,
+                               0,
+                               static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord) * default_coords.size()),
+                               default_coords.data()));
+
+            GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_));
+            GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(QUAD_INDICES)),
+                            QUAD_INDICES.data(),
+                            GL_STATIC_DRAW));
+
+            set_layout();
+
+            // Meshes are uploaded whole for every draw, their buffers are sized then.
+            GL(glBindVertexArray(mesh_vao_));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo_));
+            GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_ebo_));
+
+            set_layout();
+
+            GL(glBindVertexArray(0));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
         });
     }
 
+    // Variants are compiled the first time they are drawn, which is when their texture units are assigned.
+    shader& get_shader(const image_shader_variant& variant)
+    {
+        auto it = shaders_.find(variant);
+        if (it == shaders_.end()) {
+            auto program = get_image_shader(ogl_, variant);
+
+            program->use();
+            program->set("plane[0]", texture_id::plane0);
+            program->set("plane[1]", texture_id::plane1);
+            program->set("plane[2]", texture_id::plane2);
+            program->set("plane[3]", texture_id::plane3);
+            program->set("local_key", texture_id::local_key);
+            program->set("layer_key", texture_id::layer_key);
+            program->set("background", texture_id::background);
+            program->set("mix_plane[0]", texture_id::mix_plane0);
+            program->set("mix_plane[1]", texture_id::mix_plane1);
+            program->set("mix_plane[2]", texture_id::mix_plane2);
+            program->set("mix_plane[3]", texture_id::mix_plane3);
+
+            it = shaders_.emplace(variant, std::move(program)).first;
+        }
+        return *it->second;
+    }
+
     ~impl()
     {
         ogl_->dispatch_sync([&] {
             GL(glDeleteVertexArrays(1, &vao_));
             GL(glDeleteBuffers(1, &vbo_));
+            GL(glDeleteBuffers(1, &ebo_));
+            GL(glDeleteVertexArrays(1, &mesh_vao_));
+            GL(glDeleteBuffers(1, &mesh_vbo_));
+            GL(glDeleteBuffers(1, &mesh_ebo_));
         });
     }
 
+    spl::shared_ptr<texture> get_mipmaps(const spl::shared_ptr<texture>& source)
+    {
+        mipmaps_.erase(std::remove_if(mipmaps_.begin(),
+                                      mipmaps_.end(),
+                                      [](const auto& p) { return p.first.expired(); }),
+                       mipmaps_.end());
+
+        std::shared_ptr<texture> key = source;
+        for (const auto& p : mipmaps_) {
+            if (!p.first.owner_before(key) && !key.owner_before(p.first)) {
+                return spl::make_shared_ptr(p.second);
+            }
+        }
+
+        auto mipmaps = ogl_->create_mipmaps(source);
+        mipmaps_.emplace_back(key, mipmaps);
+        return spl::make_shared_ptr(mipmaps);
+    }
+
+    // Returns the image of textures decoded to bgra and keyed, the same one for as long as the textures are shown.
+    std::shared_ptr<texture> get_keyed(const std::vector<spl::shared_ptr<texture>>& textures,
+                                       const core::pixel_format_desc&              pix_desc,
+                                       core::field_mode                            field_mode,
+                                       const core::chroma&                         chroma,
+                                       const texture&                              background)
+    {
+        keyed_.erase(std::remove_if(keyed_.begin(), keyed_.end(), [](const auto& k) { return k.source.expired(); }),
+                     keyed_.end());
+
+        std::shared_ptr<texture> key = textures.at(0);
+        for (const auto& k : keyed_) {
+            if (!k.source.owner_before(key) && !key.owner_before(k.source) && k.field_mode == field_mode &&
+                k.chroma == chroma) {
+                return k.image;
+            }
+        }
+
+        // Decoded, and deinterlaced, as the item would be drawn over nothing at the size of its image.
+        const auto& plane  = pix_desc.planes.at(0);
+        auto        width  = plane.width;
+        if (pix_desc.format == core::pixel_format::uyvy) {
+            width = plane.width * 2;
+        } else if (pix_desc.format == core::pixel_format::v210) {
+            width = plane.width / 4 * 6;
+        }
+
+        draw_params decode;
+        decode.pix_desc             = pix_desc;
+        decode.textures             = textures;
+        decode.transform.field_mode = field_mode;
+        decode.background =
+            ogl_->create_texture(width, plane.height, 4, background.depth(), background.half_float());
+        draw(decode);
+
+        auto image = keyer_.key(decode.background, chroma);
+        keyed_.push_back({key, field_mode, chroma, image});
+        return image;
+    }
+
     void draw(draw_params params)
     {
         static const double epsilon = 0.001;
 
         CASPAR_ASSERT(params.pix_desc.planes.size() == params.textures.size());
+        CASPAR_ASSERT(params.mix_textures.empty() || params.mix_textures.size() == params.textures.size());
 
         if (params.textures.empty() || !params.background) {
             return;
         }
 
-        if (params.transform.opacity < epsilon) {
+        if (params.transform.opacity < epsilon && (params.mix_textures.empty() || params.mix_opacity < epsilon)) {
             return;
         }
 
-        auto coords = params.geometry.data();
+        // Keyed items are drawn from their image keyed in passes of its own, instead of keying every fragment they
+        // cover in the image shader.
+        static const bool chroma_pass = env::properties().get(L"configuration.ogl.chroma-pass", true);
+        if (chroma_pass && params.transform.chroma.enable) {
+            const auto& chroma = params.transform.chroma;
+            const auto  field  = params.transform.field_mode;
 
-        if (coords.empty()) {
-            return;
+            const auto& target = *params.background;
+
+            auto image = get_keyed(params.textures, params.pix_desc, field, chroma, target);
+            if (!params.mix_textures.empty()) {
+                params.mix_textures = {
+                    spl::make_shared_ptr(get_keyed(params.mix_textures, params.pix_desc, field, chroma, target))};
+            }
+            params.textures = {spl::make_shared_ptr(image)};
+
+            params.pix_desc = core::pixel_format_desc(core::pixel_format::bgra);
+            params.pix_desc.planes.push_back(core::pixel_format_desc::plane(image->width(), image->height(), 4));
+            params.transform.field_mode    = core::field_mode::progressive;
+            params.transform.chroma.enable = false;
         }
 
-        // Calculate transforms
-        auto f_p = params.transform.fill_translation;
-        auto f_s = params.transform.fill_scale;
+        const auto& coords  = params.geometry.data();
+        const auto  is_mesh = params.geometry.type() == core::frame_geometry::geometry_type::triangles;
 
-        bool is_default_geometry = boost::equal(coords, core::frame_geometry::get_default().data());
-        auto aspect              = params.aspect_ratio;
-        auto angle               = params.transform.angle;
-        auto anchor              = params.transform.anchor;
-        auto crop                = params.transform.crop;
-        auto pers                = params.transform.perspective;
+        if (is_mesh ? params.geometry.indices().empty() : coords.size() != 4) {
+            return;
+        }
+
+        const auto is_default_geometry = params.geometry == core::frame_geometry::get_default();
+
+        vertex_transform transform;
+        transform.crop_ul          = params.transform.crop.ul;
+        transform.crop_lr          = params.transform.crop.lr;
+        transform.crop_scale       = is_default_geometry ? std::array<double, 2>{{1.0, 1.0}} : get_crop_scale(coords);
+        transform.anchor           = params.transform.anchor;
+        transform.fill_scale       = params.transform.fill_scale;
+        transform.fill_translation = params.transform.fill_translation;
+        transform.angle            = params.transform.angle;
+        transform.aspect_ratio     = params.aspect_ratio;
+        transform.bottom_up        = params.pix_desc.bottom_up;
+
+        // Corner offsets, the perspective of the transform holds the corners themselves. A mesh carries its own warp,
+        // so it isn't corner pinned.
+        auto pers = params.transform.perspective;
         pers.ur[0] -= 1.0;
         pers.lr[0] -= 1.0;
         pers.lr[1] -= 1.0;
         pers.ll[1] -= 1.0;
-        std::vector<std::array<double, 2>> pers_corners = {pers.ul, pers.ur, pers.lr, pers.ll};
-
-        auto do_crop = [&](core::frame_geometry::coord& coord) {
-            if (!is_default_geometry) {
-                // TODO implement support for non-default geometry.
-                return;
-            }
-
-            coord.vertex_x  = std::max(coord.vertex_x, crop.ul[0]);
-            coord.vertex_x  = std::min(coord.vertex_x, crop.lr[0]);
-            coord.vertex_y  = std::max(coord.vertex_y, crop.ul[1]);
-            coord.vertex_y  = std::min(coord.vertex_y, crop.lr[1]);
-            coord.texture_x = std::max(coord.texture_x, crop.ul[0]);
-            coord.texture_x = std::min(coord.texture_x, crop.lr[0]);
-            coord.texture_y = std::max(coord.texture_y, crop.ul[1]);
-            coord.texture_y = std::min(coord.texture_y, crop.lr[1]);
-        };
-        auto do_perspective = [=](core::frame_geometry::coord& coord, const std::array<double, 2>& pers_corner) {
-            if (!is_default_geometry) {
-                // TODO implement support for non-default geometry.
-                return;
-            }
+        transform.perspective = {{pers.ul, pers.ur, pers.lr, pers.ll}};
+        if (is_mesh) {
+            transform.perspective = {};
+        }
 
-            coord.vertex_x += pers_corner[0];
-            coord.vertex_y += pers_corner[1];
-        };
-        auto rotate = [&](core::frame_geometry::coord& coord) {
-            auto orig_x    = (coord.vertex_x - anchor[0]) * f_s[0];
-            auto orig_y    = (coord.vertex_y - anchor[1]) * f_s[1] / aspect;
-            coord.vertex_x = orig_x * std::cos(angle) - orig_y * std::sin(angle);
-            coord.vertex_y = orig_x * std::sin(angle) + orig_y * std::cos(angle);
-            coord.vertex_y *= aspect;
-        };
-        auto move = [&](core::frame_geometry::coord& coord) {
-            coord.vertex_x += f_p[0];
-            coord.vertex_y += f_p[1];
-        };
-
-        int corner = 0;
-        for (auto& coord : coords) {
-            do_crop(coord);
-            do_perspective(coord, pers_corners.at(corner));
-            rotate(coord);
-            move(coord);
-
-            if (++corner == 4) {
-                corner = 0;
-            }
+        // A mesh is culled by, and picks mipmaps for, the quad that bounds it.
+        auto corners = is_mesh ? get_bounds(coords) : std::array<core::frame_geometry::coord, 4>{};
+        for (auto n = 0; n < 4; ++n) {
+            corners[n] = transform(is_mesh ? corners[n] : coords[n], n);
         }
 
         // Skip drawing if all the coordinates will be outside the screen.
-        if (is_outside_screen(coords)) {
+        if (is_outside_screen(corners)) {
             return;
         }
 
+        // Items shrunk to less than half their size, e.g. in multiview grids, are sampled from mipmaps since a single
+        // bilinear tap per pixel would alias. Packed formats are read texel by texel and can't be filtered, block
+        // compressed ones can't be copied into a texture with mipmaps.
+        static const bool   mipmaps          = env::properties().get(L"configuration.ogl.mipmaps", true);
+        static const double mipmap_threshold = 0.5;
+
+        const auto is_packed =
+            params.pix_desc.format == core::pixel_format::uyvy || params.pix_desc.format == core::pixel_format::v210;
+        if (mipmaps && !is_packed && !core::is_block_compressed(params.pix_desc.format) &&
+            get_scale(corners, *params.textures[0], *params.background) < mipmap_threshold) {
+            for (auto& tex : params.textures) {
+                tex = get_mipmaps(tex);
+            }
+            for (auto& tex : params.mix_textures) {
+                tex = get_mipmaps(tex);
+            }
+        }
+
         // Bind textures
 
         for (int n = 0; n < params.textures.size(); ++n) {
             params.textures[n]->bind(n);
         }
 
+        for (int n = 0; n < params.mix_textures.size(); ++n) {
+            params.mix_textures[n]->bind(static_cast<int>(texture_id::mix_plane0) + n);
+        }
+
         if (params.local_key) {
             params.local_key->bind(static_cast<int>(texture_id::local_key));
         }
@@ -236,71 +525,83 @@ struct image_kernel::impl
 
         // Setup shader
 
-        shader_->use();
-
-        shader_->set("plane[0]", texture_id::plane0);
-        shader_->set("plane[1]", texture_id::plane1);
-        shader_->set("plane[2]", texture_id::plane2);
-        shader_->set("plane[3]", texture_id::plane3);
-        shader_->set("local_key", texture_id::local_key);
-        shader_->set("layer_key", texture_id::layer_key);
-        shader_->set("is_hd", params.pix_desc.planes.at(0).height > 700 ? 1 : 0);
-        shader_->set("has_local_key", static_cast<bool>(params.local_key));
-        shader_->set("has_layer_key", static_cast<bool>(params.layer_key));
-        shader_->set("pixel_format", params.pix_desc.format);
-        shader_->set("opacity", params.transform.is_key ? 1.0 : params.transform.opacity);
-
-        if (params.transform.chroma.enable) {
-            shader_->set("chroma", true);
-            shader_->set("chroma_show_mask", params.transform.chroma.show_mask);
-            shader_->set("chroma_target_hue", params.transform.chroma.target_hue / 360.0);
-            shader_->set("chroma_hue_width", params.transform.chroma.hue_width);
-            shader_->set("chroma_min_saturation", params.transform.chroma.min_saturation);
-            shader_->set("chroma_min_brightness", params.transform.chroma.min_brightness);
-            shader_->set("chroma_softness", 1.0 + params.transform.chroma.softness);
-            shader_->set("chroma_spill_suppress", params.transform.chroma.spill_suppress / 360.0);
-            shader_->set("chroma_spill_suppress_saturation", params.transform.chroma.spill_suppress_saturation);
-        } else {
-            shader_->set("chroma", false);
-        }
-
-        // Setup blend_func
-
         if (params.transform.is_key) {
             params.blend_mode = core::blend_mode::normal;
         }
 
+        const auto& levels = params.transform.levels;
+
+        const auto has_levels = levels.min_input > epsilon || levels.max_input < 1.0 - epsilon ||
+                                levels.min_output > epsilon || levels.max_output < 1.0 - epsilon ||
+                                std::abs(levels.gamma - 1.0) > epsilon;
+        const auto has_csb    = std::abs(params.transform.brightness - 1.0) > epsilon ||
+                             std::abs(params.transform.saturation - 1.0) > epsilon ||
+                             std::abs(params.transform.contrast - 1.0) > epsilon;
+
+        image_shader_variant variant;
+        variant.pixel_format  = static_cast<int>(params.pix_desc.format);
+        variant.blend_mode    = static_cast<int>(params.blend_mode);
+        variant.keyer         = static_cast<int>(params.keyer);
+        variant.field_mode    = static_cast<int>(params.transform.field_mode);
+        variant.has_local_key = static_cast<bool>(params.local_key);
+        variant.has_layer_key = static_cast<bool>(params.layer_key);
+        variant.invert        = params.transform.invert;
+        variant.levels        = has_levels;
+        variant.csb           = has_csb;
+        variant.chroma        = params.transform.chroma.enable;
+        variant.has_mix       = !params.mix_textures.empty();
+
+        // Uniforms that are the same as for the previous item aren't set again. Those that a variant is compiled
+        // with don't exist in it and are ignored.
+        auto& program = get_shader(variant);
+        program.use();
+
+        program.set("is_hd", params.pix_desc.planes.at(0).height > 700 ? 1 : 0);
+        program.set("has_local_key", variant.has_local_key);
+        program.set("has_layer_key", variant.has_layer_key);
+        program.set("pixel_format", params.pix_desc.format);
+        program.set("field_mode", params.transform.field_mode);
+        program.set("precision_factor",
+                    params.pix_desc.planes.at(0).depth == core::color_depth::bit10 ? 65535.0 / 1023.0 : 1.0);
+        program.set("opacity", params.transform.is_key ? 1.0 : params.transform.opacity);
+        program.set("has_mix", variant.has_mix);
+        program.set("mix_opacity", params.mix_opacity);
+
+        program.set("chroma", variant.chroma);
+        if (variant.chroma) {
+            program.set("chroma_show_mask", params.transform.chroma.show_mask);
+            program.set("chroma_target_hue", params.transform.chroma.target_hue / 360.0);
+            program.set("chroma_hue_width", params.transform.chroma.hue_width);
+            program.set("chroma_min_saturation", params.transform.chroma.min_saturation);
+            program.set("chroma_min_brightness", params.transform.chroma.min_brightness);
+            program.set("chroma_softness", 1.0 + params.transform.chroma.softness);
+            program.set("chroma_spill_suppress", params.transform.chroma.spill_suppress / 360.0);
+            program.set("chroma_spill_suppress_saturation", params.transform.chroma.spill_suppress_saturation);
+        }
+
+        // Setup blend_func
+
         params.background->bind(static_cast<int>(texture_id::background));
-        shader_->set("background", texture_id::background);
-        shader_->set("blend_mode", params.blend_mode);
-        shader_->set("keyer", params.keyer);
+        program.set("blend_mode", params.blend_mode);
+        program.set("keyer", params.keyer);
 
         // Setup image-adjustements
-        shader_->set("invert", params.transform.invert);
-
-        if (params.transform.levels.min_input > epsilon || params.transform.levels.max_input < 1.0 - epsilon ||
-            params.transform.levels.min_output > epsilon || params.transform.levels.max_output < 1.0 - epsilon ||
-            std::abs(params.transform.levels.gamma - 1.0) > epsilon) {
-            shader_->set("levels", true);
-            shader_->set("min_input", params.transform.levels.min_input);
-            shader_->set("max_input", params.transform.levels.max_input);
-            shader_->set("min_output", params.transform.levels.min_output);
-            shader_->set("max_output", params.transform.levels.max_output);
-            shader_->set("gamma", params.transform.levels.gamma);
-        } else {
-            shader_->set("levels", false);
+        program.set("invert", params.transform.invert);
+
+        program.set("levels", has_levels);
+        if (has_levels) {
+            program.set("min_input", levels.min_input);
+            program.set("max_input", levels.max_input);
+            program.set("min_output", levels.min_output);
+            program.set("max_output", levels.max_output);
+            program.set("gamma", levels.gamma);
         }
 
-        if (std::abs(params.transform.brightness - 1.0) > epsilon ||
-            std::abs(params.transform.saturation - 1.0) > epsilon ||
-            std::abs(params.transform.contrast - 1.0) > epsilon) {
-            shader_->set("csb", true);
-
-            shader_->set("brt", params.transform.brightness);
-            shader_->set("sat", params.transform.saturation);
-            shader_->set("con", params.transform.contrast);
-        } else {
-            shader_->set("csb", false);
+        program.set("csb", has_csb);
+        if (has_csb) {
+            program.set("brt", params.transform.brightness);
+            program.set("sat", params.transform.saturation);
+            program.set("con", params.transform.contrast);
         }
 
         // Setup drawing area
@@ -330,87 +631,92 @@ struct image_kernel::impl
         // Set render target
         params.background->attach();
 
-        // Perspective correction
+        // Perspective correction, the ratios along the diagonals are the same before and after the affine part of the
+        // transform, so they are taken from the transformed corners.
+        // http://www.reedbeta.com/blog/2012/05/26/quadrilateral-interpolation-part-1/
+        std::array<double, 4> q_values = {{1.0, 1.0, 1.0, 1.0}};
+
         double diagonal_intersection_x;
         double diagonal_intersection_y;
 
-        if (get_line_intersection(pers.ul[0] + crop.ul[0],
-                                  pers.ul[1] + crop.ul[1],
-                                  pers.lr[0] + crop.lr[0],
-                                  pers.lr[1] + crop.lr[1],
-                                  pers.ur[0] + crop.lr[0],
-                                  pers.ur[1] + crop.ul[1],
-                                  pers.ll[0] + crop.ul[0],
-                                  pers.ll[1] + crop.lr[1],
+        const auto& ul = corners[0];
+        const auto& ur = corners[1];
+        const auto& lr = corners[2];
+        const auto& ll = corners[3];
+        if (get_line_intersection(ul.vertex_x,
+                                  ul.vertex_y,
+                                  lr.vertex_x,
+                                  lr.vertex_y,
+                                  ur.vertex_x,
+                                  ur.vertex_y,
+                                  ll.vertex_x,
+                                  ll.vertex_y,
                                   diagonal_intersection_x,
                                   diagonal_intersection_y) &&
-            is_default_geometry) {
-            // http://www.reedbeta.com/blog/2012/05/26/quadrilateral-interpolation-part-1/
-            auto d0 = hypotenuse(
-                pers.ll[0] + crop.ul[0], pers.ll[1] + crop.lr[1], diagonal_intersection_x, diagonal_intersection_y);
-            auto d1 = hypotenuse(
-                pers.lr[0] + crop.lr[0], pers.lr[1] + crop.lr[1], diagonal_intersection_x, diagonal_intersection_y);
-            auto d2 = hypotenuse(
-                pers.ur[0] + crop.lr[0], pers.ur[1] + crop.ul[1], diagonal_intersection_x, diagonal_intersection_y);
-            auto d3 = hypotenuse(
-                pers.ul[0] + crop.ul[0], pers.ul[1] + crop.ul[1], diagonal_intersection_x, diagonal_intersection_y);
-
-            auto ulq = calc_q(d3, d1);
-            auto urq = calc_q(d2, d0);
-            auto lrq = calc_q(d1, d3);
-            auto llq = calc_q(d0, d2);
-
-            std::vector<double> q_values = {ulq, urq, lrq, llq};
-
-            corner = 0;
-            for (auto& coord : coords) {
-                coord.texture_q = q_values[corner];
-                coord.texture_x *= q_values[corner];
-                coord.texture_y *= q_values[corner];
-
-                if (++corner == 4)
-                    corner = 0;
-            }
-        }
-
-        // Draw
-        switch (params.geometry.type()) {
-            case core::frame_geometry::geometry_type::quad: {
-                GL(glBindVertexArray(vao_));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
-
-                std::vector<core::frame_geometry::coord> coords_triangles{
-                    coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
-
-                GL(glBufferData(GL_ARRAY_BUFFER,
-                                static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords_triangles.size(),
-                                coords_triangles.data(),
-                                GL_STATIC_DRAW));
-
-                auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
-
-                auto vtx_loc = shader_->get_attrib_location("Position");
-                auto tex_loc = shader_->get_attrib_location("TexCoordIn");
-
-                GL(glEnableVertexAttribArray(vtx_loc));
-                GL(glEnableVertexAttribArray(tex_loc));
+            !is_mesh) {
+            auto d0 = hypotenuse(ll.vertex_x, ll.vertex_y, diagonal_intersection_x, diagonal_intersection_y);
+            auto d1 = hypotenuse(lr.vertex_x, lr.vertex_y, diagonal_intersection_x, diagonal_intersection_y);
+            auto d2 = hypotenuse(ur.vertex_x, ur.vertex_y, diagonal_intersection_x, diagonal_intersection_y);
+            auto d3 = hypotenuse(ul.vertex_x, ul.vertex_y, diagonal_intersection_x, diagonal_intersection_y);
 
-                GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-                GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+            q_values = {{calc_q(d3, d1), calc_q(d2, d0), calc_q(d1, d3), calc_q(d0, d2)}};
+        }
 
-                GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(coords_triangles.size())));
-                GL(glTextureBarrier());
+        // Vertex transform, see shader.vert.
+        program.set("crop_ul", transform.crop_ul[0], transform.crop_ul[1]);
+        program.set("crop_lr", transform.crop_lr[0], transform.crop_lr[1]);
+        program.set("crop_scale", transform.crop_scale[0], transform.crop_scale[1]);
+        for (auto n = 0; n < 4; ++n) {
+            const auto index = "[" + std::to_string(n) + "]";
+            program.set("perspective" + index, transform.perspective[n][0], transform.perspective[n][1]);
+            program.set("texture_q" + index, q_values[n]);
+        }
+        program.set("anchor", transform.anchor[0], transform.anchor[1]);
+        program.set("fill_scale", transform.fill_scale[0], transform.fill_scale[1]);
+        program.set("fill_translation", transform.fill_translation[0], transform.fill_translation[1]);
+        program.set("angle", transform.angle);
+        program.set("aspect_ratio", transform.aspect_ratio);
+        program.set("bottom_up", transform.bottom_up);
 
-                GL(glDisableVertexAttribArray(vtx_loc));
-                GL(glDisableVertexAttribArray(tex_loc));
+        // Draw
+        if (is_mesh) {
+            const auto& indices = params.geometry.indices();
+
+            GL(glBindVertexArray(mesh_vao_));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo_));
+            GL(glBufferData(GL_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord) * coords.size()),
+                            coords.data(),
+                            GL_STREAM_DRAW));
+            GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                            static_cast<GLsizeiptr>(sizeof(std::uint32_t) * indices.size()),
+                            indices.data(),
+                            GL_STREAM_DRAW));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+            GL(glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr));
+            GL(glTextureBarrier());
+
+            GL(glBindVertexArray(0));
+        } else {
+            GL(glBindVertexArray(vao_));
 
-                GL(glBindVertexArray(0));
+            auto base_vertex = 0;
+            if (!is_default_geometry) {
+                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+                GL(glBufferSubData(GL_ARRAY_BUFFER,
+                                   static_cast<GLintptr>(sizeof(core::frame_geometry::coord) * CUSTOM_BASE_VERTEX),
+                                   static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord) * coords.size()),
+                                   coords.data()));
                 GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-                break;
+                base_vertex = CUSTOM_BASE_VERTEX;
             }
-            default:
-                break;
+
+            GL(glDrawElementsBaseVertex(
+                GL_TRIANGLES, static_cast<GLsizei>(QUAD_INDICES.size()), GL_UNSIGNED_BYTE, nullptr, base_vertex));
+            GL(glTextureBarrier());
+
+            GL(glBindVertexArray(0));
         }
 
         // Cleanup
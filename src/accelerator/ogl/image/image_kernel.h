@@ -49,6 +49,10 @@ struct draw_params final
     std::shared_ptr<class texture>              local_key;
     std::shared_ptr<class texture>              layer_key;
     double                                      aspect_ratio = 1.0;
+
+    // The other side of a mix, added in the same pass with the transform, geometry and pixel format of the item.
+    std::vector<spl::shared_ptr<class texture>> mix_textures;
+    double                                      mix_opacity = 0.0;
 };
 
 class image_kernel final
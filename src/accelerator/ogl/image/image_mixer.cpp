@@ -20,16 +20,20 @@
  */
 #include "image_mixer.h"
 
+#include "image_converter.h"
 #include "image_kernel.h"
 
 #include "../util/buffer.h"
 #include "../util/device.h"
 #include "../util/texture.h"
+#include "../util/timer_query.h"
 
 #include <common/array.h>
+#include <common/except.h>
 #include <common/future.h>
 #include <common/log.h>
 
+#include <core/diagnostics/trace.h>
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
 #include <core/frame/geometry.h>
@@ -45,6 +49,10 @@
 #include <boost/any.hpp>
 
 #include <algorithm>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
@@ -53,10 +61,11 @@ using future_texture = std::shared_future<std::shared_ptr<texture>>;
 
 struct item
 {
-    core::pixel_format_desc     pix_desc = core::pixel_format::invalid;
-    std::vector<future_texture> textures;
-    core::image_transform       transform;
-    core::frame_geometry        geometry = core::frame_geometry::get_default();
+    core::pixel_format_desc pix_desc = core::pixel_format::invalid;
+    // Shared with the frame the textures were memoized on, so that visiting it doesn't allocate.
+    std::shared_ptr<const std::vector<future_texture>> textures;
+    core::image_transform                              transform;
+    core::frame_geometry                               geometry = core::frame_geometry::get_default();
 };
 
 struct layer
@@ -71,16 +80,272 @@ struct layer
     }
 };
 
+// Culling mirrors image_kernel and the draw order of image_renderer: the layers of a list are drawn in order, each
+// after its sublayers, and a key is taken by the next item that isn't one, or else by the items of the next layer.
+namespace {
+
+const double cull_epsilon = 0.001;
+
+bool is_opaque(core::pixel_format format)
+{
+    switch (format) {
+        case core::pixel_format::gray:
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::luma:
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb:
+        case core::pixel_format::nv12:
+        case core::pixel_format::uyvy:
+        case core::pixel_format::v210:
+        case core::pixel_format::dxt1:
+        case core::pixel_format::ycocg_dxt5:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_default(const core::frame_geometry& geometry)
+{
+    return geometry == core::frame_geometry::get_default();
+}
+
+bool has_clip(const core::image_transform& transform)
+{
+    auto m_p = transform.clip_translation;
+    auto m_s = transform.clip_scale;
+
+    return m_p[0] > std::numeric_limits<double>::epsilon() || m_p[1] > std::numeric_limits<double>::epsilon() ||
+           m_s[0] < 1.0 - std::numeric_limits<double>::epsilon() ||
+           m_s[1] < 1.0 - std::numeric_limits<double>::epsilon();
+}
+
+// Returns whether an item with transform can't leave anything in its target.
+bool is_empty(const core::image_transform& transform, const core::frame_geometry& geometry)
+{
+    if (transform.opacity < cull_epsilon || transform.fill_scale[0] == 0.0 || transform.fill_scale[1] == 0.0) {
+        return true;
+    }
+
+    const auto& crop = transform.crop;
+    if (is_default(geometry) && (crop.lr[0] <= crop.ul[0] || crop.lr[1] <= crop.ul[1])) {
+        return true;
+    }
+
+    if (has_clip(transform)) {
+        for (int n = 0; n < 2; ++n) {
+            auto m_p = transform.clip_translation[n];
+            auto m_s = transform.clip_scale[n];
+            if (m_s <= 0.0 || m_p >= 1.0 || m_p + m_s <= 0.0) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Returns whether item replaces every pixel of its target, when it isn't keyed.
+bool covers_frame(const item& item)
+{
+    const auto& t = item.transform;
+
+    if (t.is_key || t.is_mix || t.invert || t.chroma.enable || t.opacity < 1.0 || !is_opaque(item.pix_desc.format)) {
+        return false;
+    }
+
+    if (!is_default(item.geometry) || t.angle != 0.0 || has_clip(t)) {
+        return false;
+    }
+
+    const core::corners   default_corners;
+    const core::rectangle default_crop;
+    if (t.perspective.ul != default_corners.ul || t.perspective.ur != default_corners.ur ||
+        t.perspective.lr != default_corners.lr || t.perspective.ll != default_corners.ll ||
+        t.crop.ul != default_crop.ul || t.crop.lr != default_crop.lr) {
+        return false;
+    }
+
+    for (int n = 0; n < 2; ++n) {
+        auto from = (0.0 - t.anchor[n]) * t.fill_scale[n] + t.fill_translation[n];
+        auto to   = (1.0 - t.anchor[n]) * t.fill_scale[n] + t.fill_translation[n];
+        if (std::min(from, to) > 0.0 || std::max(from, to) < 1.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool is_same_layout(const core::pixel_format_desc& lhs, const core::pixel_format_desc& rhs)
+{
+    if (lhs.format != rhs.format || lhs.bottom_up != rhs.bottom_up || lhs.planes.size() != rhs.planes.size()) {
+        return false;
+    }
+    for (std::size_t n = 0; n < lhs.planes.size(); ++n) {
+        const auto& l = lhs.planes[n];
+        const auto& r = rhs.planes[n];
+        if (l.width != r.width || l.height != r.height || l.stride != r.stride || l.depth != r.depth) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns whether the two sides of a mix transition can be added in a single pass instead of through a mix texture.
+// They have to be placed alike and read in the same way, and nothing may be applied to them after they are added
+// that isn't linear.
+bool is_fusable_mix(const item& src, const item& dst)
+{
+    const auto& s = src.transform;
+    const auto& d = dst.transform;
+
+    if (!s.is_mix || !d.is_mix || s.invert || d.invert || !is_same_layout(src.pix_desc, dst.pix_desc) ||
+        src.geometry != dst.geometry) {
+        return false;
+    }
+
+    const auto& sl = s.levels;
+    const auto& dl = d.levels;
+    if (sl.min_input != dl.min_input || sl.max_input != dl.max_input || sl.gamma != dl.gamma ||
+        sl.min_output != dl.min_output || sl.max_output != dl.max_output) {
+        return false;
+    }
+
+    auto opaque_s    = s;
+    auto opaque_d    = d;
+    opaque_s.opacity = 1.0;
+    opaque_d.opacity = 1.0;
+    return opaque_s == opaque_d;
+}
+
+std::size_t count_items(const layer& layer)
+{
+    auto count = layer.items.size();
+    for (auto& sublayer : layer.sublayers) {
+        count += count_items(sublayer);
+    }
+    return count;
+}
+
+// Removes layers without items, which don't change what is drawn or which layer a key is taken by.
+void remove_empty_layers(std::vector<layer>& layers)
+{
+    for (auto& layer : layers) {
+        remove_empty_layers(layer.sublayers);
+    }
+    layers.erase(std::remove_if(layers.begin(),
+                                layers.end(),
+                                [](const layer& layer) { return layer.items.empty() && layer.sublayers.empty(); }),
+                 layers.end());
+}
+
+// Removes everything that is drawn before the last item that covers the whole frame. Returns the number of items
+// removed.
+std::size_t cull_occluded(std::vector<layer>& layers)
+{
+    auto occluder      = layers.end();
+    auto occluder_item = std::size_t(0);
+    auto has_layer_key = false;
+
+    for (auto it = layers.begin(); it != layers.end(); ++it) {
+        if (it->items.empty()) {
+            continue;
+        }
+
+        auto has_local_key = false;
+        for (std::size_t n = 0; n < it->items.size(); ++n) {
+            const auto& item = it->items[n];
+            if (item.transform.is_key) {
+                has_local_key = true;
+                continue;
+            }
+            if (it->blend_mode == core::blend_mode::normal && !has_local_key && !has_layer_key && covers_frame(item)) {
+                occluder      = it;
+                occluder_item = n;
+            }
+            has_local_key = false;
+        }
+        has_layer_key = has_local_key;
+    }
+
+    if (occluder == layers.end()) {
+        return 0;
+    }
+
+    std::size_t culled = occluder_item;
+    for (auto it = layers.begin(); it != occluder; ++it) {
+        culled += count_items(*it);
+    }
+    for (auto& sublayer : occluder->sublayers) {
+        culled += count_items(sublayer);
+    }
+
+    occluder->sublayers.clear();
+    occluder->items.erase(occluder->items.begin(), occluder->items.begin() + occluder_item);
+    layers.erase(layers.begin(), occluder);
+
+    return culled;
+}
+
+// Block compressed planes are uploaded as their blocks, the others as texels of the stride and depth of the plane.
+std::future<std::shared_ptr<texture>>
+upload_plane(device& ogl, const array<const std::uint8_t>& data, const core::pixel_format_desc& desc, int n)
+{
+    const auto& plane = desc.planes[n];
+    if (core::is_block_compressed(desc.format)) {
+        const auto compression =
+            desc.format == core::pixel_format::dxt1 ? texture_compression::bc1 : texture_compression::bc3;
+        return ogl.copy_async(data, plane.width, plane.height, compression);
+    }
+    return ogl.copy_async(data, plane.width, plane.height, plane.stride, core::bytes_per_sample(plane.depth));
+}
+
+} // namespace
+
 class image_renderer
 {
     spl::shared_ptr<device> ogl_;
     image_kernel            kernel_;
+    image_converter         converter_;
+    const int               channel_id_;
+    const bool              half_float_;
+
+    // Queries of the passes of each top level layer and of the conversions, only touched on the device thread.
+    std::vector<std::unique_ptr<timer_query>> layer_timers_;
+    std::unique_ptr<timer_query>              convert_timer_;
+
+    mutable std::mutex  gpu_time_mutex_;
+    std::vector<double> layer_gpu_times_;
+    double              convert_gpu_time_ = 0.0;
+
+    // The texture mixed at the tick before while conversions are woven, only touched on the device thread.
+    std::shared_ptr<texture> previous_texture_;
 
   public:
-    explicit image_renderer(const spl::shared_ptr<device>& ogl)
+    image_renderer(const spl::shared_ptr<device>& ogl, int channel_id, bool half_float)
         : ogl_(ogl)
         , kernel_(ogl_)
+        , converter_(ogl_)
+        , channel_id_(channel_id)
+        , half_float_(half_float)
+    {
+    }
+
+    ~image_renderer()
+    {
+        ogl_->dispatch_sync([&] {
+            layer_timers_.clear();
+            convert_timer_.reset();
+            previous_texture_.reset();
+        });
+    }
+
+    // Gpu time in milliseconds of the passes of each top level layer, bottom first, and of the conversions.
+    std::pair<std::vector<double>, double> gpu_times() const
     {
+        std::lock_guard<std::mutex> lock(gpu_time_mutex_);
+        return std::make_pair(layer_gpu_times_, convert_gpu_time_);
     }
 
     std::future<array<const std::uint8_t>> operator()(std::vector<layer>             layers,
@@ -92,15 +357,134 @@ class image_renderer
         }
 
         return flatten(ogl_->dispatch_async([=]() mutable -> std::shared_future<array<const std::uint8_t>> {
-            auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4);
+            CASPAR_TRACE_SCOPE("image_renderer::draw", channel_id_);
 
-            draw(target_texture, std::move(layers), format_desc);
+            auto target_texture = create_texture(format_desc.width, format_desc.height, 4);
+
+            draw_timed(target_texture, std::move(layers), format_desc);
 
             return ogl_->copy_async(target_texture);
         }));
     }
 
+    std::vector<std::future<array<const std::uint8_t>>> operator()(std::vector<layer>                   layers,
+                                                                   const core::video_format_desc&       format_desc,
+                                                                   std::vector<core::pixel_format_desc> formats)
+    {
+        future_texture texture;
+        return (*this)(std::move(layers), format_desc, std::move(formats), true, texture);
+    }
+
+    std::vector<std::future<array<const std::uint8_t>>> operator()(std::vector<layer>                   layers,
+                                                                   const core::video_format_desc&       format_desc,
+                                                                   std::vector<core::pixel_format_desc> formats,
+                                                                   bool                                 readback,
+                                                                   future_texture&                      texture)
+    {
+        using planes_t = std::vector<std::shared_future<array<const std::uint8_t>>>;
+
+        if (layers.empty() && formats.empty() && readback) {
+            std::vector<std::future<array<const std::uint8_t>>> result;
+            result.push_back((*this)(std::move(layers), format_desc));
+            return result;
+        }
+
+        // Empty frames are rendered too, since the converted planes aren't blank.
+        std::shared_future<std::pair<planes_t, future_texture>> rendered = ogl_->dispatch_async([=]() mutable {
+            CASPAR_TRACE_SCOPE("image_renderer::draw", channel_id_);
+
+            auto target_texture = create_texture(format_desc.width, format_desc.height, 4);
+
+            draw_timed(target_texture, std::move(layers), format_desc);
+
+            planes_t result;
+            if (readback) {
+                result.push_back(ogl_->copy_async(target_texture));
+            } else {
+                // Read back on demand, from a thread other than the device's, which the copy is dispatched to.
+                auto ogl = ogl_;
+                result.push_back(
+                    std::async(std::launch::deferred, [=] { return ogl->copy_async(target_texture).get(); }).share());
+            }
+
+            // Readbacks are timed on their own, convert everything before the first one is started.
+            std::vector<std::shared_ptr<ogl::texture>> plane_textures;
+            if (!formats.empty()) {
+                if (!convert_timer_) {
+                    convert_timer_ = std::make_unique<timer_query>([this](double elapsed) {
+                        std::lock_guard<std::mutex> lock(gpu_time_mutex_);
+                        convert_gpu_time_ = elapsed;
+                    });
+                }
+                scoped_timer_query query(*convert_timer_);
+                for (auto& desc : formats) {
+                    for (auto& plane_texture : converter_.convert(target_texture, desc, previous_texture_)) {
+                        plane_textures.push_back(std::move(plane_texture));
+                    }
+                }
+            }
+
+            // Only kept while it is needed, since it holds on to a texture of the pool.
+            const auto woven = std::any_of(formats.begin(), formats.end(), [](const core::pixel_format_desc& desc) {
+                return desc.woven_line >= 0;
+            });
+            previous_texture_ = woven ? target_texture : nullptr;
+            for (auto& plane_texture : plane_textures) {
+                result.push_back(ogl_->copy_async(plane_texture));
+            }
+            return std::make_pair(std::move(result), future_texture(ogl_->finish_async(target_texture)));
+        });
+
+        texture = std::async(std::launch::deferred, [=] { return rendered.get().second.get(); }).share();
+
+        std::shared_future<planes_t> planes =
+            std::async(std::launch::deferred, [=] { return rendered.get().first; }).share();
+
+        std::size_t count = 1;
+        for (auto& desc : formats) {
+            count += desc.planes.size();
+        }
+
+        std::vector<std::future<array<const std::uint8_t>>> result;
+        for (std::size_t n = 0; n < count; ++n) {
+            result.push_back(std::async(std::launch::deferred, [=] { return planes.get().at(n).get(); }));
+        }
+        return result;
+    }
+
   private:
+    // Composition targets, which are only quantized to 8 bits when read back in half float mode.
+    std::shared_ptr<texture> create_texture(int width, int height, int stride)
+    {
+        return ogl_->create_texture(width, height, stride, 1, half_float_);
+    }
+
+    // Draws layers like draw does, with the passes of each top level layer timed including its sublayers.
+    void draw_timed(std::shared_ptr<texture>&      target_texture,
+                    std::vector<layer>             layers,
+                    const core::video_format_desc& format_desc)
+    {
+        std::shared_ptr<texture> layer_key_texture;
+
+        for (std::size_t n = 0; n < layers.size(); ++n) {
+            if (n == layer_timers_.size()) {
+                layer_timers_.push_back(std::make_unique<timer_query>([this, n](double elapsed) {
+                    std::lock_guard<std::mutex> lock(gpu_time_mutex_);
+                    if (n < layer_gpu_times_.size()) {
+                        layer_gpu_times_[n] = elapsed;
+                    }
+                }));
+            }
+
+            scoped_timer_query query(*layer_timers_[n]);
+            draw(target_texture, layers[n].sublayers, format_desc);
+            draw(target_texture, std::move(layers[n]), layer_key_texture, format_desc);
+        }
+
+        std::lock_guard<std::mutex> lock(gpu_time_mutex_);
+        layer_gpu_times_.resize(layers.size(), 0.0);
+    }
+
     void draw(std::shared_ptr<texture>&      target_texture,
               std::vector<layer>             layers,
               const core::video_format_desc& format_desc)
@@ -124,33 +508,104 @@ class image_renderer
         std::shared_ptr<texture> local_key_texture;
         std::shared_ptr<texture> local_mix_texture;
 
-        if (layer.blend_mode != core::blend_mode::normal) {
-            auto layer_texture = ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
-
-            for (auto& item : layer.items)
-                draw(layer_texture,
-                     std::move(item),
-                     layer_key_texture,
-                     local_key_texture,
-                     local_mix_texture,
-                     format_desc);
+        // A single item is blended straight onto the target, the layer texture is only needed to blend several
+        // items, or keyed ones, as a whole.
+        const auto is_single_item = layer.items.size() == 1 && !layer.items.front().transform.is_key &&
+                                    !layer.items.front().transform.is_mix;
+
+        if (layer.blend_mode != core::blend_mode::normal && is_single_item) {
+            draw(target_texture,
+                 std::move(layer.items.front()),
+                 layer_key_texture,
+                 local_key_texture,
+                 local_mix_texture,
+                 format_desc,
+                 layer.blend_mode);
+        } else if (layer.blend_mode != core::blend_mode::normal) {
+            auto layer_texture = create_texture(target_texture->width(), target_texture->height(), 4);
+
+            draw(layer_texture,
+                 std::move(layer.items),
+                 layer_key_texture,
+                 local_key_texture,
+                 local_mix_texture,
+                 format_desc);
 
             draw(layer_texture, std::move(local_mix_texture), core::blend_mode::normal);
             draw(target_texture, std::move(layer_texture), layer.blend_mode);
         } else // fast path
         {
-            for (auto& item : layer.items)
+            draw(target_texture,
+                 std::move(layer.items),
+                 layer_key_texture,
+                 local_key_texture,
+                 local_mix_texture,
+                 format_desc);
+
+            draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal);
+        }
+
+        layer_key_texture = std::move(local_key_texture);
+    }
+
+    // Draws the items of a layer in order. A mix of two items that is_fusable_mix allows is drawn in one pass,
+    // unless it is keyed or mixed with more items, which need the mix texture.
+    void draw(std::shared_ptr<texture>&      target_texture,
+              std::vector<item>              items,
+              std::shared_ptr<texture>&      layer_key_texture,
+              std::shared_ptr<texture>&      local_key_texture,
+              std::shared_ptr<texture>&      local_mix_texture,
+              const core::video_format_desc& format_desc)
+    {
+        for (std::size_t n = 0; n < items.size(); ++n) {
+            const auto fuse = n + 1 < items.size() && !local_key_texture && !local_mix_texture &&
+                              is_fusable_mix(items[n], items[n + 1]) &&
+                              (n + 2 == items.size() || !items[n + 2].transform.is_mix);
+            if (fuse) {
+                draw(target_texture, std::move(items[n]), std::move(items[n + 1]), layer_key_texture, format_desc);
+                ++n;
+            } else {
                 draw(target_texture,
-                     std::move(item),
+                     std::move(items[n]),
                      layer_key_texture,
                      local_key_texture,
                      local_mix_texture,
                      format_desc);
-
-            draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal);
+            }
         }
+    }
 
-        layer_key_texture = std::move(local_key_texture);
+    void draw(std::shared_ptr<texture>&      target_texture,
+              item                           src,
+              item                           dst,
+              std::shared_ptr<texture>&      layer_key_texture,
+              const core::video_format_desc& format_desc)
+    {
+        draw_params draw_params;
+        draw_params.pix_desc  = std::move(src.pix_desc);
+        draw_params.transform = std::move(src.transform);
+        draw_params.geometry  = src.geometry;
+        draw_params.aspect_ratio =
+            static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+        draw_params.textures     = get_textures(src);
+        draw_params.mix_textures = get_textures(dst);
+        draw_params.mix_opacity  = dst.transform.opacity;
+        draw_params.background   = target_texture;
+        draw_params.layer_key    = layer_key_texture;
+
+        kernel_.draw(std::move(draw_params));
+    }
+
+    std::vector<spl::shared_ptr<texture>> get_textures(const item& item)
+    {
+        std::vector<spl::shared_ptr<texture>> textures;
+        for (auto& future_texture : *item.textures) {
+            auto tex = future_texture.get();
+            // Frames routed from a channel on another device were uploaded on its context.
+            tex->wait();
+            textures.push_back(spl::make_shared_ptr(std::move(tex)));
+        }
+        return textures;
     }
 
     void draw(std::shared_ptr<texture>&      target_texture,
@@ -158,7 +613,8 @@ class image_renderer
               std::shared_ptr<texture>&      layer_key_texture,
               std::shared_ptr<texture>&      local_key_texture,
               std::shared_ptr<texture>&      local_mix_texture,
-              const core::video_format_desc& format_desc)
+              const core::video_format_desc& format_desc,
+              core::blend_mode               blend_mode = core::blend_mode::normal)
     {
         draw_params draw_params;
         draw_params.pix_desc  = std::move(item.pix_desc);
@@ -166,15 +622,12 @@ class image_renderer
         draw_params.geometry  = item.geometry;
         draw_params.aspect_ratio =
             static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
-
-        for (auto& future_texture : item.textures) {
-            draw_params.textures.push_back(spl::make_shared_ptr(future_texture.get()));
-        }
+        draw_params.textures = get_textures(item);
 
         if (item.transform.is_key) {
             local_key_texture = local_key_texture
                                     ? local_key_texture
-                                    : ogl_->create_texture(target_texture->width(), target_texture->height(), 1);
+                                    : create_texture(target_texture->width(), target_texture->height(), 1);
 
             draw_params.background = local_key_texture;
             draw_params.local_key  = nullptr;
@@ -184,7 +637,7 @@ class image_renderer
         } else if (item.transform.is_mix) {
             local_mix_texture = local_mix_texture
                                     ? local_mix_texture
-                                    : ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
+                                    : create_texture(target_texture->width(), target_texture->height(), 4);
 
             draw_params.background = local_mix_texture;
             draw_params.local_key  = std::move(local_key_texture);
@@ -199,6 +652,7 @@ class image_renderer
             draw_params.background = target_texture;
             draw_params.local_key  = std::move(local_key_texture);
             draw_params.layer_key  = layer_key_texture;
+            draw_params.blend_mode = blend_mode;
 
             kernel_.draw(std::move(draw_params));
         }
@@ -234,14 +688,17 @@ struct image_mixer::impl
     std::vector<core::image_transform> transform_stack_;
     std::vector<layer>                 layers_; // layer/stream/items
     std::vector<layer*>                layer_stack_;
+    std::size_t                        culled_items_ = 0;
+    core::image_mixer::render_stats    stats_;
 
   public:
-    impl(const spl::shared_ptr<device>& ogl, int channel_id)
+    impl(const spl::shared_ptr<device>& ogl, int channel_id, bool half_float)
         : ogl_(ogl)
-        , renderer_(ogl)
+        , renderer_(ogl, channel_id, half_float)
         , transform_stack_(1)
     {
-        CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id;
+        CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id
+                         << (half_float ? L" (half float)" : L"");
     }
 
     void push(const core::frame_transform& transform)
@@ -276,20 +733,31 @@ struct image_mixer::impl
         item.transform = transform_stack_.back();
         item.geometry  = frame.geometry();
 
+        // Empty items are dropped before they are uploaded, unless they take a key, which they would hide.
+        auto& items = layer_stack_.back()->items;
+        if (!item.transform.is_key && is_empty(item.transform, item.geometry) &&
+            (items.empty() || !items.back().transform.is_key)) {
+            ++culled_items_;
+            return;
+        }
+
         auto textures_ptr = boost::any_cast<std::shared_ptr<std::vector<future_texture>>>(frame.opaque());
 
-        if (textures_ptr) {
-            item.textures = *textures_ptr;
-        } else {
-            for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
-                item.textures.emplace_back(ogl_->copy_async(frame.image_data(n),
-                                                            item.pix_desc.planes[n].width,
-                                                            item.pix_desc.planes[n].height,
-                                                            item.pix_desc.planes[n].stride));
-            }
+        if (!textures_ptr) {
+            // Frames which are shown more than once, e.g. stills and paused clips, only get uploaded the first time.
+            auto memo = frame.memoize(ogl_.get(), [&]() -> boost::any {
+                std::vector<future_texture> textures;
+                for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
+                    textures.emplace_back(upload_plane(*ogl_, frame.image_data(n), item.pix_desc, n));
+                }
+                return std::make_shared<decltype(textures)>(std::move(textures));
+            });
+            textures_ptr = boost::any_cast<std::shared_ptr<std::vector<future_texture>>>(memo);
         }
 
-        layer_stack_.back()->items.push_back(item);
+        item.textures = std::move(textures_ptr);
+
+        items.push_back(std::move(item));
     }
 
     void pop()
@@ -298,9 +766,63 @@ struct image_mixer::impl
         layer_stack_.resize(transform_stack_.back().layer_depth);
     }
 
+    // Takes the layers that were visited, without what can't be seen.
+    std::vector<layer> take_layers()
+    {
+        auto layers = std::move(layers_);
+        layers_.clear();
+
+        culled_items_ += cull_occluded(layers);
+        remove_empty_layers(layers);
+
+        std::size_t items = culled_items_;
+        for (auto& layer : layers) {
+            items += count_items(layer);
+        }
+
+        stats_.items        = static_cast<int>(items);
+        stats_.culled_items = static_cast<int>(culled_items_);
+        culled_items_       = 0;
+
+        return layers;
+    }
+
+    core::image_mixer::render_stats stats() const
+    {
+        auto stats     = stats_;
+        auto times     = renderer_.gpu_times();
+        stats.gpu_time = times.second;
+        for (auto time : times.first) {
+            stats.gpu_time += time;
+        }
+        stats.gpu_layer_times = std::move(times.first);
+        return stats;
+    }
+
     std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
     {
-        return renderer_(std::move(layers_), format_desc);
+        return renderer_(take_layers(), format_desc);
+    }
+
+    std::vector<std::future<array<const std::uint8_t>>> render(const core::video_format_desc&              format_desc,
+                                                               const std::vector<core::pixel_format_desc>& formats)
+    {
+        return renderer_(take_layers(), format_desc, formats);
+    }
+
+    std::vector<std::future<array<const std::uint8_t>>> render(const core::video_format_desc&              format_desc,
+                                                               const std::vector<core::pixel_format_desc>& formats,
+                                                               bool                                        readback,
+                                                               boost::any&                                 texture)
+    {
+        future_texture rendered;
+        auto           result = renderer_(take_layers(), format_desc, formats, readback, rendered);
+
+        // Mixed frames carry their texture like uploaded ones, so that they can also be drawn by another mixer.
+        if (rendered.valid()) {
+            texture = std::make_shared<std::vector<future_texture>>(1, rendered);
+        }
+        return result;
     }
 
     core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
@@ -323,9 +845,71 @@ struct image_mixer::impl
                 }
                 std::vector<future_texture> textures;
                 for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
-                    textures.emplace_back(self->ogl_->copy_async(
-                        image_data[n], desc.planes[n].width, desc.planes[n].height, desc.planes[n].stride));
+                    textures.emplace_back(upload_plane(*self->ogl_, image_data[n], desc, n));
+                }
+                return std::make_shared<decltype(textures)>(std::move(textures));
+            });
+    }
+
+    core::mutable_frame create_frame(const void*                      tag,
+                                     const core::pixel_format_desc&   desc,
+                                     const core::const_frame&         previous,
+                                     std::vector<core::image_region>& dirty) override
+    {
+        // Only single plane frames whose previous texture is known are updated in place.
+        auto previous_textures = previous ? boost::any_cast<std::shared_ptr<std::vector<future_texture>>>(
+                                                &previous.opaque())
+                                          : nullptr;
+
+        auto reusable = desc.planes.size() == 1 && previous_textures && *previous_textures &&
+                        (*previous_textures)->size() == 1 && previous.pixel_format_desc().format == desc.format &&
+                        previous.pixel_format_desc().planes.size() == 1 &&
+                        previous.pixel_format_desc().bottom_up == desc.bottom_up;
+        if (reusable) {
+            const auto& a = desc.planes[0];
+            const auto& b = previous.pixel_format_desc().planes[0];
+            reusable      = a.width == b.width && a.height == b.height && a.stride == b.stride && a.depth == b.depth;
+        }
+
+        if (!reusable) {
+            dirty.clear();
+            for (auto& plane : desc.planes) {
+                dirty.push_back(core::image_region{0, 0, plane.width, plane.height});
+            }
+            return create_frame(tag, desc);
+        }
+
+        const auto& plane = desc.planes[0];
+
+        std::vector<core::image_region> regions;
+        for (auto region : dirty) {
+            const auto x0 = std::max(region.x, 0);
+            const auto y0 = std::max(region.y, 0);
+            const auto x1 = std::min(region.x + region.width, plane.width);
+            const auto y1 = std::min(region.y + region.height, plane.height);
+            if (x1 > x0 && y1 > y0) {
+                regions.push_back(core::image_region{x0, y0, x1 - x0, y1 - y0});
+            }
+        }
+        dirty = regions;
+
+        std::vector<array<std::uint8_t>> image_data;
+        image_data.push_back(ogl_->create_array(plane.size));
+
+        std::weak_ptr<image_mixer::impl> weak_self = shared_from_this();
+        return core::mutable_frame(
+            tag,
+            std::move(image_data),
+            array<int32_t>{},
+            desc,
+            [weak_self, previous_texture = (*previous_textures)->at(0), regions = std::move(regions)](
+                std::vector<array<const std::uint8_t>> image_data) -> boost::any {
+                auto self = weak_self.lock();
+                if (!self) {
+                    return boost::any{};
                 }
+                std::vector<future_texture> textures;
+                textures.emplace_back(self->ogl_->copy_async(image_data[0], previous_texture, regions));
                 return std::make_shared<decltype(textures)>(std::move(textures));
             });
     }
@@ -367,8 +951,8 @@ struct image_mixer::impl
 #endif
 };
 
-image_mixer::image_mixer(const spl::shared_ptr<device>& ogl, int channel_id)
-    : impl_(std::make_unique<impl>(ogl, channel_id))
+image_mixer::image_mixer(const spl::shared_ptr<device>& ogl, int channel_id, bool half_float)
+    : impl_(std::make_unique<impl>(ogl, channel_id, half_float))
 {
 }
 image_mixer::~image_mixer() {}
@@ -379,10 +963,45 @@ std::future<array<const std::uint8_t>> image_mixer::operator()(const core::video
 {
     return impl_->render(format_desc);
 }
+std::vector<std::future<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& formats)
+{
+    for (auto& desc : formats) {
+        if (!image_converter::is_supported(desc)) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported conversion format."));
+        }
+    }
+    return impl_->render(format_desc, formats);
+}
+std::vector<std::future<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc&              format_desc,
+                        const std::vector<core::pixel_format_desc>& formats,
+                        bool                                        readback,
+                        boost::any&                                 texture)
+{
+    for (auto& desc : formats) {
+        if (!image_converter::is_supported(desc)) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported conversion format."));
+        }
+    }
+    return impl_->render(format_desc, formats, readback, texture);
+}
+core::image_mixer::render_stats image_mixer::stats() const { return impl_->stats(); }
+bool image_mixer::is_convertible(const core::pixel_format_desc& desc) const
+{
+    return image_converter::is_supported(desc);
+}
 core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
 {
     return impl_->create_frame(tag, desc);
 }
+core::mutable_frame image_mixer::create_frame(const void*                      tag,
+                                              const core::pixel_format_desc&   desc,
+                                              const core::const_frame&         previous,
+                                              std::vector<core::image_region>& dirty)
+{
+    return impl_->create_frame(tag, desc, previous, dirty);
+}
 
 #ifdef WIN32
 core::const_frame image_mixer::import_d3d_texture(const void*                                tag,
@@ -29,13 +29,15 @@
 #include <core/video_format.h>
 
 #include <future>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 class image_mixer final : public core::image_mixer
 {
   public:
-    image_mixer(const spl::shared_ptr<class device>& ogl, int channel_id);
+    // half_float composites in 16 bit float textures to avoid banding across blend passes and 10 bit sources.
+    image_mixer(const spl::shared_ptr<class device>& ogl, int channel_id, bool half_float = false);
     image_mixer(const image_mixer&) = delete;
 
     ~image_mixer();
@@ -43,7 +45,21 @@ class image_mixer final : public core::image_mixer
     image_mixer& operator=(const image_mixer&) = delete;
 
     std::future<array<const std::uint8_t>> operator()(const core::video_format_desc& format_desc) override;
-    core::mutable_frame                    create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    std::vector<std::future<array<const std::uint8_t>>>
+                        operator()(const core::video_format_desc&              format_desc,
+                                   const std::vector<core::pixel_format_desc>& formats) override;
+    std::vector<std::future<array<const std::uint8_t>>>
+                        operator()(const core::video_format_desc&              format_desc,
+                                   const std::vector<core::pixel_format_desc>& formats,
+                                   bool                                        readback,
+                                   boost::any&                                 texture) override;
+    bool                is_convertible(const core::pixel_format_desc& desc) const override;
+    render_stats        stats() const override;
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    core::mutable_frame create_frame(const void*                      tag,
+                                     const core::pixel_format_desc&   desc,
+                                     const core::const_frame&         previous,
+                                     std::vector<core::image_region>& dirty) override;
 #ifdef WIN32
     core::const_frame import_d3d_texture(const void*                                tag,
                                          const std::shared_ptr<d3d::d3d_texture2d>& d3d_texture) override;
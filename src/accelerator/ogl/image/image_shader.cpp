@@ -23,21 +23,47 @@
 #include "../util/device.h"
 #include "../util/shader.h"
 
+#include "ogl_chroma_key_fragment.h"
+#include "ogl_convert_fragment.h"
+#include "ogl_convert_vertex.h"
 #include "ogl_image_fragment.h"
 #include "ogl_image_vertex.h"
 
+#include <common/env.h>
+#include <common/log.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/blend_modes.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
-std::weak_ptr<shader> g_shader;
-std::mutex            g_shader_mutex;
+namespace {
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
+std::shared_ptr<shader> get_shader(const spl::shared_ptr<device>& ogl,
+                                   std::weak_ptr<shader>&         cache,
+                                   const std::string&             vertex_source,
+                                   const std::string&             fragment_source)
 {
-    std::lock_guard<std::mutex> lock(g_shader_mutex);
-    auto                        existing_shader = g_shader.lock();
-
-    if (existing_shader) {
-        return existing_shader;
+    static std::mutex mutex;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto                        existing_shader = cache.lock();
+        if (existing_shader) {
+            return existing_shader;
+        }
     }
 
     // The deleter is alive until the weak pointer is destroyed, so we have
@@ -52,11 +78,223 @@ std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
         }
     };
 
-    existing_shader.reset(new shader(std::string(vertex_shader), std::string(fragment_shader)), deleter);
+    // Compiled without holding the lock, so that a warm-up in the background doesn't stall the device thread. If
+    // both compile the same program the one that finished first is kept.
+    std::shared_ptr<shader> new_shader(new shader(vertex_source, fragment_source), deleter);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto                        existing_shader = cache.lock();
+    if (existing_shader) {
+        return existing_shader;
+    }
+    cache = new_shader;
+
+    return new_shader;
+}
+
+// Defines the branches of variant right after the #version line, which has to come first.
+std::string variant_source(const image_shader_variant& variant)
+{
+    std::ostringstream defines;
+    defines << std::boolalpha << "#define VARIANT\n"
+            << "#define PIXEL_FORMAT " << variant.pixel_format << "\n"
+            << "#define BLEND_MODE " << variant.blend_mode << "\n"
+            << "#define KEYER " << variant.keyer << "\n"
+            << "#define FIELD_MODE " << variant.field_mode << "\n"
+            << "#define HAS_LOCAL_KEY " << variant.has_local_key << "\n"
+            << "#define HAS_LAYER_KEY " << variant.has_layer_key << "\n"
+            << "#define INVERT " << variant.invert << "\n"
+            << "#define LEVELS " << variant.levels << "\n"
+            << "#define CSB " << variant.csb << "\n"
+            << "#define CHROMA " << variant.chroma << "\n"
+            << "#define HAS_MIX " << variant.has_mix << "\n";
+
+    std::string source(fragment_shader);
+    source.insert(source.find('\n') + 1, defines.str());
+    return source;
+}
+
+// Programs are cached per device, since the uniforms set on a program are shared by every context that uses it.
+template <typename Key>
+std::weak_ptr<shader>& get_cache(const device& ogl, const Key& key)
+{
+    static std::mutex                                                     mutex;
+    static std::map<std::pair<const device*, Key>, std::weak_ptr<shader>> caches;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return caches[std::make_pair(&ogl, key)];
+}
+
+std::string variants_filename() { return u8(env::data_folder()) + "shaders/variants"; }
+
+bool shader_cache_enabled()
+{
+    static const bool enabled = env::properties().get(L"configuration.ogl.shader-cache", true);
+    return enabled;
+}
+
+// Variants are recorded one per line. Lines written before has_mix was added end after chroma.
+std::istream& operator>>(std::istream& stream, image_shader_variant& variant)
+{
+    std::string line;
+    if (!std::getline(stream, line)) {
+        return stream;
+    }
+
+    std::istringstream fields(line);
+    if (!(fields >> variant.pixel_format >> variant.blend_mode >> variant.keyer >> variant.field_mode >>
+          variant.has_local_key >> variant.has_layer_key >> variant.invert >> variant.levels >> variant.csb >>
+          variant.chroma)) {
+        stream.setstate(std::ios::failbit);
+        return stream;
+    }
+    if (!(fields >> variant.has_mix)) {
+        variant.has_mix = false;
+    }
+    return stream;
+}
+
+std::ostream& operator<<(std::ostream& stream, const image_shader_variant& variant)
+{
+    return stream << variant.pixel_format << " " << variant.blend_mode << " " << variant.keyer << " "
+                  << variant.field_mode << " " << variant.has_local_key << " " << variant.has_layer_key << " "
+                  << variant.invert << " " << variant.levels << " " << variant.csb << " " << variant.chroma << " "
+                  << variant.has_mix;
+}
+
+std::set<image_shader_variant> load_variants()
+{
+    std::set<image_shader_variant> variants;
+
+    std::ifstream file(variants_filename());
+    for (image_shader_variant variant; file >> variant;) {
+        variants.insert(variant);
+    }
+    return variants;
+}
+
+// Keeps the variants that have been drawn in the data folder, so that they are compiled ahead of use next time.
+void record_variant(const image_shader_variant& variant)
+{
+    static std::mutex                     mutex;
+    static std::set<image_shader_variant> recorded = load_variants();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!recorded.insert(variant).second) {
+        return;
+    }
+
+    try {
+        boost::filesystem::create_directories(boost::filesystem::path(u16(variants_filename())).parent_path());
+
+        std::ofstream file(variants_filename(), std::ios::app);
+        file << variant << "\n";
+    } catch (...) {
+        CASPAR_LOG(warning) << L"Failed to write " << u16(variants_filename());
+    }
+}
+
+} // namespace
+
+bool image_shader_variant::operator<(const image_shader_variant& other) const
+{
+    return std::tie(pixel_format,
+                    blend_mode,
+                    keyer,
+                    field_mode,
+                    has_local_key,
+                    has_layer_key,
+                    invert,
+                    levels,
+                    csb,
+                    chroma,
+                    has_mix) < std::tie(other.pixel_format,
+                                        other.blend_mode,
+                                        other.keyer,
+                                        other.field_mode,
+                                        other.has_local_key,
+                                        other.has_layer_key,
+                                        other.invert,
+                                        other.levels,
+                                        other.csb,
+                                        other.chroma,
+                                        other.has_mix);
+}
+
+std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl, const image_shader_variant& variant)
+{
+    static const bool enabled = env::properties().get(L"configuration.ogl.shader-variants", true);
+
+    if (!enabled) {
+        return get_shader(ogl, get_cache(*ogl, std::string("image")), vertex_shader, fragment_shader);
+    }
+
+    if (shader_cache_enabled()) {
+        record_variant(variant);
+    }
+
+    return get_shader(ogl, get_cache(*ogl, variant), vertex_shader, variant_source(variant));
+}
+
+std::shared_ptr<shader> get_convert_shader(const spl::shared_ptr<device>& ogl)
+{
+    return get_shader(ogl, get_cache(*ogl, std::string("convert")), convert_vertex_shader, convert_fragment_shader);
+}
+
+std::shared_ptr<shader> get_chroma_key_shader(const spl::shared_ptr<device>& ogl)
+{
+    return get_shader(
+        ogl, get_cache(*ogl, std::string("chroma_key")), convert_vertex_shader, chroma_key_fragment_shader);
+}
+
+std::future<std::vector<std::shared_ptr<shader>>> warm_up_shaders(const spl::shared_ptr<device>& ogl)
+{
+    // A strong reference would let the compile thread destroy the device it runs on.
+    std::weak_ptr<device> weak_ogl = ogl;
+
+    return ogl->compile_async([weak_ogl] {
+        std::vector<std::shared_ptr<shader>> shaders;
+
+        auto ogl = weak_ogl.lock();
+        if (!ogl) {
+            return shaders;
+        }
+
+        caspar::timer timer;
+
+        // Every pixel format drawn as is, and layers composited with every blend mode.
+        std::set<image_shader_variant> variants;
+        for (auto n = 0; n < static_cast<int>(core::pixel_format::count); ++n) {
+            image_shader_variant variant;
+            variant.pixel_format = n;
+            variants.insert(variant);
+        }
+        for (auto n = 0; n < static_cast<int>(core::blend_mode::blend_mode_count); ++n) {
+            image_shader_variant variant;
+            variant.pixel_format = static_cast<int>(core::pixel_format::bgra);
+            variant.blend_mode   = n;
+            variants.insert(variant);
+        }
+        if (shader_cache_enabled()) {
+            auto used = load_variants();
+            variants.insert(used.begin(), used.end());
+        }
+
+        auto device = spl::make_shared_ptr(ogl);
+        shaders.push_back(get_convert_shader(device));
+        for (auto& variant : variants) {
+            try {
+                shaders.push_back(get_image_shader(device, variant));
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
 
-    g_shader = existing_shader;
+        CASPAR_LOG(info) << L"Compiled " << shaders.size() << L" shaders in "
+                         << static_cast<int>(timer.elapsed() * 1000.0) << L" ms.";
 
-    return existing_shader;
+        return shaders;
+    });
 }
 
 }}} // namespace caspar::accelerator::ogl
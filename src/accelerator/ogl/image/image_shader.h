@@ -23,6 +23,10 @@
 
 #include <common/memory.h>
 
+#include <future>
+#include <memory>
+#include <vector>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 class shader;
@@ -36,9 +40,39 @@ enum class texture_id
     plane3,
     local_key,
     layer_key,
-    background
+    background,
+    mix_plane0,
+    mix_plane1,
+    mix_plane2,
+    mix_plane3
+};
+
+// The branches of the image shader that a variant is compiled with, instead of taking them from uniforms.
+struct image_shader_variant
+{
+    int  pixel_format  = 0;
+    int  blend_mode    = 0;
+    int  keyer         = 0;
+    int  field_mode    = 0;
+    bool has_local_key = false;
+    bool has_layer_key = false;
+    bool invert        = false;
+    bool levels        = false;
+    bool csb           = false;
+    bool chroma        = false;
+    bool has_mix       = false;
+
+    bool operator<(const image_shader_variant& other) const;
 };
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl);
+// Returns the image shader compiled for variant, or the one that branches at runtime if variants are disabled by
+// configuration.ogl.shader-variants.
+std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl, const image_shader_variant& variant);
+std::shared_ptr<shader> get_convert_shader(const spl::shared_ptr<device>& ogl);
+std::shared_ptr<shader> get_chroma_key_shader(const spl::shared_ptr<device>& ogl);
+
+// Compiles the common variants and the ones drawn in earlier runs in the background. The shaders are only cached
+// while the result is kept.
+std::future<std::vector<std::shared_ptr<shader>>> warm_up_shaders(const spl::shared_ptr<device>& ogl);
 
 }}} // namespace caspar::accelerator::ogl
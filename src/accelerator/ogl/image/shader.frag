@@ -7,29 +7,50 @@ uniform sampler2D	background;
 uniform sampler2D	plane[4];
 uniform sampler2D	local_key;
 uniform sampler2D	layer_key;
+uniform sampler2D	mix_plane[4];
 
 uniform bool		is_hd;
+uniform float		precision_factor;
+uniform float		opacity;
+uniform float		mix_opacity;
+
+// Variants are compiled with the branches below fixed, see image_shader_variant.
+#ifdef VARIANT
+const bool			has_local_key	= HAS_LOCAL_KEY;
+const bool			has_layer_key	= HAS_LAYER_KEY;
+const int			blend_mode		= BLEND_MODE;
+const int			keyer			= KEYER;
+const int			pixel_format	= PIXEL_FORMAT;
+const int			field_mode		= FIELD_MODE;
+const bool			invert			= INVERT;
+const bool			levels			= LEVELS;
+const bool			csb				= CSB;
+const bool			chroma			= CHROMA;
+const bool			has_mix			= HAS_MIX;
+#else
 uniform bool		has_local_key;
 uniform bool		has_layer_key;
 uniform int			blend_mode;
 uniform int			keyer;
 uniform int			pixel_format;
-
+uniform int			field_mode;
 uniform bool        invert;
-uniform float		opacity;
 uniform bool		levels;
+uniform bool		csb;
+uniform bool		chroma;
+uniform bool		has_mix;
+#endif
+
 uniform float		min_input;
 uniform float		max_input;
 uniform float		gamma;
 uniform float		min_output;
 uniform float		max_output;
 
-uniform bool		csb;
 uniform float		brt;
 uniform float		sat;
 uniform float		con;
 
-uniform bool		chroma;
 uniform bool		chroma_show_mask;
 uniform float		chroma_target_hue;
 uniform float		chroma_hue_width;
@@ -468,65 +489,171 @@ vec4 ycbcra_to_rgba(float y, float cb, float cr, float a)
 
 vec4 get_sample(sampler2D sampler, vec2 coords)
 {
-    return texture2D(sampler, coords);
+    return texture2D(sampler, coords) * precision_factor;
+}
+
+// Packed 4:2:2 formats are uploaded as bgra texels and read without filtering, one pixel at a time.
+ivec2 get_packed_pos(sampler2D p0, vec2 coords, int width)
+{
+    int height = textureSize(p0, 0).y;
+    return clamp(ivec2(coords * vec2(width, height)), ivec2(0), ivec2(width - 1, height - 1));
+}
+
+vec4 get_uyvy_color(sampler2D p0, vec2 coords)
+{
+    ivec2 pos   = get_packed_pos(p0, coords, textureSize(p0, 0).x * 2);
+    vec4  texel = texelFetch(p0, ivec2(pos.x / 2, pos.y), 0);
+    return ycbcra_to_rgba(pos.x % 2 == 0 ? texel.g : texel.a, texel.b, texel.r, 1.0);
+}
+
+uint get_v210_word(sampler2D p0, int x, int y)
+{
+    uvec4 b = uvec4(floor(texelFetch(p0, ivec2(x, y), 0) * 255.0 + 0.5));
+    return b.b | (b.g << 8) | (b.r << 16) | (b.a << 24);
+}
+
+float get_v210_code(uint word, int index)
+{
+    return float((word >> (10 * index)) & 1023u) / 1020.0;
+}
+
+// Each group of four words holds six pixels: Cb0 Y0 Cr0, Y1 Cb2 Y2, Cr2 Y3 Cb4, Y4 Cr4 Y5. Rows are expected to
+// be a whole number of groups without padding.
+vec4 get_v210_color(sampler2D p0, vec2 coords)
+{
+    ivec2 pos = get_packed_pos(p0, coords, textureSize(p0, 0).x / 4 * 6);
+    int   x   = pos.x / 6 * 4;
+
+    uint w0 = get_v210_word(p0, x, pos.y);
+    uint w1 = get_v210_word(p0, x + 1, pos.y);
+    uint w2 = get_v210_word(p0, x + 2, pos.y);
+    uint w3 = get_v210_word(p0, x + 3, pos.y);
+
+    float y[6]  = float[6](get_v210_code(w0, 1), get_v210_code(w1, 0), get_v210_code(w1, 2),
+                           get_v210_code(w2, 1), get_v210_code(w3, 0), get_v210_code(w3, 2));
+    float cb[3] = float[3](get_v210_code(w0, 0), get_v210_code(w1, 1), get_v210_code(w2, 2));
+    float cr[3] = float[3](get_v210_code(w0, 2), get_v210_code(w2, 0), get_v210_code(w3, 1));
+
+    int n = pos.x % 6;
+    return ycbcra_to_rgba(y[n], cb[n / 2], cr[n / 2], 1.0);
 }
 
-vec4 get_rgba_color()
+// HAP Q stores co and cg offset by half and scaled up by up to 8 where the chroma range of the block allows it.
+vec4 get_ycocg_color(sampler2D p0, vec2 coords)
+{
+    vec4  cocgsy = get_sample(p0, coords) - vec4(128.0 / 255.0, 128.0 / 255.0, 0.0, 0.0);
+    float scale  = cocgsy.b * (255.0 / 8.0) + 1.0;
+    float co     = cocgsy.r / scale;
+    float cg     = cocgsy.g / scale;
+    float y      = cocgsy.a;
+    return vec4(y + co - cg, y + cg, y - co - cg, 1.0);
+}
+
+// The planes are passed in, so that both sides of a mix are read the same way.
+vec4 get_rgba_color(sampler2D p0, sampler2D p1, sampler2D p2, sampler2D p3, vec2 coords)
 {
     switch(pixel_format)
     {
     case 0:		//gray
-        return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rrr, 1.0);
+        return vec4(get_sample(p0, coords).rrr, 1.0);
     case 1:		//bgra,
-        return get_sample(plane[0], TexCoord.st / TexCoord.q).bgra;
+        return get_sample(p0, coords).bgra;
     case 2:		//rgba,
-        return get_sample(plane[0], TexCoord.st / TexCoord.q).rgba;
+        return get_sample(p0, coords).rgba;
     case 3:		//argb,
-        return get_sample(plane[0], TexCoord.st / TexCoord.q).argb;
+        return get_sample(p0, coords).argb;
     case 4:		//abgr,
-        return get_sample(plane[0], TexCoord.st / TexCoord.q).gbar;
+        return get_sample(p0, coords).gbar;
     case 5:		//ycbcr,
         {
-            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r;
-            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r;
-            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r;
+            float y  = get_sample(p0, coords).r;
+            float cb = get_sample(p1, coords).r;
+            float cr = get_sample(p2, coords).r;
             return ycbcra_to_rgba(y, cb, cr, 1.0);
         }
     case 6:		//ycbcra
         {
-            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r;
-            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r;
-            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r;
-            float a  = get_sample(plane[3], TexCoord.st / TexCoord.q).r;
+            float y  = get_sample(p0, coords).r;
+            float cb = get_sample(p1, coords).r;
+            float cr = get_sample(p2, coords).r;
+            float a  = get_sample(p3, coords).r;
             return ycbcra_to_rgba(y, cb, cr, a);
         }
     case 7:		//luma
         {
-            vec3 y3 = get_sample(plane[0], TexCoord.st / TexCoord.q).rrr;
+            vec3 y3 = get_sample(p0, coords).rrr;
             return vec4((y3-0.065)/0.859, 1.0);
         }
     case 8:		//bgr,
-        return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).bgr, 1.0);
+        return vec4(get_sample(p0, coords).bgr, 1.0);
     case 9:		//rgb,
-        return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rgb, 1.0);
+        return vec4(get_sample(p0, coords).rgb, 1.0);
+    case 10:	//nv12
+        {
+            float y    = get_sample(p0, coords).r;
+            vec2  cbcr = get_sample(p1, coords).rg;
+            return ycbcra_to_rgba(y, cbcr.x, cbcr.y, 1.0);
+        }
+    case 11:	//uyvy
+        return get_uyvy_color(p0, coords);
+    case 12:	//v210
+        return get_v210_color(p0, coords);
+    case 13:	//dxt1
+        return vec4(get_sample(p0, coords).rgb, 1.0);
+    case 14:	//dxt5
+        return get_sample(p0, coords).rgba;
+    case 15:	//ycocg_dxt5
+        return get_ycocg_color(p0, coords);
     }
     return vec4(0.0, 0.0, 0.0, 0.0);
 }
 
-void main()
+/*
+** Motion adaptive deinterlacing of a single frame: lines of the shown field are kept, lines of the other field
+** are woven in where they match their neighbours and interpolated from them where the fields differ.
+*/
+vec4 get_deinterlaced_color(sampler2D p0, sampler2D p1, sampler2D p2, sampler2D p3, vec2 coords)
 {
-    vec4 color = get_rgba_color();
+    float height = float(textureSize(p0, 0).y);
+    float line   = floor(coords.y * height);
+
+    if (mod(line, 2.0) == (field_mode == 1 ? 0.0 : 1.0))
+        return get_rgba_color(p0, p1, p2, p3, coords);
+
+    vec4 woven = get_rgba_color(p0, p1, p2, p3, vec2(coords.x, (line + 0.5) / height));
+    vec4 above = get_rgba_color(p0, p1, p2, p3, vec2(coords.x, (line - 0.5) / height));
+    vec4 below = get_rgba_color(p0, p1, p2, p3, vec2(coords.x, (line + 1.5) / height));
+    vec4 bob   = (above + below) * 0.5;
+
+    float combing = distance(woven.rgb, bob.rgb) - distance(above.rgb, below.rgb) * 0.5;
+    return mix(woven, bob, smoothstep(0.02, 0.08, combing));
+}
+
+vec4 get_color(sampler2D p0, sampler2D p1, sampler2D p2, sampler2D p3)
+{
+    vec2 coords = TexCoord.st / TexCoord.q;
+    vec4 color  = field_mode != 0
+            ? get_deinterlaced_color(p0, p1, p2, p3, coords)
+            : get_rgba_color(p0, p1, p2, p3, coords);
     if (chroma)
         color = chroma_key(color);
     if(levels)
         color.rgb = LevelsControl(color.rgb, min_input, gamma, max_input, min_output, max_output);
     if(csb)
         color.rgb = ContrastSaturationBrightness(color, brt, sat, con);
+    return color;
+}
+
+void main()
+{
+    vec4 color = get_color(plane[0], plane[1], plane[2], plane[3]) * opacity;
+    // The other side of a mix shares the transform, the two are added as in a mix texture.
+    if (has_mix)
+        color += get_color(mix_plane[0], mix_plane[1], mix_plane[2], mix_plane[3]) * mix_opacity;
     if(has_local_key)
         color *= texture(local_key, TexCoord2.st).r;
     if(has_layer_key)
         color *= texture(layer_key, TexCoord2.st).r;
-    color *= opacity;
     if (invert)
         color = 1.0 - color;
     if (blend_mode >= 0)
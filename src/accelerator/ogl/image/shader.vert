@@ -1,16 +1,49 @@
 #version 450
-in vec4 TexCoordIn;
-in vec2 Position;
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec4 TexCoordIn;
 
 out vec4 TexCoord;
 out vec4 TexCoord2;
 
+// The transform of the item, see vertex_transform in image_kernel.cpp which does the same for culling.
+uniform vec2  crop_ul;
+uniform vec2  crop_lr;
+uniform vec2  crop_scale;     // vertex units per texture unit, moves the vertices of a quad along with its crop
+uniform vec2  perspective[4]; // offsets of the ul, ur, lr and ll corners
+uniform float texture_q[4];   // perspective correction of the corners
+uniform vec2  anchor;
+uniform vec2  fill_scale;
+uniform vec2  fill_translation;
+uniform float angle;
+uniform float aspect_ratio;
+uniform bool  bottom_up;
+
 void main()
 {
-    TexCoord = TexCoordIn;
-    vec4 pos = vec4(Position, 0, 1);
-    TexCoord2 = vec4(pos.xy, 0.0, 0.0);
-    pos.x = pos.x*2.0 - 1.0;
-    pos.y = pos.y*2.0 - 1.0;
-    gl_Position = pos;
+    // Quads are drawn as indexed triangles, at a base vertex that is a multiple of 4. Meshes have no corners, they
+    // are drawn without perspective offsets and with a q of 1.
+    int corner = gl_VertexID % 4;
+
+    vec2 tex     = TexCoordIn.st;
+    vec2 cropped = clamp(tex, crop_ul, crop_lr);
+    vec2 pos     = Position + (cropped - tex) * crop_scale;
+    tex          = cropped;
+
+    if (bottom_up) {
+        tex.y = 1.0 - tex.y;
+    }
+
+    pos += perspective[corner];
+
+    vec2 orig = (pos - anchor) * fill_scale;
+    orig.y /= aspect_ratio;
+    pos.x = orig.x * cos(angle) - orig.y * sin(angle);
+    pos.y = (orig.x * sin(angle) + orig.y * cos(angle)) * aspect_ratio;
+    pos += fill_translation;
+
+    float q   = texture_q[corner];
+    TexCoord  = vec4(tex * q, TexCoordIn.p, TexCoordIn.q * q);
+    TexCoord2 = vec4(pos, 0.0, 0.0);
+
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
 }
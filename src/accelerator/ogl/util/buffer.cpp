@@ -26,6 +26,8 @@
 
 #include <GL/glew.h>
 
+#include <mutex>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 static tbb::atomic<int>         g_w_total_count;
@@ -42,6 +44,9 @@ struct buffer::impl
     GLenum     target_ = 0;
     GLbitfield flags_  = 0;
 
+    std::mutex          fence_mutex_;
+    std::vector<GLsync> fences_;
+
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
 
@@ -62,6 +67,10 @@ struct buffer::impl
 
     ~impl()
     {
+        for (auto fence : fences_) {
+            glDeleteSync(fence);
+        }
+
         GL(glUnmapNamedBuffer(id_));
         glDeleteBuffers(1, &id_);
 
@@ -72,6 +81,18 @@ struct buffer::impl
     void bind() { GL(glBindBuffer(target_, id_)); }
 
     void unbind() { GL(glBindBuffer(target_, 0)); }
+
+    void add_fence(GLsync fence)
+    {
+        std::lock_guard<std::mutex> lock(fence_mutex_);
+        fences_.push_back(fence);
+    }
+
+    std::vector<GLsync> take_fences()
+    {
+        std::lock_guard<std::mutex> lock(fence_mutex_);
+        return std::move(fences_);
+    }
 };
 
 buffer::buffer(int size, bool write)
@@ -88,12 +109,14 @@ buffer& buffer::operator=(buffer&& other)
     impl_ = std::move(other.impl_);
     return *this;
 }
-void* buffer::data() { return impl_->data_; }
-bool  buffer::write() const { return impl_->write_; }
-int   buffer::size() const { return impl_->size_; }
-void  buffer::bind() { return impl_->bind(); }
-void  buffer::unbind() { return impl_->unbind(); }
-int   buffer::id() const { return impl_->id_; }
+void*               buffer::data() { return impl_->data_; }
+bool                buffer::write() const { return impl_->write_; }
+int                 buffer::size() const { return impl_->size_; }
+void                buffer::bind() { return impl_->bind(); }
+void                buffer::unbind() { return impl_->unbind(); }
+int                 buffer::id() const { return impl_->id_; }
+void                buffer::add_fence(GLsync fence) { impl_->add_fence(fence); }
+std::vector<GLsync> buffer::take_fences() { return impl_->take_fences(); }
 
 boost::property_tree::wptree buffer::info()
 {
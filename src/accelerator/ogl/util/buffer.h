@@ -21,8 +21,12 @@
 
 #pragma once
 
+#include <GL/glew.h>
+
 #include <boost/property_tree/ptree.hpp>
+
 #include <memory>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -47,6 +51,10 @@ class buffer final
     int   size() const;
     bool  write() const;
 
+    // Fences the gpu commands that use the buffer. The buffer must not be reused before they have signalled.
+    void                add_fence(GLsync fence);
+    std::vector<GLsync> take_fences();
+
   private:
     struct impl;
     std::unique_ptr<impl> impl_;
@@ -21,16 +21,23 @@
 #include "device.h"
 
 #include "buffer.h"
+#include "pool.h"
 #include "shader.h"
 #include "texture.h"
+#include "timer_query.h"
 
 #include <common/array.h>
 #include <common/assert.h>
 #include <common/env.h>
 #include <common/except.h>
+#include <common/executor.h>
 #include <common/gl/gl_check.h>
 #include <common/os/thread.h>
 
+#include <core/diagnostics/memory.h>
+#include <core/diagnostics/trace.h>
+#include <core/frame/pixel_format.h>
+
 #include <GL/glew.h>
 
 #include <SFML/Window/Context.hpp>
@@ -42,15 +49,21 @@
 
 #include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/spawn.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include <tbb/concurrent_queue.h>
-#include <tbb/concurrent_unordered_map.h>
+#include <tbb/parallel_for.h>
 
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <future>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -58,17 +71,38 @@ using namespace boost::asio;
 
 struct device::impl : public std::enable_shared_from_this<impl>
 {
-    using texture_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<texture>>;
-    using buffer_queue_t  = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
-
+    const int   index_;
     sf::Context device_;
 
-    std::array<tbb::concurrent_unordered_map<size_t, texture_queue_t>, 4> device_pools_;
-    std::array<tbb::concurrent_unordered_map<size_t, buffer_queue_t>, 2>  host_pools_;
+    pool<texture> device_pool_;
+    pool<buffer>  host_pool_;
+
+    struct fence_task
+    {
+        GLsync                                fence = nullptr;
+        std::chrono::steady_clock::time_point start;
+        std::function<void(double)>           done;
+    };
+
+    tbb::concurrent_bounded_queue<fence_task> fence_queue_;
+    std::thread                               fence_thread_;
+
+    tbb::concurrent_bounded_queue<std::function<void(timer_query&)>> upload_queue_;
+    std::vector<std::thread>                                         upload_threads_;
+
+    mutable std::mutex readback_mutex_;
+    std::deque<double> readback_latencies_;
+    const std::size_t  max_readback_latencies_ = 512;
+
+    // Gpu time of transfers in milliseconds, smoothed over the recent ones.
+    mutable std::mutex gpu_time_mutex_;
+    double             upload_gpu_time_   = 0.0;
+    double             readback_gpu_time_ = 0.0;
 
-    using sync_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
+    timer_query upload_timer_{[this](double elapsed) { record_gpu_time(upload_gpu_time_, elapsed); }};
+    timer_query readback_timer_{[this](double elapsed) { record_gpu_time(readback_gpu_time_, elapsed); }};
 
-    sync_queue_t sync_queue_;
+    std::atomic<std::size_t> staging_copies_{0};
 
     GLuint fbo_;
 
@@ -83,11 +117,22 @@ struct device::impl : public std::enable_shared_from_this<impl>
     decltype(make_work_guard(service_)) work_;
     std::thread                         thread_;
 
-    impl()
-        : device_(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1)
+    // Allocates host buffers on a shared context so that producers never queue behind rendering.
+    std::unique_ptr<sf::Context> alloc_context_;
+    executor                     alloc_executor_{L"OpenGL Allocator"};
+
+    // Compiles shaders ahead of use on a shared context, so that rendering doesn't wait for them.
+    std::unique_ptr<sf::Context> compile_context_;
+    executor                     compile_executor_{L"OpenGL Compiler"};
+
+    explicit impl(int index)
+        : index_(index)
+        , device_(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1)
+        , device_pool_(env::properties().get(L"configuration.ogl.device-memory-budget", std::size_t(0)) * 1024 * 1024)
+        , host_pool_(env::properties().get(L"configuration.ogl.host-memory-budget", std::size_t(0)) * 1024 * 1024)
         , work_(make_work_guard(service_))
     {
-        CASPAR_LOG(info) << L"Initializing OpenGL Device.";
+        CASPAR_LOG(info) << L"Initializing OpenGL Device " << index_ << L".";
 
         device_.setActive(true);
 
@@ -133,9 +178,55 @@ struct device::impl : public std::enable_shared_from_this<impl>
         }
 #endif
 
+        fence_thread_ = std::thread([&] {
+            // Fences are shared between contexts, wait for them on a context of our own so that the device thread is
+            // free to keep submitting work.
+            sf::Context context(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1);
+            context.setActive(true);
+            set_thread_name(L"OpenGL Fence");
+            set_thread_role(L"gl");
+            run_fences();
+            context.setActive(false);
+        });
+
+        alloc_executor_.invoke([&] {
+            alloc_context_ = std::make_unique<sf::Context>(
+                sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1);
+            alloc_context_->setActive(true);
+        });
+
+        compile_executor_.invoke([&] {
+            compile_context_ = std::make_unique<sf::Context>(
+                sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1);
+            compile_context_->setActive(true);
+        });
+
+        auto upload_threads = env::properties().get(L"configuration.ogl.upload-threads", 0);
+        for (auto n = 0; n < upload_threads; ++n) {
+            upload_threads_.emplace_back([this, n] {
+                sf::Context context(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1);
+                context.setActive(true);
+                set_thread_name(L"OpenGL Upload " + std::to_wstring(n));
+                set_thread_role(L"gl");
+                {
+                    timer_query timer([this](double elapsed) { record_gpu_time(upload_gpu_time_, elapsed); });
+                    while (true) {
+                        std::function<void(timer_query&)> task;
+                        upload_queue_.pop(task);
+                        if (!task) {
+                            break;
+                        }
+                        task(timer);
+                    }
+                }
+                context.setActive(false);
+            });
+        }
+
         thread_ = std::thread([&] {
             device_.setActive(true);
-            set_thread_name(L"OpenGL Device");
+            set_thread_name(L"OpenGL Device " + std::to_wstring(index_));
+            set_thread_role(L"gl");
             service_.run();
             device_.setActive(false);
         });
@@ -143,18 +234,30 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
     ~impl()
     {
+        // Uploads may still dispatch to the device thread, stop them first.
+        for (std::size_t n = 0; n < upload_threads_.size(); ++n) {
+            upload_queue_.push(nullptr);
+        }
+        for (auto& thread : upload_threads_) {
+            thread.join();
+        }
+
+        alloc_executor_.invoke([&] { alloc_context_.reset(); });
+        alloc_executor_.stop();
+
+        compile_executor_.invoke([&] { compile_context_.reset(); });
+        compile_executor_.stop();
+
         work_.reset();
         thread_.join();
 
-        device_.setActive(true);
-
-        for (auto& pool : host_pools_)
-            pool.clear();
+        fence_queue_.push(fence_task{});
+        fence_thread_.join();
 
-        for (auto& pool : device_pools_)
-            pool.clear();
+        device_.setActive(true);
 
-        sync_queue_.clear();
+        host_pool_.clear();
+        device_pool_.clear();
 
         GL(glDeleteFramebuffers(1, &fbo_));
     }
@@ -189,19 +292,227 @@ struct device::impl : public std::enable_shared_from_this<impl>
         return dispatch_async(std::forward<Func>(func)).get();
     }
 
+    // Blocks the calling thread until the GPU has passed the fence.
+    static void client_wait(GLsync fence)
+    {
+        while (true) {
+            auto wait = glClientWaitSync(fence, 0, 100000000);
+            if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
+                break;
+            }
+            if (wait == GL_WAIT_FAILED) {
+                CASPAR_LOG(warning) << L" ogl: glClientWaitSync failed.";
+                break;
+            }
+        }
+    }
+
+    void run_fences()
+    {
+        while (true) {
+            fence_task task;
+            fence_queue_.pop(task);
+
+            if (!task.fence) {
+                break;
+            }
+
+            client_wait(task.fence);
+
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - task.start).count();
+            task.done(elapsed);
+        }
+    }
+
+    // Suspends the calling coroutine until the GPU has passed the fence. Returns the time in seconds it took.
+    double wait_fence(GLsync fence, yield_context yield)
+    {
+        deadline_timer timer(service_);
+        timer.expires_at(boost::posix_time::pos_infin);
+
+        double elapsed = 0.0;
+
+        fence_task task;
+        task.fence = fence;
+        task.start = std::chrono::steady_clock::now();
+        task.done  = [&](double value) {
+            // Resumed through the device thread, which is still inside this coroutine until it yields below.
+            boost::asio::post(service_, [&, value] {
+                elapsed = value;
+                timer.cancel();
+            });
+        };
+        fence_queue_.push(std::move(task));
+
+        boost::system::error_code ec;
+        timer.async_wait(yield[ec]);
+
+        return elapsed;
+    }
+
+    void record_readback(double latency)
+    {
+        std::lock_guard<std::mutex> lock(readback_mutex_);
+        readback_latencies_.push_back(latency);
+        while (readback_latencies_.size() > max_readback_latencies_) {
+            readback_latencies_.pop_front();
+        }
+    }
+
+    void record_gpu_time(double& average, double elapsed)
+    {
+        std::lock_guard<std::mutex> lock(gpu_time_mutex_);
+        average = average * 0.9 + elapsed * 0.1;
+    }
+
     std::wstring version() { return version_; }
 
-    std::shared_ptr<texture> create_texture(int width, int height, int stride, bool clear)
+    static std::uint64_t texture_key(int                 width,
+                                     int                 height,
+                                     int                 stride,
+                                     int                 depth,
+                                     bool                half_float,
+                                     bool                mipmaps,
+                                     texture_compression compression = texture_compression::none)
+    {
+        return static_cast<std::uint64_t>(compression) << 50 | static_cast<std::uint64_t>(mipmaps ? 1 : 0) << 49 |
+               static_cast<std::uint64_t>(half_float ? 1 : 0) << 48 | static_cast<std::uint64_t>(depth) << 40 |
+               static_cast<std::uint64_t>(stride) << 32 |
+               static_cast<std::uint64_t>(width & 0xFFFF) << 16 | static_cast<std::uint64_t>(height & 0xFFFF);
+    }
+
+    static std::uint64_t buffer_key(int size, bool write)
+    {
+        return static_cast<std::uint64_t>(write ? 1 : 0) << 32 | static_cast<std::uint64_t>(size);
+    }
+
+    // Rounds size up so that at most a quarter of a buffer is wasted, odd sized frames can then share buffers.
+    static int size_class(int size)
+    {
+        auto step = 4096;
+        while (step * 8 < size) {
+            step *= 2;
+        }
+        return (size + step - 1) / step * step;
+    }
+
+    template <typename T>
+    void release(std::vector<std::shared_ptr<T>> items)
+    {
+        if (!items.empty()) {
+            // Objects have to be deleted with an active context.
+            boost::asio::post(service_, [items = std::move(items)] {});
+        }
+    }
+
+    void return_texture(std::shared_ptr<texture> tex)
+    {
+        auto key  = texture_key(tex->width(),
+                               tex->height(),
+                               tex->stride(),
+                               tex->depth(),
+                               tex->half_float(),
+                               tex->mipmaps(),
+                               tex->compression());
+        auto size = static_cast<std::size_t>(tex->device_size());
+        release(device_pool_.push(key, size, std::move(tex)));
+    }
+
+    void return_buffer(std::shared_ptr<buffer> buf)
+    {
+        auto key  = buffer_key(buf->size(), buf->write());
+        auto size = static_cast<std::size_t>(buf->size());
+        release(host_pool_.push(key, size, std::move(buf)));
+    }
+
+    std::shared_ptr<buffer> allocate_buffer(int size, bool write)
+    {
+        auto buf = std::make_shared<buffer>(size, write);
+        if (std::this_thread::get_id() != thread_.get_id()) {
+            // Make sure the buffer exists before it is used by another context.
+            GL(glFinish());
+        }
+        host_pool_.allocated(size);
+        return buf;
+    }
+
+    // Returns a buffer to the device, and the bytes charged for it to the account of its owner.
+    struct buffer_deleter
+    {
+        std::shared_ptr<buffer>                            buf;
+        std::shared_ptr<impl>                              self;
+        std::shared_ptr<core::diagnostics::memory_account> account;
+
+        void operator()(buffer*)
+        {
+            if (account) {
+                account->add(core::diagnostics::memory_kind::host, -buf->size());
+            }
+            self->recycle_buffer(std::move(buf));
+        }
+    };
+
+    // The account that the buffer of data is charged to, textures uploaded from it go to the same owner.
+    static std::shared_ptr<core::diagnostics::memory_account> owner_of(const array<const uint8_t>& data)
+    {
+        auto buf     = data.storage<std::shared_ptr<buffer>>();
+        auto deleter = buf ? std::get_deleter<buffer_deleter>(*buf) : nullptr;
+        return deleter ? deleter->account : nullptr;
+    }
+
+    static std::shared_ptr<texture> charge(std::shared_ptr<texture>                           tex,
+                                           std::shared_ptr<core::diagnostics::memory_account> account)
+    {
+        if (!tex || !account) {
+            return tex;
+        }
+
+        const auto size = static_cast<std::int64_t>(tex->device_size());
+        account->add(core::diagnostics::memory_kind::device, size);
+
+        auto ptr = tex.get();
+        return std::shared_ptr<texture>(ptr, [tex = std::move(tex), account = std::move(account), size](texture*) {
+            account->add(core::diagnostics::memory_kind::device, -size);
+        });
+    }
+
+    // Returns the buffer to the pool once the gpu is done with it.
+    void recycle_buffer(std::shared_ptr<buffer> buf)
+    {
+        auto fences = buf->take_fences();
+        if (fences.empty()) {
+            return_buffer(std::move(buf));
+            return;
+        }
+
+        // The fence thread waits in order, so the buffer is free once the last fence has been passed.
+        for (std::size_t n = 0; n < fences.size(); ++n) {
+            fence_task task;
+            task.fence = fences[n];
+            task.start = std::chrono::steady_clock::now();
+            if (n + 1 < fences.size()) {
+                task.done = [fence = fences[n]](double) { glDeleteSync(fence); };
+            } else {
+                task.done = [this, fence = fences[n], buf](double) mutable {
+                    glDeleteSync(fence);
+                    return_buffer(std::move(buf));
+                };
+            }
+            fence_queue_.push(std::move(task));
+        }
+    }
+
+    std::shared_ptr<texture>
+    create_texture(int width, int height, int stride, int depth, bool half_float, bool mipmaps, bool clear)
     {
         CASPAR_VERIFY(stride > 0 && stride < 5);
+        CASPAR_VERIFY(depth == 1 || depth == 2);
         CASPAR_VERIFY(width > 0 && height > 0);
 
-        // TODO (perf) Shared pool.
-        auto pool = &device_pools_[stride - 1][(width << 16 & 0xFFFF0000) | (height & 0x0000FFFF)];
-
-        std::shared_ptr<texture> tex;
-        if (!pool->try_pop(tex)) {
-            tex = std::make_shared<texture>(width, height, stride);
+        auto tex = device_pool_.pop(texture_key(width, height, stride, depth, half_float, mipmaps));
+        if (!tex) {
+            tex = std::make_shared<texture>(width, height, stride, depth, half_float, mipmaps);
+            device_pool_.allocated(tex->device_size());
         }
 
         if (clear) {
@@ -209,103 +520,260 @@ struct device::impl : public std::enable_shared_from_this<impl>
         }
 
         auto ptr = tex.get();
-        return std::shared_ptr<texture>(
-            ptr, [tex = std::move(tex), pool, self = shared_from_this()](texture*) mutable { pool->push(tex); });
+        return std::shared_ptr<texture>(ptr, [tex = std::move(tex), self = shared_from_this()](texture*) mutable {
+            self->return_texture(std::move(tex));
+        });
+    }
+
+    std::shared_ptr<texture> create_texture(int width, int height, texture_compression compression)
+    {
+        CASPAR_VERIFY(width > 0 && height > 0);
+
+        auto tex = device_pool_.pop(texture_key(width, height, 4, 1, false, false, compression));
+        if (!tex) {
+            tex = std::make_shared<texture>(width, height, compression);
+            device_pool_.allocated(tex->device_size());
+        }
+
+        auto ptr = tex.get();
+        return std::shared_ptr<texture>(ptr, [tex = std::move(tex), self = shared_from_this()](texture*) mutable {
+            self->return_texture(std::move(tex));
+        });
     }
 
     std::shared_ptr<buffer> create_buffer(int size, bool write)
     {
         CASPAR_VERIFY(size > 0);
 
-        // TODO (perf) Shared pool.
-        auto pool = &host_pools_[static_cast<int>(write ? 1 : 0)][size];
+        size = size_class(size);
+
+        auto key = buffer_key(size, write);
+        auto buf = host_pool_.pop(key);
+        if (!buf) {
+            if (std::this_thread::get_id() == thread_.get_id()) {
+                buf = allocate_buffer(size, write);
+            } else {
+                buf = alloc_executor_.invoke([&] { return allocate_buffer(size, write); });
+            }
+        }
+
+        // Keep a spare buffer ready so that the next frame of this size is served straight from the pool.
+        if (write && host_pool_.count(key) == 0 && alloc_executor_.is_running()) {
+            alloc_executor_.begin_invoke([=] {
+                if (host_pool_.count(key) == 0) {
+                    return_buffer(allocate_buffer(size, write));
+                }
+            });
+        }
 
-        std::shared_ptr<buffer> buf;
-        if (!pool->try_pop(buf)) {
-            // TODO (perf) Avoid blocking in create_array.
-            dispatch_sync([&] { buf = std::make_shared<buffer>(size, write); });
+        // Charged to the layer or channel that the calling thread works for, e.g. the decoder of a producer.
+        auto account = core::diagnostics::memory_account::for_owner();
+        if (account) {
+            account->add(core::diagnostics::memory_kind::host, buf->size());
         }
 
         auto ptr = buf.get();
-        return std::shared_ptr<buffer>(ptr, [buf = std::move(buf), self = shared_from_this()](buffer*) mutable {
-            self->sync_queue_.emplace(std::move(buf));
-        });
+        return std::shared_ptr<buffer>(ptr, buffer_deleter{std::move(buf), shared_from_this(), std::move(account)});
     }
 
     array<uint8_t> create_array(int size)
     {
         auto buf = create_buffer(size, true);
         auto ptr = reinterpret_cast<uint8_t*>(buf->data());
-        return array<uint8_t>(ptr, buf->size(), buf);
+        return array<uint8_t>(ptr, size, buf);
+    }
+
+    std::shared_ptr<texture> upload(const array<const uint8_t>& source, int width, int height, int stride, int depth)
+    {
+        auto buf = *source.storage<std::shared_ptr<buffer>>();
+
+        auto tex = create_texture(width, height, stride, depth, false, false, false);
+        tex->copy_from(*buf);
+        tex->fence();
+
+        buf->add_fence(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        GL(glFlush());
+
+        return tex;
+    }
+
+    std::shared_ptr<texture>
+    upload(const array<const uint8_t>& source, int width, int height, texture_compression compression)
+    {
+        auto buf = *source.storage<std::shared_ptr<buffer>>();
+
+        auto tex = create_texture(width, height, compression);
+        tex->copy_from(*buf);
+        tex->fence();
+
+        buf->add_fence(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        GL(glFlush());
+
+        return tex;
+    }
+
+    // Copies previous on the gpu and only uploads the regions of source that changed.
+    std::shared_ptr<texture> upload(const array<const uint8_t>&            source,
+                                    const std::shared_ptr<texture>&        previous,
+                                    const std::vector<core::image_region>& regions)
+    {
+        auto buf = *source.storage<std::shared_ptr<buffer>>();
+
+        auto tex = create_texture(previous->width(),
+                                  previous->height(),
+                                  previous->stride(),
+                                  previous->depth(),
+                                  previous->half_float(),
+                                  false,
+                                  false);
+        tex->copy_from(previous->id());
+        for (auto& region : regions) {
+            tex->copy_from(*buf, region.x, region.y, region.width, region.height);
+        }
+        tex->fence();
+
+        buf->add_fence(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        GL(glFlush());
+
+        return tex;
+    }
+
+    // Returns source if it is already backed by a pbo, otherwise stages it into a pooled one using tbb workers.
+    array<const uint8_t> stage(const array<const uint8_t>& source)
+    {
+        if (source.storage<std::shared_ptr<buffer>>()) {
+            return source;
+        }
+
+        ++staging_copies_;
+
+        auto buf  = create_buffer(static_cast<int>(source.size()), true);
+        auto dest = reinterpret_cast<uint8_t*>(buf->data());
+        auto src  = source.data();
+
+        const std::size_t grain = 1 << 20;
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, source.size(), grain), [&](const auto& r) {
+            std::memcpy(dest + r.begin(), src + r.begin(), r.size());
+        });
+
+        return array<const uint8_t>(dest, source.size(), std::move(buf));
     }
 
     std::future<std::shared_ptr<texture>>
-    copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+    copy_async(const array<const uint8_t>& data, int width, int height, int stride, int depth)
     {
-        return dispatch_async([=] {
-            std::shared_ptr<buffer> buf;
+        auto source  = stage(data);
+        auto account = owner_of(source);
+        return upload_async([=] { return charge(upload(source, width, height, stride, depth), account); });
+    }
 
-            auto tmp = source.storage<std::shared_ptr<buffer>>();
-            if (tmp) {
-                buf = *tmp;
-            } else {
-                buf = create_buffer(static_cast<int>(source.size()), true);
-                // TODO (perf) Copy inside a TBB worker.
-                std::memcpy(buf->data(), source.data(), source.size());
+    std::future<std::shared_ptr<texture>>
+    copy_async(const array<const uint8_t>& data, int width, int height, texture_compression compression)
+    {
+        auto source  = stage(data);
+        auto account = owner_of(source);
+        return upload_async([=] { return charge(upload(source, width, height, compression), account); });
+    }
+
+    std::future<std::shared_ptr<texture>> copy_async(const array<const uint8_t>&                         data,
+                                                     const std::shared_future<std::shared_ptr<texture>>& previous,
+                                                     const std::vector<core::image_region>&              regions)
+    {
+        auto source  = stage(data);
+        auto account = owner_of(source);
+
+        // previous was queued before this upload, so it is ready or completes without waiting on it.
+        return upload_async([=] { return charge(upload(source, previous.get(), regions), account); });
+    }
+
+    template <typename Func>
+    std::future<std::shared_ptr<texture>> upload_async(Func&& func)
+    {
+        if (upload_threads_.empty()) {
+            return dispatch_async([this, func = std::forward<Func>(func)] {
+                scoped_timer_query query(upload_timer_);
+                return func();
+            });
+        }
+
+        // Upload on a shared context and only hand the texture over once the transfer has completed, so that the
+        // device thread never waits for it.
+        using task_type = std::packaged_task<std::shared_ptr<texture>(timer_query&)>;
+        auto task       = std::make_shared<task_type>([func = std::forward<Func>(func)](timer_query& timer) {
+            CASPAR_TRACE_SCOPE("device::copy_async upload");
+
+            std::shared_ptr<texture> tex;
+            {
+                scoped_timer_query query(timer);
+                tex = func();
             }
 
-            auto tex = create_texture(width, height, stride, false);
-            tex->copy_from(*buf);
-            // TODO (perf) save tex on source
+            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            GL(glFlush());
+            client_wait(fence);
+            glDeleteSync(fence);
+
             return tex;
         });
+        auto future = task->get_future();
+        upload_queue_.push([task](timer_query& timer) { (*task)(timer); });
+        return future;
     }
 
     std::future<array<const uint8_t>> copy_async(const std::shared_ptr<texture>& source)
     {
         return spawn_async([=](yield_context yield) {
-            auto buf = create_buffer(source->size(), false);
-            source->copy_to(*buf);
+            CASPAR_TRACE_SCOPE("device::copy_async readback");
 
-            sync_queue_.push(nullptr);
+            auto buf = create_buffer(source->size(), false);
+            {
+                scoped_timer_query query(readback_timer_);
+                source->copy_to(*buf);
+            }
 
             auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
             GL(glFlush());
 
-            deadline_timer timer(service_);
-            for (auto n = 0; true; ++n) {
-                // TODO (perf) Smarter non-polling solution?
-                timer.expires_from_now(boost::posix_time::milliseconds(2));
-                timer.async_wait(yield);
-
-                auto wait = glClientWaitSync(fence, 0, 1);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    break;
-                }
-            }
+            record_readback(wait_fence(fence, yield));
 
             glDeleteSync(fence);
 
-            {
-                std::shared_ptr<buffer> buf2;
-                while (sync_queue_.try_pop(buf2) && buf2) {
-                    auto pool = &host_pools_[static_cast<int>(buf2->write() ? 1 : 0)][buf2->size()];
-                    pool->push(std::move(buf2));
-                }
-            }
-
             auto ptr  = reinterpret_cast<uint8_t*>(buf->data());
-            auto size = buf->size();
+            auto size = source->size();
             return array<const uint8_t>(ptr, size, std::move(buf));
         });
     }
 
+    std::shared_ptr<texture> create_mipmaps(const std::shared_ptr<texture>& source)
+    {
+        auto tex = create_texture(
+            source->width(), source->height(), source->stride(), source->depth(), source->half_float(), true, false);
+        tex->copy_from(source->id());
+        tex->generate_mipmaps();
+        return tex;
+    }
+
+    std::future<std::shared_ptr<texture>> finish_async(const std::shared_ptr<texture>& source)
+    {
+        return spawn_async([=](yield_context yield) {
+            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            GL(glFlush());
+
+            wait_fence(fence, yield);
+
+            glDeleteSync(fence);
+
+            return source;
+        });
+    }
+
 #ifdef WIN32
     std::future<std::shared_ptr<texture>> copy_async(GLuint source, int width, int height, int stride)
     {
         return spawn_async([=](yield_context yield) {
-            auto tex = create_texture(width, height, stride, false);
+            auto tex = create_texture(width, height, stride, 1, false, false, false);
 
             tex->copy_from(source);
 
@@ -313,17 +781,7 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
             GL(glFlush());
 
-            deadline_timer timer(service_);
-            for (auto n = 0; true; ++n) {
-                // TODO (perf) Smarter non-polling solution?
-                timer.expires_from_now(boost::posix_time::milliseconds(2));
-                timer.async_wait(yield);
-
-                auto wait = glClientWaitSync(fence, 0, 1);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    break;
-                }
-            }
+            wait_fence(fence, yield);
 
             glDeleteSync(fence);
 
@@ -337,37 +795,21 @@ struct device::impl : public std::enable_shared_from_this<impl>
         boost::property_tree::wptree info;
 
         boost::property_tree::wptree pooled_device_buffers;
-        size_t                       total_pooled_device_buffer_size  = 0;
-        size_t                       total_pooled_device_buffer_count = 0;
-
-        for (size_t i = 0; i < device_pools_.size(); ++i) {
-            auto& pools      = device_pools_.at(i);
-            bool  mipmapping = i > 3;
-            auto  stride     = mipmapping ? i - 3 : i + 1;
-
-            for (auto& pool : pools) {
-                auto width  = pool.first >> 16;
-                auto height = pool.first & 0x0000FFFF;
-                auto size   = width * height * stride;
-                auto count  = pool.second.size();
-
-                if (count == 0)
-                    continue;
 
-                boost::property_tree::wptree pool_info;
+        for (auto& entry : device_pool_.get_keys()) {
+            boost::property_tree::wptree pool_info;
 
-                pool_info.add(L"stride", stride);
-                pool_info.add(L"mipmapping", mipmapping);
-                pool_info.add(L"width", width);
-                pool_info.add(L"height", height);
-                pool_info.add(L"size", size);
-                pool_info.add(L"count", count);
+            pool_info.add(L"compression", entry.key >> 50 & 0x3);
+            pool_info.add(L"mipmaps", (entry.key >> 49 & 0x1) != 0);
+            pool_info.add(L"half-float", (entry.key >> 48 & 0x1) != 0);
+            pool_info.add(L"depth", entry.key >> 40 & 0xFF);
+            pool_info.add(L"stride", entry.key >> 32 & 0xFF);
+            pool_info.add(L"width", entry.key >> 16 & 0xFFFF);
+            pool_info.add(L"height", entry.key & 0xFFFF);
+            pool_info.add(L"size", entry.size);
+            pool_info.add(L"count", entry.count);
 
-                total_pooled_device_buffer_size += size * count;
-                total_pooled_device_buffer_count += count;
-
-                pooled_device_buffers.add_child(L"device_buffer_pool", pool_info);
-            }
+            pooled_device_buffers.add_child(L"device_buffer_pool", pool_info);
         }
 
         info.add_child(L"gl.details.pooled_device_buffers", pooled_device_buffers);
@@ -378,39 +820,83 @@ struct device::impl : public std::enable_shared_from_this<impl>
         size_t                       total_read_count  = 0;
         size_t                       total_write_count = 0;
 
-        for (size_t i = 0; i < host_pools_.size(); ++i) {
-            auto& pools    = host_pools_.at(i);
-            auto  is_write = i == 1;
-
-            for (auto& pool : pools) {
-                auto size  = pool.first;
-                auto count = pool.second.size();
+        for (auto& entry : host_pool_.get_keys()) {
+            auto is_write = (entry.key >> 32) != 0;
 
-                if (count == 0)
-                    continue;
+            boost::property_tree::wptree pool_info;
 
-                boost::property_tree::wptree pool_info;
+            pool_info.add(L"usage", is_write ? L"write_only" : L"read_only");
+            pool_info.add(L"size", entry.size);
+            pool_info.add(L"count", entry.count);
 
-                pool_info.add(L"usage", is_write ? L"write_only" : L"read_only");
-                pool_info.add(L"size", size);
-                pool_info.add(L"count", count);
+            pooled_host_buffers.add_child(L"host_buffer_pool", pool_info);
 
-                pooled_host_buffers.add_child(L"host_buffer_pool", pool_info);
-
-                (is_write ? total_write_count : total_read_count) += count;
-                (is_write ? total_write_size : total_read_size) += size * count;
-            }
+            (is_write ? total_write_count : total_read_count) += entry.count;
+            (is_write ? total_write_size : total_read_size) += entry.size * entry.count;
         }
 
         info.add_child(L"gl.details.pooled_host_buffers", pooled_host_buffers);
-        info.add(L"gl.summary.pooled_device_buffers.total_count", total_pooled_device_buffer_count);
-        info.add(L"gl.summary.pooled_device_buffers.total_size", total_pooled_device_buffer_size);
-        // info.add_child(L"gl.summary.all_device_buffers", texture::info());
+
+        auto device_stats = device_pool_.get_stats();
+        info.add(L"gl.summary.pooled_device_buffers.total_count", device_stats.pooled_count);
+        info.add(L"gl.summary.pooled_device_buffers.total_size", device_stats.pooled_size);
         info.add(L"gl.summary.pooled_host_buffers.total_read_count", total_read_count);
         info.add(L"gl.summary.pooled_host_buffers.total_write_count", total_write_count);
         info.add(L"gl.summary.pooled_host_buffers.total_read_size", total_read_size);
         info.add(L"gl.summary.pooled_host_buffers.total_write_size", total_write_size);
+
+        auto add_pool_stats = [&](const std::wstring& path, std::size_t budget, const auto& stats) {
+            info.add(path + L".budget", budget);
+            info.add(path + L".allocated_count", stats.allocated_count);
+            info.add(path + L".allocated_size", stats.allocated_size);
+            info.add(path + L".pooled_count", stats.pooled_count);
+            info.add(path + L".pooled_size", stats.pooled_size);
+            info.add(path + L".high_water_mark", stats.high_water_mark);
+            info.add(path + L".evicted_count", stats.evicted_count);
+        };
+
+        add_pool_stats(L"gl.summary.device_pool", device_pool_.budget(), device_stats);
+        add_pool_stats(L"gl.summary.host_pool", host_pool_.budget(), host_pool_.get_stats());
+        // info.add_child(L"gl.summary.all_device_buffers", texture::info());
         info.add_child(L"gl.summary.all_host_buffers", buffer::info());
+        info.add(L"gl.summary.staging_copies", staging_copies_.load());
+        {
+            std::lock_guard<std::mutex> lock(gpu_time_mutex_);
+            info.add(L"gl.summary.gpu_time.upload", upload_gpu_time_);
+            info.add(L"gl.summary.gpu_time.readback", readback_gpu_time_);
+        }
+
+        std::vector<double> latencies;
+        {
+            std::lock_guard<std::mutex> lock(readback_mutex_);
+            latencies.assign(readback_latencies_.begin(), readback_latencies_.end());
+        }
+
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+
+            auto percentile = [&](double p) {
+                return latencies.at(static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1))) * 1000.0;
+            };
+
+            info.add(L"gl.summary.readback_latency.count", latencies.size());
+            info.add(L"gl.summary.readback_latency.min", latencies.front() * 1000.0);
+            info.add(L"gl.summary.readback_latency.p50", percentile(0.50));
+            info.add(L"gl.summary.readback_latency.p95", percentile(0.95));
+            info.add(L"gl.summary.readback_latency.p99", percentile(0.99));
+            info.add(L"gl.summary.readback_latency.max", latencies.back() * 1000.0);
+        }
+
+        boost::property_tree::wptree owners;
+        for (auto& usage : core::diagnostics::memory_usages()) {
+            boost::property_tree::wptree owner_info;
+            owner_info.add(L"channel", usage.owner.video_channel);
+            owner_info.add(L"layer", usage.owner.layer);
+            owner_info.add(L"host_size", usage.host);
+            owner_info.add(L"device_size", usage.device);
+            owners.add_child(L"owner", owner_info);
+        }
+        info.add_child(L"gl.summary.owners", owners);
 
         return info;
     }
@@ -421,14 +907,8 @@ struct device::impl : public std::enable_shared_from_this<impl>
             CASPAR_LOG(info) << " ogl: Running GC.";
 
             try {
-                for (auto& pools : device_pools_) {
-                    for (auto& pool : pools)
-                        pool.second.clear();
-                }
-                for (auto& pools : host_pools_) {
-                    for (auto& pool : pools)
-                        pool.second.clear();
-                }
+                device_pool_.clear();
+                host_pool_.clear();
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
@@ -436,25 +916,44 @@ struct device::impl : public std::enable_shared_from_this<impl>
     }
 };
 
-device::device()
-    : impl_(new impl())
+device::device(int index)
+    : impl_(new impl(index))
 {
 }
 device::~device() {}
-std::shared_ptr<texture> device::create_texture(int width, int height, int stride)
+std::shared_ptr<texture> device::create_texture(int width, int height, int stride, int depth, bool half_float)
+{
+    return impl_->create_texture(width, height, stride, depth, half_float, false, true);
+}
+std::shared_ptr<texture> device::create_mipmaps(const std::shared_ptr<texture>& source)
 {
-    return impl_->create_texture(width, height, stride, true);
+    return impl_->create_mipmaps(source);
 }
 array<uint8_t> device::create_array(int size) { return impl_->create_array(size); }
 std::future<std::shared_ptr<texture>>
-device::copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+device::copy_async(const array<const uint8_t>& source, int width, int height, int stride, int depth)
 {
-    return impl_->copy_async(source, width, height, stride);
+    return impl_->copy_async(source, width, height, stride, depth);
+}
+std::future<std::shared_ptr<texture>>
+device::copy_async(const array<const uint8_t>& source, int width, int height, texture_compression compression)
+{
+    return impl_->copy_async(source, width, height, compression);
+}
+std::future<std::shared_ptr<texture>> device::copy_async(const array<const uint8_t>&                         source,
+                                                        const std::shared_future<std::shared_ptr<texture>>& previous,
+                                                        const std::vector<core::image_region>&              regions)
+{
+    return impl_->copy_async(source, previous, regions);
 }
 std::future<array<const uint8_t>> device::copy_async(const std::shared_ptr<texture>& source)
 {
     return impl_->copy_async(source);
 }
+std::future<std::shared_ptr<texture>> device::finish_async(const std::shared_ptr<texture>& source)
+{
+    return impl_->finish_async(source);
+}
 #ifdef WIN32
 std::shared_ptr<void>                 device::d3d_interop() const { return impl_->interop_handle_; }
 std::future<std::shared_ptr<texture>> device::copy_async(GLuint source, int width, int height, int stride)
@@ -463,6 +962,14 @@ std::future<std::shared_ptr<texture>> device::copy_async(GLuint source, int widt
 }
 #endif
 void         device::dispatch(std::function<void()> func) { boost::asio::dispatch(impl_->service_, std::move(func)); }
+void         device::compile(std::function<void()> func)
+{
+    impl_->compile_executor_.begin_invoke([func = std::move(func)] {
+        func();
+        // Objects are only guaranteed to be complete in other contexts once the commands creating them have finished.
+        GL(glFinish());
+    });
+}
 std::wstring device::version() const { return impl_->version(); }
 boost::property_tree::wptree device::info() const { return impl_->info(); }
 std::future<void>            device::gc() { return impl_->gc(); }
@@ -23,34 +23,54 @@
 
 #include <accelerator/accelerator.h>
 #include <common/array.h>
+#include <common/forward.h>
 
 #include <functional>
 #include <future>
+#include <vector>
 
 #ifdef WIN32
 #include <GL/glew.h>
 #endif
 
+FORWARD2(caspar, core, struct image_region);
+
 namespace caspar { namespace accelerator { namespace ogl {
 
+enum class texture_compression;
+
 class device final
     : public std::enable_shared_from_this<device>
     , public accelerator_device
 {
   public:
-    device();
+    // Each device has a context and thread of its own. Objects are shared between the contexts of all devices.
+    explicit device(int index = 0);
     ~device();
 
     device(const device&) = delete;
 
     device& operator=(const device&) = delete;
 
-    std::shared_ptr<class texture> create_texture(int width, int height, int stride);
+    std::shared_ptr<class texture>
+                   create_texture(int width, int height, int stride, int depth = 1, bool half_float = false);
     array<uint8_t>                 create_array(int size);
+    // Returns a copy of source with a full chain of mipmaps. Has to be called on the device thread.
+    std::shared_ptr<class texture> create_mipmaps(const std::shared_ptr<class texture>& source);
 
     std::future<std::shared_ptr<class texture>>
-                                      copy_async(const array<const uint8_t>& source, int width, int height, int stride);
+    copy_async(const array<const uint8_t>& source, int width, int height, int stride, int depth = 1);
+    // Uploads the blocks of a block compressed image as they are.
+    std::future<std::shared_ptr<class texture>>
+    copy_async(const array<const uint8_t>& source, int width, int height, texture_compression compression);
+    // Uploads a texture that matches previous apart from regions, which are read from source.
+    std::future<std::shared_ptr<class texture>>
+    copy_async(const array<const uint8_t>&                               source,
+               const std::shared_future<std::shared_ptr<class texture>>& previous,
+               const std::vector<core::image_region>&                    regions);
     std::future<array<const uint8_t>> copy_async(const std::shared_ptr<class texture>& source);
+    // Returns source once the commands that render it have completed, so that other contexts can sample it.
+    std::future<std::shared_ptr<class texture>> finish_async(const std::shared_ptr<class texture>& source);
 #ifdef WIN32
     std::shared_ptr<void>                 d3d_interop() const;
     std::future<std::shared_ptr<texture>> copy_async(GLuint source, int width, int height, int stride);
@@ -73,6 +93,19 @@ class device final
         return dispatch_async(std::forward<Func>(func)).get();
     }
 
+    // Runs func on a shared context of its own, for work such as compiling shaders that shouldn't hold up rendering.
+    template <typename Func>
+    auto compile_async(Func&& func)
+    {
+        using result_type = decltype(func());
+        using task_type   = std::packaged_task<result_type()>;
+
+        auto task   = std::make_shared<task_type>(std::forward<Func>(func));
+        auto future = task->get_future();
+        compile([=] { (*task)(); });
+        return future;
+    }
+
     std::wstring version() const;
 
     boost::property_tree::wptree info() const;
@@ -80,6 +113,7 @@ class device final
 
   private:
     void dispatch(std::function<void()> func);
+    void compile(std::function<void()> func);
     struct impl;
     std::shared_ptr<impl> impl_;
 };
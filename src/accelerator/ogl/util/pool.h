@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+/**
+ * Pool of idle gpu objects keyed by size class. Objects that are returned are
+ * kept in least recently used order and evicted, oldest first, whenever the
+ * total size of all objects allocated through the pool exceeds the budget.
+ */
+template <typename T>
+class pool final
+{
+    struct entry
+    {
+        std::uint64_t      key;
+        std::size_t        size;
+        std::shared_ptr<T> item;
+    };
+
+    using list_t = std::list<entry>;
+
+  public:
+    struct stats
+    {
+        std::size_t allocated_size  = 0;
+        std::size_t allocated_count = 0;
+        std::size_t pooled_size     = 0;
+        std::size_t pooled_count    = 0;
+        std::size_t high_water_mark = 0;
+        std::size_t evicted_count   = 0;
+    };
+
+    struct key_info
+    {
+        std::uint64_t key;
+        std::size_t   size;
+        std::size_t   count;
+    };
+
+    explicit pool(std::size_t budget = 0)
+        : budget_(budget)
+    {
+    }
+
+    pool(const pool&) = delete;
+    pool& operator=(const pool&) = delete;
+
+    /**
+     * Takes the most recently returned object for key, or returns nullptr.
+     */
+    std::shared_ptr<T> pop(std::uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = index_.find(key);
+        if (it == index_.end() || it->second.empty()) {
+            return nullptr;
+        }
+
+        auto pos = it->second.back();
+        it->second.pop_back();
+
+        auto item = std::move(pos->item);
+        stats_.pooled_size -= pos->size;
+        stats_.pooled_count -= 1;
+        lru_.erase(pos);
+
+        return item;
+    }
+
+    /**
+     * Number of idle objects for key.
+     */
+    std::size_t count(std::uint64_t key) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = index_.find(key);
+        return it == index_.end() ? 0 : it->second.size();
+    }
+
+    /**
+     * Accounts for a newly created object of size bytes.
+     */
+    void allocated(std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        stats_.allocated_size += size;
+        stats_.allocated_count += 1;
+        stats_.high_water_mark = std::max(stats_.high_water_mark, stats_.allocated_size);
+    }
+
+    /**
+     * Returns an object to the pool. Objects evicted to stay within budget
+     * are returned and must be released by the caller on a thread with an
+     * active context.
+     */
+    std::vector<std::shared_ptr<T>> push(std::uint64_t key, std::size_t size, std::shared_ptr<T> item)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        lru_.push_front(entry{key, size, std::move(item)});
+        index_[key].push_back(lru_.begin());
+        stats_.pooled_size += size;
+        stats_.pooled_count += 1;
+
+        std::vector<std::shared_ptr<T>> evicted;
+        while (budget_ > 0 && stats_.allocated_size > budget_ && !lru_.empty()) {
+            evicted.push_back(evict_oldest());
+        }
+        return evicted;
+    }
+
+    /**
+     * Removes all idle objects, which must be released by the caller.
+     */
+    std::vector<std::shared_ptr<T>> clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<std::shared_ptr<T>> evicted;
+        while (!lru_.empty()) {
+            evicted.push_back(evict_oldest());
+        }
+        return evicted;
+    }
+
+    stats get_stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    std::vector<key_info> get_keys() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<key_info> result;
+        for (auto& pair : index_) {
+            if (!pair.second.empty()) {
+                result.push_back(key_info{pair.first, pair.second.front()->size, pair.second.size()});
+            }
+        }
+        return result;
+    }
+
+    std::size_t budget() const { return budget_; }
+
+  private:
+    std::shared_ptr<T> evict_oldest()
+    {
+        auto  pos = std::prev(lru_.end());
+        auto& vec = index_[pos->key];
+        vec.erase(std::find(vec.begin(), vec.end(), pos));
+
+        auto item = std::move(pos->item);
+        stats_.pooled_size -= pos->size;
+        stats_.pooled_count -= 1;
+        stats_.allocated_size -= pos->size;
+        stats_.allocated_count -= 1;
+        stats_.evicted_count += 1;
+        lru_.erase(pos);
+
+        return item;
+    }
+
+    const std::size_t budget_;
+
+    mutable std::mutex                                                        mutex_;
+    list_t                                                                    lru_;
+    std::unordered_map<std::uint64_t, std::vector<typename list_t::iterator>> index_;
+    stats                                                                     stats_;
+};
+
+}}} // namespace caspar::accelerator::ogl
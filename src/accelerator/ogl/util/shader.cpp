@@ -20,19 +20,40 @@
  */
 #include "shader.h"
 
+#include <common/env.h>
 #include <common/gl/gl_check.h>
+#include <common/log.h>
+#include <common/utf.h>
 
 #include <GL/glew.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <array>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 struct shader::impl
 {
-    GLuint                                 program_;
-    std::unordered_map<std::string, GLint> uniform_locations_;
-    std::unordered_map<std::string, GLint> attrib_locations_;
+    // The last value set is kept with the location, so that uniforms which don't change between draws aren't set
+    // again.
+    struct uniform
+    {
+        GLint                location;
+        bool                 is_set = false;
+        std::array<float, 2> value  = {};
+    };
+
+    GLuint                                   program_;
+    std::unordered_map<std::string, uniform> uniforms_;
+    std::unordered_map<std::string, GLint>   attrib_locations_;
 
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
@@ -40,6 +61,95 @@ struct shader::impl
   public:
     impl(const std::string& vertex_source_str, const std::string& fragment_source_str)
         : program_(0)
+    {
+        auto cache_filename = binary_cache_filename(vertex_source_str, fragment_source_str);
+        if (!cache_filename.empty() && load_binary(cache_filename)) {
+            GL(glUseProgramObjectARB(program_));
+            return;
+        }
+
+        compile(vertex_source_str, fragment_source_str);
+
+        if (!cache_filename.empty()) {
+            save_binary(cache_filename);
+        }
+        GL(glUseProgramObjectARB(program_));
+    }
+
+    ~impl() { glDeleteProgram(program_); }
+
+    // Linked programs are kept in the data folder, keyed by their sources and the driver, which is the only one
+    // that can load them.
+    static std::string binary_cache_filename(const std::string& vertex_source_str,
+                                             const std::string& fragment_source_str)
+    {
+        static const bool enabled = env::properties().get(L"configuration.ogl.shader-cache", true);
+        if (!enabled) {
+            return "";
+        }
+
+        std::ostringstream key;
+        key << glGetString(GL_VENDOR) << "|" << glGetString(GL_RENDERER) << "|" << glGetString(GL_VERSION) << "|"
+            << vertex_source_str << "|" << fragment_source_str;
+
+        std::ostringstream str;
+        str << std::hex << std::hash<std::string>{}(key.str()) << ".bin";
+        return u8(env::data_folder()) + "shaders/" + str.str();
+    }
+
+    bool load_binary(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        GLenum format = 0;
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.eof() || binary.empty()) {
+            return false;
+        }
+
+        program_ = glCreateProgram();
+        glProgramBinary(program_, format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+        // Binaries are rejected after driver updates, the program is then compiled from source again.
+        GLint success = GL_FALSE;
+        glGetProgramiv(program_, GL_LINK_STATUS, &success);
+        if (success == GL_FALSE) {
+            glDeleteProgram(program_);
+            program_ = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void save_binary(const std::string& filename) const
+    {
+        try {
+            GLint length = 0;
+            GL(glGetProgramiv(program_, GL_PROGRAM_BINARY_LENGTH, &length));
+            if (length <= 0) {
+                return;
+            }
+
+            GLenum            format = 0;
+            std::vector<char> binary(length);
+            GL(glGetProgramBinary(program_, length, nullptr, &format, binary.data()));
+
+            boost::filesystem::path path(u16(filename));
+            boost::filesystem::create_directories(path.parent_path());
+
+            std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+            file.write(binary.data(), binary.size());
+        } catch (...) {
+            CASPAR_LOG(warning) << L"Failed to write shader cache " << u16(filename);
+        }
+    }
+
+    void compile(const std::string& vertex_source_str, const std::string& fragment_source_str)
     {
         GLint success;
 
@@ -82,6 +192,7 @@ struct shader::impl
         GL(glAttachObjectARB(program_, vertex_shader));
         GL(glAttachObjectARB(program_, fragmemt_shader));
 
+        GL(glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
         GL(glLinkProgramARB(program_));
 
         GL(glDeleteObjectARB(vertex_shader));
@@ -96,19 +207,30 @@ struct shader::impl
             str << "Failed to link shader program:" << std::endl << info << std::endl;
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
         }
-        GL(glUseProgramObjectARB(program_));
     }
 
-    ~impl() { glDeleteProgram(program_); }
-
-    GLint get_uniform_location(const char* name)
+    uniform& get_uniform(const std::string& name)
     {
-        auto it = uniform_locations_.find(name);
-        if (it == uniform_locations_.end())
-            it = uniform_locations_.insert(std::make_pair(name, glGetUniformLocation(program_, name))).first;
+        auto it = uniforms_.find(name);
+        if (it == uniforms_.end()) {
+            uniform u;
+            u.location = glGetUniformLocation(program_, name.c_str());
+            it         = uniforms_.emplace(name, u).first;
+        }
         return it->second;
     }
 
+    // Returns false if the uniform already has the value.
+    static bool update(uniform& u, float value0, float value1)
+    {
+        if (u.is_set && u.value[0] == value0 && u.value[1] == value1) {
+            return false;
+        }
+        u.is_set = true;
+        u.value  = {value0, value1};
+        return true;
+    }
+
     GLint get_attrib_location(const char* name)
     {
         auto it = attrib_locations_.find(name);
@@ -119,20 +241,32 @@ struct shader::impl
 
     void set(const std::string& name, bool value) { set(name, value ? 1 : 0); }
 
-    void set(const std::string& name, int value) { GL(glUniform1i(get_uniform_location(name.c_str()), value)); }
-
-    void set(const std::string& name, float value) { GL(glUniform1f(get_uniform_location(name.c_str()), value)); }
+    void set(const std::string& name, int value)
+    {
+        auto& u = get_uniform(name);
+        if (update(u, static_cast<float>(value), 0.0f)) {
+            GL(glUniform1i(u.location, value));
+        }
+    }
 
-    void set(const std::string& name, double value0, double value1)
+    void set(const std::string& name, float value)
     {
-        GL(glUniform2f(get_uniform_location(name.c_str()), static_cast<float>(value0), static_cast<float>(value1)));
+        auto& u = get_uniform(name);
+        if (update(u, value, 0.0f)) {
+            GL(glUniform1f(u.location, value));
+        }
     }
 
-    void set(const std::string& name, double value)
+    void set(const std::string& name, double value0, double value1)
     {
-        GL(glUniform1f(get_uniform_location(name.c_str()), static_cast<float>(value)));
+        auto& u = get_uniform(name);
+        if (update(u, static_cast<float>(value0), static_cast<float>(value1))) {
+            GL(glUniform2f(u.location, static_cast<float>(value0), static_cast<float>(value1)));
+        }
     }
 
+    void set(const std::string& name, double value) { set(name, static_cast<float>(value)); }
+
     void use() { GL(glUseProgramObjectARB(program_)); }
 };
 
@@ -26,39 +26,93 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
-static GLenum FORMAT[]          = {0, GL_RED, GL_RG, GL_BGR, GL_BGRA};
-static GLenum INTERNAL_FORMAT[] = {0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+static GLenum FORMAT[]             = {0, GL_RED, GL_RG, GL_BGR, GL_BGRA};
+static GLenum INTERNAL_FORMAT[]    = {0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+static GLenum INTERNAL_FORMAT_16[] = {0, GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+static GLenum INTERNAL_FORMAT_F16[] = {0, GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F};
 static GLenum TYPE[] = {0, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_8_8_8_8_REV};
 
 struct texture::impl
 {
     GLuint  id_     = 0;
-    GLsizei width_  = 0;
-    GLsizei height_ = 0;
-    GLsizei stride_ = 0;
-    GLsizei size_   = 0;
+    GLsizei width_      = 0;
+    GLsizei height_     = 0;
+    GLsizei stride_     = 0;
+    GLsizei depth_      = 1;
+    GLsizei size_       = 0;
+    bool    half_float_ = false;
+    GLsizei levels_     = 1;
+    GLsync  fence_      = nullptr;
+
+    texture_compression compression_ = texture_compression::none;
 
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
 
   public:
-    impl(int width, int height, int stride)
+    impl(int width, int height, int stride, int depth, bool half_float, bool mipmaps)
         : width_(width)
         , height_(height)
         , stride_(stride)
-        , size_(width * height * stride)
+        , depth_(depth)
+        , size_(width * height * stride * depth)
+        , half_float_(half_float)
+        , levels_(mipmaps ? 1 + static_cast<GLsizei>(std::log2(std::max(width, height))) : 1)
+    {
+        GL(glCreateTextures(GL_TEXTURE_2D, 1, &id_));
+        GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+        GL(glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL(glTextureStorage2D(id_, levels_, internal_format(), width_, height_));
+    }
+
+    impl(int width, int height, texture_compression compression)
+        : width_(width)
+        , height_(height)
+        , stride_(4)
+        , size_((width + 3) / 4 * ((height + 3) / 4) * (compression == texture_compression::bc1 ? 8 : 16))
+        , compression_(compression)
     {
         GL(glCreateTextures(GL_TEXTURE_2D, 1, &id_));
         GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-        GL(glTextureStorage2D(id_, 1, INTERNAL_FORMAT[stride_], width_, height_));
+        GL(glTextureStorage2D(id_, 1, internal_format(), width_, height_));
     }
 
-    ~impl() { glDeleteTextures(1, &id_); }
+    ~impl()
+    {
+        if (fence_) {
+            glDeleteSync(fence_);
+        }
+        glDeleteTextures(1, &id_);
+    }
+
+    GLenum internal_format() const
+    {
+        switch (compression_) {
+            case texture_compression::bc1:
+                return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case texture_compression::bc3:
+                return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            default:
+                break;
+        }
+        if (half_float_) {
+            return INTERNAL_FORMAT_F16[stride_];
+        }
+        return depth_ > 1 ? INTERNAL_FORMAT_16[stride_] : INTERNAL_FORMAT[stride_];
+    }
+
+    // Transfers always use the host format given by depth, half float storage is converted by the driver.
+    GLenum type() const { return depth_ > 1 ? GL_UNSIGNED_SHORT : TYPE[stride_]; }
 
     void bind() { GL(glBindTexture(GL_TEXTURE_2D, id_)); }
 
@@ -72,27 +126,70 @@ struct texture::impl
 
     void attach() { GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, id_, 0)); }
 
-    void clear() { GL(glClearTexImage(id_, 0, FORMAT[stride_], TYPE[stride_], nullptr)); }
+    void clear()
+    {
+        if (compression_ == texture_compression::none) {
+            GL(glClearTexImage(id_, 0, FORMAT[stride_], type(), nullptr));
+        }
+    }
+
+    void generate_mipmaps() { GL(glGenerateTextureMipmap(id_)); }
+
+    void fence()
+    {
+        if (fence_) {
+            glDeleteSync(fence_);
+        }
+        fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void wait()
+    {
+        if (fence_) {
+            GL(glWaitSync(fence_, 0, GL_TIMEOUT_IGNORED));
+        }
+    }
 
-#ifdef WIN32
     void copy_from(int texture_id)
     {
         GL(glCopyImageSubData(
             texture_id, GL_TEXTURE_2D, 0, 0, 0, 0, id_, GL_TEXTURE_2D, 0, 0, 0, 0, width_, height_, 1));
     }
-#endif
 
     void copy_from(buffer& src)
     {
         src.bind();
 
+        if (compression_ != texture_compression::none) {
+            GL(glCompressedTextureSubImage2D(id_, 0, 0, 0, width_, height_, internal_format(), size_, nullptr));
+            src.unbind();
+            return;
+        }
+
         if (width_ % 16 > 0) {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         } else {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         }
 
-        GL(glTextureSubImage2D(id_, 0, 0, 0, width_, height_, FORMAT[stride_], TYPE[stride_], nullptr));
+        GL(glTextureSubImage2D(id_, 0, 0, 0, width_, height_, FORMAT[stride_], type(), nullptr));
+
+        src.unbind();
+    }
+
+    // Uploads a region of src, which holds a whole image of this texture's size.
+    void copy_from(buffer& src, int x, int y, int width, int height)
+    {
+        src.bind();
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, width_);
+
+        const auto offset = (static_cast<std::size_t>(y) * width_ + x) * stride_ * depth_;
+        GL(glTextureSubImage2D(
+            id_, 0, x, y, width, height, FORMAT[stride_], type(), reinterpret_cast<const void*>(offset)));
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
         src.unbind();
     }
@@ -100,13 +197,18 @@ struct texture::impl
     void copy_to(buffer& dst)
     {
         dst.bind();
-        GL(glGetTextureImage(id_, 0, FORMAT[stride_], TYPE[stride_], size_, nullptr));
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        GL(glGetTextureImage(id_, 0, FORMAT[stride_], type(), size_, nullptr));
         dst.unbind();
     }
 };
 
-texture::texture(int width, int height, int stride)
-    : impl_(new impl(width, height, stride))
+texture::texture(int width, int height, int stride, int depth, bool half_float, bool mipmaps)
+    : impl_(new impl(width, height, stride, depth, half_float, mipmaps))
+{
+}
+texture::texture(int width, int height, texture_compression compression)
+    : impl_(new impl(width, height, compression))
 {
 }
 texture::texture(texture&& other)
@@ -123,15 +225,31 @@ void texture::bind(int index) { impl_->bind(index); }
 void texture::unbind() { impl_->unbind(); }
 void texture::attach() { impl_->attach(); }
 void texture::clear() { impl_->clear(); }
-#ifdef WIN32
+void texture::generate_mipmaps() { impl_->generate_mipmaps(); }
+void texture::fence() { impl_->fence(); }
+void texture::wait() { impl_->wait(); }
 void texture::copy_from(int source) { impl_->copy_from(source); }
-#endif
 void texture::copy_from(buffer& source) { impl_->copy_from(source); }
+void texture::copy_from(buffer& source, int x, int y, int width, int height)
+{
+    impl_->copy_from(source, x, y, width, height);
+}
 void texture::copy_to(buffer& dest) { impl_->copy_to(dest); }
 int  texture::width() const { return impl_->width_; }
 int  texture::height() const { return impl_->height_; }
 int  texture::stride() const { return impl_->stride_; }
-int  texture::size() const { return impl_->width_ * impl_->height_ * impl_->stride_; }
+int  texture::depth() const { return impl_->depth_; }
+int  texture::size() const { return impl_->size_; }
+int  texture::device_size() const
+{
+    auto size = impl_->half_float_ ? impl_->width_ * impl_->height_ * impl_->stride_ * 2 : impl_->size_;
+    // The chain of mipmaps adds a third.
+    return impl_->levels_ > 1 ? size / 3 * 4 : size;
+}
+bool texture::half_float() const { return impl_->half_float_; }
+bool texture::mipmaps() const { return impl_->levels_ > 1; }
 int  texture::id() const { return impl_->id_; }
 
+texture_compression texture::compression() const { return impl_->compression_; }
+
 }}} // namespace caspar::accelerator::ogl
@@ -25,10 +25,22 @@
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+// Block compressed textures are uploaded as their blocks of 4x4 pixels and decompressed by the gpu when sampled.
+enum class texture_compression
+{
+    none = 0,
+    bc1, // dxt1, 8 bytes per block
+    bc3, // dxt5, 16 bytes per block
+};
+
 class texture final
 {
   public:
-    texture(int width, int height, int stride);
+    // half_float stores the texture as 16 bit float, while uploads and readbacks keep the format given by depth.
+    // mipmaps allocates a full chain of levels below the image, which generate_mipmaps fills in.
+    texture(int width, int height, int stride, int depth = 1, bool half_float = false, bool mipmaps = false);
+    // Can only be uploaded and sampled, it can't be rendered to, cleared or read back.
+    texture(int width, int height, texture_compression compression);
     texture(const texture&) = delete;
     texture(texture&& other);
     ~texture();
@@ -36,22 +48,33 @@ class texture final
     texture& operator=(const texture&) = delete;
     texture& operator                  =(texture&& other);
 
-#ifdef WIN32
     void copy_from(int source);
-#endif
     void copy_from(class buffer& source);
+    void copy_from(class buffer& source, int x, int y, int width, int height);
     void copy_to(class buffer& dest);
 
     void attach();
     void clear();
+    void generate_mipmaps();
+
+    // Marks the commands that have written the texture so far. Contexts other than the one that wrote it have to
+    // wait for them before sampling it.
+    void fence();
+    void wait();
     void bind(int index);
     void unbind();
 
-    int width() const;
-    int height() const;
-    int stride() const;
-    int size() const;
-    int id() const;
+    int  width() const;
+    int  height() const;
+    int  stride() const;
+    int  depth() const;
+    int  size() const;
+    int  device_size() const;
+    bool half_float() const;
+    bool mipmaps() const;
+    int  id() const;
+
+    texture_compression compression() const;
 
   private:
     struct impl;
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "timer_query.h"
+
+#include <common/gl/gl_check.h>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+thread_local bool g_active = false;
+
+} // namespace
+
+timer_query::timer_query(std::function<void(double)> done, int depth)
+    : done_(std::move(done))
+    , ids_(static_cast<std::size_t>(depth), 0)
+    , pending_(static_cast<std::size_t>(depth), false)
+{
+}
+
+timer_query::~timer_query()
+{
+    // The queries are only created once the timer is first used on its thread.
+    if (ids_.front() != 0) {
+        glDeleteQueries(static_cast<GLsizei>(ids_.size()), ids_.data());
+    }
+}
+
+void timer_query::begin()
+{
+    if (ids_.front() == 0) {
+        GL(glGenQueries(static_cast<GLsizei>(ids_.size()), ids_.data()));
+    }
+
+    poll();
+
+    if (g_active || pending_[next_]) {
+        return;
+    }
+
+    GL(glBeginQuery(GL_TIME_ELAPSED, ids_[next_]));
+    active_  = true;
+    g_active = true;
+}
+
+void timer_query::end()
+{
+    if (!active_) {
+        return;
+    }
+
+    GL(glEndQuery(GL_TIME_ELAPSED));
+    pending_[next_] = true;
+    next_           = (next_ + 1) % ids_.size();
+    active_         = false;
+    g_active        = false;
+}
+
+void timer_query::poll()
+{
+    // Queries complete in the order they were issued, starting from the oldest one.
+    for (std::size_t n = 0; n < ids_.size(); ++n) {
+        auto index = (next_ + n) % ids_.size();
+        if (!pending_[index]) {
+            continue;
+        }
+
+        GLint available = 0;
+        GL(glGetQueryObjectiv(ids_[index], GL_QUERY_RESULT_AVAILABLE, &available));
+        if (!available) {
+            break;
+        }
+
+        GLuint64 elapsed = 0;
+        GL(glGetQueryObjectui64v(ids_[index], GL_QUERY_RESULT, &elapsed));
+        pending_[index] = false;
+
+        if (done_) {
+            done_(static_cast<double>(elapsed) / 1000000.0);
+        }
+    }
+}
+
+}}} // namespace caspar::accelerator::ogl
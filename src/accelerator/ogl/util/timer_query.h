@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Measures the gpu time of the commands between begin and end with GL_TIME_ELAPSED queries. Results are only read
+// once the gpu has made them available, a few frames later, so that the calling thread never waits for it. Queries
+// belong to a context, a timer_query has to be used and destroyed on the thread of one.
+class timer_query final
+{
+  public:
+    // done is called from begin or poll with the gpu time of a section in milliseconds.
+    explicit timer_query(std::function<void(double)> done, int depth = 4);
+    ~timer_query();
+
+    timer_query(const timer_query&) = delete;
+    timer_query& operator=(const timer_query&) = delete;
+
+    // Sections are skipped while all queries are pending, or when another section is already open on the thread,
+    // since time elapsed queries can't nest.
+    void begin();
+    void end();
+
+    // Reports the sections that have completed.
+    void poll();
+
+  private:
+    std::function<void(double)> done_;
+    std::vector<GLuint>         ids_;
+    std::vector<bool>           pending_;
+    std::size_t                 next_   = 0;
+    bool                        active_ = false;
+};
+
+class scoped_timer_query
+{
+    timer_query& query_;
+
+    scoped_timer_query(const scoped_timer_query&) = delete;
+    scoped_timer_query& operator=(const scoped_timer_query&) = delete;
+
+  public:
+    explicit scoped_timer_query(timer_query& query)
+        : query_(query)
+    {
+        query_.begin();
+    }
+
+    ~scoped_timer_query() { query_.end(); }
+};
+
+}}} // namespace caspar::accelerator::ogl
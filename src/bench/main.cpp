@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the pipeline of a channel headless, with an offscreen device, synthetic producers and no consumers, and
+// reports how long its stages take. Frames are produced as fast as they are mixed instead of at the channel rate.
+//
+// casparcg-bench [--config casparcg.config] [--format 1080p5000] [--scene bars|clip|stress] [--layers 16]
+//                [--frames 1000] [--warmup 50] [--half-float] [--parallel-layers]
+
+#include <accelerator/accelerator.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/memory.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/mixer/mixer.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_format.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace bench {
+
+namespace {
+
+struct options
+{
+    std::wstring config     = L"casparcg.config";
+    std::wstring format     = L"1080p5000";
+    std::wstring scene      = L"bars";
+    int          layers     = 16;
+    int          frames     = 1000;
+    int          warmup     = 50;
+    bool         half_float = false;
+    bool         parallel   = false;
+};
+
+options parse_options(int argc, char** argv)
+{
+    options result;
+
+    for (int n = 1; n < argc; ++n) {
+        const std::string arg = argv[n];
+
+        auto value = [&]() -> std::wstring {
+            if (n + 1 >= argc) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value for " + arg));
+            }
+            return u16(argv[++n]);
+        };
+
+        if (arg == "--config") {
+            result.config = value();
+        } else if (arg == "--format") {
+            result.format = value();
+        } else if (arg == "--scene") {
+            result.scene = value();
+        } else if (arg == "--layers") {
+            result.layers = boost::lexical_cast<int>(value());
+        } else if (arg == "--frames") {
+            result.frames = boost::lexical_cast<int>(value());
+        } else if (arg == "--warmup") {
+            result.warmup = boost::lexical_cast<int>(value());
+        } else if (arg == "--half-float") {
+            result.half_float = true;
+        } else if (arg == "--parallel-layers") {
+            result.parallel = true;
+        } else {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown option " + arg));
+        }
+    }
+
+    if (result.layers < 1 || result.frames < 1 || result.warmup < 0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("--layers and --frames must be positive."));
+    }
+
+    return result;
+}
+
+// Full resolution colour bars, uploaded once and then shown as a still.
+class bars_producer : public core::frame_producer
+{
+    core::draw_frame frame_;
+
+  public:
+    bars_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                  const core::video_format_desc&              format_desc,
+                  const core::image_transform&                transform)
+    {
+        static const std::uint32_t colors[] = {
+            0xFFC0C0C0, 0xFFC0C000, 0xFF00C0C0, 0xFF00C000, 0xFFC000C0, 0xFFC00000, 0xFF0000C0};
+
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
+        auto frame = frame_factory->create_frame(this, desc);
+
+        auto data = reinterpret_cast<std::uint32_t*>(frame.image_data(0).data());
+        for (int y = 0; y < format_desc.height; ++y) {
+            for (int x = 0; x < format_desc.width; ++x) {
+                data[y * format_desc.width + x] = colors[x * 7 / format_desc.width];
+            }
+        }
+
+        frame_                             = core::draw_frame(std::move(frame));
+        frame_.transform().image_transform = transform;
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override { return frame_; }
+
+    std::wstring print() const override { return L"bars_producer"; }
+    std::wstring name() const override { return L"bars"; }
+};
+
+// Loops over frames that were decoded up front. They are copied into new frames every tick and uploaded like the
+// frames of a decoder, as 4:2:2 ycbcr.
+class clip_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::pixel_format_desc                    desc_{core::pixel_format::ycbcr};
+    std::vector<std::vector<std::uint8_t>>     frames_;
+    std::size_t                                next_ = 0;
+
+  public:
+    clip_producer(const spl::shared_ptr<core::frame_factory>& frame_factory, const core::video_format_desc& format_desc)
+        : frame_factory_(frame_factory)
+    {
+        desc_.planes.push_back(core::pixel_format_desc::plane(format_desc.width, format_desc.height, 1));
+        desc_.planes.push_back(core::pixel_format_desc::plane(format_desc.width / 2, format_desc.height, 1));
+        desc_.planes.push_back(core::pixel_format_desc::plane(format_desc.width / 2, format_desc.height, 1));
+
+        // A second of moving ramps, so that no two frames are alike.
+        const auto count = std::max(1, static_cast<int>(std::round(format_desc.fps)));
+        for (int n = 0; n < count; ++n) {
+            std::vector<std::uint8_t> frame;
+            for (auto& plane : desc_.planes) {
+                for (int y = 0; y < plane.height; ++y) {
+                    for (int x = 0; x < plane.width; ++x) {
+                        frame.push_back(static_cast<std::uint8_t>(16 + (x + y + n * 8) % 220));
+                    }
+                }
+            }
+            frames_.push_back(std::move(frame));
+        }
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        auto& source = frames_[next_];
+        next_        = (next_ + 1) % frames_.size();
+
+        auto frame  = frame_factory_->create_frame(this, desc_);
+        auto offset = source.data();
+        for (std::size_t n = 0; n < desc_.planes.size(); ++n) {
+            std::memcpy(frame.image_data(n).data(), offset, desc_.planes[n].size);
+            offset += desc_.planes[n].size;
+        }
+
+        return core::draw_frame(std::move(frame));
+    }
+
+    std::wstring print() const override { return L"clip_producer"; }
+    std::wstring name() const override { return L"clip"; }
+};
+
+void load(core::stage& stage, int index, const spl::shared_ptr<core::frame_producer>& producer)
+{
+    stage.load(index, producer).get();
+    stage.play(index).get();
+}
+
+// Layers of overlapping translucent tiles on a grid, so that none of them are culled as hidden.
+void load_stress(core::stage&                                stage,
+                 const spl::shared_ptr<core::frame_factory>& frame_factory,
+                 const core::video_format_desc&              format_desc,
+                 int                                         layers)
+{
+    const auto columns = static_cast<int>(std::ceil(std::sqrt(layers)));
+
+    for (int n = 0; n < layers; ++n) {
+        core::image_transform transform;
+        transform.opacity             = 0.5;
+        transform.fill_scale          = {2.0 / columns, 2.0 / columns};
+        transform.fill_translation[0] = static_cast<double>(n % columns) / columns - 0.5 / columns;
+        transform.fill_translation[1] = static_cast<double>(n / columns) / columns - 0.5 / columns;
+
+        load(stage, n + 1, spl::make_shared<bars_producer>(frame_factory, format_desc, transform));
+    }
+}
+
+struct samples
+{
+    std::string         name;
+    std::vector<double> values;
+};
+
+void print_report(const options& opts, const core::video_format_desc& format_desc, std::vector<samples>& series)
+{
+    std::cout << "scene " << u8(opts.scene);
+    if (opts.scene == L"stress") {
+        std::cout << " (" << opts.layers << " layers)";
+    }
+    std::cout << ", " << u8(format_desc.name) << ", " << opts.frames << " frames"
+              << (opts.half_float ? ", half float" : "") << (opts.parallel ? ", parallel layers" : "") << "\n\n";
+
+    std::cout << std::left << std::setw(10) << "ms" << std::right;
+    for (auto heading : {"mean", "p50", "p95", "p99", "max"}) {
+        std::cout << std::setw(10) << heading;
+    }
+    std::cout << "\n";
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (auto& s : series) {
+        auto& values = s.values;
+        std::sort(values.begin(), values.end());
+
+        auto percentile = [&](double p) {
+            return values[std::min(values.size() - 1, static_cast<std::size_t>(p * values.size()))];
+        };
+
+        std::cout << std::left << std::setw(10) << s.name << std::right << std::setw(10)
+                  << std::accumulate(values.begin(), values.end(), 0.0) / values.size() << std::setw(10)
+                  << percentile(0.50) << std::setw(10) << percentile(0.95) << std::setw(10) << percentile(0.99)
+                  << std::setw(10) << values.back() << "\n";
+    }
+
+    std::cout << "\nframe budget " << 1000.0 / format_desc.fps << " ms" << std::endl;
+}
+
+int run(const options& opts)
+{
+    const core::video_format_desc format_desc(opts.format);
+    if (format_desc.format == core::video_format::invalid) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video format " + opts.format));
+    }
+
+    accelerator::accelerator accelerator;
+
+    spl::shared_ptr<core::image_mixer> image_mixer(accelerator.create_image_mixer(1, opts.half_float));
+    auto                               graph = spl::make_shared<caspar::diagnostics::graph>();
+
+    core::stage stage(1, graph, opts.parallel);
+    core::mixer mixer(1, graph, image_mixer);
+    mixer.set_readback(true);
+
+    if (opts.scene == L"bars") {
+        load(stage, 1, spl::make_shared<bars_producer>(image_mixer, format_desc, core::image_transform()));
+    } else if (opts.scene == L"clip") {
+        load(stage, 1, spl::make_shared<clip_producer>(image_mixer, format_desc));
+    } else if (opts.scene == L"stress") {
+        load_stress(stage, image_mixer, format_desc, opts.layers);
+    } else {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown scene " + opts.scene));
+    }
+
+    std::vector<samples> series{{"produce", {}}, {"mix", {}}, {"consume", {}}, {"frame", {}}, {"gpu", {}}};
+
+    core::layer_frames frames;
+    std::uint64_t      checksum = 0;
+
+    for (int n = 0; n < opts.warmup + opts.frames; ++n) {
+        const auto nb_samples = format_desc.audio_cadence[n % format_desc.audio_cadence.size()];
+
+        caspar::timer frame_timer;
+
+        caspar::timer produce_timer;
+        stage(format_desc, nb_samples, {}, frames);
+        const auto produce_time = produce_timer.elapsed();
+
+        std::vector<core::draw_frame> draw_frames;
+        for (auto& p : frames) {
+            draw_frames.push_back(p.second.foreground);
+        }
+
+        caspar::timer mix_timer;
+        auto          mixed    = mixer(std::move(draw_frames), format_desc, nb_samples);
+        const auto    mix_time = mix_timer.elapsed();
+
+        // Consumers only touch the frame once it has been read back.
+        caspar::timer consume_timer;
+        auto&         image = mixed.image_data(0);
+        if (image.size() > 0) {
+            checksum += image.data()[image.size() / 2];
+        }
+        const auto consume_time = consume_timer.elapsed();
+
+        if (n < opts.warmup) {
+            continue;
+        }
+
+        series[0].values.push_back(produce_time * 1000.0);
+        series[1].values.push_back(mix_time * 1000.0);
+        series[2].values.push_back(consume_time * 1000.0);
+        series[3].values.push_back(frame_timer.elapsed() * 1000.0);
+        series[4].values.push_back(image_mixer->stats().gpu_time);
+    }
+
+    print_report(opts, format_desc, series);
+
+    CASPAR_LOG(trace) << L"Checksum " << checksum;
+
+    return 0;
+}
+
+} // namespace
+
+}} // namespace caspar::bench
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    tbb::task_scheduler_init init;
+
+    try {
+        auto opts = bench::parse_options(argc, argv);
+
+        log::add_cout_sink();
+        env::configure(opts.config);
+        log::set_log_level(L"warning");
+
+        auto result = bench::run(opts);
+
+        log::flush();
+        return result;
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        log::flush();
+        return 1;
+    }
+}
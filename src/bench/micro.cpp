@@ -0,0 +1,459 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Micro benchmarks of hot kernels, at the sizes they run at in a channel. Each benchmark is run for at least
+// --min-time seconds, 5 times, and the median time per iteration is reported.
+//
+// casparcg-microbench [--config casparcg.config] [--filter substring] [--min-time 0.2]
+
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/memory.h>
+#include <common/memshfl.h>
+#include <common/timer.h>
+#include <common/tweener.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <modules/ffmpeg/util/av_util.h>
+
+#include <protocol/amcp/AMCPProtocolStrategy.h>
+#include <protocol/osc/client.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/scalable_allocator.h>
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+namespace caspar { namespace bench {
+
+namespace {
+
+// Results are added to the sink, so that the work that produces them isn't optimized away.
+volatile std::uintptr_t g_sink = 0;
+
+struct benchmark
+{
+    std::string name;
+    // Bytes processed per iteration, 0 if throughput doesn't apply.
+    std::size_t                  bytes = 0;
+    std::function<void(int64_t)> run;
+};
+
+std::vector<benchmark>& benchmarks()
+{
+    static std::vector<benchmark> result;
+    return result;
+}
+
+void add(std::string name, std::size_t bytes, std::function<void(int64_t)> run)
+{
+    benchmarks().push_back(benchmark{std::move(name), bytes, std::move(run)});
+}
+
+struct resolution
+{
+    const char* name;
+    int         width;
+    int         height;
+};
+
+const resolution resolutions[]    = {{"pal", 720, 576}, {"1080", 1920, 1080}, {"2160", 3840, 2160}};
+const int        audio_channels[] = {2, 8, 16};
+
+// Allocates frames in host memory, like the upload buffers of the accelerator but without a device.
+class host_frame_factory : public core::frame_factory
+{
+  public:
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> planes;
+        for (auto& plane : desc.planes) {
+            auto storage = std::shared_ptr<void>(scalable_aligned_malloc(plane.size, 64), scalable_aligned_free);
+            auto ptr     = reinterpret_cast<std::uint8_t*>(storage.get());
+            planes.emplace_back(ptr, plane.size, std::move(storage));
+        }
+        return core::mutable_frame(tag, std::move(planes), array<std::int32_t>{}, desc);
+    }
+
+    core::mutable_frame create_frame(const void*                      tag,
+                                     const core::pixel_format_desc&   desc,
+                                     const core::const_frame&         previous,
+                                     std::vector<core::image_region>& dirty) override
+    {
+        dirty.clear();
+        if (!desc.planes.empty()) {
+            core::image_region region;
+            region.width  = desc.planes[0].width;
+            region.height = desc.planes[0].height;
+            dirty.push_back(region);
+        }
+        return create_frame(tag, desc);
+    }
+
+#ifdef WIN32
+    core::const_frame import_d3d_texture(const void*                                              tag,
+                                         const std::shared_ptr<accelerator::d3d::d3d_texture2d>& d3d_texture) override
+    {
+        CASPAR_THROW_EXCEPTION(not_supported());
+    }
+#endif
+};
+
+void add_memshfl()
+{
+    for (auto& res : resolutions) {
+        const auto size = static_cast<std::size_t>(res.width) * res.height * 4;
+
+        auto source = std::make_shared<std::vector<std::uint8_t, tbb::cache_aligned_allocator<std::uint8_t>>>(size, 1);
+        auto dest   = std::make_shared<std::vector<std::uint8_t, tbb::cache_aligned_allocator<std::uint8_t>>>(size);
+
+        // bgra to argb.
+        add(std::string("memshfl/") + res.name, size, [=](int64_t iterations) {
+            for (int64_t n = 0; n < iterations; ++n) {
+                memshfl(dest->data(), source->data(), size, 0x0C0D0E0F, 0x08090A0B, 0x04050607, 0x00010203);
+            }
+            g_sink += (*dest)[size / 2];
+        });
+
+        // Offset by a pixel, so that neither buffer is vector aligned.
+        add(std::string("extract_key/unaligned/") + res.name, size - 4, [=](int64_t iterations) {
+            for (int64_t n = 0; n < iterations; ++n) {
+                extract_key(dest->data() + 4, source->data() + 4, size - 4);
+            }
+            g_sink += (*dest)[size / 2];
+        });
+
+        add(std::string("bgra_to_bgr/") + res.name, size, [=](int64_t iterations) {
+            for (int64_t n = 0; n < iterations; ++n) {
+                bgra_to_bgr(dest->data(), source->data(), size / 4);
+            }
+            g_sink += (*dest)[size / 2];
+        });
+    }
+}
+
+void add_audio_mixer()
+{
+    // A layer for every channel pair, e.g. a clip, a sting and graphics.
+    for (auto channels : audio_channels) {
+        const int nb_samples = 1920;
+        const int layers     = 8;
+
+        auto format_desc           = core::video_format_desc(core::video_format::x1080p5000);
+        format_desc.audio_channels = channels;
+        auto mixer                 = std::make_shared<core::audio_mixer>(spl::make_shared<diagnostics::graph>());
+        auto tags                  = std::make_shared<std::vector<int>>(layers);
+        auto frames                = std::make_shared<std::vector<core::const_frame>>();
+
+        for (int n = 0; n < layers; ++n) {
+            std::vector<std::int32_t> samples(static_cast<std::size_t>(nb_samples) * channels, 1 << 24);
+            frames->push_back(core::const_frame(
+                core::mutable_frame(&(*tags)[n],
+                                    {},
+                                    array<std::int32_t>(std::move(samples)),
+                                    core::pixel_format_desc(core::pixel_format::invalid))));
+        }
+
+        core::frame_transform transform;
+        transform.audio_transform.volume = 0.5;
+
+        add("audio_mixer/" + std::to_string(channels) + "ch",
+            static_cast<std::size_t>(nb_samples) * channels * layers * sizeof(std::int32_t),
+            [=](int64_t iterations) {
+                for (int64_t n = 0; n < iterations; ++n) {
+                    for (auto& frame : *frames) {
+                        mixer->push(transform);
+                        mixer->visit(frame);
+                        mixer->pop();
+                    }
+                    auto result = (*mixer)(format_desc, nb_samples);
+                    g_sink += result.size();
+                }
+            });
+    }
+}
+
+void add_make_frame()
+{
+    auto factory = std::make_shared<host_frame_factory>();
+
+    for (auto& res : resolutions) {
+        auto video    = ffmpeg::alloc_frame();
+        video->format = AV_PIX_FMT_YUV422P;
+        video->width  = res.width;
+        video->height = res.height;
+        if (av_frame_get_buffer(video.get(), 64) < 0) {
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+        }
+
+        // 4:2:2 is two bytes a pixel.
+        add(std::string("make_frame/") + res.name,
+            static_cast<std::size_t>(res.width) * res.height * 2,
+            [=](int64_t iterations) {
+                for (int64_t n = 0; n < iterations; ++n) {
+                    auto frame = ffmpeg::make_frame(nullptr, *factory, video, nullptr, 0);
+                    g_sink += frame.image_data(0).size();
+                }
+            });
+    }
+}
+
+// What a channel with 16 layers of clips reports every tick.
+core::monitor::state make_channel_state()
+{
+    core::monitor::state layer;
+    layer["time"]                = {12.5, 60.0};
+    layer["frame"]               = {625, 3000};
+    layer["paused"]              = false;
+    layer["loop"]                = true;
+    layer["file/path"]           = std::wstring(L"clips/news/opener_v2.mov");
+    layer["file/streams/0/fps"]  = {25, 1};
+    layer["file/clip"]           = {0.0, 120.0};
+    layer["file/video/width"]    = 1920;
+    layer["file/video/height"]   = 1080;
+    layer["file/audio/channels"] = 8;
+    layer["buffer"]              = {12, 16};
+    layer["profiler/time"]       = {0.004, 0.04};
+
+    core::monitor::state state;
+    for (int n = 1; n <= 16; ++n) {
+        state["stage"]["layer"][n]["foreground"]["producer"] = std::wstring(L"ffmpeg");
+        state["stage"]["layer"][n]["foreground"]             = layer;
+        state["stage"]["layer"][n]["background"]["producer"] = std::wstring(L"empty");
+    }
+    state["mixer"]["audio"]["volume"] = std::vector<std::int32_t>(8, 1 << 24);
+    state["framerate"]                = {50, 1};
+    return state;
+}
+
+void add_monitor_state()
+{
+    add("monitor_state/16 layers", 0, [](int64_t iterations) {
+        for (int64_t n = 0; n < iterations; ++n) {
+            auto state = make_channel_state();
+            g_sink += state.begin() != state.end();
+        }
+    });
+}
+
+void add_tokenize()
+{
+    const std::vector<std::pair<std::string, std::wstring>> messages = {
+        {"play", L"PLAY 1-10 \"clips/news/opener v2\" LOOP SEEK 250 LENGTH 1000 FILTER \"yadif=1:-1\""},
+        {"cg add",
+         L"CG 1-20 ADD 1 \"templates/lower third\" 1 \"{\\\"f0\\\":\\\"Jane Doe\\\",\\\"f1\\\":\\\"Correspondent, "
+         L"Stockholm\\\",\\\"f2\\\":\\\"Live\\\"}\""}};
+
+    for (auto& message : messages) {
+        auto text = message.second;
+        add("tokenize/" + message.first, text.size() * sizeof(wchar_t), [=](int64_t iterations) {
+            for (int64_t n = 0; n < iterations; ++n) {
+                std::list<std::wstring> tokens;
+                g_sink += protocol::amcp::tokenize(text, tokens);
+            }
+        });
+    }
+}
+
+void add_osc()
+{
+    auto messages = std::make_shared<std::map<std::string, core::monitor::vector_t>>();
+    for (auto& p : make_channel_state()) {
+        (*messages)["/channel/1/" + p.first] = p.second;
+    }
+    auto buffer = std::make_shared<std::vector<char>>(1000000);
+
+    add("osc_bundles/16 layers", 0, [=](int64_t iterations) {
+        for (int64_t n = 0; n < iterations; ++n) {
+            protocol::osc::write_bundles(
+                *messages, 0, 1472, *buffer, [](std::vector<char> packet) { g_sink += packet.size(); });
+        }
+    });
+}
+
+void add_tweener()
+{
+    for (auto name : {L"linear", L"easeinoutsine", L"easeoutelastic"}) {
+        const tweener tween(name);
+
+        // A transform is tweened on a few values per layer, each tick.
+        add("tweener/" + u8(name), 0, [=](int64_t iterations) {
+            double sum = 0.0;
+            for (int64_t n = 0; n < iterations; ++n) {
+                sum += tween(static_cast<double>(n % 50), 0.0, 1.0, 50.0);
+            }
+            g_sink += static_cast<std::uintptr_t>(sum);
+        });
+    }
+}
+
+    // A MIXER animation tweens the whole transform of a layer, each tick.
+    for (auto name : {L"linear", L"easeinoutsine"}) {
+        const tweener tween(name);
+
+        core::frame_transform dest;
+        dest.image_transform.opacity    = 0.5;
+        dest.image_transform.fill_scale = {0.5, 0.5};
+        dest.audio_transform.volume     = 0.0;
+
+        add("frame_transform/tween/" + u8(name), 0, [=](int64_t iterations) {
+            const core::frame_transform source;
+            double                      sum = 0.0;
+            for (int64_t n = 0; n < iterations; ++n) {
+                sum += core::frame_transform::tween(static_cast<double>(n % 50), source, dest, 50.0, tween)
+                           .image_transform.opacity;
+            }
+            g_sink += static_cast<std::uintptr_t>(sum);
+        });
+    }
+}
+
+double measure(const benchmark& b, double min_time)
+{
+    // Grows the number of iterations until a run takes long enough to time.
+    int64_t iterations = 1;
+    while (true) {
+        caspar::timer timer;
+        b.run(iterations);
+        auto elapsed = timer.elapsed();
+        if (elapsed >= min_time || iterations >= (int64_t(1) << 40)) {
+            break;
+        }
+        iterations = elapsed > 0.0 ? std::max(iterations * 2,
+                                              static_cast<int64_t>(iterations * min_time * 1.2 / elapsed))
+                                   : iterations * 100;
+    }
+
+    std::vector<double> times;
+    for (int n = 0; n < 5; ++n) {
+        caspar::timer timer;
+        b.run(iterations);
+        times.push_back(timer.elapsed() / iterations);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int run(const std::string& filter, double min_time)
+{
+    add_memshfl();
+    add_audio_mixer();
+    add_make_frame();
+    add_monitor_state();
+    add_tokenize();
+    add_osc();
+    add_tweener();
+
+    std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(14) << "time" << std::setw(14)
+              << "throughput" << "\n";
+
+    for (auto& b : benchmarks()) {
+        if (b.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        auto time = measure(b, min_time);
+
+        std::cout << std::left << std::setw(28) << b.name << std::right << std::fixed;
+        if (time >= 1e-3) {
+            std::cout << std::setw(11) << std::setprecision(3) << time * 1e3 << " ms";
+        } else if (time >= 1e-6) {
+            std::cout << std::setw(11) << std::setprecision(3) << time * 1e6 << " us";
+        } else {
+            std::cout << std::setw(11) << std::setprecision(3) << time * 1e9 << " ns";
+        }
+        if (b.bytes > 0) {
+            std::cout << std::setw(9) << std::setprecision(2) << b.bytes / time / 1e9 << " GB/s";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+} // namespace
+
+}} // namespace caspar::bench
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    tbb::task_scheduler_init init;
+
+    try {
+        std::wstring config   = L"casparcg.config";
+        std::string  filter   = "";
+        double       min_time = 0.2;
+
+        for (int n = 1; n < argc; ++n) {
+            const std::string arg = argv[n];
+            if (n + 1 >= argc) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Missing value for " + arg));
+            }
+            if (arg == "--config") {
+                config = u16(argv[++n]);
+            } else if (arg == "--filter") {
+                filter = argv[++n];
+            } else if (arg == "--min-time") {
+                min_time = boost::lexical_cast<double>(argv[++n]);
+            } else {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown option " + arg));
+            }
+        }
+
+        log::add_cout_sink();
+        env::configure(config);
+        log::set_log_level(L"warning");
+
+        auto result = bench::run(filter, min_time);
+
+        log::flush();
+        return result;
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        log::flush();
+        return 1;
+    }
+}
@@ -83,6 +83,18 @@ class array final
         return boost::any_cast<S>(storage_.get());
     }
 
+    /**
+     * Returns another array referencing the same data and storage.
+     */
+    array share() const
+    {
+        array result;
+        result.ptr_     = ptr_;
+        result.size_    = size_;
+        result.storage_ = storage_;
+        return result;
+    }
+
   private:
     T*                          ptr_  = nullptr;
     std::size_t                 size_ = 0;
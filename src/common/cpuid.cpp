@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cpuid.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace caspar {
+
+namespace {
+
+cpu_features detect()
+{
+    cpu_features features;
+
+#ifdef _MSC_VER
+    int info[4] = {};
+
+    __cpuid(info, 0);
+    auto max_leaf = info[0];
+
+    __cpuid(info, 1);
+    features.sse41    = (info[2] & (1 << 19)) != 0;
+    auto has_osxsave  = (info[2] & (1 << 27)) != 0;
+    auto has_avx      = (info[2] & (1 << 28)) != 0;
+    auto xcr0         = has_osxsave ? _xgetbv(0) : 0;
+    auto os_ymm       = (xcr0 & 0x06) == 0x06;
+    auto os_zmm       = (xcr0 & 0xE6) == 0xE6;
+
+    if (max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        features.avx2     = has_avx && os_ymm && (info[1] & (1 << 5)) != 0;
+        features.avx512bw = os_zmm && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse41    = __builtin_cpu_supports("sse4.1") != 0;
+    features.avx2     = __builtin_cpu_supports("avx2") != 0;
+    features.avx512bw = __builtin_cpu_supports("avx512f") != 0 && __builtin_cpu_supports("avx512bw") != 0;
+#endif
+
+    return features;
+}
+
+} // namespace
+
+const cpu_features& cpuid()
+{
+    static const cpu_features features = detect();
+    return features;
+}
+
+} // namespace caspar
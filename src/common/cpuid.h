@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifdef _MSC_VER
+#define CASPAR_TARGET_AVX2
+#define CASPAR_TARGET_AVX512
+#else
+#define CASPAR_TARGET_AVX2 __attribute__((target("avx2")))
+#define CASPAR_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+
+namespace caspar {
+
+struct cpu_features
+{
+    bool sse41    = false;
+    bool avx2     = false;
+    bool avx512bw = false;
+};
+
+/**
+ * Instruction set extensions supported by both the cpu and the operating
+ * system. Detected once on first use.
+ */
+const cpu_features& cpuid();
+
+} // namespace caspar
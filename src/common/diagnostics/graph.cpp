@@ -20,6 +20,11 @@
  */
 #include "graph.h"
 
+#include <tbb/concurrent_unordered_map.h>
+#include <tbb/concurrent_vector.h>
+
+#include <algorithm>
+#include <cstring>
 #include <mutex>
 #include <vector>
 
@@ -59,10 +64,65 @@ std::vector<spl::shared_ptr<spi::graph_sink>> create_sinks()
     return result;
 }
 
+namespace spi {
+
+namespace {
+
+std::uint64_t pack(const series::sample& sample)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &sample.value, sizeof(bits));
+    return bits | (sample.tag ? 1ULL << 32 : 0) | static_cast<std::uint64_t>(sample.severity) << 33;
+}
+
+series::sample unpack(std::uint64_t packed)
+{
+    series::sample sample;
+    auto           bits = static_cast<std::uint32_t>(packed);
+    std::memcpy(&sample.value, &bits, sizeof(bits));
+    sample.tag      = (packed >> 32 & 1) != 0;
+    sample.severity = static_cast<tag_severity>(packed >> 33);
+    return sample;
+}
+
+} // namespace
+
+series::series(std::string name)
+    : name_(std::move(name))
+{
+}
+
+const std::string& series::name() const { return name_; }
+int                series::color() const { return color_; }
+void               series::set_color(int color) { color_ = color; }
+
+void series::push(const sample& sample)
+{
+    // A writer claims a slot first, so a reader can briefly see the previous sample of a slot that is being written.
+    auto head = head_.fetch_add(1);
+    ring_[head % capacity].store(pack(sample), std::memory_order_release);
+}
+
+void series::read(std::uint64_t& position, std::vector<sample>& samples) const
+{
+    const auto head = head_.load(std::memory_order_acquire);
+    position        = std::max(position, head > capacity ? head - capacity : 0);
+    for (; position < head; ++position) {
+        samples.push_back(unpack(ring_[position % capacity].load(std::memory_order_acquire)));
+    }
+}
+
+} // namespace spi
+
 struct graph::impl
 {
     std::vector<spl::shared_ptr<spi::graph_sink>> sinks_ = create_sinks();
 
+    // Series are only added, the handle of a series is its index.
+    std::mutex                                           series_mutex_;
+    tbb::concurrent_unordered_map<std::string, int>      ids_;
+    tbb::concurrent_vector<std::shared_ptr<spi::series>> series_;
+
   public:
     impl() {}
 
@@ -78,24 +138,37 @@ struct graph::impl
             sink->set_text(value);
     }
 
-    void set_value(const std::string& name, double value)
+    int series(const std::string& name)
     {
-        for (auto& sink : sinks_)
-            sink->set_value(name, value);
-    }
+        auto it = ids_.find(name);
+        if (it != ids_.end()) {
+            return it->second;
+        }
 
-    void set_tag(tag_severity severity, const std::string& name)
-    {
+        std::lock_guard<std::mutex> lock(series_mutex_);
+
+        it = ids_.find(name);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+
+        auto series = std::make_shared<spi::series>(name);
+        auto id     = static_cast<int>(series_.push_back(series) - series_.begin());
         for (auto& sink : sinks_)
-            sink->set_tag(severity, name);
+            sink->add_series(series);
+        ids_.insert(std::make_pair(name, id));
+        return id;
     }
 
-    void set_color(const std::string& name, int color)
+    void set_value(int id, double value)
     {
-        for (auto& sink : sinks_)
-            sink->set_color(name, color);
+        series_[id]->push({static_cast<float>(value), false, tag_severity::SILENT});
     }
 
+    void set_tag(tag_severity severity, int id) { series_[id]->push({0.0f, true, severity}); }
+
+    void set_color(int id, int color) { series_[id]->set_color(color); }
+
     void auto_reset()
     {
         for (auto& sink : sinks_)
@@ -113,10 +186,13 @@ graph::graph()
 }
 
 void graph::set_text(const std::wstring& value) { impl_->set_text(value); }
-void graph::set_value(const std::string& name, double value) { impl_->set_value(name, value); }
-void graph::set_color(const std::string& name, int color) { impl_->set_color(name, color); }
-void graph::set_tag(tag_severity severity, const std::string& name) { impl_->set_tag(severity, name); }
+void graph::set_value(const std::string& name, double value) { impl_->set_value(impl_->series(name), value); }
+void graph::set_color(const std::string& name, int color) { impl_->set_color(impl_->series(name), color); }
+void graph::set_tag(tag_severity severity, const std::string& name) { impl_->set_tag(severity, impl_->series(name)); }
 void graph::auto_reset() { impl_->auto_reset(); }
+int  graph::series(const std::string& name) { return impl_->series(name); }
+void graph::set_value(int series, double value) { impl_->set_value(series, value); }
+void graph::set_tag(tag_severity severity, int series) { impl_->set_tag(severity, series); }
 
 void register_graph(const spl::shared_ptr<graph>& graph) { graph->impl_->activate(); }
 
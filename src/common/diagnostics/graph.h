@@ -23,9 +23,14 @@
 
 #include "../memory.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
 #include <tuple>
+#include <vector>
 
 namespace caspar { namespace diagnostics {
 
@@ -51,6 +56,12 @@ class graph
     void set_tag(tag_severity severity, const std::string& name);
     void auto_reset();
 
+    // Handle of the series name, which is registered on first use. Values and tags set through the handle only write
+    // to the ring of the series, so hot paths should look it up once.
+    int  series(const std::string& name);
+    void set_value(int series, double value);
+    void set_tag(tag_severity severity, int series);
+
   private:
     struct impl;
     std::shared_ptr<impl> impl_;
@@ -63,6 +74,42 @@ void register_graph(const spl::shared_ptr<graph>& graph);
 
 namespace spi {
 
+// A line of a graph. Samples are written to a ring without locks and read by the sinks at their own pace, a sink that
+// falls behind by more than capacity samples only sees the latest ones.
+class series
+{
+  public:
+    struct sample
+    {
+        float        value;
+        bool         tag;
+        tag_severity severity;
+    };
+
+    static const int capacity = 256;
+
+    explicit series(std::string name);
+
+    series(const series&) = delete;
+    series& operator=(const series&) = delete;
+
+    const std::string& name() const;
+
+    int  color() const;
+    void set_color(int color);
+
+    void push(const sample& sample);
+
+    // Appends the samples written after position to samples and advances position.
+    void read(std::uint64_t& position, std::vector<sample>& samples) const;
+
+  private:
+    const std::string                                name_;
+    std::atomic<int>                                 color_{-1};
+    std::array<std::atomic<std::uint64_t>, capacity> ring_{};
+    std::atomic<std::uint64_t>                       head_{0};
+};
+
 class graph_sink
 {
     graph_sink(const graph_sink&) = delete;
@@ -73,9 +120,7 @@ class graph_sink
     virtual ~graph_sink(){};
     virtual void activate()                                              = 0;
     virtual void set_text(const std::wstring& value)                     = 0;
-    virtual void set_value(const std::string& name, double value)        = 0;
-    virtual void set_color(const std::string& name, int color)           = 0;
-    virtual void set_tag(tag_severity severity, const std::string& name) = 0;
+    virtual void add_series(const std::shared_ptr<const series>& series) = 0;
     virtual void auto_reset()                                            = 0;
 };
 
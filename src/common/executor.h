@@ -26,13 +26,26 @@
 #include "os/thread.h"
 
 #include <tbb/concurrent_queue.h>
+#include <tbb/task_arena.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <future>
+#include <mutex>
 
 namespace caspar {
 
+// High priority tasks, e.g. the tick of a channel, run before the normal ones that are already queued. They aren't
+// limited by the capacity of the executor.
+enum class task_priority
+{
+    normal,
+    high,
+};
+
+// Runs tasks one at a time in the order they were queued. By default on a thread of its own, a pooled executor
+// runs them as a strand on the tbb pool instead, which suits executors whose tasks are short and don't block.
 class executor final
 {
     executor(const executor&);
@@ -41,26 +54,42 @@ class executor final
     using task_t  = std::function<void()>;
     using queue_t = tbb::concurrent_bounded_queue<task_t>;
 
-    std::wstring      name_;
-    std::atomic<bool> is_running_{true};
-    queue_t           queue_;
-    std::thread       thread_;
+    std::wstring                  name_;
+    std::atomic<bool>             is_running_{true};
+    queue_t                       queue_;
+    tbb::concurrent_queue<task_t> high_queue_;
+    const bool                    pooled_;
+    std::thread                   thread_;
+
+    // Tasks queued on a pooled executor that haven't run yet, the strand is scheduled while there are any.
+    std::atomic<std::size_t> pending_{0};
+    std::mutex               mutex_;
+    std::condition_variable  drained_;
 
   public:
-    executor(const std::wstring& name)
+    executor(const std::wstring& name, bool pooled = false)
         : name_(name)
-        , thread_(std::thread([this] { run(); }))
+        , pooled_(pooled)
     {
+        if (!pooled_) {
+            thread_ = std::thread([this] { run(); });
+        }
     }
 
     ~executor()
     {
         stop();
-        thread_.join();
+
+        if (pooled_) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            drained_.wait(lock, [this] { return pending_ == 0; });
+        } else {
+            thread_.join();
+        }
     }
 
     template <typename Func>
-    auto begin_invoke(Func&& func)
+    auto begin_invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (!is_running_) {
             CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info("executor not running."));
@@ -70,30 +99,44 @@ class executor final
 
         auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
 
-        queue_.push([=]() mutable { (*task)(); });
+        if (priority == task_priority::high) {
+            high_queue_.push([=]() mutable { (*task)(); });
+
+            // Wakes the thread, if the queue is full it will get to the task with the next one anyway.
+            if (!pooled_) {
+                queue_.try_push([] {});
+            }
+        } else {
+            queue_.push([=]() mutable { (*task)(); });
+        }
+
+        if (pooled_ && pending_++ == 0) {
+            pool().enqueue([this] { drain(); });
+        }
 
         return task->get_future();
     }
 
     template <typename Func>
-    auto invoke(Func&& func)
+    auto invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (is_current()) { // Avoids potential deadlock.
             return func();
         }
 
-        return begin_invoke(std::forward<Func>(func)).get();
+        return begin_invoke(std::forward<Func>(func), priority).get();
     }
 
     template <typename Func>
-    typename std::enable_if<std::is_same<void, decltype(std::declval<Func>())>::value, void>::type invoke(Func&& func)
+    typename std::enable_if<std::is_same<void, decltype(std::declval<Func>())>::value, void>::type
+    invoke(Func&& func, task_priority priority = task_priority::normal)
     {
         if (is_current()) { // Avoids potential deadlock.
             func();
             return;
         }
 
-        begin_invoke(std::forward<Func>(func)).wait();
+        begin_invoke(std::forward<Func>(func), priority).wait();
     }
 
     void set_capacity(queue_t::size_type capacity) { queue_.set_capacity(capacity); }
@@ -108,7 +151,10 @@ class executor final
             return;
         }
         is_running_ = false;
-        queue_.push(nullptr);
+
+        if (!pooled_) {
+            queue_.push(nullptr);
+        }
     }
 
     void wait()
@@ -120,11 +166,58 @@ class executor final
 
     bool is_running() const { return is_running_; }
 
-    bool is_current() const { return std::this_thread::get_id() == thread_.get_id(); }
+    bool is_current() const
+    {
+        return pooled_ ? current() == this : std::this_thread::get_id() == thread_.get_id();
+    }
 
     const std::wstring& name() const { return name_; }
 
   private:
+    static tbb::task_arena& pool()
+    {
+        static tbb::task_arena arena;
+        return arena;
+    }
+
+    static const executor*& current()
+    {
+        static thread_local const executor* current = nullptr;
+        return current;
+    }
+
+    // Runs the queued tasks of a pooled executor, only one drain of an executor is scheduled at a time.
+    void drain()
+    {
+        auto previous = current();
+        current()     = this;
+
+        while (true) {
+            task_t task;
+            if ((high_queue_.try_pop(task) || queue_.try_pop(task)) && task && is_running_) {
+                try {
+                    task();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+
+            // Only the drain takes from pending_, so others are still queued if it is above one.
+            if (pending_ > 1) {
+                --pending_;
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) {
+                drained_.notify_all();
+                break;
+            }
+        }
+
+        current() = previous;
+    }
+
     void run()
     {
         set_thread_name(name_);
@@ -138,6 +231,9 @@ class executor final
                     if (!task) {
                         return;
                     }
+                    for (task_t high; high_queue_.try_pop(high);) {
+                        high();
+                    }
                     task();
                 } while (queue_.try_pop(task));
             } catch (...) {
@@ -31,7 +31,6 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/sinks/async_frontend.hpp>
-#include <boost/log/sinks/sync_frontend.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
 #include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/sources/logger.hpp>
@@ -41,7 +40,11 @@
 #include <boost/smart_ptr/make_shared_object.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
 
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <iostream>
 
 namespace logging  = boost::log;
@@ -51,6 +54,80 @@ namespace keywords = boost::log::keywords;
 
 namespace caspar { namespace log {
 
+namespace {
+
+std::atomic<std::uint64_t> overruns{0};
+std::atomic<std::uint64_t> dropped{0};
+
+// Bounded queueing strategy for asynchronous_sink. Records are only formatted and written by the feeding thread of
+// the sink, a record that doesn't fit is counted as an overrun and discarded rather than blocking the thread that
+// logs it. An empty record wakes up the feeding thread when it is interrupted.
+class ring_queue
+{
+    tbb::concurrent_bounded_queue<logging::record_view> queue_;
+    std::atomic<bool>                                   interrupted_{false};
+
+  protected:
+    ring_queue() { queue_.set_capacity(8192); }
+
+    template <typename ArgsT>
+    explicit ring_queue(const ArgsT&)
+        : ring_queue()
+    {
+    }
+
+    void enqueue(const logging::record_view& rec) { try_enqueue(rec); }
+
+    bool try_enqueue(const logging::record_view& rec)
+    {
+        if (!queue_.try_push(rec)) {
+            ++overruns;
+        }
+        return true;
+    }
+
+    bool try_dequeue_ready(logging::record_view& rec) { return try_dequeue(rec); }
+
+    bool try_dequeue(logging::record_view& rec)
+    {
+        while (queue_.try_pop(rec)) {
+            if (rec) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool dequeue_ready(logging::record_view& rec)
+    {
+        while (!interrupted_.exchange(false)) {
+            queue_.pop(rec);
+            if (rec) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void interrupt_dequeue()
+    {
+        interrupted_ = true;
+        queue_.try_push(logging::record_view());
+    }
+};
+
+// Messages that a thread may log per second, see rate_limit.
+struct rate_state
+{
+    double                                rate   = 1.0;
+    double                                tokens = 1.0;
+    std::chrono::steady_clock::time_point last   = std::chrono::steady_clock::now();
+};
+
+thread_local rate_state thread_rate;
+
+} // namespace
+
 std::string current_exception_diagnostic_information()
 {
     {
@@ -161,7 +238,7 @@ void my_formatter(bool print_all_characters, const boost::log::record_view& rec,
 
 void add_file_sink(const std::wstring& file)
 {
-    using file_sink_type = boost::log::sinks::synchronous_sink<boost::log::sinks::text_file_backend>;
+    using file_sink_type = boost::log::sinks::asynchronous_sink<boost::log::sinks::text_file_backend, ring_queue>;
 
     try {
         if (!boost::filesystem::is_directory(boost::filesystem::path(file).parent_path())) {
@@ -191,7 +268,7 @@ void add_cout_sink()
                                                       return boost::posix_time::microsec_clock::local_time();
                                                   }));
 
-    using stream_sink_type = sinks::asynchronous_sink<sinks::wtext_ostream_backend>;
+    using stream_sink_type = sinks::asynchronous_sink<sinks::wtext_ostream_backend, ring_queue>;
 
     auto stream_backend = boost::make_shared<boost::log::sinks::wtext_ostream_backend>();
     stream_backend->add_stream(boost::shared_ptr<std::wostream>(&std::wcout, boost::null_deleter()));
@@ -229,4 +306,34 @@ bool set_log_level(const std::wstring& lvl)
 
 std::wstring& get_log_level() { return current_log_level; }
 
+void flush() { logging::core::get()->flush(); }
+
+log_stats get_stats() { return log_stats{overruns, dropped}; }
+
+void set_thread_log_rate(double rate)
+{
+    thread_rate.rate   = rate;
+    thread_rate.tokens = std::max(1.0, rate);
+}
+
+bool rate_limit(boost::log::trivial::severity_level lvl)
+{
+    auto& state = thread_rate;
+    if (lvl >= boost::log::trivial::error || state.rate <= 0.0) {
+        return true;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    state.tokens   = std::min(std::max(1.0, state.rate),
+                            state.tokens + std::chrono::duration<double>(now - state.last).count() * state.rate);
+    state.last     = now;
+
+    if (state.tokens < 1.0) {
+        ++dropped;
+        return false;
+    }
+    state.tokens -= 1.0;
+    return true;
+}
+
 }} // namespace caspar::log
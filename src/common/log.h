@@ -31,6 +31,7 @@
 #define WIN32_LEAN_AND_MEAN
 #include <boost/stacktrace.hpp>
 
+#include <cstdint>
 #include <string>
 
 namespace caspar { namespace log {
@@ -60,11 +61,36 @@ using caspar_logger = boost::log::sources::wseverity_logger<boost::log::trivial:
 BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(logger, caspar_logger)
 #define CASPAR_LOG(lvl) BOOST_LOG_SEV(::caspar::log::logger::get(), boost::log::trivial::severity_level::lvl)
 
+// Sinks write from a thread of their own, records that don't fit in its queue are counted as overruns and lost.
 void          add_file_sink(const std::wstring& file);
 void          add_cout_sink();
 bool          set_log_level(const std::wstring& lvl);
 std::wstring& get_log_level();
 
+// Waits for the sinks to write the records logged so far.
+void flush();
+
+struct log_stats
+{
+    std::uint64_t overruns; // lost because the queue of a sink was full
+    std::uint64_t dropped;  // suppressed by rate_limit
+};
+
+log_stats get_stats();
+
+// Messages per second that the calling thread may log with CASPAR_LOG_LIMITED, 0 for no limit. Threads take the
+// log-rate of their role, or 1 if it has none.
+void set_thread_log_rate(double rate);
+
+// Whether the calling thread is within its rate, errors and fatals always are. Used for messages in loops that would
+// otherwise flood the log, e.g. while waiting for input.
+bool rate_limit(boost::log::trivial::severity_level lvl);
+
+#define CASPAR_LOG_LIMITED(lvl)                                                                                        \
+    if (!::caspar::log::rate_limit(boost::log::trivial::severity_level::lvl)) {                                        \
+    } else                                                                                                             \
+        CASPAR_LOG(lvl)
+
 inline std::wstring get_stack_trace()
 {
     auto bt = boost::stacktrace::stacktrace();
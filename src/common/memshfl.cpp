@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memshfl.h"
+
+#include "cpuid.h"
+
+#include <immintrin.h>
+
+#include <cstdint>
+
+namespace caspar {
+
+namespace {
+
+// Streaming stores only pay off for buffers that are well past the caches.
+const std::size_t stream_threshold = 256 * 1024;
+
+bool use_stream(const void* dest, std::size_t count, std::size_t alignment)
+{
+    return count >= stream_threshold && reinterpret_cast<std::uintptr_t>(dest) % alignment == 0;
+}
+
+void memshfl_c(std::uint8_t* dest, const std::uint8_t* source, std::size_t count, const std::uint8_t* pattern)
+{
+    for (std::size_t n = 0; n < count; ++n) {
+        auto p  = pattern[n % 16];
+        auto i  = n - n % 16 + (p & 0x0F);
+        dest[n] = (p & 0x80) != 0 || i >= count ? 0 : source[i];
+    }
+}
+
+void memshfl_sse(std::uint8_t* dest, const std::uint8_t* source, std::size_t count, const std::uint8_t* pattern)
+{
+    const auto mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+
+    std::size_t n = 0;
+    if (use_stream(dest, count, 16)) {
+        for (; n + 64 <= count; n += 64) {
+            auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n));
+            auto xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 16));
+            auto xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 32));
+            auto xmm3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 48));
+
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n), _mm_shuffle_epi8(xmm0, mask));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 16), _mm_shuffle_epi8(xmm1, mask));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 32), _mm_shuffle_epi8(xmm2, mask));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 48), _mm_shuffle_epi8(xmm3, mask));
+        }
+        _mm_sfence();
+    }
+    for (; n + 16 <= count; n += 16) {
+        auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), _mm_shuffle_epi8(xmm0, mask));
+    }
+
+    memshfl_c(dest + n, source + n, count - n, pattern);
+}
+
+CASPAR_TARGET_AVX2 void
+memshfl_avx2(std::uint8_t* dest, const std::uint8_t* source, std::size_t count, const std::uint8_t* pattern)
+{
+    // pshufb doesn't cross 128 bit lanes, so every lane gets the whole pattern.
+    const auto mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern)));
+
+    std::size_t n = 0;
+    if (use_stream(dest, count, 32)) {
+        for (; n + 128 <= count; n += 128) {
+            auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n));
+            auto ymm1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 32));
+            auto ymm2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 64));
+            auto ymm3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 96));
+
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n), _mm256_shuffle_epi8(ymm0, mask));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 32), _mm256_shuffle_epi8(ymm1, mask));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 64), _mm256_shuffle_epi8(ymm2, mask));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 96), _mm256_shuffle_epi8(ymm3, mask));
+        }
+        _mm_sfence();
+    }
+    for (; n + 32 <= count; n += 32) {
+        auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n), _mm256_shuffle_epi8(ymm0, mask));
+    }
+
+    memshfl_sse(dest + n, source + n, count - n, pattern);
+}
+
+CASPAR_TARGET_AVX512 void
+memshfl_avx512(std::uint8_t* dest, const std::uint8_t* source, std::size_t count, const std::uint8_t* pattern)
+{
+    const auto mask = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern)));
+
+    std::size_t n = 0;
+    if (use_stream(dest, count, 64)) {
+        for (; n + 256 <= count; n += 256) {
+            auto zmm0 = _mm512_loadu_si512(source + n);
+            auto zmm1 = _mm512_loadu_si512(source + n + 64);
+            auto zmm2 = _mm512_loadu_si512(source + n + 128);
+            auto zmm3 = _mm512_loadu_si512(source + n + 192);
+
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n), _mm512_shuffle_epi8(zmm0, mask));
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 64), _mm512_shuffle_epi8(zmm1, mask));
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 128), _mm512_shuffle_epi8(zmm2, mask));
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 192), _mm512_shuffle_epi8(zmm3, mask));
+        }
+        _mm_sfence();
+    }
+    for (; n + 64 <= count; n += 64) {
+        _mm512_storeu_si512(dest + n, _mm512_shuffle_epi8(_mm512_loadu_si512(source + n), mask));
+    }
+
+    // Masked bytes past count load as zero, which is what a pattern pointing there gives.
+    if (n < count) {
+        const auto tail = _cvtu64_mask64(~0ULL >> (64 - (count - n)));
+        _mm512_mask_storeu_epi8(dest + n, tail, _mm512_shuffle_epi8(_mm512_maskz_loadu_epi8(tail, source + n), mask));
+    }
+}
+
+void bgra_to_bgr_c(std::uint8_t* dest, const std::uint8_t* source, std::size_t pixels)
+{
+    for (std::size_t n = 0; n < pixels; ++n) {
+        dest[n * 3 + 0] = source[n * 4 + 0];
+        dest[n * 3 + 1] = source[n * 4 + 1];
+        dest[n * 3 + 2] = source[n * 4 + 2];
+    }
+}
+
+const std::uint8_t bgr_pattern[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80};
+
+// Every store writes a whole vector but only advances by the packed bytes, the rest is overwritten by the next one.
+
+void bgra_to_bgr_sse(std::uint8_t* dest, const std::uint8_t* source, std::size_t pixels)
+{
+    const auto mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr_pattern));
+
+    std::size_t n = 0;
+    for (; n + 6 <= pixels; n += 4) {
+        auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n * 3), _mm_shuffle_epi8(xmm0, mask));
+    }
+
+    bgra_to_bgr_c(dest + n * 3, source + n * 4, pixels - n);
+}
+
+CASPAR_TARGET_AVX2 void bgra_to_bgr_avx2(std::uint8_t* dest, const std::uint8_t* source, std::size_t pixels)
+{
+    const auto mask    = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr_pattern)));
+    const auto compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+    std::size_t n = 0;
+    for (; n + 11 <= pixels; n += 8) {
+        auto ymm0 = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n * 4)), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n * 3), _mm256_permutevar8x32_epi32(ymm0, compact));
+    }
+
+    bgra_to_bgr_sse(dest + n * 3, source + n * 4, pixels - n);
+}
+
+CASPAR_TARGET_AVX512 void bgra_to_bgr_avx512(std::uint8_t* dest, const std::uint8_t* source, std::size_t pixels)
+{
+    const auto mask    = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bgr_pattern)));
+    const auto compact = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 3, 7, 11, 15);
+
+    for (std::size_t n = 0; n < pixels; n += 16) {
+        const auto count = pixels - n < 16 ? pixels - n : 16;
+        const auto load  = _cvtu64_mask64(~0ULL >> (64 - count * 4));
+        const auto store = _cvtu64_mask64(~0ULL >> (64 - count * 3));
+
+        auto zmm0 = _mm512_shuffle_epi8(_mm512_maskz_loadu_epi8(load, source + n * 4), mask);
+        _mm512_mask_storeu_epi8(dest + n * 3, store, _mm512_permutexvar_epi32(compact, zmm0));
+    }
+}
+
+using memshfl_fn     = void (*)(std::uint8_t*, const std::uint8_t*, std::size_t, const std::uint8_t*);
+using bgra_to_bgr_fn = void (*)(std::uint8_t*, const std::uint8_t*, std::size_t);
+
+const memshfl_fn g_memshfl = cpuid().avx512bw ? memshfl_avx512 : cpuid().avx2 ? memshfl_avx2 : memshfl_sse;
+const bgra_to_bgr_fn g_bgra_to_bgr =
+    cpuid().avx512bw ? bgra_to_bgr_avx512 : cpuid().avx2 ? bgra_to_bgr_avx2 : bgra_to_bgr_sse;
+
+} // namespace
+
+void memshfl(void* dest, const void* source, std::size_t count, int m1, int m2, int m3, int m4)
+{
+    std::uint8_t pattern[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pattern), _mm_set_epi32(m1, m2, m3, m4));
+
+    g_memshfl(static_cast<std::uint8_t*>(dest), static_cast<const std::uint8_t*>(source), count, pattern);
+}
+
+void extract_key(void* dest, const void* source, std::size_t count)
+{
+    memshfl(dest, source, count, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+}
+
+void bgra_to_bgr(void* dest, const void* source, std::size_t pixels)
+{
+    g_bgra_to_bgr(static_cast<std::uint8_t*>(dest), static_cast<const std::uint8_t*>(source), pixels);
+}
+
+} // namespace caspar
@@ -21,34 +21,30 @@
 
 #pragma once
 
-#ifdef _MSC_VER
-#include <intrin.h>
-#else
-#include <tmmintrin.h>
-#endif
+#include <cstddef>
 
 namespace caspar {
 
-static void* aligned_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
-{
-    __m128i*       dest128   = reinterpret_cast<__m128i*>(dest);
-    const __m128i* source128 = reinterpret_cast<const __m128i*>(source);
-
-    count /= 16; // 128 bit
+/**
+ * Shuffles the bytes of every 16 byte block of source into dest the way
+ * pshufb does: byte n of a block is taken from byte n of the pattern within
+ * the block, or zeroed if its high bit is set. m4 holds pattern bytes 0-3
+ * and m1 bytes 12-15. Any count and alignment is handled, bytes of a last
+ * partial block that point past count are zeroed. dest and source must not
+ * overlap. The widest of SSSE3, AVX2 and AVX-512 the cpu supports is used.
+ */
+void memshfl(void* dest, const void* source, std::size_t count, int m1, int m2, int m3, int m4);
 
-    const __m128i mask128 = _mm_set_epi32(m1, m2, m3, m4);
-    for (size_t n = 0; n < count / 4; ++n) {
-        __m128i xmm0 = _mm_load_si128(source128++);
-        __m128i xmm1 = _mm_load_si128(source128++);
-        __m128i xmm2 = _mm_load_si128(source128++);
-        __m128i xmm3 = _mm_load_si128(source128++);
+/**
+ * Writes the alpha of each of the count bytes of bgra pixels in source to
+ * all four bytes of the dest pixel, which is the key signal of a fill.
+ */
+void extract_key(void* dest, const void* source, std::size_t count);
 
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm0, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm1, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm2, mask128));
-        _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm3, mask128));
-    }
-    return dest;
-}
+/**
+ * Packs pixels bgra pixels from source into 24 bit bgr in dest, dropping the
+ * alpha.
+ */
+void bgra_to_bgr(void* dest, const void* source, std::size_t pixels);
 
 } // namespace caspar
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <boost/optional.hpp>
 
@@ -29,6 +30,9 @@ namespace caspar {
 
 boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive);
 
+// Returns the files next to stem whose name without extension matches the last part of stem in any case.
+std::vector<std::wstring> find_stem_case_insensitive(const std::wstring& stem);
+
 std::wstring clean_path(std::wstring path);
 
 std::wstring ensure_trailing_slash(std::wstring folder);
@@ -22,16 +22,181 @@
 #include "../../stdafx.h"
 
 #include "../filesystem.h"
+#include "../thread.h"
 
+#include <atomic>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
 using namespace boost::filesystem;
 
 namespace caspar {
 
+namespace {
+
+const uint32_t WATCH_MASK =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+struct directory
+{
+    std::unordered_map<std::wstring, std::wstring>              leaves; // By lower case leaf.
+    std::unordered_map<std::wstring, std::vector<std::wstring>> stems;  // By lower case stem.
+};
+
+// Lower case listings of the directories that have been searched, shared by all lookups. Each listed directory is
+// watched with inotify and its listing dropped as soon as anything is added to, removed from or renamed in it, so
+// the listings never go stale. Directories that can't be watched aren't listed and are searched every time.
+class directory_index
+{
+    int                                                         fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    std::mutex                                                  mutex_;
+    std::map<int, std::string>                                  watches_; // By watch descriptor.
+    std::unordered_map<std::string, std::shared_ptr<directory>> directories_;
+    std::atomic<bool>                                           abort_{false};
+    std::thread                                                 thread_;
+
+  public:
+    directory_index()
+    {
+        if (fd_ >= 0) {
+            thread_ = std::thread([this] {
+                set_thread_name(L"[directory_index]");
+                run();
+            });
+        }
+    }
+
+    ~directory_index()
+    {
+        abort_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    // Returns nullptr if dir can't be watched.
+    std::shared_ptr<const directory> get(const path& dir)
+    {
+        if (fd_ < 0) {
+            return nullptr;
+        }
+
+        const auto key = dir.string();
+
+        // The lock is held while listing so that events for the directory are handled after it has been listed.
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = directories_.find(key);
+        if (it != directories_.end()) {
+            return it->second;
+        }
+
+        const auto wd = inotify_add_watch(fd_, key.c_str(), WATCH_MASK);
+        if (wd < 0) {
+            return nullptr;
+        }
+        watches_[wd] = key;
+
+        auto                      listing = std::make_shared<directory>();
+        boost::system::error_code ec;
+        for (directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            const auto leaf = it->path().filename();
+            listing->leaves.emplace(boost::to_lower_copy(leaf.wstring()), leaf.wstring());
+            listing->stems[boost::to_lower_copy(leaf.stem().wstring())].push_back(leaf.wstring());
+        }
+        if (ec) {
+            return nullptr;
+        }
+
+        directories_[key] = listing;
+        return listing;
+    }
+
+  private:
+    void run()
+    {
+        alignas(inotify_event) char buffer[64 * 1024];
+
+        while (!abort_) {
+            pollfd pfd = {fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) {
+                continue;
+            }
+
+            const auto size = read(fd_, buffer, sizeof(buffer));
+            if (size <= 0) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto ptr = buffer; ptr < buffer + size;) {
+                const auto event = reinterpret_cast<const inotify_event*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    directories_.clear();
+                    continue;
+                }
+
+                auto it = watches_.find(event->wd);
+                if (it == watches_.end()) {
+                    continue;
+                }
+                directories_.erase(it->second);
+
+                if (event->mask & IN_MOVE_SELF) {
+                    inotify_rm_watch(fd_, event->wd);
+                }
+                if (event->mask & IN_IGNORED) {
+                    watches_.erase(it);
+                }
+            }
+        }
+    }
+};
+
+directory_index& get_directory_index()
+{
+    static directory_index index;
+    return index;
+}
+
+// Returns the leaf in dir that matches part in any case, or an empty path if there is none.
+path find_leaf(const path& dir, const path& part)
+{
+    auto listing = get_directory_index().get(dir);
+    if (listing) {
+        auto it = listing->leaves.find(boost::to_lower_copy(part.wstring()));
+        return it != listing->leaves.end() ? path(it->second) : path();
+    }
+
+    for (auto it = directory_iterator(dir); it != directory_iterator(); ++it) {
+        auto leaf = it->path().leaf();
+
+        if (boost::algorithm::iequals(part.wstring(), leaf.wstring())) {
+            return leaf;
+        }
+    }
+    return path();
+}
+
+} // namespace
+
 boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive)
 {
     path p(case_insensitive);
@@ -48,26 +213,47 @@ boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_ins
         if (exists(concatenated)) {
             result = concatenated;
         } else {
-            bool found = false;
-
-            for (auto it = directory_iterator(absolute(result)); it != directory_iterator(); ++it) {
-                auto leaf = it->path().leaf();
+            auto leaf = find_leaf(absolute(result), part);
 
-                if (boost::algorithm::iequals(part.wstring(), leaf.wstring())) {
-                    result = result / leaf;
-                    found  = true;
-                    break;
-                }
-            }
-
-            if (!found)
+            if (leaf.empty())
                 return boost::none;
+
+            result = result / leaf;
         }
     }
 
     return result.wstring();
 }
 
+std::vector<std::wstring> find_stem_case_insensitive(const std::wstring& stem)
+{
+    path p(stem);
+
+    auto parent = find_case_insensitive(p.parent_path().wstring());
+    if (!parent)
+        return {};
+
+    auto                      dir  = absolute(path(*parent));
+    auto                      name = p.filename().wstring();
+    std::vector<std::wstring> result;
+
+    auto listing = get_directory_index().get(dir);
+    if (listing) {
+        auto it = listing->stems.find(boost::to_lower_copy(name));
+        if (it != listing->stems.end()) {
+            for (auto& leaf : it->second)
+                result.push_back((dir / leaf).wstring());
+        }
+        return result;
+    }
+
+    for (auto it = directory_iterator(dir); it != directory_iterator(); ++it) {
+        if (boost::iequals(it->path().stem().wstring(), name))
+            result.push_back(it->path().wstring());
+    }
+    return result;
+}
+
 std::wstring clean_path(std::wstring path)
 {
     boost::replace_all(path, L"\\\\", L"/");
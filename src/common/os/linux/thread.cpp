@@ -1,8 +1,72 @@
 #include "../thread.h"
+#include "../../log.h"
 #include "../../utf.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <pthread.h>
+#include <sched.h>
+
 namespace caspar {
 
 void set_thread_name(const std::wstring& name) { pthread_setname_np(pthread_self(), u8(name).c_str()); }
 
+void set_thread_role(const std::wstring& role)
+{
+    auto policy = get_thread_policy(role);
+
+    if (policy.scheduler == L"fifo" || policy.scheduler == L"rr") {
+        const auto scheduler = policy.scheduler == L"fifo" ? SCHED_FIFO : SCHED_RR;
+
+        sched_param param    = {};
+        param.sched_priority = std::max(sched_get_priority_min(scheduler),
+                                        std::min(policy.priority, sched_get_priority_max(scheduler)));
+
+        if (auto error = pthread_setschedparam(pthread_self(), scheduler, &param)) {
+            CASPAR_LOG(warning) << L"Failed to set " << policy.scheduler << L" scheduling for " << role
+                                << L" thread: " << u16(std::strerror(error));
+        }
+    } else if (policy.scheduler != L"other") {
+        CASPAR_LOG(warning) << L"Invalid scheduler for " << role << L" threads: " << policy.scheduler;
+    }
+
+    if (!policy.cpus.empty()) {
+        set_thread_affinity(policy.cpus);
+    }
+
+    log::set_thread_log_rate(policy.log_rate);
+}
+
+std::vector<int> get_numa_node_cpus(int node)
+{
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string   list;
+    if (node < 0 || !std::getline(file, list)) {
+        return {};
+    }
+    return parse_cpu_list(u16(list));
+}
+
+void set_thread_affinity(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpus.empty()) {
+        for (auto cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    for (auto cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    if (auto error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        CASPAR_LOG(warning) << L"Failed to set cpu affinity of thread: " << u16(std::strerror(error));
+    }
+}
+
 } // namespace caspar
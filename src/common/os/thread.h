@@ -1,8 +1,46 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace caspar {
 
 void set_thread_name(const std::wstring& name);
-}
+
+// Scheduling and log rate of the threads of a role, as configured under configuration.threads.<role>.
+struct thread_policy
+{
+    std::wstring     scheduler = L"other"; // other, fifo or rr
+    int              priority  = 0;
+    std::vector<int> cpus;           // including the numa-node
+    double           log_rate = 1.0; // see log::set_thread_log_rate
+};
+
+thread_policy get_thread_policy(const std::wstring& role);
+
+// Applies the policy of role to the calling thread. Roles without configuration are left as they are, settings
+// that can't be applied, e.g. real-time scheduling without the privileges for it, are logged and skipped.
+void set_thread_role(const std::wstring& role);
+
+// Parses a list of cpus such as "0-3,8", the format used by the config and by sysfs.
+std::vector<int> parse_cpu_list(const std::wstring& list);
+
+// Returns the cpus of a numa node, or none if there is no such node.
+std::vector<int> get_numa_node_cpus(int node);
+
+// Returns the cpus of a cpus/numa-node pair of settings, the cpus of the node if there are none, or those of them
+// that are on the node.
+std::vector<int> resolve_cpus(std::vector<int> cpus, int numa_node);
+
+// Limits the calling thread to cpus, no cpus allows all of them again.
+void set_thread_affinity(const std::vector<int>& cpus);
+
+// The cpus that the threads serving a channel are limited to, as configured with cpus or numa-node on the channel.
+// Memory is allocated on the node of the cpu that first touches it, so frames rendered by those threads stay local.
+void             set_channel_cpus(int channel, std::vector<int> cpus);
+std::vector<int> get_channel_cpus(int channel);
+
+// Limits the calling thread to the cpus of channel, threads of channels that aren't pinned are left as they are.
+void bind_thread_to_channel(int channel);
+
+} // namespace caspar
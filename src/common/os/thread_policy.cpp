@@ -0,0 +1,121 @@
+#include "thread.h"
+
+#include "../env.h"
+#include "../log.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace caspar {
+
+std::vector<int> parse_cpu_list(const std::wstring& list)
+{
+    std::vector<int> cpus;
+
+    std::vector<std::wstring> ranges;
+    boost::split(ranges, list, boost::is_any_of(L","), boost::token_compress_on);
+    for (auto& range : ranges) {
+        boost::trim(range);
+        if (range.empty()) {
+            continue;
+        }
+
+        auto dash  = range.find(L'-');
+        auto first = std::stoi(range.substr(0, dash));
+        auto last  = dash == std::wstring::npos ? first : std::stoi(range.substr(dash + 1));
+        for (auto cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+std::vector<int> resolve_cpus(std::vector<int> cpus, int numa_node)
+{
+    if (numa_node < 0) {
+        return cpus;
+    }
+
+    auto node_cpus = get_numa_node_cpus(numa_node);
+    if (node_cpus.empty()) {
+        CASPAR_LOG(warning) << L"No numa node " << numa_node;
+        return cpus;
+    }
+    if (cpus.empty()) {
+        return node_cpus;
+    }
+
+    auto off_node = [&](int cpu) { return std::find(node_cpus.begin(), node_cpus.end(), cpu) == node_cpus.end(); };
+    cpus.erase(std::remove_if(cpus.begin(), cpus.end(), off_node), cpus.end());
+    return cpus;
+}
+
+thread_policy get_thread_policy(const std::wstring& role)
+{
+    thread_policy policy;
+
+    try {
+        auto config = env::properties().get_child_optional(L"configuration.threads." + role);
+        if (!config) {
+            return policy;
+        }
+
+        policy.scheduler = boost::to_lower_copy(config->get(L"scheduler", policy.scheduler));
+        policy.priority  = config->get(L"priority", policy.priority);
+        policy.log_rate  = config->get(L"log-rate", policy.log_rate);
+        policy.cpus =
+            resolve_cpus(parse_cpu_list(config->get(L"cpus", L"")), config->get(L"numa-node", -1));
+    } catch (...) {
+        CASPAR_LOG(warning) << L"Invalid thread configuration for " << role;
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+
+    return policy;
+}
+
+namespace {
+
+struct channel_cpus
+{
+    std::mutex                       mutex;
+    std::map<int, std::vector<int>> cpus;
+};
+
+channel_cpus& get_channel_cpus_registry()
+{
+    static channel_cpus registry;
+    return registry;
+}
+
+} // namespace
+
+void set_channel_cpus(int channel, std::vector<int> cpus)
+{
+    auto&                       registry = get_channel_cpus_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.cpus[channel] = std::move(cpus);
+}
+
+std::vector<int> get_channel_cpus(int channel)
+{
+    auto&                       registry = get_channel_cpus_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    auto it = registry.cpus.find(channel);
+    return it != registry.cpus.end() ? it->second : std::vector<int>();
+}
+
+void bind_thread_to_channel(int channel)
+{
+    auto cpus = get_channel_cpus(channel);
+    if (!cpus.empty()) {
+        set_thread_affinity(cpus);
+    }
+}
+
+} // namespace caspar
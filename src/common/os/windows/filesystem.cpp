@@ -24,6 +24,7 @@
 #include "../filesystem.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
 namespace caspar {
@@ -35,6 +36,21 @@ boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_ins
     return boost::none;
 }
 
+std::vector<std::wstring> find_stem_case_insensitive(const std::wstring& stem)
+{
+    boost::filesystem::path p(stem);
+
+    std::vector<std::wstring> result;
+    if (!boost::filesystem::is_directory(p.parent_path()))
+        return result;
+
+    for (boost::filesystem::directory_iterator it(p.parent_path()), end; it != end; ++it) {
+        if (boost::iequals(it->path().stem().wstring(), p.filename().wstring()))
+            result.push_back(it->path().wstring());
+    }
+    return result;
+}
+
 std::wstring clean_path(std::wstring path) { return path; }
 
 std::wstring ensure_trailing_slash(std::wstring folder)
@@ -4,6 +4,7 @@
 
 #include <windows.h>
 
+#include "../../log.h"
 #include "../../utf.h"
 
 namespace caspar {
@@ -33,4 +34,59 @@ inline void SetThreadName(DWORD dwThreadID, LPCSTR szThreadName)
 
 void set_thread_name(const std::wstring& name) { SetThreadName(GetCurrentThreadId(), u8(name).c_str()); }
 
+// Windows has no real-time scheduling classes, fifo and rr raise the thread to time critical.
+void set_thread_role(const std::wstring& role)
+{
+    auto policy = get_thread_policy(role);
+
+    if (policy.scheduler == L"fifo" || policy.scheduler == L"rr") {
+        if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+            CASPAR_LOG(warning) << L"Failed to raise the priority of " << role << L" thread";
+        }
+    } else if (policy.scheduler != L"other") {
+        CASPAR_LOG(warning) << L"Invalid scheduler for " << role << L" threads: " << policy.scheduler;
+    }
+
+    if (!policy.cpus.empty()) {
+        set_thread_affinity(policy.cpus);
+    }
+
+    log::set_thread_log_rate(policy.log_rate);
+}
+
+std::vector<int> get_numa_node_cpus(int node)
+{
+    std::vector<int> cpus;
+
+    ULONGLONG mask = 0;
+    if (node >= 0 && GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask)) {
+        for (auto cpu = 0; cpu < 64; ++cpu) {
+            if (mask & (ULONGLONG(1) << cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    return cpus;
+}
+
+void set_thread_affinity(const std::vector<int>& cpus)
+{
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus) {
+        if (cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+            mask |= DWORD_PTR(1) << cpu;
+        }
+    }
+
+    if (cpus.empty()) {
+        DWORD_PTR system_mask = 0;
+        GetProcessAffinityMask(GetCurrentProcess(), &mask, &system_mask);
+    }
+
+    if (mask != 0 && !SetThreadAffinityMask(GetCurrentThread(), mask)) {
+        CASPAR_LOG(warning) << L"Failed to set cpu affinity of thread";
+    }
+}
+
 } // namespace caspar
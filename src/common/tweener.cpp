@@ -54,15 +54,12 @@
 #include <boost/regex.hpp>
 
 #include <algorithm>
-#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace caspar {
 
-using tweener_t = std::function<double(double, double, double, double)>;
-
 static const double PI   = std::atan(1.0) * 4.0;
 static const double H_PI = std::atan(1.0) * 2.0;
 
@@ -417,7 +414,7 @@ double ease_out_in_bounce(double t, double b, double c, double d, const std::vec
     return ease_in_bounce(t * 2 - d, b + c / 2, c / 2, d, params);
 }
 
-using tween_t = std::function<double(double, double, double, double, const std::vector<double>&)>;
+using tween_t = tweener::func_t;
 
 const std::unordered_map<std::wstring, tween_t>& get_tweens()
 {
@@ -468,14 +465,13 @@ const std::unordered_map<std::wstring, tween_t>& get_tweens()
     return tweens;
 }
 
-tweener_t get_tweener(std::wstring name)
+// Resolves name to one of get_tweens() and its parameters, once for the lifetime of the tweener.
+tween_t get_tweener(std::wstring name, std::vector<double>& params)
 {
     std::transform(name.begin(), name.end(), name.begin(), std::towlower);
 
     if (name == L"linear")
-        return [](double t, double b, double c, double d) { return ease_none(t, b, c, d, std::vector<double>()); };
-
-    std::vector<double> params;
+        return ease_none;
 
     static const boost::wregex expr(
         LR"((?<NAME>\w*)(:(?<V0>\d+\.?\d?))?(:(?<V1>\d+\.?\d?))?)"); // boost::regex has no repeated captures?
@@ -492,17 +488,22 @@ tweener_t get_tweener(std::wstring name)
     if (it == get_tweens().end())
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not find tween " + name));
 
-    auto tween = it->second;
-    return [=](double t, double b, double c, double d) { return tween(t, b, c, d, params); };
+    return it->second;
 };
 
 tweener::tweener(const std::wstring& name)
-    : func_(get_tweener(name))
+    : func_(get_tweener(name, params_))
     , name_(name)
 {
+    // The amplitude of an elastic tween is compared with c.
+    const auto elastic = func_ == ease_in_elastic || func_ == ease_out_elastic || func_ == ease_in_out_elastic ||
+                         func_ == ease_out_in_elastic;
+    linear_ = !(elastic && params_.size() > 1 && params_[1] != 0.0);
 }
 
-double tweener::operator()(double t, double b, double c, double d) const { return func_(t, b, c, d); }
+double tweener::operator()(double t, double b, double c, double d) const { return func_(t, b, c, d, params_); }
+
+bool tweener::linear() const { return linear_; }
 
 bool tweener::operator==(const tweener& other) const { return name_ == other.name_; }
 
@@ -21,7 +21,6 @@
 
 #pragma once
 
-#include <functional>
 #include <string>
 #include <vector>
 
@@ -71,12 +70,24 @@ class tweener
      */
     double operator()(double t, double b, double c, double d) const;
 
+    /**
+     * @return Whether the tweened value is linear in b and c, i.e. equal to
+     *         b + c * (*this)(t, 0, 1, d), so that one evaluation per
+     *         timepoint can be shared by any number of values. All tween
+     *         functions are, except elastic ones given an amplitude.
+     */
+    bool linear() const;
+
     bool operator==(const tweener& other) const;
     bool operator!=(const tweener& other) const;
 
+    using func_t = double (*)(double, double, double, double, const std::vector<double>&);
+
   private:
-    std::function<double(double, double, double, double)> func_;
-    std::wstring                                          name_;
+    std::vector<double> params_;
+    func_t              func_;
+    std::wstring        name_;
+    bool                linear_ = true;
 };
 
 } // namespace caspar
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StdAfx.h"
+
+#include "channel_arena.h"
+
+#include <common/os/thread.h>
+
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+namespace caspar { namespace core {
+
+struct channel_arena::impl
+{
+    using clock = std::chrono::steady_clock;
+
+    // Binds the workers to the cpus of the channel and accounts the time that threads spend in the arena.
+    class observer : public tbb::task_scheduler_observer
+    {
+        impl& impl_;
+
+      public:
+        observer(tbb::task_arena& arena, impl& impl)
+            : tbb::task_scheduler_observer(arena)
+            , impl_(impl)
+        {
+            observe(true);
+        }
+
+        ~observer() { observe(false); }
+
+        void on_scheduler_entry(bool worker) override
+        {
+            if (worker) {
+                bind_thread_to_channel(impl_.channel_);
+            }
+            impl_.update(1);
+        }
+
+        void on_scheduler_exit(bool worker) override
+        {
+            impl_.update(-1);
+            if (worker && impl_.pinned_) {
+                set_thread_affinity({});
+            }
+        }
+    };
+
+    const int       channel_;
+    const int       concurrency_;
+    const bool      pinned_ = !get_channel_cpus(channel_).empty();
+    tbb::task_arena arena_;
+
+    std::mutex        mutex_;
+    int               active_       = 0;
+    clock::duration   busy_         = clock::duration::zero();
+    clock::time_point changed_      = clock::now();
+    clock::duration   sampled_busy_ = clock::duration::zero();
+    clock::time_point sampled_      = changed_;
+
+    observer observer_{arena_, *this};
+
+    impl(int channel, int concurrency)
+        : channel_(channel)
+        , concurrency_(concurrency)
+        , arena_(concurrency)
+    {
+    }
+
+    // Accumulates the thread time spent in the arena up to now before delta threads enter or leave it.
+    void update(int delta)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto now = clock::now();
+        busy_ += (now - changed_) * active_;
+        changed_ = now;
+        active_ += delta;
+    }
+
+    double utilization()
+    {
+        update(0);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto elapsed = std::chrono::duration<double>(changed_ - sampled_).count();
+        const auto busy    = std::chrono::duration<double>(busy_ - sampled_busy_).count();
+        sampled_           = changed_;
+        sampled_busy_      = busy_;
+
+        return elapsed > 0.0 ? std::min(1.0, busy / (elapsed * concurrency_)) : 0.0;
+    }
+};
+
+channel_arena::channel_arena(int channel, int concurrency)
+    : impl_(new impl(channel, concurrency))
+{
+}
+channel_arena::~channel_arena() {}
+void   channel_arena::execute(const std::function<void()>& func) { impl_->arena_.execute(func); }
+void   channel_arena::enqueue(std::function<void()> func) { impl_->arena_.enqueue(std::move(func)); }
+int    channel_arena::concurrency() const { return impl_->concurrency_; }
+double channel_arena::utilization() { return impl_->utilization(); }
+
+namespace {
+
+std::mutex                                     arenas_mutex;
+std::map<int, std::shared_ptr<channel_arena>> arenas;
+
+} // namespace
+
+void set_channel_arena(int channel, int concurrency)
+{
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+
+    if (concurrency > 0) {
+        arenas[channel] = std::make_shared<channel_arena>(channel, concurrency);
+    } else {
+        arenas.erase(channel);
+    }
+}
+
+std::shared_ptr<channel_arena> get_channel_arena(int channel)
+{
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+
+    auto it = arenas.find(channel);
+    return it != arenas.end() ? it->second : nullptr;
+}
+
+void execute_in_channel_arena(int channel, const std::function<void()>& func)
+{
+    if (auto arena = get_channel_arena(channel)) {
+        arena->execute(func);
+    } else {
+        func();
+    }
+}
+
+void enqueue_in_channel_arena(int channel, std::function<void()> func)
+{
+    if (auto arena = get_channel_arena(channel)) {
+        arena->enqueue(std::move(func));
+    } else {
+        static tbb::task_arena global_arena;
+        global_arena.enqueue(std::move(func));
+    }
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+namespace caspar { namespace core {
+
+// A tbb arena for the parallel work of one channel, its layers, decoders and encoders, so that a busy channel can't
+// take the workers that another channel needs to make its deadline. Its workers are bound to the cpus of the channel
+// if it is pinned.
+class channel_arena final
+{
+  public:
+    channel_arena(int channel, int concurrency);
+    ~channel_arena();
+
+    channel_arena(const channel_arena&) = delete;
+    channel_arena& operator=(const channel_arena&) = delete;
+
+    void execute(const std::function<void()>& func);
+
+    // Runs func on a worker of the arena without waiting for it.
+    void enqueue(std::function<void()> func);
+
+    int concurrency() const;
+
+    // Share of the workers of the arena that were busy since the previous call, from 0 to 1.
+    double utilization();
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+// Gives channel an arena of concurrency workers, 0 removes it.
+void                           set_channel_arena(int channel, int concurrency);
+std::shared_ptr<channel_arena> get_channel_arena(int channel);
+
+// Runs func in the arena of channel, or on the calling thread if the channel has none.
+void execute_in_channel_arena(int channel, const std::function<void()>& func);
+
+// Runs func on a worker of the arena of channel, or of the global pool if the channel has none, without waiting for it.
+void enqueue_in_channel_arena(int channel, std::function<void()> func);
+
+}} // namespace caspar::core
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StdAfx.h"
+
+#include "channel_group.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <tbb/parallel_for.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace core {
+
+struct channel_group::impl
+{
+    const std::wstring name_;
+
+    // Held for the whole tick, so that channels are only added and removed in between.
+    std::mutex                           mutex_;
+    std::condition_variable              cond_;
+    std::map<int, channel_group::tick_t> ticks_;
+
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+
+    explicit impl(std::wstring name)
+        : name_(std::move(name))
+    {
+        thread_ = std::thread([this] {
+#ifdef WIN32
+            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+            set_thread_name(L"channel-group-" + name_);
+            set_thread_role(L"channel");
+
+            std::vector<std::function<void()>> rest;
+
+            while (!abort_request_) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_request_ || !ticks_.empty(); });
+
+                rest.clear();
+                for (auto& tick : ticks_) {
+                    rest.push_back(tick.second());
+                }
+
+                tbb::parallel_for(std::size_t(0), rest.size(), [&](std::size_t n) { rest[n](); });
+            }
+        });
+
+        CASPAR_LOG(info) << L"channel_group[" << name_ << L"] Initialized.";
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void add(int index, channel_group::tick_t tick)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ticks_[index] = std::move(tick);
+        }
+        cond_.notify_all();
+    }
+
+    void remove(int index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ticks_.erase(index);
+    }
+};
+
+channel_group::channel_group(std::wstring name)
+    : impl_(new impl(std::move(name)))
+{
+}
+channel_group::~channel_group() {}
+void                channel_group::add(int index, tick_t tick) { impl_->add(index, std::move(tick)); }
+void                channel_group::remove(int index) { impl_->remove(index); }
+const std::wstring& channel_group::name() const { return impl_->name_; }
+
+}} // namespace caspar::core
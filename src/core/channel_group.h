@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace core {
+
+// Ticks a group of channels from one thread so that they stay in phase. Each tick produces the channels one after
+// the other in index order, so that a route from a lower to a higher channel is handed over within the same tick,
+// and then mixes and consumes them concurrently on the tbb pool.
+class channel_group final
+{
+  public:
+    // Produces a frame and returns what is left of the tick, which is mixing and consuming it.
+    using tick_t = std::function<std::function<void()>()>;
+
+    explicit channel_group(std::wstring name);
+    ~channel_group();
+
+    channel_group(const channel_group&) = delete;
+    channel_group& operator=(const channel_group&) = delete;
+
+    void add(int index, tick_t tick);
+
+    // Waits for the tick that is running, the channel isn't ticked anymore once this returns.
+    void remove(int index);
+
+    const std::wstring& name() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "clock_source.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace core {
+
+namespace {
+
+const std::int64_t NANOS_PER_SECOND = 1000000000;
+
+class system_clock_source : public clock_source
+{
+  public:
+    std::int64_t now() const override
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    std::wstring print() const override { return L"system"; }
+};
+
+#ifndef WIN32
+// The PTP hardware clock of a network card, e.g. /dev/ptp0, as disciplined by ptp4l. It keeps TAI, which is the
+// epoch that SMPTE ST 2059 aligns frames to.
+class ptp_clock_source : public clock_source
+{
+    const std::wstring device_;
+    int                fd_;
+    clockid_t          id_;
+
+  public:
+    explicit ptp_clock_source(const std::wstring& device)
+        : device_(device.empty() ? L"/dev/ptp0" : device)
+        , fd_(open(u8(device_).c_str(), O_RDONLY))
+    {
+        if (fd_ < 0) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Could not open PTP clock " + device_));
+        }
+        // FD_TO_CLOCKID of the kernel's dynamic posix clocks.
+        id_ = static_cast<clockid_t>((~static_cast<unsigned int>(fd_) << 3) | 3);
+    }
+
+    ~ptp_clock_source() override { close(fd_); }
+
+    std::int64_t now() const override
+    {
+        timespec spec;
+        if (clock_gettime(id_, &spec) != 0) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not read PTP clock " + device_));
+        }
+        return static_cast<std::int64_t>(spec.tv_sec) * NANOS_PER_SECOND + spec.tv_nsec;
+    }
+
+    std::wstring print() const override { return L"ptp[" + device_ + L"]"; }
+};
+#endif
+
+struct clock_registry
+{
+    std::mutex                                     mutex;
+    std::map<std::wstring, clock_source_factory_t> factories;
+    std::weak_ptr<clock_source>                    source;
+
+    clock_registry()
+    {
+        factories[L"system"] = [](const std::wstring&) { return std::make_shared<system_clock_source>(); };
+#ifndef WIN32
+        factories[L"ptp"] = [](const std::wstring& device) { return std::make_shared<ptp_clock_source>(device); };
+#endif
+    }
+};
+
+clock_registry& get_registry()
+{
+    static clock_registry registry;
+    return registry;
+}
+
+// The start of frame n, computed without overflowing for times since the epoch of a wall clock.
+std::int64_t get_frame_start(std::int64_t n, int duration, int time_scale)
+{
+    const auto ticks = n * duration;
+    return ticks / time_scale * NANOS_PER_SECOND + ticks % time_scale * NANOS_PER_SECOND / time_scale;
+}
+
+std::int64_t get_frame_index(std::int64_t time, int duration, int time_scale)
+{
+    const auto ticks = time / NANOS_PER_SECOND * time_scale + time % NANOS_PER_SECOND * time_scale / NANOS_PER_SECOND;
+    return ticks / duration;
+}
+
+} // namespace
+
+void register_clock_source(const std::wstring& name, const clock_source_factory_t& factory)
+{
+    auto&                       registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.factories[boost::to_lower_copy(name)] = factory;
+}
+
+std::shared_ptr<clock_source> get_clock_source()
+{
+    auto&                       registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    auto source = registry.source.lock();
+    if (source) {
+        return source;
+    }
+
+    const auto name =
+        boost::to_lower_copy(env::properties().get(L"configuration.output.clock", std::wstring(L"system")));
+    const auto device = env::properties().get(L"configuration.output.clock-device", std::wstring());
+
+    auto it = registry.factories.find(name);
+    if (it == registry.factories.end()) {
+        CASPAR_LOG(warning) << L"Clock " << name << L" isn't available, channels are paced by the system clock.";
+    } else {
+        try {
+            source = it->second(device);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << L"Could not open clock " << name << L", channels are paced by the system clock.";
+        }
+    }
+    if (!source) {
+        source = std::make_shared<system_clock_source>();
+    }
+
+    CASPAR_LOG(info) << L"Channels without a synchronization clock are paced by the " << source->print()
+                     << L" clock.";
+
+    registry.source = source;
+    return source;
+}
+
+frame_pacer::frame_pacer(std::shared_ptr<clock_source> source)
+    : source_(std::move(source))
+    , spin_(std::max(0, env::properties().get(L"configuration.output.clock-spin", 2000)) * 1000LL)
+{
+}
+
+void frame_pacer::wait(int duration, int time_scale)
+{
+    if (duration != duration_ || time_scale != time_scale_) {
+        duration_   = duration;
+        time_scale_ = time_scale;
+        next_       = -1;
+    }
+
+    auto now = source_->now();
+    if (next_ < 0 || now > get_frame_start(next_ + 1, duration_, time_scale_)) {
+        next_ = get_frame_index(now, duration_, time_scale_) + 1;
+    }
+
+    // The os may oversleep by a scheduler tick, so the last part of the wait is spun.
+    const auto start = get_frame_start(next_, duration_, time_scale_);
+    for (auto left = start - now; left > 0; left = start - now) {
+        if (left > spin_) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(left - spin_));
+        } else {
+            std::this_thread::yield();
+        }
+        now = source_->now();
+    }
+
+    ++next_;
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace core {
+
+// A time base that channels are paced against while none of their consumers has a synchronization clock, e.g. a
+// PTP hardware clock or the reference input of a card, see configuration.output.clock.
+class clock_source
+{
+  public:
+    virtual ~clock_source() {}
+
+    // Nanoseconds since the epoch of the source. Frames start on multiples of the frame duration since the epoch, so
+    // channels paced by the same source, on any machine, tick in phase.
+    virtual std::int64_t now() const = 0;
+
+    virtual std::wstring print() const = 0;
+};
+
+// device is configuration.output.clock-device, if set.
+using clock_source_factory_t = std::function<std::shared_ptr<clock_source>(const std::wstring& device)>;
+
+// Makes a source available as configuration.output.clock. system and ptp are built in.
+void register_clock_source(const std::wstring& name, const clock_source_factory_t& factory);
+
+// Returns the configured source, which is shared by all channels, or the system clock if it can't be opened.
+std::shared_ptr<clock_source> get_clock_source();
+
+// Waits for the frame boundaries of a source. Most of the wait is slept, the rest is spun for precision.
+class frame_pacer final
+{
+  public:
+    explicit frame_pacer(std::shared_ptr<clock_source> source);
+
+    // Waits for the start of the frame after the last one waited for, of duration / time_scale seconds. The first
+    // wait, and one that is more than a frame late, starts at the next boundary instead.
+    void wait(int duration, int time_scale);
+
+  private:
+    std::shared_ptr<clock_source> source_;
+    std::int64_t                  spin_;
+    std::int64_t                  next_       = -1;
+    int                           duration_   = 0;
+    int                           time_scale_ = 0;
+};
+
+}} // namespace caspar::core
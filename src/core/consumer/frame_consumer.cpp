@@ -25,10 +25,13 @@
 
 #include <common/except.h>
 #include <common/future.h>
+#include <common/param.h>
 
 #include <core/frame/frame.h>
+#include <core/mixer/audio/audio_route.h>
 #include <core/video_format.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/circular_buffer.hpp>
 #include <boost/property_tree/ptree.hpp>
 
@@ -122,6 +125,8 @@ class destroy_consumer_proxy : public frame_consumer
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                  index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    void set_frame_clock(std::function<void()> tick) override { consumer_->set_frame_clock(std::move(tick)); }
+    bool needs_host_memory() const override { return consumer_->needs_host_memory(); }
 };
 
 class print_consumer_proxy : public frame_consumer
@@ -153,8 +158,60 @@ class print_consumer_proxy : public frame_consumer
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
     int                  index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    void set_frame_clock(std::function<void()> tick) override { consumer_->set_frame_clock(std::move(tick)); }
+    bool needs_host_memory() const override { return consumer_->needs_host_memory(); }
 };
 
+// Sends the consumer the mixed frames with their audio routed, e.g. to put the program on other tracks of an sdi
+// output than the rest of the channel's consumers.
+class route_consumer_proxy : public frame_consumer
+{
+    std::shared_ptr<frame_consumer>          consumer_;
+    const std::shared_ptr<const audio_route> route_;
+    int                                      channels_ = 0;
+
+  public:
+    route_consumer_proxy(spl::shared_ptr<frame_consumer>&& consumer, std::shared_ptr<const audio_route> route)
+        : consumer_(std::move(consumer))
+        , route_(std::move(route))
+    {
+    }
+
+    std::future<bool> send(const_frame frame) override
+    {
+        const auto& audio = frame.audio_data();
+        if (!frame || channels_ < 1 || audio.size() == 0) {
+            return consumer_->send(std::move(frame));
+        }
+
+        auto routed = std::make_shared<std::vector<std::int32_t>>(
+            audio_apply_route(audio.data(), audio.size() / channels_, channels_, *route_));
+        auto data = array<const std::int32_t>(routed->data(), routed->size(), routed);
+
+        return consumer_->send(frame.with_audio(std::move(data)));
+    }
+    void initialize(const video_format_desc& format_desc, int channel_index) override
+    {
+        channels_ = format_desc.audio_channels;
+        consumer_->initialize(format_desc, channel_index);
+    }
+    std::wstring         print() const override { return consumer_->print(); }
+    std::wstring         name() const override { return consumer_->name(); }
+    bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
+    int                  index() const override { return consumer_->index(); }
+    core::monitor::state state() const override { return consumer_->state(); }
+    void set_frame_clock(std::function<void()> tick) override { consumer_->set_frame_clock(std::move(tick)); }
+    bool needs_host_memory() const override { return consumer_->needs_host_memory(); }
+};
+
+spl::shared_ptr<frame_consumer> route_audio(spl::shared_ptr<frame_consumer> consumer, const std::wstring& route)
+{
+    if (boost::trim_copy(route).empty()) {
+        return consumer;
+    }
+    return spl::make_shared<route_consumer_proxy>(std::move(consumer), audio_route::parse(route));
+}
+
 spl::shared_ptr<core::frame_consumer>
 frame_consumer_registry::create_consumer(const std::vector<std::wstring>&            params,
                                          std::vector<spl::shared_ptr<video_channel>> channels) const
@@ -176,6 +233,8 @@ frame_consumer_registry::create_consumer(const std::vector<std::wstring>&
         CASPAR_THROW_EXCEPTION(file_not_found() << msg_info("No match found for supplied commands. Check syntax."));
     }
 
+    consumer = route_audio(std::move(consumer), get_param(L"AUDIO_ROUTE", params, L""));
+
     return spl::make_shared<destroy_consumer_proxy>(spl::make_shared<print_consumer_proxy>(std::move(consumer)));
 }
 
@@ -191,8 +250,9 @@ frame_consumer_registry::create_consumer(const std::wstring&
         CASPAR_THROW_EXCEPTION(user_error()
                                << msg_info(L"No consumer factory registered for element name " + element_name));
 
-    return spl::make_shared<destroy_consumer_proxy>(
-        spl::make_shared<print_consumer_proxy>(found->second(element, channels)));
+    auto consumer = route_audio(found->second(element, channels), element.get(L"audio-route", L""));
+
+    return spl::make_shared<destroy_consumer_proxy>(spl::make_shared<print_consumer_proxy>(std::move(consumer)));
 }
 
 const spl::shared_ptr<frame_consumer>& frame_consumer::empty()
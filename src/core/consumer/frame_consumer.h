@@ -59,6 +59,15 @@ class frame_consumer
     virtual std::wstring name() const  = 0;
     virtual bool         has_synchronization_clock() const { return false; }
     virtual int          index() const = 0;
+
+    // Consumers that only take audio or draw the mixed texture themselves return false. The channel only reads frames
+    // back to host memory ahead of time while a consumer needs it, otherwise the image of a frame is read back the
+    // first time image_data is called on it.
+    virtual bool needs_host_memory() const { return true; }
+
+    // Set on the consumer whose clock paces the channel. Consumers call tick, from any thread, each time their
+    // hardware has taken a frame, and the output then waits for those ticks instead of on send blocking.
+    virtual void set_frame_clock(std::function<void()> tick) {}
 };
 
 using consumer_factory_t =
@@ -20,44 +20,491 @@
  */
 #include "output.h"
 
+#include "clock_source.h"
 #include "frame_consumer.h"
 
+#include "../diagnostics/trace.h"
 #include "../frame/frame.h"
 #include "../monitor/monitor.h"
 #include "../video_format.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/except.h>
+#include <common/log.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 
-#include <boost/optional.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace core {
 
 using time_point_t = decltype(std::chrono::high_resolution_clock::now());
 
+// Counts the ticks of the consumer that paces the channel.
+class frame_clock
+{
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    int64_t                 ticks_ = 0;
+
+  public:
+    void tick()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++ticks_;
+        }
+        cond_.notify_all();
+    }
+
+    int64_t ticks()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ticks_;
+    }
+
+    // Returns false if there was no tick after last within timeout.
+    bool wait(int64_t last, std::chrono::microseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, timeout, [&] { return ticks_ > last; });
+    }
+};
+
+enum class overflow_policy
+{
+    drop,
+    block,
+    disconnect
+};
+
+overflow_policy get_overflow_policy()
+{
+    const auto policy = env::properties().get(L"configuration.output.overflow-policy", std::wstring(L"drop"));
+    if (boost::iequals(policy, L"block")) {
+        return overflow_policy::block;
+    }
+    if (boost::iequals(policy, L"disconnect")) {
+        return overflow_policy::disconnect;
+    }
+    if (!boost::iequals(policy, L"drop")) {
+        CASPAR_LOG(warning) << L"Invalid output overflow-policy: " << policy << L", using drop.";
+    }
+    return overflow_policy::drop;
+}
+
+// Shifts the audio of the frames sent to a consumer against their video, later by a positive offset and earlier by a
+// negative one, which delays the video by whole frames and the audio by the rest. While the video delay fills up the
+// first frame is repeated in silence.
+class av_delay
+{
+    std::deque<const_frame>  frames_;
+    std::deque<std::int32_t> samples_;
+    std::size_t              video_delay_ = 0;
+    bool                     enabled_     = false;
+
+  public:
+    void reset(const video_format_desc& format_desc, int milliseconds)
+    {
+        const auto frame_ms = 1000.0 * format_desc.duration / format_desc.time_scale;
+        video_delay_ = milliseconds < 0 ? static_cast<std::size_t>(std::ceil(-milliseconds / frame_ms)) : 0;
+
+        const auto audio_delay = (milliseconds + video_delay_ * frame_ms) * format_desc.audio_sample_rate / 1000.0;
+        frames_.clear();
+        samples_.assign(static_cast<std::size_t>(std::llround(audio_delay)) * format_desc.audio_channels, 0);
+        enabled_ = milliseconds != 0;
+    }
+
+    const_frame operator()(const_frame frame)
+    {
+        if (!enabled_) {
+            return frame;
+        }
+
+        const auto& audio = frame.audio_data();
+        samples_.insert(samples_.end(), audio.begin(), audio.end());
+        frames_.push_back(std::move(frame));
+
+        if (frames_.size() <= video_delay_) {
+            const auto& first = frames_.front();
+            return first.with_audio(std::vector<std::int32_t>(first.audio_data().size(), 0));
+        }
+
+        auto next = std::move(frames_.front());
+        frames_.pop_front();
+
+        const auto                count = std::min(next.audio_data().size(), samples_.size());
+        std::vector<std::int32_t> shifted(samples_.begin(), samples_.begin() + count);
+        samples_.erase(samples_.begin(), samples_.begin() + count);
+        shifted.resize(next.audio_data().size(), 0);
+
+        return next.with_audio(std::move(shifted));
+    }
+};
+
+// Measures the A/V offset of a sync test signal in the frames sent to a consumer, from the start of the frame that
+// flashes to the sample that the beep starts on, in milliseconds. Positive offsets are audio that is late.
+class av_sync_meter
+{
+    double       video_time_ = 0.0; // of the next frame, in seconds
+    std::int64_t samples_    = 0;   // before the next frame
+    double       flash_      = -1.0;
+    double       beep_       = -1.0;
+    bool         flashing_   = false;
+    bool         beeping_    = false;
+
+  public:
+    // Returns whether the offset was measured on frame.
+    bool operator()(const const_frame& frame, const video_format_desc& format_desc, double& offset)
+    {
+        const auto& audio    = frame.audio_data();
+        const auto  channels = std::max(format_desc.audio_channels, 1);
+        const auto  time     = video_time_;
+        const auto  samples  = samples_;
+        video_time_ += static_cast<double>(format_desc.duration) / format_desc.time_scale;
+        samples_ += audio.size() / channels;
+
+        if (!frame.timing().test_signal) {
+            flash_ = beep_ = -1.0;
+            flashing_ = beeping_ = false;
+            return false;
+        }
+
+        // The flash is white over the whole frame, so the centre of the mixed bgra image is enough to detect it.
+        const auto& image  = frame.image_data(0);
+        const auto  center = (frame.height() / 2 * frame.width() + frame.width() / 2) * 4;
+        const auto  flash  = image.size() >= center + 4 && image.data()[center + 1] > 128;
+        if (flash && !flashing_) {
+            flash_ = time;
+        }
+        flashing_ = flash;
+
+        auto beep = std::find_if(audio.begin(), audio.end(), [](std::int32_t sample) {
+            return std::abs(static_cast<std::int64_t>(sample)) > std::numeric_limits<std::int32_t>::max() / 16;
+        });
+        if (beep != audio.end() && !beeping_) {
+            beep_ = static_cast<double>(samples + (beep - audio.begin()) / channels) / format_desc.audio_sample_rate;
+        }
+        beeping_ = beep != audio.end();
+
+        // A flash or beep that isn't matched within half a second belongs to no pair.
+        if (flash_ >= 0.0 && time - flash_ > 0.5) {
+            flash_ = -1.0;
+        }
+        if (beep_ >= 0.0 && time - beep_ > 0.5) {
+            beep_ = -1.0;
+        }
+        if (flash_ < 0.0 || beep_ < 0.0) {
+            return false;
+        }
+
+        offset = (beep_ - flash_) * 1000.0;
+        flash_ = beep_ = -1.0;
+        return true;
+    }
+};
+
+// Delivers frames to one consumer on its own thread, so that a slow consumer only falls behind by itself.
+// Consumers with a synchronization clock always block with room for a single frame, since their back-pressure
+// is what paces the channel.
+class port
+{
+    const int                             index_;
+    const int                             channel_index_;
+    const spl::shared_ptr<frame_consumer> consumer_;
+    const overflow_policy                 policy_;
+    const std::size_t                     capacity_;
+
+    std::mutex                                       mutex_;
+    std::condition_variable                          cond_;
+    std::deque<std::pair<const_frame, time_point_t>> frames_;
+    bool                                             busy_     = false;
+    bool                                             closed_   = false;
+    bool                                             abort_    = false;
+    bool                                             finished_ = false;
+    monitor::state                                   state_;
+    double                                           latency_ = 0.0;
+    std::int64_t                                     dropped_ = 0;
+
+    // The correction and its delay, which is reset on the port's thread once the offset or the format changed.
+    video_format_desc format_desc_;
+    int               av_offset_        = 0;
+    bool              av_delay_changed_ = true;
+    av_delay          av_delay_;
+    av_sync_meter     av_sync_meter_;
+    double            measured_offset_ = 0.0;
+    monitor::state    timing_;
+    double            total_latency_ = 0.0;
+
+    std::thread thread_;
+
+  public:
+    port(int                             index,
+         int                             channel_index,
+         spl::shared_ptr<frame_consumer> consumer,
+         const video_format_desc&        format_desc,
+         overflow_policy                 policy,
+         std::size_t                     capacity)
+        : index_(index)
+        , channel_index_(channel_index)
+        , consumer_(std::move(consumer))
+        , policy_(consumer_->has_synchronization_clock() ? overflow_policy::block : policy)
+        , capacity_(consumer_->has_synchronization_clock() ? 1 : std::max<std::size_t>(capacity, 1))
+        , state_(consumer_->state())
+        , format_desc_(format_desc)
+        , thread_([this] { run(); })
+    {
+    }
+
+    ~port()
+    {
+        stop();
+        thread_.join();
+    }
+
+    port(const port&) = delete;
+    port& operator=(const port&) = delete;
+
+    const spl::shared_ptr<frame_consumer>& consumer() const { return consumer_; }
+
+    // Queues frame for delivery. Returns false once the consumer is done or has been disconnected.
+    bool push(const_frame frame)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (closed_) {
+            return false;
+        }
+
+        if (frames_.size() + (busy_ ? 1 : 0) >= capacity_) {
+            switch (policy_) {
+                case overflow_policy::block:
+                    cond_.wait(lock, [&] { return closed_ || frames_.size() + (busy_ ? 1 : 0) < capacity_; });
+                    if (closed_) {
+                        return false;
+                    }
+                    break;
+                case overflow_policy::disconnect:
+                    CASPAR_LOG(warning) << consumer_->print() << L" Disconnected, " << capacity_
+                                        << L" frames behind.";
+                    closed_ = true;
+                    return false;
+                case overflow_policy::drop:
+                    ++dropped_;
+                    if (frames_.empty()) {
+                        return true;
+                    }
+                    // Keeps the newest frames, so that a consumer which catches up is as close to live as possible.
+                    frames_.pop_front();
+                    break;
+            }
+        }
+
+        frames_.emplace_back(std::move(frame), std::chrono::high_resolution_clock::now());
+        cond_.notify_all();
+
+        return true;
+    }
+
+    // Discards queued frames and reinitializes the consumer once it has taken the frame in flight.
+    void initialize(const video_format_desc& format_desc, int channel_index)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            frames_.clear();
+            const auto timeout = std::chrono::microseconds(static_cast<int>(4e6 / format_desc.fps));
+            if (!cond_.wait_for(lock, timeout, [&] { return !busy_; })) {
+                CASPAR_THROW_EXCEPTION(timed_out() << msg_info(consumer_->print() + L" Didn't take a frame."));
+            }
+            format_desc_      = format_desc;
+            av_delay_changed_ = true;
+        }
+        consumer_->initialize(format_desc, channel_index);
+    }
+
+    // Sends the audio milliseconds later than the video, or earlier if negative, see av_delay.
+    void set_av_offset(int milliseconds)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        av_offset_        = milliseconds;
+        av_delay_changed_ = true;
+    }
+
+    double total_latency()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return total_latency_;
+    }
+
+    // Stops delivery without waiting for the frame in flight.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_  = true;
+            closed_ = true;
+            frames_.clear();
+        }
+        cond_.notify_all();
+    }
+
+    bool finished()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return finished_;
+    }
+
+    monitor::state state()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto state              = state_;
+        state["output/backlog"]       = static_cast<std::int32_t>(frames_.size() + (busy_ ? 1 : 0));
+        state["output/latency"]       = latency_;
+        state["output/dropped"]       = dropped_;
+        state["output/timing"]        = timing_;
+        state["output/av-correction"] = av_offset_;
+        state["output/av-offset"]     = measured_offset_;
+        return state;
+    }
+
+  private:
+    void run()
+    {
+        set_thread_name(L"[core::output::port " + std::to_wstring(index_) + L"]");
+        set_thread_role(L"output");
+        bind_thread_to_channel(channel_index_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cond_.wait(lock, [&] { return abort_ || !frames_.empty(); });
+            if (abort_) {
+                break;
+            }
+
+            auto frame = std::move(frames_.front());
+            frames_.pop_front();
+            busy_                  = true;
+            const auto format_desc = format_desc_;
+            if (av_delay_changed_) {
+                av_delay_.reset(format_desc_, av_offset_);
+                av_delay_changed_ = false;
+            }
+            lock.unlock();
+
+            auto         sent     = false;
+            auto         measured = false;
+            double       offset   = 0.0;
+            frame_timing timing;
+            auto         sending = std::chrono::steady_clock::now();
+            try {
+                auto next = av_delay_(std::move(frame.first));
+                measured  = av_sync_meter_(next, format_desc, offset);
+                timing    = next.timing();
+
+                CASPAR_TRACE_SCOPE("consumer::send", channel_index_);
+                sending = std::chrono::steady_clock::now();
+                sent    = consumer_->send(std::move(next)).get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            auto state = consumer_->state();
+            auto latency =
+                std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frame.second);
+
+            // The time of each stage that the frame passed, in milliseconds, up to when the consumer took it.
+            const auto sent_at = std::chrono::steady_clock::now();
+            const auto elapsed = [](std::chrono::steady_clock::time_point from,
+                                    std::chrono::steady_clock::time_point to) {
+                return from.time_since_epoch().count() != 0 && to.time_since_epoch().count() != 0
+                           ? std::chrono::duration<double, std::milli>(to - from).count()
+                           : 0.0;
+            };
+            monitor::state timing_state;
+            timing_state["produce"] = elapsed(timing.received, timing.mixing);
+            timing_state["mix"]     = elapsed(timing.mixing, timing.mixed);
+            timing_state["queue"]   = elapsed(timing.mixed, sending);
+            timing_state["send"]    = elapsed(sending, sent_at);
+            timing_state["total"]   = elapsed(timing.received, sent_at);
+
+            lock.lock();
+            busy_          = false;
+            state_         = std::move(state);
+            latency_       = latency.count();
+            timing_        = std::move(timing_state);
+            total_latency_ = elapsed(timing.received, sent_at);
+            if (measured) {
+                measured_offset_ = offset;
+            }
+            if (!sent) {
+                closed_ = true;
+            }
+            cond_.notify_all();
+            if (closed_) {
+                break;
+            }
+        }
+        finished_ = true;
+    }
+};
+
 struct output::impl
 {
     monitor::state                      state_;
-    spl::shared_ptr<diagnostics::graph> graph_;
+    spl::shared_ptr<caspar::diagnostics::graph> graph_;
     const int                           channel_index_;
     video_format_desc                   format_desc_;
+    const overflow_policy               policy_;
+    const std::size_t                   queue_depth_;
+
+    std::mutex                           consumers_mutex_;
+    std::map<int, std::shared_ptr<port>> consumers_;
+    std::vector<std::shared_ptr<port>>   removed_;
+    std::atomic<bool>                    needs_host_memory_{false};
 
-    std::mutex                                     consumers_mutex_;
-    std::map<int, spl::shared_ptr<frame_consumer>> consumers_;
+    // Reused by the tick, which only allocates when consumers are added, see the "tick-alloc" tag.
+    using port_list = std::vector<std::pair<int, std::shared_ptr<port>>>;
+    port_list                          ports_;
+    std::vector<int>                   closed_ports_;
+    std::vector<std::shared_ptr<port>> finished_ports_;
+    std::int64_t                       tick_allocations_ = 0;
 
-    boost::optional<time_point_t> time_;
+    // Paces the channel while no consumer has a synchronization clock.
+    frame_pacer pacer_{get_clock_source()};
+
+    // The first consumer with a synchronization clock is the master. Clocks that never tick, e.g. of consumers
+    // that pace the channel by blocking in send, are never waited for.
+    int                          clock_index_ = -1;
+    std::shared_ptr<frame_clock> clock_;
+    int64_t                      clock_ticks_ = 0;
 
   public:
-    impl(spl::shared_ptr<diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index)
+    impl(spl::shared_ptr<caspar::diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index)
         : graph_(std::move(graph))
         , channel_index_(channel_index)
         , format_desc_(format_desc)
+        , policy_(get_overflow_policy())
+        , queue_depth_(std::max(1, env::properties().get(L"configuration.output.queue-depth", 2)))
     {
+        graph_->set_color("output-latency", caspar::diagnostics::color(0.9f, 0.9f, 0.3f, 0.8f));
     }
 
     void add(int index, spl::shared_ptr<frame_consumer> consumer)
@@ -66,8 +513,12 @@ struct output::impl
 
         consumer->initialize(format_desc_, channel_index_);
 
+        auto p =
+            std::make_shared<port>(index, channel_index_, std::move(consumer), format_desc_, policy_, queue_depth_);
+
         std::lock_guard<std::mutex> lock(consumers_mutex_);
-        consumers_.emplace(index, std::move(consumer));
+        consumers_.emplace(index, std::move(p));
+        update_host_memory();
     }
 
     void add(const spl::shared_ptr<frame_consumer>& consumer) { add(consumer->index(), consumer); }
@@ -77,14 +528,43 @@ struct output::impl
         std::lock_guard<std::mutex> lock(consumers_mutex_);
         auto                        it = consumers_.find(index);
         if (it != consumers_.end()) {
+            retire(it->second);
             consumers_.erase(it);
+            update_host_memory();
             return true;
         }
         return false;
     }
 
+    // Requires consumers_mutex_. The port is joined by a later tick once its frame in flight has been taken.
+    void retire(const std::shared_ptr<port>& port)
+    {
+        port->stop();
+        removed_.push_back(port);
+    }
+
+    // Requires consumers_mutex_.
+    void update_host_memory()
+    {
+        needs_host_memory_ = std::any_of(
+            consumers_.begin(), consumers_.end(), [](auto& p) { return p.second->consumer()->needs_host_memory(); });
+    }
+
+    bool needs_host_memory() const { return needs_host_memory_; }
+
     bool remove(const spl::shared_ptr<frame_consumer>& consumer) { return remove(consumer->index()); }
 
+    bool set_av_offset(int index, int milliseconds)
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        auto                        it = consumers_.find(index);
+        if (it == consumers_.end()) {
+            return false;
+        }
+        it->second->set_av_offset(milliseconds);
+        return true;
+    }
+
     void operator()(const_frame input_frame, const core::video_format_desc& format_desc)
     {
         if (!input_frame) {
@@ -96,8 +576,6 @@ struct output::impl
             return;
         }
 
-        auto time = std::move(time_);
-
         if (format_desc_ != format_desc) {
             std::lock_guard<std::mutex> lock(consumers_mutex_);
             for (auto it = consumers_.begin(); it != consumers_.end();) {
@@ -106,76 +584,133 @@ struct output::impl
                     ++it;
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
+                    retire(it->second);
                     it = consumers_.erase(it);
                 }
             }
+            update_host_memory();
             format_desc_ = format_desc;
-            time_        = boost::none;
             return;
         }
 
-        decltype(consumers_) consumers;
+        const auto capacity = ports_.capacity() + closed_ports_.capacity() + finished_ports_.capacity();
+
         {
             std::lock_guard<std::mutex> lock(consumers_mutex_);
-            consumers = consumers_;
-        }
+            ports_.assign(consumers_.begin(), consumers_.end());
 
-        std::map<int, std::future<bool>> futures;
+            auto it =
+                std::stable_partition(removed_.begin(), removed_.end(), [](auto& p) { return !p->finished(); });
+            finished_ports_.assign(std::make_move_iterator(it), std::make_move_iterator(removed_.end()));
+            removed_.erase(it, removed_.end());
+        }
+        finished_ports_.clear();
 
-        for (auto it = consumers_.begin(); it != consumers_.end();) {
-            try {
-                futures.emplace(it->first, it->second->send(input_frame));
-                ++it;
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                it = consumers_.erase(it);
+        // Frames mixed before a consumer that needs host memory was added are read back when it first asks for them.
+        closed_ports_.clear();
+        for (auto& p : ports_) {
+            if (!p.second->push(input_frame)) {
+                closed_ports_.push_back(p.first);
             }
         }
 
-        for (auto& p : futures) {
-            try {
-                if (!p.second.get()) {
-                    consumers_.erase(p.first);
+        if (!closed_ports_.empty()) {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            for (auto index : closed_ports_) {
+                auto port = std::find_if(ports_.begin(), ports_.end(), [&](auto& p) { return p.first == index; });
+                auto it   = consumers_.find(index);
+                if (it != consumers_.end() && it->second == port->second) {
+                    retire(it->second);
+                    consumers_.erase(it);
                 }
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                consumers_.erase(p.first);
+                ports_.erase(port);
             }
+            update_host_memory();
+        }
+
+        if (ports_.capacity() + closed_ports_.capacity() + finished_ports_.capacity() != capacity) {
+            ++tick_allocations_;
+            graph_->set_tag(caspar::diagnostics::tag_severity::INFO, "tick-alloc");
         }
 
         monitor::state state;
-        for (auto& p : consumers_) {
+        double         latency = 0.0;
+        for (auto& p : ports_) {
             state["port"][p.first] = p.second->state();
+            latency                = std::max(latency, p.second->total_latency());
         }
-        state_ = std::move(state);
+        // The longest time from receive to send, full scale at ten frames.
+        graph_->set_value("output-latency", latency * format_desc_.fps / 10000.0);
+        state["tick-allocations"] = tick_allocations_;
+        state_                    = std::move(state);
 
-        const auto needs_sync = std::all_of(
-            consumers_.begin(), consumers_.end(), [](auto& p) { return !p.second->has_synchronization_clock(); });
+        update_clock(ports_);
+
+        const auto needs_sync = std::all_of(ports_.begin(), ports_.end(), [](auto& p) {
+            return !p.second->consumer()->has_synchronization_clock();
+        });
 
         if (needs_sync) {
-            if (!time) {
-                time = std::chrono::high_resolution_clock::now();
-            } else {
-                std::this_thread::sleep_until(*time);
-            }
-            time_ = *time + std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.fps));
+            pacer_.wait(format_desc_.duration, format_desc_.time_scale);
         } else {
-            time_.reset();
+            if (clock_ && clock_->ticks() > 0) {
+                // Wait for the master to take this frame, or give up after a couple of frames if it stalls.
+                const auto timeout = std::chrono::microseconds(static_cast<int>(2e6 / format_desc_.fps));
+                if (!clock_->wait(clock_ticks_, timeout)) {
+                    CASPAR_LOG(trace) << print() << L" Clock didn't tick.";
+                }
+                clock_ticks_ = clock_->ticks();
+            }
+        }
+    }
+
+    void update_clock(const port_list& ports)
+    {
+        auto it = std::find_if(
+            ports.begin(), ports.end(), [](auto& p) { return p.second->consumer()->has_synchronization_clock(); });
+
+        const auto index = it != ports.end() ? it->first : -1;
+        if (index == clock_index_) {
+            return;
+        }
+
+        auto old = std::find_if(ports.begin(), ports.end(), [&](auto& p) { return p.first == clock_index_; });
+        if (old != ports.end()) {
+            old->second->consumer()->set_frame_clock(nullptr);
+        }
+
+        clock_index_ = index;
+        clock_.reset();
+        clock_ticks_ = 0;
+
+        if (it != ports.end()) {
+            clock_ = std::make_shared<frame_clock>();
+            it->second->consumer()->set_frame_clock([weak_clock = std::weak_ptr<frame_clock>(clock_)] {
+                auto clock = weak_clock.lock();
+                if (clock) {
+                    clock->tick();
+                }
+            });
+            CASPAR_LOG(info) << print() << L" " << it->second->consumer()->print() << L" is the clock master.";
         }
     }
 
     std::wstring print() const { return L"output[" + std::to_wstring(channel_index_) + L"]"; }
 };
 
-output::output(spl::shared_ptr<diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index)
+output::output(spl::shared_ptr<caspar::diagnostics::graph> graph,
+               const video_format_desc&                  format_desc,
+               int                                       channel_index)
     : impl_(new impl(std::move(graph), format_desc, channel_index))
 {
 }
 output::~output() {}
 void output::add(int index, const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(index, consumer); }
 void output::add(const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(consumer); }
+bool output::needs_host_memory() const { return impl_->needs_host_memory(); }
 bool output::remove(int index) { return impl_->remove(index); }
 bool output::remove(const spl::shared_ptr<frame_consumer>& consumer) { return impl_->remove(consumer); }
+bool output::set_av_offset(int index, int milliseconds) { return impl_->set_av_offset(index, milliseconds); }
 void output::operator()(const_frame frame, const video_format_desc& format_desc)
 {
     return (*impl_)(std::move(frame), format_desc);
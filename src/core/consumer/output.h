@@ -49,6 +49,13 @@ class output final
     bool remove(const spl::shared_ptr<frame_consumer>& consumer);
     bool remove(int index);
 
+    // Sends the audio of consumer index milliseconds later than its video, or earlier if negative, e.g. to correct
+    // the offset of a device downstream. Returns false if there is no such consumer.
+    bool set_av_offset(int index, int milliseconds);
+
+    // Returns whether any consumer needs mixed frames in host memory, see frame_consumer::needs_host_memory.
+    bool needs_host_memory() const;
+
     core::monitor::state state() const;
 
   private:
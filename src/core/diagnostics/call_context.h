@@ -43,6 +43,12 @@ class scoped_call_context
 
   public:
     scoped_call_context() { saved_ = call_context::for_thread(); }
+    scoped_call_context(int video_channel, int layer)
+        : scoped_call_context()
+    {
+        call_context::for_thread().video_channel = video_channel;
+        call_context::for_thread().layer         = layer;
+    }
     ~scoped_call_context() { call_context::for_thread() = saved_; }
 };
 
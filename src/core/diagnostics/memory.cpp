@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "memory.h"
+
+#include <common/env.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+namespace {
+
+struct account_registry
+{
+    std::mutex                                                      mutex;
+    std::map<std::pair<int, int>, std::shared_ptr<memory_account>> accounts;
+
+    std::shared_ptr<memory_account> find_or_add(const call_context& owner)
+    {
+        auto& account = accounts[std::make_pair(owner.video_channel, owner.layer)];
+        if (!account) {
+            auto channel = owner.layer >= 0 ? find_or_add(call_context{owner.video_channel, -1}) : nullptr;
+            account      = std::make_shared<memory_account>(owner, std::move(channel));
+        }
+        return account;
+    }
+};
+
+account_registry& registry()
+{
+    static account_registry registry;
+    return registry;
+}
+
+std::int64_t cap(const std::wstring& name)
+{
+    return env::properties().get(L"configuration.memory." + name, std::int64_t(0)) * 1024 * 1024;
+}
+
+std::int64_t layer_cap()
+{
+    static const auto value = cap(L"layer-cap");
+    return value;
+}
+
+std::int64_t channel_cap()
+{
+    static const auto value = cap(L"channel-cap");
+    return value;
+}
+
+std::int64_t pressure_cap()
+{
+    static const auto value = cap(L"pressure-cap");
+    return value;
+}
+
+std::atomic<std::int64_t> all_bytes{0};
+
+} // namespace
+
+memory_account::memory_account(call_context owner, std::shared_ptr<memory_account> channel)
+    : owner_(owner)
+    , channel_(std::move(channel))
+{
+    bytes_[0] = 0;
+    bytes_[1] = 0;
+}
+
+std::shared_ptr<memory_account> memory_account::for_owner(const call_context& owner)
+{
+    if (owner.video_channel < 0) {
+        return nullptr;
+    }
+
+    // Threads mostly allocate for one owner, e.g. a decoder for its layer, so the last account is kept at hand.
+    thread_local call_context                    cached_owner;
+    thread_local std::shared_ptr<memory_account> cached_account;
+    if (cached_account && cached_owner.video_channel == owner.video_channel && cached_owner.layer == owner.layer) {
+        return cached_account;
+    }
+
+    auto& accounts = registry();
+
+    std::lock_guard<std::mutex> lock(accounts.mutex);
+    cached_owner   = owner;
+    cached_account = accounts.find_or_add(owner);
+    return cached_account;
+}
+
+void memory_account::add(memory_kind kind, std::int64_t bytes)
+{
+    bytes_[static_cast<int>(kind)] += bytes;
+    total_ += bytes;
+    all_bytes += bytes;
+    if (channel_) {
+        channel_->total_ += bytes;
+    }
+}
+
+bool memory_account::over_cap() const
+{
+    if (owner_.layer >= 0 && layer_cap() > 0 && total_ > layer_cap()) {
+        return true;
+    }
+    const auto& channel = channel_ ? *channel_ : *this;
+    return channel_cap() > 0 && channel.total_ > channel_cap();
+}
+
+memory_charge::memory_charge(std::shared_ptr<memory_account> account, memory_kind kind, std::int64_t bytes)
+    : account_(std::move(account))
+    , kind_(kind)
+    , bytes_(bytes)
+{
+    if (account_) {
+        account_->add(kind_, bytes_);
+    }
+}
+
+memory_charge::memory_charge(memory_charge&& other)
+    : account_(std::move(other.account_))
+    , kind_(other.kind_)
+    , bytes_(other.bytes_)
+{
+    other.bytes_ = 0;
+}
+
+memory_charge& memory_charge::operator=(memory_charge&& other)
+{
+    if (this != &other) {
+        if (account_) {
+            account_->add(kind_, -bytes_);
+        }
+        account_     = std::move(other.account_);
+        kind_        = other.kind_;
+        bytes_       = other.bytes_;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+memory_charge::~memory_charge()
+{
+    if (account_) {
+        account_->add(kind_, -bytes_);
+    }
+}
+
+bool memory_pressure() { return pressure_cap() > 0 && all_bytes > pressure_cap(); }
+
+int buffer_frames(double duration, double fps, std::int64_t frame_bytes, std::int64_t budget, int min_frames)
+{
+    auto frames = static_cast<std::int64_t>(duration * fps);
+    if (budget > 0 && frame_bytes > 0) {
+        frames = std::min(frames, budget / frame_bytes);
+    }
+    return static_cast<int>(std::max<std::int64_t>(frames, min_frames));
+}
+
+monitor::state memory_state(int video_channel)
+{
+    auto& accounts = registry();
+
+    std::int64_t host     = 0;
+    std::int64_t device   = 0;
+    auto         over_cap = false;
+
+    monitor::state state;
+    {
+        std::lock_guard<std::mutex> lock(accounts.mutex);
+
+        auto it  = accounts.accounts.lower_bound(std::make_pair(video_channel, -1));
+        auto end = accounts.accounts.lower_bound(std::make_pair(video_channel + 1, -1));
+        for (; it != end; ++it) {
+            const auto& account      = *it->second;
+            const auto  layer_host   = account.bytes(memory_kind::host);
+            const auto  layer_device = account.bytes(memory_kind::device);
+
+            host += layer_host;
+            device += layer_device;
+            over_cap = over_cap || account.over_cap();
+
+            if (account.owner().layer >= 0 && (layer_host != 0 || layer_device != 0)) {
+                state["layer"][account.owner().layer]["host"]   = layer_host;
+                state["layer"][account.owner().layer]["device"] = layer_device;
+            }
+        }
+    }
+
+    state["host"]     = host;
+    state["device"]   = device;
+    state["over-cap"] = over_cap;
+    state["pressure"] = memory_pressure();
+    return state;
+}
+
+std::vector<memory_usage> memory_usages()
+{
+    auto& accounts = registry();
+
+    std::vector<memory_usage> result;
+
+    std::lock_guard<std::mutex> lock(accounts.mutex);
+    for (auto& p : accounts.accounts) {
+        memory_usage usage;
+        usage.owner  = p.second->owner();
+        usage.host   = p.second->bytes(memory_kind::host);
+        usage.device = p.second->bytes(memory_kind::device);
+        if (usage.host != 0 || usage.device != 0) {
+            result.push_back(usage);
+        }
+    }
+    return result;
+}
+
+}}} // namespace caspar::core::diagnostics
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "call_context.h"
+
+#include <core/monitor/monitor.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+enum class memory_kind
+{
+    host,
+    device,
+};
+
+// The bytes held by the owner of a call_context, a layer of a channel, or the channel itself for layer -1. Accounts
+// live as long as the server, so charges and producers can hold on to them without looking them up again.
+class memory_account
+{
+    const call_context                    owner_;
+    const std::shared_ptr<memory_account> channel_;
+    std::atomic<std::int64_t>             bytes_[2];
+    std::atomic<std::int64_t>             total_{0};
+
+    memory_account(const memory_account&) = delete;
+    memory_account& operator=(const memory_account&) = delete;
+
+  public:
+    memory_account(call_context owner, std::shared_ptr<memory_account> channel);
+
+    // Returns the account of owner, which is nullptr for allocations outside of a channel, e.g. by the device thread.
+    static std::shared_ptr<memory_account> for_owner(const call_context& owner = call_context::for_thread());
+
+    void add(memory_kind kind, std::int64_t bytes);
+
+    std::int64_t bytes(memory_kind kind) const { return bytes_[static_cast<int>(kind)]; }
+
+    // Bytes of the account, and for a channel those of its layers as well.
+    std::int64_t total() const { return total_; }
+
+    // True while the layer holds more than configuration.memory.layer-cap allows, or its channel more than
+    // channel-cap. Owners drop or stop buffering frames then.
+    bool over_cap() const;
+
+    const call_context& owner() const { return owner_; }
+};
+
+// Keeps bytes charged to an account until it is destroyed.
+class memory_charge
+{
+    std::shared_ptr<memory_account> account_;
+    memory_kind                     kind_  = memory_kind::host;
+    std::int64_t                    bytes_ = 0;
+
+    memory_charge(const memory_charge&) = delete;
+    memory_charge& operator=(const memory_charge&) = delete;
+
+  public:
+    memory_charge() = default;
+    memory_charge(std::shared_ptr<memory_account> account, memory_kind kind, std::int64_t bytes);
+    memory_charge(memory_charge&& other);
+    memory_charge& operator=(memory_charge&& other);
+    ~memory_charge();
+
+    const std::shared_ptr<memory_account>& account() const { return account_; }
+};
+
+// True while all owners together hold more than configuration.memory.pressure-cap. Buffers of owners that aren't
+// being played from, e.g. producers loaded in the background, stop at their minimum then.
+bool memory_pressure();
+
+// The frames that a buffer should hold to cover duration seconds at fps, without its frames of frame_bytes each
+// going over budget bytes, 0 for no budget. Never fewer than min_frames.
+int buffer_frames(double duration, double fps, std::int64_t frame_bytes, std::int64_t budget, int min_frames);
+
+// The channel totals and those of each layer that holds memory, for the state of the channel.
+monitor::state memory_state(int video_channel);
+
+struct memory_usage
+{
+    call_context owner;
+    std::int64_t host   = 0;
+    std::int64_t device = 0;
+};
+
+// The usage of every owner that holds memory.
+std::vector<memory_usage> memory_usages();
+
+}}} // namespace caspar::core::diagnostics
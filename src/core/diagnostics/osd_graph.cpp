@@ -35,15 +35,17 @@
 #include <boost/circular_buffer.hpp>
 #include <boost/optional.hpp>
 
-#include <tbb/concurrent_unordered_map.h>
+#include <tbb/concurrent_queue.h>
 
 #include <GL/glew.h>
 
 #include <atomic>
+#include <cstdint>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <tuple>
+#include <vector>
 
 namespace caspar { namespace core { namespace diagnostics { namespace osd {
 
@@ -247,42 +249,48 @@ class context : public drawable
 
 class line : public drawable
 {
+    std::shared_ptr<const caspar::diagnostics::spi::series> series_;
+    std::uint64_t                                           position_ = 0;
+    std::vector<caspar::diagnostics::spi::series::sample>   samples_;
+
     size_t                                                   res_{1024};
     boost::circular_buffer<sf::Vertex>                       line_data_{res_};
     boost::circular_buffer<boost::optional<sf::VertexArray>> line_tags_{res_};
 
-    std::atomic<float> tick_data_;
-    std::atomic<bool>  tick_tag_;
-    std::atomic<int>   color_;
+    float tick_data_ = -1.0f;
+    bool  tick_tag_  = false;
 
     double x_delta_ = 1.0 / (static_cast<double>(res_) - 1.0);
 
   public:
-    line()
-        : tick_data_(-1.0f)
-        , tick_tag_(false)
-        , color_(0xFFFFFFFF)
+    explicit line(std::shared_ptr<const caspar::diagnostics::spi::series> series)
+        : series_(std::move(series))
     {
     }
 
-    line(const line& other)
-        : res_(other.res_)
-        , line_data_(other.line_data_)
-        , line_tags_(other.line_tags_)
-        , tick_data_(other.tick_data_.load())
-        , tick_tag_(other.tick_tag_.load())
-        , color_(other.color_.load())
-        , x_delta_(other.x_delta_)
-    {
-    }
-
-    void set_value(float value) { tick_data_ = value; }
-
-    void set_tag() { tick_tag_ = true; }
+    const std::string& name() const { return series_->name(); }
 
-    void set_color(int color) { color_ = color; }
+    int get_color() const { return series_->color(); }
 
-    int get_color() { return color_; }
+    // Takes the samples written since the last render, the last value is drawn and any tag since then.
+    void update(bool auto_reset)
+    {
+        samples_.clear();
+        series_->read(position_, samples_);
+
+        auto has_value = false;
+        for (auto& sample : samples_) {
+            if (sample.tag) {
+                tick_tag_ = true;
+            } else {
+                tick_data_ = sample.value;
+                has_value  = true;
+            }
+        }
+        if (!has_value && auto_reset) {
+            tick_data_ = 0.0f;
+        }
+    }
 
     void render(sf::RenderTarget& target, sf::RenderStates states) override
     {
@@ -302,7 +310,7 @@ class line : public drawable
             }
         }
 
-        auto color = get_sfml_color(color_);
+        auto color = get_sfml_color(get_color());
         color.a    = 255 * 0.8;
         line_data_.push_back(sf::Vertex(
             sf::Vector2f(get_insertion_xcoord(), std::max(0.1f, std::min(0.9f, (1.0f - tick_data_) * 0.8f + 0.1f))),
@@ -356,8 +364,11 @@ struct graph
     , public caspar::diagnostics::spi::graph_sink
     , public std::enable_shared_from_this<graph>
 {
-    call_context                                     context_ = call_context::for_thread();
-    tbb::concurrent_unordered_map<std::string, line> lines_;
+    call_context context_ = call_context::for_thread();
+
+    // Series are handed over to the render thread, which is the only one that touches lines_.
+    tbb::concurrent_queue<std::shared_ptr<const caspar::diagnostics::spi::series>> added_;
+    std::vector<line>                                                              lines_;
 
     std::mutex   mutex_;
     std::wstring text_;
@@ -374,18 +385,11 @@ struct graph
         text_ = std::move(temp);
     }
 
-    void set_value(const std::string& name, double value) override
-    {
-        lines_[name].set_value(static_cast<float>(value));
-    }
-
-    void set_tag(caspar::diagnostics::tag_severity /*severity*/, const std::string& name) override
+    void add_series(const std::shared_ptr<const caspar::diagnostics::spi::series>& series) override
     {
-        lines_[name].set_tag();
+        added_.push(series);
     }
 
-    void set_color(const std::string& name, int color) override { lines_[name].set_color(color); }
-
     void auto_reset() override
     {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -408,6 +412,14 @@ struct graph
             auto_reset = auto_reset_;
         }
 
+        std::shared_ptr<const caspar::diagnostics::spi::series> series;
+        while (added_.try_pop(series)) {
+            lines_.emplace_back(std::move(series));
+        }
+        for (auto& line : lines_) {
+            line.update(auto_reset);
+        }
+
         sf::Text text(text_str.c_str(), get_default_font(), text_size);
         text.setStyle(sf::Text::Italic);
         text.move(text_margin, text_margin);
@@ -429,10 +441,10 @@ struct graph
 
         float x_offset = text_margin;
 
-        for (auto it = lines_.begin(); it != lines_.end(); ++it) {
-            sf::Text line_text(it->first, get_default_font(), text_size);
+        for (auto& line : lines_) {
+            sf::Text line_text(line.name(), get_default_font(), text_size);
             line_text.setPosition(x_offset, text_margin + text_offset / 2);
-            line_text.setColor(get_sfml_color(it->second.get_color()));
+            line_text.setColor(get_sfml_color(line.get_color()));
             target.draw(line_text, states);
             x_offset += line_text.getLocalBounds().width + text_margin * 2;
         }
@@ -480,10 +492,8 @@ struct graph
 
         glDisable(GL_LINE_STIPPLE);
 
-        for (auto it = lines_.begin(); it != lines_.end(); ++it) {
-            target.draw(it->second, states);
-            if (auto_reset)
-                it->second.set_value(0.0f);
+        for (auto& line : lines_) {
+            target.draw(line, states);
         }
     }
 };
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "trace.h"
+
+#include "call_context.h"
+
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace core { namespace diagnostics { namespace trace {
+
+std::atomic<bool> enabled{false};
+
+namespace {
+
+// Spans beyond this are dropped, so that a long trace can't exhaust memory.
+const std::size_t MAX_EVENTS = 1 << 20;
+
+struct event
+{
+    const char*  name;
+    std::int64_t start;
+    std::int64_t duration;
+    int          channel;
+    int          layer;
+    int          thread;
+};
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int thread_index()
+{
+    static std::atomic<int> next{1};
+    thread_local int        index = next++;
+    return index;
+}
+
+struct recorder
+{
+    std::mutex                   mutex;
+    std::condition_variable      cond;
+    bool                         stop_requested = false;
+    std::thread                  thread;
+    tbb::concurrent_queue<event> events;
+    std::atomic<std::size_t>     count{0};
+
+    ~recorder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop_requested = true;
+        }
+        cond.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    void write(const std::wstring& filename)
+    {
+        boost::filesystem::ofstream file(boost::filesystem::path(filename), std::ios::trunc);
+        if (!file) {
+            CASPAR_LOG(error) << L"[trace] Failed to open " << filename;
+            return;
+        }
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        auto  first = true;
+        event e;
+        while (events.try_pop(e)) {
+            file << (first ? "\n" : ",\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1"
+                 << ",\"tid\":" << e.thread << ",\"ts\":" << e.start << ",\"dur\":" << e.duration
+                 << ",\"args\":{\"channel\":" << e.channel << ",\"layer\":" << e.layer << "}}";
+            first = false;
+        }
+
+        file << "\n]}\n";
+
+        CASPAR_LOG(info) << L"[trace] Wrote " << std::min(count.load(), MAX_EVENTS) << L" spans to " << filename;
+    }
+};
+
+recorder& get_recorder()
+{
+    static recorder instance;
+    return instance;
+}
+
+} // namespace
+
+bool start(const std::wstring& filename, std::chrono::milliseconds duration)
+{
+    auto&                       recorder = get_recorder();
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+
+    if (enabled) {
+        return false;
+    }
+
+    // The previous trace is done recording, but may still be writing.
+    if (recorder.thread.joinable()) {
+        recorder.thread.join();
+    }
+
+    event e;
+    while (recorder.events.try_pop(e)) {
+    }
+    recorder.count          = 0;
+    recorder.stop_requested = false;
+    enabled                 = true;
+
+    recorder.thread = std::thread([&recorder, filename, duration] {
+        set_thread_name(L"trace");
+
+        {
+            std::unique_lock<std::mutex> lock(recorder.mutex);
+            recorder.cond.wait_for(lock, duration, [&] { return recorder.stop_requested; });
+            enabled = false;
+        }
+
+        try {
+            recorder.write(filename);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+
+    CASPAR_LOG(info) << L"[trace] Recording " << duration.count() << L" ms to " << filename;
+
+    return true;
+}
+
+void stop()
+{
+    auto& recorder = get_recorder();
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        recorder.stop_requested = true;
+    }
+    recorder.cond.notify_all();
+}
+
+void scope::begin()
+{
+    const auto& context = call_context::for_thread();
+    channel_            = channel_ != -1 ? channel_ : context.video_channel;
+    layer_              = layer_ != -1 ? layer_ : context.layer;
+    start_              = now();
+}
+
+void scope::end()
+{
+    auto& recorder = get_recorder();
+    if (recorder.count++ >= MAX_EVENTS) {
+        return;
+    }
+
+    recorder.events.push(event{name_, start_, now() - start_, channel_, layer_, thread_index()});
+}
+
+}}}} // namespace caspar::core::diagnostics::trace
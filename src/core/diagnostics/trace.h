@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace core { namespace diagnostics { namespace trace {
+
+// Records the spans of all threads for duration and then writes them to filename as a Chrome trace, which also
+// opens in Perfetto. Spans carry the channel and layer of the call_context of their thread. Returns false if a trace
+// is already being recorded.
+bool start(const std::wstring& filename, std::chrono::milliseconds duration);
+
+// Ends the trace that is being recorded early and writes it.
+void stop();
+
+extern std::atomic<bool> enabled;
+
+// Records the time from construction to destruction as a span while a trace is recorded, and costs a load otherwise.
+// name has to outlive the trace, e.g. a literal. A channel or layer of -1 is taken from the call_context.
+class scope
+{
+    const char*  name_;
+    int          channel_;
+    int          layer_;
+    std::int64_t start_ = -1;
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+  public:
+    explicit scope(const char* name, int channel = -1, int layer = -1)
+        : name_(name)
+        , channel_(channel)
+        , layer_(layer)
+    {
+        if (enabled.load(std::memory_order_relaxed)) {
+            begin();
+        }
+    }
+
+    ~scope()
+    {
+        if (start_ >= 0) {
+            end();
+        }
+    }
+
+  private:
+    void begin();
+    void end();
+};
+
+}}}} // namespace caspar::core::diagnostics::trace
+
+#define _CASPAR_TRACE_SCOPE_LINENAME_CAT(name, line) name##line
+#define _CASPAR_TRACE_SCOPE_LINENAME(name, line) _CASPAR_TRACE_SCOPE_LINENAME_CAT(name, line)
+#define CASPAR_TRACE_SCOPE(...)                                                                                        \
+    ::caspar::core::diagnostics::trace::scope _CASPAR_TRACE_SCOPE_LINENAME(trace_scope_, __LINE__)(__VA_ARGS__)
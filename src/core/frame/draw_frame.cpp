@@ -74,14 +74,12 @@ struct draw_frame::impl
 };
 
 draw_frame::draw_frame()
-    : impl_(new impl())
+    : impl_(std::make_shared<impl>())
 {
 }
 draw_frame::draw_frame(const draw_frame& other)
-    : impl_(new impl())
+    : impl_(other.impl_)
 {
-    impl_->frame_     = other.impl_->frame_;
-    impl_->transform_ = other.impl_->transform_;
 }
 
 draw_frame::draw_frame(draw_frame&& other)
@@ -89,15 +87,15 @@ draw_frame::draw_frame(draw_frame&& other)
 {
 }
 draw_frame::draw_frame(const_frame frame)
-    : impl_(new impl(std::move(frame)))
+    : impl_(std::make_shared<impl>(std::move(frame)))
 {
 }
 draw_frame::draw_frame(mutable_frame&& frame)
-    : impl_(new impl(std::move(frame)))
+    : impl_(std::make_shared<impl>(std::move(frame)))
 {
 }
 draw_frame::draw_frame(std::vector<draw_frame> frames)
-    : impl_(new impl(std::move(frames)))
+    : impl_(std::make_shared<impl>(std::move(frames)))
 {
 }
 draw_frame::~draw_frame() {}
@@ -108,9 +106,19 @@ draw_frame& draw_frame::operator=(draw_frame other)
 }
 void                   draw_frame::swap(draw_frame& other) { impl_.swap(other.impl_); }
 const frame_transform& draw_frame::transform() const { return impl_->transform_; }
-frame_transform&       draw_frame::transform() { return impl_->transform_; }
+frame_transform&       draw_frame::transform()
+{
+    // Children are shared by the copy, so only this node is duplicated.
+    if (impl_.use_count() > 1) {
+        impl_ = std::make_shared<impl>(*impl_);
+    }
+    return impl_->transform_;
+}
 void                   draw_frame::accept(frame_visitor& visitor) const { impl_->accept(visitor); }
-bool draw_frame::operator==(const draw_frame& other) const { return impl_ && *impl_ == *other.impl_; }
+bool draw_frame::operator==(const draw_frame& other) const
+{
+    return impl_ && (impl_ == other.impl_ || *impl_ == *other.impl_);
+}
 bool draw_frame::operator!=(const draw_frame& other) const { return !(*this == other); }
 
 draw_frame draw_frame::over(draw_frame frame1, draw_frame frame2)
@@ -25,6 +25,7 @@
 
 namespace caspar { namespace core {
 
+// A tree of frames and transforms. Copies share the tree, so copying costs a reference count whatever its size.
 class draw_frame final
 {
   public:
@@ -61,7 +62,7 @@ class draw_frame final
 
   private:
     struct impl;
-    std::unique_ptr<impl> impl_;
+    std::shared_ptr<impl> impl_; // Shared between copies, copied on the first change to a shared one.
 };
 
 }} // namespace caspar::core
@@ -26,8 +26,11 @@
 #include <common/array.h>
 #include <common/except.h>
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -39,6 +42,7 @@ struct mutable_frame::impl
     const core::pixel_format_desc    desc_;
     const void*                      tag_;
     frame_geometry                   geometry_ = frame_geometry::get_default();
+    frame_timing                     timing_;
     mutable_frame::commit_t          commit_;
 
     impl(const impl&) = delete;
@@ -55,6 +59,7 @@ struct mutable_frame::impl
         , tag_(tag)
         , commit_(std::move(commit))
     {
+        timing_.received = std::chrono::steady_clock::now();
     }
 };
 
@@ -86,27 +91,52 @@ std::size_t                mutable_frame::width() const { return impl_->desc_.pl
 std::size_t                mutable_frame::height() const { return impl_->desc_.planes.at(0).height; }
 const frame_geometry&      mutable_frame::geometry() const { return impl_->geometry_; }
 frame_geometry&            mutable_frame::geometry() { return impl_->geometry_; }
+const frame_timing&        mutable_frame::timing() const { return impl_->timing_; }
+frame_timing&              mutable_frame::timing() { return impl_->timing_; }
 
 struct const_frame::impl
 {
-    std::vector<array<const std::uint8_t>> image_data_;
-    array<const std::int32_t>              audio_data_;
-    core::pixel_format_desc                desc_     = pixel_format::invalid;
+    std::vector<array<const std::uint8_t>>                     image_data_;
+    std::shared_future<std::vector<array<const std::uint8_t>>> deferred_image_data_;
+    array<const std::int32_t>                                  audio_data_;
+    core::pixel_format_desc                                    desc_ = pixel_format::invalid;
     frame_geometry                         geometry_ = frame_geometry::get_default();
+    frame_timing                           timing_;
     boost::any                             opaque_;
+    const void*                            tag_ = nullptr;
+
+    std::mutex                                      memo_mutex_;
+    std::vector<std::pair<const void*, boost::any>> memo_;
+    std::shared_ptr<impl>                           memo_owner_; // Set on frames that share the memo of another.
 
     impl(std::vector<array<const std::uint8_t>> image_data,
          array<const std::int32_t>              audio_data,
-         const core::pixel_format_desc&         desc)
+         const core::pixel_format_desc&         desc,
+         boost::any                             opaque)
         : image_data_(std::move(image_data))
         , audio_data_(std::move(audio_data))
         , desc_(desc)
+        , opaque_(std::move(opaque))
     {
         if (desc_.planes.size() != image_data_.size()) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
         }
     }
 
+    impl(std::shared_future<std::vector<array<const std::uint8_t>>> image_data,
+         array<const std::int32_t>                                  audio_data,
+         const core::pixel_format_desc&                             desc,
+         boost::any                                                 opaque)
+        : deferred_image_data_(std::move(image_data))
+        , audio_data_(std::move(audio_data))
+        , desc_(desc)
+        , opaque_(std::move(opaque))
+    {
+        if (!deferred_image_data_.valid()) {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+    }
+
     impl(std::vector<array<std::uint8_t>>&& image_data,
          array<const std::int32_t>          audio_data,
          const core::pixel_format_desc&     desc)
@@ -125,6 +155,8 @@ struct const_frame::impl
         , audio_data_(std::move(other.impl_->audio_data_))
         , desc_(std::move(other.impl_->desc_))
         , geometry_(std::move(other.impl_->geometry_))
+        , timing_(other.impl_->timing_)
+        , tag_(other.impl_->tag_)
     {
         if (desc_.planes.size() != image_data_.size() && !other.impl_->commit_) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
@@ -134,20 +166,56 @@ struct const_frame::impl
         }
     }
 
-    const array<const std::uint8_t>& image_data(std::size_t index) const { return image_data_.at(index); }
+    const array<const std::uint8_t>& image_data(std::size_t index) const
+    {
+        if (deferred_image_data_.valid()) {
+            const auto& image_data = deferred_image_data_.get();
+            if (image_data.size() != desc_.planes.size()) {
+                CASPAR_THROW_EXCEPTION(invalid_argument());
+            }
+            return image_data.at(index);
+        }
+        return image_data_.at(index);
+    }
 
     std::size_t width() const { return desc_.planes.at(0).width; }
 
     std::size_t height() const { return desc_.planes.at(0).height; }
 
     std::size_t size() const { return desc_.planes.at(0).size; }
+
+    boost::any memoize(const void* key, const std::function<boost::any()>& func)
+    {
+        if (memo_owner_) {
+            return memo_owner_->memoize(key, func);
+        }
+
+        std::lock_guard<std::mutex> lock(memo_mutex_);
+
+        for (auto& entry : memo_) {
+            if (entry.first == key) {
+                return entry.second;
+            }
+        }
+
+        memo_.emplace_back(key, func());
+        return memo_.back().second;
+    }
 };
 
 const_frame::const_frame() {}
 const_frame::const_frame(std::vector<array<const std::uint8_t>> image_data,
                          array<const std::int32_t>              audio_data,
-                         const core::pixel_format_desc&         desc)
-    : impl_(new impl(std::move(image_data), std::move(audio_data), desc))
+                         const core::pixel_format_desc&         desc,
+                         boost::any                             opaque)
+    : impl_(new impl(std::move(image_data), std::move(audio_data), desc, std::move(opaque)))
+{
+}
+const_frame::const_frame(std::shared_future<std::vector<array<const std::uint8_t>>> image_data,
+                         array<const std::int32_t>                                  audio_data,
+                         const core::pixel_format_desc&                             desc,
+                         boost::any                                                 opaque)
+    : impl_(new impl(std::move(image_data), std::move(audio_data), desc, std::move(opaque)))
 {
 }
 const_frame::const_frame(mutable_frame&& other)
@@ -176,5 +244,50 @@ std::size_t                      const_frame::height() const { return impl_->hei
 std::size_t                      const_frame::size() const { return impl_->size(); }
 const frame_geometry&            const_frame::geometry() const { return impl_->geometry_; }
 const boost::any&                const_frame::opaque() const { return impl_->opaque_; }
+const void*                      const_frame::stream_tag() const { return impl_ ? impl_->tag_ : nullptr; }
+const frame_timing&              const_frame::timing() const
+{
+    static const frame_timing empty;
+    return impl_ ? impl_->timing_ : empty;
+}
+boost::any const_frame::memoize(const void* key, const std::function<boost::any()>& func) const
+{
+    return impl_ ? impl_->memoize(key, func) : func();
+}
+const_frame const_frame::with_audio(array<const std::int32_t> audio_data) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto frame = impl_->deferred_image_data_.valid()
+                     ? const_frame(impl_->deferred_image_data_, std::move(audio_data), impl_->desc_, impl_->opaque_)
+                     : const_frame(impl_->image_data_, std::move(audio_data), impl_->desc_, impl_->opaque_);
+    frame.impl_->geometry_   = impl_->geometry_;
+    frame.impl_->tag_        = impl_->tag_;
+    frame.impl_->timing_     = impl_->timing_;
+    frame.impl_->memo_owner_ = impl_->memo_owner_ ? impl_->memo_owner_ : impl_;
+    return frame;
+}
+const_frame const_frame::with_geometry(frame_geometry geometry) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto frame               = with_audio(impl_->audio_data_);
+    frame.impl_->geometry_ = std::move(geometry);
+    return frame;
+}
+const_frame const_frame::with_timing(frame_timing timing) const
+{
+    if (!impl_) {
+        return const_frame();
+    }
+
+    auto frame           = with_audio(impl_->audio_data_);
+    frame.impl_->timing_ = std::move(timing);
+    return frame;
+}
 const_frame::operator bool() const { return impl_ != nullptr && impl_->desc_.format != core::pixel_format::invalid; }
 }} // namespace caspar::core
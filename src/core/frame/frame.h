@@ -4,14 +4,26 @@
 
 #include <boost/any.hpp>
 
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <future>
 #include <memory>
 #include <vector>
 
 namespace caspar { namespace core {
 
+// When a frame passed the stages of its channel, on the steady clock, which the outputs report the latency of each
+// stage by. Stages that a frame didn't pass are left at the epoch.
+struct frame_timing
+{
+    std::chrono::steady_clock::time_point received; // created, for mixed frames the oldest frame they were drawn from
+    std::chrono::steady_clock::time_point mixing;   // the mixer started on it
+    std::chrono::steady_clock::time_point mixed;    // the mixer handed it off, read back if that was requested
+    bool test_signal = false; // drawn from a sync test signal, which the outputs measure the A/V offset of
+};
+
 class mutable_frame final
 {
     friend class const_frame;
@@ -49,6 +61,9 @@ class mutable_frame final
     class frame_geometry&       geometry();
     const class frame_geometry& geometry() const;
 
+    frame_timing&       timing();
+    const frame_timing& timing() const;
+
   private:
     struct impl;
     std::unique_ptr<impl> impl_;
@@ -60,7 +75,14 @@ class const_frame final
     const_frame();
     explicit const_frame(std::vector<array<const std::uint8_t>> image_data,
                          array<const std::int32_t>              audio_data,
-                         const struct pixel_format_desc&        desc);
+                         const struct pixel_format_desc&        desc,
+                         boost::any                             opaque = boost::any());
+    // The image data is only waited for the first time that image_data is called, e.g. for a mixed frame that is
+    // read back from the gpu on demand.
+    explicit const_frame(std::shared_future<std::vector<array<const std::uint8_t>>> image_data,
+                         array<const std::int32_t>                                  audio_data,
+                         const struct pixel_format_desc&                            desc,
+                         boost::any                                                 opaque = boost::any());
     const_frame(const const_frame& other);
     const_frame(mutable_frame&& other);
 
@@ -84,6 +106,26 @@ class const_frame final
 
     const class frame_geometry& geometry() const;
 
+    const void* stream_tag() const;
+
+    const frame_timing& timing() const;
+
+    /**
+     * Returns the value memoized on this frame (and all copies of it) under
+     * key, calling func to create it the first time.
+     */
+    boost::any memoize(const void* key, const std::function<boost::any()>& func) const;
+
+    // Returns a frame with the image of this one and audio_data, which shares the values memoized on this one.
+    const_frame with_audio(array<const std::int32_t> audio_data) const;
+
+    // Returns a frame with the image of this one drawn with geometry, which shares the values memoized on this one,
+    // e.g. its textures, so that an image is only uploaded once however often it is drawn with new geometry.
+    const_frame with_geometry(class frame_geometry geometry) const;
+
+    // Returns a frame with the image and audio of this one and timing, which shares the values memoized on this one.
+    const_frame with_timing(frame_timing timing) const;
+
     bool operator==(const const_frame& other) const;
     bool operator!=(const const_frame& other) const;
     bool operator<(const const_frame& other) const;
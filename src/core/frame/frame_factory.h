@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <vector>
+
 #ifdef WIN32
 #include <common/forward.h>
 #include <memory>
@@ -40,6 +42,14 @@ class frame_factory
 
     virtual class mutable_frame create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc) = 0;
 
+    // Creates a frame showing the image of previous, an earlier frame of this factory with the same desc, apart from
+    // the regions in dirty. Only those regions of the new frame's image are uploaded, so only they need to be written.
+    // On return dirty holds the regions to write, clipped to the image, or the whole image if previous can't be used.
+    virtual class mutable_frame create_frame(const void*                       video_stream_tag,
+                                             const struct pixel_format_desc&   desc,
+                                             const class const_frame&          previous,
+                                             std::vector<struct image_region>& dirty) = 0;
+
 #ifdef WIN32
     virtual class const_frame import_d3d_texture(const void* video_stream_tag,
                                                  const std::shared_ptr<accelerator::d3d::d3d_texture2d>& d3d_texture) = 0;
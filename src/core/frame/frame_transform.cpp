@@ -103,6 +103,9 @@ image_transform& image_transform::operator*=(const image_transform& other)
     is_mix |= other.is_mix;
     blend_mode = std::max(blend_mode, other.blend_mode);
     layer_depth += other.layer_depth;
+    if (other.field_mode != core::field_mode::progressive) {
+        field_mode = other.field_mode;
+    }
 
     return *this;
 }
@@ -112,79 +115,78 @@ image_transform image_transform::operator*(const image_transform& other) const
     return image_transform(*this) *= other;
 }
 
-double do_tween(double time, double source, double dest, double duration, const tweener& tween)
-{
-    return tween(time, source, dest - source, duration);
-};
+namespace {
 
-template <typename Rect>
-void do_tween_rectangle(const Rect&    source,
-                        const Rect&    dest,
-                        Rect&          out,
-                        double         time,
-                        double         duration,
-                        const tweener& tweener)
+// Tweens any number of values to the same timepoint. A linear tweener is evaluated once, every value is then
+// interpolated with the resulting weight.
+class tween_values
 {
-    out.ul[0] = do_tween(time, source.ul[0], dest.ul[0], duration, tweener);
-    out.ul[1] = do_tween(time, source.ul[1], dest.ul[1], duration, tweener);
-    out.lr[0] = do_tween(time, source.lr[0], dest.lr[0], duration, tweener);
-    out.lr[1] = do_tween(time, source.lr[1], dest.lr[1], duration, tweener);
-}
+    const tweener& tween_;
+    const double   time_;
+    const double   duration_;
+    const bool     linear_;
+    const double   weight_;
+
+  public:
+    tween_values(double time, double duration, const tweener& tween)
+        : tween_(tween)
+        , time_(time)
+        , duration_(duration)
+        , linear_(tween.linear())
+        , weight_(linear_ ? tween(time, 0.0, 1.0, duration) : 0.0)
+    {
+    }
 
-void do_tween_corners(const corners& source,
-                      const corners& dest,
-                      corners&       out,
-                      double         time,
-                      double         duration,
-                      const tweener& tweener)
-{
-    do_tween_rectangle(source, dest, out, time, duration, tweener);
+    double operator()(double source, double dest) const
+    {
+        return linear_ ? source + (dest - source) * weight_ : tween_(time_, source, dest - source, duration_);
+    }
 
-    out.ur[0] = do_tween(time, source.ur[0], dest.ur[0], duration, tweener);
-    out.ur[1] = do_tween(time, source.ur[1], dest.ur[1], duration, tweener);
-    out.ll[0] = do_tween(time, source.ll[0], dest.ll[0], duration, tweener);
-    out.ll[1] = do_tween(time, source.ll[1], dest.ll[1], duration, tweener);
+    template <std::size_t N>
+    void operator()(const std::array<double, N>& source, const std::array<double, N>& dest, std::array<double, N>& out)
+        const
+    {
+        for (std::size_t n = 0; n < N; ++n) {
+            out[n] = (*this)(source[n], dest[n]);
+        }
+    }
 };
 
+} // namespace
+
 image_transform image_transform::tween(double                 time,
                                        const image_transform& source,
                                        const image_transform& dest,
                                        double                 duration,
                                        const tweener&         tween)
 {
+    const tween_values tw(time, duration, tween);
+
     image_transform result;
 
-    result.brightness          = do_tween(time, source.brightness, dest.brightness, duration, tween);
-    result.contrast            = do_tween(time, source.contrast, dest.contrast, duration, tween);
-    result.saturation          = do_tween(time, source.saturation, dest.saturation, duration, tween);
-    result.opacity             = do_tween(time, source.opacity, dest.opacity, duration, tween);
-    result.anchor[0]           = do_tween(time, source.anchor[0], dest.anchor[0], duration, tween);
-    result.anchor[1]           = do_tween(time, source.anchor[1], dest.anchor[1], duration, tween);
-    result.fill_translation[0] = do_tween(time, source.fill_translation[0], dest.fill_translation[0], duration, tween);
-    result.fill_translation[1] = do_tween(time, source.fill_translation[1], dest.fill_translation[1], duration, tween);
-    result.fill_scale[0]       = do_tween(time, source.fill_scale[0], dest.fill_scale[0], duration, tween);
-    result.fill_scale[1]       = do_tween(time, source.fill_scale[1], dest.fill_scale[1], duration, tween);
-    result.clip_translation[0] = do_tween(time, source.clip_translation[0], dest.clip_translation[0], duration, tween);
-    result.clip_translation[1] = do_tween(time, source.clip_translation[1], dest.clip_translation[1], duration, tween);
-    result.clip_scale[0]       = do_tween(time, source.clip_scale[0], dest.clip_scale[0], duration, tween);
-    result.clip_scale[1]       = do_tween(time, source.clip_scale[1], dest.clip_scale[1], duration, tween);
-    result.angle               = do_tween(time, source.angle, dest.angle, duration, tween);
-    result.levels.max_input    = do_tween(time, source.levels.max_input, dest.levels.max_input, duration, tween);
-    result.levels.min_input    = do_tween(time, source.levels.min_input, dest.levels.min_input, duration, tween);
-    result.levels.max_output   = do_tween(time, source.levels.max_output, dest.levels.max_output, duration, tween);
-    result.levels.min_output   = do_tween(time, source.levels.min_output, dest.levels.min_output, duration, tween);
-    result.levels.gamma        = do_tween(time, source.levels.gamma, dest.levels.gamma, duration, tween);
-    result.chroma.target_hue   = do_tween(time, source.chroma.target_hue, dest.chroma.target_hue, duration, tween);
-    result.chroma.hue_width    = do_tween(time, source.chroma.hue_width, dest.chroma.hue_width, duration, tween);
-    result.chroma.min_saturation =
-        do_tween(time, source.chroma.min_saturation, dest.chroma.min_saturation, duration, tween);
-    result.chroma.min_brightness =
-        do_tween(time, source.chroma.min_brightness, dest.chroma.min_brightness, duration, tween);
-    result.chroma.softness = do_tween(time, source.chroma.softness, dest.chroma.softness, duration, tween);
-    result.chroma.spill_suppress =
-        do_tween(time, source.chroma.spill_suppress, dest.chroma.spill_suppress, duration, tween);
+    result.brightness = tw(source.brightness, dest.brightness);
+    result.contrast   = tw(source.contrast, dest.contrast);
+    result.saturation = tw(source.saturation, dest.saturation);
+    result.opacity    = tw(source.opacity, dest.opacity);
+    tw(source.anchor, dest.anchor, result.anchor);
+    tw(source.fill_translation, dest.fill_translation, result.fill_translation);
+    tw(source.fill_scale, dest.fill_scale, result.fill_scale);
+    tw(source.clip_translation, dest.clip_translation, result.clip_translation);
+    tw(source.clip_scale, dest.clip_scale, result.clip_scale);
+    result.angle                            = tw(source.angle, dest.angle);
+    result.levels.max_input                 = tw(source.levels.max_input, dest.levels.max_input);
+    result.levels.min_input                 = tw(source.levels.min_input, dest.levels.min_input);
+    result.levels.max_output                = tw(source.levels.max_output, dest.levels.max_output);
+    result.levels.min_output                = tw(source.levels.min_output, dest.levels.min_output);
+    result.levels.gamma                     = tw(source.levels.gamma, dest.levels.gamma);
+    result.chroma.target_hue                = tw(source.chroma.target_hue, dest.chroma.target_hue);
+    result.chroma.hue_width                 = tw(source.chroma.hue_width, dest.chroma.hue_width);
+    result.chroma.min_saturation            = tw(source.chroma.min_saturation, dest.chroma.min_saturation);
+    result.chroma.min_brightness            = tw(source.chroma.min_brightness, dest.chroma.min_brightness);
+    result.chroma.softness                  = tw(source.chroma.softness, dest.chroma.softness);
+    result.chroma.spill_suppress            = tw(source.chroma.spill_suppress, dest.chroma.spill_suppress);
     result.chroma.spill_suppress_saturation =
-        do_tween(time, source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation, duration, tween);
+        tw(source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation);
     result.chroma.enable    = dest.chroma.enable;
     result.chroma.show_mask = dest.chroma.show_mask;
     result.is_key           = source.is_key || dest.is_key;
@@ -192,9 +194,14 @@ image_transform image_transform::tween(double                 time,
     result.is_mix           = source.is_mix || dest.is_mix;
     result.blend_mode       = std::max(source.blend_mode, dest.blend_mode);
     result.layer_depth      = dest.layer_depth;
+    result.field_mode       = dest.field_mode;
 
-    do_tween_rectangle(source.crop, dest.crop, result.crop, time, duration, tween);
-    do_tween_corners(source.perspective, dest.perspective, result.perspective, time, duration, tween);
+    tw(source.crop.ul, dest.crop.ul, result.crop.ul);
+    tw(source.crop.lr, dest.crop.lr, result.crop.lr);
+    tw(source.perspective.ul, dest.perspective.ul, result.perspective.ul);
+    tw(source.perspective.ur, dest.perspective.ur, result.perspective.ur);
+    tw(source.perspective.lr, dest.perspective.lr, result.perspective.lr);
+    tw(source.perspective.ll, dest.perspective.ll, result.perspective.ll);
 
     return result;
 }
@@ -212,6 +219,17 @@ bool operator==(const rectangle& lhs, const rectangle& rhs)
     return boost::range::equal(lhs.ul, rhs.ul, eq) && boost::range::equal(lhs.lr, rhs.lr, eq);
 }
 
+bool operator==(const chroma& lhs, const chroma& rhs)
+{
+    return lhs.enable == rhs.enable && lhs.show_mask == rhs.show_mask && eq(lhs.target_hue, rhs.target_hue) &&
+           eq(lhs.hue_width, rhs.hue_width) && eq(lhs.min_saturation, rhs.min_saturation) &&
+           eq(lhs.min_brightness, rhs.min_brightness) && eq(lhs.softness, rhs.softness) &&
+           eq(lhs.spill_suppress, rhs.spill_suppress) &&
+           eq(lhs.spill_suppress_saturation, rhs.spill_suppress_saturation);
+}
+
+bool operator!=(const chroma& lhs, const chroma& rhs) { return !(lhs == rhs); }
+
 bool operator==(const image_transform& lhs, const image_transform& rhs)
 {
     return eq(lhs.opacity, rhs.opacity) && eq(lhs.contrast, rhs.contrast) && eq(lhs.brightness, rhs.brightness) &&
@@ -222,12 +240,7 @@ bool operator==(const image_transform& lhs, const image_transform& rhs)
            boost::range::equal(lhs.clip_scale, rhs.clip_scale, eq) && eq(lhs.angle, rhs.angle) &&
            lhs.is_key == rhs.is_key && lhs.invert == rhs.invert && lhs.is_mix == rhs.is_mix &&
            lhs.blend_mode == rhs.blend_mode && lhs.layer_depth == rhs.layer_depth &&
-           lhs.chroma.enable == rhs.chroma.enable && lhs.chroma.show_mask == rhs.chroma.show_mask &&
-           eq(lhs.chroma.target_hue, rhs.chroma.target_hue) && eq(lhs.chroma.hue_width, rhs.chroma.hue_width) &&
-           eq(lhs.chroma.min_saturation, rhs.chroma.min_saturation) &&
-           eq(lhs.chroma.min_brightness, rhs.chroma.min_brightness) && eq(lhs.chroma.softness, rhs.chroma.softness) &&
-           eq(lhs.chroma.spill_suppress, rhs.chroma.spill_suppress) &&
-           eq(lhs.chroma.spill_suppress_saturation, rhs.chroma.spill_suppress_saturation) && lhs.crop == rhs.crop &&
+           lhs.field_mode == rhs.field_mode && lhs.chroma == rhs.chroma && lhs.crop == rhs.crop &&
            lhs.perspective == rhs.perspective;
 }
 
@@ -238,6 +251,9 @@ bool operator!=(const image_transform& lhs, const image_transform& rhs) { return
 audio_transform& audio_transform::operator*=(const audio_transform& other)
 {
     volume *= other.volume;
+    if (other.route) {
+        route = route ? audio_route::combine(*route, *other.route) : other.route;
+    }
     return *this;
 }
 
@@ -253,12 +269,17 @@ audio_transform audio_transform::tween(double                 time,
                                        const tweener&         tween)
 {
     audio_transform result;
-    result.volume = do_tween(time, source.volume, dest.volume, duration, tween);
+    result.volume = tween_values(time, duration, tween)(source.volume, dest.volume);
+    result.route  = dest.route;
 
     return result;
 }
 
-bool operator==(const audio_transform& lhs, const audio_transform& rhs) { return eq(lhs.volume, rhs.volume); }
+bool operator==(const audio_transform& lhs, const audio_transform& rhs)
+{
+    return eq(lhs.volume, rhs.volume) &&
+           (lhs.route == rhs.route || (lhs.route && rhs.route && *lhs.route == *rhs.route));
+}
 
 bool operator!=(const audio_transform& lhs, const audio_transform& rhs) { return !(lhs == rhs); }
 
@@ -23,11 +23,13 @@
 
 #include <common/tweener.h>
 
+#include <core/mixer/audio/audio_route.h>
 #include <core/mixer/image/blend_modes.h>
 
 #include <boost/optional.hpp>
 
 #include <array>
+#include <memory>
 
 namespace caspar { namespace core {
 
@@ -51,6 +53,9 @@ struct chroma
     double spill_suppress_saturation = 1.0;
 };
 
+bool operator==(const chroma& lhs, const chroma& rhs);
+bool operator!=(const chroma& lhs, const chroma& rhs);
+
 struct levels final
 {
     double min_input  = 0.0;
@@ -68,6 +73,14 @@ struct corners final
     std::array<double, 2> ll = {0.0, 1.0};
 };
 
+// Which field of an interlaced frame to show, the other field is interpolated from it when mixing.
+enum class field_mode
+{
+    progressive,
+    upper,
+    lower,
+};
+
 struct rectangle final
 {
     std::array<double, 2> ul = {0.0, 0.0};
@@ -97,6 +110,7 @@ struct image_transform final
     bool             is_mix      = false;
     core::blend_mode blend_mode  = blend_mode::normal;
     int              layer_depth = 0;
+    core::field_mode field_mode  = core::field_mode::progressive;
 
     image_transform& operator*=(const image_transform& other);
     image_transform  operator*(const image_transform& other) const;
@@ -115,6 +129,10 @@ struct audio_transform final
 {
     double volume = 1.0;
 
+    // Channels of the audio are mixed through route if set. Routes aren't tweened, the route of the destination
+    // applies at once.
+    std::shared_ptr<const audio_route> route;
+
     audio_transform& operator*=(const audio_transform& other);
     audio_transform  operator*(const audio_transform& other) const;
 
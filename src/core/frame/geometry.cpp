@@ -45,12 +45,30 @@ struct frame_geometry::impl
     {
         if (type == geometry_type::quad && data.size() != 4)
             CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("The number of coordinates needs to be 4"));
+        if (type == geometry_type::triangles)
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("A triangle mesh needs indices"));
 
         data_ = std::move(data);
     }
 
+    impl(std::vector<coord> data, std::vector<std::uint32_t> indices)
+        : type_(geometry_type::triangles)
+    {
+        if (indices.empty() || indices.size() % 3 != 0)
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("The number of indices needs to be a multiple of 3"));
+
+        for (auto index : indices) {
+            if (index >= data.size())
+                CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Index out of range of the coordinates"));
+        }
+
+        data_    = std::move(data);
+        indices_ = std::move(indices);
+    }
+
     frame_geometry::geometry_type type_;
     std::vector<coord>            data_;
+    std::vector<std::uint32_t>    indices_;
 };
 
 frame_geometry::frame_geometry(geometry_type type, std::vector<coord> data)
@@ -58,8 +76,23 @@ frame_geometry::frame_geometry(geometry_type type, std::vector<coord> data)
 {
 }
 
+frame_geometry::frame_geometry(std::vector<coord> data, std::vector<std::uint32_t> indices)
+    : impl_(new impl(std::move(data), std::move(indices)))
+{
+}
+
 frame_geometry::geometry_type             frame_geometry::type() const { return impl_->type_; }
 const std::vector<frame_geometry::coord>& frame_geometry::data() const { return impl_->data_; }
+const std::vector<std::uint32_t>&         frame_geometry::indices() const { return impl_->indices_; }
+
+bool frame_geometry::operator==(const frame_geometry& other) const
+{
+    return impl_ == other.impl_ ||
+           (impl_->type_ == other.impl_->type_ && impl_->data_ == other.impl_->data_ &&
+            impl_->indices_ == other.impl_->indices_);
+}
+
+bool frame_geometry::operator!=(const frame_geometry& other) const { return !(*this == other); }
 
 const frame_geometry& frame_geometry::get_default()
 {
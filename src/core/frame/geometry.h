@@ -23,6 +23,7 @@
 
 #include <common/memory.h>
 
+#include <cstdint>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -32,7 +33,8 @@ class frame_geometry
   public:
     enum class geometry_type
     {
-        quad
+        quad,
+        triangles // an indexed triangle mesh, e.g. several quads or a warp, drawn in one go
     };
 
     struct coord
@@ -51,9 +53,14 @@ class frame_geometry
     };
 
     frame_geometry(geometry_type type, std::vector<coord> data);
+    frame_geometry(std::vector<coord> data, std::vector<std::uint32_t> indices);
 
-    geometry_type             type() const;
-    const std::vector<coord>& data() const;
+    geometry_type                     type() const;
+    const std::vector<coord>&         data() const;
+    const std::vector<std::uint32_t>& indices() const; // three per triangle, empty for a quad
+
+    bool operator==(const frame_geometry& other) const;
+    bool operator!=(const frame_geometry& other) const;
 
     static const frame_geometry& get_default();
 
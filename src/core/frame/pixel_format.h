@@ -37,30 +37,62 @@ enum class pixel_format
     luma,
     bgr,
     rgb,
+    nv12,
+    uyvy,       // 8 bit 4:2:2 packed as u y v y, one plane of width / 2 stride 4 texels
+    v210,       // 10 bit 4:2:2 packed per SMPTE RP 2071, one plane of 32 bit words padded to 48 pixels per row
+    dxt1,       // block compressed rgb, 8 bytes per 4x4 pixels
+    dxt5,       // block compressed rgba, 16 bytes per 4x4 pixels
+    ycocg_dxt5, // scaled YCoCg in dxt5 blocks as written by HAP Q, co cg scale y in r g b a
     count,
     invalid,
 };
 
+enum class color_depth
+{
+    bit8 = 0,
+    bit10, // 16 bit samples holding 10 bit values in the low bits
+    bit16,
+};
+
+inline int bytes_per_sample(color_depth depth) { return depth == color_depth::bit8 ? 1 : 2; }
+
+// Block compressed formats are uploaded as they are and decompressed when sampled.
+inline bool is_block_compressed(pixel_format format)
+{
+    return format == pixel_format::dxt1 || format == pixel_format::dxt5 || format == pixel_format::ycocg_dxt5;
+}
+
 struct pixel_format_desc final
 {
     struct plane
     {
-        int linesize = 0;
-        int width    = 0;
-        int height   = 0;
-        int size     = 0;
-        int stride   = 0;
+        int         linesize = 0;
+        int         width    = 0;
+        int         height   = 0;
+        int         size     = 0;
+        int         stride   = 0;
+        color_depth depth    = color_depth::bit8;
 
         plane() = default;
 
-        plane(int width, int height, int stride)
-            : linesize(width * stride)
+        plane(int width, int height, int stride, color_depth depth = color_depth::bit8)
+            : linesize(width * stride * bytes_per_sample(depth))
             , width(width)
             , height(height)
-            , size(width * height * stride)
+            , size(width * height * stride * bytes_per_sample(depth))
             , stride(stride)
+            , depth(depth)
         {
         }
+
+        // The blocks of an image of width and height pixels in a block compressed format.
+        static plane blocks(int width, int height, int block_size)
+        {
+            plane result(width, height, 4);
+            result.linesize = (width + 3) / 4 * block_size;
+            result.size     = result.linesize * ((height + 3) / 4);
+            return result;
+        }
     };
 
     pixel_format_desc() = default;
@@ -72,6 +104,42 @@ struct pixel_format_desc final
 
     pixel_format       format = pixel_format::invalid;
     std::vector<plane> planes;
+
+    // The rows of the planes are stored bottom row first, as decoded by FreeImage, and are flipped by the mixer.
+    bool bottom_up = false;
+
+    // Set for conversions of interlaced channels, which mix one field per tick. Every second row starting at
+    // woven_line is then taken from the frame mixed at the tick before, so that the conversion of the second field
+    // holds both fields, woven on the gpu. -1 doesn't weave.
+    int woven_line = -1;
+};
+
+inline bool operator==(const pixel_format_desc::plane& lhs, const pixel_format_desc::plane& rhs)
+{
+    return lhs.linesize == rhs.linesize && lhs.width == rhs.width && lhs.height == rhs.height &&
+           lhs.size == rhs.size && lhs.stride == rhs.stride && lhs.depth == rhs.depth;
+}
+
+inline bool operator!=(const pixel_format_desc::plane& lhs, const pixel_format_desc::plane& rhs)
+{
+    return !(lhs == rhs);
+}
+
+inline bool operator==(const pixel_format_desc& lhs, const pixel_format_desc& rhs)
+{
+    return lhs.format == rhs.format && lhs.planes == rhs.planes && lhs.bottom_up == rhs.bottom_up &&
+           lhs.woven_line == rhs.woven_line;
+}
+
+inline bool operator!=(const pixel_format_desc& lhs, const pixel_format_desc& rhs) { return !(lhs == rhs); }
+
+// A rectangle of pixels within a plane.
+struct image_region final
+{
+    int x      = 0;
+    int y      = 0;
+    int width  = 0;
+    int height = 0;
 };
 
 }} // namespace caspar::core
\ No newline at end of file
@@ -37,6 +37,7 @@ FORWARD2(caspar, core, class draw_frame);
 FORWARD2(caspar, core, class mutable_frame);
 FORWARD2(caspar, core, class const_frame);
 FORWARD2(caspar, core, class video_channel);
+FORWARD2(caspar, core, class channel_group);
 FORWARD2(caspar, core, struct pixel_format_desc);
 FORWARD2(caspar, core, class cg_producer_registry);
 FORWARD2(caspar, core, struct frame_transform);
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio_kernel.h"
+
+#include <common/cpuid.h>
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Largest float that still converts to a valid int32.
+const float max_sample = 2147483520.0f;
+const float min_sample = -2147483648.0f;
+
+// Upper bound of simd peak accumulators, enough for 32 interleaved channels with 256 bit vectors.
+const std::size_t max_accumulators = 32;
+
+std::size_t gcd(std::size_t a, std::size_t b) { return b == 0 ? a : gcd(b, a % b); }
+
+std::size_t lcm(std::size_t a, std::size_t b) { return a / gcd(a, b) * b; }
+
+void accumulate_c(float* dest, const std::int32_t* source, std::size_t count, float gain)
+{
+    for (std::size_t n = 0; n < count; ++n) {
+        dest[n] += static_cast<float>(source[n]) * gain;
+    }
+}
+
+void accumulate_ramp_c(float*              dest,
+                       const std::int32_t* source,
+                       std::size_t         begin,
+                       std::size_t         count,
+                       float               gain,
+                       float               step,
+                       int                 channels)
+{
+    for (auto n = begin; n < count; ++n) {
+        dest[n] += static_cast<float>(source[n]) * (gain + step * static_cast<float>(n / channels));
+    }
+}
+
+void saturate_c(std::int32_t* dest, const float* source, std::size_t count, float gain, int channels, float* peaks)
+{
+    for (std::size_t n = 0; n < count; ++n) {
+        auto sample = source[n] * gain;
+        auto ch     = n % channels;
+        peaks[ch]   = std::max(peaks[ch], std::abs(sample));
+        dest[n]     = static_cast<std::int32_t>(std::min(std::max(sample, min_sample), max_sample));
+    }
+}
+
+void accumulate_sse(float* dest, const std::int32_t* source, std::size_t count, float gain)
+{
+    const auto g = _mm_set1_ps(gain);
+
+    std::size_t n = 0;
+    for (; n + 8 <= count; n += 8) {
+        auto s0 = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n)));
+        auto s1 = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 4)));
+        _mm_storeu_ps(dest + n, _mm_add_ps(_mm_loadu_ps(dest + n), _mm_mul_ps(s0, g)));
+        _mm_storeu_ps(dest + n + 4, _mm_add_ps(_mm_loadu_ps(dest + n + 4), _mm_mul_ps(s1, g)));
+    }
+
+    accumulate_c(dest + n, source + n, count - n, gain);
+}
+
+void accumulate_ramp_sse(float*              dest,
+                         const std::int32_t* source,
+                         std::size_t         count,
+                         float               gain,
+                         float               step,
+                         int                 channels)
+{
+    const std::size_t width = 4;
+    const auto        block = lcm(width, channels);
+    const auto        nb    = block / width;
+
+    if (nb > max_accumulators) {
+        accumulate_ramp_c(dest, source, 0, count, gain, step, channels);
+        return;
+    }
+
+    // Gain offset of every lane relative to the first sample frame of a block.
+    __m128 offsets[max_accumulators];
+    for (std::size_t a = 0; a < nb; ++a) {
+        float lanes[width];
+        for (std::size_t j = 0; j < width; ++j) {
+            lanes[j] = step * static_cast<float>((a * width + j) / channels);
+        }
+        offsets[a] = _mm_loadu_ps(lanes);
+    }
+
+    std::size_t n = 0;
+    for (; n + block <= count; n += block) {
+        const auto base = _mm_set1_ps(gain + step * static_cast<float>(n / channels));
+        for (std::size_t a = 0; a < nb; ++a) {
+            auto offset = n + a * width;
+            auto g      = _mm_add_ps(base, offsets[a]);
+            auto s      = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + offset)));
+            _mm_storeu_ps(dest + offset, _mm_add_ps(_mm_loadu_ps(dest + offset), _mm_mul_ps(s, g)));
+        }
+    }
+
+    accumulate_ramp_c(dest, source, n, count, gain, step, channels);
+}
+
+void saturate_sse(std::int32_t* dest, const float* source, std::size_t count, float gain, int channels, float* peaks)
+{
+    const std::size_t width = 4;
+    const auto        block = lcm(width, channels);
+    const auto        nb    = block / width;
+
+    if (nb > max_accumulators) {
+        saturate_c(dest, source, count, gain, channels, peaks);
+        return;
+    }
+
+    const auto g        = _mm_set1_ps(gain);
+    const auto lo       = _mm_set1_ps(min_sample);
+    const auto hi       = _mm_set1_ps(max_sample);
+    const auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    __m128 acc[max_accumulators];
+    for (std::size_t a = 0; a < nb; ++a) {
+        acc[a] = _mm_setzero_ps();
+    }
+
+    std::size_t n = 0;
+    for (; n + block <= count; n += block) {
+        for (std::size_t a = 0; a < nb; ++a) {
+            auto offset = n + a * width;
+            auto sample = _mm_mul_ps(_mm_loadu_ps(source + offset), g);
+            acc[a]      = _mm_max_ps(acc[a], _mm_and_ps(sample, abs_mask));
+            sample      = _mm_min_ps(_mm_max_ps(sample, lo), hi);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + offset), _mm_cvttps_epi32(sample));
+        }
+    }
+
+    // Blocks start on a frame boundary so lane j always belongs to channel j % channels.
+    float lanes[max_accumulators * width];
+    for (std::size_t a = 0; a < nb; ++a) {
+        _mm_storeu_ps(lanes + a * width, acc[a]);
+    }
+    for (std::size_t j = 0; j < block; ++j) {
+        peaks[j % channels] = std::max(peaks[j % channels], lanes[j]);
+    }
+
+    saturate_c(dest + n, source + n, count - n, gain, channels, peaks);
+}
+
+CASPAR_TARGET_AVX2 void accumulate_avx2(float* dest, const std::int32_t* source, std::size_t count, float gain)
+{
+    const auto g = _mm256_set1_ps(gain);
+
+    std::size_t n = 0;
+    for (; n + 16 <= count; n += 16) {
+        auto s0 = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n)));
+        auto s1 = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 8)));
+        _mm256_storeu_ps(dest + n, _mm256_add_ps(_mm256_loadu_ps(dest + n), _mm256_mul_ps(s0, g)));
+        _mm256_storeu_ps(dest + n + 8, _mm256_add_ps(_mm256_loadu_ps(dest + n + 8), _mm256_mul_ps(s1, g)));
+    }
+
+    accumulate_c(dest + n, source + n, count - n, gain);
+}
+
+CASPAR_TARGET_AVX2 void accumulate_ramp_avx2(float*              dest,
+                                             const std::int32_t* source,
+                                             std::size_t         count,
+                                             float               gain,
+                                             float               step,
+                                             int                 channels)
+{
+    const std::size_t width = 8;
+    const auto        block = lcm(width, channels);
+    const auto        nb    = block / width;
+
+    if (nb > max_accumulators) {
+        accumulate_ramp_c(dest, source, 0, count, gain, step, channels);
+        return;
+    }
+
+    __m256 offsets[max_accumulators];
+    for (std::size_t a = 0; a < nb; ++a) {
+        float lanes[width];
+        for (std::size_t j = 0; j < width; ++j) {
+            lanes[j] = step * static_cast<float>((a * width + j) / channels);
+        }
+        offsets[a] = _mm256_loadu_ps(lanes);
+    }
+
+    std::size_t n = 0;
+    for (; n + block <= count; n += block) {
+        const auto base = _mm256_set1_ps(gain + step * static_cast<float>(n / channels));
+        for (std::size_t a = 0; a < nb; ++a) {
+            auto offset = n + a * width;
+            auto g      = _mm256_add_ps(base, offsets[a]);
+            auto s      = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + offset)));
+            _mm256_storeu_ps(dest + offset, _mm256_add_ps(_mm256_loadu_ps(dest + offset), _mm256_mul_ps(s, g)));
+        }
+    }
+
+    accumulate_ramp_c(dest, source, n, count, gain, step, channels);
+}
+
+CASPAR_TARGET_AVX2 void
+saturate_avx2(std::int32_t* dest, const float* source, std::size_t count, float gain, int channels, float* peaks)
+{
+    const std::size_t width = 8;
+    const auto        block = lcm(width, channels);
+    const auto        nb    = block / width;
+
+    if (nb > max_accumulators) {
+        saturate_c(dest, source, count, gain, channels, peaks);
+        return;
+    }
+
+    const auto g        = _mm256_set1_ps(gain);
+    const auto lo       = _mm256_set1_ps(min_sample);
+    const auto hi       = _mm256_set1_ps(max_sample);
+    const auto abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+    __m256 acc[max_accumulators];
+    for (std::size_t a = 0; a < nb; ++a) {
+        acc[a] = _mm256_setzero_ps();
+    }
+
+    std::size_t n = 0;
+    for (; n + block <= count; n += block) {
+        for (std::size_t a = 0; a < nb; ++a) {
+            auto offset = n + a * width;
+            auto sample = _mm256_mul_ps(_mm256_loadu_ps(source + offset), g);
+            acc[a]      = _mm256_max_ps(acc[a], _mm256_and_ps(sample, abs_mask));
+            sample      = _mm256_min_ps(_mm256_max_ps(sample, lo), hi);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + offset), _mm256_cvttps_epi32(sample));
+        }
+    }
+
+    float lanes[max_accumulators * width];
+    for (std::size_t a = 0; a < nb; ++a) {
+        _mm256_storeu_ps(lanes + a * width, acc[a]);
+    }
+    for (std::size_t j = 0; j < block; ++j) {
+        peaks[j % channels] = std::max(peaks[j % channels], lanes[j]);
+    }
+
+    saturate_c(dest + n, source + n, count - n, gain, channels, peaks);
+}
+
+using accumulate_fn      = void (*)(float*, const std::int32_t*, std::size_t, float);
+using accumulate_ramp_fn = void (*)(float*, const std::int32_t*, std::size_t, float, float, int);
+using saturate_fn        = void (*)(std::int32_t*, const float*, std::size_t, float, int, float*);
+
+const accumulate_fn      g_accumulate      = cpuid().avx2 ? accumulate_avx2 : accumulate_sse;
+const accumulate_ramp_fn g_accumulate_ramp = cpuid().avx2 ? accumulate_ramp_avx2 : accumulate_ramp_sse;
+const saturate_fn        g_saturate        = cpuid().avx2 ? saturate_avx2 : saturate_sse;
+
+} // namespace
+
+void audio_accumulate(float* dest, const std::int32_t* source, std::size_t count, float gain)
+{
+    g_accumulate(dest, source, count, gain);
+}
+
+void audio_accumulate_ramp(float*              dest,
+                           const std::int32_t* source,
+                           std::size_t         count,
+                           float               gain_from,
+                           float               gain_to,
+                           int                 channels)
+{
+    auto frames = channels > 0 ? count / channels : 0;
+    if (gain_from == gain_to || frames == 0) {
+        g_accumulate(dest, source, count, gain_to);
+        return;
+    }
+    g_accumulate_ramp(dest, source, count, gain_from, (gain_to - gain_from) / static_cast<float>(frames), channels);
+}
+
+void audio_saturate(std::int32_t* dest, const float* source, std::size_t count, float gain, int channels, float* peaks)
+{
+    if (channels < 1) {
+        return;
+    }
+    g_saturate(dest, source, count, gain, channels, peaks);
+}
+
+}} // namespace caspar::core
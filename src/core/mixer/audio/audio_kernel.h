@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caspar { namespace core {
+
+/**
+ * Adds count samples from source, scaled by gain, to the float accumulator
+ * dest.
+ */
+void audio_accumulate(float* dest, const std::int32_t* source, std::size_t count, float gain);
+
+/**
+ * Same as audio_accumulate but with the gain ramped linearly from gain_from
+ * at the first sample frame towards gain_to, which is reached by the frame
+ * following the last one. All channels of a sample frame share its gain.
+ */
+void audio_accumulate_ramp(float*              dest,
+                           const std::int32_t* source,
+                           std::size_t         count,
+                           float               gain_from,
+                           float               gain_to,
+                           int                 channels);
+
+/**
+ * Scales count accumulated samples by gain and stores them saturated in
+ * dest. The absolute peak (before saturation) of every interleaved channel
+ * is max:ed into peaks, which must hold at least channels values.
+ */
+void audio_saturate(std::int32_t* dest, const float* source, std::size_t count, float gain, int channels, float* peaks);
+
+}} // namespace caspar::core
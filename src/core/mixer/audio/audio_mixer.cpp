@@ -22,18 +22,27 @@
 #include "../../StdAfx.h"
 
 #include "audio_mixer.h"
+#include "audio_kernel.h"
+#include "audio_route.h"
+#include "loudness_meter.h"
 
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
 #include <core/monitor/monitor.h>
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/scope_exit.h>
 
 #include <boost/container/flat_map.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/algorithm.hpp>
 
+#include <tbb/concurrent_queue.h>
+
 #include <atomic>
-#include <stack>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -42,20 +51,50 @@ using namespace boost::container;
 
 struct audio_item
 {
+    const void*          tag   = nullptr;
+    int                  layer = -1;
     audio_transform      transform;
     array<const int32_t> samples;
+    float                from = 0.0f; // Gain the item is ramped from, set when it is mixed.
 };
 
-using audio_buffer_ps = std::vector<double>;
+using buffer_pool_t = tbb::concurrent_queue<std::vector<int32_t>>;
 
 struct audio_mixer::impl
 {
     monitor::state                      state_;
-    std::stack<core::audio_transform>   transform_stack_;
-    std::vector<audio_item>             items_;
+    std::vector<core::audio_transform>  transform_stack_;
+    std::vector<audio_item>             items_; // Cleared after each mix, keeping its storage for the next one.
     std::atomic<float>                  master_volume_{1.0f};
     spl::shared_ptr<diagnostics::graph> graph_;
 
+    std::vector<float>             mixed_;
+    std::vector<float>             peaks_;
+    std::vector<int32_t>           max_;
+    std::shared_ptr<buffer_pool_t> buffer_pool_ = std::make_shared<buffer_pool_t>();
+
+    // Volume each stream ended the previous tick with, ramped from on the next one. The two maps are swapped every
+    // tick so that neither is reallocated.
+    flat_map<const void*, float> volumes_;
+    flat_map<const void*, float> next_volumes_;
+
+    // Meters of the mix, and of each layer visited by the last mix, which are created again when the format changes.
+    const bool loudness_enabled_  = env::properties().get(L"configuration.audio.loudness", true);
+    const bool layer_loudness_    = env::properties().get(L"configuration.audio.layer-loudness", false);
+    const int  loudness_channels_ = env::properties().get(L"configuration.audio.loudness-channels", 2);
+
+    std::unique_ptr<loudness_meter> meter_;
+    flat_map<int, loudness_meter>   layer_meters_;
+    std::vector<int>                layers_;
+    std::vector<float>              layer_mixed_;
+    int                             meter_channels_    = 0;
+    int                             meter_sample_rate_ = 0;
+    int                             layer_             = -1;
+    std::atomic<bool>               reset_loudness_{false};
+
+    mutable std::mutex loudness_mutex_;
+    core::loudness     loudness_;
+
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
 
@@ -64,27 +103,44 @@ struct audio_mixer::impl
     {
         graph_->set_color("volume", diagnostics::color(1.0f, 0.8f, 0.1f));
         graph_->set_color("audio-clipping", diagnostics::color(0.3f, 0.6f, 0.3f));
-        transform_stack_.push(core::audio_transform());
+        transform_stack_.push_back(core::audio_transform());
     }
 
     void push(const frame_transform& transform)
     {
-        transform_stack_.push(transform_stack_.top() * transform.audio_transform);
+        transform_stack_.push_back(transform_stack_.back() * transform.audio_transform);
     }
 
     void visit(const const_frame& frame)
     {
-        if (transform_stack_.top().volume < 0.002 || !frame.audio_data())
+        if (!frame.audio_data())
             return;
 
+        // Keep silent streams which were audible last tick so that they get to fade out.
+        if (transform_stack_.back().volume < 0.002) {
+            auto it = volumes_.find(frame.stream_tag());
+            if (it == volumes_.end() || it->second < 0.002f)
+                return;
+        }
+
         audio_item item;
-        item.transform = transform_stack_.top();
+        item.tag       = frame.stream_tag();
+        item.layer     = layer_;
+        item.transform = transform_stack_.back();
         item.samples   = frame.audio_data();
 
         items_.push_back(std::move(item));
     }
 
-    void pop() { transform_stack_.pop(); }
+    void pop() { transform_stack_.pop_back(); }
+
+    void set_layer(int layer)
+    {
+        layer_ = layer;
+        if (layer_loudness_ && (layers_.empty() || layers_.back() != layer)) {
+            layers_.push_back(layer);
+        }
+    }
 
     void set_master_volume(float volume) { master_volume_ = volume; }
 
@@ -93,54 +149,179 @@ struct audio_mixer::impl
     array<const int32_t> mix(const video_format_desc& format_desc, int nb_samples)
     {
         auto channels = format_desc.audio_channels;
-        auto items    = std::move(items_);
-        auto result   = std::vector<int32_t>(nb_samples * channels, 0);
+        auto& items   = items_;
+        auto size     = static_cast<std::size_t>(nb_samples * channels);
+        CASPAR_SCOPE_EXIT
+        {
+            items.clear();
+            layers_.clear();
+            layer_ = -1;
+        };
+
+        // Layers that are gone drop out of the state.
+        state_ = {};
+
+        mixed_.assign(size, 0.0f);
 
-        auto mixed = std::vector<double>(nb_samples * channels, 0.0f);
+        auto& volumes = next_volumes_;
+        volumes.clear();
+        volumes.reserve(items.size());
 
         for (auto& item : items) {
-            auto ptr  = item.samples.data();
-            auto size = result.size();
-            for (auto n = 0; n < size; ++n) {
-                if (n < item.samples.size()) {
-                    mixed[n] = static_cast<double>(ptr[n]) * item.transform.volume + mixed[n];
-                } else {
-                    auto offset = (item.samples.size()) - (channels - (n % channels));
-                    mixed[n]    = static_cast<double>(ptr[offset]) * item.transform.volume + mixed[n];
+            auto gain = static_cast<float>(item.transform.volume);
+
+            // Untagged streams, and repeated occurrences of a stream, have no history to ramp from.
+            item.from = gain;
+            if (item.tag && volumes.emplace(item.tag, gain).second) {
+                auto it = volumes_.find(item.tag);
+                if (it != volumes_.end()) {
+                    item.from = it->second;
                 }
             }
-        }
 
-        auto master_volume = master_volume_.load();
-        for (auto n = 0; n < mixed.size(); ++n) {
-            auto sample = mixed[n] * master_volume;
-            if (sample > std::numeric_limits<int32_t>::max()) {
-                result[n] = std::numeric_limits<int32_t>::max();
-            } else if (sample < std::numeric_limits<int32_t>::min()) {
-                result[n] = std::numeric_limits<int32_t>::min();
-            } else {
-                result[n] = static_cast<int32_t>(sample);
-            }
+            accumulate(mixed_, item, channels);
         }
 
-        auto max = std::vector<int32_t>(channels, std::numeric_limits<int32_t>::min());
-        for (size_t n = 0; n < result.size(); n += channels) {
-            for (int ch = 0; ch < channels; ++ch) {
-                max[ch] = std::max(max[ch], std::abs(result[n + ch]));
-            }
+        volumes_.swap(volumes);
+
+        measure_loudness(format_desc, nb_samples);
+
+        peaks_.assign(channels, 0.0f);
+
+        auto result = create_buffer(size);
+        audio_saturate(result.data(), mixed_.data(), size, master_volume_.load(), channels, peaks_.data());
+
+        // Peaks are measured before saturation, anything beyond the int32 range has clipped.
+        const auto clip_level = 2147483520.0f;
+
+        max_.resize(channels);
+        for (int ch = 0; ch < channels; ++ch) {
+            max_[ch] = peaks_[ch] > clip_level ? std::numeric_limits<int32_t>::max()
+                                               : static_cast<int32_t>(peaks_[ch]);
         }
 
-        if (boost::range::count_if(max, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
+        if (boost::range::count_if(peaks_, [&](auto val) { return val > clip_level; }) > 0) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-clipping");
         }
 
-        state_["volume"] = std::move(max);
+        state_["volume"] = max_;
 
         graph_->set_value("volume",
-                          static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
+                          max_.empty() ? 0.0
+                                       : static_cast<double>(*boost::max_element(max_)) /
+                                             std::numeric_limits<int32_t>::max());
 
         return std::move(result);
     }
+
+    static void accumulate(std::vector<float>& mixed, const audio_item& item, int channels)
+    {
+        auto size  = mixed.size();
+        auto ptr   = item.samples.data();
+        auto count = std::min(size, item.samples.size());
+        auto gain  = static_cast<float>(item.transform.volume);
+
+        if (item.transform.route) {
+            // Short routed items end in silence instead of repeating their last sample.
+            audio_accumulate_route(
+                mixed.data(), ptr, count / channels, channels, *item.transform.route, item.from, gain);
+            return;
+        }
+
+        audio_accumulate_ramp(mixed.data(), ptr, count, item.from, gain, channels);
+
+        // Repeat the last sample of each channel when the item is short.
+        if (count < size && item.samples.size() >= static_cast<std::size_t>(channels)) {
+            for (auto n = count; n < size; ++n) {
+                auto offset = item.samples.size() - (channels - (n % channels));
+                mixed[n] += static_cast<float>(ptr[offset]) * gain;
+            }
+        }
+    }
+
+    // The mix is metered after the master volume, as it is sent to the consumers, layers before it.
+    void measure_loudness(const video_format_desc& format_desc, int nb_samples)
+    {
+        if (!loudness_enabled_) {
+            return;
+        }
+
+        if (!meter_ || meter_channels_ != format_desc.audio_channels ||
+            meter_sample_rate_ != format_desc.audio_sample_rate) {
+            meter_channels_    = format_desc.audio_channels;
+            meter_sample_rate_ = format_desc.audio_sample_rate;
+            meter_.reset(new loudness_meter(meter_sample_rate_, meter_channels_, loudness_channels_));
+            layer_meters_.clear();
+        }
+
+        if (reset_loudness_.exchange(false)) {
+            meter_->reset();
+            for (auto& meter : layer_meters_) {
+                meter.second.reset();
+            }
+        }
+
+        const auto scale = 1.0f / 2147483648.0f;
+        meter_->update(mixed_.data(), nb_samples, master_volume_.load() * scale);
+
+        state_["loudness"] = meter_->state();
+        {
+            std::lock_guard<std::mutex> lock(loudness_mutex_);
+            loudness_ = meter_->loudness();
+        }
+
+        if (!layer_loudness_) {
+            return;
+        }
+
+        // Layers that weren't visited are gone, a layer that comes back starts its integrated loudness over.
+        for (auto it = layer_meters_.begin(); it != layer_meters_.end();) {
+            if (std::find(layers_.begin(), layers_.end(), it->first) == layers_.end()) {
+                it = layer_meters_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto layer : layers_) {
+            layer_mixed_.assign(mixed_.size(), 0.0f);
+            for (auto& item : items_) {
+                if (item.layer == layer) {
+                    accumulate(layer_mixed_, item, meter_channels_);
+                }
+            }
+
+            auto it = layer_meters_.find(layer);
+            if (it == layer_meters_.end()) {
+                it = layer_meters_
+                         .emplace(layer, loudness_meter(meter_sample_rate_, meter_channels_, loudness_channels_))
+                         .first;
+            }
+            it->second.update(layer_mixed_.data(), nb_samples, scale);
+
+            state_["layer"][layer]["loudness"] = it->second.state();
+        }
+    }
+
+    array<int32_t> create_buffer(std::size_t size)
+    {
+        std::vector<int32_t> buffer;
+        buffer_pool_->try_pop(buffer);
+        buffer.resize(size);
+
+        auto ptr       = buffer.data();
+        auto weak_pool = std::weak_ptr<buffer_pool_t>(buffer_pool_);
+        auto storage   = std::shared_ptr<std::vector<int32_t>>(
+            new std::vector<int32_t>(std::move(buffer)), [weak_pool](std::vector<int32_t>* p) {
+                std::unique_ptr<std::vector<int32_t>> guard(p);
+                auto                                  pool = weak_pool.lock();
+                if (pool && pool->unsafe_size() < 16) {
+                    pool->push(std::move(*p));
+                }
+            });
+
+        return array<int32_t>(ptr, size, std::move(storage));
+    }
 };
 
 audio_mixer::audio_mixer(spl::shared_ptr<diagnostics::graph> graph)
@@ -157,5 +338,12 @@ array<const int32_t> audio_mixer::operator()(const video_format_desc& format_des
     return impl_->mix(format_desc, nb_samples);
 }
 core::monitor::state audio_mixer::state() const { return impl_->state_; }
+void                 audio_mixer::set_layer(int layer) { impl_->set_layer(layer); }
+core::loudness       audio_mixer::loudness() const
+{
+    std::lock_guard<std::mutex> lock(impl_->loudness_mutex_);
+    return impl_->loudness_;
+}
+void audio_mixer::reset_loudness() { impl_->reset_loudness_ = true; }
 
 }} // namespace caspar::core
@@ -26,6 +26,7 @@
 #include <common/memory.h>
 
 #include <core/frame/frame_visitor.h>
+#include <core/mixer/audio/loudness_meter.h>
 #include <core/monitor/monitor.h>
 #include <core/video_format.h>
 
@@ -48,6 +49,13 @@ class audio_mixer final : public frame_visitor
     float                get_master_volume();
     core::monitor::state state() const;
 
+    // Frames visited from now on are the audio of layer, which is metered on its own if audio.layer-loudness is set.
+    void set_layer(int layer);
+
+    // Loudness of the mixed audio as of the last mix, see loudness_meter.
+    core::loudness loudness() const;
+    void           reset_loudness();
+
     void push(const struct frame_transform& transform) override;
     void visit(const class const_frame& frame) override;
     void pop() override;
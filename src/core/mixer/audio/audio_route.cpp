@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio_route.h"
+
+#include <common/except.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+namespace caspar { namespace core {
+
+namespace {
+
+void add(std::vector<audio_route::entry>& entries, int source, int destination, float gain)
+{
+    for (auto& entry : entries) {
+        if (entry.source == source && entry.destination == destination) {
+            entry.gain += gain;
+            return;
+        }
+    }
+    entries.push_back(audio_route::entry{source, destination, gain});
+}
+
+} // namespace
+
+std::shared_ptr<const audio_route> audio_route::parse(const std::wstring& str)
+{
+    auto route = std::make_shared<audio_route>();
+
+    std::vector<std::wstring> tokens;
+    boost::split(tokens, boost::trim_copy(str), boost::is_any_of(L" \t,"), boost::token_compress_on);
+
+    for (auto& token : tokens) {
+        if (token.empty()) {
+            continue;
+        }
+
+        std::vector<std::wstring> parts;
+        boost::split(parts, token, boost::is_any_of(L":"));
+
+        try {
+            if (parts.size() < 2 || parts.size() > 3) {
+                throw boost::bad_lexical_cast();
+            }
+            const auto source      = boost::lexical_cast<int>(parts[0]);
+            const auto destination = boost::lexical_cast<int>(parts[1]);
+            const auto gain        = parts.size() > 2 ? boost::lexical_cast<float>(parts[2]) : 1.0f;
+            if (source < 1 || destination < 1) {
+                throw boost::bad_lexical_cast();
+            }
+            add(route->entries, source - 1, destination - 1, gain);
+        } catch (const boost::bad_lexical_cast&) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid audio route: " + token));
+        }
+    }
+
+    return route;
+}
+
+std::wstring audio_route::print() const
+{
+    std::wstringstream str;
+    for (auto& entry : entries) {
+        if (&entry != &entries.front()) {
+            str << L" ";
+        }
+        str << entry.source + 1 << L":" << entry.destination + 1;
+        if (entry.gain != 1.0f) {
+            str << L":" << entry.gain;
+        }
+    }
+    return str.str();
+}
+
+std::shared_ptr<const audio_route> audio_route::combine(const audio_route& outer, const audio_route& inner)
+{
+    auto route = std::make_shared<audio_route>();
+    for (auto& first : inner.entries) {
+        for (auto& second : outer.entries) {
+            if (first.destination == second.source) {
+                add(route->entries, first.source, second.destination, first.gain * second.gain);
+            }
+        }
+    }
+    return route;
+}
+
+bool operator==(const audio_route& lhs, const audio_route& rhs)
+{
+    return std::equal(lhs.entries.begin(),
+                      lhs.entries.end(),
+                      rhs.entries.begin(),
+                      rhs.entries.end(),
+                      [](const audio_route::entry& a, const audio_route::entry& b) {
+                          return a.source == b.source && a.destination == b.destination && a.gain == b.gain;
+                      });
+}
+
+bool operator!=(const audio_route& lhs, const audio_route& rhs) { return !(lhs == rhs); }
+
+// An entry is one strided multiply-add per sample frame, so routing costs a few of them per frame instead of a
+// filter graph.
+void audio_accumulate_route(float*              dest,
+                            const std::int32_t* source,
+                            std::size_t         nb_samples,
+                            int                 channels,
+                            const audio_route&  route,
+                            float               gain_from,
+                            float               gain_to)
+{
+    const auto step = nb_samples > 0 ? (gain_to - gain_from) / static_cast<float>(nb_samples) : 0.0f;
+
+    for (auto& entry : route.entries) {
+        if (entry.source >= channels || entry.destination >= channels) {
+            continue;
+        }
+
+        auto src = source + entry.source;
+        auto dst = dest + entry.destination;
+        for (std::size_t n = 0; n < nb_samples; ++n) {
+            dst[n * channels] += static_cast<float>(src[n * channels]) *
+                                 (entry.gain * (gain_from + step * static_cast<float>(n)));
+        }
+    }
+}
+
+std::vector<std::int32_t>
+audio_apply_route(const std::int32_t* source, std::size_t nb_samples, int channels, const audio_route& route)
+{
+    std::vector<float> mixed(nb_samples * channels, 0.0f);
+    audio_accumulate_route(mixed.data(), source, nb_samples, channels, route, 1.0f, 1.0f);
+
+    std::vector<std::int32_t> result(mixed.size());
+    for (std::size_t n = 0; n < mixed.size(); ++n) {
+        result[n] = static_cast<std::int32_t>(std::min(std::max(mixed[n], -2147483648.0f), 2147483520.0f));
+    }
+    return result;
+}
+
+}} // namespace caspar::core
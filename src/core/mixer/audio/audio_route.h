@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+/**
+ * A sparse matrix of gains from source to destination channels of
+ * interleaved audio. Destination channels that no entry routes to are
+ * silent, channels beyond the audio are ignored.
+ */
+struct audio_route final
+{
+    struct entry
+    {
+        int   source;
+        int   destination;
+        float gain;
+    };
+
+    std::vector<entry> entries;
+
+    /**
+     * Parses "source:destination[:gain] ..." with channels counted from 1,
+     * e.g. "1:3 2:4" moves a stereo pair to channels 3 and 4 and
+     * "1:1:0.5 2:1:0.5" mixes it down to mono. Throws user_error.
+     */
+    static std::shared_ptr<const audio_route> parse(const std::wstring& str);
+
+    std::wstring print() const;
+
+    // Routes through inner and then through outer, entries between the same channels are summed.
+    static std::shared_ptr<const audio_route> combine(const audio_route& outer, const audio_route& inner);
+};
+
+bool operator==(const audio_route& lhs, const audio_route& rhs);
+bool operator!=(const audio_route& lhs, const audio_route& rhs);
+
+/**
+ * Adds nb_samples sample frames of source through route to dest, both with
+ * channels interleaved channels, with the gain ramped linearly from gain_from
+ * to gain_to like audio_accumulate_ramp.
+ */
+void audio_accumulate_route(float*              dest,
+                            const std::int32_t* source,
+                            std::size_t         nb_samples,
+                            int                 channels,
+                            const audio_route&  route,
+                            float               gain_from,
+                            float               gain_to);
+
+/**
+ * Returns the audio routed into a buffer of the same size, saturated to
+ * int32.
+ */
+std::vector<std::int32_t>
+audio_apply_route(const std::int32_t* source, std::size_t nb_samples, int channels, const audio_route& route);
+
+}} // namespace caspar::core
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loudness_meter.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const double pi          = 3.14159265358979323846;
+const double floor_lufs  = -120.0;
+const double gate_lufs   = -70.0;
+const double bins_per_lu = 10.0;
+const int    nb_bins     = 1000; // -70 to +30 LUFS.
+
+// Gating blocks of 400 ms overlap by 75%, so they are summed from sub-blocks of 100 ms.
+const int momentary_blocks  = 4;
+const int short_term_blocks = 30;
+
+// Polyphase interpolation filter of ITU-R BS.1770-4 Annex 2, 12 taps for each of the 4 phases.
+const float true_peak_taps[12][4] = {
+    {0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f},
+    {0.0109863281250f, 0.0292968750000f, 0.0330810546875f, 0.0148925781250f},
+    {-0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f},
+    {0.0332031250000f, 0.0891113281250f, 0.1015625000000f, 0.0476074218750f},
+    {-0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f},
+    {0.1373291015625f, 0.4650878906250f, 0.7797851562500f, 0.9721679687500f},
+    {0.9721679687500f, 0.7797851562500f, 0.4650878906250f, 0.1373291015625f},
+    {-0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f},
+    {0.0476074218750f, 0.1015625000000f, 0.0891113281250f, 0.0332031250000f},
+    {-0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f},
+    {0.0148925781250f, 0.0330810546875f, 0.0292968750000f, 0.0109863281250f},
+    {-0.0083007812500f, -0.0189208984375f, -0.0291748046875f, 0.0017089843750f},
+};
+const int history = 11;
+
+struct biquad
+{
+    double b0, b1, b2, a1, a2;
+};
+
+// The two K-weighting stages, a high shelf and a high pass, for sample_rate as derived in libebur128.
+biquad shelf_filter(int sample_rate)
+{
+    const auto f0 = 1681.974450955533;
+    const auto g  = 3.999843853973347;
+    const auto q  = 0.7071752369554196;
+
+    const auto k  = std::tan(pi * f0 / sample_rate);
+    const auto vh = std::pow(10.0, g / 20.0);
+    const auto vb = std::pow(vh, 0.4996667741545416);
+    const auto a0 = 1.0 + k / q + k * k;
+
+    return {(vh + vb * k / q + k * k) / a0,
+            2.0 * (k * k - vh) / a0,
+            (vh - vb * k / q + k * k) / a0,
+            2.0 * (k * k - 1.0) / a0,
+            (1.0 - k / q + k * k) / a0};
+}
+
+biquad high_pass_filter(int sample_rate)
+{
+    const auto f0 = 38.13547087602444;
+    const auto q  = 0.5003270373238773;
+
+    const auto k  = std::tan(pi * f0 / sample_rate);
+    const auto a0 = 1.0 + k / q + k * k;
+
+    return {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+}
+
+double to_lufs(double power)
+{
+    return power > 0.0 ? std::max(-0.691 + 10.0 * std::log10(power), floor_lufs) : floor_lufs;
+}
+
+} // namespace
+
+struct loudness_meter::impl
+{
+    struct channel
+    {
+        double weight;
+        double shelf[2]     = {0.0, 0.0}; // Transposed direct form II.
+        double high_pass[2] = {0.0, 0.0};
+        float  input[history] = {};
+    };
+
+    const int         channels_;
+    const std::size_t block_size_;
+    const biquad      shelf_;
+    const biquad      high_pass_;
+
+    std::vector<channel> metered_;
+
+    double      block_energy_   = 0.0;
+    std::size_t block_position_ = 0;
+
+    std::vector<double> blocks_ = std::vector<double>(short_term_blocks, 0.0); // Mean power of each sub-block.
+    std::size_t         next_   = 0;
+    std::size_t         filled_ = 0;
+
+    // Gating blocks above the absolute gate, in steps of 0.1 LU, which keeps the integrated loudness of any
+    // duration in constant memory.
+    std::vector<std::uint64_t> counts_   = std::vector<std::uint64_t>(nb_bins, 0);
+    std::vector<double>        energies_ = std::vector<double>(nb_bins, 0.0);
+
+    float peak_ = 0.0f;
+
+    std::vector<float>  input_;
+    std::vector<double> power_;
+
+    impl(int sample_rate, int channels, int metered_channels)
+        : channels_(channels)
+        , block_size_(static_cast<std::size_t>(std::max(sample_rate / 10, 1)))
+        , shelf_(shelf_filter(sample_rate))
+        , high_pass_(high_pass_filter(sample_rate))
+    {
+        const auto count = std::max(0, std::min(metered_channels, channels));
+        for (auto n = 0; n < count; ++n) {
+            channel ch;
+            ch.weight = count == 6 && n == 3 ? 0.0 : count == 6 && n >= 4 ? 1.41 : 1.0;
+            metered_.push_back(ch);
+        }
+    }
+
+    void update(const float* samples, std::size_t nb_samples, float gain)
+    {
+        input_.resize(history + nb_samples);
+        power_.assign(nb_samples, 0.0);
+
+        auto peak     = _mm_setzero_ps();
+        auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+        for (std::size_t c = 0; c < metered_.size(); ++c) {
+            auto& ch = metered_[c];
+
+            std::copy_n(ch.input, history, input_.begin());
+            for (std::size_t n = 0; n < nb_samples; ++n) {
+                input_[history + n] = samples[n * channels_ + c] * gain;
+            }
+            std::copy_n(input_.end() - history, history, ch.input);
+
+            // The four interpolated phases of a sample are the lanes of one vector.
+            for (std::size_t n = 0; n < nb_samples; ++n) {
+                auto x   = input_.data() + history + n;
+                auto acc = _mm_setzero_ps();
+                for (auto k = 0; k < 12; ++k) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(x[-k]), _mm_loadu_ps(true_peak_taps[k])));
+                }
+                peak = _mm_max_ps(peak, _mm_and_ps(acc, abs_mask));
+            }
+
+            if (ch.weight == 0.0) {
+                continue;
+            }
+
+            auto s = ch.shelf;
+            auto h = ch.high_pass;
+            for (std::size_t n = 0; n < nb_samples; ++n) {
+                // The offset, far below anything audible, keeps the filters out of denormals in silence.
+                const auto x = static_cast<double>(input_[history + n]) + 1e-18;
+
+                const auto y = shelf_.b0 * x + s[0];
+                s[0]         = shelf_.b1 * x - shelf_.a1 * y + s[1];
+                s[1]         = shelf_.b2 * x - shelf_.a2 * y;
+
+                const auto z = high_pass_.b0 * y + h[0];
+                h[0]         = high_pass_.b1 * y - high_pass_.a1 * z + h[1];
+                h[1]         = high_pass_.b2 * y - high_pass_.a2 * z;
+
+                power_[n] += ch.weight * z * z;
+            }
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, peak);
+        peak_ = std::max({peak_, lanes[0], lanes[1], lanes[2], lanes[3]});
+
+        for (std::size_t n = 0; n < nb_samples; ++n) {
+            block_energy_ += power_[n];
+            if (++block_position_ == block_size_) {
+                push_block();
+            }
+        }
+    }
+
+    void push_block()
+    {
+        blocks_[next_] = block_energy_ / static_cast<double>(block_size_);
+        next_          = (next_ + 1) % blocks_.size();
+        filled_        = std::min(filled_ + 1, blocks_.size());
+
+        block_energy_   = 0.0;
+        block_position_ = 0;
+
+        if (filled_ < momentary_blocks) {
+            return;
+        }
+
+        const auto power    = mean(momentary_blocks);
+        const auto loudness = to_lufs(power);
+        if (loudness <= gate_lufs) {
+            return;
+        }
+
+        const auto bin = std::min(static_cast<int>((loudness - gate_lufs) * bins_per_lu), nb_bins - 1);
+        counts_[bin] += 1;
+        energies_[bin] += power;
+    }
+
+    // Mean power of the last count sub-blocks.
+    double mean(std::size_t count) const
+    {
+        auto sum = 0.0;
+        for (std::size_t n = 1; n <= count; ++n) {
+            sum += blocks_[(next_ + blocks_.size() - n) % blocks_.size()];
+        }
+        return sum / static_cast<double>(count);
+    }
+
+    double integrated() const
+    {
+        std::uint64_t count  = 0;
+        auto          energy = 0.0;
+        for (auto n = 0; n < nb_bins; ++n) {
+            count += counts_[n];
+            energy += energies_[n];
+        }
+        if (count == 0) {
+            return floor_lufs;
+        }
+
+        // Relative gate, 10 LU below the loudness of the blocks above the absolute gate.
+        const auto relative = to_lufs(energy / static_cast<double>(count)) - 10.0;
+        const auto first    = std::max(0, static_cast<int>(std::ceil((relative - gate_lufs) * bins_per_lu - 0.5)));
+
+        count  = 0;
+        energy = 0.0;
+        for (auto n = first; n < nb_bins; ++n) {
+            count += counts_[n];
+            energy += energies_[n];
+        }
+        return count > 0 ? to_lufs(energy / static_cast<double>(count)) : floor_lufs;
+    }
+
+    void reset()
+    {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        std::fill(energies_.begin(), energies_.end(), 0.0);
+        peak_ = 0.0f;
+    }
+};
+
+loudness_meter::loudness_meter(int sample_rate, int channels, int metered_channels)
+    : impl_(new impl(sample_rate, channels, metered_channels))
+{
+}
+loudness_meter::~loudness_meter() {}
+loudness_meter::loudness_meter(loudness_meter&& other)
+    : impl_(std::move(other.impl_))
+{
+}
+loudness_meter& loudness_meter::operator=(loudness_meter&& other)
+{
+    impl_ = std::move(other.impl_);
+    return *this;
+}
+void loudness_meter::update(const float* samples, std::size_t nb_samples, float gain)
+{
+    impl_->update(samples, nb_samples, gain);
+}
+void   loudness_meter::reset() { impl_->reset(); }
+core::loudness loudness_meter::loudness() const
+{
+    core::loudness result;
+    result.momentary  = to_lufs(impl_->mean(momentary_blocks));
+    result.short_term = to_lufs(impl_->mean(short_term_blocks));
+    result.integrated = impl_->integrated();
+    result.true_peak  = impl_->peak_ > 0.0f ? std::max(20.0 * std::log10(impl_->peak_), floor_lufs) : floor_lufs;
+    return result;
+}
+monitor::state loudness_meter::state() const
+{
+    const auto values = loudness();
+
+    monitor::state state;
+    state["momentary"]  = values.momentary;
+    state["short-term"] = values.short_term;
+    state["integrated"] = values.integrated;
+    state["true-peak"]  = values.true_peak;
+    return state;
+}
+
+}} // namespace caspar::core
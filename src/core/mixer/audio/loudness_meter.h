@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace caspar { namespace core {
+
+struct loudness
+{
+    double momentary  = -120.0;
+    double short_term = -120.0;
+    double integrated = -120.0;
+    double true_peak  = -120.0; // The highest since the meter was created or reset.
+};
+
+/**
+ * EBU R128 loudness of the first channels of interleaved audio: momentary
+ * (400 ms), short-term (3 s) and gated integrated loudness in LUFS, measured
+ * through the K-weighting filters of ITU-R BS.1770, and the true peak in dBTP
+ * from 4x oversampling. Loudness below -120 LUFS, e.g. silence, is reported
+ * as -120.
+ */
+class loudness_meter final
+{
+  public:
+    // Six metered channels are weighted as 5.1, i.e. the lfe is ignored and the surrounds count 1.41 times.
+    loudness_meter(int sample_rate, int channels, int metered_channels);
+    ~loudness_meter();
+
+    loudness_meter(loudness_meter&&);
+    loudness_meter& operator=(loudness_meter&&);
+
+    loudness_meter(const loudness_meter&) = delete;
+    loudness_meter& operator=(const loudness_meter&) = delete;
+
+    /**
+     * Measures nb_samples sample frames of the interleaved samples, which
+     * are scaled by gain to a full scale of 1.0.
+     */
+    void update(const float* samples, std::size_t nb_samples, float gain);
+
+    // Restarts the integrated loudness and the true peak.
+    void reset();
+
+    core::loudness loudness() const;
+
+    // momentary, short-term, integrated and true-peak.
+    monitor::state state() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -27,6 +27,7 @@
 
 #include <cstdint>
 #include <future>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -47,7 +48,41 @@ class image_mixer
 
     virtual std::future<array<const uint8_t>> operator()(const struct video_format_desc& format_desc) = 0;
 
+    // Renders like operator() and also converts the result to each of formats, which must be convertible. Returns the
+    // bgra image followed by the planes of every format in order.
+    virtual std::vector<std::future<array<const uint8_t>>>
+    operator()(const struct video_format_desc& format_desc, const std::vector<struct pixel_format_desc>& formats) = 0;
+
+    // Renders like above, but the bgra image is only read back once its future is waited for unless readback is set,
+    // which must not be done on the device thread. texture is set to the rendered image in the form that opaque()
+    // holds for frames of create_frame, so that it can be drawn without a round trip.
+    virtual std::vector<std::future<array<const uint8_t>>>
+    operator()(const struct video_format_desc&              format_desc,
+               const std::vector<struct pixel_format_desc>& formats,
+               bool                                         readback,
+               boost::any&                                  texture) = 0;
+
+    // Returns whether rendered frames can be converted to desc without leaving the gpu.
+    virtual bool is_convertible(const struct pixel_format_desc& desc) const = 0;
+
+    // Counts of the last render. Culled items couldn't be seen and weren't drawn.
+    struct render_stats
+    {
+        int items        = 0;
+        int culled_items = 0;
+
+        // Gpu time in milliseconds of a recent frame and of each of its top level layers, or 0 if not measured.
+        double              gpu_time = 0.0;
+        std::vector<double> gpu_layer_times;
+    };
+
+    virtual render_stats stats() const { return {}; }
+
     class mutable_frame create_frame(const void* tag, const struct pixel_format_desc& desc) override = 0;
+    class mutable_frame create_frame(const void*                       tag,
+                                     const struct pixel_format_desc&   desc,
+                                     const class const_frame&          previous,
+                                     std::vector<struct image_region>& dirty) override = 0;
 
 #ifdef WIN32
     class const_frame
@@ -29,17 +29,126 @@
 #include "image/image_mixer.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/timer.h>
 
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_transform.h>
+#include <core/frame/frame_visitor.h>
 #include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <queue>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace core {
 
+namespace {
+
+const_frame read_frame(std::future<array<const uint8_t>> image,
+                       array<const std::int32_t>          audio,
+                       const pixel_format_desc&           desc,
+                       boost::any                         texture)
+{
+    std::vector<array<const uint8_t>> image_data;
+    image_data.emplace_back(image.get());
+    return const_frame(std::move(image_data), std::move(audio), desc, std::move(texture));
+}
+
+// The image is only read back from the gpu once a consumer asks for it.
+const_frame deferred_frame(std::future<array<const uint8_t>> image,
+                           array<const std::int32_t>          audio,
+                           const pixel_format_desc&           desc,
+                           boost::any                         texture)
+{
+    auto image_data = std::async(std::launch::deferred, [image = std::move(image)]() mutable {
+        std::vector<array<const uint8_t>> result;
+        result.emplace_back(image.get());
+        return result;
+    });
+    return const_frame(image_data.share(), std::move(audio), desc, std::move(texture));
+}
+
+// A number that stays with the image of a frame and its copies, and is never given to another.
+std::uint64_t frame_id(const const_frame& frame)
+{
+    static std::atomic<std::uint64_t> next{1};
+    static const int                  key = 0;
+
+    auto memo = frame.memoize(&key, [] { return boost::any(static_cast<std::uint64_t>(next++)); });
+    return boost::any_cast<std::uint64_t>(memo);
+}
+
+// Records what the image mixer is given, with frames by their id, so that a composition that is the same as the one
+// of the tick before is known to render the same image. It also records when the oldest of the frames was received,
+// and whether any is a test signal, for the timing of the mixed frame.
+class composition : public frame_visitor
+{
+    enum item_kind
+    {
+        push_item,
+        frame_item,
+        pop_item
+    };
+
+    struct item
+    {
+        item_kind       kind;
+        image_transform transform;
+        std::uint64_t   id = 0;
+
+        bool operator==(const item& other) const
+        {
+            return kind == other.kind && id == other.id && transform == other.transform;
+        }
+    };
+
+  public:
+    using items = std::vector<item>;
+
+    void push(const frame_transform& transform) override
+    {
+        items_.push_back(item{push_item, transform.image_transform});
+    }
+
+    void visit(const const_frame& frame) override
+    {
+        const auto& timing = frame.timing();
+        if (timing.received.time_since_epoch().count() != 0 &&
+            (timing_.received.time_since_epoch().count() == 0 || timing.received < timing_.received)) {
+            timing_.received = timing.received;
+        }
+        timing_.test_signal |= timing.test_signal;
+
+        // Like the image mixer, frames without an image, e.g. the audio of a clip, aren't drawn.
+        if (frame.pixel_format_desc().format != pixel_format::invalid && !frame.pixel_format_desc().planes.empty()) {
+            items_.push_back(item{frame_item, image_transform{}, frame_id(frame)});
+        }
+    }
+
+    void pop() override { items_.push_back(item{pop_item}); }
+
+    items take() { return std::move(items_); }
+
+    const frame_timing& timing() const { return timing_; }
+
+  private:
+    items        items_;
+    frame_timing timing_;
+};
+
+} // namespace
+
 struct mixer::impl
 {
     monitor::state                       state_;
@@ -47,7 +156,30 @@ struct mixer::impl
     spl::shared_ptr<diagnostics::graph>  graph_;
     audio_mixer                          audio_mixer_{graph_};
     spl::shared_ptr<image_mixer>         image_mixer_;
-    std::queue<std::future<const_frame>> buffer_;
+    std::atomic<bool>                    readback_{true};
+    std::atomic<int>                     depth_{1};
+
+    // Mixed frames that haven't been handed off, with the time since they started mixing.
+    struct pending_frame
+    {
+        std::shared_future<const_frame> frame;
+        caspar::timer                   timer;
+        frame_timing                    timing;
+    };
+    std::queue<pending_frame> buffer_;
+
+    // The last frame that was rendered and what it was rendered from. Ticks with the same composition hand it on
+    // again instead of rendering, e.g. slates, holding graphics and paused layers.
+    const bool skip_unchanged_ = env::properties().get(L"configuration.ogl.skip-unchanged", true);
+    std::shared_future<const_frame>                       previous_mix_;
+    composition::items                                    previous_composition_;
+    std::vector<std::shared_ptr<const pixel_format_desc>> previous_formats_;
+    video_format_desc                                     previous_format_desc_;
+    bool                                                  previous_readback_ = false;
+    bool                                                  previous_stable_   = false;
+
+    std::mutex                                            formats_mutex_;
+    std::vector<std::weak_ptr<const pixel_format_desc>> formats_;
 
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
@@ -57,40 +189,198 @@ struct mixer::impl
         , graph_(std::move(graph))
         , image_mixer_(std::move(image_mixer))
     {
+        graph_->set_color("culled-items", diagnostics::color(0.4f, 0.6f, 1.0f));
+        graph_->set_color("gpu-time", diagnostics::color(0.6f, 0.3f, 1.0f, 0.8f));
     }
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+    const_frame operator()(std::vector<draw_frame>  frames,
+                           const video_format_desc& format_desc,
+                           int                      nb_samples,
+                           const std::vector<int>&  layers)
     {
-        for (auto& frame : frames) {
+        caspar::timer mix_timer;
+        const auto    mixing = std::chrono::steady_clock::now();
+
+        composition comp;
+        for (std::size_t n = 0; n < frames.size(); ++n) {
+            auto& frame = frames[n];
+            if (n < layers.size()) {
+                audio_mixer_.set_layer(layers[n]);
+            }
             frame.accept(audio_mixer_);
             frame.transform().image_transform.layer_depth = 1;
+            frame.accept(comp);
+        }
+
+        auto timing   = comp.timing();
+        timing.mixing = mixing;
+
+        auto formats = requested_formats();
+
+        const bool readback = readback_;
+
+        // Woven conversions also hold the field of the tick before, which is only the same once it was unchanged too.
+        const auto woven = std::any_of(formats.begin(), formats.end(), [](auto& format) {
+            return format->woven_line >= 0;
+        });
+
+        auto       items  = comp.take();
+        const auto stable = previous_mix_.valid() && items == previous_composition_ && formats == previous_formats_ &&
+                            readback == previous_readback_ && format_desc == previous_format_desc_;
+        previous_composition_ = std::move(items);
+        previous_formats_     = formats;
+        previous_readback_    = readback;
+        previous_format_desc_ = format_desc;
+
+        const auto unchanged      = skip_unchanged_ && stable && (!woven || previous_stable_);
+        previous_stable_          = stable;
+        state_["image/unchanged"] = unchanged;
+
+        if (unchanged) {
+            auto audio      = audio_mixer_(format_desc, nb_samples);
+            state_["audio"] = audio_mixer_.state();
+
+            auto mixed = std::async(std::launch::deferred,
+                                    [previous = previous_mix_, audio = std::move(audio)]() mutable {
+                                        return previous.get().with_audio(std::move(audio));
+                                    });
+            return hand_off(mixed.share(), mix_timer, timing);
+        }
+
+        for (auto& frame : frames) {
             frame.accept(*image_mixer_);
         }
 
-        auto image = (*image_mixer_)(format_desc);
+        std::vector<pixel_format_desc> descs;
+        for (auto& format : formats) {
+            descs.push_back(*format);
+        }
+
+        boost::any texture;
+        auto       image = (*image_mixer_)(format_desc, descs, readback, texture);
         auto audio = audio_mixer_(format_desc, nb_samples);
 
         state_["audio"] = audio_mixer_.state();
 
-        buffer_.push(std::async(
-            std::launch::deferred,
-            [image = std::move(image), audio = std::move(audio), graph = graph_, format_desc, tag = this]() mutable {
-                auto desc = pixel_format_desc(pixel_format::bgra);
-                desc.planes.push_back(pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
-                std::vector<array<const uint8_t>> image_data;
-                image_data.emplace_back(std::move(image.get()));
-                return const_frame(std::move(image_data), std::move(audio), desc);
-            }));
-
-        if (buffer_.size() < 2) {
+        const auto stats             = image_mixer_->stats();
+        state_["image/items"]        = stats.items;
+        state_["image/culled-items"] = stats.culled_items;
+        graph_->set_value("culled-items",
+                          stats.items > 0 ? static_cast<double>(stats.culled_items) / stats.items : 0.0);
+
+        state_["image/gpu-time"]       = stats.gpu_time;
+        state_["image/gpu-layer-time"] = stats.gpu_layer_times;
+        graph_->set_value("gpu-time", stats.gpu_time / 1000.0 * format_desc.fps * 0.5);
+
+        auto mixed = std::async(std::launch::deferred,
+                                [image   = std::move(image),
+                                 audio   = std::move(audio),
+                                 formats = std::move(formats),
+                                 texture = std::move(texture),
+                                 graph   = graph_,
+                                 format_desc,
+                                 readback,
+                                 tag = this]() mutable {
+                                    auto desc = pixel_format_desc(pixel_format::bgra);
+                                    desc.planes.push_back(
+                                        pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
+                                    auto frame = readback ? read_frame(std::move(image.at(0)),
+                                                                       std::move(audio),
+                                                                       desc,
+                                                                       std::move(texture))
+                                                          : deferred_frame(std::move(image.at(0)),
+                                                                           std::move(audio),
+                                                                           desc,
+                                                                           std::move(texture));
+
+                                    // The memo holds on to the format, so that its key can't be reused by another
+                                    // request while the frame is alive.
+                                    auto it = image.begin() + 1;
+                                    for (auto& format : formats) {
+                                        std::vector<array<const uint8_t>> planes;
+                                        for (std::size_t n = 0; n < format->planes.size(); ++n, ++it) {
+                                            planes.emplace_back(std::move(it->get()));
+                                        }
+                                        auto converted = const_frame(std::move(planes), {}, *format);
+                                        frame.memoize(format.get(), [&]() -> boost::any {
+                                            return std::make_pair(format, std::move(converted));
+                                        });
+                                    }
+
+                                    return frame;
+                                });
+        previous_mix_ = mixed.share();
+        return hand_off(previous_mix_, mix_timer, timing);
+    }
+
+    const_frame hand_off(std::shared_future<const_frame> mixed, const caspar::timer& mix_timer, frame_timing timing)
+    {
+        buffer_.push(pending_frame{std::move(mixed), mix_timer, timing});
+
+        // Frames beyond the depth, e.g. after it was lowered, are dropped so that the latency goes down at once.
+        const auto depth = static_cast<std::size_t>(depth_);
+        while (buffer_.size() > depth + 1) {
+            buffer_.pop();
+        }
+
+        if (buffer_.size() <= depth) {
             return const_frame{};
         }
 
-        auto frame = std::move(buffer_.front().get());
+        // Waits for the readback of the oldest frame, which at depth 0 is the one that was just mixed.
+        auto entry = std::move(buffer_.front());
         buffer_.pop();
-        return frame;
+        auto frame = entry.frame.get();
+
+        state_["depth"]   = static_cast<int>(depth);
+        state_["latency"] = entry.timer.elapsed() * 1000.0;
+
+        entry.timing.mixed = std::chrono::steady_clock::now();
+        return frame.with_timing(entry.timing);
+    }
+
+    std::vector<std::shared_ptr<const pixel_format_desc>> requested_formats()
+    {
+        std::lock_guard<std::mutex> lock(formats_mutex_);
+
+        std::vector<std::shared_ptr<const pixel_format_desc>> result;
+        for (auto it = formats_.begin(); it != formats_.end();) {
+            auto format = it->lock();
+            if (format) {
+                result.push_back(std::move(format));
+                ++it;
+            } else {
+                it = formats_.erase(it);
+            }
+        }
+        return result;
+    }
+
+    std::shared_ptr<const pixel_format_desc> request_format(const pixel_format_desc& desc)
+    {
+        if (!image_mixer_->is_convertible(desc)) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(formats_mutex_);
+
+        // Consumers that want the same format share its conversion, which is only rendered and read back once.
+        for (auto& weak_format : formats_) {
+            auto format = weak_format.lock();
+            if (format && *format == desc) {
+                return format;
+            }
+        }
+
+        auto format = std::make_shared<const pixel_format_desc>(desc);
+        formats_.push_back(format);
+        return format;
     }
 
+    void set_readback(bool readback) { readback_ = readback; }
+
+    void set_depth(int depth) { depth_ = std::max(0, std::min(2, depth)); }
+
     void set_master_volume(float volume) { audio_mixer_.set_master_volume(volume); }
 
     float get_master_volume() { return audio_mixer_.get_master_volume(); }
@@ -100,15 +390,44 @@ mixer::mixer(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::
     : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer)))
 {
 }
+void        mixer::set_readback(bool readback) { impl_->set_readback(readback); }
+void        mixer::set_depth(int depth) { impl_->set_depth(depth); }
 void        mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
 float       mixer::get_master_volume() { return impl_->get_master_volume(); }
-const_frame mixer::operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+loudness    mixer::loudness() const { return impl_->audio_mixer_.loudness(); }
+void        mixer::reset_loudness() { impl_->audio_mixer_.reset_loudness(); }
+const_frame mixer::operator()(std::vector<draw_frame>  frames,
+                              const video_format_desc& format_desc,
+                              int                      nb_samples,
+                              const std::vector<int>&  layers)
 {
-    return (*impl_)(std::move(frames), format_desc, nb_samples);
+    return (*impl_)(std::move(frames), format_desc, nb_samples, layers);
 }
 mutable_frame mixer::create_frame(const void* tag, const pixel_format_desc& desc)
 {
     return impl_->image_mixer_->create_frame(tag, desc);
 }
 core::monitor::state mixer::state() const { return impl_->state_; }
+std::shared_ptr<const pixel_format_desc> mixer::request_format(const pixel_format_desc& desc)
+{
+    return impl_->request_format(desc);
+}
+
+bool same_image(const const_frame& frame, const const_frame& other)
+{
+    return frame && other && frame_id(frame) == frame_id(other);
+}
+
+const_frame converted_frame(const const_frame& frame, const std::shared_ptr<const pixel_format_desc>& format)
+{
+    if (!frame || !format) {
+        return const_frame{};
+    }
+
+    using entry_t = std::pair<std::shared_ptr<const pixel_format_desc>, const_frame>;
+
+    auto memo  = frame.memoize(format.get(), [] { return boost::any{}; });
+    auto entry = boost::any_cast<entry_t>(&memo);
+    return entry && entry->first == format ? entry->second : const_frame{};
+}
 }} // namespace caspar::core
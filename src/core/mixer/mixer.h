@@ -24,9 +24,13 @@
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <core/frame/pixel_format.h>
 #include <core/fwd.h>
 #include <core/monitor/monitor.h>
 
+#include <memory>
+#include <vector>
+
 FORWARD2(caspar, diagnostics, class graph);
 
 namespace caspar { namespace core {
@@ -41,18 +45,47 @@ class mixer final
                    spl::shared_ptr<caspar::diagnostics::graph> graph,
                    spl::shared_ptr<image_mixer>                image_mixer);
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples);
+    // layers holds the index of the layer of each frame, if given the audio of each layer can be metered on its own.
+    const_frame operator()(std::vector<draw_frame>  frames,
+                           const video_format_desc& format_desc,
+                           int                      nb_samples,
+                           const std::vector<int>&  layers = {});
+
+    // Mixed frames are read back to host memory while set. Otherwise they are only read back once image_data is
+    // called, and opaque() holds the rendered texture for consumers that draw it themselves.
+    void set_readback(bool readback);
+
+    // Frames, 0 to 2, that are mixed ahead of the one handed off, giving the gpu time to render and read them back.
+    // 0 waits for the frame that was just mixed, which has the lowest latency.
+    void set_depth(int depth);
 
     void  set_master_volume(float volume);
     float get_master_volume();
 
+    struct loudness loudness() const;
+    void            reset_loudness();
+
     mutable_frame create_frame(const void* tag, const pixel_format_desc& desc);
 
     core::monitor::state state() const;
 
+    // Has mixed frames also carry their image converted to desc on the gpu for as long as the returned format is
+    // held, see converted_frame. Returns nullptr if the image mixer can't convert to desc. With a woven_line the
+    // conversion holds the field of the frame mixed before too, see pixel_format_desc. Requests of equal descriptions
+    // get the same format, which is converted once for all of them.
+    std::shared_ptr<const pixel_format_desc> request_format(const pixel_format_desc& desc);
+
   private:
     struct impl;
     spl::shared_ptr<impl> impl_;
 };
 
+// Whether other has the image of frame, e.g. because the channel handed on the frame it mixed before when nothing
+// changed. Consumers may skip encoding it again.
+bool same_image(const const_frame& frame, const const_frame& other);
+
+// Returns the conversion of a mixed frame to format, or an empty frame if it wasn't converted, e.g. because it was
+// mixed before the format was requested.
+const_frame converted_frame(const const_frame& frame, const std::shared_ptr<const pixel_format_desc>& format);
+
 }} // namespace caspar::core
\ No newline at end of file
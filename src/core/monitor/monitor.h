@@ -24,7 +24,9 @@
 #include <boost/variant.hpp>
 
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <boost/container/flat_map.hpp>
@@ -36,57 +38,100 @@ using data_t     = boost::variant<bool, std::int32_t, std::int64_t, float, doubl
 using vector_t   = boost::container::small_vector<data_t, 2>;
 using data_map_t = boost::container::flat_map<std::string, vector_t>;
 
+// Copies share their data until one of them is changed, so taking a snapshot of a state is cheap.
 class state
 {
-    data_map_t data_;
+    std::shared_ptr<data_map_t> data_;
 
+    data_map_t& mutable_data()
+    {
+        if (!data_) {
+            data_ = std::make_shared<data_map_t>();
+        } else if (data_.use_count() > 1) {
+            data_ = std::make_shared<data_map_t>(*data_);
+        }
+        return *data_;
+    }
+
+    static void append(std::string& path, const std::string& key) { path += key; }
+    static void append(std::string& path, const char* key) { path += key; }
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type append(std::string& path, T key)
+    {
+        path += std::to_string(key);
+    }
+    template <typename T>
+    static typename std::enable_if<!std::is_integral<T>::value>::type append(std::string& path, const T& key)
+    {
+        path += boost::lexical_cast<std::string>(key);
+    }
+
+    // Paths are built in place, a temporary proxy hands its path on to the next one instead of copying it.
     class state_proxy
     {
         std::string key_;
-        data_map_t& data_;
+        state&      state_;
 
       public:
-        state_proxy(const std::string& key, data_map_t& data)
-            : key_(key)
-            , data_(data)
+        state_proxy(std::string key, state& state)
+            : key_(std::move(key))
+            , state_(state)
         {
         }
 
         state_proxy& operator=(data_t data)
         {
-            data_[key_] = {std::move(data)};
+            auto& value = state_.mutable_data()[key_];
+            value.clear();
+            value.push_back(std::move(data));
             return *this;
         }
 
         state_proxy& operator=(vector_t data)
         {
-            data_[key_] = std::move(data);
+            state_.mutable_data()[key_] = std::move(data);
             return *this;
         }
 
         template <typename T>
-        state_proxy operator[](const T& key)
+        state_proxy operator[](const T& key) &
         {
-            return state_proxy(key_ + "/" + boost::lexical_cast<std::string>(key), data_);
+            auto path = key_;
+            path += '/';
+            append(path, key);
+            return state_proxy(std::move(path), state_);
+        }
+
+        template <typename T>
+        state_proxy operator[](const T& key) &&
+        {
+            key_ += '/';
+            append(key_, key);
+            return state_proxy(std::move(key_), state_);
         }
 
         template <typename T>
         state_proxy& operator=(const std::vector<T>& data)
         {
-            data_[key_] = vector_t(data.begin(), data.end());
+            state_.mutable_data()[key_].assign(data.begin(), data.end());
             return *this;
         }
 
         state_proxy& operator=(std::initializer_list<data_t> data)
         {
-            data_[key_] = vector_t(std::move(data));
+            state_.mutable_data()[key_].assign(data.begin(), data.end());
             return *this;
         }
 
         state_proxy& operator=(const state& other)
         {
+            auto& data = state_.mutable_data();
+            auto  path = key_ + "/";
+            auto  size = path.size();
             for (auto& p : other) {
-                data_[key_ + "/" + p.first] = std::move(p.second);
+                path.resize(size);
+                path += p.first;
+                data[path] = p.second;
             }
             return *this;
         }
@@ -94,29 +139,32 @@ class state
 
   public:
     state() = default;
-    state(const state& other)
-        : data_(other.data_)
-    {
-    }
+    state(const state& other) = default;
     state(data_map_t data)
-        : data_(std::move(data))
+        : data_(std::make_shared<data_map_t>(std::move(data)))
     {
     }
-    state& operator=(const state& other)
-    {
-        data_ = other.data_;
-        return *this;
-    }
+    state& operator=(const state& other) = default;
 
     template <typename T>
     state_proxy operator[](const T& key)
     {
-        return state_proxy(boost::lexical_cast<std::string>(key), data_);
+        std::string path;
+        path.reserve(64);
+        append(path, key);
+        return state_proxy(std::move(path), *this);
     }
 
-    data_map_t::const_iterator begin() const { return data_.begin(); }
+    data_map_t::const_iterator begin() const { return data_ ? data_->cbegin() : empty().cbegin(); }
+
+    data_map_t::const_iterator end() const { return data_ ? data_->cend() : empty().cend(); }
 
-    data_map_t::const_iterator end() const { return data_.end(); }
+  private:
+    static const data_map_t& empty()
+    {
+        static const data_map_t data;
+        return data;
+    }
 };
 
 }}} // namespace caspar::core::monitor
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "async_producer.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <core/diagnostics/call_context.h>
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+
+#include <tbb/task_arena.h>
+
+#include <chrono>
+#include <future>
+#include <limits>
+
+namespace caspar { namespace core {
+
+namespace {
+
+tbb::task_arena& loader_arena()
+{
+    static tbb::task_arena arena;
+    return arena;
+}
+
+} // namespace
+
+class async_producer : public frame_producer
+{
+    mutable monitor::state state_;
+
+    const std::wstring                                  description_;
+    std::shared_future<spl::shared_ptr<frame_producer>> future_;
+    mutable std::shared_ptr<frame_producer>             producer_;
+    mutable spl::shared_ptr<frame_producer>             leading_ = frame_producer::empty();
+    bool                                                played_  = false;
+    mutable bool                                        failed_  = false;
+
+  public:
+    async_producer(std::wstring                                      description,
+                   std::function<spl::shared_ptr<frame_producer>()> factory,
+                   std::function<void(std::exception_ptr)>          done)
+        : description_(std::move(description))
+    {
+        state_["loading"] = true;
+
+        auto task = std::make_shared<std::packaged_task<spl::shared_ptr<frame_producer>()>>(std::move(factory));
+        future_   = task->get_future().share();
+
+        auto future  = future_;
+        auto context = diagnostics::call_context::for_thread();
+        loader_arena().enqueue([task, future, done, context] {
+            {
+                diagnostics::scoped_call_context save;
+                diagnostics::call_context::for_thread() = context;
+                (*task)();
+            }
+
+            std::exception_ptr error;
+            try {
+                future.get();
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            try {
+                if (done) {
+                    done(error);
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+
+        CASPAR_LOG(debug) << print() << L" Loading";
+    }
+
+    // Picks up the producer once it has been created, without waiting for it.
+    bool loaded() const
+    {
+        if (producer_) {
+            return true;
+        }
+
+        if (failed_ || future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+
+        try {
+            producer_ = future_.get();
+            if (played_) {
+                producer_->leading_producer(leading_);
+                leading_ = frame_producer::empty();
+            }
+            return true;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << print() << L" Failed to load";
+
+            failed_           = true;
+            state_["loading"] = false;
+            state_["failed"]  = true;
+            return false;
+        }
+    }
+
+    // frame_producer
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        if (loaded()) {
+            return producer_->receive(nb_samples);
+        }
+        return played_ ? leading_->receive(nb_samples) : draw_frame{};
+    }
+
+    draw_frame first_frame() override { return loaded() ? producer_->first_frame() : draw_frame{}; }
+
+    draw_frame last_frame() override
+    {
+        if (loaded()) {
+            return producer_->last_frame();
+        }
+        return played_ ? leading_->last_frame() : draw_frame{};
+    }
+
+    void leading_producer(const spl::shared_ptr<frame_producer>& producer) override
+    {
+        if (loaded()) {
+            producer_->leading_producer(producer);
+        } else {
+            leading_ = producer;
+            played_  = true;
+        }
+    }
+
+    // Once loaded the layer swaps in the producer itself. If loading failed whatever was playing before stays.
+    spl::shared_ptr<frame_producer> following_producer() const override
+    {
+        if (loaded()) {
+            return spl::shared_ptr<frame_producer>(producer_);
+        }
+        return failed_ && played_ ? leading_ : frame_producer::empty();
+    }
+
+    boost::optional<int64_t> auto_play_delta() const override
+    {
+        return loaded() ? producer_->auto_play_delta() : boost::none;
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        if (!loaded()) {
+            CASPAR_THROW_EXCEPTION(invalid_operation() << msg_info(L"Producer is still loading: " + description_));
+        }
+        return producer_->call(params);
+    }
+
+    uint32_t frame_number() const override
+    {
+        return producer_ ? producer_->frame_number() : played_ ? leading_->frame_number() : 0;
+    }
+
+    uint32_t nb_frames() const override
+    {
+        return producer_ ? producer_->nb_frames()
+                         : played_ ? leading_->nb_frames() : std::numeric_limits<uint32_t>::max();
+    }
+
+    std::wstring print() const override { return L"async[" + description_ + L"]"; }
+
+    std::wstring name() const override { return producer_ ? producer_->name() : L"async"; }
+
+    core::monitor::state state() const override { return producer_ ? producer_->state() : state_; }
+
+    // Leaves the producer to be picked up on the channel thread.
+    bool ready() const override
+    {
+        if (future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+
+        try {
+            return future_.get()->ready();
+        } catch (...) {
+            return false;
+        }
+    }
+};
+
+spl::shared_ptr<frame_producer> create_async_producer(std::wstring                                      description,
+                                                      std::function<spl::shared_ptr<frame_producer>()> factory,
+                                                      std::function<void(std::exception_ptr)>          done)
+{
+    return spl::make_shared<async_producer>(std::move(description), std::move(factory), std::move(done));
+}
+
+}} // namespace caspar::core
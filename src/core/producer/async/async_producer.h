@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <exception>
+#include <functional>
+#include <string>
+
+namespace caspar { namespace core {
+
+// Stands in for the producer returned by factory, which is run on a background thread. Until that producer is ready
+// nothing is shown, or the producer it was played over keeps playing, and then it takes over. done is called from the
+// background thread with the exception if factory failed, or nullptr.
+spl::shared_ptr<class frame_producer>
+create_async_producer(std::wstring                                            description,
+                      std::function<spl::shared_ptr<class frame_producer>()> factory,
+                      std::function<void(std::exception_ptr)>                 done = nullptr);
+
+}} // namespace caspar::core
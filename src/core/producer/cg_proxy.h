@@ -50,6 +50,10 @@ class cg_proxy
     virtual void         update(int layer, const std::wstring& data)  = 0;
     virtual std::wstring invoke(int layer, const std::wstring& label) = 0;
 
+    // Calls between begin_batch and commit_batch may be held back and reach the template together when committed.
+    virtual void begin_batch() {}
+    virtual void commit_batch() {}
+
     static const spl::shared_ptr<cg_proxy>& empty();
 };
 
@@ -36,21 +36,74 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <list>
+#include <memory>
+#include <mutex>
 #include <sstream>
 
 namespace caspar { namespace core {
 
+namespace {
+
+// Colours and gradients, which are one pixel per colour that the mixer stretches over the channel, are shared by
+// value between the producers and frames of each frame factory, so that each is only created and uploaded once,
+// e.g. for the EMPTY that every transition from a cleared layer starts from. The mixer memoizes its texture on the
+// shared frame.
+const std::size_t COLOR_CACHE_SIZE = 256;
+
+struct color_cache
+{
+    struct entry
+    {
+        std::weak_ptr<frame_factory> factory;
+        std::vector<uint32_t>        values;
+        const_frame                  frame;
+    };
+
+    std::mutex       mutex;
+    std::list<entry> entries; // the most recently used first
+};
+
+color_cache& get_color_cache()
+{
+    static color_cache cache;
+    return cache;
+}
+
+} // namespace
+
 draw_frame
 create_color_frame(void* tag, const spl::shared_ptr<frame_factory>& frame_factory, const std::vector<uint32_t>& values)
 {
+    auto& cache = get_color_cache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it) {
+            if (it->values == values && it->factory.lock().get() == frame_factory.get()) {
+                cache.entries.splice(cache.entries.begin(), cache.entries, it);
+                return core::draw_frame(it->frame);
+            }
+        }
+    }
+
+    // The frames have no audio, so a tag of their own doesn't matter to the audio mixer.
     core::pixel_format_desc desc(pixel_format::bgra);
     desc.planes.push_back(core::pixel_format_desc::plane(static_cast<int>(values.size()), 1, 4));
-    auto frame = frame_factory->create_frame(tag, desc);
+    auto frame = frame_factory->create_frame(&cache, desc);
 
     for (int i = 0; i < values.size(); ++i)
         *reinterpret_cast<uint32_t*>(frame.image_data(0).begin() + i * 4) = values.at(i);
 
-    return core::draw_frame(std::move(frame));
+    const_frame result(std::move(frame));
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.remove_if([](const color_cache::entry& entry) { return entry.factory.expired(); });
+    cache.entries.push_front({frame_factory, values, result});
+    if (cache.entries.size() > COLOR_CACHE_SIZE) {
+        cache.entries.pop_back();
+    }
+
+    return core::draw_frame(result);
 }
 
 draw_frame create_color_frame(void* tag, const spl::shared_ptr<frame_factory>& frame_factory, uint32_t value)
@@ -27,21 +27,59 @@
 #include "../frame/draw_frame.h"
 
 #include "color/color_producer.h"
+#include "multiview/multiview_producer.h"
+#include "playlist/playlist_producer.h"
 #include "route/route_producer.h"
 #include "separated/separated_producer.h"
+#include "sync/sync_test_producer.h"
 
 #include <common/assert.h>
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/except.h>
 #include <common/executor.h>
 #include <common/future.h>
 #include <common/memory.h>
+#include <common/timer.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace caspar { namespace core {
 struct frame_producer_registry::impl
 {
     std::vector<producer_factory_t> producer_factories;
+
+    // The factory that last created a producer for a resource, by upper case resource, tried first the next time.
+    std::mutex                  mutex;
+    std::map<std::wstring, int> hints;
+
+    int get_hint(const std::wstring& resource)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto                        it = hints.find(boost::to_upper_copy(resource));
+        return it != hints.end() ? it->second : -1;
+    }
+
+    void set_hint(const std::wstring& resource, int index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (index < 0) {
+            hints.erase(boost::to_upper_copy(resource));
+            return;
+        }
+        if (hints.size() >= 1024) {
+            hints.clear();
+        }
+        hints[boost::to_upper_copy(resource)] = index;
+    }
 };
 
 frame_producer_registry::frame_producer_registry()
@@ -93,13 +131,84 @@ const spl::shared_ptr<frame_producer>& frame_producer::empty()
     return producer;
 }
 
-std::shared_ptr<executor>& producer_destroyer()
+// Threads that released producers are destroyed on, so that joining decoders or closing browsers doesn't hold up
+// the channel. Each destroy goes to the thread with the shortest queue. When max-pending destroys are queued the
+// producer is destroyed where it was released instead, which slows down whoever releases them, e.g. a mass CLEAR,
+// rather than letting the memory of old producers pile up.
+struct producer_destroyer
 {
-    static auto destroyer = [] {
-        auto result = std::make_shared<executor>(L"Producer destroyer");
-        result->set_capacity(std::numeric_limits<unsigned int>::max());
-        return result;
-    }();
+    std::vector<std::unique_ptr<executor>> executors;
+    const int                              max_pending;
+    std::atomic<int>                       pending{0};
+    spl::shared_ptr<diagnostics::graph>    graph;
+
+    producer_destroyer()
+        : max_pending(std::max(1, env::properties().get(L"configuration.destroyer.max-pending", 16)))
+    {
+        const auto threads = std::max(1, env::properties().get(L"configuration.destroyer.threads", 2));
+        for (auto n = 0; n < threads; ++n) {
+            executors.push_back(std::make_unique<executor>(L"Producer destroyer " + std::to_wstring(n)));
+            executors.back()->set_capacity(std::numeric_limits<unsigned int>::max());
+        }
+
+        graph->set_color("destroy-time", diagnostics::color(1.0f, 0.5f, 0.0f));
+        graph->set_color("pending", diagnostics::color(0.3f, 0.6f, 1.0f));
+        graph->set_color("synchronous-destroy", diagnostics::color(0.9f, 0.1f, 0.1f));
+        graph->set_text(L"producer destroyer");
+        diagnostics::register_graph(graph);
+    }
+
+    // Returns the seconds it took.
+    static double destroy(std::shared_ptr<frame_producer>& producer, const std::wstring& str)
+    {
+        if (!producer.unique())
+            CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: " << producer.use_count();
+        else
+            CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
+
+        caspar::timer timer;
+        producer.reset();
+        CASPAR_LOG(info) << str << L" Destroyed in " << static_cast<int>(timer.elapsed() * 1000.0) << L" ms.";
+        return timer.elapsed();
+    }
+
+    // Returns false if the producer should be destroyed by the caller.
+    bool begin_destroy(std::shared_ptr<frame_producer>& producer)
+    {
+        if (pending >= max_pending) {
+            graph->set_tag(diagnostics::tag_severity::WARNING, "synchronous-destroy");
+            CASPAR_LOG(warning) << producer->print() << L" " << pending
+                                << L" producers are waiting to be destroyed, destroying it synchronously.";
+            return false;
+        }
+
+        auto& destroyer = *std::min_element(executors.begin(), executors.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs->size() < rhs->size();
+        });
+
+        graph->set_value("pending", static_cast<double>(++pending) / max_pending);
+
+        auto holder = std::make_shared<std::shared_ptr<frame_producer>>(std::move(producer));
+        destroyer->begin_invoke([=] {
+            auto         producer = std::move(*holder);
+            std::wstring str;
+            try {
+                str = producer->print();
+                // 1 is a second.
+                graph->set_value("destroy-time", std::min(1.0, destroy(producer, str)));
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            graph->set_value("pending", static_cast<double>(--pending) / max_pending);
+        });
+
+        return true;
+    }
+};
+
+std::shared_ptr<producer_destroyer>& get_producer_destroyer()
+{
+    static auto destroyer = std::make_shared<producer_destroyer>();
 
     return destroyer;
 }
@@ -114,8 +223,8 @@ std::atomic<bool>& destroy_producers_in_separate_thread()
 void destroy_producers_synchronously()
 {
     destroy_producers_in_separate_thread() = false;
-    // Join destroyer, executing rest of producers in queue synchronously.
-    producer_destroyer().reset();
+    // Join destroyers, executing rest of producers in queue synchronously.
+    get_producer_destroyer().reset();
 }
 
 class destroy_producer_proxy : public frame_producer
@@ -134,34 +243,18 @@ class destroy_producer_proxy : public frame_producer
         if (producer_ == core::frame_producer::empty() || !destroy_producers_in_separate_thread())
             return;
 
-        auto destroyer = producer_destroyer();
+        auto destroyer = get_producer_destroyer();
 
         if (!destroyer)
             return;
 
-        CASPAR_VERIFY(destroyer->size() < 8);
-
-        auto producer = new spl::shared_ptr<frame_producer>(std::move(producer_));
-
-        destroyer->begin_invoke([=] {
-            std::unique_ptr<spl::shared_ptr<frame_producer>> pointer_guard(producer);
-            auto                                             str = (*producer)->print();
-            try {
-                if (!producer->unique())
-                    CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
-                                      << producer->use_count();
-                else
-                    CASPAR_LOG(debug) << str << L" Destroying on asynchronous destruction thread.";
-            } catch (...) {
-            }
-
-            try {
-                pointer_guard.reset();
-                CASPAR_LOG(info) << str << L" Destroyed.";
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+        try {
+            if (!destroyer->begin_destroy(producer_)) {
+                producer_destroyer::destroy(producer_, producer_->print());
             }
-        });
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
     }
 
     draw_frame                receive_impl(int nb_samples) override { return producer_->receive(nb_samples); }
@@ -177,6 +270,9 @@ class destroy_producer_proxy : public frame_producer
     draw_frame           last_frame() override { return producer_->last_frame(); }
     draw_frame           first_frame() override { return producer_->first_frame(); }
     core::monitor::state state() const override { return producer_->state(); }
+    bool                 ready() const override { return producer_->ready(); }
+    bool                 has_key() const override { return producer_->has_key(); }
+    boost::optional<boost::rational<int>> frame_rate() const override { return producer_->frame_rate(); }
 };
 
 spl::shared_ptr<core::frame_producer> create_destroy_proxy(spl::shared_ptr<core::frame_producer> producer)
@@ -184,9 +280,12 @@ spl::shared_ptr<core::frame_producer> create_destroy_proxy(spl::shared_ptr<core:
     return spl::make_shared<destroy_producer_proxy>(std::move(producer));
 }
 
+// Tries the factory at index first, if there is one, and then the others in order. index is set to the factory that
+// created the producer, or -1 if none did.
 spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_dependencies&     dependencies,
                                                          const std::vector<std::wstring>&       params,
                                                          const std::vector<producer_factory_t>& factories,
+                                                         int&                                   index,
                                                          bool                                   throw_on_fail = false)
 {
     if (params.empty()) {
@@ -200,24 +299,53 @@ spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_de
 
     producer = create_route_producer(dependencies, params);
     if (producer != frame_producer::empty()) {
+        index = -1;
         return producer;
     }
 
-    if (std::any_of(factories.begin(), factories.end(), [&](const producer_factory_t& factory) -> bool {
-            try {
-                producer = factory(dependencies, params);
-            } catch (user_error&) {
+    producer = create_multiview_producer(dependencies, params);
+    if (producer != frame_producer::empty()) {
+        index = -1;
+        return producer;
+    }
+
+    producer = create_playlist_producer(dependencies, params);
+    if (producer != frame_producer::empty()) {
+        index = -1;
+        return producer;
+    }
+
+    producer = create_sync_test_producer(dependencies, params);
+    if (producer != frame_producer::empty()) {
+        index = -1;
+        return producer;
+    }
+
+    auto try_factory = [&](int n) -> bool {
+        try {
+            producer = factories[n](dependencies, params);
+        } catch (user_error&) {
+            throw;
+        } catch (...) {
+            if (throw_on_fail)
                 throw;
-            } catch (...) {
-                if (throw_on_fail)
-                    throw;
-                else
-                    CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-            return producer != frame_producer::empty();
-        })) {
+            else
+                CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        return producer != frame_producer::empty();
+    };
+
+    const auto hint = index >= 0 && index < static_cast<int>(factories.size()) ? index : -1;
+    if (hint >= 0 && try_factory(hint)) {
         return producer;
     }
+
+    for (index = 0; index < static_cast<int>(factories.size()); ++index) {
+        if (index != hint && try_factory(index)) {
+            return producer;
+        }
+    }
+    index = -1;
     return frame_producer::empty();
 }
 
@@ -225,19 +353,29 @@ spl::shared_ptr<core::frame_producer>
 frame_producer_registry::create_producer(const frame_producer_dependencies& dependencies,
                                          const std::vector<std::wstring>&   params) const
 {
+    if (params.empty()) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("params cannot be empty"));
+    }
+
     auto& producer_factories = impl_->producer_factories;
-    auto  producer           = do_create_producer(dependencies, params, producer_factories);
+    auto  index              = impl_->get_hint(params.at(0));
+    auto  producer           = do_create_producer(dependencies, params, producer_factories, index);
     auto  key_producer       = frame_producer::empty();
 
-    if (!params.empty() && !boost::contains(params.at(0), L"://")) {
+    impl_->set_hint(params.at(0), index);
+
+    if (!params.empty() && !boost::contains(params.at(0), L"://") && !producer->has_key()) {
         try // to find a key file.
         {
             auto params_copy = params;
+            // A key is most likely of the same kind as its fill.
+            auto key_index = index;
             params_copy[0] += L"_A";
-            key_producer = do_create_producer(dependencies, params_copy, producer_factories);
+            key_producer = do_create_producer(dependencies, params_copy, producer_factories, key_index);
             if (key_producer == frame_producer::empty()) {
+                key_index = index;
                 params_copy[0] += L"LPHA";
-                key_producer = do_create_producer(dependencies, params_copy, producer_factories);
+                key_producer = do_create_producer(dependencies, params_copy, producer_factories, key_index);
             }
         } catch (...) {
         }
@@ -31,6 +31,7 @@
 #include <core/video_format.h>
 
 #include <boost/optional.hpp>
+#include <boost/rational.hpp>
 
 #include <cstdint>
 #include <functional>
@@ -114,6 +115,17 @@ class frame_producer
     virtual void                            leading_producer(const spl::shared_ptr<frame_producer>&) {}
     virtual spl::shared_ptr<frame_producer> following_producer() const { return core::frame_producer::empty(); }
     virtual boost::optional<int64_t>        auto_play_delta() const { return boost::none; }
+
+    // Whether the next frames can be received without underflowing, e.g. once a background buffer has been filled.
+    // May be called from any thread.
+    virtual bool ready() const { return true; }
+
+    // Whether the frames are already masked with the key of a separated fill and key pair, e.g. a _A file.
+    virtual bool has_key() const { return false; }
+
+    // The rate that the frames are rendered at if it isn't the channel's, in which case the layer receives them on
+    // a clock of their own and gets nb_samples for that rate, see layer.
+    virtual boost::optional<boost::rational<int>> frame_rate() const { return boost::none; }
 };
 
 class frame_producer_registry;
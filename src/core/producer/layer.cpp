@@ -26,10 +26,176 @@
 #include "frame_producer.h"
 
 #include "../frame/draw_frame.h"
+#include "../frame/frame.h"
+#include "../frame/frame_transform.h"
+#include "../frame/frame_visitor.h"
+#include "../frame/pixel_format.h"
 #include "../video_format.h"
 
+#include <common/array.h>
+#include <common/env.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
 namespace caspar { namespace core {
 
+// Queued producers are created, and so open and start buffering their input, as soon as they are queued.
+const std::size_t MAX_QUEUE_LENGTH = 8;
+
+// Frames of a producer with a rate of its own that are received in one tick at most, e.g. to catch up after a stall.
+const int MAX_CLOCK_FRAMES = 8;
+
+namespace {
+
+// Mixes the audio of the frames a producer drew, with their volumes, so that it can be drawn apart from their images.
+class audio_collector : public frame_visitor
+{
+    std::vector<double>                                              volumes_{1.0};
+    std::vector<std::pair<const array<const std::int32_t>*, double>> items_;
+
+  public:
+    void push(const frame_transform& transform) override
+    {
+        volumes_.push_back(volumes_.back() * transform.audio_transform.volume);
+    }
+
+    void visit(const const_frame& frame) override
+    {
+        if (frame.audio_data().size() > 0 && volumes_.back() > 0.0) {
+            items_.emplace_back(&frame.audio_data(), volumes_.back());
+        }
+    }
+
+    void pop() override { volumes_.pop_back(); }
+
+    void append_to(std::deque<std::int32_t>& samples) const
+    {
+        if (items_.size() == 1 && items_.front().second == 1.0) {
+            samples.insert(samples.end(), items_.front().first->begin(), items_.front().first->end());
+            return;
+        }
+
+        std::vector<double> mixed;
+        for (auto& item : items_) {
+            mixed.resize(std::max(mixed.size(), item.first->size()), 0.0);
+            for (std::size_t n = 0; n < item.first->size(); ++n) {
+                mixed[n] += item.first->data()[n] * item.second;
+            }
+        }
+        const auto min = static_cast<double>(std::numeric_limits<std::int32_t>::min());
+        const auto max = static_cast<double>(std::numeric_limits<std::int32_t>::max());
+        for (auto sample : mixed) {
+            samples.push_back(static_cast<std::int32_t>(std::max(min, std::min(max, sample))));
+        }
+    }
+};
+
+} // namespace
+
+// Receives the frames of a producer with a rate of its own on their own clock instead of once per tick, e.g. 23.98
+// content on a 59.94 channel or a template at 30 on 50i. Ticks in between show the last frame again, or blend it
+// into the one before by their phase, drawn by the mixer from the textures it already has, so that no layer is
+// converted to the rate of the channel on the cpu. The audio is taken apart from the frames and rebuffered into the
+// cadence of the channel, which has the same sample rate.
+class layer_clock
+{
+    const bool blend_ =
+        boost::iequals(env::properties().get(L"configuration.layer-clock", std::wstring(L"repeat")), L"blend");
+
+    const frame_producer*    producer_ = nullptr;
+    boost::rational<int>     rate_     = 0;
+    double                   phase_    = 0.0; // native frames since the last one was received
+    std::int64_t             frames_   = 0;
+    draw_frame               previous_;
+    draw_frame               current_;
+    std::deque<std::int32_t> samples_;
+
+  public:
+    void reset()
+    {
+        producer_ = nullptr;
+        rate_     = 0;
+        previous_ = draw_frame{};
+        current_  = draw_frame{};
+        samples_.clear();
+    }
+
+    draw_frame operator()(frame_producer&          producer,
+                          boost::rational<int>     rate,
+                          const video_format_desc& format_desc,
+                          int                      nb_samples)
+    {
+        if (&producer != producer_ || rate != rate_) {
+            reset();
+            producer_ = &producer;
+            rate_     = rate;
+            phase_    = 1.0;
+            frames_   = 0;
+        }
+
+        for (int n = 0; phase_ >= 1.0 && n < MAX_CLOCK_FRAMES; ++n) {
+            auto frame = producer.receive(native_samples(format_desc));
+            frames_ += 1;
+            if (!frame) {
+                frame = producer.last_frame();
+            }
+
+            audio_collector audio;
+            frame.accept(audio);
+            audio.append_to(samples_);
+
+            previous_ = current_ ? current_ : draw_frame::still(frame);
+            current_  = draw_frame::still(frame);
+            phase_ -= 1.0;
+        }
+        phase_ = std::fmod(phase_, 1.0);
+
+        const auto channels = static_cast<std::size_t>(format_desc.audio_channels);
+        const auto size     = static_cast<std::size_t>(nb_samples) * channels;
+
+        // Drift between the clocks is bounded to a fifth of a second of audio, beyond which the oldest is dropped.
+        const auto capacity = static_cast<std::size_t>(format_desc.audio_sample_rate / 5) * channels + size;
+        if (samples_.size() > capacity) {
+            samples_.erase(samples_.begin(), samples_.begin() + (samples_.size() - capacity));
+        }
+
+        std::vector<std::int32_t> audio(size, 0);
+        const auto                count = std::min(size, samples_.size());
+        std::copy_n(samples_.begin(), count, audio.begin());
+        samples_.erase(samples_.begin(), samples_.begin() + count);
+
+        auto video = current_;
+        if (blend_ && previous_ != current_) {
+            auto next = current_;
+            next.transform().image_transform.opacity *= phase_;
+            video = draw_frame(std::vector<draw_frame>{previous_, std::move(next)});
+        }
+
+        phase_ += boost::rational_cast<double>(rate_ / format_desc.framerate);
+
+        mutable_frame audio_frame(this, {}, array<std::int32_t>(std::move(audio)), pixel_format_desc());
+        return draw_frame(std::vector<draw_frame>{std::move(video), draw_frame(std::move(audio_frame))});
+    }
+
+  private:
+    // The samples of the next native frame, in the cadence of its rate.
+    int native_samples(const video_format_desc& format_desc) const
+    {
+        const auto per_frame = static_cast<std::int64_t>(format_desc.audio_sample_rate) * rate_.denominator();
+        const auto rate      = rate_.numerator();
+        return static_cast<int>((frames_ + 1) * per_frame / rate - frames_ * per_frame / rate);
+    }
+};
+
 struct layer::impl
 {
     monitor::state state_;
@@ -37,8 +203,14 @@ struct layer::impl
     spl::shared_ptr<frame_producer> foreground_ = frame_producer::empty();
     spl::shared_ptr<frame_producer> background_ = frame_producer::empty();
 
+    // Producers that take the background in turn, each with whether it plays automatically.
+    std::deque<std::pair<spl::shared_ptr<frame_producer>, bool>> queue_;
+
     bool auto_play_ = false;
     bool paused_    = false;
+    int  play_wait_ = 0;
+
+    layer_clock clock_;
 
   public:
     void pause() { paused_ = true; }
@@ -47,8 +219,10 @@ struct layer::impl
 
     void load(spl::shared_ptr<frame_producer> producer, bool preview, bool auto_play)
     {
+        queue_.clear();
         background_ = std::move(producer);
         auto_play_  = auto_play;
+        play_wait_  = 0;
 
         if (auto_play_ && foreground_ == frame_producer::empty()) {
             play();
@@ -59,8 +233,33 @@ struct layer::impl
         }
     }
 
+    bool queue(spl::shared_ptr<frame_producer> producer, bool auto_play)
+    {
+        if (background_ == frame_producer::empty()) {
+            load(std::move(producer), false, auto_play);
+            return true;
+        }
+        if (queue_.size() >= MAX_QUEUE_LENGTH) {
+            return false;
+        }
+        queue_.emplace_back(std::move(producer), auto_play);
+        return true;
+    }
+
+    void play(int wait)
+    {
+        if (wait > 0 && background_ != frame_producer::empty() && !background_->ready()) {
+            play_wait_ = wait;
+            return;
+        }
+
+        play();
+    }
+
     void play()
     {
+        play_wait_ = 0;
+
         if (background_ != frame_producer::empty()) {
             if (!paused_) {
                 background_->leading_producer(foreground_);
@@ -72,6 +271,12 @@ struct layer::impl
             background_ = frame_producer::empty();
 
             auto_play_ = false;
+
+            if (!queue_.empty()) {
+                background_ = std::move(queue_.front().first);
+                auto_play_  = queue_.front().second;
+                queue_.pop_front();
+            }
         }
 
         paused_ = false;
@@ -81,11 +286,16 @@ struct layer::impl
     {
         foreground_ = frame_producer::empty();
         auto_play_  = false;
+        play_wait_  = 0;
     }
 
     draw_frame receive(const video_format_desc& format_desc, int nb_samples)
     {
         try {
+            if (play_wait_ > 0 && (background_->ready() || --play_wait_ == 0)) {
+                play();
+            }
+
             if (foreground_->following_producer() != core::frame_producer::empty()) {
                 foreground_ = foreground_->following_producer();
             }
@@ -103,15 +313,26 @@ struct layer::impl
                 }
             }
 
-            auto frame = paused_ ? core::draw_frame{} : foreground_->receive(nb_samples);
-            if (!frame) {
-                frame = foreground_->last_frame();
+            const auto rate = foreground_->frame_rate();
+
+            core::draw_frame frame;
+            if (!paused_ && rate && rate->numerator() > 0 && *rate != format_desc.framerate) {
+                frame = clock_(*foreground_, *rate, format_desc, nb_samples);
+            } else {
+                clock_.reset();
+                frame = paused_ ? core::draw_frame{} : foreground_->receive(nb_samples);
+                if (!frame) {
+                    frame = foreground_->last_frame();
+                }
             }
 
             state_                           = {};
             state_["foreground"]             = foreground_->state();
             state_["foreground"]["producer"] = foreground_->name();
             state_["foreground"]["paused"]   = paused_;
+            if (rate) {
+                state_["foreground"]["frame-rate"] = {rate->numerator(), rate->denominator()};
+            }
 
             if (frames_left > 0) {
                 state_["foreground"]["frames_left"] = frames_left;
@@ -119,6 +340,15 @@ struct layer::impl
 
             state_["background"]             = background_->state();
             state_["background"]["producer"] = background_->name();
+            state_["background"]["ready"]    = background_->ready();
+
+            if (play_wait_ > 0) {
+                state_["background"]["play_wait"] = play_wait_;
+            }
+
+            if (!queue_.empty()) {
+                state_["background"]["queue"] = static_cast<std::int32_t>(queue_.size());
+            }
 
             return frame;
         } catch (...) {
@@ -159,7 +389,11 @@ void layer::load(spl::shared_ptr<frame_producer> frame_producer, bool preview, b
 {
     return impl_->load(std::move(frame_producer), preview, auto_play);
 }
-void       layer::play() { impl_->play(); }
+bool layer::queue(spl::shared_ptr<frame_producer> frame_producer, bool auto_play)
+{
+    return impl_->queue(std::move(frame_producer), auto_play);
+}
+void       layer::play(int wait) { impl_->play(wait); }
 void       layer::pause() { impl_->pause(); }
 void       layer::resume() { impl_->resume(); }
 void       layer::stop() { impl_->stop(); }
@@ -44,7 +44,11 @@ class layer final
     void swap(layer& other);
 
     void load(spl::shared_ptr<frame_producer> producer, bool preview, bool auto_play = false);
-    void play();
+    // Loads the producer unless there is a background already, in which case it waits in line behind it. Returns
+    // false if the queue is full. Load clears the queue.
+    bool queue(spl::shared_ptr<frame_producer> producer, bool auto_play = false);
+    // With wait the swap is held back for up to that many frames until the background is ready.
+    void play(int wait = 0);
     void pause();
     void resume();
     void stop();
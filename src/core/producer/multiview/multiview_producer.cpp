@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "multiview_producer.h"
+
+#include "../color/color_producer.h"
+#include "../route/route_producer.h"
+
+#include <common/future.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/frame_visitor.h>
+#include <core/monitor/monitor.h>
+#include <core/video_channel.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/range/algorithm/find_if.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const double border     = 0.03; // of a tile, left around it for its tally
+const double bar_width  = 0.02; // of a tile, for each audio channel
+const double min_level  = -60.0;
+const double over_level = -1.0;
+const double fall_rate  = 20.0; // dB per second
+
+// The peak of each audio channel of the frames in a tree, in dBFS.
+class peak_visitor : public frame_visitor
+{
+    std::vector<std::int32_t> peaks_;
+
+  public:
+    explicit peak_visitor(int channels)
+        : peaks_(static_cast<std::size_t>(std::max(channels, 0)), 0)
+    {
+    }
+
+    void push(const frame_transform& transform) override {}
+
+    void visit(const const_frame& frame) override
+    {
+        if (peaks_.empty()) {
+            return;
+        }
+
+        const auto& samples = frame.audio_data();
+        for (std::size_t n = 0; n < samples.size(); ++n) {
+            // The magnitude of the most negative sample doesn't fit, it is counted as full scale.
+            auto sample = std::max(samples.data()[n], -std::numeric_limits<std::int32_t>::max());
+            auto& peak  = peaks_[n % peaks_.size()];
+            peak        = std::max(peak, std::abs(sample));
+        }
+    }
+
+    void pop() override {}
+
+    std::vector<double> levels() const
+    {
+        const auto full_scale = static_cast<double>(std::numeric_limits<std::int32_t>::max());
+
+        std::vector<double> levels;
+        for (auto peak : peaks_) {
+            levels.push_back(peak > 0 ? std::max(min_level, 20.0 * std::log10(peak / full_scale)) : min_level);
+        }
+        return levels;
+    }
+};
+
+struct tile
+{
+    std::wstring                          source;
+    spl::shared_ptr<core::frame_producer> route;
+    int                                   divisor        = 1;
+    int                                   audio_channels = 0;
+
+    draw_frame          frame;
+    std::vector<double> levels;
+    draw_frame          tally; // guarded by the mutex of the producer
+};
+
+} // namespace
+
+// Tiles the mixed frames of other channels, which are drawn from their textures as they were rendered and scaled down
+// through mipmaps. A tile can be refreshed at a fraction of the frame rate, in between it shows the same frame, which
+// costs no more than a draw of the tile. Tallies and audio bars are drawn over the tiles.
+class multiview_producer : public frame_producer
+{
+    monitor::state state_;
+
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const double                               fps_;
+    const int                                  columns_;
+    const int                                  rows_;
+    const bool                                 bars_;
+
+    std::vector<tile> tiles_;
+    std::uint64_t     tick_ = 0;
+
+    draw_frame bar_;
+    draw_frame over_bar_;
+
+    mutable std::mutex mutex_;
+
+  public:
+    multiview_producer(const frame_producer_dependencies& dependencies,
+                       std::vector<tile>                  tiles,
+                       int                                columns,
+                       bool                               bars)
+        : frame_factory_(dependencies.frame_factory)
+        , fps_(dependencies.format_desc.fps)
+        , columns_(columns > 0 ? columns : static_cast<int>(std::ceil(std::sqrt(tiles.size()))))
+        , rows_(static_cast<int>((tiles.size() + columns_ - 1) / columns_))
+        , bars_(bars)
+        , tiles_(std::move(tiles))
+        , bar_(create_color_frame(this, frame_factory_, L"GREEN"))
+        , over_bar_(create_color_frame(this, frame_factory_, L"RED"))
+    {
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        const auto fall = fps_ > 0.0 ? fall_rate / fps_ : 0.0;
+
+        std::vector<draw_frame> frames;
+        for (auto n = 0; n < static_cast<int>(tiles_.size()); ++n) {
+            auto& tile = tiles_[n];
+
+            // Every frame is read, so that the route doesn't fall behind, even if only some of them are shown.
+            auto frame = tile.route->receive(nb_samples);
+            if (frame) {
+                peak_visitor visitor(tile.audio_channels);
+                frame.accept(visitor);
+
+                auto levels = visitor.levels();
+                tile.levels.resize(levels.size(), min_level);
+                for (std::size_t c = 0; c < levels.size(); ++c) {
+                    tile.levels[c] = std::max(levels[c], tile.levels[c] - fall);
+                }
+
+                if (!tile.frame || tick_ % tile.divisor == 0) {
+                    tile.frame = frame;
+                }
+            }
+
+            compose(n, tile, frames);
+        }
+        ++tick_;
+
+        state_["tiles"] = static_cast<int>(tiles_.size());
+
+        return draw_frame(std::move(frames));
+    }
+
+    void compose(int index, const tile& tile, std::vector<draw_frame>& frames)
+    {
+        const auto width  = 1.0 / columns_;
+        const auto height = 1.0 / rows_;
+        const auto x      = (index % columns_) * width;
+        const auto y      = (index / columns_) * height;
+
+        auto place = [&](draw_frame frame, double left, double top, double w, double h) {
+            frame_transform transform;
+            transform.image_transform.fill_translation = {x + left * width, y + top * height};
+            transform.image_transform.fill_scale       = {w * width, h * height};
+            transform.audio_transform.volume           = 0.0;
+            frames.push_back(draw_frame::push(std::move(frame), transform));
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (tile.tally) {
+                place(tile.tally, 0.0, 0.0, 1.0, 1.0);
+            }
+        }
+
+        if (tile.frame) {
+            place(tile.frame, border, border, 1.0 - 2.0 * border, 1.0 - 2.0 * border);
+        }
+
+        if (bars_) {
+            const auto bottom = 1.0 - border;
+            for (std::size_t c = 0; c < tile.levels.size(); ++c) {
+                const auto level = tile.levels[c];
+                if (level <= min_level) {
+                    continue;
+                }
+                const auto h = (1.0 - 2.0 * border) * (level - min_level) / -min_level;
+                const auto l = 1.0 - border - (tile.levels.size() - c) * bar_width;
+                place(level > over_level ? over_bar_ : bar_, l, bottom - h, bar_width * 0.8, h);
+            }
+        }
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        // TALLY <tile> <color|OFF>, with tiles counted from 1.
+        if (params.size() < 3 || !boost::iequals(params.at(0), L"TALLY")) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Usage: TALLY <tile> <color|OFF>"));
+        }
+
+        const auto index = std::stoi(params.at(1)) - 1;
+        if (index < 0 || index >= static_cast<int>(tiles_.size())) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No tile " + params.at(1)));
+        }
+
+        auto tally = boost::iequals(params.at(2), L"OFF") ? draw_frame{}
+                                                          : create_color_frame(this, frame_factory_, params.at(2));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        tiles_[index].tally = std::move(tally);
+
+        return make_ready_future(std::wstring());
+    }
+
+    std::wstring print() const override { return L"multiview[" + std::to_wstring(tiles_.size()) + L"]"; }
+
+    std::wstring name() const override { return L"multiview"; }
+
+    core::monitor::state state() const override { return state_; }
+};
+
+spl::shared_ptr<core::frame_producer> create_multiview_producer(const core::frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"[MULTIVIEW]")) {
+        return core::frame_producer::empty();
+    }
+
+    // [MULTIVIEW] <channel>[-<layer>][:<divisor>]... [COLUMNS <count>] [NO_BARS]
+    static boost::wregex expr(L"(?<CHANNEL>\\d+)(-(?<LAYER>\\d+))?(:(?<DIVISOR>\\d+))?");
+
+    std::vector<tile> tiles;
+    for (auto it = params.begin() + 1; it != params.end(); ++it) {
+        boost::wsmatch what;
+        if (!boost::regex_match(*it, what, expr)) {
+            break;
+        }
+
+        auto channel    = std::stoi(what["CHANNEL"].str());
+        auto channel_it = boost::find_if(
+            dependencies.channels, [=](spl::shared_ptr<core::video_channel> ch) { return ch->index() == channel; });
+        if (channel_it == dependencies.channels.end()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channel with id " + std::to_wstring(channel)));
+        }
+
+        auto source = L"route://" + what["CHANNEL"].str();
+        if (what["LAYER"].matched) {
+            source += L"-" + what["LAYER"].str();
+        }
+
+        tile entry{source, create_route_producer(dependencies, {source, L"MIXED"})};
+        entry.divisor        = what["DIVISOR"].matched ? std::max(1, std::stoi(what["DIVISOR"].str())) : 1;
+        entry.audio_channels = (*channel_it)->video_format_desc().audio_channels;
+        tiles.push_back(std::move(entry));
+    }
+
+    if (tiles.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"A multiview needs at least one channel"));
+    }
+
+    return spl::make_shared<multiview_producer>(
+        dependencies, std::move(tiles), get_param(L"COLUMNS", params, 0), !contains_param(L"NO_BARS", params));
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "playlist_producer.h"
+
+#include "../transition/transition_producer.h"
+
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <limits>
+#include <utility>
+
+namespace caspar { namespace core {
+
+namespace {
+
+struct playlist_item
+{
+    std::wstring    params;
+    transition_info transition; // from the item before
+};
+
+// Keeps the items after the current one open, so that each has buffered its first frames by the time that it plays.
+// The items are opened one at a time on a loader thread of the playlist, which bounds what it decodes ahead to
+// preload items. An item is cut or transitioned to on the exact frame that its predecessor ends on, less the
+// duration of its transition.
+class playlist_producer : public frame_producer
+{
+    const frame_producer_dependencies dependencies_;
+    const std::vector<playlist_item>  items_;
+    const std::size_t                 preload_;
+    const bool                        loop_;
+
+    spl::shared_ptr<frame_producer> current_ = frame_producer::empty();
+    std::size_t                     index_   = 0;
+
+    std::deque<std::pair<std::size_t, std::shared_future<spl::shared_ptr<frame_producer>>>> preloaded_;
+
+    bool           next_requested_ = false;
+    std::int64_t   underflows_     = 0;
+    monitor::state state_;
+
+    executor loader_{L"playlist loader"};
+
+  public:
+    playlist_producer(const frame_producer_dependencies& dependencies,
+                      std::vector<playlist_item>         items,
+                      std::size_t                        preload,
+                      bool                               loop)
+        : dependencies_(dependencies)
+        , items_(std::move(items))
+        , preload_(preload)
+        , loop_(loop)
+    {
+        current_ = create_transition_producer(create_item(dependencies_, items_[0].params), items_[0].transition);
+        preload_items();
+        update_state();
+    }
+
+    static spl::shared_ptr<frame_producer> create_item(const frame_producer_dependencies& dependencies,
+                                                       const std::wstring&                params)
+    {
+        return create_destroy_proxy(dependencies.producer_registry->create_producer(dependencies, params));
+    }
+
+    void preload_items()
+    {
+        auto next = (preloaded_.empty() ? index_ : preloaded_.back().first) + 1;
+        while (preloaded_.size() < preload_) {
+            if (next >= items_.size()) {
+                if (!loop_) {
+                    break;
+                }
+                next = 0;
+            }
+
+            auto dependencies = dependencies_;
+            auto params       = items_[next].params;
+            preloaded_.emplace_back(
+                next, loader_.begin_invoke([=] { return create_item(dependencies, params); }).share());
+            next += 1;
+        }
+    }
+
+    // Plays the first preloaded item, waiting for it to open if it hasn't yet, which counts as an underflow.
+    void advance()
+    {
+        // Items that fail to open are skipped, once each.
+        for (std::size_t tries = 0; tries < items_.size() && !preloaded_.empty(); ++tries) {
+            auto index  = preloaded_.front().first;
+            auto future = std::move(preloaded_.front().second);
+            preloaded_.pop_front();
+
+            if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++underflows_;
+                CASPAR_LOG(warning) << print() << L" Item " << index + 1 << L" wasn't open in time.";
+            }
+
+            try {
+                auto producer = future.get();
+                if (!producer->ready()) {
+                    ++underflows_;
+                    CASPAR_LOG(warning) << print() << L" Item " << index + 1 << L" wasn't buffered in time.";
+                }
+
+                auto transition = create_transition_producer(producer, items_[index].transition);
+                transition->leading_producer(current_);
+                current_ = std::move(transition);
+                index_   = index;
+                preload_items();
+                return;
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(warning) << print() << L" Skipping item " << index + 1 << L".";
+                index_ = index;
+                preload_items();
+            }
+        }
+    }
+
+    // The frames that are left of the producer, or -1 if its length isn't known.
+    static std::int64_t frames_left(const spl::shared_ptr<frame_producer>& producer)
+    {
+        if (producer->nb_frames() == std::numeric_limits<uint32_t>::max()) {
+            return -1;
+        }
+        return std::max<std::int64_t>(0, static_cast<std::int64_t>(producer->nb_frames()) - producer->frame_number());
+    }
+
+    void update_state()
+    {
+        state_ = current_->state();
+
+        // What is buffered to play without another item having to open, to the first item of unknown length.
+        std::int64_t buffered  = frames_left(current_);
+        int          preloaded = 0;
+        for (auto& entry : preloaded_) {
+            if (entry.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                break;
+            }
+            try {
+                auto& producer = entry.second.get();
+                if (!producer->ready()) {
+                    break;
+                }
+                preloaded += 1;
+                if (buffered >= 0) {
+                    buffered = frames_left(producer) < 0 ? -1 : buffered + frames_left(producer);
+                }
+            } catch (...) {
+                break;
+            }
+        }
+
+        state_["playlist/index"]      = static_cast<std::int64_t>(index_ + 1);
+        state_["playlist/count"]      = static_cast<std::int64_t>(items_.size());
+        state_["playlist/preloaded"]  = preloaded;
+        state_["playlist/underflows"] = underflows_;
+        if (buffered >= 0) {
+            state_["playlist/buffered"] = buffered;
+        }
+    }
+
+    // frame_producer
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        if (current_->following_producer() != frame_producer::empty()) {
+            current_ = current_->following_producer();
+        }
+
+        if (!preloaded_.empty()) {
+            const auto left = frames_left(current_);
+            const auto next = items_[preloaded_.front().first].transition.duration;
+            if (next_requested_ || (left >= 0 && left - next < 1)) {
+                advance();
+            }
+        }
+        next_requested_ = false;
+
+        auto frame = current_->receive(nb_samples);
+
+        update_state();
+
+        return frame;
+    }
+
+    draw_frame last_frame() override { return current_->last_frame(); }
+
+    draw_frame first_frame() override { return current_->first_frame(); }
+
+    // Before the first frame, the playlist transitions from the producer to its first item.
+    void leading_producer(const spl::shared_ptr<frame_producer>& producer) override
+    {
+        current_->leading_producer(producer);
+    }
+
+    uint32_t nb_frames() const override
+    {
+        const auto left = frames_left(current_);
+        if (!preloaded_.empty() || left < 0) {
+            return std::numeric_limits<uint32_t>::max();
+        }
+        return frame_number() + static_cast<uint32_t>(left);
+    }
+
+    bool ready() const override { return current_->ready(); }
+
+    boost::optional<boost::rational<int>> frame_rate() const override { return current_->frame_rate(); }
+
+    // NEXT plays the next item with its transition, other calls go to the item that plays.
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        if (!params.empty() && boost::iequals(params.at(0), L"NEXT")) {
+            next_requested_ = true;
+            return make_ready_future(std::wstring());
+        }
+        return current_->call(params);
+    }
+
+    std::wstring print() const override
+    {
+        return L"playlist[" + std::to_wstring(index_ + 1) + L"/" + std::to_wstring(items_.size()) + L"|" +
+               current_->print() + L"]";
+    }
+
+    std::wstring name() const override { return L"playlist"; }
+
+    monitor::state state() const override { return state_; }
+};
+
+bool is_transition(const std::wstring& token)
+{
+    static const boost::wregex expr(L"CUT|MIX|PUSH|SLIDE|WIPE", boost::regex::icase);
+    return boost::regex_match(token, expr);
+}
+
+bool is_transition_option(const std::wstring& token)
+{
+    static const boost::wregex expr(L"LINEAR|EASE\\w*|FROMLEFT|FROMRIGHT|LEFT|RIGHT", boost::regex::icase);
+    return boost::regex_match(token, expr);
+}
+
+bool is_number(const std::wstring& token)
+{
+    return !token.empty() && std::all_of(token.begin(), token.end(), [](wchar_t c) { return c >= L'0' && c <= L'9'; });
+}
+
+} // namespace
+
+spl::shared_ptr<core::frame_producer> create_playlist_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"[PLAYLIST]")) {
+        return core::frame_producer::empty();
+    }
+
+    std::vector<playlist_item> items;
+    transition_info            transition;
+    std::size_t                preload = 2;
+    bool                       loop    = false;
+
+    for (std::size_t n = 1; n < params.size(); ++n) {
+        const auto& token = params.at(n);
+
+        if (boost::iequals(token, L"PRELOAD") && n + 1 < params.size() && is_number(params.at(n + 1))) {
+            preload = std::max<std::size_t>(1, std::stoul(params.at(++n)));
+        } else if (boost::iequals(token, L"LOOP")) {
+            loop = true;
+        } else if (is_transition(token) && n + 1 < params.size() && is_number(params.at(n + 1))) {
+            auto message = boost::to_upper_copy(token) + L" " + params.at(++n);
+            while (n + 1 < params.size() && is_transition_option(params.at(n + 1))) {
+                message += L" " + boost::to_upper_copy(params.at(++n));
+            }
+            if (!try_match_transition(message, transition)) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid playlist transition: " + message));
+            }
+        } else {
+            items.push_back({token, transition});
+            transition = transition_info{};
+        }
+    }
+
+    if (items.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"A playlist needs at least one item"));
+    }
+
+    return spl::make_shared<playlist_producer>(dependencies, std::move(items), preload, loop);
+}
+
+}} // namespace caspar::core
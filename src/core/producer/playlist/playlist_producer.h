@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/producer/frame_producer.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// [PLAYLIST] <item> [<transition>] <item>... [PRELOAD <count>] [LOOP], where each item is the parameters of a
+// producer, quoted if there are several, and a transition, e.g. MIX 10, applies to the item that follows it.
+spl::shared_ptr<core::frame_producer> create_playlist_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params);
+
+}} // namespace caspar::core
@@ -31,9 +31,8 @@
 
 #include <boost/range/algorithm/find_if.hpp>
 #include <boost/regex.hpp>
-#include <boost/signals2.hpp>
 
-#include <tbb/concurrent_queue.h>
+#include <cstdint>
 
 namespace caspar { namespace core {
 
@@ -41,36 +40,23 @@ class route_producer : public frame_producer
 {
     spl::shared_ptr<diagnostics::graph> graph_;
 
-    tbb::concurrent_bounded_queue<core::draw_frame> buffer_;
-
-    caspar::timer produce_timer_;
     caspar::timer consume_timer_;
 
-    std::shared_ptr<route>             route_;
-    boost::signals2::scoped_connection connection_;
+    std::shared_ptr<route> route_;
+    const int              depth_;
+    std::uint64_t          position_;
 
     core::draw_frame frame_;
 
   public:
     route_producer(std::shared_ptr<route> route, int buffer)
         : route_(route)
-        , connection_(route_->signal.connect([this](const core::draw_frame& frame) {
-            auto frame2 = frame;
-            if (!frame2) {
-                // We got a frame, so ensure it is a real frame (otherwise the layer gets confused)
-                frame2 = core::draw_frame::push(frame2);
-            }
-            if (!buffer_.try_push(frame2)) {
-                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-            }
-            graph_->set_value("produce-time", produce_timer_.elapsed() * route_->format_desc.fps * 0.5);
-            produce_timer_.restart();
-        }))
+        , depth_(buffer > 0 ? buffer : route->format_desc.field_count)
+        , position_(route->head())
     {
-        buffer_.set_capacity(buffer > 0 ? buffer : route->format_desc.field_count);
+        route_->reserve(depth_);
 
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
-        graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_text(print());
@@ -79,10 +65,26 @@ class route_producer : public frame_producer
         CASPAR_LOG(debug) << print() << L" Initialized";
     }
 
+    bool read(core::draw_frame& frame)
+    {
+        const auto position = position_;
+        if (!route_->read(position_, depth_, frame)) {
+            return false;
+        }
+        if (position_ - 1 != position) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+        if (!frame) {
+            // We got a frame, so ensure it is a real frame (otherwise the layer gets confused)
+            frame = core::draw_frame::push(frame);
+        }
+        return true;
+    }
+
     draw_frame last_frame() override
     {
         if (!frame_) {
-            buffer_.try_pop(frame_);
+            read(frame_);
         }
         return core::draw_frame::still(frame_);
     }
@@ -90,7 +92,7 @@ class route_producer : public frame_producer
     draw_frame receive_impl(int nb_samples) override
     {
         core::draw_frame frame;
-        if (!buffer_.try_pop(frame)) {
+        if (!read(frame)) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
         } else {
             frame_ = frame;
@@ -119,19 +121,24 @@ spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_pr
     auto channel = std::stoi(what["CHANNEL"].str());
     auto layer   = what["LAYER"].matched ? std::stoi(what["LAYER"].str()) : -1;
 
+    auto channel_it = boost::find_if(dependencies.channels,
+                                     [=](spl::shared_ptr<core::video_channel> ch) { return ch->index() == channel; });
+
+    if (channel_it == dependencies.channels.end()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channel with id " + std::to_wstring(channel)));
+    }
+
     auto mode = core::route_mode::foreground;
     if (layer >= 0) {
         if (contains_param(L"BACKGROUND", params))
             mode = core::route_mode::background;
         else if (contains_param(L"NEXT", params))
             mode = core::route_mode::next;
-    }
-
-    auto channel_it = boost::find_if(dependencies.channels,
-                                     [=](spl::shared_ptr<core::video_channel> ch) { return ch->index() == channel; });
-
-    if (channel_it == dependencies.channels.end()) {
-        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channel with id " + std::to_wstring(channel)));
+    } else if (contains_param(L"MIXED", params) ||
+               (!contains_param(L"COMPOSE", params) &&
+                (*channel_it)->video_format_desc() == dependencies.format_desc)) {
+        // A channel of the same format is shown as it was rendered, instead of being composited again from its layers.
+        mode = core::route_mode::mixed;
     }
 
     auto buffer = get_param(L"BUFFER", params, 0);
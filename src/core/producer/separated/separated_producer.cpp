@@ -106,6 +106,10 @@ class separated_producer : public frame_producer
 
     std::wstring name() const override { return L"separated"; }
 
+    bool ready() const override { return fill_producer_->ready() && key_producer_->ready(); }
+
+    bool has_key() const override { return true; }
+
     core::monitor::state state() const override { return state_; }
 };
 
@@ -25,76 +25,470 @@
 
 #include "layer.h"
 
+#include "../diagnostics/call_context.h"
+#include "../diagnostics/trace.h"
 #include "../frame/draw_frame.h"
 
 #include <common/diagnostics/graph.h>
 #include <common/executor.h>
 #include <common/future.h>
+#include <common/os/thread.h>
 
+#include <core/channel_arena.h>
 #include <core/frame/frame_transform.h>
 
 #include <boost/range/adaptors.hpp>
 
+#include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <future>
+#include <limits>
 #include <map>
 #include <vector>
 
 namespace caspar { namespace core {
 
+namespace {
+
+// Ticks over the frame budget before one more layer is degraded, and ticks well under it before one is restored.
+const int    DEGRADE_TICKS    = 5;
+const int    RESTORE_TICKS    = 100;
+const double RESTORE_FRACTION = 0.75;
+
+// Without the passes of the mixer that are expensive per pixel, i.e. blending, chroma keying and levels.
+frame_transform simplified(frame_transform transform)
+{
+    transform.image_transform.blend_mode = blend_mode::normal;
+    transform.image_transform.chroma     = core::chroma{};
+    transform.image_transform.levels     = core::levels{};
+    return transform;
+}
+
+} // namespace
+
 struct stage::impl : public std::enable_shared_from_this<impl>
 {
-    int                                 channel_index_;
-    spl::shared_ptr<diagnostics::graph> graph_;
-    monitor::state                      state_;
-    std::map<int, layer>                layers_;
-    std::map<int, tweened_transform>    tweens_;
+    int                                         channel_index_;
+    spl::shared_ptr<caspar::diagnostics::graph> graph_;
+    std::shared_ptr<const monitor::state>       state_ = std::make_shared<const monitor::state>();
+    const bool                                  parallel_layers_;
+    const double                                layer_deadline_;
+    const double                                frame_budget_;
+
+    // Sorted vectors by index, so that the tick walks contiguous memory however sparse the indices are. Layers and
+    // tweens are only inserted by commands and are moved when they are, so references don't outlive one.
+    boost::container::flat_map<int, layer>             layers_;
+    boost::container::flat_map<int, tweened_transform> tweens_;
+
+    // The layers that routes fetch the background of, sorted once per tick.
+    std::vector<int> fetch_background_;
+
+    struct layer_task
+    {
+        int             index;
+        core::layer*    layer;
+        frame_transform transform;
+        bool            fetch_background;
+        bool            hold;
+        draw_frame      held;
+        layer_frame     result;
+    };
+
+    std::vector<layer_task> tasks_;
+
+    // Transforms are queued and applied together, by the next tick or by one task for all of those that arrived
+    // since the last one, instead of by a task each. apply_transform tweens from the current transform and
+    // apply_transforms from the destination of the running tween.
+    struct pending_transforms
+    {
+        std::vector<stage::transform_tuple_t> transforms;
+        bool                                  from_current;
+        std::shared_ptr<std::promise<void>>   applied;
+    };
+
+    tbb::concurrent_queue<pending_transforms> pending_transforms_;
+    std::atomic<bool>                         apply_posted_{false};
 
-    executor executor_{L"stage " + std::to_wstring(channel_index_)};
+    // A layer whose receive missed its deadline, held by the task until it returns. Its last frame stands in for it.
+    struct stalled_layer
+    {
+        std::shared_ptr<core::layer>    layer;
+        std::shared_future<layer_frame> result;
+        draw_frame                      last_frame;
+    };
+
+    std::map<int, stalled_layer> stalled_;
+    std::map<int, draw_frame>    last_frames_;
+    std::int64_t                 late_layers_ = 0;
+
+    // While the channel is over its frame budget, layers are degraded one step at a time in order of priority, and
+    // restored in the reverse order once it is well under it again. Layers of the highest priority on the channel are
+    // never degraded. At level 1 a layer is drawn without blend modes, chroma keys and levels, at level 2 its producer
+    // is also only received every other tick and its previous frame is held, muted, in between.
+    std::map<int, int>        priorities_;
+    std::map<int, int>        degradation_;
+    std::map<int, draw_frame> held_frames_;
+    std::atomic<double>       load_{0.0};
+    int                       degradation_steps_ = 0;
+    int                       over_ticks_        = 0;
+    int                       under_ticks_       = 0;
+    std::uint64_t             tick_count_        = 0;
+
+    // A channel that is pinned to cpus gets a stage thread of its own, bound to them.
+    const bool pinned_ = !get_channel_cpus(channel_index_).empty();
+
+    executor executor_{L"stage " + std::to_wstring(channel_index_), !pinned_};
 
   public:
-    impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph)
+    impl(int                                         channel_index,
+         spl::shared_ptr<caspar::diagnostics::graph> graph,
+         bool                                        parallel_layers,
+         double                                      layer_deadline,
+         double                                      frame_budget)
         : channel_index_(channel_index)
         , graph_(std::move(graph))
+        , parallel_layers_(parallel_layers)
+        , layer_deadline_(layer_deadline)
+        , frame_budget_(frame_budget)
+    {
+        if (pinned_) {
+            executor_.begin_invoke([this] { bind_thread_to_channel(channel_index_); });
+        }
+        if (layer_deadline_ > 0.0) {
+            graph_->set_color("late-layer", caspar::diagnostics::color(0.9f, 0.3f, 0.6f));
+        }
+        if (frame_budget_ > 0.0) {
+            graph_->set_color("degraded-layer", caspar::diagnostics::color(0.9f, 0.6f, 0.2f));
+        }
+    }
+
+    int degradation(int index) const
+    {
+        auto it = degradation_.find(index);
+        return it == degradation_.end() ? 0 : it->second;
+    }
+
+    // The transform of the layer, without the expensive passes if it is degraded.
+    frame_transform fetch_transform(int index)
+    {
+        auto transform = tweens_[index].fetch();
+        return degradation(index) > 0 ? simplified(transform) : transform;
+    }
+
+    // Whether the layer holds its previous frame instead of being received this tick.
+    bool holds(int index) const
     {
+        return tick_count_ % 2 == 1 && degradation(index) > 1 && held_frames_.find(index) != held_frames_.end();
+    }
+
+    layer_frame held_frame(int index)
+    {
+        layer_frame result    = {};
+        result.foreground     = draw_frame::push(draw_frame::still(held_frames_[index]), fetch_transform(index));
+        result.has_background = layers_.find(index)->second.has_background();
+        return result;
+    }
+
+    // Steps the degradation of the layers by the load of the last tick, that the channel reports.
+    void update_degradation()
+    {
+        if (frame_budget_ <= 0.0) {
+            return;
+        }
+
+        const auto load = load_.load();
+        if (load > frame_budget_) {
+            under_ticks_ = 0;
+            if (++over_ticks_ >= DEGRADE_TICKS) {
+                over_ticks_ = 0;
+                degradation_steps_ += 1;
+            }
+        } else if (load < frame_budget_ * RESTORE_FRACTION && degradation_steps_ > 0) {
+            over_ticks_ = 0;
+            if (++under_ticks_ >= RESTORE_TICKS) {
+                under_ticks_ = 0;
+                degradation_steps_ -= 1;
+            }
+        } else {
+            over_ticks_  = 0;
+            under_ticks_ = 0;
+        }
+
+        // The layers that may be degraded, lowest priority first and then bottom up.
+        std::vector<std::pair<int, int>> candidates;
+        auto                             highest = std::numeric_limits<int>::min();
+        for (auto& p : layers_) {
+            auto it       = priorities_.find(p.first);
+            auto priority = it == priorities_.end() ? 0 : it->second;
+            highest       = std::max(highest, priority);
+            candidates.emplace_back(priority, p.first);
+        }
+        candidates.erase(std::remove_if(candidates.begin(),
+                                        candidates.end(),
+                                        [&](const std::pair<int, int>& c) { return c.first == highest; }),
+                         candidates.end());
+        std::sort(candidates.begin(), candidates.end());
+
+        const auto count   = static_cast<int>(candidates.size());
+        degradation_steps_ = std::min(degradation_steps_, count * 2);
+
+        std::map<int, int> levels;
+        for (int n = 0; n < count; ++n) {
+            const auto level = (degradation_steps_ > n ? 1 : 0) + (degradation_steps_ > count + n ? 1 : 0);
+            if (level > 0) {
+                levels[candidates[n].second] = level;
+            }
+        }
+
+        for (auto& p : layers_) {
+            const auto before = degradation(p.first);
+            auto       it     = levels.find(p.first);
+            const auto after  = it == levels.end() ? 0 : it->second;
+            if (after > before) {
+                graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "degraded-layer");
+                CASPAR_LOG(warning) << L"[stage] Layer " << channel_index_ << L"-" << p.first << L" degraded to level "
+                                    << after << L", the channel is at " << static_cast<int>(load * 100.0)
+                                    << L"% of its frame budget.";
+            } else if (after < before) {
+                CASPAR_LOG(info) << L"[stage] Layer " << channel_index_ << L"-" << p.first << L" restored to level "
+                                 << after << L".";
+            }
+            if (after < 2) {
+                held_frames_.erase(p.first);
+            }
+        }
+
+        degradation_ = std::move(levels);
     }
 
-    std::map<int, layer_frame>
-    operator()(const video_format_desc& format_desc, int nb_samples, std::vector<int>& fetch_background)
+    // Receives every layer on a worker of the channel arena and waits until layer_deadline frames since the start of
+    // the tick. Layers that are later than that are taken out of the stage until their receive returns, so that a
+    // producer that hangs only freezes its own layer.
+    void receive_with_deadline(const video_format_desc&                 format_desc,
+                               int                                      nb_samples,
+                               const std::function<bool(int)>&          has_background,
+                               layer_frames&                            frames,
+                               std::chrono::steady_clock::time_point    start)
     {
-        return executor_.invoke([=] {
-            std::map<int, layer_frame> frames;
+        const auto deadline =
+            start + std::chrono::microseconds(static_cast<std::int64_t>(
+                        layer_deadline_ * 1e6 * format_desc.duration / format_desc.time_scale));
+
+        // Layers that returned since they stalled get their place back, unless another one was loaded there.
+        for (auto it = stalled_.begin(); it != stalled_.end();) {
+            if (it->second.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++it;
+                continue;
+            }
+            if (layers_.find(it->first) == layers_.end()) {
+                CASPAR_LOG(info) << L"[stage] Layer " << channel_index_ << L"-" << it->first << L" recovered.";
+                layers_.emplace(it->first, std::move(*it->second.layer));
+            }
+            it = stalled_.erase(it);
+        }
+
+        struct pending
+        {
+            int                             index;
+            std::shared_ptr<core::layer>    layer;
+            std::shared_future<layer_frame> result;
+            frame_transform                 transform;
+        };
+
+        std::vector<pending> tasks;
+        for (auto& p : layers_) {
+            if (!has_background(p.first) && holds(p.first)) {
+                frames.emplace(p.first, held_frame(p.first));
+                continue;
+            }
+
+            auto layer      = std::make_shared<core::layer>(std::move(p.second));
+            auto promise    = std::make_shared<std::promise<layer_frame>>();
+            auto background = has_background(p.first);
+            auto index      = p.first;
+            tasks.push_back({index, layer, promise->get_future().share(), fetch_transform(index)});
+
+            enqueue_in_channel_arena(channel_index_, [=] {
+                try {
+                    CASPAR_TRACE_SCOPE("layer::receive", channel_index_, index);
+                    diagnostics::scoped_call_context context(channel_index_, index);
+                    layer_frame result    = {};
+                    result.foreground     = layer->receive(format_desc, nb_samples);
+                    result.has_background = layer->has_background();
+                    if (background) {
+                        result.background = layer->receive_background(format_desc, nb_samples);
+                    }
+                    promise->set_value(std::move(result));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        }
+
+        for (auto& task : tasks) {
+            if (task.result.wait_until(deadline) == std::future_status::ready) {
+                auto result = task.result.get();
+                last_frames_[task.index] = result.foreground;
+                if (degradation(task.index) > 1) {
+                    held_frames_[task.index] = result.foreground;
+                }
+                result.foreground        = draw_frame::push(std::move(result.foreground), task.transform);
+                frames.emplace_hint(frames.end(), task.index, std::move(result));
+                layers_[task.index] = std::move(*task.layer);
+            } else {
+                ++late_layers_;
+                graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "late-layer");
+                CASPAR_LOG(warning) << L"[stage] Layer " << channel_index_ << L"-" << task.index
+                                    << L" missed its deadline, showing its last frame until it returns.";
+                stalled_[task.index] = {std::move(task.layer), std::move(task.result), last_frames_[task.index]};
+                layers_.erase(task.index);
+            }
+        }
+
+        for (auto& p : stalled_) {
+            if (layers_.find(p.first) == layers_.end()) {
+                layer_frame res = {};
+                res.foreground  = draw_frame::push(p.second.last_frame, fetch_transform(p.first));
+                frames.emplace(p.first, std::move(res));
+            }
+        }
+
+        for (auto it = last_frames_.begin(); it != last_frames_.end();) {
+            if (layers_.find(it->first) == layers_.end() && stalled_.find(it->first) == stalled_.end()) {
+                it = last_frames_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Fills frames, which is reused by the caller from tick to tick.
+    void operator()(const video_format_desc& format_desc,
+                    int                      nb_samples,
+                    const std::vector<int>&  fetch_background,
+                    layer_frames&            frames)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        auto tick = [&] {
+            frames.clear();
 
             try {
+                apply_pending_transforms();
+
                 for (auto& t : tweens_)
                     t.second.tick(1);
 
-                for (auto& p : layers_) {
-                    auto& layer = p.second;
-                    auto& tween = tweens_[p.first];
-
-                    layer_frame res    = {};
-                    res.foreground     = draw_frame::push(layer.receive(format_desc, nb_samples), tween.fetch());
-                    res.has_background = layer.has_background();
-                    if (std::find(fetch_background.begin(), fetch_background.end(), p.first) !=
-                        fetch_background.end()) {
-                        res.background = layer.receive_background(format_desc, nb_samples);
+                tick_count_ += 1;
+                update_degradation();
+
+                fetch_background_.assign(fetch_background.begin(), fetch_background.end());
+                std::sort(fetch_background_.begin(), fetch_background_.end());
+
+                const auto has_background = [&](int index) {
+                    return !fetch_background_.empty() &&
+                           std::binary_search(fetch_background_.begin(), fetch_background_.end(), index);
+                };
+
+                if (layer_deadline_ > 0.0) {
+                    receive_with_deadline(format_desc, nb_samples, has_background, frames, start);
+                } else if (parallel_layers_ && layers_.size() > 1) {
+                    // Fetch tweens up front so that the shared tweens_ map is only touched from the stage thread.
+                    tasks_.clear();
+                    for (auto& p : layers_) {
+                        layer_task task       = {};
+                        task.index            = p.first;
+                        task.layer            = &p.second;
+                        task.transform        = fetch_transform(p.first);
+                        task.fetch_background = has_background(p.first);
+                        task.hold             = degradation(p.first) > 1;
+                        if (!task.fetch_background && holds(p.first)) {
+                            frames.emplace(p.first, held_frame(p.first));
+                            continue;
+                        }
+                        tasks_.push_back(std::move(task));
+                    }
+
+                    execute_in_channel_arena(channel_index_, [&] {
+                        tbb::parallel_for(std::size_t(0), tasks_.size(), [&](std::size_t n) {
+                            auto& task = tasks_[n];
+                            CASPAR_TRACE_SCOPE("layer::receive", channel_index_, task.index);
+                            diagnostics::scoped_call_context context(channel_index_, task.index);
+                            auto frame = task.layer->receive(format_desc, nb_samples);
+                            if (task.hold) {
+                                task.held = frame;
+                            }
+                            task.result.foreground     = draw_frame::push(std::move(frame), task.transform);
+                            task.result.has_background = task.layer->has_background();
+                            if (task.fetch_background) {
+                                task.result.background = task.layer->receive_background(format_desc, nb_samples);
+                            }
+                        });
+                    });
+
+                    for (auto& task : tasks_) {
+                        if (task.hold) {
+                            held_frames_[task.index] = std::move(task.held);
+                        }
+                        frames.emplace(task.index, std::move(task.result));
+                    }
+                    tasks_.clear();
+                } else {
+                    for (auto& p : layers_) {
+                        if (!has_background(p.first) && holds(p.first)) {
+                            frames.emplace_hint(frames.end(), p.first, held_frame(p.first));
+                            continue;
+                        }
+
+                        auto& layer = p.second;
+                        CASPAR_TRACE_SCOPE("layer::receive", channel_index_, p.first);
+                        diagnostics::scoped_call_context context(channel_index_, p.first);
+
+                        auto frame = layer.receive(format_desc, nb_samples);
+                        if (degradation(p.first) > 1) {
+                            held_frames_[p.first] = frame;
+                        }
+
+                        layer_frame res    = {};
+                        res.foreground     = draw_frame::push(std::move(frame), fetch_transform(p.first));
+                        res.has_background = layer.has_background();
+                        if (has_background(p.first)) {
+                            res.background = layer.receive_background(format_desc, nb_samples);
+                        }
+                        frames.emplace_hint(frames.end(), p.first, std::move(res));
                     }
-                    frames[p.first] = res;
                 }
 
                 monitor::state state;
                 for (auto& p : layers_) {
                     state["layer"][p.first] = p.second.state();
                 }
-                state_ = std::move(state);
+                for (auto& p : stalled_) {
+                    state["layer"][p.first]["stalled"] = true;
+                }
+                if (layer_deadline_ > 0.0) {
+                    state["late-layers"] = late_layers_;
+                }
+                if (frame_budget_ > 0.0) {
+                    for (auto& p : layers_) {
+                        state["layer"][p.first]["degradation"] = degradation(p.first);
+                    }
+                    state["load"] = load_.load();
+                }
+                std::atomic_store(&state_, std::make_shared<const monitor::state>(std::move(state)));
             } catch (...) {
                 layers_.clear();
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
+        };
 
-            return frames;
-        });
+        // The tick runs ahead of commands that are already queued.
+        executor_.invoke(tick, task_priority::high);
     }
 
     layer& get_layer(int index)
@@ -106,18 +500,41 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         return it->second;
     }
 
-    std::future<void>
-    apply_transforms(const std::vector<std::tuple<int, stage::transform_func_t, unsigned int, tweener>>& transforms)
+    std::future<void> queue_transforms(std::vector<stage::transform_tuple_t> transforms, bool from_current)
     {
-        return executor_.begin_invoke([=] {
-            for (auto& transform : transforms) {
-                auto& tween = tweens_[std::get<0>(transform)];
-                auto  src   = tween.fetch();
-                auto  dst   = std::get<1>(transform)(tween.dest());
-                tweens_[std::get<0>(transform)] =
-                    tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
+        auto applied = std::make_shared<std::promise<void>>();
+        auto future  = applied->get_future();
+        pending_transforms_.push({std::move(transforms), from_current, std::move(applied)});
+
+        if (!apply_posted_.exchange(true)) {
+            executor_.begin_invoke([=] { apply_pending_transforms(); });
+        }
+        return future;
+    }
+
+    void apply_pending_transforms()
+    {
+        apply_posted_ = false;
+
+        pending_transforms pending;
+        while (pending_transforms_.try_pop(pending)) {
+            try {
+                for (auto& transform : pending.transforms) {
+                    auto& tween = tweens_[std::get<0>(transform)];
+                    auto  src   = tween.fetch();
+                    auto  dst   = std::get<1>(transform)(pending.from_current ? src : tween.dest());
+                    tween       = tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
+                }
+                pending.applied->set_value();
+            } catch (...) {
+                pending.applied->set_exception(std::current_exception());
             }
-        });
+        }
+    }
+
+    std::future<void> apply_transforms(const std::vector<stage::transform_tuple_t>& transforms)
+    {
+        return queue_transforms(transforms, false);
     }
 
     std::future<void> apply_transform(int                            index,
@@ -125,26 +542,31 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                       unsigned int                   mix_duration,
                                       const tweener&                 tween)
     {
-        return executor_.begin_invoke([=] {
-            auto src       = tweens_[index].fetch();
-            auto dst       = transform(src);
-            tweens_[index] = tweened_transform(src, dst, mix_duration, tween);
-        });
+        return queue_transforms({stage::transform_tuple_t(index, transform, mix_duration, tween)}, true);
     }
 
     std::future<void> clear_transforms(int index)
     {
-        return executor_.begin_invoke([=] { tweens_.erase(index); });
+        return executor_.begin_invoke([=] {
+            apply_pending_transforms();
+            tweens_.erase(index);
+        });
     }
 
     std::future<void> clear_transforms()
     {
-        return executor_.begin_invoke([=] { tweens_.clear(); });
+        return executor_.begin_invoke([=] {
+            apply_pending_transforms();
+            tweens_.clear();
+        });
     }
 
     std::future<frame_transform> get_current_transform(int index)
     {
-        return executor_.begin_invoke([=] { return tweens_[index].fetch(); });
+        return executor_.begin_invoke([=] {
+            apply_pending_transforms();
+            return tweens_[index].fetch();
+        });
     }
 
     std::future<void> load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
@@ -152,6 +574,11 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         return executor_.begin_invoke([=] { get_layer(index).load(producer, preview, auto_play); });
     }
 
+    std::future<bool> queue(int index, const spl::shared_ptr<frame_producer>& producer, bool auto_play)
+    {
+        return executor_.begin_invoke([=] { return get_layer(index).queue(producer, auto_play); });
+    }
+
     std::future<void> pause(int index)
     {
         return executor_.begin_invoke([=] { get_layer(index).pause(); });
@@ -162,9 +589,9 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         return executor_.begin_invoke([=] { get_layer(index).resume(); });
     }
 
-    std::future<void> play(int index)
+    std::future<void> play(int index, int wait)
     {
-        return executor_.begin_invoke([=] { get_layer(index).play(); });
+        return executor_.begin_invoke([=] { get_layer(index).play(wait); });
     }
 
     std::future<void> stop(int index)
@@ -174,14 +601,29 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> clear(int index)
     {
-        return executor_.begin_invoke([=] { layers_.erase(index); });
+        return executor_.begin_invoke([=] {
+            layers_.erase(index);
+            stalled_.erase(index);
+            held_frames_.erase(index);
+        });
     }
 
     std::future<void> clear()
     {
-        return executor_.begin_invoke([=] { layers_.clear(); });
+        return executor_.begin_invoke([=] {
+            layers_.clear();
+            stalled_.clear();
+            held_frames_.clear();
+        });
+    }
+
+    std::future<void> set_priority(int index, int priority)
+    {
+        return executor_.begin_invoke([=] { priorities_[index] = priority; });
     }
 
+    void report_load(double load) { load_ = load; }
+
     std::future<void> swap_layers(stage& other, bool swap_transforms)
     {
         auto other_impl = other.impl_;
@@ -196,8 +638,11 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
             std::swap(layers_, other_impl->layers_);
 
-            if (swap_transforms)
+            if (swap_transforms) {
+                apply_pending_transforms();
+                other_impl->apply_pending_transforms();
                 std::swap(tweens_, other_impl->tweens_);
+            }
         };
 
         return invoke_both(other, func);
@@ -206,10 +651,18 @@ struct stage::impl : public std::enable_shared_from_this<impl>
     std::future<void> swap_layer(int index, int other_index, bool swap_transforms)
     {
         return executor_.begin_invoke([=] {
+            // Both are inserted before either is referenced, as an insertion moves the elements of the map.
+            get_layer(index);
+            get_layer(other_index);
             std::swap(get_layer(index), get_layer(other_index));
 
-            if (swap_transforms)
+            if (swap_transforms) {
+                // Both are inserted before either is referenced, as an insertion moves the elements of the map.
+                apply_pending_transforms();
+                tweens_[index];
+                tweens_[other_index];
                 std::swap(tweens_[index], tweens_[other_index]);
+            }
         });
     }
 
@@ -226,6 +679,8 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             std::swap(my_layer, other_layer);
 
             if (swap_transforms) {
+                apply_pending_transforms();
+                other_impl->apply_pending_transforms();
                 auto& my_tween    = tweens_[index];
                 auto& other_tween = other_impl->tweens_[other_index];
                 std::swap(my_tween, other_tween);
@@ -264,8 +719,12 @@ struct stage::impl : public std::enable_shared_from_this<impl>
     }
 };
 
-stage::stage(int channel_index, spl::shared_ptr<diagnostics::graph> graph)
-    : impl_(new impl(channel_index, std::move(graph)))
+stage::stage(int                                         channel_index,
+             spl::shared_ptr<caspar::diagnostics::graph> graph,
+             bool                                        parallel_layers,
+             double                                      layer_deadline,
+             double                                      frame_budget)
+    : impl_(new impl(channel_index, std::move(graph), parallel_layers, layer_deadline, frame_budget))
 {
 }
 std::future<std::wstring> stage::call(int index, const std::vector<std::wstring>& params)
@@ -290,12 +749,18 @@ std::future<void> stage::load(int index, const spl::shared_ptr<frame_producer>&
 {
     return impl_->load(index, producer, preview, auto_play);
 }
+std::future<bool> stage::queue(int index, const spl::shared_ptr<frame_producer>& producer, bool auto_play)
+{
+    return impl_->queue(index, producer, auto_play);
+}
 std::future<void> stage::pause(int index) { return impl_->pause(index); }
 std::future<void> stage::resume(int index) { return impl_->resume(index); }
-std::future<void> stage::play(int index) { return impl_->play(index); }
+std::future<void> stage::play(int index, int wait) { return impl_->play(index, wait); }
 std::future<void> stage::stop(int index) { return impl_->stop(index); }
 std::future<void> stage::clear(int index) { return impl_->clear(index); }
 std::future<void> stage::clear() { return impl_->clear(); }
+std::future<void> stage::set_priority(int index, int priority) { return impl_->set_priority(index, priority); }
+void              stage::report_load(double load) { impl_->report_load(load); }
 std::future<void> stage::swap_layers(stage& other, bool swap_transforms)
 {
     return impl_->swap_layers(other, swap_transforms);
@@ -310,10 +775,12 @@ std::future<void> stage::swap_layer(int index, int other_index, stage& other, bo
 }
 std::future<std::shared_ptr<frame_producer>> stage::foreground(int index) { return impl_->foreground(index); }
 std::future<std::shared_ptr<frame_producer>> stage::background(int index) { return impl_->background(index); }
-std::map<int, layer_frame>                   stage::
-                                             operator()(const video_format_desc& format_desc, int nb_samples, std::vector<int>& fetch_background)
+void stage::operator()(const video_format_desc& format_desc,
+                       int                      nb_samples,
+                       const std::vector<int>&  fetch_background,
+                       layer_frames&            frames)
 {
-    return (*impl_)(format_desc, nb_samples, fetch_background);
+    (*impl_)(format_desc, nb_samples, fetch_background, frames);
 }
-core::monitor::state stage::state() const { return impl_->state_; }
+core::monitor::state stage::state() const { return *std::atomic_load(&impl_->state_); }
 }} // namespace caspar::core
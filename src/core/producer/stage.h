@@ -30,6 +30,8 @@
 
 #include <core/frame/draw_frame.h>
 
+#include <boost/container/flat_map.hpp>
+
 #include <functional>
 #include <future>
 #include <map>
@@ -47,6 +49,8 @@ struct layer_frame
     bool       has_background;
 };
 
+using layer_frames = boost::container::flat_map<int, layer_frame>;
+
 class stage final
 {
     stage(const stage&);
@@ -56,10 +60,20 @@ class stage final
     using transform_func_t  = std::function<struct frame_transform(struct frame_transform)>;
     using transform_tuple_t = std::tuple<int, transform_func_t, unsigned int, tweener>;
 
-    explicit stage(int channel_index, spl::shared_ptr<caspar::diagnostics::graph> graph);
-
-    std::map<int, layer_frame>
-    operator()(const video_format_desc& format_desc, int nb_samples, std::vector<int>& fetch_background);
+    // With a layer_deadline, in frames, layers are received concurrently and those that take longer are held until
+    // they return, showing their last frame meanwhile. With a frame_budget, the fraction of a frame that producing
+    // and mixing may take, layers of lower priority are degraded while the channel goes over it.
+    explicit stage(int                                         channel_index,
+                   spl::shared_ptr<caspar::diagnostics::graph> graph,
+                   bool                                        parallel_layers = false,
+                   double                                      layer_deadline  = 0.0,
+                   double                                      frame_budget    = 0.0);
+
+    // Receives a frame from every layer into frames, which keeps its capacity when reused for the next tick.
+    void operator()(const video_format_desc& format_desc,
+                    int                      nb_samples,
+                    const std::vector<int>&  fetch_background,
+                    layer_frames&            frames);
 
     std::future<void> apply_transforms(const std::vector<transform_tuple_t>& transforms);
     std::future<void>
@@ -69,13 +83,21 @@ class stage final
     std::future<frame_transform> get_current_transform(int index);
     std::future<void>
                               load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview = false, bool auto_play = false);
+    std::future<bool>
+                              queue(int index, const spl::shared_ptr<frame_producer>& producer, bool auto_play = false);
     std::future<void>         pause(int index);
     std::future<void>         resume(int index);
-    std::future<void>         play(int index);
+    std::future<void>         play(int index, int wait = 0);
     std::future<void>         stop(int index);
     std::future<std::wstring> call(int index, const std::vector<std::wstring>& params);
     std::future<void>         clear(int index);
     std::future<void>         clear();
+
+    // Layers of lower priority are degraded first, those of the highest priority on the channel never. Default 0.
+    std::future<void> set_priority(int index, int priority);
+
+    // The time that the channel took for the last frame, as a fraction of the frame period.
+    void report_load(double load);
     std::future<void>         swap_layers(stage& other, bool swap_transforms);
     std::future<void>         swap_layer(int index, int other_index, bool swap_transforms);
     std::future<void>         swap_layer(int index, int other_index, stage& other, bool swap_transforms);
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sync_test_producer.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/math/constants/constants.hpp>
+
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const double BEEP_FREQUENCY = 1000.0;
+const double BEEP_AMPLITUDE = 0.25; // -12 dBFS
+
+// The flash and the beep start on the same frame, the beep on its first sample, so that the offset between them
+// downstream is what the pipeline and the devices after it add.
+class sync_test_producer : public frame_producer
+{
+    const spl::shared_ptr<frame_factory> frame_factory_;
+    const video_format_desc              format_desc_;
+    const std::uint32_t                  period_;
+
+    std::uint32_t  frame_   = 0;
+    std::int64_t   flashes_ = 0;
+    monitor::state state_;
+
+  public:
+    sync_test_producer(const frame_producer_dependencies& dependencies, std::uint32_t period)
+        : frame_factory_(dependencies.frame_factory)
+        , format_desc_(dependencies.format_desc)
+        , period_(period)
+    {
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // frame_producer
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        const auto flash = frame_++ % period_ == 0;
+
+        pixel_format_desc desc(pixel_format::bgra);
+        desc.planes.push_back(pixel_format_desc::plane(1, 1, 4));
+        auto frame = frame_factory_->create_frame(this, desc);
+
+        *reinterpret_cast<std::uint32_t*>(frame.image_data(0).begin()) = flash ? 0xFFFFFFFF : 0xFF000000;
+
+        std::vector<std::int32_t> audio(static_cast<std::size_t>(nb_samples) * format_desc_.audio_channels, 0);
+        if (flash) {
+            const auto amplitude = BEEP_AMPLITUDE * std::numeric_limits<std::int32_t>::max();
+            for (int n = 0; n < nb_samples; ++n) {
+                const auto phase =
+                    2.0 * boost::math::constants::pi<double>() * BEEP_FREQUENCY * n / format_desc_.audio_sample_rate;
+                const auto sample = static_cast<std::int32_t>(amplitude * std::sin(phase));
+                std::fill_n(audio.begin() + n * format_desc_.audio_channels, format_desc_.audio_channels, sample);
+            }
+            flashes_ += 1;
+        }
+        frame.audio_data()         = array<std::int32_t>(std::move(audio));
+        frame.timing().test_signal = true;
+
+        state_["sync-test/period"]  = static_cast<std::int32_t>(period_);
+        state_["sync-test/flashes"] = flashes_;
+
+        return draw_frame(std::move(frame));
+    }
+
+    std::wstring print() const override { return L"sync-test[" + std::to_wstring(period_) + L"]"; }
+
+    std::wstring name() const override { return L"sync-test"; }
+
+    monitor::state state() const override { return state_; }
+};
+
+} // namespace
+
+spl::shared_ptr<core::frame_producer> create_sync_test_producer(const core::frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"[SYNC_TEST]")) {
+        return core::frame_producer::empty();
+    }
+
+    auto period = static_cast<std::uint32_t>(std::max(1.0, std::round(dependencies.format_desc.fps)));
+    for (std::size_t n = 1; n + 1 < params.size(); ++n) {
+        if (boost::iequals(params.at(n), L"PERIOD")) {
+            try {
+                period = static_cast<std::uint32_t>(std::stoul(params.at(++n)));
+            } catch (...) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid sync test period: " + params.at(n)));
+            }
+        }
+    }
+
+    if (period == 0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"The sync test period must be at least one frame"));
+    }
+
+    return spl::make_shared<sync_test_producer>(dependencies, period);
+}
+
+}} // namespace caspar::core
@@ -28,13 +28,92 @@
 #include "../../monitor/monitor.h"
 #include "../frame_producer.h"
 
+#include <common/except.h>
+#include <common/log.h>
 #include <common/param.h>
 #include <common/scope_exit.h>
+#include <common/timer.h>
 
+#include <boost/algorithm/string.hpp>
+
+#include <chrono>
 #include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace caspar { namespace core {
 
+namespace {
+
+using sting_clip = std::vector<draw_frame>;
+
+std::mutex                                                                         g_cache_mutex;
+std::map<std::pair<std::wstring, std::wstring>, std::shared_ptr<const sting_clip>> g_cache;
+
+// Clips are cached per format, since they are decoded at its frame rate.
+std::pair<std::wstring, std::wstring> cache_key(const std::wstring& filename, const video_format_desc& format_desc)
+{
+    return std::make_pair(boost::to_upper_copy(filename), format_desc.name);
+}
+
+// Plays the frames of a cached clip once.
+class sting_clip_producer : public frame_producer
+{
+    const std::wstring                      filename_;
+    const std::shared_ptr<const sting_clip> clip_;
+    std::size_t                             position_ = 0;
+
+  public:
+    sting_clip_producer(std::wstring filename, std::shared_ptr<const sting_clip> clip)
+        : filename_(std::move(filename))
+        , clip_(std::move(clip))
+    {
+    }
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        return position_ < clip_->size() ? clip_->at(position_++) : draw_frame{};
+    }
+
+    draw_frame last_frame() override { return position_ > 0 ? clip_->at(position_ - 1) : first_frame(); }
+
+    draw_frame first_frame() override { return clip_->front(); }
+
+    uint32_t nb_frames() const override { return static_cast<uint32_t>(clip_->size()); }
+
+    uint32_t frame_number() const override { return static_cast<uint32_t>(position_); }
+
+    std::wstring print() const override { return L"sting-cache[" + filename_ + L"]"; }
+
+    std::wstring name() const override { return L"sting-cache"; }
+};
+
+std::shared_ptr<frame_producer> find_cached_clip(const std::wstring& filename, const video_format_desc& format_desc)
+{
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+
+    auto it = g_cache.find(cache_key(filename, format_desc));
+    if (it == g_cache.end()) {
+        return nullptr;
+    }
+    return std::make_shared<sting_clip_producer>(filename, it->second);
+}
+
+spl::shared_ptr<frame_producer> create_clip_producer(const frame_producer_dependencies& dependencies,
+                                                     const std::wstring&                filename)
+{
+    auto cached = find_cached_clip(filename, dependencies.format_desc);
+    if (cached) {
+        return spl::make_shared_ptr(cached);
+    }
+    return dependencies.producer_registry->create_producer(dependencies, filename);
+}
+
+} // namespace
+
 class sting_producer : public frame_producer
 {
     monitor::state  state_;
@@ -169,6 +248,11 @@ class sting_producer : public frame_producer
 
     uint32_t frame_number() const override { return dst_producer_->frame_number(); }
 
+    bool ready() const override
+    {
+        return dst_producer_->ready() && mask_producer_->ready() && overlay_producer_->ready();
+    }
+
     std::wstring print() const override
     {
         return L"transition[" + src_producer_->print() + L"=>" + dst_producer_->print() + L"]";
@@ -214,17 +298,82 @@ spl::shared_ptr<frame_producer> create_sting_producer(const frame_producer_depen
                                                       sting_info&                            info)
 {
     // Any producer which exposes a fixed duration will work here, not just ffmpeg
-    auto mask_producer = dependencies.producer_registry->create_producer(dependencies, info.mask_filename);
+    auto mask_producer = create_clip_producer(dependencies, info.mask_filename);
 
     auto overlay_producer = frame_producer::empty();
     if (!info.overlay_filename.empty()) {
         // This could be any producer, no requirement for it to be of fixed length
-        overlay_producer = dependencies.producer_registry->create_producer(dependencies, info.overlay_filename);
+        overlay_producer = create_clip_producer(dependencies, info.overlay_filename);
     }
 
     return spl::make_shared<sting_producer>(destination, info, mask_producer, overlay_producer);
 }
 
+void cache_sting_clip(const frame_producer_dependencies& dependencies, const std::wstring& filename, double scale)
+{
+    std::vector<std::wstring> params{filename};
+    if (scale < 1.0) {
+        params.push_back(L"VF");
+        params.push_back(L"scale=trunc(iw*" + std::to_wstring(scale) + L"/2)*2:trunc(ih*" + std::to_wstring(scale) +
+                         L"/2)*2");
+    }
+
+    auto producer = dependencies.producer_registry->create_producer(dependencies, params);
+    if (producer == frame_producer::empty()) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename));
+    }
+
+    const auto& format_desc = dependencies.format_desc;
+
+    // Clips of unknown length end when nothing more is decoded for a while, or after a minute.
+    const auto idle_timeout = 5.0;
+    const auto max_frames   = static_cast<std::size_t>(format_desc.fps * 60.0);
+
+    auto          clip = std::make_shared<sting_clip>();
+    caspar::timer idle;
+    while (clip->size() < producer->nb_frames() && clip->size() < max_frames) {
+        auto frame = producer->receive(format_desc.audio_cadence[clip->size() % format_desc.audio_cadence.size()]);
+        if (frame) {
+            clip->push_back(std::move(frame));
+            idle.restart();
+        } else if (idle.elapsed() < idle_timeout) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        } else if (clip->empty()) {
+            CASPAR_THROW_EXCEPTION(timed_out() << msg_info(L"Nothing decoded from " + filename));
+        } else {
+            break;
+        }
+    }
+
+    CASPAR_LOG(info) << L"[sting_producer] Cached " << clip->size() << L" frames of " << filename << L" for "
+                     << format_desc.name << L".";
+
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+    g_cache[cache_key(filename, format_desc)] = std::move(clip);
+}
+
+std::size_t uncache_sting_clip(const std::wstring& filename)
+{
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+
+    if (filename.empty()) {
+        auto count = g_cache.size();
+        g_cache.clear();
+        return count;
+    }
+
+    std::size_t count = 0;
+    for (auto it = g_cache.begin(); it != g_cache.end();) {
+        if (it->first.first == boost::to_upper_copy(filename)) {
+            it = g_cache.erase(it);
+            ++count;
+        } else {
+            ++it;
+        }
+    }
+    return count;
+}
+
 bool try_match_sting(const std::vector<std::wstring>& params, sting_info& stingInfo)
 {
     auto match = std::find_if(params.begin(), params.end(), param_comparer(L"STING"));
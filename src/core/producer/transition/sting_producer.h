@@ -26,6 +26,7 @@
 
 #include <common/memory.h>
 
+#include <cstddef>
 #include <string>
 
 namespace caspar { namespace core {
@@ -43,4 +44,14 @@ spl::shared_ptr<frame_producer> create_sting_producer(const frame_producer_depen
                                                       const spl::shared_ptr<frame_producer>& destination,
                                                       sting_info&                            info);
 
+// Decodes the whole of the clip filename for the format of dependencies into memory, so that stings using it as mask
+// or overlay don't open or decode anything when they are triggered. A scale below 1 decodes the clip at a fraction of
+// its size, which the mixer scales back up and is fine for soft masks. Blocks until the clip is decoded.
+void cache_sting_clip(const frame_producer_dependencies& dependencies,
+                      const std::wstring&                filename,
+                      double                             scale = 1.0);
+
+// Removes filename from the sting cache, or every clip if it is empty, and returns the number of clips removed.
+std::size_t uncache_sting_clip(const std::wstring& filename);
+
 }} // namespace caspar::core
@@ -131,6 +131,8 @@ class transition_producer : public frame_producer
 
     uint32_t frame_number() const override { return dst_producer_->frame_number(); }
 
+    bool ready() const override { return dst_producer_->ready(); }
+
     std::wstring print() const override
     {
         return L"transition[" + src_producer_->print() + L"=>" + dst_producer_->print() + L"]";
@@ -25,7 +25,11 @@
 
 #include "video_format.h"
 
+#include "channel_arena.h"
+#include "channel_group.h"
+
 #include "consumer/output.h"
+#include "diagnostics/trace.h"
 #include "frame/draw_frame.h"
 #include "frame/frame.h"
 #include "frame/frame_factory.h"
@@ -37,20 +41,84 @@
 #include <common/timer.h>
 
 #include <core/diagnostics/call_context.h>
+#include <core/diagnostics/memory.h>
 #include <core/mixer/image/image_mixer.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace core {
 
 bool operator<(const route_id& a, const route_id& b) { return a.mode + (a.index << 2) < b.mode + (b.index << 2); }
 
+struct route::entry
+{
+    std::uint64_t position;
+    draw_frame    frame;
+};
+
+void route::publish(draw_frame frame)
+{
+    const auto position = head_.load(std::memory_order_relaxed);
+
+    std::atomic_store(&slots_[position % capacity],
+                      std::shared_ptr<const entry>(std::make_shared<entry>(entry{position, std::move(frame)})));
+    head_.store(position + 1, std::memory_order_release);
+
+    const auto depth = static_cast<std::uint64_t>(depth_.load(std::memory_order_relaxed));
+    if (position >= depth) {
+        std::atomic_store(&slots_[(position - depth) % capacity], std::shared_ptr<const entry>());
+    }
+}
+
+void route::reserve(int depth)
+{
+    depth = std::max(1, std::min(depth, capacity - 1));
+
+    auto current = depth_.load();
+    while (current < depth && !depth_.compare_exchange_weak(current, depth)) {
+    }
+}
+
+std::uint64_t route::head() const { return head_.load(std::memory_order_acquire); }
+
+bool route::read(std::uint64_t& position, int depth, draw_frame& frame) const
+{
+    depth = std::max(1, std::min(depth, depth_.load(std::memory_order_relaxed)));
+
+    while (true) {
+        const auto head = head_.load(std::memory_order_acquire);
+        if (head - position > static_cast<std::uint64_t>(depth)) {
+            position = head - depth;
+        }
+        if (position >= head) {
+            return false;
+        }
+
+        auto entry = std::atomic_load(&slots_[position % capacity]);
+        position += 1;
+
+        // Otherwise the writer has lapped the reader in between, so try the next one.
+        if (entry && entry->position == position - 1) {
+            frame = entry->frame;
+            return true;
+        }
+    }
+}
+
 struct video_channel::impl final
 {
-    monitor::state state_;
+    // Published once per tick and never modified afterwards, INFO and OSC readers take a reference to the last
+    // snapshot without locking, and without copying the data that the state shares with its producers.
+    std::shared_ptr<const monitor::state> state_ = std::make_shared<const monitor::state>();
 
     const int index_;
 
@@ -63,156 +131,398 @@ struct video_channel::impl final
         return spl::make_shared<caspar::diagnostics::graph>();
     }(index_);
 
+    // Handles of the series set on every tick.
+    const int produce_time_id_ = graph_->series("produce-time");
+    const int mix_time_id_     = graph_->series("mix-time");
+    const int consume_time_id_ = graph_->series("consume-time");
+    const int frame_time_id_   = graph_->series("frame-time");
+    const int osc_time_id_     = graph_->series("osc-time");
+
     caspar::core::output         output_;
     spl::shared_ptr<image_mixer> image_mixer_;
     caspar::core::mixer          mixer_;
     caspar::core::stage          stage_;
 
-    uint64_t frame_counter_ = 0;
+    // The arena that the parallel work of the channel runs in, if it has one of its own.
+    const std::shared_ptr<channel_arena> arena_ = get_channel_arena(index_);
+
+    std::atomic<uint64_t> frame_counter_{0};
+
+    // Commands that run at the start of the tick of their frame, a min-heap by frame and then by the order they were
+    // scheduled in. next_scheduled_ lets the tick skip the lock while nothing is due.
+    struct scheduled_command
+    {
+        uint64_t              frame;
+        uint64_t              sequence;
+        std::function<void()> command;
+
+        bool operator<(const scheduled_command& other) const
+        {
+            return frame != other.frame ? frame > other.frame : sequence > other.sequence;
+        }
+    };
+
+    std::mutex                     schedule_mutex_;
+    std::vector<scheduled_command> schedule_;
+    uint64_t                       schedule_sequence_ = 0;
+    std::atomic<uint64_t>          next_scheduled_{std::numeric_limits<uint64_t>::max()};
+
+    // Times that the containers reused by the tick had to grow, see the "tick-alloc" tag.
+    std::int64_t tick_allocations_ = 0;
+
+    // The time of producing and of mixing the last frame as fractions of its period, which the stage degrades layers
+    // by. Consuming is left out, since it includes the wait for the outputs' clock.
+    double              produce_load_ = 0.0;
+    std::atomic<double> mix_load_{0.0};
 
     std::function<void(core::monitor::state)> tick_;
 
+    using route_list = std::vector<std::pair<route_id, std::weak_ptr<core::route>>>;
+
+    // Routes are added under the mutex, the tick reads the list that is swapped in afterwards without locking.
     std::map<route_id, std::weak_ptr<core::route>> routes_;
     std::mutex                                     routes_mutex_;
+    std::shared_ptr<const route_list>              route_list_ = std::make_shared<route_list>();
+
+    std::shared_ptr<const monitor::state> mixer_state_  = std::make_shared<const monitor::state>();
+    std::shared_ptr<const monitor::state> output_state_ = std::make_shared<const monitor::state>();
+
+    const int                                  pipeline_depth_;
+    std::unique_ptr<executor>                  mix_executor_;
+    std::unique_ptr<executor>                  output_executor_;
+    std::deque<std::future<std::future<void>>> pipeline_;
 
-    std::atomic<bool> abort_request_{false};
-    std::thread       thread_;
+    // Reused from tick to tick, growing only when layers or routes are added.
+    std::vector<int> background_routes_;
+    layer_frames     stage_frames_;
+
+    const std::shared_ptr<channel_group> group_;
+    std::atomic<bool>                    abort_request_{false};
+    std::thread                          thread_;
 
   public:
     impl(int                                       index,
          const core::video_format_desc&            format_desc,
          std::unique_ptr<image_mixer>              image_mixer,
-         std::function<void(core::monitor::state)> tick)
+         std::function<void(core::monitor::state)> tick,
+         int                                       pipeline_depth,
+         bool                                      parallel_layers,
+         int                                       mixer_depth,
+         double                                    layer_deadline,
+         double                                    frame_budget,
+         std::shared_ptr<channel_group>            group)
         : index_(index)
         , format_desc_(format_desc)
         , output_(graph_, format_desc, index)
         , image_mixer_(std::move(image_mixer))
         , mixer_(index, graph_, image_mixer_)
-        , stage_(index, graph_)
+        , stage_(index, graph_, parallel_layers, layer_deadline, frame_budget)
         , tick_(std::move(tick))
+        , pipeline_depth_(std::max(1, pipeline_depth))
+        , group_(std::move(group))
     {
+        mixer_.set_depth(mixer_depth);
+
+        if (pipeline_depth_ > 1) {
+            mix_executor_    = std::make_unique<executor>(L"channel-mixer-" + std::to_wstring(index_));
+            output_executor_ = std::make_unique<executor>(L"channel-output-" + std::to_wstring(index_));
+            mix_executor_->begin_invoke([this] { bind_thread_to_channel(index_); });
+            output_executor_->begin_invoke([this] { bind_thread_to_channel(index_); });
+        }
+
         graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("mix-time", caspar::diagnostics::color(1.0f, 0.0f, 0.9f, 0.8f));
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
         graph_->set_color("frame-time", caspar::diagnostics::color(1.0f, 0.4f, 0.4f, 0.8f));
         graph_->set_color("osc-time", caspar::diagnostics::color(0.3f, 0.4f, 0.0f, 0.8f));
+        if (arena_) {
+            graph_->set_color("arena", caspar::diagnostics::color(0.4f, 0.6f, 1.0f, 0.8f));
+        }
         graph_->set_text(print());
         caspar::diagnostics::register_graph(graph_);
 
-        CASPAR_LOG(info) << print() << " Successfully Initialized.";
+        CASPAR_LOG(info) << print() << " Successfully Initialized (pipeline depth: " << pipeline_depth_
+                         << ", mixer depth: " << mixer_depth << ").";
+
+        if (group_) {
+            group_->add(index_, [this] { return produce(); });
+            return;
+        }
 
         thread_ = std::thread([=] {
 #ifdef WIN32
             SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
 #endif
             set_thread_name(L"channel-" + std::to_wstring(index_));
+            set_thread_role(L"channel");
+            bind_thread_to_channel(index_);
 
             while (!abort_request_) {
-                try {
-                    core::video_format_desc format_desc;
-                    {
-                        std::lock_guard<std::mutex> lock(format_desc_mutex_);
-                        format_desc = format_desc_;
-                    }
+                produce()();
+            }
+        });
+    }
 
-                    frame_counter_ += 1;
+    // Produces a frame and hands it to the routes, and returns the rest of the tick which mixes, consumes and
+    // reports it. Grouped channels are produced one after the other and then finished concurrently.
+    std::function<void()> produce()
+    {
+        try {
+            core::video_format_desc format_desc;
+            {
+                std::lock_guard<std::mutex> lock(format_desc_mutex_);
+                format_desc = format_desc_;
+            }
 
-                    auto nb_samples = format_desc.audio_cadence[frame_counter_ % format_desc.audio_cadence.size()];
+            frame_counter_ += 1;
 
-                    caspar::timer frame_timer;
+            run_scheduled(frame_counter_);
 
-                    // Determine all layers that need a frame from the background producer
-                    std::vector<int> background_routes = {};
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
+            auto nb_samples = format_desc.audio_cadence[frame_counter_ % format_desc.audio_cadence.size()];
 
-                        for (auto& r : routes_) {
-                            // Ensure pointer is still valid
-                            if (!r.second.lock())
-                                continue;
+            caspar::timer frame_timer;
 
-                            if (r.first.mode != route_mode::foreground) {
-                                background_routes.push_back(r.first.index);
-                            }
-                        }
-                    }
+            const auto capacity = background_routes_.capacity() + stage_frames_.capacity();
 
-                    // Produce
-                    caspar::timer produce_timer;
-                    auto          stage_frames = stage_(format_desc, nb_samples, background_routes);
-                    graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.fps * 0.5);
+            const auto routes = std::atomic_load(&route_list_);
 
-                    // Mix
-                    caspar::timer mix_timer;
+            // Determine all layers that need a frame from the background producer
+            background_routes_.clear();
+            for (auto& r : *routes) {
+                // Ensure pointer is still valid
+                if (r.second.expired())
+                    continue;
 
-                    std::vector<core::draw_frame> frames;
-                    for (auto& p : stage_frames) {
-                        frames.push_back(p.second.foreground);
-                    }
+                if (r.first.mode == route_mode::background || r.first.mode == route_mode::next) {
+                    background_routes_.push_back(r.first.index);
+                }
+            }
+
+            // Produce
+            caspar::timer produce_timer;
+            {
+                CASPAR_TRACE_SCOPE("video_channel::produce", index_);
+                stage_(format_desc, nb_samples, background_routes_, stage_frames_);
+            }
+            produce_load_ = produce_timer.elapsed() * format_desc.fps;
+            graph_->set_value(produce_time_id_, produce_load_ * 0.5);
+
+            if (background_routes_.capacity() + stage_frames_.capacity() != capacity) {
+                ++tick_allocations_;
+                graph_->set_tag(caspar::diagnostics::tag_severity::INFO, "tick-alloc");
+            }
+
+            // Handed over to the mixer, so it is the one container that is allocated every tick.
+            std::vector<core::draw_frame> frames;
+            std::vector<int>              layers;
+            frames.reserve(stage_frames_.size());
+            layers.reserve(stage_frames_.size());
+            for (auto& p : stage_frames_) {
+                frames.push_back(p.second.foreground);
+                layers.push_back(p.first);
+            }
+
+            // Routes get their frames before the channel is mixed, so that the channels produced after this one in
+            // a group receive them in the same tick.
+            for (auto& r : *routes) {
+                if (r.first.mode == route_mode::mixed) {
+                    continue;
+                }
+
+                auto route = r.second.lock();
+                if (!route) {
+                    continue;
+                }
+
+                if (r.first.index == -1) {
+                    route->publish(core::draw_frame(frames));
+                    continue;
+                }
 
-                    auto mixed_frame = mixer_(frames, format_desc, nb_samples);
-                    graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.fps * 0.5);
-
-                    // Consume
-                    caspar::timer consume_timer;
-                    output_(std::move(mixed_frame), format_desc);
-                    graph_->set_value("consume-time", consume_timer.elapsed() * format_desc.fps * 0.5);
-
-                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
-
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
-
-                        for (auto& r : routes_) {
-                            auto route = r.second.lock();
-                            if (!route) {
-                                continue;
-                            }
-
-                            if (r.first.index == -1) {
-                                route->signal(core::draw_frame(std::move(frames)));
-                                continue;
-                            }
-
-                            auto it = stage_frames.find(r.first.index);
-                            if (it == stage_frames.end()) {
-                                // Layer doesnt exist, so send empty frame to avoid freezing on last
-                                route->signal(draw_frame{});
-                            } else {
-                                if (r.first.mode == route_mode::background ||
-                                    (r.first.mode == route_mode::next && it->second.has_background)) {
-                                    route->signal(draw_frame::pop(it->second.background));
-                                } else {
-                                    route->signal(draw_frame::pop(it->second.foreground));
-                                }
-                            }
-                        }
+                auto it = stage_frames_.find(r.first.index);
+                if (it == stage_frames_.end()) {
+                    // Layer doesnt exist, so send empty frame to avoid freezing on last
+                    route->publish(draw_frame{});
+                } else {
+                    if (r.first.mode == route_mode::background ||
+                        (r.first.mode == route_mode::next && it->second.has_background)) {
+                        route->publish(draw_frame::pop(it->second.background));
+                    } else {
+                        route->publish(draw_frame::pop(it->second.foreground));
                     }
+                }
+            }
+
+            return [this,
+                    frames = std::move(frames),
+                    layers = std::move(layers),
+                    format_desc,
+                    nb_samples,
+                    routes,
+                    frame_timer]() mutable {
+                finish(std::move(frames), std::move(layers), format_desc, nb_samples, routes, frame_timer);
+            };
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return [] {};
+        }
+    }
 
-                    monitor::state state = {};
-                    state["stage"]       = stage_.state();
-                    state["mixer"]       = mixer_.state();
-                    state["output"]      = output_.state();
-                    state["framerate"]   = {format_desc_.framerate.numerator(), format_desc_.framerate.denominator()};
-                    state_               = state;
-
-                    caspar::timer osc_timer;
-                    tick_(state_);
-                    graph_->set_value("osc-time", osc_timer.elapsed() * format_desc.fps * 0.5);
-                } catch (...) {
-                    CASPAR_LOG_CURRENT_EXCEPTION();
+    void finish(std::vector<core::draw_frame>            frames,
+                std::vector<int>                         layers,
+                const core::video_format_desc&           format_desc,
+                int                                      nb_samples,
+                const std::shared_ptr<const route_list>& routes,
+                const caspar::timer&                     frame_timer)
+    {
+        try {
+            if (pipeline_depth_ > 1) {
+                // Mix and consume on their own executors so that the next frame can be produced while
+                // this one is being mixed and the previous one is being consumed.
+                pipeline_.push_back(mix_executor_->begin_invoke([=] {
+                    auto mixed_frame = mix(frames, layers, format_desc, nb_samples);
+                    publish_mixed(*routes, mixed_frame);
+                    return output_executor_->begin_invoke(
+                        [=]() mutable { consume(std::move(mixed_frame), format_desc); });
+                }));
+
+                while (pipeline_.size() >= static_cast<std::size_t>(pipeline_depth_)) {
+                    auto tick = std::move(pipeline_.front());
+                    pipeline_.pop_front();
+                    tick.get().get();
                 }
+            } else {
+                auto mixed_frame = mix(std::move(frames), layers, format_desc, nb_samples);
+                publish_mixed(*routes, mixed_frame);
+                consume(std::move(mixed_frame), format_desc);
             }
-        });
+
+            graph_->set_value(frame_time_id_, frame_timer.elapsed() * format_desc.fps * 0.5);
+            stage_.report_load(produce_load_ + mix_load_);
+
+            monitor::state state      = {};
+            state["stage"]            = stage_.state();
+            state["tick-allocations"] = tick_allocations_;
+            state["mixer"]            = *std::atomic_load(&mixer_state_);
+            state["output"]           = *std::atomic_load(&output_state_);
+            state["memory"]           = core::diagnostics::memory_state(index_);
+            state["framerate"] = {format_desc_.framerate.numerator(), format_desc_.framerate.denominator()};
+            state["frame"]     = static_cast<std::int64_t>(frame_counter_.load());
+            if (arena_) {
+                const auto utilization = arena_->utilization();
+                graph_->set_value("arena", utilization);
+                state["arena/concurrency"] = arena_->concurrency();
+                state["arena/utilization"] = utilization;
+            }
+            std::atomic_store(&state_, std::make_shared<const monitor::state>(state));
+
+            caspar::timer osc_timer;
+            tick_(state);
+            graph_->set_value(osc_time_id_, osc_timer.elapsed() * format_desc.fps * 0.5);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    const_frame mix(std::vector<core::draw_frame>  frames,
+                    const std::vector<int>&        layers,
+                    const core::video_format_desc& format_desc,
+                    int                            nb_samples)
+    {
+        mixer_.set_readback(output_.needs_host_memory());
+
+        CASPAR_TRACE_SCOPE("video_channel::mix", index_);
+
+        caspar::timer mix_timer;
+        auto          mixed_frame = mixer_(std::move(frames), format_desc, nb_samples, layers);
+        mix_load_ = mix_timer.elapsed() * format_desc.fps;
+        graph_->set_value(mix_time_id_, mix_load_ * 0.5);
+
+        std::atomic_store(&mixer_state_, std::make_shared<const monitor::state>(mixer_.state()));
+
+        return mixed_frame;
+    }
+
+    // Mixed routes get the frame as rendered, so that each channel they go to only draws its texture.
+    static void publish_mixed(const route_list& routes, const const_frame& mixed_frame)
+    {
+        for (auto& r : routes) {
+            if (r.first.mode != route_mode::mixed) {
+                continue;
+            }
+
+            if (auto route = r.second.lock()) {
+                route->publish(draw_frame(mixed_frame));
+            }
+        }
+    }
+
+    void consume(const_frame mixed_frame, const core::video_format_desc& format_desc)
+    {
+        CASPAR_TRACE_SCOPE("video_channel::consume", index_);
+
+        caspar::timer consume_timer;
+        output_(std::move(mixed_frame), format_desc);
+        graph_->set_value(consume_time_id_, consume_timer.elapsed() * format_desc.fps * 0.5);
+
+        std::atomic_store(&output_state_, std::make_shared<const monitor::state>(output_.state()));
     }
 
     ~impl()
     {
         CASPAR_LOG(info) << print() << " Uninitializing.";
         abort_request_ = true;
-        thread_.join();
+        if (group_) {
+            group_->remove(index_);
+        } else {
+            thread_.join();
+        }
+
+        for (auto& tick : pipeline_) {
+            try {
+                tick.get().get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void schedule(uint64_t frame, std::function<void()> command)
+    {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        schedule_.push_back({frame, schedule_sequence_++, std::move(command)});
+        std::push_heap(schedule_.begin(), schedule_.end());
+        next_scheduled_ = schedule_.front().frame;
+    }
+
+    void run_scheduled(uint64_t frame)
+    {
+        if (next_scheduled_ > frame) {
+            return;
+        }
+
+        std::vector<std::function<void()>> commands;
+        {
+            std::lock_guard<std::mutex> lock(schedule_mutex_);
+            while (!schedule_.empty() && schedule_.front().frame <= frame) {
+                std::pop_heap(schedule_.begin(), schedule_.end());
+                commands.push_back(std::move(schedule_.back().command));
+                schedule_.pop_back();
+            }
+            next_scheduled_ = schedule_.empty() ? std::numeric_limits<uint64_t>::max() : schedule_.front().frame;
+        }
+
+        for (auto& command : commands) {
+            try {
+                command();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
     }
 
+    uint64_t frame_number() const { return frame_counter_; }
+
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground)
     {
         std::lock_guard<std::mutex> lock(routes_mutex_);
@@ -233,8 +543,21 @@ struct video_channel::impl final
                 route->name += L"/background";
             } else if (mode == route_mode::next) {
                 route->name += L"/next";
+            } else if (mode == route_mode::mixed) {
+                route->name += L"/mixed";
             }
             routes_[id] = route;
+
+            auto list = std::make_shared<route_list>();
+            for (auto it = routes_.begin(); it != routes_.end();) {
+                if (it->second.expired()) {
+                    it = routes_.erase(it);
+                } else {
+                    list->emplace_back(it->first, it->second);
+                    ++it;
+                }
+            }
+            std::atomic_store(&route_list_, std::shared_ptr<const route_list>(std::move(list)));
         }
 
         return route;
@@ -246,11 +569,14 @@ struct video_channel::impl final
         return format_desc_;
     }
 
+    // The channel keeps the number of audio channels it was configured with.
     void video_format_desc(const core::video_format_desc& format_desc)
     {
         stage_.clear();
         std::lock_guard<std::mutex> lock(format_desc_mutex_);
-        format_desc_ = format_desc;
+        const auto audio_channels   = format_desc_.audio_channels;
+        format_desc_                = format_desc;
+        format_desc_.audio_channels = audio_channels;
     }
 
     std::wstring print() const
@@ -264,8 +590,23 @@ struct video_channel::impl final
 video_channel::video_channel(int                                       index,
                              const core::video_format_desc&            format_desc,
                              std::unique_ptr<image_mixer>              image_mixer,
-                             std::function<void(core::monitor::state)> tick)
-    : impl_(new impl(index, format_desc, std::move(image_mixer), std::move(tick)))
+                             std::function<void(core::monitor::state)> tick,
+                             int                                       pipeline_depth,
+                             bool                                      parallel_layers,
+                             int                                       mixer_depth,
+                             double                                    layer_deadline,
+                             double                                    frame_budget,
+                             std::shared_ptr<channel_group>            group)
+    : impl_(new impl(index,
+                     format_desc,
+                     std::move(image_mixer),
+                     std::move(tick),
+                     pipeline_depth,
+                     parallel_layers,
+                     mixer_depth,
+                     layer_deadline,
+                     frame_budget,
+                     std::move(group)))
 {
 }
 video_channel::~video_channel() {}
@@ -282,8 +623,13 @@ void                           core::video_channel::video_format_desc(const core
     impl_->video_format_desc(format_desc);
 }
 int                  video_channel::index() const { return impl_->index(); }
-core::monitor::state video_channel::state() const { return impl_->state_; }
+core::monitor::state video_channel::state() const { return *std::atomic_load(&impl_->state_); }
 
 std::shared_ptr<route> video_channel::route(int index, route_mode mode) { return impl_->route(index, mode); }
+void video_channel::schedule(uint64_t frame, std::function<void()> command)
+{
+    impl_->schedule(frame, std::move(command));
+}
+uint64_t video_channel::frame_number() const { return impl_->frame_number(); }
 
 }} // namespace caspar::core
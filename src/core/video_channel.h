@@ -28,9 +28,11 @@
 
 #include <common/memory.h>
 
-#include <boost/signals2.hpp>
-
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <memory>
 
 namespace caspar { namespace core {
 
@@ -38,7 +40,8 @@ enum route_mode
 {
     foreground,
     background,
-    next, // background if any, otherwise foreground
+    next,  // background if any, otherwise foreground
+    mixed, // the frame rendered by the channel mixer, which other channels draw from its texture
 };
 
 struct route_id
@@ -49,18 +52,38 @@ struct route_id
     bool const operator==(const route_id& o) { return index == o.index && mode == o.mode; }
 };
 
+// Frames published by a channel to any number of route producers. The channel is the only writer and never waits,
+// readers keep their own position in the ring and skip the frames that they were too slow for.
 struct route
 {
+    static const int capacity = 16;
+
     route()             = default;
     route(const route&) = delete;
-    route(route&&)      = default;
 
     route& operator=(const route&) = delete;
-    route& operator=(route&&) = default;
 
-    boost::signals2::signal<void(class draw_frame)> signal;
-    video_format_desc                               format_desc;
-    std::wstring                                    name;
+    void publish(class draw_frame frame);
+
+    // Keeps the last depth frames in the ring for a reader, older ones are released as new ones are published.
+    void reserve(int depth);
+
+    // The position that the next published frame gets.
+    std::uint64_t head() const;
+
+    // Reads the frame at position and advances it, first skipping the frames that are more than depth behind the
+    // head. Returns false if there is no frame at position yet.
+    bool read(std::uint64_t& position, int depth, class draw_frame& frame) const;
+
+    video_format_desc format_desc;
+    std::wstring      name;
+
+  private:
+    struct entry;
+
+    std::array<std::shared_ptr<const entry>, capacity> slots_;
+    std::atomic<std::uint64_t>                         head_{0};
+    std::atomic<int>                                   depth_{1};
 };
 
 class video_channel final
@@ -69,10 +92,18 @@ class video_channel final
     video_channel& operator=(const video_channel&);
 
   public:
+    // A channel with a group is ticked by it in phase with the others, instead of running a thread of its own. See
+    // stage for layer_deadline and frame_budget.
     explicit video_channel(int                                       index,
                            const video_format_desc&                  format_desc,
                            std::unique_ptr<image_mixer>              image_mixer,
-                           std::function<void(core::monitor::state)> on_tick);
+                           std::function<void(core::monitor::state)> on_tick,
+                           int                                       pipeline_depth  = 1,
+                           bool                                      parallel_layers = false,
+                           int                                       mixer_depth     = 1,
+                           double                                    layer_deadline  = 0.0,
+                           double                                    frame_budget    = 0.0,
+                           std::shared_ptr<channel_group>            group           = nullptr);
     ~video_channel();
 
     core::monitor::state state() const;
@@ -93,6 +124,12 @@ class video_channel final
 
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground);
 
+    // Runs command on the thread of the channel at the start of the tick of frame, before the stage is produced, so
+    // that it takes effect in exactly that frame. Commands of frames that have passed run with the next tick. They
+    // delay the frame while they run, so they shouldn't block, e.g. by opening files.
+    void     schedule(uint64_t frame, std::function<void()> command);
+    uint64_t frame_number() const;
+
   private:
     struct impl;
     spl::unique_ptr<impl> impl_;
@@ -23,7 +23,11 @@
 #pragma once
 
 #include <Windows.h>
+
+#include <core/frame/frame.h>
+
 #include <boost/align.hpp>
+
 #include <vector>
 
 namespace caspar { namespace bluefish {
@@ -45,7 +49,21 @@ struct blue_dma_buffer
 
     int id() const { return id_; }
 
-    PBYTE image_data() { return image_buffer_.data(); }
+    // Frames the size of the image are DMA'd from where the mixer read them back to, instead of being copied into
+    // the image buffer first. The frame is held until release() is called once the DMA has completed.
+    bool set_frame(const core::const_frame& frame)
+    {
+        if (frame.image_data(0).size() != image_size_) {
+            frame_ = core::const_frame{};
+            return false;
+        }
+        frame_ = frame;
+        return true;
+    }
+
+    void release() { frame_ = core::const_frame{}; }
+
+    PBYTE image_data() { return frame_ ? const_cast<PBYTE>(frame_.image_data(0).begin()) : image_buffer_.data(); }
     PBYTE hanc_data() { return hanc_buffer_.data(); }
 
     size_t image_size() const { return image_size_; }
@@ -57,6 +75,7 @@ struct blue_dma_buffer
     size_t                                                           hanc_size_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> image_buffer_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> hanc_buffer_;
+    core::const_frame                                                frame_;
 };
 using blue_dma_buffer_ptr = std::shared_ptr<blue_dma_buffer>;
 
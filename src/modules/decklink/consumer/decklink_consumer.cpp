@@ -31,7 +31,10 @@
 #include <core/consumer/frame_consumer.h>
 #include <core/diagnostics/call_context.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/mixer/audio/audio_mixer.h>
+#include <core/mixer/mixer.h>
+#include <core/video_channel.h>
 
 #include <common/array.h>
 #include <common/diagnostics/graph.h>
@@ -44,15 +47,17 @@
 
 #include <tbb/scalable_allocator.h>
 
-#include <boost/circular_buffer.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <future>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 namespace caspar { namespace decklink {
 
@@ -73,6 +78,13 @@ struct configuration
         default_latency = normal_latency
     };
 
+    enum class pixel_format_t
+    {
+        bgra,
+        uyvy,
+        v210,
+    };
+
     int       device_index      = 1;
     int       key_device_idx    = 0;
     bool      embedded_audio    = false;
@@ -81,6 +93,8 @@ struct configuration
     bool      key_only          = false;
     int       base_buffer_depth = 3;
 
+    pixel_format_t pixel_format = pixel_format_t::bgra;
+
     int buffer_depth() const
     {
         return base_buffer_depth + (latency == latency_t::low_latency ? 0 : 1) +
@@ -132,18 +146,84 @@ void set_keyer(const com_iface_ptr<IDeckLinkAttributes>& attributes,
     }
 }
 
+BMDPixelFormat get_decklink_pixel_format(configuration::pixel_format_t pixel_format)
+{
+    switch (pixel_format) {
+        case configuration::pixel_format_t::uyvy:
+            return bmdFormat8BitYUV;
+        case configuration::pixel_format_t::v210:
+            return bmdFormat10BitYUV;
+        default:
+            return bmdFormat8BitBGRA;
+    }
+}
+
+int get_row_bytes(BMDPixelFormat pix_fmt, int width)
+{
+    switch (pix_fmt) {
+        case bmdFormat8BitYUV:
+            return width * 2;
+        case bmdFormat10BitYUV:
+            return (width + 47) / 48 * 128;
+        default:
+            return width * 4;
+    }
+}
+
+// The card's native format as rendered by the gpu, a single plane of 32 bit texels.
+core::pixel_format_desc get_pixel_format_desc(configuration::pixel_format_t pixel_format, int width, int height)
+{
+    core::pixel_format_desc desc(pixel_format == configuration::pixel_format_t::uyvy ? core::pixel_format::uyvy
+                                                                                      : core::pixel_format::v210);
+    desc.planes.push_back(core::pixel_format_desc::plane(
+        get_row_bytes(get_decklink_pixel_format(pixel_format), width) / 4, height, 4));
+    return desc;
+}
+
+// Cards embed 2, 8 or 16 channels, the smallest of them that holds the channel's audio.
+int get_audio_channels(int channels)
+{
+    for (auto count : {2, 8}) {
+        if (channels <= count) {
+            return count;
+        }
+    }
+    return 16;
+}
+
+// Has the mixer of the consumer's channel render desc, see core::mixer::request_format.
+using format_request =
+    std::function<std::shared_ptr<const core::pixel_format_desc>(const core::pixel_format_desc& desc)>;
+
+// Cards only key bgra frames.
+configuration validate_pixel_format(configuration config)
+{
+    if (config.pixel_format != configuration::pixel_format_t::bgra &&
+        (config.key_only || config.keyer == configuration::keyer_t::internal_keyer ||
+         config.keyer == configuration::keyer_t::external_separate_device_keyer)) {
+        CASPAR_LOG(warning) << L"[decklink_consumer] Keying requires bgra output, falling back to it.";
+        config.pixel_format = configuration::pixel_format_t::bgra;
+    }
+    return config;
+}
+
 class decklink_frame : public IDeckLinkVideoFrame
 {
     core::video_format_desc format_desc_;
     std::shared_ptr<void>   data_;
     std::atomic<int>        ref_count_{0};
     int                     nb_samples_;
+    BMDPixelFormat          pix_fmt_;
 
   public:
-    decklink_frame(std::shared_ptr<void> data, const core::video_format_desc& format_desc, int nb_samples)
+    decklink_frame(std::shared_ptr<void>          data,
+                   const core::video_format_desc& format_desc,
+                   int                            nb_samples,
+                   BMDPixelFormat                 pix_fmt = bmdFormat8BitBGRA)
         : format_desc_(format_desc)
         , data_(data)
         , nb_samples_(nb_samples)
+        , pix_fmt_(pix_fmt)
     {
     }
 
@@ -168,8 +248,8 @@ class decklink_frame : public IDeckLinkVideoFrame
 
     long STDMETHODCALLTYPE GetWidth() override { return static_cast<long>(format_desc_.width); }
     long STDMETHODCALLTYPE GetHeight() override { return static_cast<long>(format_desc_.height); }
-    long STDMETHODCALLTYPE GetRowBytes() override { return static_cast<long>(format_desc_.width * 4); }
-    BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() override { return bmdFormat8BitBGRA; }
+    long STDMETHODCALLTYPE GetRowBytes() override { return get_row_bytes(pix_fmt_, format_desc_.width); }
+    BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() override { return pix_fmt_; }
     BMDFrameFlags STDMETHODCALLTYPE GetFlags() override { return bmdFrameFlagDefault; }
 
     HRESULT STDMETHODCALLTYPE GetBytes(void** buffer) override
@@ -265,6 +345,7 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
 
     const std::wstring            model_name_ = get_model_name(decklink_);
     const core::video_format_desc format_desc_;
+    const int                     audio_channels_ = get_audio_channels(format_desc_.audio_channels);
 
     std::mutex                    buffer_mutex_;
     std::condition_variable       buffer_cond_;
@@ -276,42 +357,183 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
     long long video_scheduled_ = 0;
     long long audio_scheduled_ = 0;
 
-    boost::circular_buffer<std::vector<int32_t>> audio_container_{static_cast<unsigned long>(buffer_size_ + 1)};
-
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
     reference_signal_detector           reference_signal_detector_{output_};
     std::atomic<int64_t>                scheduled_frames_completed_{0};
     std::unique_ptr<key_video_context>  key_context_;
 
+    const BMDPixelFormat pix_fmt_ = get_decklink_pixel_format(config_.pixel_format);
+
     com_ptr<IDeckLinkDisplayMode> mode_ =
-        get_display_mode(output_, format_desc_.format, bmdFormat8BitBGRA, bmdVideoOutputFlagDefault);
+        get_display_mode(output_, format_desc_.format, pix_fmt_, bmdVideoOutputFlagDefault);
     int field_count_ = mode_->GetFieldDominance() != bmdProgressiveFrame ? 2 : 1;
 
+    // The audio of the last buffer_size_ + 1 ticks, kept until the card has taken it, in slots allocated once for the
+    // most samples a tick can carry.
+    const int audio_slot_samples_ =
+        *std::max_element(format_desc_.audio_cadence.begin(), format_desc_.audio_cadence.end()) * field_count_;
+    std::vector<std::int32_t> audio_ring_ = std::vector<std::int32_t>(
+        config_.embedded_audio ? (buffer_size_ + 1) * audio_slot_samples_ * audio_channels_ : 0);
+    int audio_slot_ = 0;
+
+    // While held, mixed frames carry the key and the fill in the card's format rendered by the gpu, see
+    // converted_frame. In interlaced modes they are woven by the gpu, the bgra fill too.
+    const std::shared_ptr<const core::pixel_format_desc> key_format_;
+    const std::shared_ptr<const core::pixel_format_desc> fill_format_;
+    const std::shared_ptr<const core::pixel_format_desc> bgra_format_;
+
     std::atomic<bool> abort_request_{false};
 
-    bool doFrame(std::shared_ptr<void>& image_data, std::vector<std::int32_t>& audio_data, bool topField)
+    std::mutex            tick_mutex_;
+    std::function<void()> tick_;
+
+    // Returns the next slot of audio_ring_, or nullptr without embedded audio.
+    std::int32_t* next_audio_slot()
+    {
+        if (audio_ring_.empty())
+            return nullptr;
+
+        audio_slot_ = (audio_slot_ + 1) % (buffer_size_ + 1);
+        return audio_ring_.data() + audio_slot_ * audio_slot_samples_ * audio_channels_;
+    }
+
+    // Appends the audio of the next frame to the slot, which already holds nb_samples samples.
+    bool doFrame(std::vector<core::const_frame>& frames, std::int32_t* slot, int& nb_samples)
     {
         core::const_frame frame(pop());
         if (abort_request_)
             return false;
 
-        int firstLine = topField ? 0 : 1;
-        for (auto y = firstLine; y < format_desc_.height; y += field_count_) {
-            std::memcpy(reinterpret_cast<char*>(image_data.get()) + (long long)y * format_desc_.width * 4,
-                        frame.image_data(0).data() + (long long)y * format_desc_.width * 4,
-                        (size_t)format_desc_.width * 4);
+        const auto& audio = frame.audio_data();
+        const auto  count = std::min(static_cast<int>(audio.size()) / format_desc_.audio_channels,
+                                    audio_slot_samples_ - nb_samples);
+        if (slot && count > 0) {
+            auto dest = slot + nb_samples * audio_channels_;
+            if (audio_channels_ == format_desc_.audio_channels) {
+                std::copy_n(audio.begin(), count * audio_channels_, dest);
+            } else {
+                // Channels beyond what the card embeds are dropped, the rest are padded with silence.
+                const auto channels = std::min(audio_channels_, format_desc_.audio_channels);
+                for (int n = 0; n < count; ++n, dest += audio_channels_) {
+                    std::copy_n(audio.begin() + n * format_desc_.audio_channels, channels, dest);
+                    std::fill_n(dest + channels, audio_channels_ - channels, 0);
+                }
+            }
         }
-        audio_data.insert(audio_data.end(), frame.audio_data().begin(), frame.audio_data().end());
+        nb_samples += std::max(count, 0);
+        frames.push_back(std::move(frame));
 
         return true;
     }
 
+    // Requests desc, woven in the field order of the mode if it is interlaced.
+    std::shared_ptr<const core::pixel_format_desc> request_format(const format_request&   request,
+                                                                  core::pixel_format_desc desc) const
+    {
+        if (field_count_ == 2) {
+            desc.woven_line = mode_->GetFieldDominance() == bmdUpperFieldFirst ? 0 : 1;
+        }
+        return request ? request(desc) : nullptr;
+    }
+
+    // Has the mixer render the key, so that it isn't split out of every fill frame on the cpu.
+    std::shared_ptr<const core::pixel_format_desc> request_key_format(const format_request& request) const
+    {
+        if (config_.keyer != configuration::keyer_t::external_separate_device_keyer && !config_.key_only) {
+            return nullptr;
+        }
+        core::pixel_format_desc desc(core::pixel_format::luma);
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, format_desc_.height, 4));
+        return request_format(request, desc);
+    }
+
+    std::shared_ptr<const core::pixel_format_desc> request_fill_format(const format_request& request) const
+    {
+        if (config_.pixel_format == configuration::pixel_format_t::bgra) {
+            return nullptr;
+        }
+        auto format = request_format(
+            request, get_pixel_format_desc(config_.pixel_format, format_desc_.width, format_desc_.height));
+        if (!format) {
+            CASPAR_LOG(warning) << print() << L" The mixer can't render yuv, the driver will convert from bgra.";
+        }
+        return format;
+    }
+
+    // Progressive frames are scheduled as mixed, so bgra is only requested to have the fields woven.
+    std::shared_ptr<const core::pixel_format_desc> request_bgra_format(const format_request& request) const
+    {
+        if (field_count_ != 2) {
+            return nullptr;
+        }
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, format_desc_.height, 4));
+        return request_format(request, desc);
+    }
+
+    // Returns the mixed bgra image, or its conversion to format, one field from each frame in display order. A
+    // single frame, or the last one of a woven format, is scheduled straight from mixer memory, which the returned
+    // buffer keeps alive.
+    std::shared_ptr<void> get_image(const std::vector<core::const_frame>&                 frames,
+                                    const std::shared_ptr<const core::pixel_format_desc>& format)
+    {
+        if (format && format->woven_line >= 0 && !frames.empty()) {
+            auto source = core::converted_frame(frames.back(), format);
+            if (!source) {
+                return nullptr;
+            }
+            return std::shared_ptr<void>(const_cast<std::uint8_t*>(source.image_data(0).data()),
+                                         [source](void*) {});
+        }
+
+        std::vector<const std::uint8_t*> sources;
+        std::vector<core::const_frame>   holders;
+        for (auto& frame : frames) {
+            auto source = frame;
+            if (format) {
+                source = core::converted_frame(frame, format);
+                if (!source) {
+                    // Not rendered by the gpu, e.g. because the frame was mixed before the format was requested.
+                    return nullptr;
+                }
+            }
+            sources.push_back(source.image_data(0).data());
+            holders.push_back(std::move(source));
+        }
+
+        if (sources.size() == 1) {
+            return std::shared_ptr<void>(const_cast<std::uint8_t*>(sources[0]), [holders](void*) {});
+        }
+
+        const auto row_bytes = static_cast<long long>(format ? format->planes[0].linesize : format_desc_.width * 4);
+
+        std::shared_ptr<void> image_data(scalable_aligned_malloc(row_bytes * format_desc_.height, 64),
+                                         scalable_aligned_free);
+
+        const auto first_line = mode_->GetFieldDominance() == bmdUpperFieldFirst ? 0 : 1;
+        for (int n = 0; n < static_cast<int>(sources.size()); ++n) {
+            for (auto y = (first_line + n) % 2; y < format_desc_.height; y += field_count_) {
+                std::memcpy(reinterpret_cast<char*>(image_data.get()) + y * row_bytes,
+                            sources[n] + y * row_bytes,
+                            static_cast<size_t>(row_bytes));
+            }
+        }
+
+        return image_data;
+    }
+
   public:
-    decklink_consumer(const configuration& config, const core::video_format_desc& format_desc, int channel_index)
+    decklink_consumer(const configuration&           config,
+                      const core::video_format_desc& format_desc,
+                      int                            channel_index,
+                      const format_request&          request)
         : channel_index_(channel_index)
         , config_(config)
         , format_desc_(format_desc)
+        , key_format_(request_key_format(request))
+        , fill_format_(request_fill_format(request))
+        , bgra_format_(request_bgra_format(request))
     {
         if (config.keyer == configuration::keyer_t::external_separate_device_keyer) {
             key_context_.reset(new key_video_context(config, print()));
@@ -342,7 +564,9 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         }
 
         set_latency(configuration_, config.latency, print());
-        set_keyer(attributes_, keyer_, config.keyer, print());
+        if (config.pixel_format == configuration::pixel_format_t::bgra) {
+            set_keyer(attributes_, keyer_, config.keyer, print());
+        }
 
         if (config.embedded_audio) {
             output_->BeginAudioPreroll();
@@ -351,11 +575,13 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         for (int n = 0; n < buffer_size_; ++n) {
             auto nb_samples = format_desc_.audio_cadence[n % format_desc_.audio_cadence.size()] * field_count_;
             if (config.embedded_audio) {
-                schedule_next_audio(std::vector<int32_t>(nb_samples * format_desc_.audio_channels), nb_samples);
+                auto slot = next_audio_slot();
+                std::fill_n(slot, nb_samples * audio_channels_, 0);
+                schedule_next_audio(slot, nb_samples);
             }
 
             std::shared_ptr<void> image_data(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-            schedule_next_video(image_data, nb_samples);
+            schedule_next_video(image_data, bmdFormat8BitBGRA, nullptr, nb_samples);
         }
 
         if (config.embedded_audio) {
@@ -383,7 +609,7 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
     {
         if (FAILED(output_->EnableAudioOutput(bmdAudioSampleRate48kHz,
                                               bmdAudioSampleType32bitInteger,
-                                              format_desc_.audio_channels,
+                                              audio_channels_,
                                               bmdAudioOutputStreamTimestamped))) {
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable audio output."));
         }
@@ -432,13 +658,15 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
     HRESULT STDMETHODCALLTYPE ScheduledFrameCompleted(IDeckLinkVideoFrame*           completed_frame,
                                                       BMDOutputFrameCompletionResult result) override
     {
-#ifdef WIN32
         thread_local auto priority_set = false;
         if (!priority_set) {
             priority_set = true;
+#ifdef WIN32
             SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
-        }
 #endif
+            set_thread_role(L"decklink");
+            bind_thread_to_channel(channel_index_);
+        }
         try {
             auto elapsed = tick_timer_.elapsed();
             int  fieldTimeMs = static_cast<int>(1000 / format_desc_.fps);
@@ -489,11 +717,12 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
                 }
             }
 
-            std::shared_ptr<void>     image_data(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-            std::vector<std::int32_t> audio_data;
+            std::vector<core::const_frame> frames;
+            auto                           audio_slot = next_audio_slot();
+            int                            nb_samples = 0;
 
             if (mode_->GetFieldDominance() != bmdProgressiveFrame) {
-                if (!doFrame(image_data, audio_data, mode_->GetFieldDominance() == bmdUpperFieldFirst))
+                if (!doFrame(frames, audio_slot, nb_samples))
                     return E_FAIL;
 
                 // Wait to pull frame for second field...
@@ -502,19 +731,39 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
                 tick_time = tick_timer_.elapsed() * format_desc_.fps * 0.5;
                 graph_->set_value("tick-time-f2", tick_time);
 
-                if (!doFrame(image_data, audio_data, mode_->GetFieldDominance() != bmdUpperFieldFirst))
+                if (!doFrame(frames, audio_slot, nb_samples))
                     return E_FAIL;
             } else {
-                if (!doFrame(image_data, audio_data, true))
+                if (!doFrame(frames, audio_slot, nb_samples))
                     return E_FAIL;
             }
 
-            const auto nb_samples = static_cast<int>(audio_data.size()) / format_desc_.audio_channels;
+            std::shared_ptr<void> key;
+            if (key_context_ || config_.key_only) {
+                key = get_image(frames, key_format_);
+            }
+
+            // Frames the gpu didn't convert are scheduled as bgra, which the driver converts.
+            std::shared_ptr<void> fill;
+            BMDPixelFormat        fill_pix_fmt = bmdFormat8BitBGRA;
+            if (!config_.key_only || !key) {
+                if (fill_format_) {
+                    fill         = get_image(frames, fill_format_);
+                    fill_pix_fmt = fill ? pix_fmt_ : bmdFormat8BitBGRA;
+                }
+                if (!fill && bgra_format_) {
+                    fill         = get_image(frames, bgra_format_);
+                    fill_pix_fmt = bmdFormat8BitBGRA;
+                }
+                if (!fill) {
+                    fill = get_image(frames, nullptr);
+                }
+            }
 
-            schedule_next_video(image_data, nb_samples);
+            schedule_next_video(fill, fill_pix_fmt, key, nb_samples);
 
             if (config_.embedded_audio) {
-                schedule_next_audio(std::move(audio_data), nb_samples);
+                schedule_next_audio(audio_slot, nb_samples);
             }
         } catch (...) {
             std::lock_guard<std::mutex> lock(exception_mutex_);
@@ -537,16 +786,26 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             }
         }
         buffer_cond_.notify_all();
+
+        {
+            std::lock_guard<std::mutex> lock(tick_mutex_);
+            if (tick_ && frame) {
+                tick_();
+            }
+        }
+
         return frame;
     }
 
-    void schedule_next_audio(std::vector<std::int32_t> audio, int nb_samples)
+    void set_frame_clock(std::function<void()> tick)
     {
-        // TODO (refactor) does ScheduleAudioSamples copy data?
-
-        audio_container_.push_back(std::move(audio));
+        std::lock_guard<std::mutex> lock(tick_mutex_);
+        tick_ = std::move(tick);
+    }
 
-        if (FAILED(output_->ScheduleAudioSamples(audio_container_.back().data(),
+    void schedule_next_audio(const std::int32_t* audio, int nb_samples)
+    {
+        if (FAILED(output_->ScheduleAudioSamples(const_cast<std::int32_t*>(audio),
                                                  nb_samples,
                                                  audio_scheduled_,
                                                  format_desc_.audio_sample_rate,
@@ -557,18 +816,18 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         audio_scheduled_ += nb_samples;
     }
 
-    void schedule_next_video(std::shared_ptr<void> fill, int nb_samples)
+    // The key is split out of the fill here unless the gpu already rendered it.
+    void
+    schedule_next_video(std::shared_ptr<void> fill, BMDPixelFormat pix_fmt, std::shared_ptr<void> key, int nb_samples)
     {
-        std::shared_ptr<void> key;
-
-        if (key_context_ || config_.key_only) {
+        if ((key_context_ || config_.key_only) && !key) {
             key = std::shared_ptr<void>(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
 
-            aligned_memshfl(key.get(), fill.get(), format_desc_.size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+            extract_key(key.get(), fill.get(), format_desc_.size);
+        }
 
-            if (config_.key_only) {
-                fill = key;
-            }
+        if (config_.key_only) {
+            fill = key;
         }
 
         if (key_context_) {
@@ -581,7 +840,8 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             }
         }
 
-        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(fill, format_desc_, nb_samples));
+        auto fill_frame =
+            wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(fill, format_desc_, nb_samples, pix_fmt));
         if (FAILED(output_->ScheduleVideoFrame(get_raw(fill_frame),
                                                video_scheduled_,
                                                format_desc_.duration * field_count_,
@@ -629,16 +889,22 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
 
 struct decklink_consumer_proxy : public core::frame_consumer
 {
-    const configuration                config_;
-    std::unique_ptr<decklink_consumer> consumer_;
-    core::video_format_desc            format_desc_;
-    executor                           executor_;
+    const configuration                             config_;
+    std::vector<std::weak_ptr<core::video_channel>> channels_;
+    std::unique_ptr<decklink_consumer>              consumer_;
+    core::video_format_desc                         format_desc_;
+    std::function<void()>                           tick_;
+    executor                                        executor_;
 
   public:
-    explicit decklink_consumer_proxy(const configuration& config)
-        : config_(config)
+    decklink_consumer_proxy(const configuration& config, std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : config_(validate_pixel_format(config))
         , executor_(L"decklink_consumer[" + std::to_wstring(config.device_index) + L"]")
     {
+        for (auto& channel : channels) {
+            channels_.push_back(static_cast<std::shared_ptr<core::video_channel>>(channel));
+        }
+
         executor_.begin_invoke([=] { com_initialize(); });
     }
 
@@ -656,12 +922,30 @@ struct decklink_consumer_proxy : public core::frame_consumer
     void initialize(const core::video_format_desc& format_desc, int channel_index) override
     {
         format_desc_ = format_desc;
+
+        format_request request = [=](const core::pixel_format_desc& desc) {
+            return request_format(desc, channel_index);
+        };
+
         executor_.invoke([=] {
             consumer_.reset();
-            consumer_.reset(new decklink_consumer(config_, format_desc, channel_index));
+            consumer_.reset(new decklink_consumer(config_, format_desc, channel_index, request));
+            consumer_->set_frame_clock(tick_);
         });
     }
 
+    std::shared_ptr<const core::pixel_format_desc> request_format(const core::pixel_format_desc& desc,
+                                                                  int                            channel_index)
+    {
+        for (auto& weak_channel : channels_) {
+            auto channel = weak_channel.lock();
+            if (channel && channel->index() == channel_index) {
+                return channel->mixer().request_format(desc);
+            }
+        }
+        return nullptr;
+    }
+
     std::future<bool> send(core::const_frame frame) override
     {
         return executor_.begin_invoke([=] { return consumer_->send(frame); });
@@ -674,6 +958,17 @@ struct decklink_consumer_proxy : public core::frame_consumer
     int index() const override { return 300 + config_.device_index; }
 
     bool has_synchronization_clock() const override { return true; }
+
+    // The card takes a frame from the buffer every time it completes one, on the hardware clock.
+    void set_frame_clock(std::function<void()> tick) override
+    {
+        executor_.begin_invoke([=] {
+            tick_ = tick;
+            if (consumer_) {
+                consumer_->set_frame_clock(tick);
+            }
+        });
+    }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
@@ -705,7 +1000,13 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     config.embedded_audio = contains_param(L"EMBEDDED_AUDIO", params);
     config.key_only       = contains_param(L"KEY_ONLY", params);
 
-    return spl::make_shared<decklink_consumer_proxy>(config);
+    if (contains_param(L"UYVY", params)) {
+        config.pixel_format = configuration::pixel_format_t::uyvy;
+    } else if (contains_param(L"V210", params)) {
+        config.pixel_format = configuration::pixel_format_t::v210;
+    }
+
+    return spl::make_shared<decklink_consumer_proxy>(config, std::move(channels));
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -730,13 +1031,20 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
         config.latency = configuration::latency_t::normal_latency;
     }
 
+    auto pixel_format = ptree.get(L"pixel-format", L"bgra");
+    if (pixel_format == L"uyvy") {
+        config.pixel_format = configuration::pixel_format_t::uyvy;
+    } else if (pixel_format == L"v210") {
+        config.pixel_format = configuration::pixel_format_t::v210;
+    }
+
     config.key_only          = ptree.get(L"key-only", config.key_only);
     config.device_index      = ptree.get(L"device", config.device_index);
     config.key_device_idx    = ptree.get(L"key-device", config.key_device_idx);
     config.embedded_audio    = ptree.get(L"embedded-audio", config.embedded_audio);
     config.base_buffer_depth = ptree.get(L"buffer-depth", config.base_buffer_depth);
 
-    return spl::make_shared<decklink_consumer_proxy>(config);
+    return spl::make_shared<decklink_consumer_proxy>(config, std::move(channels));
 }
 
 }} // namespace caspar::decklink
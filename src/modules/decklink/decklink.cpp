@@ -22,11 +22,13 @@
 #include "StdAfx.h"
 
 #include "decklink.h"
+#include "util/reference_clock.h"
 #include "util/util.h"
 
 #include "consumer/decklink_consumer.h"
 #include "producer/decklink_producer.h"
 
+#include <core/consumer/clock_source.h>
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
 
@@ -72,6 +74,9 @@ void init(core::module_dependencies dependencies)
     dependencies.consumer_registry->register_consumer_factory(L"Decklink Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"decklink", create_preconfigured_consumer);
     dependencies.producer_registry->register_producer_factory(L"Decklink Producer", create_producer);
+    core::register_clock_source(L"decklink", [](const std::wstring& device) {
+        return std::make_shared<reference_clock>(device.empty() ? 1 : std::stoi(device));
+    });
 }
 
 }} // namespace caspar::decklink
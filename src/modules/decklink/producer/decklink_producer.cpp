@@ -23,6 +23,7 @@
 
 #include "decklink_producer.h"
 
+#include "../util/memory_allocator.h"
 #include "../util/util.h"
 
 #include <common/diagnostics/graph.h>
@@ -35,6 +36,7 @@
 
 #include <ffmpeg/util/av_assert.h>
 #include <ffmpeg/util/av_util.h>
+#include <ffmpeg/util/frame_sync.h>
 
 #include <core/diagnostics/call_context.h>
 #include <core/frame/draw_frame.h>
@@ -42,8 +44,6 @@
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
 
-#include <tbb/concurrent_queue.h>
-
 #include <boost/algorithm/string.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -69,12 +69,44 @@ extern "C" {
 
 #include <boost/format.hpp>
 
+#include <deque>
+
 #include "../decklink_api.h"
 
 using namespace caspar::ffmpeg;
 
 namespace caspar { namespace decklink {
 
+// Hands the captured bytes to ffmpeg by reference, so that filters don't copy them. The reference holds on to
+// the DeckLink frame or packet, which returns its buffer to the allocator once released.
+template <typename T>
+void ref_bytes(AVFrame* frame, T* source, void* bytes, int size)
+{
+    source->AddRef();
+    frame->buf[0] = av_buffer_create(
+        reinterpret_cast<uint8_t*>(bytes), size, [](void* opaque, uint8_t*) { static_cast<T*>(opaque)->Release(); },
+        source, AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0]) {
+        source->Release();
+        FF_RET(AVERROR(ENOMEM), "av_buffer_create");
+    }
+}
+
+// Progressive input at the channel's resolution and frame rate needs neither deinterlacing, scaling nor rate
+// conversion, so unless a filter is asked for its frames are passed on as captured and converted on the gpu.
+bool is_passthrough(const std::string&             filter_spec,
+                    const core::video_format_desc& format_desc,
+                    com_ptr<IDeckLinkDisplayMode>  dm)
+{
+    BMDTimeScale timeScale;
+    BMDTimeValue frameDuration;
+    dm->GetFrameRate(&frameDuration, &timeScale);
+
+    return filter_spec.empty() && dm->GetFieldDominance() == bmdProgressiveFrame &&
+           dm->GetWidth() == format_desc.width && dm->GetHeight() == format_desc.height &&
+           boost::rational<int>(timeScale / 1000, frameDuration / 1000) == format_desc.framerate;
+}
+
 struct Filter
 {
     std::shared_ptr<AVFilterGraph> graph        = nullptr;
@@ -210,10 +242,7 @@ struct Filter
                                                             << msg_info_t("only single audio input supported"));
                 }
 
-                auto args = (boost::format("time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=%#x") % 1 %
-                             format_desc.audio_sample_rate % format_desc.audio_sample_rate % AV_SAMPLE_FMT_S32 %
-                             av_get_default_channel_layout(format_desc.audio_channels))
-                                .str();
+                auto args = abuffer_args(format_desc);
                 auto name = (boost::format("in_%d") % 0).str();
 
                 FF(avfilter_graph_create_filter(
@@ -245,11 +274,11 @@ struct Filter
 #pragma warning(push)
 #pragma warning(disable : 4245)
 #endif
-            AVSampleFormat sample_fmts[]     = {AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_NONE};
-            int64_t        channel_layouts[] = {av_get_default_channel_layout(format_desc.audio_channels), 0};
-            int            sample_rates[]    = {format_desc.audio_sample_rate, 0};
+            AVSampleFormat sample_fmts[]    = {AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_NONE};
+            int            channel_counts[] = {format_desc.audio_channels, -1};
+            int            sample_rates[]   = {format_desc.audio_sample_rate, 0};
             FF(av_opt_set_int_list(sink, "sample_fmts", sample_fmts, -1, AV_OPT_SEARCH_CHILDREN));
-            FF(av_opt_set_int_list(sink, "channel_layouts", channel_layouts, 0, AV_OPT_SEARCH_CHILDREN));
+            FF(av_opt_set_int_list(sink, "channel_counts", channel_counts, -1, AV_OPT_SEARCH_CHILDREN));
             FF(av_opt_set_int_list(sink, "sample_rates", sample_rates, 0, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -292,6 +321,7 @@ class decklink_producer : public IDeckLinkInputCallback
     com_ptr<IDeckLink>                 decklink_   = get_device(device_index_);
     com_iface_ptr<IDeckLinkInput>      input_      = iface_cast<IDeckLinkInput>(decklink_);
     com_iface_ptr<IDeckLinkAttributes> attributes_ = iface_cast<IDeckLinkAttributes>(decklink_);
+    com_ptr<memory_allocator>          allocator_;
 
     const std::wstring model_name_ = get_model_name(decklink_);
 
@@ -305,8 +335,9 @@ class decklink_producer : public IDeckLinkInputCallback
     bool freeze_on_lost_;
     bool has_signal_;
 
-    tbb::concurrent_bounded_queue<core::draw_frame> frame_buffer_;
-    core::draw_frame                                last_frame_;
+    // Absorbs the drift between the clock of the input and that of the channel.
+    FrameSync        sync_;
+    core::draw_frame last_frame_;
 
     std::exception_ptr exception_;
 
@@ -320,6 +351,9 @@ class decklink_producer : public IDeckLinkInputCallback
     Filter video_filter_;
     Filter audio_filter_;
 
+    bool                                 passthrough_ = false;
+    std::deque<std::shared_ptr<AVFrame>> video_frames_;
+
   public:
     decklink_producer(const core::video_format_desc&              format_desc,
                       int                                         device_index,
@@ -332,6 +366,7 @@ class decklink_producer : public IDeckLinkInputCallback
         , format_desc_(format_desc)
         , frame_factory_(frame_factory)
         , freeze_on_lost_(freeze_on_lost)
+        , sync_(this, frame_factory, format_desc, graph_)
         , input_format(format_desc_)
         , vfilter_(vfilter)
         , afilter_(afilter)
@@ -344,11 +379,10 @@ class decklink_producer : public IDeckLinkInputCallback
         mode_         = get_display_mode(input_, input_format.format, bmdFormat8BitYUV, bmdVideoOutputFlagDefault);
         video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_);
         audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_);
+        passthrough_  = is_passthrough(vfilter_, format_desc_, mode_);
 
         boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
 
-        frame_buffer_.set_capacity(3);
-
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("frame-time", diagnostics::color(1.0f, 0.0f, 0.0f));
@@ -370,6 +404,13 @@ class decklink_producer : public IDeckLinkInputCallback
             flags = 0;
         }
 
+        allocator_ = wrap_raw<com_ptr>(new memory_allocator(frame_factory_));
+        allocator_->set_upload(passthrough_);
+
+        if (FAILED(input_->SetVideoInputFrameMemoryAllocator(get_raw(allocator_)))) {
+            CASPAR_LOG(warning) << print() << L" Failed to set video input allocator.";
+        }
+
         if (FAILED(input_->EnableVideoInput(mode_->GetDisplayMode(), bmdFormat8BitYUV, flags))) {
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable video input.")
                                                       << boost::errinfo_api_function("EnableVideoInput"));
@@ -430,6 +471,10 @@ class decklink_producer : public IDeckLinkInputCallback
 
             video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_);
             audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_);
+            passthrough_  = is_passthrough(vfilter_, format_desc_, mode_);
+            allocator_->set_upload(passthrough_);
+            video_frames_.clear();
+            sync_.clear();
 
             // reinitializing video input with the new display mode
             if (FAILED(input_->EnableVideoInput(newMode, bmdFormat8BitYUV, bmdVideoInputEnableFormatDetection))) {
@@ -468,7 +513,7 @@ class decklink_producer : public IDeckLinkInputCallback
                 state_["file/audio/channels"]    = format_desc_.audio_channels;
                 state_["file/fps"]               = format_desc_.fps;
                 state_["profiler/time"]          = {frame_timer.elapsed(), format_desc_.fps};
-                state_["buffer"]                 = {frame_buffer_.size(), frame_buffer_.capacity()};
+                state_["buffer"]                 = {sync_.size(), sync_.capacity()};
                 state_["has_signal"]             = has_signal_;
 
                 if (video) {
@@ -479,7 +524,7 @@ class decklink_producer : public IDeckLinkInputCallback
 
             graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
             graph_->set_value("output-buffer",
-                              static_cast<float>(frame_buffer_.size()) / static_cast<float>(frame_buffer_.capacity()));
+                              static_cast<float>(sync_.size()) / static_cast<float>(sync_.capacity()));
         };
 
         try {
@@ -514,8 +559,7 @@ class decklink_producer : public IDeckLinkInputCallback
 
                 void* video_bytes = nullptr;
                 if (SUCCEEDED(video->GetBytes(&video_bytes)) && video_bytes) {
-                    video->AddRef();
-                    src = std::shared_ptr<AVFrame>(src.get(), [src, video](AVFrame* ptr) { video->Release(); });
+                    ref_bytes(src.get(), video, video_bytes, video->GetRowBytes() * video->GetHeight());
 
                     src->data[0]     = reinterpret_cast<uint8_t*>(video_bytes);
                     src->linesize[0] = video->GetRowBytes();
@@ -525,7 +569,13 @@ class decklink_producer : public IDeckLinkInputCallback
                         src->pts = in_video_pts;
                     }
 
-                    if (video_filter_.video_source) {
+                    if (passthrough_) {
+                        video_frames_.push_back(src);
+                        if (video_frames_.size() > sync_.capacity()) {
+                            video_frames_.pop_front();
+                            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                        }
+                    } else if (video_filter_.video_source) {
                         FF(av_buffersrc_write_frame(video_filter_.video_source, src.get()));
                     }
                     if (audio_filter_.video_source) {
@@ -542,13 +592,13 @@ class decklink_producer : public IDeckLinkInputCallback
 
                 void* audio_bytes = nullptr;
                 if (SUCCEEDED(audio->GetBytes(&audio_bytes)) && audio_bytes) {
-                    audio->AddRef();
-                    src = std::shared_ptr<AVFrame>(src.get(), [src, audio](AVFrame* ptr) { audio->Release(); });
                     src->nb_samples  = audio->GetSampleFrameCount();
                     src->data[0]     = reinterpret_cast<uint8_t*>(audio_bytes);
                     src->linesize[0] = src->nb_samples * src->channels *
                                        av_get_bytes_per_sample(static_cast<AVSampleFormat>(src->format));
 
+                    ref_bytes(src.get(), audio, audio_bytes, src->linesize[0]);
+
                     if (SUCCEEDED(audio->GetPacketTime(&in_audio_pts, format_desc_.audio_sample_rate))) {
                         src->pts = in_audio_pts;
                     }
@@ -569,8 +619,9 @@ class decklink_producer : public IDeckLinkInputCallback
 
                     // TODO (fix) this may get stuck if the decklink sends a frame of video or audio
 
-                    if (av_buffersink_get_frame_flags(video_filter_.sink, av_video.get(), AV_BUFFERSINK_FLAG_PEEK) <
-                        0) {
+                    if (passthrough_ ? video_frames_.empty()
+                                     : av_buffersink_get_frame_flags(
+                                           video_filter_.sink, av_video.get(), AV_BUFFERSINK_FLAG_PEEK) < 0) {
                         return S_OK;
                     }
 
@@ -585,10 +636,16 @@ class decklink_producer : public IDeckLinkInputCallback
 
                 // TODO (fix) auto V/A sync even if decklink is wrong.
 
-                av_buffersink_get_frame(video_filter_.sink, av_video.get());
+                auto video_tb = AVRational{1, AV_TIME_BASE};
+                if (passthrough_) {
+                    av_video = video_frames_.front();
+                    video_frames_.pop_front();
+                } else {
+                    av_buffersink_get_frame(video_filter_.sink, av_video.get());
+                    video_tb = av_buffersink_get_time_base(video_filter_.sink);
+                }
                 av_buffersink_get_samples(audio_filter_.sink, av_audio.get(), audio_cadence_[0]);
 
-                auto video_tb = av_buffersink_get_time_base(video_filter_.sink);
                 auto audio_tb = av_buffersink_get_time_base(audio_filter_.sink);
 
                 CASPAR_LOG(debug) << av_video->pts << " " << av_audio->pts;
@@ -611,13 +668,12 @@ class decklink_producer : public IDeckLinkInputCallback
                 graph_->set_value("in-sync", in_sync * 2.0 + 0.5);
                 graph_->set_value("out-sync", out_sync * 2.0 + 0.5);
 
-                auto frame = core::draw_frame(make_frame(this, *frame_factory_, av_video, av_audio));
-                if (!frame_buffer_.try_push(frame)) {
-                    core::draw_frame dummy;
-                    frame_buffer_.try_pop(dummy);
-                    frame_buffer_.try_push(frame);
-                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-                }
+                // The audio goes through the sync on its own, to be resampled to the clock of the channel.
+                auto frame = core::draw_frame(
+                    passthrough_ ? make_passthrough_frame(av_video)
+                                 : make_frame(this, *frame_factory_, av_video, nullptr, format_desc_.audio_channels));
+                sync_.push(
+                    std::move(frame), reinterpret_cast<const std::int32_t*>(av_audio->data[0]), av_audio->nb_samples);
 
                 boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
             }
@@ -629,28 +685,47 @@ class decklink_producer : public IDeckLinkInputCallback
         return S_OK;
     }
 
-    core::draw_frame get_frame(bool use_last_frame)
+    // Frames captured into upload buffers are handed to the mixer as they are, others are copied.
+    core::mutable_frame make_passthrough_frame(const std::shared_ptr<AVFrame>& video)
+    {
+        const auto desc = pixel_format_desc(AV_PIX_FMT_UYVY422, video->width, video->height);
+
+        auto data = video->linesize[0] == desc.planes.at(0).linesize ? allocator_->take(video->data[0])
+                                                                     : array<std::uint8_t>{};
+        if (!data) {
+            return make_frame(this, *frame_factory_, video, nullptr, format_desc_.audio_channels);
+        }
+
+        std::vector<array<std::uint8_t>> planes;
+        planes.push_back(std::move(data));
+
+        return core::mutable_frame(this, std::move(planes), array<std::int32_t>{}, desc);
+    }
+
+    core::draw_frame get_frame(bool use_last_frame, int nb_samples)
     {
         if (exception_ != nullptr) {
             std::rethrow_exception(exception_);
         }
 
-        core::draw_frame frame;
+        auto frame = sync_.pop(nb_samples > 0 ? nb_samples : format_desc_.audio_cadence[0]);
 
-        if (!frame_buffer_.try_pop(frame)) {
-            if (freeze_on_lost_ || use_last_frame)
-                frame = last_frame_;
+        if (!frame) {
+            // The last frame is repeated without its audio.
+            if ((freeze_on_lost_ || use_last_frame) && last_frame_)
+                frame = core::draw_frame::still(last_frame_);
             graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
         } else {
             last_frame_ = frame;
         }
 
-        graph_->set_value("output-buffer",
-                          static_cast<float>(frame_buffer_.size()) / static_cast<float>(frame_buffer_.capacity()));
+        graph_->set_value("output-buffer", static_cast<float>(sync_.size()) / static_cast<float>(sync_.capacity()));
 
         return frame;
     }
 
+    core::draw_frame last_frame() { return last_frame_ ? last_frame_ : get_frame(true, 0); }
+
     std::wstring print() const
     {
         return model_name_ + L" [" + std::to_wstring(device_index_) + L"|" + input_format.name + L"]";
@@ -704,11 +779,11 @@ class decklink_producer_proxy : public core::frame_producer
 
     // frame_producer
 
-    core::draw_frame receive_impl(int nb_samples) override { return producer_->get_frame(false); }
+    core::draw_frame receive_impl(int nb_samples) override { return producer_->get_frame(false, nb_samples); }
 
     core::draw_frame first_frame() override { return receive_impl(0); }
 
-    core::draw_frame last_frame() override { return core::draw_frame::still(producer_->get_frame(true)); }
+    core::draw_frame last_frame() override { return core::draw_frame::still(producer_->last_frame()); }
 
     uint32_t nb_frames() const override { return length_; }
 
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../decklink_api.h"
+
+#include <common/array.h>
+#include <common/log.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+
+#include <tbb/scalable_allocator.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+namespace caspar { namespace decklink {
+
+// Pooled, aligned buffers for captured frames. The driver only allocates up front from its own pool, so frames that
+// are held on to by reference, e.g. by a deinterlacer, would otherwise stall the capture. In upload mode buffers
+// are taken from the upload pool of frame_factory instead, so that unfiltered frames go to the gpu as captured.
+class memory_allocator : public IDeckLinkMemoryAllocator
+{
+    std::atomic<int> ref_count_{0};
+
+    const std::shared_ptr<core::frame_factory> frame_factory_;
+    std::atomic<bool>                          upload_{false};
+
+    std::mutex                           mutex_;
+    std::multimap<unsigned int, void*>   free_;
+    std::map<void*, unsigned int>        sizes_;
+    std::map<void*, array<std::uint8_t>> uploads_;
+    std::multiset<void*>                 taken_;
+
+  public:
+    explicit memory_allocator(std::shared_ptr<core::frame_factory> frame_factory = nullptr)
+        : frame_factory_(std::move(frame_factory))
+    {
+    }
+
+    memory_allocator(const memory_allocator&) = delete;
+    memory_allocator& operator=(const memory_allocator&) = delete;
+
+    virtual ~memory_allocator() { Decommit(); }
+
+    // Applies to buffers allocated from now on, the driver keeps using the ones it already has.
+    void set_upload(bool upload) { upload_ = upload && frame_factory_; }
+
+    // Hands the upload buffer starting at bytes over to the caller, or returns an empty array if it isn't one.
+    // The driver still releases the buffer later, which is then ignored.
+    array<std::uint8_t> take(void* bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = uploads_.find(bytes);
+        if (it == uploads_.end()) {
+            return {};
+        }
+        auto data = std::move(it->second);
+        uploads_.erase(it);
+        taken_.insert(bytes);
+
+        return data;
+    }
+
+    // IUnknown
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) override { return E_NOINTERFACE; }
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++ref_count_; }
+
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        if (--ref_count_ == 0) {
+            delete this;
+
+            return 0;
+        }
+
+        return ref_count_;
+    }
+
+    // IDeckLinkMemoryAllocator
+
+    HRESULT STDMETHODCALLTYPE AllocateBuffer(unsigned int size, void** buffer) override
+    {
+        if (upload_) {
+            try {
+                core::pixel_format_desc desc(core::pixel_format::gray);
+                desc.planes.push_back(core::pixel_format_desc::plane(static_cast<int>(size), 1, 1));
+
+                auto data = std::move(frame_factory_->create_frame(this, desc).image_data(0));
+                *buffer   = data.data();
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                uploads_.emplace(*buffer, std::move(data));
+
+                return S_OK;
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                return E_OUTOFMEMORY;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = free_.find(size);
+        if (it != free_.end()) {
+            *buffer = it->second;
+            free_.erase(it);
+            return S_OK;
+        }
+
+        *buffer = scalable_aligned_malloc(size, 64);
+        if (!*buffer) {
+            return E_OUTOFMEMORY;
+        }
+        sizes_[*buffer] = size;
+
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE ReleaseBuffer(void* buffer) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto taken = taken_.find(buffer);
+        if (taken != taken_.end()) {
+            taken_.erase(taken);
+            return S_OK;
+        }
+
+        if (uploads_.erase(buffer) > 0) {
+            return S_OK;
+        }
+
+        auto it = sizes_.find(buffer);
+        if (it == sizes_.end()) {
+            return E_INVALIDARG;
+        }
+        free_.emplace(it->second, buffer);
+
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Commit() override { return S_OK; }
+
+    HRESULT STDMETHODCALLTYPE Decommit() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& p : free_) {
+            sizes_.erase(p.second);
+            scalable_aligned_free(p.second);
+        }
+        free_.clear();
+
+        return S_OK;
+    }
+};
+
+}} // namespace caspar::decklink
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../decklink_api.h"
+#include "util.h"
+
+#include <common/except.h>
+
+#include <core/consumer/clock_source.h>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace decklink {
+
+// The hardware clock of a card, which is locked to its reference input when there is one, so that IP channels can
+// be paced by house reference with configuration.output.clock set to decklink. Its epoch is arbitrary.
+class reference_clock : public core::clock_source
+{
+    const int                      device_index_;
+    com_ptr<IDeckLink>             decklink_;
+    com_iface_ptr<IDeckLinkOutput> output_;
+
+  public:
+    explicit reference_clock(int device_index)
+        : device_index_(device_index)
+        , decklink_(get_device(device_index))
+        , output_(iface_cast<IDeckLinkOutput>(decklink_))
+    {
+        reference_signal_detector(output_).detect_change([this] { return print(); });
+    }
+
+    std::int64_t now() const override
+    {
+        BMDTimeValue hardware_time   = 0;
+        BMDTimeValue time_in_frame   = 0;
+        BMDTimeValue ticks_per_frame = 0;
+        if (FAILED(output_->GetHardwareReferenceClock(1000000000, &hardware_time, &time_in_frame, &ticks_per_frame))) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not read the reference clock."));
+        }
+        return hardware_time;
+    }
+
+    std::wstring print() const override { return L"decklink[" + std::to_wstring(device_index_) + L"]"; }
+};
+
+}} // namespace caspar::decklink
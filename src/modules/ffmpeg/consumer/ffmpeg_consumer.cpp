@@ -20,24 +20,35 @@
  */
 
 #include "ffmpeg_consumer.h"
+#include "paced_output.h"
+#include "segment_writer.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
+#include "../util/page_cache.h"
 
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/executor.h>
 #include <common/future.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
+#include <common/utf.h>
 
+#include <core/channel_arena.h>
+#include <core/diagnostics/memory.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/mixer.h>
+#include <core/video_channel.h>
 #include <core/video_format.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/regex.hpp>
 
@@ -57,7 +68,9 @@ extern "C" {
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
 #include <libswscale/swscale.h>
@@ -68,18 +81,198 @@ extern "C" {
 
 #include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
-#include <tbb/parallel_invoke.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 namespace caspar { namespace ffmpeg {
 
 // TODO multiple output streams
 // TODO multiple output files
-// TODO run video filter, video encoder, audio filter, audio encoder in separate threads.
 // TODO realtime with smaller buffer?
 
+using latency_clock = std::chrono::steady_clock;
+
+// What the consumer gives up when encoding can't keep up: the frames that don't fit (newest), the frames that have
+// waited the longest (oldest) or video bitrate (quality), in which case frames that don't fit are dropped as well.
+enum class drop_policy
+{
+    newest,
+    oldest,
+    quality,
+};
+
+struct latency_control
+{
+    drop_policy               policy = drop_policy::newest;
+    std::chrono::milliseconds max_latency{0};
+    std::atomic<double>       quality{1.0};
+};
+
+struct Packet
+{
+    std::shared_ptr<AVPacket> packet;
+    latency_clock::time_point time; // When the frame it was encoded from was sent to the consumer.
+};
+
+double elapsed_ms(latency_clock::time_point time)
+{
+    return std::chrono::duration<double, std::milli>(latency_clock::now() - time).count();
+}
+
+using request_format_t =
+    std::function<std::shared_ptr<const core::pixel_format_desc>(const core::pixel_format_desc& desc)>;
+
+// Picks the encoder input format closest to yuva422p, which is what the cpu path produces, that the mixer could
+// convert to.
+AVPixelFormat get_gpu_pix_fmt(const AVPixelFormat* pix_fmts)
+{
+    static const AVPixelFormat gpu_pix_fmts[] = {AV_PIX_FMT_YUVA422P,
+                                                 AV_PIX_FMT_YUVA420P,
+                                                 AV_PIX_FMT_YUVA444P,
+                                                 AV_PIX_FMT_YUV422P,
+                                                 AV_PIX_FMT_YUV420P,
+                                                 AV_PIX_FMT_YUV444P,
+                                                 AV_PIX_FMT_YUV422P10,
+                                                 AV_PIX_FMT_YUV420P10,
+                                                 AV_PIX_FMT_YUV444P10,
+                                                 AV_PIX_FMT_NV12,
+                                                 AV_PIX_FMT_P010};
+
+    if (!pix_fmts) {
+        return AV_PIX_FMT_YUVA422P;
+    }
+
+    std::vector<AVPixelFormat> candidates;
+    for (auto pix_fmt = pix_fmts; *pix_fmt != AV_PIX_FMT_NONE; ++pix_fmt) {
+        if (std::find(std::begin(gpu_pix_fmts), std::end(gpu_pix_fmts), *pix_fmt) != std::end(gpu_pix_fmts)) {
+            candidates.push_back(*pix_fmt);
+        }
+    }
+    if (candidates.empty()) {
+        return AV_PIX_FMT_YUVA422P;
+    }
+    candidates.push_back(AV_PIX_FMT_NONE);
+
+    return avcodec_find_best_pix_fmt_of_list(candidates.data(), AV_PIX_FMT_YUVA422P, 1, nullptr);
+}
+
+// Returns the config of encoders that only take frames in device memory, e.g. the vaapi ones. Others, nvenc and qsv
+// included, upload system memory frames themselves.
+const AVCodecHWConfig* get_hw_frames_config(const AVCodec* codec)
+{
+    if (codec->type != AVMEDIA_TYPE_VIDEO || !codec->pix_fmts) {
+        return nullptr;
+    }
+
+    for (auto pix_fmt = codec->pix_fmts; *pix_fmt != AV_PIX_FMT_NONE; ++pix_fmt) {
+        if (!(av_pix_fmt_desc_get(*pix_fmt)->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            return nullptr;
+        }
+    }
+
+    for (int n = 0;; ++n) {
+        auto config = avcodec_get_hw_config(codec, n);
+        if (!config || config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_FRAMES_CTX) {
+            return config;
+        }
+    }
+}
+
+// Options applied to well known encoders unless set by the user.
+void set_default_options(const AVCodec* codec, bool realtime, std::map<std::string, std::string>& options)
+{
+    const std::string name = codec->name;
+
+    if (name == "libx264") {
+        options.emplace("preset", "veryfast");
+    } else if (name == "h264_nvenc" || name == "hevc_nvenc") {
+        options.emplace("preset", "fast");
+        if (realtime) {
+            options.emplace("zerolatency", "1");
+        }
+    } else if (name == "h264_qsv" || name == "hevc_qsv") {
+        options.emplace("preset", "veryfast");
+        if (realtime) {
+            options.emplace("async_depth", "1");
+        }
+    } else if (name == "h264_vaapi" || name == "hevc_vaapi") {
+        if (realtime) {
+            options.emplace("bf", "0");
+        }
+    }
+}
+
+void free_frame(void* opaque, uint8_t* data) { delete static_cast<core::const_frame*>(opaque); }
+
+// Sample aspect ratio of the channel picture scaled to width x height.
+AVRational get_sar(const core::video_format_desc& format_desc, int width, int height)
+{
+    const auto sar = boost::rational<int>(format_desc.square_width, format_desc.square_height) /
+                     boost::rational<int>(width, height);
+    return {sar.numerator(), sar.denominator()};
+}
+
+// Parses a ladder spec such as 1920x1080,1280x720,854x480.
+std::vector<std::pair<int, int>> parse_ladder(const std::string& spec)
+{
+    static const boost::regex size_exp("(\\d+)x(\\d+)");
+
+    std::vector<std::string> sizes;
+    boost::split(sizes, spec, boost::is_any_of(","));
+
+    std::vector<std::pair<int, int>> ladder;
+    for (auto& size : sizes) {
+        boost::smatch what;
+        if (!boost::regex_match(size, what, size_exp)) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid ladder size " + size));
+        }
+
+        // Even sizes, so that subsampled chroma lines up.
+        const auto width  = std::stoi(what[1].str()) & ~1;
+        const auto height = std::stoi(what[2].str()) & ~1;
+        if (width <= 0 || height <= 0) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid ladder size " + size));
+        }
+        ladder.emplace_back(width, height);
+    }
+    return ladder;
+}
+
+// Wraps the planes of a frame converted by the mixer without copying them.
+std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, AVPixelFormat pix_fmt, AVRational sar)
+{
+    auto av_frame = alloc_frame();
+
+    const auto& planes = frame.pixel_format_desc().planes;
+
+    av_frame->sample_aspect_ratio = sar;
+    av_frame->width               = planes.at(0).width;
+    av_frame->height              = planes.at(0).height;
+    av_frame->format              = pix_fmt;
+
+    for (int n = 0; n < static_cast<int>(planes.size()); ++n) {
+        auto data = const_cast<uint8_t*>(frame.image_data(n).data());
+
+        av_frame->buf[n] = av_buffer_create(
+            data, planes[n].size, free_frame, new core::const_frame(frame), AV_BUFFER_FLAG_READONLY);
+        if (!av_frame->buf[n]) {
+            FF_RET(AVERROR(ENOMEM), "av_buffer_create");
+        }
+        av_frame->data[n]     = data;
+        av_frame->linesize[n] = planes[n].linesize;
+    }
+
+    return av_frame;
+}
+
 struct Stream
 {
     std::shared_ptr<AVFilterGraph> graph  = nullptr;
@@ -91,14 +284,51 @@ struct Stream
 
     tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
 
+    // Video is fed to the filter graph as input_pix_fmt_. With a gpu_format_ the mixer converts it, otherwise (and
+    // for frames mixed before the request) swscale does.
+    AVPixelFormat                            input_pix_fmt_ = AV_PIX_FMT_YUVA422P;
+    std::shared_ptr<const core::pixel_format_desc> gpu_format_;
+
+    // Frames context that filtered frames are uploaded to for encoders that only take device memory.
+    std::shared_ptr<AVBufferRef> hw_frames_;
+
+    // Size of the video fed to the filter graph, which is smaller than the channel for ladder renditions.
+    int width_  = 0;
+    int height_ = 0;
+
     int64_t pts = 0;
 
+    // Filtering and encoding run as separate stages, each on its own thread behind a bounded queue. Scaling runs in
+    // the arena of the channel.
+    std::string                                             name_;
+    int                                                     channel_ = -1;
+    std::shared_ptr<diagnostics::graph>                     graph_;
+    tbb::concurrent_bounded_queue<std::pair<core::const_frame, latency_clock::time_point>> input_;
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVFrame>>                                filtered_;
+    std::thread                                             filter_thread_;
+    std::thread                                             encode_thread_;
+    std::exception_ptr                                      exception_;
+    std::mutex                                              exception_mutex_;
+
+    // Send times by source pts, from which the latency of each stage is measured.
+    AVRational                                   source_time_base_{0, 1};
+    std::map<int64_t, latency_clock::time_point> times_;
+    std::mutex                                   times_mutex_;
+    std::atomic<double>                          queue_latency_{0.0};
+    std::atomic<double>                          encode_latency_{0.0};
+    int64_t                                      bit_rate_ = 0;
+
     Stream(AVFormatContext*                    oc,
            std::string                         suffix,
            AVCodecID                           codec_id,
            const core::video_format_desc&      format_desc,
+           int                                 width,
+           int                                 height,
            bool                                realtime,
-           std::map<std::string, std::string>& options)
+           std::map<std::string, std::string>& options,
+           const request_format_t&             request_format)
+        : width_(width)
+        , height_(height)
     {
         std::map<std::string, std::string> stream_options;
 
@@ -136,6 +366,40 @@ struct Stream
             FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
         }
 
+        set_default_options(codec, realtime, stream_options);
+
+        // The filter graph outputs system memory frames, for hardware only encoders in a format the device takes.
+        const auto                   hw_config = get_hw_frames_config(codec);
+        std::vector<AVPixelFormat>   hw_sw_pix_fmts;
+        std::shared_ptr<AVBufferRef> hw_device;
+        if (hw_config) {
+            std::string device_name;
+            {
+                const auto it = stream_options.find("hwdevice");
+                if (it != stream_options.end()) {
+                    device_name = std::move(it->second);
+                    stream_options.erase(it);
+                }
+            }
+
+            AVBufferRef* device = nullptr;
+            FF(av_hwdevice_ctx_create(
+                &device, hw_config->device_type, device_name.empty() ? nullptr : device_name.c_str(), nullptr, 0));
+            hw_device = std::shared_ptr<AVBufferRef>(device, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+
+            hw_sw_pix_fmts = {AV_PIX_FMT_NV12, AV_PIX_FMT_P010, AV_PIX_FMT_NONE};
+        }
+        const auto sw_pix_fmts = hw_config ? hw_sw_pix_fmts.data() : codec->pix_fmts;
+
+        if (codec->type == AVMEDIA_TYPE_VIDEO && request_format) {
+            const auto pix_fmt = get_gpu_pix_fmt(sw_pix_fmts);
+
+            gpu_format_ = request_format(pixel_format_desc(pix_fmt, width_, height_));
+            if (gpu_format_) {
+                input_pix_fmt_ = pix_fmt;
+            }
+        }
+
         AVFilterInOut* outputs = nullptr;
         AVFilterInOut* inputs  = nullptr;
 
@@ -176,26 +440,26 @@ struct Stream
             }
 
             if (codec->type == AVMEDIA_TYPE_VIDEO) {
-                const auto sar = boost::rational<int>(format_desc.square_width, format_desc.square_height) /
-                                 boost::rational<int>(format_desc.width, format_desc.height);
+                const auto sar = get_sar(format_desc, width_, height_);
 
                 auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:sar=%d/%d:frame_rate=%d/%d") %
-                             format_desc.width % format_desc.height % AV_PIX_FMT_YUVA422P % format_desc.duration %
-                             format_desc.time_scale % sar.numerator() % sar.denominator() %
+                             width_ % height_ % input_pix_fmt_ % format_desc.duration %
+                             format_desc.time_scale % sar.num % sar.den %
                              format_desc.framerate.numerator() % format_desc.framerate.denominator())
                                 .str();
                 auto name = (boost::format("in_%d") % 0).str();
 
+                source_time_base_ = {format_desc.duration, format_desc.time_scale};
+
                 FF(avfilter_graph_create_filter(
                     &source, avfilter_get_by_name("buffer"), name.c_str(), args.c_str(), nullptr, graph.get()));
                 FF(avfilter_link(source, 0, cur->filter_ctx, cur->pad_idx));
             } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
-                auto args = (boost::format("time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=%#x") % 1 %
-                             format_desc.audio_sample_rate % format_desc.audio_sample_rate % AV_SAMPLE_FMT_S32 %
-                             av_get_default_channel_layout(format_desc.audio_channels))
-                                .str();
+                auto args = abuffer_args(format_desc);
                 auto name = (boost::format("in_%d") % 0).str();
 
+                source_time_base_ = {1, format_desc.audio_sample_rate};
+
                 FF(avfilter_graph_create_filter(
                     &source, avfilter_get_by_name("abuffer"), name.c_str(), args.c_str(), nullptr, graph.get()));
                 FF(avfilter_link(source, 0, cur->filter_ctx, cur->pad_idx));
@@ -216,7 +480,7 @@ struct Stream
             // TODO codec->profiles
             // TODO FF(av_opt_set_int_list(sink, "framerates", codec->supported_framerates, { 0, 0 },
             // AV_OPT_SEARCH_CHILDREN));
-            FF(av_opt_set_int_list(sink, "pix_fmts", codec->pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+            FF(av_opt_set_int_list(sink, "pix_fmts", sw_pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -278,6 +542,25 @@ struct Stream
             enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink);
             enc->time_base           = st->time_base;
             enc->pix_fmt             = static_cast<AVPixelFormat>(av_buffersink_get_format(sink));
+
+            if (hw_config) {
+                auto frames = av_hwframe_ctx_alloc(hw_device.get());
+                if (!frames) {
+                    FF_RET(AVERROR(ENOMEM), "av_hwframe_ctx_alloc");
+                }
+                hw_frames_ = std::shared_ptr<AVBufferRef>(frames, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+
+                auto frames_ctx               = reinterpret_cast<AVHWFramesContext*>(hw_frames_->data);
+                frames_ctx->format            = hw_config->pix_fmt;
+                frames_ctx->sw_format         = enc->pix_fmt;
+                frames_ctx->width             = enc->width;
+                frames_ctx->height            = enc->height;
+                frames_ctx->initial_pool_size = 32;
+                FF(av_hwframe_ctx_init(hw_frames_.get()));
+
+                enc->pix_fmt       = hw_config->pix_fmt;
+                enc->hw_frames_ctx = av_buffer_ref(hw_frames_.get());
+            }
         } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
             st->time_base = {1, av_buffersink_get_sample_rate(sink)};
 
@@ -318,7 +601,7 @@ struct Stream
         }
     }
 
-    std::shared_ptr<SwsContext> get_sws(int width, int height)
+    std::shared_ptr<SwsContext> get_sws(int width, int height, int dst_width, int dst_height)
     {
         std::shared_ptr<SwsContext> sws;
 
@@ -326,8 +609,18 @@ struct Stream
             return sws;
         }
 
-        sws.reset(sws_getContext(
-                      width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUVA422P, 0, nullptr, nullptr, nullptr),
+        const auto flags = width == dst_width && height == dst_height ? 0 : SWS_BICUBIC;
+
+        sws.reset(sws_getContext(width,
+                                 height,
+                                 AV_PIX_FMT_BGRA,
+                                 dst_width,
+                                 dst_height,
+                                 input_pix_fmt_,
+                                 flags,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr),
                   [](SwsContext* ptr) { sws_freeContext(ptr); });
 
         if (!sws) {
@@ -356,53 +649,212 @@ struct Stream
         return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
     }
 
-    void send(core::const_frame&                             in_frame,
-              const core::video_format_desc&                 format_desc,
-              std::function<void(std::shared_ptr<AVPacket>)> cb)
+    ~Stream()
     {
-        std::shared_ptr<AVFrame>  frame;
-        std::shared_ptr<AVPacket> pkt;
+        input_.abort();
+        filtered_.abort();
+        if (filter_thread_.joinable()) {
+            filter_thread_.join();
+        }
+        if (encode_thread_.joinable()) {
+            encode_thread_.join();
+        }
+    }
+
+    void start(const std::string&                  name,
+               int                                 channel,
+               std::shared_ptr<diagnostics::graph> graph,
+               const core::video_format_desc&      format_desc,
+               bool                                realtime,
+               const latency_control&              latency,
+               std::function<void(Packet)>         cb)
+    {
+        bit_rate_ = enc->bit_rate;
+
+        name_    = name;
+        channel_ = channel;
+        graph_   = std::move(graph);
+        graph_->set_color(name_ + "-filter", diagnostics::color(0.4f, 0.8f, 0.8f));
+        graph_->set_color(name_ + "-encode", diagnostics::color(0.8f, 0.8f, 0.4f));
+
+        input_.set_capacity(realtime ? 1 : 8);
+        filtered_.set_capacity(realtime ? 1 : 8);
+
+        filter_thread_ = std::thread([=, &latency] {
+            run(L"filter", [&] {
+                while (true) {
+                    std::pair<core::const_frame, latency_clock::time_point> entry;
+                    input_.pop(entry);
+                    update_graph();
+
+                    queue_latency_ = elapsed_ms(entry.second);
+
+                    if (entry.first && latency.policy == drop_policy::oldest &&
+                        latency.max_latency.count() > 0 &&
+                        latency_clock::now() - entry.second > latency.max_latency) {
+                        skip(entry.first, format_desc);
+                        graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                        continue;
+                    }
+
+                    if (!filter(entry.first, entry.second, format_desc)) {
+                        break;
+                    }
+                }
+            });
+        });
+
+        encode_thread_ = std::thread([=, &latency] {
+            run(L"encode", [&] {
+                while (true) {
+                    std::shared_ptr<AVFrame> frame;
+                    filtered_.pop(frame);
+                    update_graph();
+                    if (!encode(frame, latency.quality, cb)) {
+                        break;
+                    }
+                }
+            });
+        });
+    }
+
+    // An empty frame flushes the stream, after which stop() returns once everything is encoded.
+    void send(const core::const_frame& frame, latency_clock::time_point time)
+    {
+        rethrow();
+        input_.push(std::make_pair(frame, time));
+        update_graph();
+    }
+
+    // Milliseconds from the consumer receiving the last frames to them being filtered and encoded.
+    double queue_latency() const { return queue_latency_; }
+    double encode_latency() const { return encode_latency_; }
+
+    void stop()
+    {
+        filter_thread_.join();
+        encode_thread_.join();
+        rethrow();
+    }
+
+  private:
+    void run(const std::wstring& stage, const std::function<void()>& func)
+    {
+        try {
+            set_thread_name(L"[ffmpeg::consumer::" + u16(name_) + L"-" + stage + L"]");
+            func();
+        } catch (tbb::user_abort&) {
+            // Unblock the other stage.
+            input_.abort();
+            filtered_.abort();
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(exception_mutex_);
+                exception_ = std::current_exception();
+            }
+            input_.abort();
+            filtered_.abort();
+        }
+    }
+
+    void rethrow()
+    {
+        std::lock_guard<std::mutex> lock(exception_mutex_);
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+    }
+
+    void update_graph()
+    {
+        graph_->set_value(name_ + "-filter", static_cast<double>(input_.size() + 0.001) / input_.capacity());
+        graph_->set_value(name_ + "-encode", static_cast<double>(filtered_.size() + 0.001) / filtered_.capacity());
+    }
+
+    // Drops a frame, leaving a gap in the timestamps for the time it would have taken.
+    void skip(const core::const_frame& in_frame, const core::video_format_desc& format_desc)
+    {
+        if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+            pts += 1;
+        } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
+            pts += in_frame.audio_data().size() / format_desc.audio_channels;
+        }
+    }
+
+    // Returns when the frame that ts (enc time base) was encoded from was sent.
+    latency_clock::time_point get_time(int64_t ts)
+    {
+        std::lock_guard<std::mutex> lock(times_mutex_);
+
+        auto it = times_.upper_bound(av_rescale_q(ts, enc->time_base, source_time_base_));
+        if (it == times_.begin()) {
+            return latency_clock::now();
+        }
+        auto time = std::prev(it)->second;
+        times_.erase(times_.begin(), std::prev(it));
+        return time;
+    }
+
+    // Returns false once the filter graph has been flushed.
+    bool filter(const core::const_frame&       in_frame,
+                latency_clock::time_point      time,
+                const core::video_format_desc& format_desc)
+    {
+        if (in_frame) {
+            std::lock_guard<std::mutex> lock(times_mutex_);
+            times_[pts] = time;
+        }
+
+        std::shared_ptr<AVFrame> frame;
 
         if (in_frame) {
             if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-                frame = make_av_video_frame(in_frame, format_desc);
+                auto converted = core::converted_frame(in_frame, gpu_format_);
+                if (converted) {
+                    frame = make_av_video_frame(converted, input_pix_fmt_, get_sar(format_desc, width_, height_));
+                } else {
+                    frame = make_av_video_frame(in_frame, format_desc);
+
+                    const auto pix_desc = av_pix_fmt_desc_get(input_pix_fmt_);
 
-                {
                     auto frame2                 = alloc_frame();
-                    frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
-                    frame2->width               = frame->width;
-                    frame2->height              = frame->height;
-                    frame2->format              = AV_PIX_FMT_YUVA422P;
-                    frame2->colorspace          = AVCOL_SPC_BT709;
-                    frame2->color_primaries     = AVCOL_PRI_BT709;
-                    frame2->color_range         = AVCOL_RANGE_MPEG;
-                    frame2->color_trc           = AVCOL_TRC_BT709;
+                    frame2->sample_aspect_ratio = get_sar(format_desc, width_, height_);
+                    frame2->width               = width_;
+                    frame2->height              = height_;
+                    frame2->format              = input_pix_fmt_;
                     av_frame_get_buffer(frame2.get(), 64);
 
-                    int h = frame->height / 8;
-                    tbb::parallel_for(0, 8, [&](int i) {
-                        auto sws = get_sws(frame->width, h);
+                    // Slices have to start on a chroma row, and scaling needs the whole picture.
+                    const bool scaled = frame->width != width_ || frame->height != height_;
+                    const int  slices = !scaled && frame->height % (8 << pix_desc->log2_chroma_h) == 0 ? 8 : 1;
 
-                        uint8_t* src[4] = {};
-                        src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
+                    int h  = frame->height / slices;
+                    int h2 = height_ / slices;
+                    core::execute_in_channel_arena(channel_, [&] {
+                        tbb::parallel_for(0, slices, [&](int i) {
+                            auto sws = get_sws(frame->width, h, width_, h2);
 
-                        uint8_t* dst[4] = {};
-                        dst[0]          = frame2->data[0] + frame2->linesize[0] * (i * h);
-                        dst[1]          = frame2->data[1] + frame2->linesize[1] * (i * h);
-                        dst[2]          = frame2->data[2] + frame2->linesize[2] * (i * h);
-                        dst[3]          = frame2->data[3] + frame2->linesize[3] * (i * h);
+                            uint8_t* src[4] = {};
+                            src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
 
-                        sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
-                    });
+                            uint8_t* dst[4] = {};
+                            for (int n = 0; n < 4 && frame2->data[n]; ++n) {
+                                const auto shift = n == 1 || n == 2 ? pix_desc->log2_chroma_h : 0;
+                                dst[n]           = frame2->data[n] + frame2->linesize[n] * ((i * h2) >> shift);
+                            }
 
-                    int i = frame->height - h;
-                    if (i > 0) {
-                        // TODO
-                    }
+                            sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
+                        });
+                    });
 
                     frame = std::move(frame2);
                 }
 
+                frame->colorspace      = AVCOL_SPC_BT709;
+                frame->color_primaries = AVCOL_PRI_BT709;
+                frame->color_range     = AVCOL_RANGE_MPEG;
+                frame->color_trc       = AVCOL_TRC_BT709;
+
                 frame->pts = pts;
                 pts += 1;
             } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
@@ -418,29 +870,58 @@ struct Stream
         }
 
         while (true) {
-            pkt     = alloc_packet();
-            int ret = avcodec_receive_packet(enc.get(), pkt.get());
+            frame   = alloc_frame();
+            int ret = av_buffersink_get_frame(sink, frame.get());
+            if (ret == AVERROR(EAGAIN)) {
+                return true;
+            }
+            if (ret == AVERROR_EOF) {
+                filtered_.push(nullptr);
+                return false;
+            }
+            FF_RET(ret, "av_buffersink_get_frame");
+            filtered_.push(std::move(frame));
+        }
+    }
+
+    // Returns false once the encoder has been flushed.
+    bool encode(std::shared_ptr<AVFrame> frame, double quality, const std::function<void(Packet)>& cb)
+    {
+        // Encoders like libx264 and nvenc pick up bitrate changes on the next frame.
+        if (frame && bit_rate_ > 0 && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+            const auto bit_rate = static_cast<int64_t>(bit_rate_ * quality);
+            if (std::abs(bit_rate - enc->bit_rate) > bit_rate_ / 20) {
+                enc->bit_rate = bit_rate;
+            }
+        }
+
+        if (frame && hw_frames_) {
+            auto hw_frame = alloc_frame();
+            FF(av_hwframe_get_buffer(hw_frames_.get(), hw_frame.get(), 0));
+            FF(av_hwframe_transfer_data(hw_frame.get(), frame.get(), 0));
+            FF(av_frame_copy_props(hw_frame.get(), frame.get()));
+            frame = std::move(hw_frame);
+        }
+
+        FF(avcodec_send_frame(enc.get(), frame.get()));
 
+        while (true) {
+            auto pkt = alloc_packet();
+            int  ret = avcodec_receive_packet(enc.get(), pkt.get());
             if (ret == AVERROR(EAGAIN)) {
-                frame = alloc_frame();
-                ret   = av_buffersink_get_frame(sink, frame.get());
-                if (ret == AVERROR(EAGAIN)) {
-                    return;
-                }
-                if (ret == AVERROR_EOF) {
-                    FF(avcodec_send_frame(enc.get(), nullptr));
-                } else {
-                    FF_RET(ret, "av_buffersink_get_frame");
-                    FF(avcodec_send_frame(enc.get(), frame.get()));
-                }
-            } else if (ret == AVERROR_EOF) {
-                return;
-            } else {
-                FF_RET(ret, "avcodec_receive_packet");
-                pkt->stream_index = st->index;
-                av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
-                cb(std::move(pkt));
+                return true;
+            }
+            if (ret == AVERROR_EOF) {
+                return false;
             }
+            FF_RET(ret, "avcodec_receive_packet");
+
+            const auto time = get_time(pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts);
+            encode_latency_ = elapsed_ms(time);
+
+            pkt->stream_index = st->index;
+            av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
+            cb(Packet{std::move(pkt), time});
         }
     }
 };
@@ -458,14 +939,25 @@ struct ffmpeg_consumer : public core::frame_consumer
     std::string path_;
     std::string args_;
 
+    std::vector<std::weak_ptr<core::video_channel>> channels_;
+
     std::exception_ptr exception_;
     std::mutex         exception_mutex_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
-    std::thread                                      frame_thread_;
+    latency_control latency_;
+
+    tbb::concurrent_bounded_queue<std::pair<core::const_frame, latency_clock::time_point>> frame_buffer_;
+    std::thread                                                                            frame_thread_;
+
+    // Frames waiting in frame_buffer_ are charged to the channel, new ones are dropped while it is over its cap.
+    std::shared_ptr<core::diagnostics::memory_account> memory_;
+    std::atomic<std::int64_t>                          buffered_bytes_{0};
 
   public:
-    ffmpeg_consumer(std::string path, std::string args, bool realtime)
+    ffmpeg_consumer(std::string                                       path,
+                    std::string                                       args,
+                    bool                                              realtime,
+                    std::vector<spl::shared_ptr<core::video_channel>> channels)
         : channel_index_([&] {
             boost::crc_16_type result;
             result.process_bytes(path.data(), path.length());
@@ -475,9 +967,11 @@ struct ffmpeg_consumer : public core::frame_consumer
         , path_(std::move(path))
         , args_(std::move(args))
     {
-        state_["file/path"] = u8(path_);
+        for (auto& channel : channels) {
+            channels_.push_back(static_cast<std::shared_ptr<core::video_channel>>(channel));
+        }
 
-        frame_buffer_.set_capacity(realtime_ ? 1 : 64);
+        state_["file/path"] = u8(path_);
 
         diagnostics::register_graph(graph_);
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
@@ -488,9 +982,26 @@ struct ffmpeg_consumer : public core::frame_consumer
     ~ffmpeg_consumer()
     {
         if (frame_thread_.joinable()) {
-            frame_buffer_.push(core::const_frame{});
+            frame_buffer_.push(std::make_pair(core::const_frame{}, latency_clock::now()));
             frame_thread_.join();
         }
+        if (memory_) {
+            memory_->add(core::diagnostics::memory_kind::host, -buffered_bytes_);
+        }
+    }
+
+    void charge(const core::const_frame& frame, std::int64_t sign)
+    {
+        if (!memory_ || !frame) {
+            return;
+        }
+
+        std::int64_t bytes = frame.audio_data().size() * sizeof(std::int32_t);
+        for (auto& plane : frame.pixel_format_desc().planes) {
+            bytes += plane.size;
+        }
+        buffered_bytes_ += sign * bytes;
+        memory_->add(core::diagnostics::memory_kind::host, sign * bytes);
     }
 
     // frame consumer
@@ -503,25 +1014,104 @@ struct ffmpeg_consumer : public core::frame_consumer
 
         format_desc_   = format_desc;
         channel_index_ = channel_index;
+        memory_        = core::diagnostics::memory_account::for_owner({channel_index, -1});
 
         graph_->set_text(print());
 
-        frame_thread_ = std::thread([=] {
-            try {
-                std::map<std::string, std::string> options;
-                {
-                    static boost::regex opt_exp("-(?<NAME>[^-\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
-                    for (auto it = boost::sregex_iterator(args_.begin(), args_.end(), opt_exp);
-                         it != boost::sregex_iterator();
-                         ++it) {
-                        options[(*it)["NAME"].str().c_str()] =
-                            (*it)["VALUE"].matched ? (*it)["VALUE"].str().c_str() : "";
-                    }
+        std::map<std::string, std::string> options;
+        {
+            static boost::regex opt_exp("-(?<NAME>[^-\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
+            for (auto it = boost::sregex_iterator(args_.begin(), args_.end(), opt_exp); it != boost::sregex_iterator();
+                 ++it) {
+                options[(*it)["NAME"].str().c_str()] = (*it)["VALUE"].matched ? (*it)["VALUE"].str().c_str() : "";
+            }
+        }
+
+        // -max_latency bounds the frames buffered ahead of the encoders, -drop picks what gives way when it's reached.
+        {
+            const auto it = options.find("drop");
+            if (it != options.end()) {
+                if (it->second == "newest") {
+                    latency_.policy = drop_policy::newest;
+                } else if (it->second == "oldest") {
+                    latency_.policy = drop_policy::oldest;
+                } else if (it->second == "quality") {
+                    latency_.policy = drop_policy::quality;
+                } else {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid drop policy: " + it->second));
+                }
+                options.erase(it);
+            }
+        }
+        {
+            const auto it = options.find("max_latency");
+            if (it != options.end()) {
+                latency_.max_latency = std::chrono::milliseconds(boost::lexical_cast<int64_t>(it->second));
+                options.erase(it);
+            }
+        }
+
+        const auto buffer_size = [=](int size) {
+            if (!realtime_) {
+                return size;
+            }
+            if (latency_.max_latency.count() <= 0) {
+                return 1;
+            }
+            return std::max(1, static_cast<int>(latency_.max_latency.count() * format_desc.fps / 1000.0));
+        };
+
+        // -segment records into files of about that many seconds each, see SegmentWriter.
+        double segment_duration = 0.0;
+        {
+            const auto it = options.find("segment");
+            if (it != options.end()) {
+                segment_duration = boost::lexical_cast<double>(it->second);
+                if (segment_duration <= 0.0) {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid segment duration: " + it->second));
                 }
+                options.erase(it);
+            }
+        }
+
+        // -pace [bitrate] sends udp:// at a steady bitrate, -muxrate if none is given, which the ts is padded to.
+        int64_t pace_rate = 0;
+        {
+            const auto it = options.find("pace");
+            if (it != options.end()) {
+                const auto muxrate = options.find("muxrate");
+                if (!it->second.empty()) {
+                    pace_rate = boost::lexical_cast<int64_t>(it->second);
+                } else if (muxrate != options.end()) {
+                    pace_rate = boost::lexical_cast<int64_t>(muxrate->second);
+                }
+                if (pace_rate <= 0) {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info("-pace needs a bitrate, or -muxrate."));
+                }
+                if (muxrate == options.end()) {
+                    options["muxrate"] = std::to_string(pace_rate);
+                }
+                options.erase("pace");
+            }
+        }
+
+        // Two seconds of frames without realtime, within a budget so that large formats stay bounded.
+        frame_buffer_.set_capacity(buffer_size(core::diagnostics::buffer_frames(
+            env::properties().get(L"configuration.ffmpeg.consumer.buffer-duration", 2.0),
+            format_desc.fps,
+            static_cast<std::int64_t>(format_desc.size),
+            env::properties().get(L"configuration.ffmpeg.consumer.buffer-budget", std::int64_t(512)) * 1024 * 1024,
+            2)));
+
+        frame_thread_ = std::thread([=, options = std::move(options)]() mutable {
+            try {
 
                 boost::filesystem::path full_path = path_;
 
                 static boost::regex prot_exp("^.+:.*");
+                if (segment_duration > 0.0 && boost::regex_match(path_, prot_exp)) {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info("Only files can be segmented: " + path_));
+                }
                 if (!boost::regex_match(path_, prot_exp)) {
                     if (!full_path.is_complete()) {
                         full_path = u8(env::media_folder()) + path_;
@@ -553,30 +1143,104 @@ struct ffmpeg_consumer : public core::frame_consumer
 
                 CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
 
-                boost::optional<Stream> video_stream;
+                request_format_t request_format;
+                if (env::properties().get(L"configuration.ffmpeg.consumer.gpu-convert", true)) {
+                    for (auto& weak_channel : channels_) {
+                        auto channel = weak_channel.lock();
+                        if (channel && channel->index() == channel_index) {
+                            request_format = [weak_channel](const core::pixel_format_desc& desc) {
+                                auto channel = weak_channel.lock();
+                                return channel ? channel->mixer().request_format(desc) : nullptr;
+                            };
+                        }
+                    }
+                }
+
+                // A ladder encodes one video stream per size, each scaled by the mixer when converting on the gpu.
+                std::vector<std::pair<int, int>> ladder;
+                {
+                    const auto it = options.find("ladder");
+                    if (it != options.end()) {
+                        ladder = parse_ladder(it->second);
+                        options.erase(it);
+                    }
+                }
+
+                std::vector<std::unique_ptr<Stream>> streams;
                 if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
-                    if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
-                        options["preset:v"] = "veryfast";
+                    if (ladder.empty()) {
+                        streams.push_back(std::make_unique<Stream>(oc,
+                                                                   ":v",
+                                                                   oc->oformat->video_codec,
+                                                                   format_desc,
+                                                                   format_desc.width,
+                                                                   format_desc.height,
+                                                                   realtime_,
+                                                                   options,
+                                                                   request_format));
+                    } else {
+                        // Options for all renditions (-b:v) give way to those for a single one (-b:v:1).
+                        for (auto& p : std::map<std::string, std::string>(options)) {
+                            if (boost::algorithm::ends_with(p.first, ":v")) {
+                                for (auto n = 0U; n < ladder.size(); ++n) {
+                                    options.emplace(p.first + ":" + std::to_string(n), p.second);
+                                }
+                                options.erase(p.first);
+                            }
+                        }
+                        for (auto n = 0U; n < ladder.size(); ++n) {
+                            streams.push_back(std::make_unique<Stream>(oc,
+                                                                       ":v:" + std::to_string(n),
+                                                                       oc->oformat->video_codec,
+                                                                       format_desc,
+                                                                       ladder[n].first,
+                                                                       ladder[n].second,
+                                                                       realtime_,
+                                                                       options,
+                                                                       request_format));
+                        }
                     }
-                    video_stream.emplace(oc, ":v", oc->oformat->video_codec, format_desc, realtime_, options);
 
                     {
                         std::lock_guard<std::mutex> lock(state_mutex_);
-                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_stream->sink));
+                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(streams.front()->sink));
                     }
                 }
 
-                boost::optional<Stream> audio_stream;
                 if (oc->oformat->audio_codec != AV_CODEC_ID_NONE) {
-                    audio_stream.emplace(oc, ":a", oc->oformat->audio_codec, format_desc, realtime_, options);
+                    streams.push_back(std::make_unique<Stream>(oc,
+                                                               ":a",
+                                                               oc->oformat->audio_codec,
+                                                               format_desc,
+                                                               format_desc.width,
+                                                               format_desc.height,
+                                                               realtime_,
+                                                               options,
+                                                               request_format));
                 }
 
-                if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                std::unique_ptr<SegmentWriter> segments;
+                std::unique_ptr<PacedOutput>   paced;
+                std::unique_ptr<CacheWindow>   cache_window;
+                if (pace_rate > 0) {
+                    if (std::string(oc->oformat->name) != "mpegts") {
+                        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Only mpegts can be paced."));
+                    }
+                    paced  = std::make_unique<PacedOutput>(path_, pace_rate);
+                    oc->pb = paced->pb();
+                } else if (segment_duration > 0.0) {
+                    segments = std::make_unique<SegmentWriter>(oc,
+                                                               full_path.string(),
+                                                               segment_duration,
+                                                               AVRational{format_desc.duration, format_desc.time_scale},
+                                                               options);
+                } else if (!(oc->oformat->flags & AVFMT_NOFILE)) {
                     // TODO (fix) interrupt_cb
                     auto dict = to_dict(std::move(options));
                     CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
                     FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
                     options = to_map(&dict);
+                    cache_window = std::make_unique<CacheWindow>(full_path.string(), true);
                 }
 
                 {
@@ -592,34 +1256,63 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 }
 
-                tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
-                packet_buffer.set_capacity(realtime_ ? 1 : 128);
+                std::vector<AVStream*> sts;
+                for (auto& stream : streams) {
+                    sts.push_back(stream->st);
+                }
+
+                std::vector<std::string>   names;
+                std::map<int, std::string> stream_names;
+                for (auto n = 0U; n < streams.size(); ++n) {
+                    auto name = streams[n]->enc->codec_type == AVMEDIA_TYPE_VIDEO ? std::string("video") : "audio";
+                    if (ladder.size() > 1 && name == "video") {
+                        name += "-" + std::to_string(n);
+                    }
+                    names.push_back(name);
+                    stream_names[streams[n]->st->index] = name;
+                }
+
+                tbb::concurrent_bounded_queue<Packet> packet_buffer;
+                packet_buffer.set_capacity(buffer_size(128));
                 auto packet_thread = std::thread([&] {
                     try {
                         CASPAR_SCOPE_EXIT
                         {
-                            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                            if (!segments && !paced && !(oc->oformat->flags & AVFMT_NOFILE)) {
                                 FF(avio_closep(&oc->pb));
                             }
                         };
 
                         std::map<int, int64_t> count;
 
-                        std::shared_ptr<AVPacket> pkt;
+                        Packet pkt;
                         while (true) {
                             packet_buffer.pop(pkt);
-                            if (!pkt) {
+                            if (!pkt.packet) {
                                 break;
                             }
-                            count[pkt->stream_index] += 1;
-                            FF(av_interleaved_write_frame(oc, pkt.get()));
-                        }
+                            const auto index = pkt.packet->stream_index;
+                            count[index] += 1;
+                            if (segments) {
+                                segments->write(pkt.packet.get());
+                            } else {
+                                FF(av_interleaved_write_frame(oc, pkt.packet.get()));
+                                if (cache_window) {
+                                    cache_window->advance(avio_tell(oc->pb));
+                                }
+                            }
 
-                        auto video_st = video_stream ? video_stream->st : nullptr;
-                        auto audio_st = audio_stream ? audio_stream->st : nullptr;
+                            // Includes output to the network for streams, as far as avio blocks on it.
+                            std::lock_guard<std::mutex> lock(state_mutex_);
+                            state_["file/" + stream_names[index] + "/latency/write"] = elapsed_ms(pkt.time);
+                        }
 
-                        if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
-                            FF(av_write_trailer(oc));
+                        if (std::all_of(sts.begin(), sts.end(), [&](AVStream* st) { return count[st->index] > 0; })) {
+                            if (segments) {
+                                segments->close();
+                            } else {
+                                FF(av_write_trailer(oc));
+                            }
                         }
 
                     } catch (...) {
@@ -632,13 +1325,22 @@ struct ffmpeg_consumer : public core::frame_consumer
                 {
                     if (packet_thread.joinable()) {
                         // TODO Is nullptr needed?
-                        packet_buffer.push(nullptr);
+                        packet_buffer.push(Packet{});
                         packet_buffer.abort();
                         packet_thread.join();
                     }
                 };
 
-                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) { packet_buffer.push(std::move(pkt)); };
+                auto packet_cb = [&](Packet pkt) { packet_buffer.push(std::move(pkt)); };
+
+                for (auto n = 0U; n < streams.size(); ++n) {
+                    streams[n]->start(names[n], channel_index_, graph_, format_desc, realtime_, latency_, packet_cb);
+                }
+                CASPAR_SCOPE_EXIT
+                {
+                    // Stop the stream stages before the packet buffer they write to goes away.
+                    streams.clear();
+                };
 
                 std::int32_t frame_number = 0;
                 while (true) {
@@ -647,31 +1349,36 @@ struct ffmpeg_consumer : public core::frame_consumer
                         state_["file/frame"] = frame_number++;
                     }
 
-                    core::const_frame frame;
-                    frame_buffer_.pop(frame);
+                    std::pair<core::const_frame, latency_clock::time_point> entry;
+                    frame_buffer_.pop(entry);
+                    charge(entry.first, -1);
                     graph_->set_value("input",
                                       static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
                     caspar::timer frame_timer;
-                    tbb::parallel_invoke(
-                        [&] {
-                            if (video_stream) {
-                                video_stream->send(frame, format_desc, packet_cb);
-                            }
-                        },
-                        [&] {
-                            if (audio_stream) {
-                                audio_stream->send(frame, format_desc, packet_cb);
-                            }
-                        });
+                    for (auto& stream : streams) {
+                        stream->send(entry.first, entry.second);
+                    }
                     graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
 
-                    if (!frame) {
-                        packet_buffer.push(nullptr);
+                    {
+                        std::lock_guard<std::mutex> lock(state_mutex_);
+                        for (auto n = 0U; n < streams.size(); ++n) {
+                            state_["file/" + names[n] + "/latency/queue"]  = streams[n]->queue_latency();
+                            state_["file/" + names[n] + "/latency/encode"] = streams[n]->encode_latency();
+                        }
+                    }
+
+                    if (!entry.first) {
                         break;
                     }
                 }
 
+                for (auto& stream : streams) {
+                    stream->stop();
+                }
+                packet_buffer.push(Packet{});
+
                 packet_thread.join();
             } catch (...) {
                 std::lock_guard<std::mutex> lock(exception_mutex_);
@@ -689,8 +1396,32 @@ struct ffmpeg_consumer : public core::frame_consumer
             }
         }
 
-        if (!frame_buffer_.try_push(frame)) {
+        auto entry = std::make_pair(std::move(frame), latency_clock::now());
+
+        // Charged before it is pushed, so that the frame thread never releases more than was charged.
+        const auto capped = memory_ && memory_->over_cap() && frame_buffer_.size() > 1;
+        if (!capped) {
+            charge(entry.first, 1);
+        }
+
+        if (capped) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        } else if (latency_.policy == drop_policy::oldest) {
+            std::pair<core::const_frame, latency_clock::time_point> oldest;
+            while (!frame_buffer_.try_push(entry)) {
+                if (frame_buffer_.try_pop(oldest)) {
+                    charge(oldest.first, -1);
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                }
+            }
+        } else if (!frame_buffer_.try_push(entry)) {
+            charge(entry.first, -1);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            if (latency_.policy == drop_policy::quality) {
+                latency_.quality = std::max(0.5, latency_.quality * 0.9);
+            }
+        } else if (latency_.policy == drop_policy::quality && frame_buffer_.size() <= 1) {
+            latency_.quality = std::min(1.0, latency_.quality + 0.01);
         }
         graph_->set_value("input", static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
@@ -723,7 +1454,8 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     for (auto n = 2; n < params.size(); ++n) {
         args.emplace_back(u8(params[n]));
     }
-    return spl::make_shared<ffmpeg_consumer>(path, boost::join(args, " "), boost::iequals(params.at(0), L"STREAM"));
+    return spl::make_shared<ffmpeg_consumer>(
+        path, boost::join(args, " "), boost::iequals(params.at(0), L"STREAM"), std::move(channels));
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -732,6 +1464,7 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
 {
     return spl::make_shared<ffmpeg_consumer>(u8(ptree.get<std::wstring>(L"path", L"")),
                                              u8(ptree.get<std::wstring>(L"args", L"")),
-                                             ptree.get(L"realtime", false));
+                                             ptree.get(L"realtime", false),
+                                             std::move(channels));
 }
 }} // namespace caspar::ffmpeg
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paced_output.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/asio.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int DATAGRAM_SIZE = 7 * 188;
+const int MAX_BATCH     = 32;
+
+struct datagram
+{
+    std::array<uint8_t, DATAGRAM_SIZE> data;
+    int                                size = 0;
+};
+
+} // namespace
+
+struct PacedOutput::impl
+{
+    using clock = std::chrono::steady_clock;
+
+    const std::string url_;
+    const double      rate_; // Bytes per second.
+    const double      burst_;
+
+    boost::asio::io_service        service_;
+    boost::asio::ip::udp::socket   socket_{service_};
+    boost::asio::ip::udp::endpoint endpoint_;
+
+    std::vector<datagram>                    pool_;
+    tbb::concurrent_bounded_queue<datagram*> free_;
+    tbb::concurrent_bounded_queue<datagram*> ready_;
+
+    AVIOContext* pb_ = nullptr;
+    std::thread  thread_;
+
+    impl(const std::string& url, int64_t bitrate)
+        : url_(url)
+        , rate_(static_cast<double>(bitrate) / 8.0)
+        , burst_(std::max(4.0 * DATAGRAM_SIZE, rate_ * 0.001))
+        , pool_(std::max<size_t>(64, static_cast<size_t>(rate_ * 0.5 / DATAGRAM_SIZE)))
+    {
+        if (bitrate <= 0) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid pacing bitrate for " + url));
+        }
+
+        char proto[16];
+        char host[256];
+        char path[1024];
+        int  port = -1;
+        av_url_split(proto, sizeof(proto), nullptr, 0, host, sizeof(host), &port, path, sizeof(path), url.c_str());
+        if (strcmp(proto, "udp") != 0 || port <= 0) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Only udp://host:port can be paced: " + url));
+        }
+
+        boost::asio::ip::udp::resolver resolver(service_);
+        endpoint_ = *resolver.resolve({host, std::to_string(port)});
+        socket_.open(endpoint_.protocol());
+
+        char ttl[16];
+        const auto query = strchr(path, '?');
+        if (query && av_find_info_tag(ttl, sizeof(ttl), "ttl", query) && endpoint_.address().is_multicast()) {
+            socket_.set_option(boost::asio::ip::multicast::hops(atoi(ttl)));
+        }
+
+        for (auto& d : pool_) {
+            free_.push(&d);
+        }
+
+        auto buffer = static_cast<uint8_t*>(av_malloc(DATAGRAM_SIZE));
+        if (buffer) {
+            pb_ = avio_alloc_context(buffer, DATAGRAM_SIZE, 1, this, nullptr, write_packet, nullptr);
+        }
+        if (!pb_) {
+            av_free(buffer);
+            throw std::bad_alloc();
+        }
+        pb_->max_packet_size = DATAGRAM_SIZE;
+
+        thread_ = std::thread([this] {
+            try {
+                set_thread_name(L"[ffmpeg::paced_output]");
+                set_thread_role(L"network");
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        avio_flush(pb_);
+        ready_.push(nullptr);
+        thread_.join();
+
+        av_freep(&pb_->buffer);
+        avio_context_free(&pb_);
+    }
+
+    // avio flushes a full buffer at a time, so each call but the last one is one datagram.
+    static int write_packet(void* opaque, uint8_t* buf, int size)
+    {
+        auto self = static_cast<impl*>(opaque);
+
+        datagram* d = nullptr;
+        self->free_.pop(d);
+        d->size = std::min(size, DATAGRAM_SIZE);
+        std::memcpy(d->data.data(), buf, d->size);
+        self->ready_.push(d);
+
+        return size;
+    }
+
+    void run()
+    {
+        auto                   tokens = burst_;
+        auto                   last   = clock::now();
+        std::vector<datagram*> batch;
+
+        const auto refill = [&] {
+            const auto now = clock::now();
+            tokens         = std::min(burst_, tokens + rate_ * std::chrono::duration<double>(now - last).count());
+            last           = now;
+        };
+
+        for (auto done = false; !done;) {
+            datagram* d = nullptr;
+            ready_.pop(d);
+            if (!d) {
+                break;
+            }
+
+            // Waits for the first datagram's tokens and sends those after it that are due as well.
+            refill();
+            if (tokens < d->size) {
+                std::this_thread::sleep_for(std::chrono::duration<double>((d->size - tokens) / rate_));
+                refill();
+            }
+
+            batch.push_back(d);
+            tokens -= d->size;
+            while (batch.size() < MAX_BATCH && tokens >= DATAGRAM_SIZE && ready_.try_pop(d)) {
+                if (!d) {
+                    done = true;
+                    break;
+                }
+                batch.push_back(d);
+                tokens -= d->size;
+            }
+
+            send(batch);
+
+            for (auto sent : batch) {
+                free_.push(sent);
+            }
+            batch.clear();
+        }
+    }
+
+    void send(const std::vector<datagram*>& batch)
+    {
+#ifdef __linux__
+        std::array<mmsghdr, MAX_BATCH> msgs{};
+        std::array<iovec, MAX_BATCH>   iovs{};
+        for (auto n = 0U; n < batch.size(); ++n) {
+            iovs[n].iov_base            = batch[n]->data.data();
+            iovs[n].iov_len             = batch[n]->size;
+            msgs[n].msg_hdr.msg_iov     = &iovs[n];
+            msgs[n].msg_hdr.msg_iovlen  = 1;
+            msgs[n].msg_hdr.msg_name    = endpoint_.data();
+            msgs[n].msg_hdr.msg_namelen = static_cast<socklen_t>(endpoint_.size());
+        }
+
+        for (auto sent = 0U; sent < batch.size();) {
+            const auto ret =
+                ::sendmmsg(socket_.native_handle(), msgs.data() + sent, static_cast<unsigned>(batch.size() - sent), 0);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                CASPAR_LOG(warning) << "paced_output[" << url_ << "] " << strerror(errno);
+                return;
+            }
+            sent += ret;
+        }
+#else
+        for (auto d : batch) {
+            boost::system::error_code ec;
+            socket_.send_to(boost::asio::buffer(d->data.data(), d->size), endpoint_, 0, ec);
+            if (ec) {
+                CASPAR_LOG(warning) << "paced_output[" << url_ << "] " << ec.message();
+                return;
+            }
+        }
+#endif
+    }
+};
+
+PacedOutput::PacedOutput(const std::string& url, int64_t bitrate)
+    : impl_(new impl(url, bitrate))
+{
+}
+
+PacedOutput::~PacedOutput() {}
+
+AVIOContext* PacedOutput::pb() const { return impl_->pb_; }
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Sends the mpegts written to pb() to a udp:// url at a steady bitrate, rather than in the bursts that avio flushes
+// it in. Datagrams of 7 ts packets are copied once into a pool, a thread of the network role takes them out through
+// a token bucket and sends those that are due together, with sendmmsg on linux.
+class PacedOutput
+{
+  public:
+    PacedOutput(const std::string& url, int64_t bitrate);
+    ~PacedOutput();
+
+    PacedOutput(const PacedOutput&) = delete;
+    PacedOutput& operator=(const PacedOutput&) = delete;
+
+    AVIOContext* pb() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "segment_writer.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <new>
+
+#include <fcntl.h>
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const char* const INDEX_MAGIC = "CASPARCG-SEGMENTS 1";
+
+const int NULL_BUFFER_SIZE = 4096;
+
+int discard_packet(void*, uint8_t*, int size) { return size; }
+
+// Flushes what the os has cached of the file to disk. avio doesn't expose its descriptor, any other one will do.
+void sync_file(const std::string& filename)
+{
+#ifdef _MSC_VER
+    const auto fd = _wopen(u16(filename).c_str(), _O_WRONLY | _O_BINARY);
+    if (fd >= 0) {
+        _commit(fd);
+        _close(fd);
+    }
+#else
+    const auto fd = ::open(filename.c_str(), O_WRONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#endif
+}
+
+} // namespace
+
+SegmentWriter::SegmentWriter(AVFormatContext*                   oc,
+                             const std::string&                 path,
+                             double                             duration,
+                             AVRational                         frame_duration,
+                             std::map<std::string, std::string> options)
+    : oc_(oc)
+    , duration_(duration)
+    , frame_duration_(frame_duration)
+    , options_(std::move(options))
+{
+    if (oc_->oformat->flags & AVFMT_NOFILE) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(std::string("Cannot segment ") + oc_->oformat->name));
+    }
+    if (duration_ <= 0.0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid segment duration."));
+    }
+
+    boost::filesystem::path file(path);
+    stem_      = (file.parent_path() / file.stem()).string();
+    extension_ = file.extension().string();
+
+    // Fragmented mp4 and mov segments can be read up to the last keyframe written, without a trailer.
+    const std::string name = oc_->oformat->name;
+    if ((boost::contains(name, "mp4") || boost::contains(name, "mov")) && options_.count("movflags") == 0) {
+        options_["movflags"] = "+frag_keyframe+empty_moov+default_base_moof";
+    }
+
+    for (auto n = 0U; n < oc_->nb_streams; ++n) {
+        if (oc_->streams[n]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            video_index_ = static_cast<int>(n);
+            break;
+        }
+    }
+
+    // oc is never written to, its header only settles the time bases the encoders use.
+    auto buffer = static_cast<uint8_t*>(av_malloc(NULL_BUFFER_SIZE));
+    null_pb_    = buffer ? avio_alloc_context(buffer, NULL_BUFFER_SIZE, 1, nullptr, nullptr, discard_packet, nullptr)
+                         : nullptr;
+    if (!null_pb_) {
+        av_free(buffer);
+        throw std::bad_alloc();
+    }
+    oc_->pb = null_pb_;
+
+    // The header names the segments and the duration of the frames that the index counts.
+    const auto pattern = boost::filesystem::path(stem_).filename().string() + "_%05d" + extension_;
+    const auto index   = index_filename();
+    io_.begin_invoke([=] {
+        std::ofstream file(index, std::ios::trunc);
+        file << INDEX_MAGIC << "\n" << pattern << " " << frame_duration.num << "/" << frame_duration.den << "\n";
+    });
+}
+
+SegmentWriter::~SegmentWriter()
+{
+    try {
+        finish(false);
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+
+    if (oc_->pb == null_pb_) {
+        oc_->pb = nullptr;
+    }
+    av_freep(&null_pb_->buffer);
+    avio_context_free(&null_pb_);
+
+    // io_ still runs the syncs queued so far before it stops.
+}
+
+std::string SegmentWriter::filename(int segment) const
+{
+    return (boost::format("%s_%05d%s") % stem_ % segment % extension_).str();
+}
+
+std::string SegmentWriter::index_filename() const { return stem_ + ".index"; }
+
+void SegmentWriter::write(AVPacket* packet)
+{
+    const auto index = packet->stream_index;
+    const auto tb    = oc_->streams[index]->time_base;
+    const auto pts   = packet->pts;
+    const auto key   = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+
+    // Segments are cut at video keyframes, so that each starts decodable.
+    if (!segment_oc_ || ((video_index_ < 0 || (index == video_index_ && key)) && pts != AV_NOPTS_VALUE &&
+                         pts * av_q2d(tb) >= next_cut_)) {
+        finish(true);
+        open();
+        if (pts != AV_NOPTS_VALUE) {
+            next_cut_ = (std::floor(pts * av_q2d(tb) / duration_) + 1.0) * duration_;
+        }
+    }
+
+    // The frame's data starts at or after where the segment stands before it's muxed, the muxer may hold on to it
+    // to interleave.
+    if (index == video_index_ && pts != AV_NOPTS_VALUE) {
+        pending_ += (boost::format("%d %d %d %d\n") % av_rescale_q(pts, tb, frame_duration_) % segment_ %
+                     avio_tell(segment_oc_->pb) % (key ? 1 : 0))
+                        .str();
+    }
+
+    av_packet_rescale_ts(packet, tb, segment_oc_->streams[index]->time_base);
+    FF(av_interleaved_write_frame(segment_oc_, packet));
+
+    if (sync_timer_.elapsed() >= 1.0) {
+        avio_flush(segment_oc_->pb);
+        sync(filename(segment_));
+    }
+}
+
+void SegmentWriter::close() { finish(true); }
+
+void SegmentWriter::open()
+{
+    segment_ += 1;
+    const auto name = filename(segment_);
+
+    FF(avformat_alloc_output_context2(&segment_oc_, oc_->oformat, nullptr, name.c_str()));
+    av_dict_copy(&segment_oc_->metadata, oc_->metadata, 0);
+
+    for (auto n = 0U; n < oc_->nb_streams; ++n) {
+        auto st = avformat_new_stream(segment_oc_, nullptr);
+        if (!st) {
+            throw std::bad_alloc();
+        }
+        FF(avcodec_parameters_copy(st->codecpar, oc_->streams[n]->codecpar));
+        st->time_base      = oc_->streams[n]->time_base;
+        st->avg_frame_rate = oc_->streams[n]->avg_frame_rate;
+        av_dict_copy(&st->metadata, oc_->streams[n]->metadata, 0);
+    }
+
+    FF(avio_open2(&segment_oc_->pb, name.c_str(), AVIO_FLAG_WRITE, nullptr, nullptr));
+
+    auto dict = to_dict(std::map<std::string, std::string>(options_));
+    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+    FF(avformat_write_header(segment_oc_, &dict));
+
+    CASPAR_LOG(info) << "ffmpeg_consumer[" << name << "] Recording segment.";
+}
+
+void SegmentWriter::finish(bool trailer)
+{
+    if (!segment_oc_) {
+        return;
+    }
+
+    CASPAR_SCOPE_EXIT
+    {
+        avio_closep(&segment_oc_->pb);
+        avformat_free_context(segment_oc_);
+        segment_oc_ = nullptr;
+    };
+
+    if (trailer) {
+        FF(av_write_trailer(segment_oc_));
+    }
+    if (segment_oc_->pb) {
+        avio_flush(segment_oc_->pb);
+    }
+    sync(filename(segment_));
+}
+
+void SegmentWriter::sync(const std::string& filename)
+{
+    sync_timer_.restart();
+
+    // The index is synced after the segment, so that it never points past what's on disk.
+    const auto index = index_filename();
+    io_.begin_invoke([=, lines = std::move(pending_)] {
+        sync_file(filename);
+
+        std::ofstream file(index, std::ios::app);
+        file << lines;
+        file.close();
+        sync_file(index);
+    });
+    pending_.clear();
+}
+
+}} // namespace caspar::ffmpeg
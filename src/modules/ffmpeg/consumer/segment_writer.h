@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <common/executor.h>
+#include <common/timer.h>
+
+#include <map>
+#include <string>
+
+extern "C" {
+#include <libavutil/rational.h>
+}
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVPacket;
+
+namespace caspar { namespace ffmpeg {
+
+// Records the streams of oc into a new file of its format about every segment duration, cut at video keyframes,
+// each with the header and trailer of the format so that a crash loses at most the open segment. A sidecar index
+// lists for every video frame the segment it is in and the size that segment has once the frame was written.
+// Segments and the index are synced to disk on an I/O thread of their own, so the packet thread never waits on it.
+class SegmentWriter
+{
+  public:
+    // Takes over oc->pb, oc itself is only used for its streams and is never written.
+    SegmentWriter(AVFormatContext*                   oc,
+                  const std::string&                 path,
+                  double                             duration,
+                  AVRational                         frame_duration,
+                  std::map<std::string, std::string> options);
+    ~SegmentWriter();
+
+    SegmentWriter(const SegmentWriter&) = delete;
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+    // Takes the packet, with the timestamps and index of its oc stream.
+    void write(AVPacket* packet);
+
+    // Writes the trailer of the open segment, the destructor only closes it.
+    void close();
+
+    std::string filename(int segment) const;
+    std::string index_filename() const;
+    int         segment() const { return segment_; }
+
+  private:
+    void open();
+    void finish(bool trailer);
+    void sync(const std::string& filename);
+
+    AVFormatContext*                   oc_;
+    AVIOContext*                       null_pb_ = nullptr;
+    std::string                        stem_;
+    std::string                        extension_;
+    double                             duration_;
+    AVRational                         frame_duration_;
+    std::map<std::string, std::string> options_;
+    int                                video_index_ = -1;
+
+    AVFormatContext* segment_oc_ = nullptr;
+    int              segment_    = -1;
+    double           next_cut_   = 0.0;
+    std::string      pending_;
+    caspar::timer    sync_timer_;
+
+    executor io_{L"ffmpeg_consumer::segments"};
+};
+
+}} // namespace caspar::ffmpeg
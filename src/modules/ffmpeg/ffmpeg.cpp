@@ -25,7 +25,11 @@
 
 #include "consumer/ffmpeg_consumer.h"
 #include "producer/ffmpeg_producer.h"
+#include "producer/raw_producer.h"
+#include "util/media_index.h"
+#include "util/raw_converter.h"
 
+#include <common/env.h>
 #include <common/log.h>
 
 #include <core/consumer/frame_consumer.h>
@@ -155,11 +159,35 @@ void init(core::module_dependencies dependencies)
     dependencies.consumer_registry->register_consumer_factory(L"FFmpeg Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ffmpeg", create_preconfigured_consumer);
 
+    // Ahead of ffmpeg, so that a converted clip is played instead of the one it was converted from.
+    dependencies.producer_registry->register_producer_factory(L"Raw Producer", create_raw_producer);
     dependencies.producer_registry->register_producer_factory(L"FFmpeg Producer", create_producer);
+
+    if (dependencies.command_repository) {
+        init_raw_converter();
+        dependencies.command_repository->register_command(L"Raw Commands", L"RAW CONVERT", raw_convert_command, 1);
+    }
+
+    // Registered ahead of the commands that ask the media scanner, which are then ignored.
+    if (dependencies.command_repository &&
+        env::properties().get(L"configuration.amcp.media-server.builtin", true)) {
+        init_media_index();
+
+        auto& repo = *dependencies.command_repository;
+        repo.register_command(L"Query Commands", L"CINF", cinf_command, 1);
+        repo.register_command(L"Query Commands", L"CLS", cls_command, 0);
+        repo.register_command(L"Query Commands", L"TLS", tls_command, 0);
+        repo.register_command(L"Thumbnail Commands", L"THUMBNAIL LIST", thumbnail_list_command, 0);
+        repo.register_command(L"Thumbnail Commands", L"THUMBNAIL RETRIEVE", thumbnail_retrieve_command, 1);
+        repo.register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE", thumbnail_generate_command, 1);
+        repo.register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE_ALL", thumbnail_generateall_command, 0);
+    }
 }
 
 void uninit()
 {
+    uninit_media_index();
+    uninit_raw_converter();
     // avfilter_uninit();
     avformat_network_deinit();
     av_lockmgr_register(nullptr);
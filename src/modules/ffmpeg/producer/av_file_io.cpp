@@ -0,0 +1,404 @@
+#include "av_file_io.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/align/aligned_allocator.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Blocks are read at offsets and in sizes that are multiples of this, as direct io requires.
+const int64_t BLOCK_SIZE = 2 * 1024 * 1024;
+
+const int CONTEXT_BUFFER_SIZE = 256 * 1024;
+
+using block_data = std::vector<uint8_t, boost::alignment::aligned_allocator<uint8_t, 4096>>;
+
+int io_threads() { return std::max(0, env::properties().get(L"configuration.ffmpeg.producer.io-threads", 4)); }
+
+// An open file, kept open by the reads still in flight. The mutex guards the blocks being read into.
+struct File
+{
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    int64_t size = 0;
+
+    std::mutex              mutex;
+    std::condition_variable cond;
+
+    File(const std::string& filename, bool direct)
+    {
+#ifdef _WIN32
+        const auto flags = direct ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN;
+        handle           = CreateFileW(u16(filename).c_str(),
+                             GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             nullptr,
+                             OPEN_EXISTING,
+                             flags,
+                             nullptr);
+        LARGE_INTEGER file_size;
+        if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &file_size)) {
+            if (handle != INVALID_HANDLE_VALUE) {
+                CloseHandle(handle);
+            }
+            CASPAR_THROW_EXCEPTION(file_read_error() << file_name_info(filename));
+        }
+        size = static_cast<int64_t>(file_size.QuadPart);
+#else
+        auto flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+        if (direct) {
+            // Filesystems without direct io, e.g. tmpfs, read through the page cache.
+            fd = ::open(filename.c_str(), flags | O_DIRECT);
+        }
+#endif
+        if (fd < 0) {
+            fd = ::open(filename.c_str(), flags);
+        }
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            CASPAR_THROW_EXCEPTION(file_read_error() << file_name_info(filename));
+        }
+        size = static_cast<int64_t>(st.st_size);
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+    }
+
+    ~File()
+    {
+#ifdef _WIN32
+        CloseHandle(handle);
+#else
+        ::close(fd);
+#endif
+    }
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    // Reads up to count bytes at offset, fewer only at the end of the file. Returns -1 on errors.
+    int64_t read(int64_t offset, uint8_t* data, int64_t count) const
+    {
+        int64_t done = 0;
+        while (done < count) {
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            overlapped.Offset     = static_cast<DWORD>(offset + done);
+            overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+            DWORD n               = 0;
+            if (!ReadFile(handle, data + done, static_cast<DWORD>(count - done), &n, &overlapped)) {
+                if (GetLastError() == ERROR_HANDLE_EOF) {
+                    break;
+                }
+                return -1;
+            }
+#else
+            const auto n = ::pread(fd, data + done, static_cast<size_t>(count - done), offset + done);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+#endif
+            if (n == 0) {
+                break;
+            }
+            done += n;
+        }
+        return done;
+    }
+};
+
+struct Block
+{
+    int64_t    offset = 0;
+    int64_t    size   = 0;
+    bool       done   = false;
+    block_data data;
+};
+
+// Threads that the reads of all files are queued on, so that the queue depth of the storage grows with the number
+// of files read rather than with the number of producers.
+class ReadPool
+{
+    std::mutex                        mutex_;
+    std::condition_variable           cond_;
+    std::deque<std::function<void()>> tasks_;
+    bool                              abort_request_ = false;
+    std::vector<std::thread>          threads_;
+
+  public:
+    explicit ReadPool(int count)
+    {
+        for (auto n = 0; n < count; ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"[ffmpeg::file_io]");
+                run();
+            });
+        }
+    }
+
+    ~ReadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    static ReadPool& instance()
+    {
+        static ReadPool pool(std::max(1, io_threads()));
+        return pool;
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        cond_.notify_one();
+    }
+
+  private:
+    void run()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return !tasks_.empty() || abort_request_; });
+                if (abort_request_) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+} // namespace
+
+struct FileIO::Impl
+{
+    const std::shared_ptr<File>               file_;
+    const std::shared_ptr<diagnostics::graph> graph_;
+    const int64_t                             depth_ =
+        std::max(1, env::properties().get(L"configuration.ffmpeg.producer.io-depth", 4));
+
+    // Blocks by index, from the one before the position to depth_ ahead of it. Only touched by the demuxer.
+    std::map<int64_t, std::shared_ptr<Block>> blocks_;
+    int64_t                                   pos_ = 0;
+
+    AVIOContext* ctx_ = nullptr;
+
+    std::chrono::steady_clock::time_point window_start_ = std::chrono::steady_clock::now();
+    int64_t                               window_bytes_ = 0;
+    std::chrono::steady_clock::duration   window_wait_{0};
+    std::atomic<int64_t>                  rate_{0};
+
+    Impl(const std::string& filename, std::shared_ptr<diagnostics::graph> graph)
+        : file_(std::make_shared<File>(filename,
+                                       env::properties().get(L"configuration.ffmpeg.producer.direct-io", false)))
+        , graph_(std::move(graph))
+    {
+        auto buffer = static_cast<unsigned char*>(av_malloc(CONTEXT_BUFFER_SIZE));
+        if (buffer) {
+            ctx_ = avio_alloc_context(buffer, CONTEXT_BUFFER_SIZE, 0, this, &Impl::read_packet, nullptr, &Impl::seek);
+        }
+        if (!ctx_) {
+            av_free(buffer);
+            CASPAR_THROW_EXCEPTION(file_read_error() << file_name_info(filename) << msg_info("avio_alloc_context"));
+        }
+
+        graph_->set_color("io-wait", diagnostics::color(0.9f, 0.6f, 0.3f));
+    }
+
+    ~Impl()
+    {
+        av_freep(&ctx_->buffer);
+        avio_context_free(&ctx_);
+    }
+
+    static int read_packet(void* opaque, uint8_t* buf, int buf_size)
+    {
+        return static_cast<Impl*>(opaque)->read(buf, buf_size);
+    }
+
+    static int64_t seek(void* opaque, int64_t offset, int whence)
+    {
+        auto self = static_cast<Impl*>(opaque);
+        switch (whence & ~AVSEEK_FORCE) {
+            case AVSEEK_SIZE:
+                return self->file_->size;
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += self->pos_;
+                break;
+            case SEEK_END:
+                offset += self->file_->size;
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+        if (offset < 0) {
+            return AVERROR(EINVAL);
+        }
+        self->pos_ = offset;
+        return offset;
+    }
+
+    int read(uint8_t* buf, int buf_size)
+    {
+        if (pos_ >= file_->size) {
+            return AVERROR_EOF;
+        }
+
+        // The block before the one read from is kept for short seeks back, those after a seek back are dropped.
+        const auto index = pos_ / BLOCK_SIZE;
+        blocks_.erase(blocks_.begin(), blocks_.lower_bound(index - 1));
+        blocks_.erase(blocks_.upper_bound(index + depth_), blocks_.end());
+        for (auto n = index; n <= index + depth_; ++n) {
+            request(n);
+        }
+
+        const auto block = blocks_[index];
+        {
+            std::unique_lock<std::mutex> lock(file_->mutex);
+            if (!block->done) {
+                const auto start = std::chrono::steady_clock::now();
+                file_->cond.wait(lock, [&] { return block->done; });
+                window_wait_ += std::chrono::steady_clock::now() - start;
+            }
+        }
+
+        if (block->size < 0) {
+            return AVERROR(EIO);
+        }
+
+        const auto offset = pos_ - block->offset;
+        if (offset >= block->size) {
+            return AVERROR_EOF;
+        }
+
+        const auto count = static_cast<int>(std::min<int64_t>(buf_size, block->size - offset));
+        std::memcpy(buf, block->data.data() + offset, count);
+        pos_ += count;
+
+        update_rate(count);
+
+        return count;
+    }
+
+    void request(int64_t index)
+    {
+        if (index * BLOCK_SIZE >= file_->size || blocks_.find(index) != blocks_.end()) {
+            return;
+        }
+
+        auto block    = std::make_shared<Block>();
+        block->offset = index * BLOCK_SIZE;
+        blocks_.emplace(index, block);
+
+        // The block is read whole even at the end of the file, as direct io reads in whole sectors.
+        ReadPool::instance().submit([file = file_, block] {
+            block_data data(static_cast<std::size_t>(BLOCK_SIZE));
+            const auto size = file->read(block->offset, data.data(), BLOCK_SIZE);
+
+            std::lock_guard<std::mutex> lock(file->mutex);
+            block->data = std::move(data);
+            block->size = size;
+            block->done = true;
+            file->cond.notify_all();
+        });
+    }
+
+    void update_rate(int64_t bytes)
+    {
+        window_bytes_ += bytes;
+
+        const auto now     = std::chrono::steady_clock::now();
+        const auto elapsed = std::chrono::duration<double>(now - window_start_).count();
+        if (elapsed < 1.0) {
+            return;
+        }
+
+        rate_ = static_cast<int64_t>(window_bytes_ / elapsed);
+        graph_->set_value("io-wait", std::chrono::duration<double>(window_wait_).count() / elapsed);
+
+        window_start_ = now;
+        window_bytes_ = 0;
+        window_wait_  = std::chrono::steady_clock::duration::zero();
+    }
+};
+
+FileIO::FileIO(const std::string& filename, std::shared_ptr<diagnostics::graph> graph)
+    : impl_(new Impl(filename, std::move(graph)))
+{
+}
+
+FileIO::~FileIO() {}
+
+bool FileIO::enabled() { return io_threads() > 0; }
+
+AVIOContext* FileIO::context() const { return impl_->ctx_; }
+
+int64_t FileIO::rate() const { return impl_->rate_; }
+
+}} // namespace caspar::ffmpeg
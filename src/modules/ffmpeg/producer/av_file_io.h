@@ -0,0 +1,41 @@
+#pragma once
+
+#include <common/diagnostics/graph.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Reads a local file for libavformat in large blocks, several of them ahead of the demuxer, on threads shared by the
+// inputs of all producers, instead of with the small buffered reads of ffmpeg's file protocol on the thread of the
+// input. With ffmpeg.producer.direct-io the blocks are read past the page cache. The part of the time the demuxer
+// waits for blocks to be read is shown on the graph as io-wait.
+class FileIO
+{
+  public:
+    // Throws if the file can't be opened.
+    FileIO(const std::string& filename, std::shared_ptr<diagnostics::graph> graph);
+    ~FileIO();
+
+    FileIO(const FileIO&) = delete;
+    FileIO& operator=(const FileIO&) = delete;
+
+    // Whether inputs of local files read through FileIO, with ffmpeg.producer.io-threads above 0.
+    static bool enabled();
+
+    // The context to set as pb of the format context before it is opened, owned by this.
+    AVIOContext* context() const;
+
+    // Bytes read from the file per second, over the last second.
+    int64_t rate() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,244 @@
+#include "av_index.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const AVRational TIME_BASE_Q = {1, AV_TIME_BASE};
+
+const char* const INDEX_MAGIC = "CASPARCG-KEYFRAMES 1";
+
+std::string file_signature(const std::string& filename)
+{
+    boost::filesystem::path path(u16(filename));
+
+    std::ostringstream str;
+    str << filename << "|" << boost::filesystem::file_size(path) << "|" << boost::filesystem::last_write_time(path);
+    return str.str();
+}
+
+} // namespace
+
+KeyframeIndex::KeyframeIndex(const std::string& filename)
+    : filename_(filename)
+{
+    std::ostringstream str;
+    str << std::hex << std::hash<std::string>{}(file_signature(filename_)) << ".idx";
+    cache_filename_ = u8(env::data_folder()) + "keyframes/" + str.str();
+
+    thread_ = std::thread([=] {
+        try {
+            set_thread_name(L"[ffmpeg::av_producer::KeyframeIndex]");
+
+            if (!load()) {
+                build();
+                save();
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+    abort_request_ = true;
+    thread_.join();
+}
+
+int KeyframeIndex::interrupt_cb(void* ctx)
+{
+    auto index = reinterpret_cast<KeyframeIndex*>(ctx);
+    return index->abort_request_ ? 1 : 0;
+}
+
+boost::optional<int64_t> KeyframeIndex::find(int64_t ts) const
+{
+    if (!ready_) {
+        return boost::none;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), ts);
+    if (it == keyframes_.begin()) {
+        return boost::none;
+    }
+    return *std::prev(it);
+}
+
+bool KeyframeIndex::ready() const { return ready_; }
+
+void KeyframeIndex::build()
+{
+    AVFormatContext* ic = nullptr;
+    FF(avformat_open_input(&ic, filename_.c_str(), nullptr, nullptr));
+    CASPAR_SCOPE_EXIT { avformat_close_input(&ic); };
+
+    ic->interrupt_callback.callback = KeyframeIndex::interrupt_cb;
+    ic->interrupt_callback.opaque   = this;
+
+    FF(avformat_find_stream_info(ic, nullptr));
+
+    const auto index = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (index < 0) {
+        return;
+    }
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        ic->streams[n]->discard = static_cast<int>(n) == index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    const auto tb = ic->streams[index]->time_base;
+
+    std::vector<int64_t> keyframes;
+
+    auto packet = alloc_packet();
+    while (!abort_request_) {
+        auto ret = av_read_frame(ic, packet.get());
+        if (ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret == AVERROR_EXIT) {
+            return;
+        }
+        FF_RET(ret, "av_read_frame");
+
+        if (packet->stream_index == index && packet->flags & AV_PKT_FLAG_KEY) {
+            const auto ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (ts != AV_NOPTS_VALUE) {
+                keyframes.push_back(av_rescale_q(ts, tb, TIME_BASE_Q));
+            }
+        }
+
+        av_packet_unref(packet.get());
+    }
+
+    if (abort_request_) {
+        return;
+    }
+
+    std::sort(keyframes.begin(), keyframes.end());
+    keyframes.erase(std::unique(keyframes.begin(), keyframes.end()), keyframes.end());
+
+    CASPAR_LOG(debug) << "av_index[" << filename_ << "] Indexed " << keyframes.size() << " keyframes.";
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        keyframes_ = std::move(keyframes);
+    }
+    ready_ = true;
+}
+
+bool KeyframeIndex::load()
+{
+    std::ifstream file(cache_filename_);
+    if (!file) {
+        return false;
+    }
+
+    std::string magic;
+    std::string signature;
+    if (!std::getline(file, magic) || !std::getline(file, signature) || magic != INDEX_MAGIC ||
+        signature != file_signature(filename_)) {
+        return false;
+    }
+
+    std::vector<int64_t> keyframes;
+    for (int64_t ts; file >> ts;) {
+        keyframes.push_back(ts);
+    }
+
+    if (!file.eof() || !std::is_sorted(keyframes.begin(), keyframes.end())) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        keyframes_ = std::move(keyframes);
+    }
+    ready_ = true;
+
+    return true;
+}
+
+void KeyframeIndex::save() const
+{
+    if (!ready_) {
+        return;
+    }
+
+    try {
+        boost::filesystem::path path(u16(cache_filename_));
+        boost::filesystem::create_directories(path.parent_path());
+
+        std::ofstream file(cache_filename_, std::ios::trunc);
+        file << INDEX_MAGIC << "\n" << file_signature(filename_) << "\n";
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto ts : keyframes_) {
+            file << ts << "\n";
+        }
+    } catch (...) {
+        CASPAR_LOG(warning) << "av_index[" << filename_ << "] Failed to write " << cache_filename_;
+    }
+}
+
+std::shared_ptr<KeyframeIndex> get_keyframe_index(const std::string& filename)
+{
+    static std::mutex                                          mutex;
+    static std::map<std::string, std::weak_ptr<KeyframeIndex>> indices;
+
+    if (!env::properties().get(L"configuration.ffmpeg.producer.keyframe-index", true)) {
+        return nullptr;
+    }
+
+    try {
+        if (!boost::filesystem::is_regular_file(boost::filesystem::path(u16(filename)))) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto index = indices[filename].lock();
+        if (!index) {
+            index             = std::make_shared<KeyframeIndex>(filename);
+            indices[filename] = index;
+        }
+        return index;
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return nullptr;
+    }
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <boost/optional.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+// Presentation times (AV_TIME_BASE) of the video keyframes of a local file. The index is read from the
+// keyframe cache in the data folder or built in the background from packet flags, without decoding.
+class KeyframeIndex
+{
+  public:
+    explicit KeyframeIndex(const std::string& filename);
+    ~KeyframeIndex();
+
+    KeyframeIndex(const KeyframeIndex&) = delete;
+    KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+
+    static int interrupt_cb(void* ctx);
+
+    // Returns the last keyframe at or before ts, or none while the index is still building.
+    boost::optional<int64_t> find(int64_t ts) const;
+
+    bool ready() const;
+
+  private:
+    void build();
+    bool load();
+    void save() const;
+
+    std::string filename_;
+    std::string cache_filename_;
+
+    mutable std::mutex   mutex_;
+    std::vector<int64_t> keyframes_;
+
+    std::atomic<bool> ready_{false};
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+};
+
+// Returns the index shared by all producers of filename, or nullptr if it can't be indexed.
+std::shared_ptr<KeyframeIndex> get_keyframe_index(const std::string& filename);
+
+}} // namespace caspar::ffmpeg
@@ -1,20 +1,41 @@
 #include "av_input.h"
 
+#include "av_file_io.h"
+
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
+#include "../util/page_cache.h"
 
+#include <common/env.h>
 #include <common/except.h>
 #include <common/os/thread.h>
 #include <common/param.h>
 #include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <core/diagnostics/call_context.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable : 4244)
 #endif
 extern "C" {
+#include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 }
 #ifdef _MSC_VER
@@ -23,20 +44,232 @@ extern "C" {
 
 namespace caspar { namespace ffmpeg {
 
-Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph)
+namespace {
+
+const AVRational TIME_BASE_Q = {1, AV_TIME_BASE};
+
+// Packet count limits, the lower one keeps streams with large packets going, the upper one bounds tiny packets.
+const std::size_t MIN_BUFFER_PACKETS = 16;
+const std::size_t MAX_BUFFER_PACKETS = 8192;
+
+// Reads taking longer than this are counted as stalls.
+const auto STALL_THRESHOLD = std::chrono::milliseconds(40);
+
+// Opening again re-reads the index, so growing mov and mxf files are looked at less often than the others.
+const auto REOPEN_INTERVAL = std::chrono::seconds(1);
+
+// Local files are growing with growing-files true, or with auto if they have been written to within timeout.
+bool is_growing_file(const std::string& filename, std::chrono::milliseconds timeout)
+{
+    const auto mode = env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.growing-files", L"false");
+    if (mode != L"true" && mode != L"auto") {
+        return false;
+    }
+
+    boost::system::error_code     ec;
+    const boost::filesystem::path path(u16(filename));
+    if (!boost::filesystem::is_regular_file(path, ec)) {
+        return false;
+    }
+    if (mode == L"true") {
+        return true;
+    }
+
+    const auto written = boost::filesystem::last_write_time(path, ec);
+    return !ec && std::time(nullptr) - written <= timeout.count() / 1000 + 1;
+}
+
+int64_t file_size(const std::string& filename)
+{
+    boost::system::error_code ec;
+    const auto                size = boost::filesystem::file_size(boost::filesystem::path(u16(filename)), ec);
+    return ec ? -1 : static_cast<int64_t>(size);
+}
+
+// What avformat_find_stream_info found for a local file, which opening it again, e.g. for a loop, a seek to the
+// start or another PLAY of the clip, takes instead of reading and decoding ahead to find it again.
+struct Probe
+{
+    struct Stream
+    {
+        std::shared_ptr<AVCodecParameters> codecpar;
+        AVRational                         time_base;
+        AVRational                         avg_frame_rate;
+        AVRational                         r_frame_rate;
+        AVRational                         sample_aspect_ratio;
+        int64_t                            start_time;
+        int64_t                            duration;
+    };
+
+    std::string         format;
+    std::vector<Stream> streams;
+    int64_t             start_time;
+    int64_t             duration;
+    int64_t             bit_rate;
+};
+
+// Files are told apart by path, size and modification time, so that a file that is replaced is probed again.
+std::string probe_key(const std::string& filename)
+{
+    boost::system::error_code     ec;
+    const boost::filesystem::path path(u16(filename));
+    if (!boost::filesystem::is_regular_file(path, ec)) {
+        return "";
+    }
+    const auto size    = boost::filesystem::file_size(path, ec);
+    const auto written = ec ? 0 : boost::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return "";
+    }
+    return filename + "|" + std::to_string(size) + "|" + std::to_string(written);
+}
+
+class ProbeCache
+{
+    std::mutex                                          mutex_;
+    std::map<std::string, std::shared_ptr<const Probe>> probes_;
+    std::deque<std::string>                             order_;
+    const std::size_t                                   capacity_;
+
+  public:
+    ProbeCache()
+        : capacity_(static_cast<std::size_t>(
+              std::max(0, env::properties().get(L"configuration.ffmpeg.producer.probe-cache", 256))))
+    {
+    }
+
+    static ProbeCache& instance()
+    {
+        static ProbeCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const Probe> find(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = probes_.find(key);
+        return it != probes_.end() ? it->second : nullptr;
+    }
+
+    void store(const std::string& key, const AVFormatContext& ic)
+    {
+        if (capacity_ == 0) {
+            return;
+        }
+
+        auto probe        = std::make_shared<Probe>();
+        probe->format     = ic.iformat->name;
+        probe->start_time = ic.start_time;
+        probe->duration   = ic.duration;
+        probe->bit_rate   = ic.bit_rate;
+        for (auto n = 0U; n < ic.nb_streams; ++n) {
+            const auto st = ic.streams[n];
+
+            Probe::Stream stream;
+            stream.codecpar = std::shared_ptr<AVCodecParameters>(
+                avcodec_parameters_alloc(), [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+            if (!stream.codecpar || avcodec_parameters_copy(stream.codecpar.get(), st->codecpar) < 0) {
+                return;
+            }
+            stream.time_base           = st->time_base;
+            stream.avg_frame_rate      = st->avg_frame_rate;
+            stream.r_frame_rate        = st->r_frame_rate;
+            stream.sample_aspect_ratio = st->sample_aspect_ratio;
+            stream.start_time          = st->start_time;
+            stream.duration            = st->duration;
+            probe->streams.push_back(std::move(stream));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (probes_.find(key) == probes_.end()) {
+            order_.push_back(key);
+        }
+        probes_[key] = std::move(probe);
+        while (order_.size() > capacity_) {
+            probes_.erase(order_.front());
+            order_.pop_front();
+        }
+    }
+};
+
+// Applies what was found before to the streams ic has just read from the header. The streams must be the same as
+// they were then, down to their codecs and time bases, or else the file is probed again, e.g. for transport streams
+// whose codecs are only known from their packets.
+bool apply_probe(AVFormatContext& ic, const Probe& probe)
+{
+    if (probe.format != ic.iformat->name || probe.streams.size() != ic.nb_streams) {
+        return false;
+    }
+    for (auto n = 0U; n < ic.nb_streams; ++n) {
+        const auto  st     = ic.streams[n];
+        const auto& stream = probe.streams[n];
+        if (st->codecpar->codec_id == AV_CODEC_ID_NONE || st->codecpar->codec_id != stream.codecpar->codec_id ||
+            av_cmp_q(st->time_base, stream.time_base) != 0) {
+            return false;
+        }
+    }
+
+    for (auto n = 0U; n < ic.nb_streams; ++n) {
+        const auto  st     = ic.streams[n];
+        const auto& stream = probe.streams[n];
+        if (avcodec_parameters_copy(st->codecpar, stream.codecpar.get()) < 0) {
+            return false;
+        }
+        st->avg_frame_rate      = stream.avg_frame_rate;
+        st->r_frame_rate        = stream.r_frame_rate;
+        st->sample_aspect_ratio = stream.sample_aspect_ratio;
+        st->start_time          = stream.start_time;
+        st->duration            = stream.duration;
+    }
+    ic.start_time = probe.start_time;
+    ic.duration   = probe.duration;
+    ic.bit_rate   = probe.bit_rate;
+    return true;
+}
+
+} // namespace
+
+Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::function<void()> on_packet)
     : filename_(filename)
     , graph_(graph)
+    , on_packet_(std::move(on_packet))
+    , buffer_capacity_(env::properties().get(L"configuration.ffmpeg.producer.read-ahead-size", INT64_C(32)) * 1024 *
+                       1024)
+    , buffer_max_duration_(env::properties().get(L"configuration.ffmpeg.producer.read-ahead-duration", INT64_C(0)) *
+                           AV_TIME_BASE / 1000)
+    , grow_poll_(env::properties().get(L"configuration.ffmpeg.producer.growing-poll", 40))
+    , growing_timeout_(env::properties().get(L"configuration.ffmpeg.producer.growing-timeout", 10) * 1000)
 {
+    growing_ = is_growing_file(filename_, growing_timeout_);
+
     graph_->set_color("seek", diagnostics::color(1.0f, 0.5f, 0.0f));
     graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+    graph_->set_color("input-stall", diagnostics::color(0.9f, 0.3f, 0.3f));
+
+    const auto channel = core::diagnostics::call_context::for_thread().video_channel;
 
-    buffer_.set_capacity(256);
     thread_ = std::thread([=] {
         try {
             set_thread_name(L"[ffmpeg::av_producer::Input]");
+            set_thread_role(L"ffmpeg");
+            bind_thread_to_channel(channel);
+
+            auto    window_start = std::chrono::steady_clock::now();
+            int64_t window_bytes = 0;
 
             while (true) {
-                auto packet = alloc_packet();
+                {
+                    std::unique_lock<std::mutex> lock(buffer_mutex_);
+                    buffer_cond_.wait(lock, [&] { return !full() || abort_request_; });
+
+                    // Waits for the writer without holding ic_mutex_, a seek or abort ends the wait.
+                    if (grow_wait_) {
+                        buffer_cond_.wait_for(lock, grow_poll_, [&] { return !grow_wait_ || abort_request_; });
+                    }
+                }
+
+                Packet packet;
+                packet.packet = alloc_packet();
 
                 {
                     std::unique_lock<std::mutex> lock(ic_mutex_);
@@ -46,21 +279,70 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                         break;
                     }
 
-                    // TODO (perf) Non blocking av_read_frame when possible.
-                    auto ret = av_read_frame(ic_.get(), packet.get());
+                    if (grow_wait_) {
+                        if (grown()) {
+                            resume();
+                        } else if (!growing_done_) {
+                            continue;
+                        }
+                        grow_wait_ = false;
+                    }
+
+                    const auto read_start = std::chrono::steady_clock::now();
+
+                    auto ret = av_read_frame(ic_.get(), packet.packet.get());
+                    if (cache_window_ && ic_->pb) {
+                        cache_window_->advance(avio_tell(ic_->pb));
+                    }
+
+                    const auto read_time = std::chrono::steady_clock::now() - read_start;
+                    if (read_time > STALL_THRESHOLD) {
+                        stall_time_ += std::chrono::duration_cast<std::chrono::milliseconds>(read_time).count();
+                        graph_->set_tag(diagnostics::tag_severity::WARNING, "input-stall");
+                    }
 
                     if (ret == AVERROR_EXIT) {
                         break;
+                    } else if (ret == AVERROR_EOF && growing_ && !growing_done_) {
+                        grow_wait_ = true;
+                        continue;
                     } else if (ret == AVERROR_EOF) {
-                        eof_   = true;
-                        packet = nullptr;
+                        eof_          = true;
+                        packet.packet = nullptr;
                     } else {
                         FF_RET(ret, "av_read_frame");
+
+                        if (growing_) {
+                            const auto index = static_cast<std::size_t>(packet.packet->stream_index);
+                            const auto dts   = packet.packet->dts;
+                            if (index < last_dts_.size() && dts != AV_NOPTS_VALUE) {
+                                if (resumed_ && last_dts_[index] != AV_NOPTS_VALUE && dts <= last_dts_[index]) {
+                                    continue;
+                                }
+                                last_dts_[index] = dts;
+                            }
+                        }
+
+                        packet.size = packet.packet->size;
+                        if (packet.packet->stream_index == duration_stream_ && packet.packet->duration > 0) {
+                            packet.duration = av_rescale_q(packet.packet->duration,
+                                                           ic_->streams[duration_stream_]->time_base,
+                                                           TIME_BASE_Q);
+                        }
+                    }
+
+                    window_bytes += packet.size;
+                    const auto now = std::chrono::steady_clock::now();
+                    if (now - window_start >= std::chrono::seconds(1)) {
+                        const auto elapsed = std::chrono::duration<double>(now - window_start).count();
+                        bitrate_           = static_cast<int64_t>(window_bytes * 8 / elapsed);
+                        window_start       = now;
+                        window_bytes       = 0;
                     }
-                }
 
-                buffer_.push(std::move(packet));
-                graph_->set_value("input", (static_cast<double>(buffer_.size()) / buffer_.capacity()));
+                    // Pushed under ic_mutex_ so that a seek can't be followed by a packet from before it.
+                    push(std::move(packet));
+                }
             }
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
@@ -70,12 +352,14 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
 
 Input::~Input()
 {
-    graph_         = spl::shared_ptr<diagnostics::graph>();
-    abort_request_ = true;
+    graph_ = spl::shared_ptr<diagnostics::graph>();
 
-    std::shared_ptr<AVPacket> packet;
-    while (buffer_.try_pop(packet))
-        ;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        abort_request_ = true;
+    }
+    buffer_cond_.notify_all();
+    ic_cond_.notify_all();
 
     thread_.join();
 }
@@ -86,11 +370,102 @@ int Input::interrupt_cb(void* ctx)
     return input->abort_request_ ? 1 : 0;
 }
 
+bool Input::full() const
+{
+    if (buffer_.size() >= MAX_BUFFER_PACKETS) {
+        return true;
+    }
+    if (buffer_.size() < MIN_BUFFER_PACKETS) {
+        return false;
+    }
+    return buffer_size_ >= buffer_capacity_ || (buffer_max_duration_ > 0 && buffer_duration_ >= buffer_max_duration_);
+}
+
+void Input::push(Packet packet)
+{
+    double fill;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        buffer_size_ += packet.size;
+        buffer_duration_ += packet.duration;
+        buffer_.push_back(std::move(packet));
+
+        fill = static_cast<double>(buffer_size_) / static_cast<double>(buffer_capacity_);
+        if (buffer_max_duration_ > 0) {
+            fill = std::max(fill, static_cast<double>(buffer_duration_) / static_cast<double>(buffer_max_duration_));
+        }
+    }
+    graph_->set_value("input", fill);
+
+    if (on_packet_) {
+        on_packet_();
+    }
+}
+
+void Input::flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        buffer_.clear();
+        buffer_size_     = 0;
+        buffer_duration_ = 0;
+    }
+    buffer_cond_.notify_all();
+}
+
 bool Input::try_pop(std::shared_ptr<AVPacket>& packet)
 {
-    auto result = buffer_.try_pop(packet);
-    graph_->set_value("input", (static_cast<double>(buffer_.size()) / buffer_.capacity()));
-    return result;
+    return try_pop(packet, [](int) { return true; });
+}
+
+bool Input::try_pop(std::shared_ptr<AVPacket>& packet, const std::function<bool(int)>& accept)
+{
+    double fill;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+
+        auto it = buffer_.begin();
+        for (; it != buffer_.end(); ++it) {
+            if (!it->packet) {
+                if (it != buffer_.begin()) {
+                    return false;
+                }
+                break;
+            }
+            if (accept(it->packet->stream_index)) {
+                break;
+            }
+        }
+        if (it == buffer_.end()) {
+            return false;
+        }
+
+        packet = std::move(it->packet);
+        buffer_size_ -= it->size;
+        buffer_duration_ -= it->duration;
+        buffer_.erase(it);
+
+        fill = static_cast<double>(buffer_size_) / static_cast<double>(buffer_capacity_);
+    }
+    buffer_cond_.notify_all();
+    graph_->set_value("input", fill);
+    return true;
+}
+
+bool Input::blocked() const
+{
+    std::lock_guard<std::mutex> lock(buffer_mutex_);
+    return full();
+}
+
+int64_t Input::bitrate() const { return bitrate_; }
+
+int64_t Input::stall_time() const { return stall_time_; }
+
+int64_t Input::io_rate() const
+{
+    const auto io = std::atomic_load(&io_);
+    return io ? io->rate() : 0;
 }
 
 AVFormatContext* Input::operator->() { return ic_.get(); }
@@ -110,6 +485,7 @@ void Input::internal_reset()
     static const std::set<std::wstring> PROTOCOLS_TREATED_AS_FORMATS = {L"dshow", L"v4l2", L"iec61883"};
 
     AVInputFormat* input_format = nullptr;
+    auto           url          = filename_;
     auto           url_parts    = caspar::protocol_split(u16(filename_));
     if (url_parts.first == L"http" || url_parts.first == L"https") {
         FF(av_dict_set(&options, "http_persistent", "0", 0)); // NOTE https://trac.ffmpeg.org/ticket/7034#comment:3
@@ -121,16 +497,43 @@ void Input::internal_reset()
     } else if (PROTOCOLS_TREATED_AS_FORMATS.find(url_parts.first) != PROTOCOLS_TREATED_AS_FORMATS.end()) {
         input_format = av_find_input_format(u8(url_parts.first).c_str());
         filename_    = u8(url_parts.second);
+        url          = filename_;
+    }
+
+    // Reads network files ahead on ffmpeg's async protocol, playlists are left alone since their segments are
+    // resolved relative to the url.
+    static const std::set<std::wstring> ASYNC_PROTOCOLS = {L"http", L"https", L"ftp", L"sftp", L"smb"};
+    if (ASYNC_PROTOCOLS.find(url_parts.first) != ASYNC_PROTOCOLS.end() &&
+        !boost::iends_with(url_parts.second, L".m3u8") &&
+        env::properties().get(L"configuration.ffmpeg.producer.async-io", true)) {
+        url = "async:" + filename_;
     }
 
-    if (input_format == nullptr) {
+    // Local files are read through FileIO, except for growing ones, which are read past their end as they grow.
+    std::shared_ptr<FileIO> io;
+    if (input_format == nullptr && url_parts.first.empty() && !growing_ && FileIO::enabled()) {
+        boost::system::error_code ec;
+        if (boost::filesystem::is_regular_file(boost::filesystem::path(u16(filename_)), ec)) {
+            io = std::make_shared<FileIO>(filename_, graph_);
+        }
+    }
+
+    if (input_format == nullptr && !io) {
         // TODO (fix) timeout?
         FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
     }
 
     AVFormatContext* ic = nullptr;
-    FF(avformat_open_input(&ic, filename_.c_str(), input_format, &options));
-    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    if (io) {
+        ic = avformat_alloc_context();
+        if (!ic) {
+            FF_RET(AVERROR(ENOMEM), "avformat_alloc_context");
+        }
+        ic->pb = io->context();
+    }
+    FF(avformat_open_input(&ic, url.c_str(), input_format, &options));
+    // The context of a file read through io is closed before io.
+    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [io](AVFormatContext* ctx) { avformat_close_input(&ctx); });
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]"
@@ -140,13 +543,92 @@ void Input::internal_reset()
     ic2->interrupt_callback.callback = Input::interrupt_cb;
     ic2->interrupt_callback.opaque   = this;
 
-    FF(avformat_find_stream_info(ic2.get(), nullptr));
+    // Growing files are probed every time as their duration changes.
+    const auto key   = growing_ ? std::string() : probe_key(filename_);
+    const auto probe = key.empty() ? nullptr : ProbeCache::instance().find(key);
+    if (!probe || !apply_probe(*ic2, *probe)) {
+        FF(avformat_find_stream_info(ic2.get(), nullptr));
+        if (!key.empty()) {
+            ProbeCache::instance().store(key, *ic2);
+        }
+    }
+
+    duration_stream_ = av_find_best_stream(ic2.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (duration_stream_ < 0) {
+        duration_stream_ = av_find_best_stream(ic2.get(), AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    }
+
+    if (growing_) {
+        const auto name = ic2->iformat->name;
+        reopen_         = std::strstr(name, "mov") != nullptr || std::strstr(name, "mxf") != nullptr;
+        last_dts_.resize(ic2->nb_streams, AV_NOPTS_VALUE);
+        if (file_size_ < 0) {
+            file_size_ = file_size(filename_);
+            grow_time_ = std::chrono::steady_clock::now();
+        }
+    }
+
     ic_ = std::move(ic2);
+    std::atomic_store(&io_, std::move(io));
+    cache_window_ = std::make_unique<CacheWindow>(filename_, false);
     ic_cond_.notify_all();
 }
 
 bool Input::eof() const { return eof_; }
 
+bool Input::growing() const { return growing_ && !growing_done_; }
+
+// Whether the file has grown since it was last read to the end, and if it hasn't for growing_timeout_ it is done.
+bool Input::grown()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (reopen_ && now - reopen_time_ < REOPEN_INTERVAL) {
+        return false;
+    }
+
+    const auto size = file_size(filename_);
+    if (size > file_size_) {
+        file_size_ = size;
+        grow_time_ = now;
+        return true;
+    }
+
+    if (now - grow_time_ > growing_timeout_) {
+        CASPAR_LOG(info) << "av_input[" + filename_ + "]"
+                         << " Stopped growing.";
+        growing_done_ = true;
+    }
+    return false;
+}
+
+// Reads on from the end of what has been read, from the last keyframe before it if the file is opened again.
+void Input::resume()
+{
+    if (!reopen_) {
+        ic_->pb->eof_reached = 0;
+        ic_->pb->error       = 0;
+        return;
+    }
+
+    reopen_time_ = std::chrono::steady_clock::now();
+
+    int64_t ts = AV_NOPTS_VALUE;
+    if (duration_stream_ >= 0 && static_cast<std::size_t>(duration_stream_) < last_dts_.size() &&
+        last_dts_[duration_stream_] != AV_NOPTS_VALUE) {
+        ts = av_rescale_q(last_dts_[duration_stream_], ic_->streams[duration_stream_]->time_base, TIME_BASE_Q);
+    }
+
+    if (!decoding_ic_) {
+        decoding_ic_ = ic_;
+    }
+    internal_reset();
+
+    if (ts != AV_NOPTS_VALUE) {
+        FF(avformat_seek_file(ic_.get(), -1, INT64_MIN, ts, ts, 0));
+    }
+    resumed_ = true;
+}
+
 void Input::seek(int64_t ts, bool flush)
 {
     std::unique_lock<std::mutex> lock(ic_mutex_);
@@ -157,10 +639,12 @@ void Input::seek(int64_t ts, bool flush)
         internal_reset();
     }
 
+    grow_wait_   = false;
+    resumed_     = false;
+    decoding_ic_ = nullptr;
+
     if (flush) {
-        std::shared_ptr<AVPacket> packet;
-        while (buffer_.try_pop(packet))
-            ;
+        this->flush();
     }
     eof_ = false;
 
@@ -3,32 +3,45 @@
 #include <common/diagnostics/graph.h>
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
-
-#include <tbb/concurrent_queue.h>
+#include <vector>
 
 struct AVPacket;
 struct AVFormatContext;
 
 namespace caspar { namespace ffmpeg {
 
+class CacheWindow;
+class FileIO;
+
 class Input
 {
   public:
-    Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph);
+    // on_packet is called from the read thread after each packet, or the end of the file, is queued.
+    Input(const std::string&                  filename,
+          std::shared_ptr<diagnostics::graph> graph,
+          std::function<void()>               on_packet = nullptr);
     ~Input();
 
     static int interrupt_cb(void* ctx);
 
     bool try_pop(std::shared_ptr<AVPacket>& packet);
 
+    // Pops the first packet of a stream that accept takes by its index, the packets passed over stay queued in order.
+    // The end of the file is only popped once it is first.
+    bool try_pop(std::shared_ptr<AVPacket>& packet, const std::function<bool(int)>& accept);
+
+    // Whether the read ahead is full, so that nothing more is read until packets are popped.
+    bool blocked() const;
+
     AVFormatContext* operator->();
 
     AVFormatContext* const operator->() const;
@@ -37,20 +50,76 @@ class Input
     bool eof() const;
     void seek(int64_t ts, bool flush = true);
 
+    // Whether the file is still being written, its duration is then not known yet.
+    bool growing() const;
+
+    // Bits per second read over the last second.
+    int64_t bitrate() const;
+
+    // Milliseconds spent in reads that blocked for longer than a frame would last.
+    int64_t stall_time() const;
+
+    // Bytes per second read from a local file through FileIO over the last second, 0 for other inputs.
+    int64_t io_rate() const;
+
   private:
+    struct Packet
+    {
+        std::shared_ptr<AVPacket> packet;
+        int64_t                   size     = 0;
+        int64_t                   duration = 0;
+    };
+
     void internal_reset();
+    bool full() const;
+    void push(Packet packet);
+    void flush();
+    bool grown();
+    void resume();
 
     std::string                         filename_;
     std::shared_ptr<diagnostics::graph> graph_;
+    const std::function<void()>         on_packet_;
 
     mutable std::mutex               ic_mutex_;
     std::shared_ptr<AVFormatContext> ic_;
+    std::shared_ptr<FileIO>          io_;
+    std::unique_ptr<CacheWindow>     cache_window_;
     std::condition_variable          ic_cond_;
 
-    tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> buffer_;
+    int duration_stream_ = -1;
+
+    // Read ahead is bounded by bytes and, optionally, by the duration of the packets of duration_stream_.
+    mutable std::mutex      buffer_mutex_;
+    std::condition_variable buffer_cond_;
+    std::deque<Packet>      buffer_;
+    int64_t                 buffer_size_     = 0;
+    int64_t                 buffer_duration_ = 0;
+    const int64_t           buffer_capacity_;
+    const int64_t           buffer_max_duration_;
+
+    std::atomic<int64_t> bitrate_{0};
+    std::atomic<int64_t> stall_time_{0};
 
     std::atomic<bool> eof_{false};
 
+    // With ffmpeg.producer.growing-files the end of a file that is still being written is a pause until it grows, it
+    // ends once it hasn't grown for growing_timeout_. Demuxers that read an index when opening, mov and mxf, are
+    // opened again to read on, and the packets up to the last ones read are skipped. decoding_ic_ keeps the context
+    // that the streams of the decoders belong to alive until the next seek.
+    bool                                  growing_ = false;
+    std::atomic<bool>                     growing_done_{false};
+    std::atomic<bool>                     grow_wait_{false};
+    bool                                  reopen_    = false;
+    bool                                  resumed_   = false;
+    int64_t                               file_size_ = -1;
+    std::chrono::steady_clock::time_point grow_time_;
+    const std::chrono::milliseconds       grow_poll_;
+    const std::chrono::milliseconds       growing_timeout_;
+    std::chrono::steady_clock::time_point reopen_time_;
+    std::vector<int64_t>                  last_dts_;
+    std::shared_ptr<AVFormatContext>      decoding_ic_;
+
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
 };
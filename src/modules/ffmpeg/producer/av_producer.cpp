@@ -1,5 +1,6 @@
 #include "av_producer.h"
 
+#include "av_index.h"
 #include "av_input.h"
 
 #include "../util/av_assert.h"
@@ -21,6 +22,10 @@
 #include <common/scope_exit.h>
 #include <common/timer.h>
 
+#include <core/channel_arena.h>
+#include <core/diagnostics/call_context.h>
+#include <core/diagnostics/memory.h>
+#include <core/diagnostics/trace.h>
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/monitor/monitor.h>
@@ -36,6 +41,7 @@ extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
 #include <libavutil/error.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixfmt.h>
@@ -50,21 +56,35 @@ extern "C" {
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <deque>
 #include <iomanip>
+#include <limits>
 #include <memory>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <tuple>
 
 namespace caspar { namespace ffmpeg {
 
 const AVRational TIME_BASE_Q = {1, AV_TIME_BASE};
 
+// How long before the end of a looping clip its start is opened and decoded.
+const int64_t PREROLL_DURATION = 2 * AV_TIME_BASE;
+
+// Shortest stretch decoded per seek when playing backwards, so that intra-only files aren't seeked for every frame.
+const int64_t REVERSE_SPAN = AV_TIME_BASE / 4;
+
+// Packets queued for each decoder, beyond them the stream waits in the read ahead of the input.
+const std::size_t DECODER_MAX_PACKETS = 64;
+const int64_t     DECODER_MAX_SIZE    = 16 * 1024 * 1024;
+
 struct Frame
 {
     std::shared_ptr<AVFrame> video;
     std::shared_ptr<AVFrame> audio;
+    std::shared_ptr<AVFrame> alpha;
     core::draw_frame         frame;
     int64_t                  start_time = AV_NOPTS_VALUE;
     int64_t                  pts        = AV_NOPTS_VALUE;
@@ -74,18 +94,29 @@ struct Frame
 // TODO (fix) Handle ts discontinuities.
 // TODO (feat) Forward options.
 
+struct DecoderOptions
+{
+    core::frame_factory* frame_factory = nullptr;
+    std::string          hwaccel;
+    bool                 background = false;
+};
+
 struct Decoder
 {
     AVStream*                             st = nullptr;
+    std::shared_ptr<void>                 opaque;
+    std::shared_ptr<void>                 threads;
     std::shared_ptr<AVCodecContext>       ctx;
+    AVPixelFormat                         pix_fmt  = AV_PIX_FMT_NONE;
     int64_t                               next_pts = AV_NOPTS_VALUE;
     std::queue<std::shared_ptr<AVPacket>> input;
+    int64_t                               input_size = 0;
     std::shared_ptr<AVFrame>              frame;
     bool                                  eof = false;
 
     Decoder() = default;
 
-    explicit Decoder(AVStream* stream)
+    explicit Decoder(AVStream* stream, const DecoderOptions& options = DecoderOptions{})
         : st(stream)
     {
         const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
@@ -102,10 +133,10 @@ struct Decoder
 
         FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
 
+        pix_fmt = ctx->pix_fmt;
+
         FF(av_opt_set_int(ctx.get(), "refcounted_frames", 1, 0));
 
-        // TODO (fix): Remove limit.
-        FF(av_opt_set_int(ctx.get(), "threads", env::properties().get(L"configuration.ffmpeg.producer.threads", 4), 0));
         // FF(av_opt_set_int(ctx.get(), "enable_er", 1, 0));
 
         ctx->pkt_timebase = stream->time_base;
@@ -122,10 +153,16 @@ struct Decoder
             }
         }
 
-        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
-            ctx->thread_type = FF_THREAD_SLICE;
+        if (ctx->codec_type == AVMEDIA_TYPE_VIDEO && !options.hwaccel.empty()) {
+            opaque = set_hwaccel(ctx.get(), options.hwaccel, pix_fmt);
+        }
+
+        if (!opaque && options.frame_factory) {
+            opaque = set_frame_allocator(ctx.get(), *options.frame_factory);
         }
 
+        threads = set_decode_threads(ctx.get(), options.background);
+
         FF(avcodec_open2(ctx.get(), codec, nullptr));
     }
 
@@ -143,6 +180,7 @@ struct Decoder
                 return false;
             }
             FF(avcodec_send_packet(ctx.get(), input.front().get()));
+            input_size -= input.front() ? input.front()->size : 0;
             input.pop();
         } else if (ret == AVERROR_EOF) {
             avcodec_flush_buffers(ctx.get());
@@ -153,6 +191,15 @@ struct Decoder
         } else {
             FF_RET(ret, "avcodec_receive_frame");
 
+            if (av_frame->hw_frames_ctx) {
+                // TODO (perf) Map the surface into OpenGL instead of downloading it.
+                auto sw_frame    = alloc_frame();
+                sw_frame->format = pix_fmt;
+                FF(av_hwframe_transfer_data(sw_frame.get(), av_frame.get(), 0));
+                FF(av_frame_copy_props(sw_frame.get(), av_frame.get()));
+                av_frame = std::move(sw_frame);
+            }
+
             // NOTE This is a workaround for DVCPRO HD.
             if (av_frame->width > 1024 && av_frame->interlaced_frame) {
                 av_frame->top_field_first = 1;
@@ -187,6 +234,260 @@ struct Decoder
     }
 };
 
+// Interleaves the decoded samples of the audio streams of a file into the s32 layout of the channel, the channels of
+// the streams one after the other as amerge would, without libavfilter. Used for files whose audio needs neither
+// filters nor resampling, the common case being mxf masters with 8 to 16 mono tracks.
+struct AudioInterleaver
+{
+    // Decoded frames are taken while a stream has fewer samples than this waiting for the others.
+    static const int64_t WANTED_SAMPLES = 8192;
+
+    struct Track
+    {
+        int                  index    = -1;
+        int                  channels = 0;
+        int                  offset   = 0;
+        std::vector<int32_t> samples;
+        std::size_t          read    = 0;
+        bool                 started = false;
+        int64_t              skip    = 0;
+        bool                 eof     = false;
+
+        int64_t buffered() const { return static_cast<int64_t>(samples.size() - read) / channels; }
+    };
+
+    std::vector<Track> tracks;
+    int                channels    = 0;
+    int                sample_rate = 0;
+    int64_t            start       = 0;
+    int64_t            pts         = 0;
+
+    // Returns nullptr unless every stream is pcm, or another format that converts to s32 as is, at the sample rate of
+    // the channel, and the streams are mono or fit the channels of the channel together.
+    static std::shared_ptr<AudioInterleaver>
+    create(const std::vector<AVStream*>& streams, int64_t start_time, const core::video_format_desc& format_desc)
+    {
+        if (!env::properties().get(L"configuration.ffmpeg.producer.native-audio", true)) {
+            return nullptr;
+        }
+
+        auto result         = std::make_shared<AudioInterleaver>();
+        result->sample_rate = format_desc.audio_sample_rate;
+
+        auto total = 0;
+        auto mono  = true;
+        for (auto st : streams) {
+            const auto par = st->codecpar;
+            if (par->codec_type != AVMEDIA_TYPE_AUDIO) {
+                continue;
+            }
+            if (par->sample_rate != format_desc.audio_sample_rate || par->channels <= 0 ||
+                !supports(static_cast<AVSampleFormat>(par->format))) {
+                return nullptr;
+            }
+
+            Track track;
+            track.index    = st->index;
+            track.channels = par->channels;
+            track.offset   = total;
+            result->tracks.push_back(std::move(track));
+
+            total += par->channels;
+            mono = mono && par->channels == 1;
+        }
+
+        // Anything else is remixed by libavfilter, mono tracks beyond the channels of the channel are left out.
+        if (result->tracks.empty() || (total > format_desc.audio_channels && !mono)) {
+            return nullptr;
+        }
+
+        result->channels = std::min(total, format_desc.audio_channels);
+        result->start    = av_rescale_q(start_time, TIME_BASE_Q, {1, result->sample_rate});
+        result->pts      = result->start;
+        return result;
+    }
+
+    static bool supports(AVSampleFormat format)
+    {
+        switch (format) {
+            case AV_SAMPLE_FMT_S16:
+            case AV_SAMPLE_FMT_S16P:
+            case AV_SAMPLE_FMT_S32:
+            case AV_SAMPLE_FMT_S32P:
+            case AV_SAMPLE_FMT_FLT:
+            case AV_SAMPLE_FMT_FLTP:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    Track* find(int index)
+    {
+        auto it = std::find_if(tracks.begin(), tracks.end(), [&](const Track& track) { return track.index == index; });
+        return it != tracks.end() ? &*it : nullptr;
+    }
+
+    bool wants(int index)
+    {
+        auto track = find(index);
+        return track && !track->eof && track->buffered() < WANTED_SAMPLES;
+    }
+
+    // Appends the samples of frame, the first frame of a stream is trimmed or padded with silence to start, as the
+    // first_pts of aresample does. A frame without data ends the stream.
+    void push(int index, const AVFrame& frame, AVRational time_base)
+    {
+        auto track = find(index);
+        if (!track) {
+            return;
+        }
+
+        if (!frame.data[0]) {
+            track->eof = true;
+            return;
+        }
+
+        if (!track->started) {
+            track->started = true;
+            if (frame.pts != AV_NOPTS_VALUE) {
+                const auto first = av_rescale_q(frame.pts, time_base, {1, sample_rate});
+                if (first < start) {
+                    track->skip = start - first;
+                } else {
+                    // At most a second, timestamps that are further off aren't worth the silence.
+                    const auto pad = std::min<int64_t>(first - start, sample_rate);
+                    track->samples.resize(track->samples.size() + pad * track->channels, 0);
+                }
+            }
+        }
+
+        const auto skip = static_cast<int>(std::min<int64_t>(track->skip, frame.nb_samples));
+        track->skip -= skip;
+
+        const auto count = frame.nb_samples - skip;
+        if (count <= 0) {
+            return;
+        }
+
+        const auto size = track->samples.size();
+        track->samples.resize(size + static_cast<std::size_t>(count) * track->channels, 0);
+        const auto dst      = track->samples.data() + size;
+        const auto channels = std::min(frame.channels, track->channels);
+
+        switch (static_cast<AVSampleFormat>(frame.format)) {
+            case AV_SAMPLE_FMT_S16:
+            case AV_SAMPLE_FMT_S16P:
+                convert<int16_t>(frame, skip, count, channels, track->channels, dst);
+                break;
+            case AV_SAMPLE_FMT_S32:
+            case AV_SAMPLE_FMT_S32P:
+                convert<int32_t>(frame, skip, count, channels, track->channels, dst);
+                break;
+            case AV_SAMPLE_FMT_FLT:
+            case AV_SAMPLE_FMT_FLTP:
+                convert<float>(frame, skip, count, channels, track->channels, dst);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // The next count samples of all streams, once every stream that hasn't ended has them, fewer at the end.
+    std::shared_ptr<AVFrame> pop(int count)
+    {
+        auto available = std::numeric_limits<int64_t>::max();
+        auto remaining = int64_t{0};
+        auto ended     = true;
+        for (auto& track : tracks) {
+            remaining = std::max(remaining, track.buffered());
+            if (!track.eof) {
+                ended     = false;
+                available = std::min(available, track.buffered());
+            }
+        }
+        if (ended ? remaining == 0 : available < count) {
+            return nullptr;
+        }
+
+        const auto nb_samples = static_cast<int>(ended ? std::min<int64_t>(count, remaining) : count);
+
+        auto frame            = alloc_frame();
+        frame->format         = AV_SAMPLE_FMT_S32;
+        frame->channels       = channels;
+        frame->channel_layout = av_get_default_channel_layout(channels);
+        frame->sample_rate    = sample_rate;
+        frame->nb_samples     = nb_samples;
+        FF(av_frame_get_buffer(frame.get(), 0));
+        frame->pts = pts;
+        pts += nb_samples;
+
+        const auto dst = reinterpret_cast<int32_t*>(frame->data[0]);
+        std::fill(dst, dst + static_cast<std::size_t>(nb_samples) * channels, 0);
+
+        for (auto& track : tracks) {
+            const auto n     = static_cast<int>(std::min<int64_t>(nb_samples, track.buffered()));
+            const auto src   = track.samples.data() + track.read;
+            const auto width = std::min(track.channels, channels - track.offset);
+            if (width == 1 && track.channels == 1) {
+                for (auto i = 0; i < n; ++i) {
+                    dst[i * channels + track.offset] = src[i];
+                }
+            } else {
+                for (auto i = 0; i < n; ++i) {
+                    for (auto c = 0; c < width; ++c) {
+                        dst[i * channels + track.offset + c] = src[i * track.channels + c];
+                    }
+                }
+            }
+
+            track.read += static_cast<std::size_t>(n) * track.channels;
+            if (track.read * 2 >= track.samples.size()) {
+                track.samples.erase(track.samples.begin(), track.samples.begin() + track.read);
+                track.read = 0;
+            }
+        }
+
+        return frame;
+    }
+
+    bool done() const
+    {
+        return std::all_of(
+            tracks.begin(), tracks.end(), [](const Track& track) { return track.eof && track.buffered() == 0; });
+    }
+
+  private:
+    static int32_t to_s32(int16_t sample) { return static_cast<int32_t>(sample) * 65536; }
+    static int32_t to_s32(int32_t sample) { return sample; }
+    static int32_t to_s32(float sample)
+    {
+        return static_cast<int32_t>(std::lrint(std::max(-1.0, std::min(1.0, static_cast<double>(sample))) * INT32_MAX));
+    }
+
+    // Plain loops over one channel at a time, which the compiler vectorizes.
+    template <typename T>
+    static void convert(const AVFrame& frame, int skip, int count, int channels, int stride, int32_t* dst)
+    {
+        if (av_sample_fmt_is_planar(static_cast<AVSampleFormat>(frame.format))) {
+            for (auto c = 0; c < channels; ++c) {
+                const auto src = reinterpret_cast<const T*>(frame.extended_data[c]) + skip;
+                for (auto i = 0; i < count; ++i) {
+                    dst[i * stride + c] = to_s32(src[i]);
+                }
+            }
+        } else {
+            const auto src =
+                reinterpret_cast<const T*>(frame.data[0]) + static_cast<std::size_t>(skip) * frame.channels;
+            for (auto i = 0; i < count; ++i) {
+                for (auto c = 0; c < channels; ++c) {
+                    dst[i * stride + c] = to_s32(src[i * frame.channels + c]);
+                }
+            }
+        }
+    }
+};
+
 struct Filter
 {
     std::shared_ptr<AVFilterGraph>  graph;
@@ -195,6 +496,13 @@ struct Filter
     std::shared_ptr<AVFrame>        frame;
     bool                            eof = false;
 
+    // Takes the place of the graph for audio without filters, its streams are fed by Chain::schedule.
+    std::shared_ptr<AudioInterleaver> interleaver;
+
+    // The alpha stream of a file with separate fill and alpha streams, filtered by a Filter of its own and matted
+    // onto the fill by the mixer instead of alphamerge.
+    int alpha_index = -1;
+
     Filter() = default;
 
     Filter(std::string                    filter_spec,
@@ -202,8 +510,24 @@ struct Filter
            std::map<int, Decoder>&        streams,
            int64_t                        start_time,
            AVMediaType                    media_type,
-           const core::video_format_desc& format_desc)
+           const core::video_format_desc& format_desc,
+           const DecoderOptions&          decoder_options = DecoderOptions{},
+           int                            stream_index    = -1)
     {
+        if (media_type == AVMEDIA_TYPE_AUDIO && filter_spec.empty()) {
+            interleaver = AudioInterleaver::create(default_streams(input), start_time, format_desc);
+            if (interleaver) {
+                for (auto& track : interleaver->tracks) {
+                    if (streams.find(track.index) == streams.end()) {
+                        streams.emplace(std::piecewise_construct,
+                                        std::forward_as_tuple(track.index),
+                                        std::forward_as_tuple(input->streams[track.index], decoder_options));
+                    }
+                }
+                return;
+            }
+        }
+
         if (media_type == AVMEDIA_TYPE_VIDEO) {
             if (filter_spec.empty()) {
                 filter_spec = "null";
@@ -211,7 +535,8 @@ struct Filter
 
             auto deint = u8(env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.auto-deinterlace", L"interlaced"));
 
-            if (deint != "none") {
+            // With gpu deinterlacing frames pass through whole and the mixer interpolates the field to show.
+            if (deint != "none" && !env::properties().get(L"configuration.ffmpeg.producer.gpu-deinterlace", false)) {
                 filter_spec += (boost::format(",bwdif=mode=send_field:parity=auto:deint=%s") % deint).str();
             }
 
@@ -275,18 +600,12 @@ struct Filter
             }
         }
 
-        std::vector<AVStream*> av_streams;
-        for (auto n = 0U; n < input->nb_streams; ++n) {
-            const auto st = input->streams[n];
-
-            if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && st->codecpar->channels == 0) {
-                continue;
-            }
-
-            auto disposition = st->disposition;
-            if (!disposition || disposition == AV_DISPOSITION_DEFAULT) {
-                av_streams.push_back(st);
-            }
+        auto av_streams = default_streams(input);
+        if (stream_index >= 0) {
+            av_streams.erase(std::remove_if(av_streams.begin(),
+                                            av_streams.end(),
+                                            [&](auto s) { return s->index != stream_index; }),
+                             av_streams.end());
         }
 
         if (audio_input_count == 1) {
@@ -315,7 +634,11 @@ struct Filter
             // https://github.com/CasparCG/server/issues/832
             if (video_av_streams.size() >= 2 &&
                 video_av_streams[0]->codecpar->height == video_av_streams[1]->codecpar->height) {
-                filter_spec = "alphamerge," + filter_spec;
+                if (env::properties().get(L"configuration.ffmpeg.producer.gpu-alphamerge", true)) {
+                    alpha_index = video_av_streams[1]->index;
+                } else {
+                    filter_spec = "alphamerge," + filter_spec;
+                }
             }
         }
 
@@ -359,14 +682,17 @@ struct Filter
 
                 auto it = streams.find(index);
                 if (it == streams.end()) {
-                    it = streams.emplace(index, input->streams[index]).first;
+                    it = streams.emplace(std::piecewise_construct,
+                                         std::forward_as_tuple(index),
+                                         std::forward_as_tuple(input->streams[index], decoder_options))
+                             .first;
                 }
 
                 auto st = it->second.ctx;
 
                 if (st->codec_type == AVMEDIA_TYPE_VIDEO) {
                     auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d") % st->width % st->height %
-                                 st->pix_fmt % st->pkt_timebase.num % st->pkt_timebase.den)
+                                 it->second.pix_fmt % st->pkt_timebase.num % st->pkt_timebase.den)
                                     .str();
                     auto name = (boost::format("in_%d") % index).str();
 
@@ -422,9 +748,15 @@ struct Filter
                                               AV_PIX_FMT_YUV422P,
                                               AV_PIX_FMT_YUV420P,
                                               AV_PIX_FMT_YUV410P,
+                                              AV_PIX_FMT_YUV444P10,
+                                              AV_PIX_FMT_YUV422P10,
+                                              AV_PIX_FMT_YUV420P10,
+                                              AV_PIX_FMT_NV12,
+                                              AV_PIX_FMT_P010,
                                               AV_PIX_FMT_YUVA444P,
                                               AV_PIX_FMT_YUVA422P,
                                               AV_PIX_FMT_YUVA420P,
+                                              AV_PIX_FMT_GRAY8,
                                               AV_PIX_FMT_NONE};
             FF(av_opt_set_int_list(sink, "pix_fmts", pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
@@ -440,7 +772,9 @@ struct Filter
             const AVSampleFormat sample_fmts[] = {AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_NONE};
             FF(av_opt_set_int_list(sink, "sample_fmts", sample_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 
-            // TODO Always output 8 channels and remove hack in make_frame.
+            // Let ffmpeg remix to the channel layout so that make_frame can copy samples as is.
+            const int channel_counts[] = {format_desc.audio_channels, -1};
+            FF(av_opt_set_int_list(sink, "channel_counts", channel_counts, -1, AV_OPT_SEARCH_CHILDREN));
 
             const int sample_rates[] = {format_desc.audio_sample_rate, -1};
             FF(av_opt_set_int_list(sink, "sample_rates", sample_rates, -1, AV_OPT_SEARCH_CHILDREN));
@@ -474,12 +808,46 @@ struct Filter
         CASPAR_LOG(debug) << avfilter_graph_dump(graph.get(), nullptr);
     }
 
+    // Streams with packets in the file and without an explicit disposition, or those that are the default.
+    static std::vector<AVStream*> default_streams(const Input& input)
+    {
+        std::vector<AVStream*> result;
+        for (auto n = 0U; n < input->nb_streams; ++n) {
+            const auto st = input->streams[n];
+
+            if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && st->codecpar->channels == 0) {
+                continue;
+            }
+
+            auto disposition = st->disposition;
+            if (!disposition || disposition == AV_DISPOSITION_DEFAULT) {
+                result.push_back(st);
+            }
+        }
+        return result;
+    }
+
+    AVRational time_base() const
+    {
+        return interleaver ? AVRational{1, interleaver->sample_rate} : av_buffersink_get_time_base(sink);
+    }
+
+    int sample_rate() const { return interleaver ? interleaver->sample_rate : av_buffersink_get_sample_rate(sink); }
+
     bool operator()(int nb_samples = -1)
     {
         if (frame || eof) {
             return false;
         }
 
+        if (interleaver) {
+            frame = interleaver->pop(nb_samples > 0 ? nb_samples : 1024);
+            if (!frame && interleaver->done()) {
+                eof = true;
+            }
+            return frame || eof;
+        }
+
         if (!sink || sources.empty()) {
             eof   = true;
             frame = nullptr;
@@ -504,12 +872,169 @@ struct Filter
     }
 };
 
+// Demuxer, decoders and filter graphs of one pass through the file.
+struct Chain
+{
+    Input                                        input;
+    std::map<int, Decoder>                       decoders;
+    Filter                                       video_filter;
+    Filter                                       audio_filter;
+    Filter                                       alpha_filter;
+    std::map<int, std::vector<AVFilterContext*>> sources;
+
+    Chain(const std::string& path, std::shared_ptr<diagnostics::graph> graph, std::function<void()> on_packet = nullptr)
+        : input(path, graph, std::move(on_packet))
+    {
+    }
+
+    // Whether all filters have a frame waiting or have ended.
+    bool ready() const
+    {
+        return (video_filter.frame || video_filter.eof) && (audio_filter.frame || audio_filter.eof) &&
+               (alpha_filter.frame || alpha_filter.eof);
+    }
+
+    bool operator()(int nb_samples)
+    {
+        std::atomic<int> progress{schedule()};
+
+        // The work below runs on tbb workers, which don't carry the call context of the producer thread.
+        const auto context = core::diagnostics::call_context::for_thread();
+
+        tbb::parallel_invoke(
+            [&] {
+                tbb::parallel_for_each(decoders, [&](auto& p) {
+                    CASPAR_TRACE_SCOPE("ffmpeg::decode", context.video_channel, context.layer);
+                    progress.fetch_or(p.second());
+                });
+            },
+            [&] {
+                CASPAR_TRACE_SCOPE("ffmpeg::video_filter", context.video_channel, context.layer);
+                progress.fetch_or(video_filter());
+            },
+            [&] {
+                CASPAR_TRACE_SCOPE("ffmpeg::alpha_filter", context.video_channel, context.layer);
+                progress.fetch_or(alpha_filter());
+            },
+            [&] {
+                CASPAR_TRACE_SCOPE("ffmpeg::audio_filter", context.video_channel, context.layer);
+                progress.fetch_or(audio_filter(nb_samples));
+            });
+
+        return progress != 0;
+    }
+
+  private:
+    bool want_packet()
+    {
+        return std::any_of(
+            decoders.begin(), decoders.end(), [](auto& p) { return p.second.input.size() < 2 && !p.second.eof; });
+    }
+
+    // Whether a packet of the stream can be queued, those that aren't decoded are always taken to be dropped.
+    bool accepts(int index) const
+    {
+        auto it = decoders.find(index);
+        if (it == decoders.end() || it->second.eof || sources.find(index) == sources.end()) {
+            return true;
+        }
+        const auto& decoder = it->second;
+        return decoder.input.size() < DECODER_MAX_PACKETS &&
+               (decoder.input.size() < 2 || decoder.input_size < DECODER_MAX_SIZE);
+    }
+
+    // Packets are taken for the decoders that are starving, those of streams that have enough queued are passed over
+    // and stay in the read ahead. Only once it is full are they queued regardless, as the packets that the starving
+    // decoders wait for can't be read before then.
+    bool schedule()
+    {
+        auto result = false;
+
+        const auto accept = [this](int index) { return accepts(index); };
+
+        std::shared_ptr<AVPacket> packet;
+        while (want_packet() && (input.try_pop(packet, accept) || (input.blocked() && input.try_pop(packet)))) {
+            result = true;
+
+            if (!packet) {
+                for (auto& p : decoders) {
+                    if (!p.second.eof) {
+                        p.second.input.push(nullptr);
+                    }
+                }
+            } else if (sources.find(packet->stream_index) != sources.end()) {
+                auto it = decoders.find(packet->stream_index);
+                if (it != decoders.end()) {
+                    it->second.input_size += packet->size;
+                    it->second.input.push(std::move(packet));
+                }
+            }
+        }
+
+        std::vector<int> eof;
+
+        for (auto& p : sources) {
+            auto it = decoders.find(p.first);
+            if (it == decoders.end() || !it->second.frame) {
+                continue;
+            }
+
+            if (audio_filter.interleaver && audio_filter.interleaver->find(p.first)) {
+                if (audio_filter.interleaver->wants(p.first)) {
+                    auto frame = std::move(it->second.frame);
+                    audio_filter.interleaver->push(p.first, *frame, it->second.ctx->pkt_timebase);
+                    if (!frame->data[0]) {
+                        eof.push_back(p.first);
+                    }
+                    result = true;
+                }
+                continue;
+            }
+
+            auto nb_requests = 0U;
+            for (auto source : p.second) {
+                nb_requests = std::max(nb_requests, av_buffersrc_get_nb_failed_requests(source));
+            }
+
+            if (nb_requests == 0) {
+                continue;
+            }
+
+            auto frame = std::move(it->second.frame);
+
+            for (auto& source : p.second) {
+                if (frame && !frame->data[0]) {
+                    FF(av_buffersrc_close(source, frame->pts, 0));
+                } else {
+                    // TODO (fix) Guard against overflow?
+                    FF(av_buffersrc_write_frame(source, frame.get()));
+                }
+                result = true;
+            }
+
+            // End Of File
+            if (!frame->data[0]) {
+                eof.push_back(p.first);
+            }
+        }
+
+        for (auto index : eof) {
+            sources.erase(index);
+        }
+
+        return result;
+    }
+};
+
 struct AVProducer::Impl
 {
     caspar::core::monitor::state state_;
     mutable boost::mutex         state_mutex_;
 
     spl::shared_ptr<diagnostics::graph> graph_;
+    const int                           frame_time_id_ = graph_->series("frame-time");
+    const int                           buffer_id_     = graph_->series("buffer");
+    const int                           underflow_id_  = graph_->series("underflow");
 
     const std::shared_ptr<core::frame_factory> frame_factory_;
     const core::video_format_desc              format_desc_;
@@ -517,21 +1042,54 @@ struct AVProducer::Impl
     const std::string                          name_;
     const std::string                          path_;
 
-    Input                  input_;
-    std::map<int, Decoder> decoders_;
-    Filter                 video_filter_;
-    Filter                 audio_filter_;
+    // Decoding runs on the cpus and in the arena of the channel that the producer is created for.
+    const core::diagnostics::call_context context_ = core::diagnostics::call_context::for_thread();
+    const int                             channel_ = context_.video_channel;
+
+    // The frames decoded for the layer are charged to it, the buffer stops filling early while it is over its cap.
+    const std::shared_ptr<core::diagnostics::memory_account> memory_ =
+        core::diagnostics::memory_account::for_owner(context_);
 
-    std::map<int, std::vector<AVFilterContext*>> sources_;
+    std::unique_ptr<Chain>         chain_;
+    std::shared_ptr<KeyframeIndex> index_;
+
+    // Second pass through the file from the loop start, opened while the tail of the current pass plays.
+    std::unique_ptr<Chain> preroll_;
+    int64_t                preroll_start_  = AV_NOPTS_VALUE;
+    bool                   preroll_failed_ = false;
 
     std::atomic<int64_t> start_{AV_NOPTS_VALUE};
     std::atomic<int64_t> duration_{AV_NOPTS_VALUE};
     std::atomic<int64_t> input_duration_{AV_NOPTS_VALUE};
     std::atomic<int64_t> seek_{AV_NOPTS_VALUE};
     std::atomic<bool>    loop_{false};
+    std::atomic<double>  speed_{1.0};
+    std::atomic<bool>    blend_{false};
 
     std::string afilter_;
     std::string vfilter_;
+    std::string hwaccel_;
+    std::string key_path_;
+
+    // Pass through the key file, seeked along with chain_. key_video_ is the key of the last frame that was pushed,
+    // key_frame_ its upload, which is reused while the fps filter repeats the key.
+    std::unique_ptr<Chain>   key_chain_;
+    std::shared_ptr<AVFrame> key_video_;
+    std::shared_ptr<AVFrame> key_shown_;
+    core::const_frame        key_frame_;
+
+    // The upload of the alpha stream of the last frame, see Filter::alpha_index.
+    std::shared_ptr<AVFrame> alpha_shown_;
+    core::const_frame        alpha_frame_;
+
+    const std::string deinterlace_ = u8(
+        env::properties().get<std::wstring>(L"configuration.ffmpeg.producer.auto-deinterlace", L"interlaced"));
+    const bool gpu_deinterlace_ =
+        deinterlace_ != "none" && env::properties().get(L"configuration.ffmpeg.producer.gpu-deinterlace", false);
+
+    // Last video frame, the fps filter repeats it for the second field of interlaced sources.
+    std::shared_ptr<AVFrame> field_video_;
+    core::const_frame        field_frame_;
 
     int64_t          frame_count_    = 0;
     bool             frame_flush_    = true;
@@ -539,14 +1097,47 @@ struct AVProducer::Impl
     int64_t          frame_duration_ = AV_NOPTS_VALUE;
     core::draw_frame frame_;
 
+    // Position of the last frame out of the filters, and frames before skip_pts_ are dropped after a short seek.
+    int64_t decode_pts_ = AV_NOPTS_VALUE;
+    int64_t skip_pts_   = AV_NOPTS_VALUE;
+
+    // Backwards the stretch from reverse_start_ to reverse_end_ is decoded into reverse_frames_, which are then
+    // buffered last first. At most reverse_capacity_ frames are kept, the ones before them are decoded again next.
+    int64_t           reverse_start_ = AV_NOPTS_VALUE;
+    int64_t           reverse_end_   = AV_NOPTS_VALUE;
+    std::deque<Frame> reverse_frames_;
+    const std::size_t reverse_capacity_ = static_cast<std::size_t>(format_desc_.fps) * 2;
+
+    // Ticks of playback that haven't been shown yet away from normal speed.
+    double phase_ = 0.0;
+
     std::deque<Frame>         buffer_;
     mutable boost::mutex      buffer_mutex_;
+    std::deque<Frame>         history_;
     boost::condition_variable buffer_cond_;
     std::atomic<bool>         buffer_eof_{false};
-    int                       buffer_capacity_ = static_cast<int>(format_desc_.fps) / 2;
+    caspar::timer             taken_timer_;
+
+    // Counts what the decode loop waits for when it can't go on, packets read, frames taken from the buffer, seeks
+    // and changed settings, so that it sleeps until one of them happens. Guarded by buffer_mutex_.
+    std::uint64_t wakeups_ = 0;
+
+    // Half a second of frames, within a budget so that large formats don't hold gigabytes on every layer.
+    const int buffer_capacity_ = core::diagnostics::buffer_frames(
+        env::properties().get(L"configuration.ffmpeg.producer.buffer-duration", 0.5),
+        format_desc_.fps,
+        static_cast<std::int64_t>(format_desc_.size),
+        env::properties().get(L"configuration.ffmpeg.producer.buffer-budget", std::int64_t(256)) * 1024 * 1024,
+        2);
+
+    // Frames shown last, still in their upload buffers, so that seeking back a little doesn't decode.
+    const std::size_t history_capacity_ = static_cast<std::size_t>(std::max(
+        0, env::properties().get(L"configuration.ffmpeg.producer.frame-cache", static_cast<int>(format_desc_.fps))));
 
     int latency_ = 0;
 
+    caspar::timer load_timer_;
+
     boost::thread     thread_;
     std::atomic<bool> abort_request_{false};
 
@@ -558,18 +1149,23 @@ struct AVProducer::Impl
          std::string                          afilter,
          boost::optional<int64_t>             start,
          boost::optional<int64_t>             duration,
-         bool                                 loop)
+         bool                                 loop,
+         std::string                          hwaccel,
+         std::string                          key_path)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , format_tb_({format_desc.duration, format_desc.time_scale})
         , name_(name)
         , path_(path)
-        , input_(path, graph_)
+        , chain_(std::make_unique<Chain>(path, graph_, [this] { wake(); }))
+        , index_(get_keyframe_index(path))
         , start_(start ? av_rescale_q(*start, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , duration_(duration ? av_rescale_q(*duration, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , loop_(loop)
         , afilter_(afilter)
         , vfilter_(vfilter)
+        , hwaccel_(hwaccel)
+        , key_path_(key_path)
     {
         diagnostics::register_graph(graph_);
         graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
@@ -579,10 +1175,14 @@ struct AVProducer::Impl
         state_["file/name"] = u8(name_);
         state_["file/path"] = u8(path_);
         state_["loop"]      = loop;
+        if (!key_path_.empty()) {
+            state_["file/key"] = u8(key_path_);
+        }
         update_state();
 
         thread_ = boost::thread([=] {
             try {
+                bind_thread_to_channel(channel_);
                 run();
             } catch (boost::thread_interrupted&) {
                 // Do nothing...
@@ -595,19 +1195,24 @@ struct AVProducer::Impl
     ~Impl()
     {
         abort_request_ = true;
-        buffer_cond_.notify_all();
+        wake();
         thread_.join();
+
+        // The read threads of the inputs wake this, stop them before the members they use are destroyed.
+        preroll_.reset();
+        key_chain_.reset();
+        chain_.reset();
     }
 
     void run()
     {
         std::vector<int> audio_cadence = format_desc_.audio_cadence;
 
-        input_.reset();
+        chain_->input.reset();
         {
             core::monitor::state streams;
-            for (auto n = 0UL; n < input_->nb_streams; ++n) {
-                auto st                             = input_->streams[n];
+            for (auto n = 0UL; n < chain_->input->nb_streams; ++n) {
+                auto st                             = chain_->input->streams[n];
                 auto framerate                      = av_guess_frame_rate(nullptr, st, nullptr);
                 streams[std::to_string(n) + "/fps"] = {framerate.num, framerate.den};
             }
@@ -617,47 +1222,78 @@ struct AVProducer::Impl
         }
 
         if (input_duration_ == AV_NOPTS_VALUE) {
-            input_duration_ = input_->duration;
+            input_duration_ = chain_->input->duration;
+        }
+
+        if (!key_path_.empty()) {
+            key_chain_ = std::make_unique<Chain>(key_path_, graph_, [this] { wake(); });
+            key_chain_->input.reset();
         }
 
         {
             const auto start = start_.load();
-            if (duration_ == AV_NOPTS_VALUE && input_->duration > 0) {
+            // A file that is still being written plays on for as long as it grows.
+            if (duration_ == AV_NOPTS_VALUE && chain_->input->duration > 0 && !chain_->input.growing()) {
                 if (start != AV_NOPTS_VALUE) {
-                    duration_ = input_->duration - start;
+                    duration_ = chain_->input->duration - start;
                 } else {
-                    duration_ = input_->duration;
+                    duration_ = chain_->input->duration;
                 }
             }
 
             if (start != AV_NOPTS_VALUE) {
                 seek_internal(start);
             } else {
-                reset(input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+                reset(*chain_, chain_->input->start_time != AV_NOPTS_VALUE ? chain_->input->start_time : 0);
+                seek_key(0);
             }
         }
 
         timer frame_timer;
 
         set_thread_name(L"[ffmpeg::av_producer]");
+        set_thread_role(L"ffmpeg");
+        core::diagnostics::call_context::for_thread() = context_;
 
         boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
 
         Frame frame;
 
-        int warning_debounce = 0;
-
         while (!abort_request_) {
+            // Taken before looking at any of the state, so that nothing that changes it afterwards is missed.
+            const auto seen = wakeups();
+
             {
                 const auto seek = seek_.exchange(AV_NOPTS_VALUE);
 
                 if (seek != AV_NOPTS_VALUE) {
-                    seek_internal(seek);
+                    preroll_.reset();
+                    if (speed_ < 0.0) {
+                        // Includes the frame at seek.
+                        seek_reverse(seek + 1);
+                    } else {
+                        reverse_end_ = AV_NOPTS_VALUE;
+                        reverse_frames_.clear();
+                        seek_internal(seek);
+                    }
                     frame = Frame{};
                     continue;
                 }
             }
 
+            if (reverse_end_ != AV_NOPTS_VALUE && reverse_end_ <= clip_start()) {
+                // Played back to the start, a loop goes on from the end.
+                const auto end = clip_end();
+                if (!loop_ || end == AV_NOPTS_VALUE) {
+                    buffer_eof_ = true;
+                    wait_wakeup(seen);
+                } else {
+                    seek_reverse(end);
+                    frame = Frame{};
+                }
+                continue;
+            }
+
             {
                 // TODO (perf) seek as soon as input is past duration or eof.
 
@@ -671,93 +1307,223 @@ struct AVProducer::Impl
                 // check whether the next frame will last beyond the end time
                 auto time = next_pts ? next_pts + frame.duration : 0;
 
-                buffer_eof_ = (video_filter_.eof && audio_filter_.eof) || time > end;
+                buffer_eof_ = (chain_->video_filter.eof && chain_->audio_filter.eof) || time > end;
+
+                if (!loop_ || reverse_end_ != AV_NOPTS_VALUE || (preroll_ && preroll_start_ != start)) {
+                    preroll_.reset();
+                } else if (!preroll_ && !preroll_failed_ && !buffer_eof_ && frame_count_ > 2 &&
+                           (end != INT64_MAX ? time > end - PREROLL_DURATION : chain_->input.eof())) {
+                    begin_preroll(start);
+                }
+
+                if (buffer_eof_ && reverse_end_ != AV_NOPTS_VALUE) {
+                    buffer_eof_ = false;
+                    next_reverse();
+                    frame = Frame{};
+                    continue;
+                }
 
                 if (buffer_eof_) {
                     if (loop_ && frame_count_ > 2) {
                         frame = Frame{};
-                        seek_internal(start);
+                        if (preroll_) {
+                            end_preroll();
+                        } else {
+                            seek_internal(start);
+                        }
                     } else {
-                        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+                        // Until a seek, or a change of the loop, start or duration.
+                        wait_wakeup(seen);
                     }
-                    // TODO (fix) Limit live polling due to bugs.
                     continue;
                 }
             }
 
-            std::atomic<int> progress{schedule()};
+            auto progress = false;
+            core::execute_in_channel_arena(channel_, [&] {
+                progress = (*chain_)(audio_cadence[0]);
 
-            tbb::parallel_invoke(
-                [&] { tbb::parallel_for_each(decoders_, [&](auto& p) { progress.fetch_or(p.second()); }); },
-                [&] { progress.fetch_or(video_filter_()); },
-                [&] { progress.fetch_or(audio_filter_(audio_cadence[0])); });
+                if (preroll_ && !preroll_->ready()) {
+                    (*preroll_)(audio_cadence[0]);
+                }
+            });
 
-            if ((!video_filter_.frame && !video_filter_.eof) || (!audio_filter_.frame && !audio_filter_.eof)) {
+            if (!chain_->ready()) {
                 if (!progress) {
-                    if (warning_debounce++ % 500 == 100) {
-                        if (!video_filter_.frame && !video_filter_.eof) {
-                            CASPAR_LOG(warning) << print() << " Waiting for video frame...";
-                        } else if (!audio_filter_.frame && !audio_filter_.eof) {
-                            CASPAR_LOG(warning) << print() << " Waiting for audio frame...";
+                    if (!wait_wakeup(seen)) {
+                        if (!chain_->video_filter.frame && !chain_->video_filter.eof) {
+                            CASPAR_LOG_LIMITED(warning) << print() << " Waiting for video frame...";
+                        } else if (!chain_->audio_filter.frame && !chain_->audio_filter.eof) {
+                            CASPAR_LOG_LIMITED(warning) << print() << " Waiting for audio frame...";
                         } else {
-                            CASPAR_LOG(warning) << print() << " Waiting for frame...";
+                            CASPAR_LOG_LIMITED(warning) << print() << " Waiting for frame...";
                         }
                     }
 
-                    boost::this_thread::sleep_for(boost::chrono::milliseconds(warning_debounce > 25 ? 10 : 1));
                     frame_timer.restart();
                 }
                 continue;
             }
 
-            warning_debounce = 0;
-
             // TODO (fix)
             // if (start_ != AV_NOPTS_VALUE && frame.pts < start_) {
             //    seek_internal(start_);
             //    continue;
             //}
 
-            const auto start_time = input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0;
+            const auto start_time = chain_->input->start_time != AV_NOPTS_VALUE ? chain_->input->start_time : 0;
 
-            if (video_filter_.frame) {
-                frame.video      = std::move(video_filter_.frame);
-                const auto tb    = av_buffersink_get_time_base(video_filter_.sink);
-                const auto fr    = av_buffersink_get_frame_rate(video_filter_.sink);
+            if (chain_->video_filter.frame) {
+                frame.video      = std::move(chain_->video_filter.frame);
+                const auto tb    = av_buffersink_get_time_base(chain_->video_filter.sink);
+                const auto fr    = av_buffersink_get_frame_rate(chain_->video_filter.sink);
                 frame.start_time = start_time;
                 frame.pts        = av_rescale_q(frame.video->pts, tb, TIME_BASE_Q) - start_time;
                 frame.duration   = av_rescale_q(1, av_inv_q(fr), TIME_BASE_Q);
             }
 
-            if (audio_filter_.frame) {
-                frame.audio      = std::move(audio_filter_.frame);
-                const auto tb    = av_buffersink_get_time_base(audio_filter_.sink);
-                const auto sr    = av_buffersink_get_sample_rate(audio_filter_.sink);
+            if (chain_->alpha_filter.frame) {
+                frame.alpha = std::move(chain_->alpha_filter.frame);
+            }
+
+            if (chain_->audio_filter.frame) {
+                frame.audio      = std::move(chain_->audio_filter.frame);
+                const auto tb    = chain_->audio_filter.time_base();
+                const auto sr    = chain_->audio_filter.sample_rate();
                 frame.start_time = start_time;
                 frame.pts        = av_rescale_q(frame.audio->pts, tb, TIME_BASE_Q) - start_time;
                 frame.duration   = av_rescale_q(frame.audio->nb_samples, {1, sr}, TIME_BASE_Q);
             }
 
-            frame.frame = core::draw_frame(make_frame(this, *frame_factory_, frame.video, frame.audio));
+            decode_pts_ = frame.pts;
+
+            if (skip_pts_ != AV_NOPTS_VALUE) {
+                if (frame.pts < skip_pts_) {
+                    boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+                    continue;
+                }
+                skip_pts_ = AV_NOPTS_VALUE;
+            }
+
+            if (reverse_end_ != AV_NOPTS_VALUE && frame.pts >= reverse_end_) {
+                next_reverse();
+                frame = Frame{};
+                continue;
+            }
+
+            std::shared_ptr<AVFrame> key;
+            if (key_chain_ && frame.video) {
+                key = next_key(frame.pts);
+            }
+
+            core::execute_in_channel_arena(channel_, [&] {
+                if (gpu_deinterlace_) {
+                    frame.frame = make_field_frame(frame);
+                } else {
+                    frame.frame = core::draw_frame(
+                        make_frame(this, *frame_factory_, frame.video, frame.audio, format_desc_.audio_channels));
+                }
+                if (frame.alpha && frame.video) {
+                    frame.frame = core::draw_frame::mask(std::move(frame.frame), make_alpha_frame(frame));
+                }
+                if (key) {
+                    frame.frame = core::draw_frame::mask(std::move(frame.frame), make_key_frame(key));
+                }
+            });
 
-            graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+            graph_->set_value(frame_time_id_, frame_timer.elapsed() * format_desc_.fps * 0.5);
             frame_timer.restart();
 
+            {
+                boost::lock_guard<boost::mutex> lock(state_mutex_);
+                state_["file/input/bitrate"] = chain_->input.bitrate();
+                state_["file/input/stall"]   = chain_->input.stall_time();
+                state_["file/input/io-rate"] = chain_->input.io_rate();
+            }
+
+            if (reverse_end_ != AV_NOPTS_VALUE) {
+                reverse_frames_.push_back(frame);
+                if (reverse_frames_.size() > reverse_capacity_) {
+                    reverse_frames_.pop_front();
+                }
+                frame_count_ += 1;
+                boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+                continue;
+            }
+
+            std::size_t buffered = 0;
             {
                 boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_ || abort_request_; });
+                buffer_cond_.wait(buffer_lock, [&] { return !buffer_full() || abort_request_; });
                 if (seek_ == AV_NOPTS_VALUE) {
                     buffer_.push_back(frame);
                 }
+                buffered = buffer_.size();
+            }
+
+            {
+                boost::lock_guard<boost::mutex> lock(state_mutex_);
+                if (frame_count_ == 0) {
+                    state_["buffer/first-frame-time"] = load_timer_.elapsed();
+                }
+                state_["buffer/frames"] = {static_cast<int>(buffered), buffer_capacity_};
+                state_["buffer/ready"]  = static_cast<int>(buffered) >= buffer_capacity_;
             }
 
             frame_count_ += 1;
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+            graph_->set_value(buffer_id_, static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
 
             boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
         }
     }
 
+    void wake()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+            wakeups_ += 1;
+        }
+        buffer_cond_.notify_all();
+    }
+
+    std::uint64_t wakeups() const
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        return wakeups_;
+    }
+
+    // Sleeps until something has happened since seen. Gives up after a second, to warn that the decode is stuck and
+    // in case a change that isn't counted could let it go on, false then.
+    bool wait_wakeup(std::uint64_t seen)
+    {
+        boost::unique_lock<boost::mutex> lock(buffer_mutex_);
+        return buffer_cond_.wait_for(
+            lock, boost::chrono::seconds(1), [&] { return wakeups_ != seen || abort_request_; });
+    }
+
+    // Full at its capacity, or with the few frames that keep it playing while over the memory cap. A buffer that
+    // hasn't been taken from for a second, e.g. in the background, stops there as well under memory pressure.
+    // Called with buffer_mutex_ held.
+    bool buffer_full() const
+    {
+        const auto size = static_cast<int>(buffer_.size());
+        if (size >= buffer_capacity_) {
+            return true;
+        }
+        if (size < 2) {
+            return false;
+        }
+        return (memory_ && memory_->over_cap()) ||
+               (taken_timer_.elapsed() > 1.0 && core::diagnostics::memory_pressure());
+    }
+
+    // Ready once the buffer is full, or holds all that is left to play.
+    bool ready() const
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        return buffer_eof_ || buffer_full();
+    }
+
     void update_state()
     {
         graph_->set_text(u16(print()));
@@ -765,6 +1531,7 @@ struct AVProducer::Impl
         state_["file/clip"] = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
         state_["file/time"] = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
         state_["loop"]      = loop_;
+        state_["speed"]     = speed_.load();
     }
 
     core::draw_frame prev_frame()
@@ -791,6 +1558,20 @@ struct AVProducer::Impl
 
         boost::lock_guard<boost::mutex> lock(buffer_mutex_);
 
+        // Away from normal speed frames are shown for more than one tick or skipped, in either case without audio.
+        const auto speed = speed_.load();
+        if (std::abs(speed) != 1.0 && frame_ && !frame_flush_) {
+            phase_ += std::abs(speed);
+            if (phase_ < 1.0) {
+                return repeat_frame();
+            }
+            for (; phase_ >= 2.0 && buffer_.size() > 1; phase_ -= 1.0) {
+                pop_buffer();
+            }
+            // What is left is dropped if decoding can't keep up.
+            phase_ -= std::floor(phase_);
+        }
+
         if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4)) {
             auto start    = start_.load();
             auto duration = duration_.load();
@@ -799,14 +1580,16 @@ struct AVProducer::Impl
             auto end = duration != AV_NOPTS_VALUE ? start + duration : INT64_MAX;
 
             if (buffer_eof_ && !frame_flush_) {
-                if (frame_time_ < end && frame_duration_ != AV_NOPTS_VALUE) {
+                if (speed_ < 0.0) {
+                    // Held at the start.
+                } else if (frame_time_ < end && frame_duration_ != AV_NOPTS_VALUE) {
                     frame_time_ += frame_duration_;
                 } else if (frame_time_ < end) {
                     frame_time_ = input_duration_;
                 }
                 return core::draw_frame::still(frame_);
             }
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+            graph_->set_tag(diagnostics::tag_severity::WARNING, underflow_id_);
             latency_ += 1;
             return core::draw_frame{};
         }
@@ -820,27 +1603,102 @@ struct AVProducer::Impl
         frame_time_     = buffer_[0].pts;
         frame_duration_ = buffer_[0].duration;
         frame_flush_    = false;
+        taken_timer_.restart();
 
-        buffer_.pop_front();
+        pop_buffer();
+        wakeups_ += 1;
         buffer_cond_.notify_all();
 
-        graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+        graph_->set_value(buffer_id_, static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
 
-        return frame_;
+        return speed == 1.0 ? frame_ : core::draw_frame::still(frame_);
+    }
+
+    // The shown frame again in slow motion, with blend faded towards the next one by how far playback has come.
+    core::draw_frame repeat_frame() const
+    {
+        if (!blend_ || buffer_.empty()) {
+            return core::draw_frame::still(frame_);
+        }
+
+        auto next                                = core::draw_frame::push(buffer_[0].frame);
+        next.transform().image_transform.opacity = phase_;
+        next.transform().audio_transform.volume  = 0.0;
+
+        return core::draw_frame::over(core::draw_frame::still(frame_), std::move(next));
+    }
+
+    // Moves the next frame to the history, backwards frames aren't kept as they are buffered in reverse.
+    void pop_buffer()
+    {
+        if (speed_ < 0.0 || history_capacity_ == 0) {
+            history_.clear();
+        } else {
+            history_.push_back(std::move(buffer_.front()));
+            if (history_.size() > history_capacity_) {
+                history_.pop_front();
+            }
+        }
+        buffer_.pop_front();
     }
 
     void seek(int64_t time)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
-        seek_ = av_rescale_q(time, format_tb_, TIME_BASE_Q);
+        const auto pts = av_rescale_q(time, format_tb_, TIME_BASE_Q);
 
-        {
-            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
-            buffer_.clear();
-            buffer_cond_.notify_all();
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+
+        if (seek_cached(pts)) {
+            return;
         }
+
+        seek_ = pts;
+
+        buffer_.clear();
+        history_.clear();
+        wakeups_ += 1;
+        buffer_cond_.notify_all();
+        graph_->set_value(buffer_id_, static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+    }
+
+    // Short seeks to a frame in the history or the buffer are served from there while the decode goes on where it is.
+    bool seek_cached(int64_t pts)
+    {
+        if (speed_ < 0.0 || seek_ != AV_NOPTS_VALUE) {
+            return false;
+        }
+
+        const auto contains = [&](const Frame& frame) {
+            return frame.pts != AV_NOPTS_VALUE && frame.pts <= pts &&
+                   pts < frame.pts + std::max<int64_t>(frame.duration, 1);
+        };
+
+        auto hit = std::find_if(history_.begin(), history_.end(), contains);
+        if (hit != history_.end()) {
+            buffer_.insert(buffer_.begin(), hit, history_.end());
+            history_.erase(hit, history_.end());
+        } else {
+            auto next = std::find_if(buffer_.begin(), buffer_.end(), contains);
+            if (next == buffer_.end()) {
+                return false;
+            }
+            for (auto n = next - buffer_.begin(); n > 0; --n) {
+                pop_buffer();
+            }
+        }
+
+        frame_          = buffer_[0].frame;
+        frame_time_     = buffer_[0].pts;
+        frame_duration_ = buffer_[0].duration;
+        phase_          = 0.0;
+
+        wakeups_ += 1;
+        buffer_cond_.notify_all();
+        graph_->set_value(buffer_id_, static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+
+        return true;
     }
 
     int64_t time() const
@@ -858,14 +1716,41 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         loop_ = loop;
+        wake();
     }
 
     bool loop() const { return loop_; }
 
+    // Changing direction seeks to the frame shown, so that playback turns around there.
+    void speed(double speed, bool blend)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        const auto reverse = speed_.exchange(speed) < 0.0;
+        blend_             = blend;
+
+        if (reverse != (speed < 0.0)) {
+            {
+                // The buffer is in the order of the old direction.
+                boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+                buffer_.clear();
+                history_.clear();
+                phase_ = 0.0;
+            }
+            seek(time());
+        } else {
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+            phase_ = 0.0;
+        }
+    }
+
+    double speed() const { return speed_; }
+
     void start(int64_t start)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
         start_ = av_rescale_q(start, format_tb_, TIME_BASE_Q);
+        wake();
     }
 
     boost::optional<int64_t> start() const
@@ -879,6 +1764,7 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         duration_ = av_rescale_q(duration, format_tb_, TIME_BASE_Q);
+        wake();
     }
 
     boost::optional<int64_t> duration() const
@@ -897,116 +1783,337 @@ struct AVProducer::Impl
     }
 
   private:
-    bool want_packet()
+    // Playback keeps going without waiting for the buffer to fill again after seeks that don't flush.
+    void seek_internal(int64_t time, bool flush = true)
     {
-        return std::any_of(
-            decoders_.begin(), decoders_.end(), [](auto& p) { return p.second.input.size() < 2 && !p.second.eof; });
+        time = time != AV_NOPTS_VALUE ? time : 0;
+
+        preroll_failed_ = false;
+
+        const auto start_time = chain_->input->start_time != AV_NOPTS_VALUE ? chain_->input->start_time : 0;
+
+        if (flush) {
+            frame_flush_ = true;
+        }
+        frame_count_ = 0;
+        buffer_eof_  = false;
+
+        if (skip_to(time, start_time)) {
+            return;
+        }
+
+        seek_key(time);
+
+        time = time + start_time;
+
+        skip_pts_   = AV_NOPTS_VALUE;
+        decode_pts_ = AV_NOPTS_VALUE;
+
+        chain_->input.seek(time);
+
+        chain_->decoders.clear();
+
+        reset(*chain_, time);
     }
 
-    bool schedule()
+    int64_t clip_start() const
     {
-        auto result = false;
+        const auto start = start_.load();
+        return start != AV_NOPTS_VALUE ? start : 0;
+    }
 
-        std::shared_ptr<AVPacket> packet;
-        while (want_packet() && input_.try_pop(packet)) {
-            result = true;
+    int64_t clip_end() const
+    {
+        const auto duration = duration_.load();
+        if (duration != AV_NOPTS_VALUE) {
+            return clip_start() + duration;
+        }
+        return input_duration_.load();
+    }
 
-            if (!packet) {
-                for (auto& p : decoders_) {
-                    if (!p.second.eof) {
-                        p.second.input.push(nullptr);
-                    }
-                }
-            } else if (sources_.find(packet->stream_index) != sources_.end()) {
-                auto it = decoders_.find(packet->stream_index);
-                if (it != decoders_.end()) {
-                    // TODO (fix): limit it->second.input.size()?
-                    it->second.input.push(std::move(packet));
-                }
+    // Decodes the frames before end, from the last keyframe at least REVERSE_SPAN before it, so that the decode stays
+    // within about a gop.
+    void seek_reverse(int64_t end)
+    {
+        const auto start      = clip_start();
+        const auto start_time = chain_->input->start_time != AV_NOPTS_VALUE ? chain_->input->start_time : 0;
+
+        auto time = std::max(start, end - REVERSE_SPAN);
+        if (index_) {
+            if (auto keyframe = index_->find(time + start_time)) {
+                time = std::max(start, *keyframe - start_time);
             }
         }
 
-        std::vector<int> eof;
+        reverse_start_ = time;
+        reverse_end_   = end;
+        reverse_frames_.clear();
 
-        for (auto& p : sources_) {
-            auto it = decoders_.find(p.first);
-            if (it == decoders_.end() || !it->second.frame) {
-                continue;
-            }
+        seek_internal(time, false);
+    }
 
-            auto nb_requests = 0U;
-            for (auto source : p.second) {
-                nb_requests = std::max(nb_requests, av_buffersrc_get_nb_failed_requests(source));
-            }
+    // Buffers the decoded frames last first and goes on with the ones before them.
+    void next_reverse()
+    {
+        auto end = reverse_frames_.empty() ? reverse_start_ : reverse_frames_.front().pts;
+        if (end >= reverse_end_) {
+            end = reverse_start_;
+        }
 
-            if (nb_requests == 0) {
-                continue;
+        while (!reverse_frames_.empty()) {
+            boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
+            buffer_cond_.wait(buffer_lock, [&] { return !buffer_full() || abort_request_; });
+            if (abort_request_ || seek_ != AV_NOPTS_VALUE) {
+                reverse_frames_.clear();
+                return;
             }
+            buffer_.push_back(std::move(reverse_frames_.back()));
+            reverse_frames_.pop_back();
+        }
 
-            auto frame = std::move(it->second.frame);
+        if (end <= clip_start()) {
+            reverse_end_ = clip_start();
+            return;
+        }
 
-            for (auto& source : p.second) {
-                if (frame && !frame->data[0]) {
-                    FF(av_buffersrc_close(source, frame->pts, 0));
-                } else {
-                    // TODO (fix) Guard against overflow?
-                    FF(av_buffersrc_write_frame(source, frame.get()));
-                }
-                result = true;
-            }
+        seek_reverse(end);
+    }
 
-            // End Of File
-            if (!frame->data[0]) {
-                eof.push_back(p.first);
-            }
+    // Decoding forward is cheaper than seeking when there is no keyframe between the current position and time.
+    bool skip_to(int64_t time, int64_t start_time)
+    {
+        if (chain_->decoders.empty() || decode_pts_ == AV_NOPTS_VALUE || time <= decode_pts_ ||
+            chain_->video_filter.eof || chain_->audio_filter.eof) {
+            return false;
         }
 
-        for (auto index : eof) {
-            sources_.erase(index);
+        boost::optional<int64_t> keyframe;
+        if (index_) {
+            keyframe = index_->find(time + start_time);
+        }
+        if (keyframe ? *keyframe - start_time > decode_pts_ : time - decode_pts_ > AV_TIME_BASE / 2) {
+            return false;
+        }
+
+        skip_pts_ = time;
+        return true;
+    }
+
+    core::field_mode field_mode(const AVFrame& video, bool second_field) const
+    {
+        if (!video.interlaced_frame && deinterlace_ != "all") {
+            return core::field_mode::progressive;
+        }
+
+        const auto upper = video.top_field_first || !video.interlaced_frame;
+        return upper != second_field ? core::field_mode::upper : core::field_mode::lower;
+    }
+
+    core::draw_frame make_field_frame(const Frame& frame)
+    {
+        if (!frame.video) {
+            return core::draw_frame(
+                make_frame(this, *frame_factory_, nullptr, frame.audio, format_desc_.audio_channels));
+        }
+
+        const auto second_field = field_video_ && field_video_->data[0] == frame.video->data[0];
+
+        core::draw_frame result;
+        if (second_field && field_frame_) {
+            // Show the other field of the frame that is already uploaded, the audio is new.
+            auto video = core::draw_frame::still(core::draw_frame(field_frame_));
+            video.transform().image_transform.field_mode = field_mode(*frame.video, true);
+
+            auto audio = core::draw_frame(
+                make_frame(this, *frame_factory_, nullptr, frame.audio, format_desc_.audio_channels));
+
+            result = core::draw_frame(std::vector<core::draw_frame>{std::move(video), std::move(audio)});
+        } else {
+            field_frame_ = core::const_frame(
+                make_frame(this, *frame_factory_, frame.video, frame.audio, format_desc_.audio_channels));
+
+            result = core::draw_frame(field_frame_);
+            result.transform().image_transform.field_mode = field_mode(*frame.video, false);
         }
 
+        field_video_ = frame.video;
         return result;
     }
 
-    void seek_internal(int64_t time)
+    void begin_preroll(int64_t start)
     {
-        time = time != AV_NOPTS_VALUE ? time : 0;
-        time = time + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+        try {
+            auto chain = std::make_unique<Chain>(path_, graph_, [this] { wake(); });
+            chain->input.reset();
+
+            const auto time = start + (chain->input->start_time != AV_NOPTS_VALUE ? chain->input->start_time : 0);
+            if (start != 0) {
+                chain->input.seek(time);
+            }
+            reset(*chain, time);
+
+            preroll_       = std::move(chain);
+            preroll_start_ = start;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << print() << " Failed to preroll loop, seeking instead.";
+            preroll_failed_ = true;
+        }
+    }
+
+    // Continues with the prerolled pass, the frames of the current pass are still in the buffer.
+    void end_preroll()
+    {
+        chain_ = std::move(preroll_);
 
-        // TODO (fix) Dont seek if time is close future.
-        input_.seek(time);
-        frame_flush_ = true;
         frame_count_ = 0;
         buffer_eof_  = false;
+        decode_pts_  = AV_NOPTS_VALUE;
+        skip_pts_    = AV_NOPTS_VALUE;
+
+        seek_key(preroll_start_);
+    }
+
+    // The key starts over with the fill, only a short skip forward decodes past the frames in between instead.
+    void seek_key(int64_t time)
+    {
+        if (!key_chain_) {
+            return;
+        }
+
+        const auto start_time = key_chain_->input->start_time != AV_NOPTS_VALUE ? key_chain_->input->start_time : 0;
 
-        decoders_.clear();
+        key_chain_->input.seek(time + start_time);
+        key_chain_->decoders.clear();
+        key_video_.reset();
 
-        reset(time);
+        reset(*key_chain_, time + start_time, true);
     }
 
-    void reset(int64_t start_time)
+    // Decodes the key up to the fill frame at pts. A key that is shorter than the fill, or starts later, holds its
+    // last frame.
+    std::shared_ptr<AVFrame> next_key(int64_t pts)
     {
-        video_filter_ = Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_);
-        audio_filter_ = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+        auto&      filter     = key_chain_->video_filter;
+        const auto start_time = key_chain_->input->start_time != AV_NOPTS_VALUE ? key_chain_->input->start_time : 0;
+
+        while (!abort_request_ && seek_ == AV_NOPTS_VALUE) {
+            if (filter.frame) {
+                const auto tb      = av_buffersink_get_time_base(filter.sink);
+                const auto key_pts = av_rescale_q(filter.frame->pts, tb, TIME_BASE_Q) - start_time;
+                if (key_pts > pts && key_video_) {
+                    break;
+                }
+                key_video_ = std::move(filter.frame);
+                if (key_pts >= pts) {
+                    break;
+                }
+            } else if (filter.eof) {
+                break;
+            } else {
+                const auto seen     = wakeups();
+                auto       progress = false;
+                core::execute_in_channel_arena(channel_, [&] { progress = (*key_chain_)(-1); });
+                if (!progress) {
+                    wait_wakeup(seen);
+                }
+            }
+        }
+
+        return key_video_;
+    }
+
+    // Reused while the fps filter repeats the alpha, which with gpu deinterlacing shows the same field as the fill.
+    core::draw_frame make_alpha_frame(const Frame& frame)
+    {
+        const auto repeat = alpha_shown_ && alpha_shown_->data[0] == frame.alpha->data[0];
+        if (!repeat || !alpha_frame_) {
+            alpha_frame_ =
+                core::const_frame(make_frame(this, *frame_factory_, frame.alpha, nullptr, format_desc_.audio_channels));
+        }
+        alpha_shown_ = frame.alpha;
+
+        auto result = core::draw_frame(alpha_frame_);
+        if (gpu_deinterlace_) {
+            result.transform().image_transform.field_mode = field_mode(*frame.alpha, repeat);
+        }
+        return result;
+    }
 
-        sources_.clear();
-        for (auto& p : video_filter_.sources) {
-            sources_[p.first].push_back(p.second);
+    core::draw_frame make_key_frame(const std::shared_ptr<AVFrame>& key)
+    {
+        if (!key_frame_ || key_shown_->data[0] != key->data[0]) {
+            key_frame_ =
+                core::const_frame(make_frame(this, *frame_factory_, key, nullptr, format_desc_.audio_channels));
         }
-        for (auto& p : audio_filter_.sources) {
-            sources_[p.first].push_back(p.second);
+        key_shown_ = key;
+        return core::draw_frame(key_frame_);
+    }
+
+    // The key is decoded without hwaccel or audio, and converted to luma so that it uploads as a single plane.
+    void reset(Chain& chain, int64_t start_time, bool key = false)
+    {
+        DecoderOptions decoder_options;
+        decoder_options.frame_factory = frame_factory_.get();
+        decoder_options.hwaccel       = key ? "" : hwaccel_;
+        {
+            // Producers that haven't been shown for a second are in the background, the key is decoded alongside.
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+            decoder_options.background = key || taken_timer_.elapsed() > 1.0;
+        }
+
+        const auto vfilter = key ? (vfilter_.empty() ? "" : vfilter_ + ",") + "format=gray" : vfilter_;
+
+        chain.video_filter = Filter(
+            vfilter, chain.input, chain.decoders, start_time, AVMEDIA_TYPE_VIDEO, format_desc_, decoder_options);
+        chain.audio_filter =
+            key ? Filter{}
+                : Filter(afilter_, chain.input, chain.decoders, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+
+        // The alpha is decoded like the key, to luma and in software, with the filters of the fill.
+        if (chain.video_filter.alpha_index >= 0) {
+            DecoderOptions alpha_options;
+            alpha_options.frame_factory = frame_factory_.get();
+            alpha_options.background    = decoder_options.background;
+
+            chain.alpha_filter = Filter((vfilter_.empty() ? "" : vfilter_ + ",") + "format=gray",
+                                        chain.input,
+                                        chain.decoders,
+                                        start_time,
+                                        AVMEDIA_TYPE_VIDEO,
+                                        format_desc_,
+                                        alpha_options,
+                                        chain.video_filter.alpha_index);
+        } else {
+            chain.alpha_filter = Filter{};
+        }
+
+        chain.sources.clear();
+        for (auto& p : chain.video_filter.sources) {
+            chain.sources[p.first].push_back(p.second);
+        }
+        for (auto& p : chain.audio_filter.sources) {
+            chain.sources[p.first].push_back(p.second);
+        }
+        for (auto& p : chain.alpha_filter.sources) {
+            chain.sources[p.first].push_back(p.second);
+        }
+        if (chain.audio_filter.interleaver) {
+            for (auto& track : chain.audio_filter.interleaver->tracks) {
+                chain.sources[track.index];
+            }
         }
 
         std::vector<int> keys;
         // Flush unused inputs.
-        for (auto& p : decoders_) {
-            if (sources_.find(p.first) == sources_.end()) {
+        for (auto& p : chain.decoders) {
+            if (chain.sources.find(p.first) == chain.sources.end()) {
                 keys.push_back(p.first);
             }
         }
 
         for (auto& key : keys) {
-            decoders_.erase(key);
+            chain.decoders.erase(key);
         }
     }
 
@@ -1029,7 +2136,9 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                        boost::optional<std::string>         afilter,
                        boost::optional<int64_t>             start,
                        boost::optional<int64_t>             duration,
-                       boost::optional<bool>                loop)
+                       boost::optional<bool>                loop,
+                       boost::optional<std::string>         hwaccel,
+                       boost::optional<std::string>         key)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -1038,7 +2147,9 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(afilter.get_value_or("")),
                      std::move(start),
                      std::move(duration),
-                     std::move(loop.get_value_or(false))))
+                     std::move(loop.get_value_or(false)),
+                     std::move(hwaccel.get_value_or("")),
+                     std::move(key.get_value_or(""))))
 {
 }
 
@@ -1046,6 +2157,8 @@ core::draw_frame AVProducer::next_frame() { return impl_->next_frame(); }
 
 core::draw_frame AVProducer::prev_frame() { return impl_->prev_frame(); }
 
+bool AVProducer::ready() const { return impl_->ready(); }
+
 AVProducer& AVProducer::seek(int64_t time)
 {
     impl_->seek(time);
@@ -1060,6 +2173,14 @@ AVProducer& AVProducer::loop(bool loop)
 
 bool AVProducer::loop() const { return impl_->loop(); }
 
+AVProducer& AVProducer::speed(double speed, bool blend)
+{
+    impl_->speed(speed, blend);
+    return *this;
+}
+
+double AVProducer::speed() const { return impl_->speed(); }
+
 AVProducer& AVProducer::start(int64_t start)
 {
     impl_->start(start);
@@ -11,6 +11,8 @@
 
 namespace caspar { namespace ffmpeg {
 
+// Decodes path in the background. With a key file, e.g. the _A file of a separated fill and key, the key is decoded
+// as luma by the same thread in step with the fill, and every frame of the fill is masked with its key.
 class AVProducer
 {
   public:
@@ -22,17 +24,27 @@ class AVProducer
                boost::optional<std::string>         afilter,
                boost::optional<int64_t>             start,
                boost::optional<int64_t>             duration,
-               boost::optional<bool>                loop);
+               boost::optional<bool>                loop,
+               boost::optional<std::string>         hwaccel = boost::none,
+               boost::optional<std::string>         key     = boost::none);
 
     core::draw_frame prev_frame();
     core::draw_frame next_frame();
 
+    // Whether next_frame can be called without underflowing, may be called from any thread.
+    bool ready() const;
+
     AVProducer& seek(int64_t time);
     int64_t     time() const;
 
     AVProducer& loop(bool loop);
     bool        loop() const;
 
+    // Plays at speed, backwards if it is negative, by decoding a gop at a time and playing its frames last first. Slow
+    // motion repeats frames, or with blend fades each into the next, and audio is only played at normal speed.
+    AVProducer& speed(double speed, bool blend = false);
+    double      speed() const;
+
     AVProducer& start(int64_t start);
     int64_t     start() const;
 
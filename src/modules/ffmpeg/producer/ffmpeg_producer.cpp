@@ -24,6 +24,7 @@
 #include "ffmpeg_producer.h"
 
 #include "av_producer.h"
+#include "hap_producer.h"
 
 #include <common/env.h>
 #include <common/os/filesystem.h>
@@ -39,6 +40,10 @@
 #include <boost/logic/tribool.hpp>
 
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 
 #pragma warning(push, 1)
 
@@ -54,13 +59,113 @@ namespace caspar { namespace ffmpeg {
 
 using namespace std::chrono_literals;
 
+// A decode shared by the producers playing the same timeline, e.g. fill and key or multiview copies. Every
+// producer keeps its own position and reads the frames of the shared decode from a short history.
+class shared_decode
+{
+    static const int64_t history_size = 8;
+
+    const std::shared_ptr<AVProducer> producer_;
+
+    mutable std::mutex           mutex_;
+    std::deque<core::draw_frame> frames_;
+    int64_t                      count_  = 0;
+    bool                         closed_ = false;
+
+  public:
+    explicit shared_decode(std::shared_ptr<AVProducer> producer)
+        : producer_(std::move(producer))
+    {
+    }
+
+    const std::shared_ptr<AVProducer>& producer() const { return producer_; }
+
+    // Producers can only join while the first frame is in the history, so that they start from the beginning.
+    bool joinable() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !closed_ && count_ < history_size;
+    }
+
+    // Called when a producer takes over the timeline, e.g. to seek, from then on it no longer matches new producers.
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+
+    core::draw_frame next_frame(int64_t& position)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (position >= count_) {
+            auto frame = producer_->next_frame();
+            if (!frame) {
+                return frame;
+            }
+
+            frames_.push_back(std::move(frame));
+            count_ += 1;
+
+            if (static_cast<int64_t>(frames_.size()) > history_size) {
+                frames_.pop_front();
+            }
+        }
+
+        const auto first = count_ - static_cast<int64_t>(frames_.size());
+        position         = std::max(position, first);
+
+        return frames_[position++ - first];
+    }
+
+    core::draw_frame last_frame(int64_t position)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto first = count_ - static_cast<int64_t>(frames_.size());
+        if (position > first && position <= count_) {
+            return core::draw_frame::still(frames_[position - 1 - first]);
+        }
+
+        return producer_->prev_frame();
+    }
+};
+
+std::shared_ptr<shared_decode> get_shared_decode(const std::wstring&                                key,
+                                                 const std::function<std::shared_ptr<AVProducer>()>& factory)
+{
+    static std::mutex                                           mutex;
+    static std::map<std::wstring, std::weak_ptr<shared_decode>> decodes;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto it = decodes.begin(); it != decodes.end();) {
+        it = it->second.expired() ? decodes.erase(it) : std::next(it);
+    }
+
+    auto decode = decodes[key].lock();
+    if (!decode || !decode->joinable()) {
+        decode       = std::make_shared<shared_decode>(factory());
+        decodes[key] = decode;
+    }
+
+    return decode;
+}
+
 struct ffmpeg_producer : public core::frame_producer
 {
+    const std::wstring                   name_;
     const std::wstring                   filename_;
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
+    const std::wstring                   vfilter_;
+    const std::wstring                   afilter_;
+    const std::wstring                   hwaccel_;
+    const std::wstring                   key_;
 
-    std::shared_ptr<AVProducer> producer_;
+    std::shared_ptr<shared_decode> decode_;
+    int64_t                        position_ = 0;
+    std::shared_ptr<AVProducer>    producer_;
 
   public:
     explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory> frame_factory,
@@ -71,27 +176,38 @@ struct ffmpeg_producer : public core::frame_producer
                              std::wstring                         afilter,
                              boost::optional<int64_t>             start,
                              boost::optional<int64_t>             duration,
-                             boost::optional<bool>                loop)
-        : filename_(filename)
+                             boost::optional<bool>                loop,
+                             std::wstring                         hwaccel,
+                             std::wstring                         key)
+        : name_(path)
+        , filename_(filename)
         , frame_factory_(frame_factory)
         , format_desc_(format_desc)
-        , producer_(new AVProducer(frame_factory_,
-                                   format_desc_,
-                                   u8(path),
-                                   u8(filename),
-                                   u8(vfilter),
-                                   u8(afilter),
-                                   start,
-                                   duration,
-                                   loop))
+        , vfilter_(vfilter)
+        , afilter_(afilter)
+        , hwaccel_(hwaccel)
+        , key_(key)
     {
+        auto factory = [&] { return make_producer(start, duration, loop); };
+
+        if (env::properties().get(L"configuration.ffmpeg.producer.shared-decode", true)) {
+            auto key = filename_ + L"|" + key_ + L"|" + vfilter_ + L"|" + afilter_ + L"|" + hwaccel_ + L"|" +
+                       format_desc_.name + L"|" + std::to_wstring(start.get_value_or(-1)) + L"|" +
+                       std::to_wstring(duration.get_value_or(-1)) + L"|" + std::to_wstring(loop.get_value_or(false));
+
+            decode_   = get_shared_decode(key, factory);
+            producer_ = decode_->producer();
+        } else {
+            producer_ = factory();
+        }
     }
 
     ~ffmpeg_producer()
     {
-        std::thread([producer = std::move(producer_)]() mutable {
+        std::thread([producer = std::move(producer_), decode = std::move(decode_)]() mutable {
             try {
                 producer.reset();
+                decode.reset();
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
@@ -99,11 +215,61 @@ struct ffmpeg_producer : public core::frame_producer
             .detach();
     }
 
+    std::shared_ptr<AVProducer>
+    make_producer(boost::optional<int64_t> start, boost::optional<int64_t> duration, boost::optional<bool> loop)
+    {
+        return std::make_shared<AVProducer>(frame_factory_,
+                                            format_desc_,
+                                            u8(name_),
+                                            u8(filename_),
+                                            u8(vfilter_),
+                                            u8(afilter_),
+                                            start,
+                                            duration,
+                                            loop,
+                                            u8(hwaccel_),
+                                            key_.empty() ? boost::optional<std::string>() : u8(key_));
+    }
+
+    // Stops sharing the decode before this producer changes its timeline, the others keep playing undisturbed.
+    void detach()
+    {
+        if (!decode_) {
+            return;
+        }
+
+        decode_->close();
+
+        if (decode_.use_count() > 1) {
+            const auto duration = producer_->duration();
+
+            auto producer = make_producer(producer_->start(),
+                                          duration != std::numeric_limits<int64_t>::max()
+                                              ? boost::optional<int64_t>(duration)
+                                              : boost::optional<int64_t>(),
+                                          producer_->loop());
+            producer->seek(producer_->time());
+            producer_ = std::move(producer);
+        }
+
+        decode_.reset();
+    }
+
     // frame_producer
 
-    core::draw_frame last_frame() override { return producer_->prev_frame(); }
+    core::draw_frame last_frame() override
+    {
+        return decode_ ? decode_->last_frame(position_) : producer_->prev_frame();
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        return decode_ ? decode_->next_frame(position_) : producer_->next_frame();
+    }
+
+    bool ready() const override { return producer_->ready(); }
 
-    core::draw_frame receive_impl(int nb_samples) override { return producer_->next_frame(); }
+    bool has_key() const override { return !key_.empty(); }
 
     std::uint32_t frame_number() const override
     {
@@ -126,12 +292,26 @@ struct ffmpeg_producer : public core::frame_producer
             value = params.at(1);
         }
 
+        if (!value.empty()) {
+            detach();
+        }
+
         if (boost::iequals(cmd, L"loop")) {
             if (!value.empty()) {
                 producer_->loop(boost::lexical_cast<bool>(value));
             }
 
             result = std::to_wstring(producer_->loop());
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                const auto speed = boost::lexical_cast<double>(value);
+                if (speed < -1.0 || speed > 4.0) {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"SPEED must be between -1 and 4"));
+                }
+                producer_->speed(speed, params.size() > 2 && boost::iequals(params.at(2), L"blend"));
+            }
+
+            result = boost::lexical_cast<std::wstring>(producer_->speed());
         } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
             if (!value.empty()) {
                 producer_->start(boost::lexical_cast<int64_t>(value));
@@ -291,18 +471,27 @@ bool is_valid_file(const std::wstring& filename)
 
 std::wstring probe_stem(const std::wstring& stem)
 {
-    auto stem2  = boost::filesystem::path(stem);
-    auto parent = find_case_insensitive(stem2.parent_path().wstring());
-
-    if (!parent)
-        return L"";
+    for (auto& file : find_stem_case_insensitive(stem)) {
+        if (is_valid_file(file))
+            return file;
+    }
+    return L"";
+}
 
-    auto dir = boost::filesystem::path(*parent);
+// The key of a separated fill and key pair, as looked up by the producer registry.
+std::wstring find_key_file(const std::wstring& name)
+{
+    for (auto suffix : {L"_A", L"_ALPHA"}) {
+        auto mediaPath     = env::media_folder() + L"/" + name + suffix;
+        auto fullMediaPath = find_case_insensitive(mediaPath);
+        if (fullMediaPath && is_valid_file(*fullMediaPath)) {
+            return *fullMediaPath;
+        }
 
-    for (auto it = boost::filesystem::directory_iterator(dir); it != boost::filesystem::directory_iterator(); ++it) {
-        if (boost::iequals(it->path().stem().wstring(), stem2.filename().wstring()) &&
-            is_valid_file(it->path().wstring()))
-            return it->path().wstring();
+        auto path = probe_stem(mediaPath);
+        if (!path.empty()) {
+            return boost::filesystem::path(path).generic_wstring();
+        }
     }
     return L"";
 }
@@ -363,9 +552,40 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto vfilter = boost::to_lower_copy(get_param(L"VF", params, filter_str));
     auto afilter = boost::to_lower_copy(get_param(L"AF", params, get_param(L"FILTER", params, L"")));
 
+    auto hwaccel = boost::to_lower_copy(get_param(
+        L"HWACCEL", params, env::properties().get(L"configuration.ffmpeg.producer.hwaccel", std::wstring(L"none"))));
+    if (hwaccel == L"none") {
+        hwaccel.clear();
+    }
+
+    std::wstring key;
+    if (!boost::contains(params.at(0), L"://") &&
+        env::properties().get(L"configuration.ffmpeg.producer.separated-key", true)) {
+        key = find_key_file(params.at(0));
+    }
+
+    // HAP frames don't have to be decoded on the cpu, unless they are filtered.
+    if (vfilter.empty() && key.empty() && !boost::contains(path, L"://") &&
+        env::properties().get(L"configuration.ffmpeg.producer.hap", true)) {
+        auto producer =
+            create_hap_producer(dependencies.frame_factory, dependencies.format_desc, name, path, in, out, loop);
+        if (producer != core::frame_producer::empty()) {
+            return producer;
+        }
+    }
+
     try {
-        auto producer = spl::make_shared<ffmpeg_producer>(
-            dependencies.frame_factory, dependencies.format_desc, name, path, vfilter, afilter, start, duration, loop);
+        auto producer = spl::make_shared<ffmpeg_producer>(dependencies.frame_factory,
+                                                          dependencies.format_desc,
+                                                          name,
+                                                          path,
+                                                          vfilter,
+                                                          afilter,
+                                                          start,
+                                                          duration,
+                                                          loop,
+                                                          hwaccel,
+                                                          key);
         return core::create_destroy_proxy(std::move(producer));
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
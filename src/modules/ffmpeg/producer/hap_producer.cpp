@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "hap_producer.h"
+
+#include "../util/av_assert.h"
+#include "../util/snappy.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Frames decompressed ahead of the one being played.
+const std::size_t BUFFER_SIZE = 4;
+
+// The top four bits of a texture section type are the compressor, the bottom four the texture format.
+const int HAP_COMPRESSOR_NONE    = 0xA0;
+const int HAP_COMPRESSOR_SNAPPY  = 0xB0;
+const int HAP_COMPRESSOR_COMPLEX = 0xC0;
+
+// Sections of the decode instructions of a texture split into chunks by the complex compressor.
+const int HAP_DECODE_INSTRUCTIONS = 0x01;
+const int HAP_COMPRESSOR_TABLE    = 0x02;
+const int HAP_SIZE_TABLE          = 0x03;
+const int HAP_OFFSET_TABLE        = 0x04;
+
+std::uint32_t read_le32(const std::uint8_t* ptr)
+{
+    return static_cast<std::uint32_t>(ptr[0]) | static_cast<std::uint32_t>(ptr[1]) << 8 |
+           static_cast<std::uint32_t>(ptr[2]) << 16 | static_cast<std::uint32_t>(ptr[3]) << 24;
+}
+
+struct section
+{
+    const std::uint8_t* data = nullptr;
+    std::size_t         size = 0;
+    int                 type = 0;
+};
+
+// A section starts with a 24 bit size and its type, or with a zero size followed by a 32 bit size.
+bool read_section(const std::uint8_t*& ptr, const std::uint8_t* end, section& result)
+{
+    if (end - ptr < 4) {
+        return false;
+    }
+    std::size_t size = ptr[0] | ptr[1] << 8 | ptr[2] << 16;
+    result.type      = ptr[3];
+    ptr += 4;
+
+    if (size == 0) {
+        if (end - ptr < 4) {
+            return false;
+        }
+        size = read_le32(ptr);
+        ptr += 4;
+    }
+    if (static_cast<std::size_t>(end - ptr) < size) {
+        return false;
+    }
+
+    result.data = ptr;
+    result.size = size;
+    ptr += size;
+    return true;
+}
+
+core::pixel_format get_format(int type)
+{
+    switch (type & 0x0F) {
+        case 0x0B:
+            return core::pixel_format::dxt1;
+        case 0x0E:
+            return core::pixel_format::dxt5;
+        case 0x0F:
+            return core::pixel_format::ycocg_dxt5;
+        default:
+            return core::pixel_format::invalid;
+    }
+}
+
+struct chunk
+{
+    int                 compressor = HAP_COMPRESSOR_NONE;
+    const std::uint8_t* src        = nullptr;
+    std::size_t         src_size   = 0;
+    std::size_t         offset     = 0;
+    std::size_t         length     = 0;
+};
+
+bool read_chunks(const section& texture, std::vector<chunk>& chunks)
+{
+    auto ptr = texture.data;
+    auto end = texture.data + texture.size;
+
+    section instructions;
+    if (!read_section(ptr, end, instructions) || instructions.type != HAP_DECODE_INSTRUCTIONS) {
+        return false;
+    }
+
+    std::vector<int>         compressors;
+    std::vector<std::size_t> sizes;
+    std::vector<std::size_t> offsets;
+
+    auto table     = instructions.data;
+    auto table_end = instructions.data + instructions.size;
+    while (table < table_end) {
+        section entry;
+        if (!read_section(table, table_end, entry)) {
+            return false;
+        }
+        if (entry.type == HAP_COMPRESSOR_TABLE) {
+            for (std::size_t n = 0; n < entry.size; ++n) {
+                compressors.push_back(entry.data[n] << 4);
+            }
+        } else if (entry.type == HAP_SIZE_TABLE) {
+            for (std::size_t n = 0; n + 4 <= entry.size; n += 4) {
+                sizes.push_back(read_le32(entry.data + n));
+            }
+        } else if (entry.type == HAP_OFFSET_TABLE) {
+            for (std::size_t n = 0; n + 4 <= entry.size; n += 4) {
+                offsets.push_back(read_le32(entry.data + n));
+            }
+        }
+    }
+
+    if (compressors.empty() || compressors.size() != sizes.size() ||
+        (!offsets.empty() && offsets.size() != sizes.size())) {
+        return false;
+    }
+
+    // Without an offset table the chunks follow each other after the instructions.
+    std::size_t src_offset = 0;
+    for (std::size_t n = 0; n < sizes.size(); ++n) {
+        chunk chunk;
+        chunk.compressor = compressors[n];
+        chunk.src_size   = sizes[n];
+        const auto start = offsets.empty() ? src_offset : offsets[n];
+        const auto available = static_cast<std::size_t>(end - ptr);
+        if (start > available || chunk.src_size > available - start) {
+            return false;
+        }
+        chunk.src = ptr + start;
+        src_offset += chunk.src_size;
+        chunks.push_back(chunk);
+    }
+    return true;
+}
+
+// Decompresses the texture of a frame, whose blocks have to fill the length bytes at dst.
+bool decode_texture(const std::uint8_t* src,
+                    std::size_t         size,
+                    core::pixel_format  format,
+                    std::uint8_t*       dst,
+                    std::size_t         length)
+{
+    section texture;
+    if (!read_section(src, src + size, texture) || get_format(texture.type) != format) {
+        return false;
+    }
+
+    std::vector<chunk> chunks;
+    const auto         compressor = texture.type & 0xF0;
+    if (compressor == HAP_COMPRESSOR_COMPLEX) {
+        if (!read_chunks(texture, chunks)) {
+            return false;
+        }
+    } else {
+        chunk chunk;
+        chunk.compressor = compressor;
+        chunk.src        = texture.data;
+        chunk.src_size   = texture.size;
+        chunks.push_back(chunk);
+    }
+
+    std::size_t offset = 0;
+    for (auto& chunk : chunks) {
+        if (chunk.compressor == HAP_COMPRESSOR_SNAPPY) {
+            if (!snappy_uncompressed_length(chunk.src, chunk.src_size, chunk.length)) {
+                return false;
+            }
+        } else if (chunk.compressor == HAP_COMPRESSOR_NONE) {
+            chunk.length = chunk.src_size;
+        } else {
+            return false;
+        }
+        chunk.offset = offset;
+        offset += chunk.length;
+    }
+    if (offset != length) {
+        return false;
+    }
+
+    // Encoders split large frames into chunks so that they can be decompressed in parallel.
+    std::atomic<bool> ok{true};
+    tbb::parallel_for(std::size_t(0), chunks.size(), [&](std::size_t n) {
+        const auto& chunk = chunks[n];
+        if (chunk.compressor == HAP_COMPRESSOR_SNAPPY) {
+            if (!snappy_uncompress(chunk.src, chunk.src_size, dst + chunk.offset, chunk.length)) {
+                ok = false;
+            }
+        } else {
+            std::memcpy(dst + chunk.offset, chunk.src, chunk.length);
+        }
+    });
+    return ok;
+}
+
+std::shared_ptr<AVFormatContext> open_input(const std::string& filename)
+{
+    AVFormatContext* ic = nullptr;
+    FF(avformat_open_input(&ic, filename.c_str(), nullptr, nullptr));
+    auto result = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ptr) { avformat_close_input(&ptr); });
+    FF(avformat_find_stream_info(ic, nullptr));
+    return result;
+}
+
+} // namespace
+
+struct hap_producer : public core::frame_producer
+{
+    core::monitor::state                       state_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::wstring                         name_;
+    const std::wstring                         path_;
+    const std::shared_ptr<AVFormatContext>     ic_;
+    const std::vector<AVIndexEntry>            entries_;
+    const core::pixel_format_desc              desc_;
+    const double                               fps_;
+    const int64_t                              in_;
+    const int64_t                              out_;
+
+    std::vector<std::uint8_t> packet_;
+
+    mutable std::mutex                               mutex_;
+    std::condition_variable                          cond_;
+    std::deque<std::pair<int64_t, core::draw_frame>> buffer_;
+    int64_t                                          next_;
+    int64_t                                          position_;
+    int64_t                                          generation_ = 0;
+    bool                                             loop_;
+    core::draw_frame                                 frame_;
+
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+
+    hap_producer(spl::shared_ptr<core::frame_factory> frame_factory,
+                 std::wstring                         name,
+                 std::wstring                         path,
+                 std::shared_ptr<AVFormatContext>     ic,
+                 std::vector<AVIndexEntry>            entries,
+                 core::pixel_format_desc              desc,
+                 double                               fps,
+                 int64_t                              in,
+                 int64_t                              out,
+                 bool                                 loop)
+        : frame_factory_(std::move(frame_factory))
+        , name_(std::move(name))
+        , path_(std::move(path))
+        , ic_(std::move(ic))
+        , entries_(std::move(entries))
+        , desc_(std::move(desc))
+        , fps_(fps)
+        , in_(in)
+        , out_(out)
+        , next_(in)
+        , position_(in)
+        , loop_(loop)
+    {
+        thread_ = std::thread([this] {
+            set_thread_name(L"[ffmpeg::hap_producer]");
+            run();
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    ~hap_producer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    core::draw_frame read_frame(int64_t index)
+    {
+        const auto& entry = entries_[index];
+
+        packet_.resize(static_cast<std::size_t>(entry.size));
+        if (avio_seek(ic_->pb, entry.pos, SEEK_SET) < 0 ||
+            avio_read(ic_->pb, packet_.data(), entry.size) != entry.size) {
+            CASPAR_THROW_EXCEPTION(file_read_error() << msg_info("Failed to read frame " + std::to_string(index)));
+        }
+
+        auto  frame = frame_factory_->create_frame(this, desc_);
+        auto& data  = frame.image_data(0);
+        if (!decode_texture(packet_.data(), packet_.size(), desc_.format, data.data(), data.size())) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << msg_info("Invalid HAP frame " + std::to_string(index)));
+        }
+
+        return core::draw_frame(std::move(frame));
+    }
+
+    void run()
+    {
+        while (true) {
+            int64_t index;
+            int64_t generation;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] {
+                    return abort_request_ || (buffer_.size() < BUFFER_SIZE && (next_ < out_ || loop_));
+                });
+                if (abort_request_) {
+                    return;
+                }
+                if (next_ >= out_) {
+                    next_ = in_;
+                }
+                index      = next_++;
+                generation = generation_;
+            }
+
+            core::draw_frame frame;
+            try {
+                frame = read_frame(index);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (generation == generation_) {
+                    buffer_.emplace_back(index, std::move(frame));
+                }
+            }
+            cond_.notify_all();
+        }
+    }
+
+    void seek(int64_t frame)
+    {
+        next_     = std::min(std::max(in_ + frame, in_), out_ - 1);
+        position_ = next_;
+        buffer_.clear();
+        generation_ += 1;
+        cond_.notify_all();
+    }
+
+    void update_state()
+    {
+        state_["file/name"] = u8(name_);
+        state_["file/path"] = u8(path_);
+        state_["file/time"] = {position_ / fps_, static_cast<double>(entries_.size()) / fps_};
+        state_["file/clip"] = {in_ / fps_, (out_ - in_) / fps_};
+        state_["loop"]      = loop_;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!buffer_.empty()) {
+            position_ = buffer_.front().first;
+            if (buffer_.front().second) {
+                frame_ = std::move(buffer_.front().second);
+            }
+            buffer_.pop_front();
+            cond_.notify_all();
+        }
+
+        update_state();
+
+        return frame_;
+    }
+
+    bool ready() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !buffer_.empty() || (next_ >= out_ && !loop_);
+    }
+
+    std::uint32_t frame_number() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<std::uint32_t>(position_ - in_);
+    }
+
+    std::uint32_t nb_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loop_ ? std::numeric_limits<std::uint32_t>::max() : static_cast<std::uint32_t>(out_ - in_);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+
+        std::wstring cmd = params.at(0);
+        std::wstring value;
+        if (params.size() > 1) {
+            value = params.at(1);
+        }
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+                cond_.notify_all();
+            }
+
+            result = std::to_wstring(loop_);
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            int64_t seek;
+            if (boost::iequals(value, L"rel")) {
+                seek = position_ - in_;
+            } else if (boost::iequals(value, L"in")) {
+                seek = 0;
+            } else if (boost::iequals(value, L"out") || boost::iequals(value, L"end")) {
+                seek = out_ - in_ - 1;
+            } else {
+                seek = boost::lexical_cast<int64_t>(value);
+            }
+
+            if (params.size() > 2) {
+                seek += boost::lexical_cast<int64_t>(params.at(2));
+            }
+
+            this->seek(seek);
+
+            result = std::to_wstring(position_ - in_);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    std::wstring print() const override
+    {
+        return L"hap[" + name_ + L"|" + std::to_wstring(position_ - in_) + L"/" + std::to_wstring(out_ - in_) + L"]";
+    }
+
+    std::wstring name() const override { return L"hap"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_hap_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                          const core::video_format_desc&              format_desc,
+                                                          const std::wstring&                         name,
+                                                          const std::wstring&                         path,
+                                                          std::int64_t                                in,
+                                                          std::int64_t                                out,
+                                                          bool                                        loop)
+{
+    try {
+        auto ic = open_input(u8(path));
+
+        const auto index = av_find_best_stream(ic.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (index < 0 || ic->streams[index]->codecpar->codec_id != AV_CODEC_ID_HAP) {
+            return core::frame_producer::empty();
+        }
+        auto stream = ic->streams[index];
+
+        // Audio and frame rate conversion are done by the ffmpeg producer.
+        for (auto n = 0U; n < ic->nb_streams; ++n) {
+            if (ic->streams[n]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+                return core::frame_producer::empty();
+            }
+        }
+        const auto fps = av_guess_frame_rate(ic.get(), stream, nullptr);
+        if (fps.num <= 0 || fps.den <= 0 || static_cast<int64_t>(fps.num) * format_desc.framerate.denominator() !=
+                                                static_cast<int64_t>(fps.den) * format_desc.framerate.numerator()) {
+            return core::frame_producer::empty();
+        }
+
+        // Every HAP frame is a keyframe, so that any frame is read straight from its position in the file.
+        std::vector<AVIndexEntry> entries;
+        for (auto n = 0; n < stream->nb_index_entries; ++n) {
+            if ((stream->index_entries[n].flags & AVINDEX_DISCARD_FRAME) == 0) {
+                entries.push_back(stream->index_entries[n]);
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const AVIndexEntry& lhs, const AVIndexEntry& rhs) {
+            return lhs.timestamp < rhs.timestamp;
+        });
+        if (entries.empty()) {
+            return core::frame_producer::empty();
+        }
+
+        // The format is only known from the frames, HAP Q Alpha and other formats are decoded by the ffmpeg producer.
+        std::uint8_t header[4];
+        if (entries[0].size < 4 || avio_seek(ic->pb, entries[0].pos, SEEK_SET) < 0 ||
+            avio_read(ic->pb, header, sizeof(header)) != sizeof(header)) {
+            return core::frame_producer::empty();
+        }
+        const auto format = get_format(header[3]);
+        if (format == core::pixel_format::invalid) {
+            return core::frame_producer::empty();
+        }
+
+        core::pixel_format_desc desc(format);
+        desc.planes.push_back(core::pixel_format_desc::plane::blocks(
+            stream->codecpar->width, stream->codecpar->height, format == core::pixel_format::dxt1 ? 8 : 16));
+
+        const auto count = static_cast<int64_t>(entries.size());
+        in               = std::min(std::max(in, INT64_C(0)), count - 1);
+        out              = std::min(std::max(out, in + 1), count);
+
+        auto producer = spl::make_shared<hap_producer>(frame_factory,
+                                                       name,
+                                                       path,
+                                                       std::move(ic),
+                                                       std::move(entries),
+                                                       std::move(desc),
+                                                       av_q2d(fps),
+                                                       in,
+                                                       out,
+                                                       loop);
+        return core::create_destroy_proxy(std::move(producer));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+    return core::frame_producer::empty();
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+#include <core/video_format.h>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Plays HAP, HAP Alpha and HAP Q clips without decoding them on the cpu: the frames are only snappy decompressed
+// and their DXT blocks are uploaded as compressed textures. Returns empty for other clips, clips with audio and clips
+// at another frame rate than the channel, which are left to the ffmpeg producer.
+spl::shared_ptr<core::frame_producer> create_hap_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                          const core::video_format_desc&              format_desc,
+                                                          const std::wstring&                         name,
+                                                          const std::wstring&                         path,
+                                                          std::int64_t                                in,
+                                                          std::int64_t                                out,
+                                                          bool                                        loop);
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "raw_producer.h"
+
+#include "../util/raw_format.h"
+
+#include <common/array.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/lexical_cast.hpp>
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <mutex>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Frames that are paged in ahead of the one being played.
+const int64_t READ_AHEAD = 8;
+
+// Asks the kernel to start reading the pages of [ptr, ptr + size) in the background.
+void will_need(const std::uint8_t* base, const std::uint8_t* ptr, std::size_t size)
+{
+#ifndef _MSC_VER
+    const auto page   = static_cast<std::size_t>(boost::interprocess::mapped_region::get_page_size());
+    const auto offset = static_cast<std::size_t>(ptr - base) % page;
+    ::madvise(const_cast<std::uint8_t*>(ptr - offset), size + offset, MADV_WILLNEED);
+#endif
+}
+
+} // namespace
+
+struct raw_producer : public core::frame_producer
+{
+    core::monitor::state                                      state_;
+    const std::wstring                                        name_;
+    const std::wstring                                        path_;
+    const core::video_format_desc                             format_desc_;
+    std::shared_ptr<const boost::interprocess::mapped_region> region_;
+    const std::uint8_t*                                       base_ = nullptr;
+    raw_header                                                header_;
+
+    mutable std::mutex mutex_;
+    int64_t            in_;
+    int64_t            out_;
+    int64_t            position_;
+    int64_t            audio_position_ = 0;
+    bool               loop_;
+    core::draw_frame   frame_;
+
+    raw_producer(const core::video_format_desc& format_desc,
+                 std::wstring                   name,
+                 std::wstring                   path,
+                 int64_t                        in,
+                 int64_t                        out,
+                 bool                           loop)
+        : name_(std::move(name))
+        , path_(std::move(path))
+        , format_desc_(format_desc)
+        , loop_(loop)
+    {
+        using namespace boost::interprocess;
+
+        // Private pages, so that anything writing to the frames gets its own copy instead of changing the file.
+        file_mapping mapping(u8(path_).c_str(), read_only);
+        region_ = std::make_shared<mapped_region>(mapping, copy_on_write);
+        base_   = static_cast<const std::uint8_t*>(region_->get_address());
+
+        const auto size = static_cast<std::uint64_t>(region_->get_size());
+        if (size < sizeof(raw_header)) {
+            CASPAR_THROW_EXCEPTION(file_read_error() << msg_info("Not a raw clip.") << file_name_info(u8(path_)));
+        }
+        std::memcpy(&header_, base_, sizeof(raw_header));
+
+        if (!is_valid(header_) ||
+            header_.video_offset + header_.frame_count * header_.frame_stride > size ||
+            header_.audio_offset + header_.audio_samples * header_.audio_channels * sizeof(std::int32_t) > size) {
+            CASPAR_THROW_EXCEPTION(file_read_error() << msg_info("Invalid or truncated raw clip.")
+                                                     << file_name_info(u8(path_)));
+        }
+
+        const auto count = static_cast<int64_t>(header_.frame_count);
+        in_              = std::min(std::max(in, INT64_C(0)), std::max(count - 1, INT64_C(0)));
+        out_             = std::min(std::max(out, in_ + 1), count);
+        position_        = in_;
+
+        seek_audio();
+        will_need(base_,
+                  base_ + header_.audio_offset,
+                  static_cast<std::size_t>(header_.audio_samples * header_.audio_channels * sizeof(std::int32_t)));
+        read_ahead(position_, READ_AHEAD);
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    void seek_audio()
+    {
+        audio_position_ = static_cast<int64_t>(position_ * static_cast<double>(header_.audio_sample_rate) *
+                                               header_.fps_den / header_.fps_num);
+    }
+
+    void read_ahead(int64_t index, int64_t count)
+    {
+        for (auto n = index; n < index + count; ++n) {
+            const auto frame = in_ + (n - in_) % (out_ - in_);
+            if (frame < out_) {
+                will_need(base_,
+                          base_ + header_.video_offset + frame * header_.frame_stride,
+                          static_cast<std::size_t>(header_.frame_stride));
+            }
+        }
+    }
+
+    array<std::int32_t> audio(int nb_samples)
+    {
+        const auto channels     = format_desc_.audio_channels;
+        const auto src_channels = static_cast<int>(header_.audio_channels);
+        const auto available =
+            std::max(static_cast<int64_t>(header_.audio_samples) - audio_position_, static_cast<int64_t>(0));
+        const auto src =
+            reinterpret_cast<const std::int32_t*>(base_ + header_.audio_offset) + audio_position_ * src_channels;
+
+        audio_position_ += nb_samples;
+
+        if (nb_samples <= 0) {
+            return {};
+        }
+
+        if (src_channels == channels && available >= nb_samples) {
+            return array<std::int32_t>(const_cast<std::int32_t*>(src),
+                                       static_cast<std::size_t>(nb_samples) * channels,
+                                       region_);
+        }
+
+        // Other layouts are truncated or padded with silence, as is the end of the file.
+        std::vector<std::int32_t> samples(static_cast<std::size_t>(nb_samples) * channels, 0);
+        for (auto i = 0; i < std::min<int64_t>(nb_samples, available); ++i) {
+            for (auto j = 0; j < std::min(channels, src_channels); ++j) {
+                samples[i * channels + j] = src[i * src_channels + j];
+            }
+        }
+        return array<std::int32_t>(std::move(samples));
+    }
+
+    core::draw_frame make_frame(int64_t index, int nb_samples)
+    {
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(header_.width, header_.height, 4));
+
+        auto ptr = const_cast<std::uint8_t*>(base_ + header_.video_offset + index * header_.frame_stride);
+
+        std::vector<array<std::uint8_t>> planes;
+        planes.emplace_back(ptr, static_cast<std::size_t>(desc.planes[0].size), region_);
+
+        return core::draw_frame(core::mutable_frame(this, std::move(planes), audio(nb_samples), desc));
+    }
+
+    void seek(int64_t frame)
+    {
+        position_ = std::min(std::max(in_ + frame, in_), out_ - 1);
+        seek_audio();
+        read_ahead(position_, READ_AHEAD);
+        frame_ = core::draw_frame{};
+    }
+
+    void update_state()
+    {
+        const auto fps      = static_cast<double>(header_.fps_num) / header_.fps_den;
+        state_["file/name"] = u8(name_);
+        state_["file/path"] = u8(path_);
+        state_["file/time"] = {position_ / fps, static_cast<double>(header_.frame_count) / fps};
+        state_["file/clip"] = {in_ / fps, (out_ - in_) / fps};
+        state_["loop"]      = loop_;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (position_ >= out_) {
+            if (!loop_) {
+                update_state();
+                return core::draw_frame::still(frame_);
+            }
+            position_ = in_;
+            seek_audio();
+        }
+
+        frame_ = make_frame(position_, nb_samples);
+        read_ahead(position_ + READ_AHEAD, 1);
+        position_ += 1;
+
+        update_state();
+
+        return frame_;
+    }
+
+    core::draw_frame first_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(make_frame(in_, 0));
+    }
+
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(frame_ ? frame_ : make_frame(std::min(position_, out_ - 1), 0));
+    }
+
+    std::uint32_t frame_number() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<std::uint32_t>(position_ - in_);
+    }
+
+    std::uint32_t nb_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loop_ ? std::numeric_limits<std::uint32_t>::max() : static_cast<std::uint32_t>(out_ - in_);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+
+        std::wstring cmd = params.at(0);
+        std::wstring value;
+        if (params.size() > 1) {
+            value = params.at(1);
+        }
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+            }
+
+            result = std::to_wstring(loop_);
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            int64_t seek;
+            if (boost::iequals(value, L"rel")) {
+                seek = position_ - in_;
+            } else if (boost::iequals(value, L"in")) {
+                seek = 0;
+            } else if (boost::iequals(value, L"out") || boost::iequals(value, L"end")) {
+                seek = out_ - in_ - 1;
+            } else {
+                seek = boost::lexical_cast<int64_t>(value);
+            }
+
+            if (params.size() > 2) {
+                seek += boost::lexical_cast<int64_t>(params.at(2));
+            }
+
+            this->seek(seek);
+
+            result = std::to_wstring(position_ - in_);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    std::wstring print() const override
+    {
+        return L"raw[" + name_ + L"|" + std::to_wstring(position_ - in_) + L"/" + std::to_wstring(out_ - in_) + L"]";
+    }
+
+    std::wstring name() const override { return L"raw"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_raw_producer(const core::frame_producer_dependencies& dependencies,
+                                                          const std::vector<std::wstring>&         params)
+{
+    auto name = params.at(0);
+    if (boost::contains(name, L"://")) {
+        return core::frame_producer::empty();
+    }
+
+    auto path = find_case_insensitive(env::media_folder() + L"/" + name);
+    if (!path || !boost::iequals(boost::filesystem::path(*path).extension().wstring(), RAW_EXTENSION)) {
+        path = find_case_insensitive(env::media_folder() + L"/" + name + RAW_EXTENSION);
+    }
+    if (!path || !boost::filesystem::is_regular_file(*path)) {
+        return core::frame_producer::empty();
+    }
+
+    auto loop = contains_param(L"LOOP", params);
+
+    auto in = get_param(L"SEEK", params, static_cast<uint32_t>(0));
+    in      = get_param(L"IN", params, in);
+
+    auto out = get_param(L"LENGTH", params, std::numeric_limits<uint32_t>::max());
+    if (out < std::numeric_limits<uint32_t>::max() - in)
+        out += in;
+    else
+        out = std::numeric_limits<uint32_t>::max();
+    out = get_param(L"OUT", params, out);
+
+    try {
+        auto producer = spl::make_shared<raw_producer>(dependencies.format_desc, name, *path, in, out, loop);
+        return core::create_destroy_proxy(std::move(producer));
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+    return core::frame_producer::empty();
+}
+
+}} // namespace caspar::ffmpeg
@@ -2,6 +2,10 @@
 
 #include "av_assert.h"
 
+#include <common/env.h>
+#include <common/log.h>
+#include <common/utf.h>
+
 #if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -10,16 +14,196 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavfilter/avfilter.h>
 #include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 }
 #if defined(_MSC_VER)
 #pragma warning(pop)
 #endif
 
+#include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
 
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
 namespace caspar { namespace ffmpeg {
 
+namespace {
+
+struct frame_allocator
+{
+    core::frame_factory* frame_factory;
+};
+
+// Planes handed out by get_buffer which have not been freed by ffmpeg yet.
+std::mutex                      g_planes_mutex;
+std::unordered_set<const void*> g_planes;
+
+void free_plane(void* opaque, uint8_t* data)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_planes_mutex);
+        g_planes.erase(opaque);
+    }
+    delete static_cast<array<std::uint8_t>*>(opaque);
+}
+
+int get_buffer(AVCodecContext* ctx, AVFrame* frame, int flags)
+{
+    auto allocator = static_cast<frame_allocator*>(ctx->opaque);
+    auto desc      = pixel_format_desc(static_cast<AVPixelFormat>(frame->format), frame->width, frame->height);
+
+    int width  = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+
+    // Planes must keep the linesizes make_frame expects, otherwise fall back to ffmpeg's own buffers.
+    auto compatible = allocator && desc.format != core::pixel_format::invalid && width == frame->width &&
+                      desc.planes.size() <= AV_NUM_DATA_POINTERS;
+    for (int n = 0; compatible && n < static_cast<int>(desc.planes.size()); ++n) {
+        compatible = desc.planes[n].linesize % linesize_align[n] == 0;
+    }
+    if (!compatible) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    // Decoders may write up to the aligned height and slightly beyond the last row.
+    for (auto& plane : desc.planes) {
+        plane.size = plane.linesize * (plane.height + height - frame->height + 2) + AV_INPUT_BUFFER_PADDING_SIZE;
+    }
+
+    auto mframe = allocator->frame_factory->create_frame(nullptr, desc);
+
+    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+        auto plane = new array<std::uint8_t>(std::move(mframe.image_data(n)));
+
+        frame->buf[n] = av_buffer_create(plane->data(), static_cast<int>(plane->size()), free_plane, plane, 0);
+        if (!frame->buf[n]) {
+            delete plane;
+            av_frame_unref(frame);
+            return AVERROR(ENOMEM);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(g_planes_mutex);
+            g_planes.insert(plane);
+        }
+
+        frame->data[n]     = plane->data();
+        frame->linesize[n] = desc.planes[n].linesize;
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
+
+// Shares the planes of video if they were allocated by get_buffer and still have the layout of desc.
+bool import_planes(const AVFrame& video, const core::pixel_format_desc& desc, std::vector<array<std::uint8_t>>& planes)
+{
+    std::lock_guard<std::mutex> lock(g_planes_mutex);
+
+    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+        if (n >= AV_NUM_DATA_POINTERS || !video.buf[n]) {
+            return false;
+        }
+
+        auto opaque = av_buffer_get_opaque(video.buf[n]);
+        if (g_planes.find(opaque) == g_planes.end()) {
+            return false;
+        }
+
+        auto plane = static_cast<array<std::uint8_t>*>(opaque);
+        if (video.data[n] != plane->data() || video.linesize[n] != desc.planes[n].linesize ||
+            plane->size() < static_cast<std::size_t>(desc.planes[n].size)) {
+            return false;
+        }
+
+        planes.push_back(plane->share());
+    }
+
+    return true;
+}
+
+using sample_pool_t = tbb::concurrent_queue<std::vector<int32_t>>;
+
+array<int32_t> create_samples(std::size_t size)
+{
+    static auto pool = std::make_shared<sample_pool_t>();
+
+    std::vector<int32_t> buffer;
+    pool->try_pop(buffer);
+    buffer.resize(size);
+
+    auto ptr       = buffer.data();
+    auto weak_pool = std::weak_ptr<sample_pool_t>(pool);
+    auto storage   = std::shared_ptr<std::vector<int32_t>>(
+        new std::vector<int32_t>(std::move(buffer)), [weak_pool](std::vector<int32_t>* p) {
+            std::unique_ptr<std::vector<int32_t>> guard(p);
+            auto                                  pool = weak_pool.lock();
+            if (pool && pool->unsafe_size() < 64) {
+                pool->push(std::move(*p));
+            }
+        });
+
+    return array<int32_t>(ptr, size, std::move(storage));
+}
+
+AVPixelFormat get_hw_format(AVCodecContext* ctx, const AVPixelFormat* formats)
+{
+    auto hw_pix_fmt = *static_cast<AVPixelFormat*>(ctx->opaque);
+    for (auto format = formats; *format != AV_PIX_FMT_NONE; ++format) {
+        if (*format == hw_pix_fmt) {
+            return *format;
+        }
+    }
+
+    CASPAR_LOG(error) << L"[ffmpeg] Hardware decoding is not available for this stream.";
+    return AV_PIX_FMT_NONE;
+}
+
+} // namespace
+
+// Interleaves s32 audio into channels channels.
+void copy_audio(core::mutable_frame& frame, const AVFrame& audio, int channels)
+{
+    const auto src_channels = audio.channels;
+    const auto nb_samples   = audio.nb_samples;
+
+    auto samples = create_samples(static_cast<std::size_t>(nb_samples) * channels);
+    auto dst     = samples.data();
+    auto src     = reinterpret_cast<const int32_t*>(audio.data[0]);
+
+    if (src_channels == channels) {
+        std::memcpy(dst, src, samples.size() * sizeof(int32_t));
+    } else {
+        // Mono is played on the first two channels, other layouts are truncated or padded with silence.
+        std::vector<int> map(channels, -1);
+        for (auto j = 0; j < std::min(src_channels, channels); ++j) {
+            map[j] = j;
+        }
+        if (src_channels == 1 && channels > 1) {
+            map[1] = 0;
+        }
+
+        for (auto i = 0; i < nb_samples; ++i) {
+            for (auto j = 0; j < channels; ++j) {
+                dst[i * channels + j] = map[j] < 0 ? 0 : src[i * src_channels + map[j]];
+            }
+        }
+    }
+
+    frame.audio_data() = std::move(samples);
+}
+
 std::shared_ptr<AVFrame> alloc_frame()
 {
     const auto frame = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
@@ -39,12 +223,23 @@ std::shared_ptr<AVPacket> alloc_packet()
 core::mutable_frame make_frame(void*                    tag,
                                core::frame_factory&     frame_factory,
                                std::shared_ptr<AVFrame> video,
-                               std::shared_ptr<AVFrame> audio)
+                               std::shared_ptr<AVFrame> audio,
+                               int                      audio_channels)
 {
     const auto pix_desc =
         video ? pixel_format_desc(static_cast<AVPixelFormat>(video->format), video->width, video->height)
               : core::pixel_format_desc(core::pixel_format::invalid);
 
+    std::vector<array<std::uint8_t>> planes;
+    if (video && import_planes(*video, pix_desc, planes)) {
+        // The decoder wrote straight into upload memory.
+        auto frame = core::mutable_frame(tag, std::move(planes), array<std::int32_t>{}, pix_desc);
+        if (audio) {
+            copy_audio(frame, *audio, audio_channels);
+        }
+        return frame;
+    }
+
     auto frame = frame_factory.create_frame(tag, pix_desc);
 
     if (video) {
@@ -58,20 +253,125 @@ core::mutable_frame make_frame(void*                    tag,
     }
 
     if (audio) {
-        // TODO This is a bit of a hack
-        frame.audio_data() = std::vector<int32_t>(audio->nb_samples * 8, 0);
-        auto dst           = frame.audio_data().data();
-        auto src           = reinterpret_cast<int32_t*>(audio->data[0]);
-        tbb::parallel_for(0, audio->nb_samples, [&](int i) {
-            for (auto j = 0; j < std::min(8, audio->channels); ++j) {
-                dst[i * 8 + j] = src[i * audio->channels + j];
-            }
-        });
+        copy_audio(frame, *audio, audio_channels);
     }
 
     return frame;
 }
 
+std::shared_ptr<void> set_frame_allocator(AVCodecContext* ctx, core::frame_factory& frame_factory)
+{
+    if (!env::properties().get(L"configuration.ffmpeg.producer.zero-copy", true)) {
+        return nullptr;
+    }
+
+    const auto descriptor = avcodec_descriptor_get(ctx->codec_id);
+    if (ctx->codec_type != AVMEDIA_TYPE_VIDEO || !ctx->codec || !(ctx->codec->capabilities & AV_CODEC_CAP_DR1) ||
+        !descriptor || !(descriptor->props & AV_CODEC_PROP_INTRA_ONLY) || ctx->field_order != AV_FIELD_PROGRESSIVE) {
+        return nullptr;
+    }
+
+    auto allocator   = std::make_shared<frame_allocator>(frame_allocator{&frame_factory});
+    ctx->opaque      = allocator.get();
+    ctx->get_buffer2 = get_buffer;
+    return allocator;
+}
+
+std::shared_ptr<void> set_decode_threads(AVCodecContext* ctx, bool background)
+{
+    static const int max_threads = std::max(1, env::properties().get(L"configuration.ffmpeg.producer.threads", 4));
+    static const int budget      = [] {
+        const auto value = env::properties().get(L"configuration.ffmpeg.producer.thread-budget", 0);
+        return value > 0 ? value : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+    }();
+    static std::mutex mutex;
+    static int        in_use = 0;
+
+    ctx->thread_count = 1;
+    ctx->thread_type  = 0;
+
+    const auto codec      = ctx->codec;
+    const auto descriptor = avcodec_descriptor_get(ctx->codec_id);
+    if (!codec || ctx->codec_type != AVMEDIA_TYPE_VIDEO || ctx->hw_device_ctx) {
+        return nullptr;
+    }
+
+    // Inter coded video scales better across frames, intra only video is sliced to not add frames of latency.
+    const auto intra_only = descriptor && (descriptor->props & AV_CODEC_PROP_INTRA_ONLY);
+    const auto frame      = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0;
+    const auto slice      = (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) != 0;
+    const auto type       = frame && (!intra_only || !slice) ? FF_THREAD_FRAME : slice ? FF_THREAD_SLICE : 0;
+    if (type == 0) {
+        return nullptr;
+    }
+
+    // About a thread for each half of a 1080 frame, half as many in the background.
+    const auto pixels = static_cast<int64_t>(ctx->width) * ctx->height;
+    auto       wanted = static_cast<int>(std::min<int64_t>(max_threads, (pixels + 1036799) / 1036800));
+    if (background) {
+        wanted = std::max(1, wanted / 2);
+    }
+
+    // A decoder always has its one thread, i.e. decodes on the thread of the producer, those above it are shared.
+    auto threads = 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads = std::max(1, std::min(wanted, 1 + budget - in_use));
+        in_use += threads - 1;
+    }
+
+    ctx->thread_count = threads;
+    ctx->thread_type  = threads > 1 ? type : 0;
+
+    return std::shared_ptr<void>(nullptr, [threads](void*) {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_use -= threads - 1;
+    });
+}
+
+std::shared_ptr<void> set_hwaccel(AVCodecContext* ctx, const std::string& hwaccel, AVPixelFormat& pix_fmt)
+{
+    auto type = av_hwdevice_find_type_by_name(hwaccel.c_str());
+    if (type == AV_HWDEVICE_TYPE_NONE) {
+        CASPAR_LOG(warning) << L"[ffmpeg] Unknown hwaccel " << u16(hwaccel) << L".";
+        return nullptr;
+    }
+
+    // Hardware decoders output nv12 or p010 surfaces for 4:2:0 video, which is what the filter graph gets fed.
+    const auto desc = av_pix_fmt_desc_get(ctx->pix_fmt);
+    if (!desc || desc->log2_chroma_w != 1 || desc->log2_chroma_h != 1) {
+        return nullptr;
+    }
+    const auto sw_pix_fmt = desc->comp[0].depth > 8 ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
+
+    auto hw_pix_fmt = std::make_shared<AVPixelFormat>(AV_PIX_FMT_NONE);
+    for (int n = 0;; ++n) {
+        auto config = avcodec_get_hw_config(ctx->codec, n);
+        if (!config) {
+            CASPAR_LOG(warning) << L"[ffmpeg] " << u16(ctx->codec->name) << L" does not support hwaccel "
+                                << u16(hwaccel) << L".";
+            return nullptr;
+        }
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) && config->device_type == type) {
+            *hw_pix_fmt = config->pix_fmt;
+            break;
+        }
+    }
+
+    AVBufferRef* device = nullptr;
+    if (av_hwdevice_ctx_create(&device, type, nullptr, nullptr, 0) < 0) {
+        CASPAR_LOG(warning) << L"[ffmpeg] Failed to create " << u16(hwaccel) << L" device.";
+        return nullptr;
+    }
+
+    ctx->hw_device_ctx = device;
+    ctx->opaque        = hw_pix_fmt.get();
+    ctx->get_format    = get_hw_format;
+    pix_fmt            = sw_pix_fmt;
+
+    return hw_pix_fmt;
+}
+
 core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
 {
     switch (pix_fmt) {
@@ -99,6 +399,18 @@ core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
             return core::pixel_format::ycbcr;
         case AV_PIX_FMT_YUV410P:
             return core::pixel_format::ycbcr;
+        case AV_PIX_FMT_YUV444P10:
+            return core::pixel_format::ycbcr;
+        case AV_PIX_FMT_YUV422P10:
+            return core::pixel_format::ycbcr;
+        case AV_PIX_FMT_YUV420P10:
+            return core::pixel_format::ycbcr;
+        case AV_PIX_FMT_NV12:
+            return core::pixel_format::nv12;
+        case AV_PIX_FMT_UYVY422:
+            return core::pixel_format::uyvy;
+        case AV_PIX_FMT_P010:
+            return core::pixel_format::nv12;
         case AV_PIX_FMT_YUVA420P:
             return core::pixel_format::ycbcra;
         case AV_PIX_FMT_YUVA422P:
@@ -118,6 +430,15 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
 
     core::pixel_format_desc desc = get_pixel_format(pix_fmt);
 
+    // 10 bit planar formats keep their values in the low bits of each sample, p010 in the high bits.
+    auto depth = core::color_depth::bit8;
+    if (pix_fmt == AV_PIX_FMT_P010) {
+        depth = core::color_depth::bit16;
+    } else if (desc.format != core::pixel_format::invalid && av_pix_fmt_desc_get(pix_fmt)->comp[0].depth > 8) {
+        depth = core::color_depth::bit10;
+    }
+    const auto bytes = core::bytes_per_sample(depth);
+
     switch (desc.format) {
         case core::pixel_format::gray:
         case core::pixel_format::luma: {
@@ -132,7 +453,8 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
         case core::pixel_format::bgra:
         case core::pixel_format::argb:
         case core::pixel_format::rgba:
-        case core::pixel_format::abgr: {
+        case core::pixel_format::abgr:
+        case core::pixel_format::uyvy: {
             desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0] / 4, height, 4));
             return desc;
         }
@@ -142,15 +464,24 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
             auto size2 = static_cast<int>(dummy_pict.data[2] - dummy_pict.data[1]);
             auto h2    = size2 / dummy_pict.linesize[1];
 
-            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0], height, 1));
-            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[1], h2, 1));
-            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[2], h2, 1));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0] / bytes, height, 1, depth));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[1] / bytes, h2, 1, depth));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[2] / bytes, h2, 1, depth));
 
             if (desc.format == core::pixel_format::ycbcra)
                 desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[3], height, 1));
 
             return desc;
         }
+        case core::pixel_format::nv12: {
+            // Chroma is stored as interleaved cb/cr pairs in a single plane.
+            auto h2 = (height + 1) / 2;
+
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0] / bytes, height, 1, depth));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[1] / (bytes * 2), h2, 2, depth));
+
+            return desc;
+        }
         default:
             desc.format = core::pixel_format::invalid;
             return desc;
@@ -218,6 +549,17 @@ std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, con
         case core::pixel_format::ycbcra:
             av_frame->format = AVPixelFormat::AV_PIX_FMT_YUVA420P;
             break;
+        case core::pixel_format::nv12:
+            av_frame->format = planes[0].depth == core::color_depth::bit8 ? AVPixelFormat::AV_PIX_FMT_NV12
+                                                                           : AVPixelFormat::AV_PIX_FMT_P010;
+            break;
+        case core::pixel_format::uyvy:
+            av_frame->format = AVPixelFormat::AV_PIX_FMT_UYVY422;
+            break;
+        case core::pixel_format::v210:
+        case core::pixel_format::dxt1:
+        case core::pixel_format::dxt5:
+        case core::pixel_format::ycocg_dxt5:
         case core::pixel_format::count:
         case core::pixel_format::invalid:
             break;
@@ -237,6 +579,19 @@ std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, con
     return av_frame;
 }
 
+std::string abuffer_args(const core::video_format_desc& format_desc)
+{
+    auto args = (boost::format("time_base=%d/%d:sample_rate=%d:sample_fmt=%s") % 1 % format_desc.audio_sample_rate %
+                 format_desc.audio_sample_rate % AV_SAMPLE_FMT_S32)
+                    .str();
+
+    const auto layout = av_get_default_channel_layout(format_desc.audio_channels);
+    if (layout != 0) {
+        return args + (boost::format(":channel_layout=%#x") % layout).str();
+    }
+    return args + (boost::format(":channels=%d") % format_desc.audio_channels).str();
+}
+
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_desc)
 {
     auto av_frame = alloc_frame();
@@ -5,6 +5,7 @@
 #include <core/frame/pixel_format.h>
 
 #include <memory>
+#include <string>
 
 struct AVFrame;
 struct AVPacket;
@@ -22,7 +23,46 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
 core::mutable_frame     make_frame(void*                    tag,
                                    core::frame_factory&     frame_factory,
                                    std::shared_ptr<AVFrame> video,
-                                   std::shared_ptr<AVFrame> audio);
+                                   std::shared_ptr<AVFrame> audio,
+                                   int                      audio_channels);
+
+// Interleaves the s32 samples of audio into the audio of frame, mapping them to channels channels.
+void copy_audio(core::mutable_frame& frame, const AVFrame& audio, int channels);
+
+/**
+ * Lets the video decoder ctx decode straight into frames from frame_factory,
+ * which make_frame then passes on without copying. Must be called before the
+ * decoder is opened and the returned handle must outlive ctx. Returns nullptr
+ * for streams it does not apply to, which is anything but progressive intra
+ * only video since decoders and filters would otherwise read back from upload
+ * memory.
+ */
+std::shared_ptr<void> set_frame_allocator(AVCodecContext* ctx, core::frame_factory& frame_factory);
+
+/**
+ * Sets up the video decoder ctx to decode on the gpu using the named ffmpeg
+ * hwaccel, e.g. cuda, vaapi, qsv or d3d11va. Must be called before the
+ * decoder is opened and the returned handle must outlive ctx. On success
+ * pix_fmt is set to the software format decoded frames are transferred to,
+ * otherwise nullptr is returned and ctx is left to decode in software.
+ */
+std::shared_ptr<void> set_hwaccel(AVCodecContext* ctx, const std::string& hwaccel, AVPixelFormat& pix_fmt);
+
+/**
+ * Picks the thread count and type of the decoder ctx for its codec and
+ * resolution, fewer for producers in the background. Every decoder has one
+ * thread, those beyond it come out of the server wide
+ * configuration.ffmpeg.producer.thread-budget. Inter coded
+ * video is decoded with frame threads, intra only video and codecs without
+ * them with slice threads. Must be called before the decoder is opened and
+ * the returned handle, which gives the threads back to the budget, must
+ * outlive ctx.
+ */
+std::shared_ptr<void> set_decode_threads(AVCodecContext* ctx, bool background);
+
+// Arguments of an abuffer source of the s32 audio of format_desc. Channel counts without a default layout, e.g. 12
+// or more than 16, are passed as a count only.
+std::string abuffer_args(const core::video_format_desc& format_desc);
 
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
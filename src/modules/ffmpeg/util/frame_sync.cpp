@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_sync.h"
+
+#include <common/array.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Bandwidths of the loop that filters the arrival times and of the one that steers the resampler, in Hz. The latter
+// is slow, so that jitter of the level doesn't modulate the pitch.
+const double DLL_BANDWIDTH  = 0.5;
+const double LOOP_BANDWIDTH = 0.02;
+const double LOOP_DAMPING   = 0.7;
+
+// The most the ratio strays from 1, far beyond the drift of real clocks and still inaudible.
+const double MAX_DRIFT = 0.005;
+
+// Inputs that arrive within this of each other came in one callback, e.g. the two frames of a field rate input.
+const double BURST_TIME = 0.002;
+
+// Audio with peaks below -50 dBFS is quiet enough to drop or insert a frame at.
+const double QUIET_PEAK = 2147483647.0 * 0.00316;
+
+// Catmull-Rom interpolation between x1 and x2.
+inline double interpolate(double x0, double x1, double x2, double x3, double t)
+{
+    return x1 + 0.5 * t * (x2 - x0 + t * (2.0 * x0 - 5.0 * x1 + 4.0 * x2 - x3 + t * (3.0 * (x1 - x2) + x3 - x0)));
+}
+
+} // namespace
+
+struct FrameSync::Impl
+{
+    struct Entry
+    {
+        core::draw_frame video;
+        int64_t          start; // The first sample of the audio that came with it.
+    };
+
+    // Filtered arrival time of the samples up to the end of the buffer, and seconds per sample of the input.
+    struct Clock
+    {
+        bool   valid  = false;
+        double time   = 0.0;
+        double period = 0.0;
+    };
+
+    const void*                                 tag_;
+    const spl::shared_ptr<core::frame_factory>  frame_factory_;
+    const int                                   channels_;
+    const double                                sample_rate_;
+    const double                                frame_samples_;
+    const double                                target_;
+    const std::size_t                           capacity_;
+    const std::shared_ptr<diagnostics::graph>   graph_;
+    const std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+
+    mutable std::mutex mutex_;
+
+    // Interleaved input samples, audio_[0] is sample audio_begin_ of the input, and position_ is where the next
+    // output sample is read.
+    std::deque<Entry>    video_;
+    std::vector<int32_t> audio_;
+    int64_t              audio_begin_ = 0;
+    int64_t              audio_end_   = 0;
+    double               position_    = 0.0;
+
+    Clock   clock_;
+    Clock   burst_clock_;
+    double  burst_time_    = 0.0;
+    int64_t burst_samples_ = 0;
+
+    bool             primed_   = false;
+    double           ratio_    = 1.0;
+    double           integral_ = 0.0;
+    core::draw_frame shown_;
+
+    Impl(const void*                          tag,
+         spl::shared_ptr<core::frame_factory> frame_factory,
+         const core::video_format_desc&       format_desc,
+         std::shared_ptr<diagnostics::graph>  graph,
+         double                               depth)
+        : tag_(tag)
+        , frame_factory_(std::move(frame_factory))
+        , channels_(format_desc.audio_channels)
+        , sample_rate_(format_desc.audio_sample_rate)
+        , frame_samples_(format_desc.audio_sample_rate / format_desc.fps)
+        , target_((depth + 1.0) * frame_samples_)
+        , capacity_(static_cast<std::size_t>(std::ceil(depth)) + 4)
+        , graph_(std::move(graph))
+    {
+        if (graph_) {
+            graph_->set_color("sync-drift", diagnostics::color(0.9f, 0.9f, 0.3f));
+        }
+    }
+
+    double now() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    void warn(const std::string& name)
+    {
+        if (graph_) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, name);
+        }
+    }
+
+    // Samples that arrived in one callback are one event for the loop, so frames pushed together are taken back and
+    // pushed as one.
+    void arrived(int nb_samples)
+    {
+        const auto time = now();
+
+        auto count = static_cast<int64_t>(nb_samples);
+        if (clock_.valid && time - burst_time_ < BURST_TIME) {
+            clock_ = burst_clock_;
+            count += burst_samples_;
+        } else {
+            burst_clock_ = clock_;
+            burst_time_  = time;
+        }
+        burst_samples_ = count;
+
+        if (count == 0) {
+            return;
+        }
+
+        const auto predicted = clock_.time + static_cast<double>(count) * clock_.period;
+        const auto error     = burst_time_ - predicted;
+        if (!clock_.valid || std::abs(error) > 0.25) {
+            clock_.valid  = true;
+            clock_.time   = burst_time_;
+            clock_.period = 1.0 / sample_rate_;
+            return;
+        }
+
+        const auto omega = 2.0 * PI * DLL_BANDWIDTH * static_cast<double>(count) * clock_.period;
+        clock_.time      = predicted + std::sqrt(2.0) * omega * error;
+        clock_.period += omega * omega * error / static_cast<double>(count);
+    }
+
+    // Samples buffered as if the input arrived evenly, including those of the frame in flight.
+    double level() const
+    {
+        if (!clock_.valid) {
+            return static_cast<double>(audio_end_) - position_;
+        }
+        const auto arriving = std::max(0.0, now() - clock_.time) / clock_.period;
+        return static_cast<double>(audio_end_) + std::min(arriving, frame_samples_ * 2.0) - position_;
+    }
+
+    bool quiet(double from, double count) const
+    {
+        const auto begin = std::max<int64_t>(static_cast<int64_t>(from) - audio_begin_, 0);
+        const auto end   = std::min<int64_t>(static_cast<int64_t>(from + count) - audio_begin_,
+                                           static_cast<int64_t>(audio_.size()) / channels_);
+        for (auto n = begin * channels_; n < end * channels_; ++n) {
+            if (std::abs(static_cast<double>(audio_[n])) > QUIET_PEAK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void push(core::draw_frame video, const std::int32_t* samples, int nb_samples)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        arrived(nb_samples);
+
+        video_.push_back(Entry{std::move(video), audio_end_});
+        if (samples && nb_samples > 0) {
+            audio_.insert(audio_.end(), samples, samples + static_cast<std::size_t>(nb_samples) * channels_);
+            audio_end_ += nb_samples;
+        }
+
+        // The channel isn't taking frames, e.g. while the layer is paused.
+        if (video_.size() > capacity_) {
+            video_.pop_front();
+            position_ = std::max(position_, static_cast<double>(video_.front().start));
+            warn("dropped-frame");
+        }
+    }
+
+    core::draw_frame pop(int nb_samples)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto error = level() - target_;
+
+        if (!primed_) {
+            if (video_.empty() || error < 0.0) {
+                return core::draw_frame{};
+            }
+            primed_ = true;
+        }
+
+        // Levels the resampler can't absorb are corrected by a frame, where it doesn't show in the audio.
+        auto insert = false;
+        if (error > frame_samples_ * 3.0 || (error > frame_samples_ && quiet(position_, frame_samples_))) {
+            position_ += frame_samples_;
+            warn("dropped-frame");
+        } else if (error < -frame_samples_ && quiet(position_, frame_samples_)) {
+            insert = true;
+            warn("late-frame");
+        } else {
+            const auto dt = nb_samples / sample_rate_;
+            const auto e  = error / sample_rate_;
+            const auto w  = 2.0 * PI * LOOP_BANDWIDTH;
+            integral_     = std::max(-MAX_DRIFT, std::min(MAX_DRIFT, integral_ + w * w * e * dt));
+            ratio_        = 1.0 + 2.0 * LOOP_DAMPING * w * e + integral_;
+            ratio_        = std::max(1.0 - MAX_DRIFT, std::min(1.0 + MAX_DRIFT, ratio_));
+        }
+
+        const auto needed = position_ + nb_samples * ratio_ + 2.0;
+        if (!insert && (video_.empty() || needed > static_cast<double>(audio_end_))) {
+            primed_ = false;
+            warn("late-frame");
+            return core::draw_frame{};
+        }
+
+        std::vector<int32_t> samples(static_cast<std::size_t>(nb_samples) * channels_, 0);
+        if (!insert) {
+            resample(samples.data(), nb_samples);
+        }
+
+        // The frame that came with the audio in the middle of this frame.
+        const auto middle  = position_ - nb_samples * ratio_ * 0.5;
+        auto       skipped = 0;
+        while (video_.size() > 1 && static_cast<double>(video_[1].start) <= middle) {
+            video_.pop_front();
+            skipped += 1;
+        }
+        if (skipped > 1 && !insert) {
+            warn("dropped-frame");
+        }
+        if (!video_.empty() && static_cast<double>(video_.front().start) <= middle) {
+            shown_ = video_.front().video;
+        }
+
+        // Keeps a sample before the position for the interpolation.
+        const auto consumed = static_cast<int64_t>(position_) - 1 - audio_begin_;
+        if (consumed > 0 && consumed * 2 * channels_ >= static_cast<int64_t>(audio_.size())) {
+            audio_.erase(audio_.begin(), audio_.begin() + consumed * channels_);
+            audio_begin_ += consumed;
+        }
+
+        if (graph_) {
+            graph_->set_value("sync-drift", (ratio_ - 1.0) / MAX_DRIFT * 0.5 + 0.5);
+        }
+
+        auto audio         = frame_factory_->create_frame(tag_, core::pixel_format_desc(core::pixel_format::invalid));
+        audio.audio_data() = array<std::int32_t>(std::move(samples));
+        return core::draw_frame(std::vector<core::draw_frame>{shown_, core::draw_frame(std::move(audio))});
+    }
+
+    // Reads nb_samples from position_ on, ratio_ input samples apart.
+    void resample(int32_t* dst, int nb_samples)
+    {
+        const auto last = static_cast<int64_t>(audio_.size()) / channels_ - 1;
+        const auto at   = [&](int64_t n, int c) {
+            return static_cast<double>(audio_[std::max<int64_t>(0, std::min(n, last)) * channels_ + c]);
+        };
+
+        for (auto i = 0; i < nb_samples; ++i) {
+            const auto position = position_ + i * ratio_;
+            const auto index    = static_cast<int64_t>(std::floor(position));
+            const auto t        = position - static_cast<double>(index);
+            const auto n        = index - audio_begin_;
+            for (auto c = 0; c < channels_; ++c) {
+                const auto value = interpolate(at(n - 1, c), at(n, c), at(n + 1, c), at(n + 2, c), t);
+                dst[i * channels_ + c] =
+                    static_cast<int32_t>(std::lrint(std::max(-2147483648.0, std::min(2147483647.0, value))));
+            }
+        }
+        position_ += nb_samples * ratio_;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        video_.clear();
+        audio_.clear();
+        audio_begin_ = audio_end_ = 0;
+        position_                 = 0.0;
+        clock_                    = Clock{};
+        primed_                   = false;
+        ratio_                    = 1.0;
+        integral_                 = 0.0;
+        shown_                    = core::draw_frame{};
+    }
+};
+
+FrameSync::FrameSync(const void*                          tag,
+                     spl::shared_ptr<core::frame_factory> frame_factory,
+                     const core::video_format_desc&       format_desc,
+                     std::shared_ptr<diagnostics::graph>  graph,
+                     double                               depth)
+    : impl_(new Impl(tag, std::move(frame_factory), format_desc, std::move(graph), depth))
+{
+}
+
+FrameSync::~FrameSync() {}
+
+void FrameSync::push(core::draw_frame video, const std::int32_t* samples, int nb_samples)
+{
+    impl_->push(std::move(video), samples, nb_samples);
+}
+
+core::draw_frame FrameSync::pop(int nb_samples) { return impl_->pop(nb_samples); }
+
+void FrameSync::clear() { impl_->clear(); }
+
+std::size_t FrameSync::size() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->video_.size();
+}
+
+std::size_t FrameSync::capacity() const { return impl_->capacity_; }
+
+}} // namespace caspar::ffmpeg
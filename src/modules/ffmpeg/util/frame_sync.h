@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/diagnostics/graph.h>
+#include <common/memory.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/video_format.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace caspar { namespace ffmpeg {
+
+// Passes the frames of a live input on to a channel whose clock drifts from the clock of the input. A delay locked
+// loop filters the arrival times of the input, so that the level of the buffer can be measured as if the input arrived
+// evenly, and a control loop steers the ratio by which the audio is resampled to keep that level at the depth. Video
+// follows the audio, so drift shows as the odd dropped or repeated frame while the audio plays on without a gap. Only
+// levels that the resampler can't absorb, e.g. after the input stalls, are corrected by whole frames, where the audio
+// is quiet unless the level is far off. The ratio is shown on the graph as sync-drift.
+class FrameSync
+{
+  public:
+    // depth is the least buffered, in frames of the channel, besides the frame that is arriving.
+    FrameSync(const void*                          tag,
+              spl::shared_ptr<core::frame_factory> frame_factory,
+              const core::video_format_desc&       format_desc,
+              std::shared_ptr<diagnostics::graph>  graph,
+              double                               depth = 1.5);
+    ~FrameSync();
+
+    FrameSync(const FrameSync&) = delete;
+    FrameSync& operator=(const FrameSync&) = delete;
+
+    // Called from the thread of the input with a frame of video without audio, and the interleaved samples that came
+    // with it in the channels of the channel.
+    void push(core::draw_frame video, const std::int32_t* samples, int nb_samples);
+
+    // Called by the channel each frame, returns the video to show with nb_samples of audio, or an empty frame while
+    // the buffer fills.
+    core::draw_frame pop(int nb_samples);
+
+    // Drops what is buffered and starts over, e.g. when the input changes format.
+    void clear();
+
+    // Video frames buffered, and the most that are before the oldest are dropped.
+    std::size_t size() const;
+    std::size_t capacity() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
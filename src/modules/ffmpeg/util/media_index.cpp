@@ -0,0 +1,561 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "media_index.h"
+#include "thumbnail.h"
+
+#include <common/base64.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const char* const INDEX_MAGIC = "CASPARCG-MEDIA-INDEX 1";
+
+struct media_info
+{
+    std::uintmax_t size     = 0;
+    std::time_t    modified = 0;
+    std::string    type;
+    std::int64_t   frames = 0;
+    std::string    time_base;
+    bool           thumbnail = false; // Whether the thumbnail has been looked for or generated during this run.
+};
+
+// The id the media scanner gives a file, its path relative to folder without the extension and in upper case.
+std::wstring get_id(const boost::filesystem::path& folder, const boost::filesystem::path& file)
+{
+    auto relative = boost::filesystem::path(file.wstring().substr(folder.wstring().size()));
+    return boost::to_upper_copy(relative.replace_extension().generic_wstring());
+}
+
+std::string format_time(std::time_t time, const char* format = "%Y%m%d%H%M%S")
+{
+    char str[32];
+    std::strftime(str, sizeof(str), format, std::localtime(&time));
+    return str;
+}
+
+bool has_thumbnail(const media_info& info) { return info.type == "MOVIE" || info.type == "STILL"; }
+
+// Fills in type, frames and time base the way the media scanner reports them. Returns false for files without
+// audio or video.
+bool probe(const boost::filesystem::path& file, media_info& info)
+{
+    AVFormatContext* ic = nullptr;
+    if (avformat_open_input(&ic, u8(file.wstring()).c_str(), nullptr, nullptr) < 0) {
+        return false;
+    }
+    CASPAR_SCOPE_EXIT { avformat_close_input(&ic); };
+
+    if (avformat_find_stream_info(ic, nullptr) < 0) {
+        return false;
+    }
+
+    const auto video = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    const auto audio = av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+
+    const std::string format = ic->iformat->name;
+    const auto        still  = video >= 0 && (boost::contains(format, "image2") || boost::ends_with(format, "_pipe"));
+
+    if (still) {
+        info.type      = "STILL";
+        info.frames    = 0;
+        info.time_base = "0/1";
+    } else if (video >= 0) {
+        auto rate = ic->streams[video]->avg_frame_rate;
+        if (rate.num <= 0 || rate.den <= 0) {
+            rate = ic->streams[video]->r_frame_rate;
+        }
+        if (rate.num <= 0 || rate.den <= 0) {
+            rate = AVRational{25, 1};
+        }
+        info.type   = "MOVIE";
+        info.frames = ic->duration != AV_NOPTS_VALUE
+                          ? av_rescale(ic->duration, rate.num, static_cast<int64_t>(rate.den) * AV_TIME_BASE)
+                          : 0;
+        info.time_base = std::to_string(rate.den) + "/" + std::to_string(rate.num);
+    } else if (audio >= 0) {
+        const auto sample_rate = std::max(ic->streams[audio]->codecpar->sample_rate, 1);
+        info.type              = "AUDIO";
+        info.frames    = ic->duration != AV_NOPTS_VALUE ? av_rescale(ic->duration, sample_rate, AV_TIME_BASE) : 0;
+        info.time_base = "1/" + std::to_string(sample_rate);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+class media_index
+{
+    const boost::filesystem::path media_folder_;
+    const boost::filesystem::path template_folder_;
+    const std::string             cache_filename_;
+    const boost::filesystem::path thumbnail_folder_;
+    const int                     thumbnail_width_;
+    const std::chrono::seconds    interval_;
+    tbb::task_arena               arena_;
+
+    mutable std::mutex                 mutex_;
+    std::map<std::wstring, media_info> media_; // By path.
+    std::vector<std::wstring>          templates_;
+    std::condition_variable            cond_;
+    bool                               abort_      = false;
+    bool                               regenerate_ = false;
+    std::thread                        thread_;
+
+  public:
+    media_index()
+        : media_folder_(env::media_folder())
+        , template_folder_(env::template_folder())
+        , cache_filename_(u8(env::data_folder()) + "media-index.txt")
+        , thumbnail_folder_(env::data_folder() + L"thumbnails")
+        , thumbnail_width_(std::max(env::properties().get(L"configuration.amcp.media-server.thumbnail-width", 256), 1))
+        , interval_(std::max(env::properties().get(L"configuration.amcp.media-server.scan-interval", 5), 1))
+        , arena_(std::max(env::properties().get(L"configuration.amcp.media-server.probe-threads", 2), 1))
+    {
+        load();
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[ffmpeg::media_index]");
+            run();
+        });
+    }
+
+    ~media_index()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    std::wstring cls() const
+    {
+        std::wstringstream str;
+        str << L"200 CLS OK\r\n";
+        for (auto& clip : clips()) {
+            str << clip.second << L"\r\n";
+        }
+        str << L"\r\n";
+        return str.str();
+    }
+
+    std::wstring cinf(const std::wstring& name) const
+    {
+        const auto id = boost::to_upper_copy(name);
+        for (auto& clip : clips()) {
+            if (clip.first == id) {
+                return L"201 CINF OK\r\n" + clip.second + L"\r\n";
+            }
+        }
+        return L"404 CINF ERROR\r\n";
+    }
+
+    std::wstring tls() const
+    {
+        std::wstringstream str;
+        str << L"200 TLS OK\r\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& id : templates_) {
+                str << id << L"\r\n";
+            }
+        }
+        str << L"\r\n";
+        return str.str();
+    }
+
+    std::wstring thumbnail_list() const
+    {
+        std::vector<std::pair<std::wstring, boost::filesystem::path>> thumbnails;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& p : media_) {
+                if (has_thumbnail(p.second)) {
+                    thumbnails.emplace_back(get_id(media_folder_, p.first), thumbnail_path(p.first, p.second));
+                }
+            }
+        }
+        std::sort(thumbnails.begin(), thumbnails.end());
+
+        std::wstringstream str;
+        str << L"200 THUMBNAIL LIST OK\r\n";
+        for (auto& thumbnail : thumbnails) {
+            boost::system::error_code ec;
+            const auto                size     = boost::filesystem::file_size(thumbnail.second, ec);
+            const auto                modified = boost::filesystem::last_write_time(thumbnail.second, ec);
+            if (!ec) {
+                str << L"\"" << thumbnail.first << L"\" " << u16(format_time(modified, "%Y%m%dT%H%M%S")) << L" "
+                    << size << L"\r\n";
+            }
+        }
+        str << L"\r\n";
+        return str.str();
+    }
+
+    std::wstring thumbnail_retrieve(const std::wstring& name) const
+    {
+        auto media = find(name);
+        if (media) {
+            boost::filesystem::ifstream file(thumbnail_path(media->first, media->second), std::ios::binary);
+            std::string                 data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (!data.empty()) {
+                return L"201 THUMBNAIL RETRIEVE OK\r\n" + u16(to_base64(data.data(), data.size())) + L"\r\n";
+            }
+        }
+        return L"404 THUMBNAIL RETRIEVE ERROR\r\n";
+    }
+
+    std::wstring thumbnail_generate(const std::wstring& name) const
+    {
+        auto media = find(name);
+        if (!media || !generate_thumbnail(media->first, media->second)) {
+            return L"404 THUMBNAIL GENERATE ERROR\r\n";
+        }
+        return L"202 THUMBNAIL GENERATE OK\r\n";
+    }
+
+    // Thumbnails are regenerated by the next scan, which is started right away.
+    std::wstring thumbnail_generate_all()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            regenerate_ = true;
+        }
+        cond_.notify_all();
+        return L"202 THUMBNAIL GENERATE_ALL OK\r\n";
+    }
+
+  private:
+    // Returns the path and info of the clip with the id name, if it is one that has a thumbnail.
+    boost::optional<std::pair<std::wstring, media_info>> find(const std::wstring& name) const
+    {
+        const auto                  id = boost::to_upper_copy(name);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& p : media_) {
+            if (has_thumbnail(p.second) && get_id(media_folder_, p.first) == id) {
+                return std::make_pair(p.first, p.second);
+            }
+        }
+        return boost::none;
+    }
+
+    // Thumbnails are cached by path, size and modification time, so that changed files get a new one.
+    boost::filesystem::path thumbnail_path(const std::wstring& path, const media_info& info) const
+    {
+        std::ostringstream str;
+        str << u8(path) << "|" << info.size << "|" << static_cast<std::int64_t>(info.modified);
+
+        std::wostringstream filename;
+        filename << std::hex << std::hash<std::string>{}(str.str()) << L".png";
+        return thumbnail_folder_ / filename.str();
+    }
+
+    bool generate_thumbnail(const std::wstring& path, const media_info& info) const
+    {
+        try {
+            const auto png = make_thumbnail(u8(path), thumbnail_width_);
+            if (png.empty()) {
+                CASPAR_LOG(warning) << L"media_index Failed to generate thumbnail for " << path;
+                return false;
+            }
+
+            boost::filesystem::create_directories(thumbnail_folder_);
+            boost::filesystem::ofstream file(thumbnail_path(path, info), std::ios::binary | std::ios::trunc);
+            file.write(png.data(), png.size());
+            return static_cast<bool>(file);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return false;
+        }
+    }
+
+    // Returns the id and CLS line of each clip, sorted by id.
+    std::vector<std::pair<std::wstring, std::wstring>> clips() const
+    {
+        std::vector<std::pair<std::wstring, std::wstring>> clips;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& p : media_) {
+                auto& info = p.second;
+                if (info.type.empty()) {
+                    continue;
+                }
+                auto id = get_id(media_folder_, p.first);
+
+                std::wstringstream line;
+                line << L"\"" << id << L"\" " << u16(info.type) << L" " << info.size << L" "
+                     << u16(format_time(info.modified)) << L" " << info.frames << L" " << u16(info.time_base);
+                clips.emplace_back(std::move(id), line.str());
+            }
+        }
+        std::sort(clips.begin(), clips.end());
+        return clips;
+    }
+
+    void run()
+    {
+        while (true) {
+            try {
+                scan();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (cond_.wait_for(lock, interval_, [&] { return abort_ || regenerate_; }) && abort_) {
+                return;
+            }
+        }
+    }
+
+    bool aborted() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return abort_;
+    }
+
+    void scan()
+    {
+        std::map<std::wstring, media_info> previous;
+        bool                               regenerate;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            previous    = media_;
+            regenerate  = regenerate_;
+            regenerate_ = false;
+        }
+
+        // Files are probed again only if their size or modification time changed. Files that can't be probed are
+        // kept without a type, so that they aren't probed on every scan either.
+        std::map<std::wstring, media_info>                media;
+        std::vector<std::pair<std::wstring, media_info*>> changed;
+        boost::system::error_code                         ec;
+        for (boost::filesystem::recursive_directory_iterator it(media_folder_, ec), end; !ec && it != end;
+             it.increment(ec)) {
+            if (!boost::filesystem::is_regular_file(it->status())) {
+                continue;
+            }
+            const auto path = it->path().wstring();
+
+            media_info info;
+            info.size     = boost::filesystem::file_size(it->path(), ec);
+            info.modified = boost::filesystem::last_write_time(it->path(), ec);
+
+            auto prev = previous.find(path);
+            if (prev != previous.end() && prev->second.size == info.size && prev->second.modified == info.modified) {
+                media.emplace(path, prev->second);
+            } else {
+                changed.emplace_back(path, &media.emplace(path, std::move(info)).first->second);
+            }
+        }
+
+        arena_.execute([&] {
+            tbb::parallel_for(std::size_t{0}, changed.size(), [&](std::size_t n) {
+                if (aborted()) {
+                    return;
+                }
+                auto& info = *changed[n].second;
+                if (!probe(changed[n].first, info)) {
+                    info.type.clear();
+                }
+            });
+        });
+
+        // Missing thumbnails are generated once per run, all of them again after THUMBNAIL GENERATE_ALL.
+        std::vector<std::pair<std::wstring, media_info*>> thumbnails;
+        for (auto& p : media) {
+            auto& info = p.second;
+            if (has_thumbnail(info) && (regenerate || !info.thumbnail)) {
+                info.thumbnail = true;
+                if (regenerate || !boost::filesystem::exists(thumbnail_path(p.first, info), ec)) {
+                    thumbnails.emplace_back(p.first, &info);
+                }
+            }
+        }
+
+        arena_.execute([&] {
+            tbb::parallel_for(std::size_t{0}, thumbnails.size(), [&](std::size_t n) {
+                if (!aborted()) {
+                    generate_thumbnail(thumbnails[n].first, *thumbnails[n].second);
+                }
+            });
+        });
+
+        std::vector<std::wstring> templates;
+        for (boost::filesystem::recursive_directory_iterator it(template_folder_, ec), end; !ec && it != end;
+             it.increment(ec)) {
+            const auto ext = boost::to_lower_copy(it->path().extension().wstring());
+            if (ext == L".ft" || ext == L".wt" || ext == L".ct" || ext == L".html") {
+                templates.push_back(get_id(template_folder_, it->path()));
+            }
+        }
+        std::sort(templates.begin(), templates.end());
+
+        const auto modified = !changed.empty() || media.size() != previous.size();
+        if (!changed.empty()) {
+            CASPAR_LOG(debug) << L"media_index Probed " << changed.size() << L" files.";
+        }
+        if (!thumbnails.empty()) {
+            CASPAR_LOG(debug) << L"media_index Generated " << thumbnails.size() << L" thumbnails.";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            media_     = std::move(media);
+            templates_ = std::move(templates);
+        }
+
+        if (modified) {
+            save();
+        }
+    }
+
+    void load()
+    {
+        std::ifstream file(cache_filename_);
+        if (!file) {
+            return;
+        }
+
+        std::string line;
+        if (!std::getline(file, line) || line != INDEX_MAGIC) {
+            return;
+        }
+
+        std::map<std::wstring, media_info> media;
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields;
+            boost::split(fields, line, boost::is_any_of("\t"));
+            if (fields.size() != 6) {
+                return;
+            }
+
+            try {
+                media_info info;
+                info.size      = std::stoull(fields[1]);
+                info.modified  = static_cast<std::time_t>(std::stoll(fields[2]));
+                info.type      = fields[3];
+                info.frames    = std::stoll(fields[4]);
+                info.time_base = fields[5];
+                media.emplace(u16(fields[0]), std::move(info));
+            } catch (...) {
+                return;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        media_ = std::move(media);
+    }
+
+    void save() const
+    {
+        try {
+            std::ofstream file(cache_filename_, std::ios::trunc);
+            file << INDEX_MAGIC << "\n";
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& p : media_) {
+                auto& info = p.second;
+                file << u8(p.first) << "\t" << info.size << "\t" << static_cast<std::int64_t>(info.modified) << "\t"
+                     << info.type << "\t" << info.frames << "\t" << info.time_base << "\n";
+            }
+        } catch (...) {
+            CASPAR_LOG(warning) << L"media_index Failed to write " << u16(cache_filename_);
+        }
+    }
+};
+
+std::unique_ptr<media_index> g_index;
+
+} // namespace
+
+void init_media_index() { g_index = std::make_unique<media_index>(); }
+
+void uninit_media_index() { g_index.reset(); }
+
+std::wstring cls_command(protocol::amcp::command_context& ctx) { return g_index->cls(); }
+
+std::wstring cinf_command(protocol::amcp::command_context& ctx) { return g_index->cinf(ctx.parameters.at(0)); }
+
+std::wstring tls_command(protocol::amcp::command_context& ctx) { return g_index->tls(); }
+
+std::wstring thumbnail_list_command(protocol::amcp::command_context& ctx) { return g_index->thumbnail_list(); }
+
+std::wstring thumbnail_retrieve_command(protocol::amcp::command_context& ctx)
+{
+    return g_index->thumbnail_retrieve(ctx.parameters.at(0));
+}
+
+std::wstring thumbnail_generate_command(protocol::amcp::command_context& ctx)
+{
+    return g_index->thumbnail_generate(ctx.parameters.at(0));
+}
+
+std::wstring thumbnail_generateall_command(protocol::amcp::command_context& ctx)
+{
+    return g_index->thumbnail_generate_all();
+}
+
+}} // namespace caspar::ffmpeg
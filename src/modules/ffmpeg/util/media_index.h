@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <protocol/amcp/AMCPCommand.h>
+
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Keeps the clips of the media folder and the templates of the template folder in memory, so that CLS, CINF and TLS
+// are answered without asking the media scanner. The folders are rescanned in the background, only new and changed
+// files are probed and the results are cached in the data folder across restarts.
+void init_media_index();
+void uninit_media_index();
+
+std::wstring cls_command(protocol::amcp::command_context& ctx);
+std::wstring cinf_command(protocol::amcp::command_context& ctx);
+std::wstring tls_command(protocol::amcp::command_context& ctx);
+
+// Thumbnails of movies and stills are generated as the index finds the files and are cached in the data folder.
+std::wstring thumbnail_list_command(protocol::amcp::command_context& ctx);
+std::wstring thumbnail_retrieve_command(protocol::amcp::command_context& ctx);
+std::wstring thumbnail_generate_command(protocol::amcp::command_context& ctx);
+std::wstring thumbnail_generateall_command(protocol::amcp::command_context& ctx);
+
+}} // namespace caspar::ffmpeg
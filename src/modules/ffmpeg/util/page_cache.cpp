@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page_cache.h"
+
+#include <common/env.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <vector>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Pages are dropped this far behind the position, so that short seeks back still hit the cache, in steps of
+// STEP_SIZE to keep the calls few.
+const int64_t WINDOW_SIZE = 32 * 1024 * 1024;
+const int64_t STEP_SIZE   = 8 * 1024 * 1024;
+
+// Absolute folders whose files are kept cached, relative ones are under the media folder.
+const std::vector<std::string>& keep_folders()
+{
+    static const auto folders = [] {
+        std::vector<std::string> result;
+        if (auto keep = env::properties().get_child_optional(L"configuration.ffmpeg.page-cache.keep")) {
+            for (auto& xml : *keep) {
+                if (xml.first == L"path") {
+                    const auto path = boost::filesystem::absolute(xml.second.get_value<std::wstring>(),
+                                                                  env::media_folder());
+                    result.push_back(u8(path.lexically_normal().wstring()));
+                }
+            }
+        }
+        return result;
+    }();
+    return folders;
+}
+
+bool keep_cached(const std::string& filename, bool write)
+{
+    static const auto enabled = env::properties().get(L"configuration.ffmpeg.page-cache.drop", true);
+    if (!enabled) {
+        return true;
+    }
+
+    boost::system::error_code     ec;
+    const boost::filesystem::path path(u16(filename));
+    if (!write) {
+        static const auto keep_size =
+            env::properties().get(L"configuration.ffmpeg.page-cache.keep-size", INT64_C(256)) * 1024 * 1024;
+        const auto size = boost::filesystem::file_size(path, ec);
+        if (ec || static_cast<int64_t>(size) < keep_size) {
+            return true;
+        }
+    }
+
+    const auto absolute = u8(boost::filesystem::absolute(path).lexically_normal().wstring());
+    for (auto& folder : keep_folders()) {
+        if (boost::starts_with(absolute, folder)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+CacheWindow::CacheWindow(const std::string& filename, bool write)
+    : write_(write)
+{
+#if !defined(_MSC_VER) && defined(POSIX_FADV_DONTNEED)
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_regular_file(boost::filesystem::path(u16(filename)), ec) ||
+        keep_cached(filename, write)) {
+        return;
+    }
+    // avio doesn't expose its descriptor, another one of the same file will do.
+    fd_ = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ >= 0 && !write_) {
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+}
+
+CacheWindow::~CacheWindow()
+{
+#ifndef _MSC_VER
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+#endif
+}
+
+void CacheWindow::advance(int64_t position)
+{
+#if !defined(_MSC_VER) && defined(POSIX_FADV_DONTNEED)
+    if (fd_ < 0) {
+        return;
+    }
+
+    if (write_) {
+        // Dirty pages can't be dropped. Writeback of each step is started once it has been written, and waited for a
+        // window later, when it is dropped, so that the writer isn't held up by it.
+        if (position < synced_ + STEP_SIZE) {
+            return;
+        }
+#ifdef __linux__
+        ::sync_file_range(fd_, synced_, position - synced_, SYNC_FILE_RANGE_WRITE);
+#endif
+        synced_ = position;
+    }
+
+    const auto end = position - WINDOW_SIZE;
+    if (end < dropped_ + STEP_SIZE) {
+        return;
+    }
+#ifdef __linux__
+    if (write_) {
+        const auto flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+        ::sync_file_range(fd_, dropped_, end - dropped_, flags);
+    }
+#endif
+    ::posix_fadvise(fd_, dropped_, end - dropped_, POSIX_FADV_DONTNEED);
+    dropped_ = end;
+#endif
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Drops the pages of a local file that is streamed through once from the page cache, a window behind where it has
+// been read or written, so that playing and recording long clips doesn't evict what is used again, e.g. stills and
+// templates. Files read that are smaller than ffmpeg.page-cache.keep-size, and any file under the folders of
+// ffmpeg.page-cache.keep, are left cached. Does nothing for other inputs and outputs, or where the system has no such
+// advice, e.g. on Windows.
+class CacheWindow
+{
+  public:
+    CacheWindow(const std::string& filename, bool write);
+    ~CacheWindow();
+
+    CacheWindow(const CacheWindow&) = delete;
+    CacheWindow& operator=(const CacheWindow&) = delete;
+
+    // Called with the position that the file has been read or written up to.
+    void advance(int64_t position);
+
+  private:
+    int     fd_ = -1;
+    bool    write_;
+    int64_t dropped_ = 0;
+    int64_t synced_  = 0;
+};
+
+}} // namespace caspar::ffmpeg
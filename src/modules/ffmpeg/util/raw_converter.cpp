@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "raw_converter.h"
+
+#include "av_assert.h"
+#include "av_util.h"
+#include "raw_format.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// The audio layout of the mixer, so that raw clips usually play without converting their samples.
+const int AUDIO_CHANNELS    = 8;
+const int AUDIO_SAMPLE_RATE = 48000;
+
+std::shared_ptr<AVCodecContext> open_decoder(AVFormatContext* ic, int index)
+{
+    if (index < 0) {
+        return nullptr;
+    }
+
+    auto stream = ic->streams[index];
+    auto codec  = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << msg_info("No decoder for stream."));
+    }
+
+    auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+    FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
+    ctx->pkt_timebase = stream->time_base;
+    FF(avcodec_open2(ctx.get(), codec, nullptr));
+
+    return ctx;
+}
+
+class raw_writer
+{
+    boost::filesystem::ofstream file_;
+    raw_header                  header_;
+    std::vector<std::uint8_t>   buffer_;
+    std::vector<std::int32_t>   audio_;
+
+    SwsContext*                 sws_ = nullptr;
+    std::shared_ptr<SwrContext> swr_;
+
+  public:
+    raw_writer(const boost::filesystem::path& path, int width, int height, AVRational fps)
+        : file_(path, std::ios::binary | std::ios::trunc)
+    {
+        if (!file_) {
+            CASPAR_THROW_EXCEPTION(file_write_error() << file_name_info(path.string()));
+        }
+
+        std::memset(&header_, 0, sizeof(header_));
+        std::memcpy(header_.magic, RAW_MAGIC, sizeof(RAW_MAGIC));
+        header_.version           = RAW_VERSION;
+        header_.width             = width;
+        header_.height            = height;
+        header_.fps_num           = fps.num;
+        header_.fps_den           = fps.den;
+        header_.audio_channels    = AUDIO_CHANNELS;
+        header_.audio_sample_rate = AUDIO_SAMPLE_RATE;
+        header_.frame_stride      = align_page(static_cast<std::uint64_t>(width) * height * 4);
+        header_.video_offset      = align_page(sizeof(raw_header));
+
+        buffer_.resize(header_.video_offset, 0);
+        file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+        buffer_.assign(header_.frame_stride, 0);
+    }
+
+    ~raw_writer() { sws_freeContext(sws_); }
+
+    raw_writer(const raw_writer&) = delete;
+    raw_writer& operator=(const raw_writer&) = delete;
+
+    void write_video(const AVFrame& frame)
+    {
+        sws_ = sws_getCachedContext(sws_,
+                                    frame.width,
+                                    frame.height,
+                                    static_cast<AVPixelFormat>(frame.format),
+                                    header_.width,
+                                    header_.height,
+                                    AV_PIX_FMT_BGRA,
+                                    SWS_BICUBIC,
+                                    nullptr,
+                                    nullptr,
+                                    nullptr);
+        if (!sws_) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << msg_info("Failed to convert video."));
+        }
+
+        uint8_t* data[]     = {buffer_.data()};
+        int      linesize[] = {static_cast<int>(header_.width * 4)};
+        sws_scale(sws_.get(), frame.data, frame.linesize, 0, frame.height, data, linesize);
+
+        file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+        header_.frame_count += 1;
+    }
+
+    void write_audio(const AVFrame* frame)
+    {
+        if (!swr_) {
+            if (!frame) {
+                return;
+            }
+            const auto layout = frame->channel_layout != 0 ? frame->channel_layout
+                                                           : av_get_default_channel_layout(frame->channels);
+            swr_ = std::shared_ptr<SwrContext>(swr_alloc_set_opts(nullptr,
+                                                                  av_get_default_channel_layout(AUDIO_CHANNELS),
+                                                                  AV_SAMPLE_FMT_S32,
+                                                                  AUDIO_SAMPLE_RATE,
+                                                                  layout,
+                                                                  static_cast<AVSampleFormat>(frame->format),
+                                                                  frame->sample_rate,
+                                                                  0,
+                                                                  nullptr),
+                                               [](SwrContext* ptr) { swr_free(&ptr); });
+            if (!swr_) {
+                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << msg_info("Failed to convert audio."));
+            }
+            FF(swr_init(swr_.get()));
+        }
+
+        const auto in_samples = frame ? frame->nb_samples : 0;
+        const auto capacity   = swr_get_out_samples(swr_.get(), in_samples);
+        if (capacity <= 0) {
+            return;
+        }
+
+        const auto offset = audio_.size();
+        audio_.resize(offset + static_cast<std::size_t>(capacity) * AUDIO_CHANNELS);
+
+        uint8_t* out[] = {reinterpret_cast<uint8_t*>(audio_.data() + offset)};
+        auto     count = swr_convert(swr_.get(),
+                                 out,
+                                 capacity,
+                                 frame ? const_cast<const uint8_t**>(frame->extended_data) : nullptr,
+                                 in_samples);
+        FF_RET(count, "swr_convert");
+
+        audio_.resize(offset + static_cast<std::size_t>(count) * AUDIO_CHANNELS);
+    }
+
+    // Appends the audio after the frames and fills in the header.
+    void close()
+    {
+        write_audio(nullptr);
+
+        header_.audio_offset  = header_.video_offset + header_.frame_count * header_.frame_stride;
+        header_.audio_samples = audio_.size() / AUDIO_CHANNELS;
+
+        file_.write(reinterpret_cast<const char*>(audio_.data()), audio_.size() * sizeof(std::int32_t));
+        file_.seekp(0);
+        file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+        file_.close();
+
+        if (!file_) {
+            CASPAR_THROW_EXCEPTION(file_write_error() << msg_info("Failed to write raw clip."));
+        }
+    }
+
+    std::uint64_t frame_count() const { return header_.frame_count; }
+};
+
+class raw_converter
+{
+    std::atomic<bool> abort_request_{false};
+    executor          executor_{L"ffmpeg::raw_converter"};
+
+  public:
+    ~raw_converter() { abort_request_ = true; }
+
+    std::wstring convert(const protocol::amcp::command_context& ctx)
+    {
+        const auto name = ctx.parameters.at(0);
+
+        auto source = find_case_insensitive(env::media_folder() + name);
+        if (!source || !boost::filesystem::is_regular_file(*source)) {
+            source.reset();
+            for (auto& file : find_stem_case_insensitive(env::media_folder() + name)) {
+                if (!boost::iequals(boost::filesystem::path(file).extension().wstring(), RAW_EXTENSION)) {
+                    source = file;
+                    break;
+                }
+            }
+        }
+        if (!source) {
+            return L"404 RAW CONVERT ERROR\r\n";
+        }
+
+        auto target = ctx.parameters.size() > 1 ? ctx.parameters.at(1)
+                                                : boost::filesystem::path(name).replace_extension().wstring();
+        if (target.empty() || boost::contains(target, L"..")) {
+            return L"403 RAW CONVERT ERROR\r\n";
+        }
+        auto path = boost::filesystem::path(env::media_folder() + target + RAW_EXTENSION);
+
+        auto client = std::weak_ptr<IO::client_connection<wchar_t>>(ctx.client);
+        executor_.begin_invoke([=] {
+            auto result = L"202 RAW CONVERT " + name + L" DONE\r\n";
+            try {
+                convert_file(u8(*source), path);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                result = L"404 RAW CONVERT " + name + L" FAILED\r\n";
+            }
+            if (auto connection = client.lock()) {
+                connection->send(std::move(result));
+            }
+        });
+
+        return L"202 RAW CONVERT OK\r\n";
+    }
+
+  private:
+    // Written next to the target and renamed once complete, so that a partial clip is never played.
+    void convert_file(const std::string& filename, const boost::filesystem::path& path)
+    {
+        AVFormatContext* ic = nullptr;
+        FF(avformat_open_input(&ic, filename.c_str(), nullptr, nullptr));
+        CASPAR_SCOPE_EXIT { avformat_close_input(&ic); };
+
+        FF(avformat_find_stream_info(ic, nullptr));
+
+        const auto video_index = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        const auto audio_index = av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, video_index, nullptr, 0);
+        if (video_index < 0) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << msg_info("No video stream."));
+        }
+        for (auto n = 0U; n < ic->nb_streams; ++n) {
+            const auto index        = static_cast<int>(n);
+            ic->streams[n]->discard = index == video_index || index == audio_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+
+        auto video = open_decoder(ic, video_index);
+        auto audio = open_decoder(ic, audio_index);
+
+        auto fps = av_guess_frame_rate(ic, ic->streams[video_index], nullptr);
+        if (fps.num <= 0 || fps.den <= 0) {
+            fps = AVRational{25, 1};
+        }
+
+        auto tmp = path;
+        tmp += L".tmp";
+        CASPAR_SCOPE_EXIT
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(tmp, ec);
+        };
+
+        raw_writer writer(tmp, video->width, video->height, fps);
+
+        auto frame = alloc_frame();
+        auto drain = [&](AVCodecContext* ctx) {
+            while (avcodec_receive_frame(ctx, frame.get()) == 0) {
+                if (ctx == video.get()) {
+                    writer.write_video(*frame);
+                } else {
+                    writer.write_audio(frame.get());
+                }
+                av_frame_unref(frame.get());
+            }
+        };
+
+        auto packet = alloc_packet();
+        while (!abort_request_) {
+            auto ret = av_read_frame(ic, packet.get());
+            if (ret == AVERROR_EOF) {
+                break;
+            }
+            FF_RET(ret, "av_read_frame");
+            CASPAR_SCOPE_EXIT { av_packet_unref(packet.get()); };
+
+            auto ctx = packet->stream_index == video_index ? video.get()
+                       : packet->stream_index == audio_index ? audio.get() : nullptr;
+            if (ctx) {
+                FF(avcodec_send_packet(ctx, packet.get()));
+                drain(ctx);
+            }
+        }
+
+        if (abort_request_) {
+            CASPAR_THROW_EXCEPTION(operation_failed() << msg_info("Conversion aborted."));
+        }
+
+        for (auto& ctx : {video, audio}) {
+            if (ctx) {
+                avcodec_send_packet(ctx.get(), nullptr);
+                drain(ctx.get());
+            }
+        }
+
+        writer.close();
+        boost::filesystem::rename(tmp, path);
+
+        CASPAR_LOG(info) << L"raw_converter Converted " << u16(filename) << L" to " << path.wstring() << L" ("
+                         << writer.frame_count() << L" frames).";
+    }
+};
+
+std::unique_ptr<raw_converter> g_converter;
+
+} // namespace
+
+void init_raw_converter() { g_converter = std::make_unique<raw_converter>(); }
+
+void uninit_raw_converter() { g_converter.reset(); }
+
+std::wstring raw_convert_command(protocol::amcp::command_context& ctx) { return g_converter->convert(ctx); }
+
+}} // namespace caspar::ffmpeg
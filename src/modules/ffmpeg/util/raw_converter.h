@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <protocol/amcp/AMCPCommand.h>
+
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// RAW CONVERT <clip> [<name>] decodes a clip of the media folder into an uncompressed raw clip (see raw_format.h)
+// next to it, one conversion at a time in the background. The client is told once the conversion is done.
+void init_raw_converter();
+void uninit_raw_converter();
+
+std::wstring raw_convert_command(protocol::amcp::command_context& ctx);
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace caspar { namespace ffmpeg {
+
+// Layout of the uncompressed clips played by the raw producer, in native (little endian) byte order:
+//
+//   raw_header         at offset 0
+//   video frames       frame_count frames of width * height BGRA pixels, top down, every frame_stride bytes from
+//                      video_offset, so that every frame starts on a page
+//   audio samples      audio_samples interleaved 32 bit samples of audio_channels channels from audio_offset
+//
+// Frames are mapped as they are played instead of being read and decoded.
+struct raw_header
+{
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t fps_num;
+    std::uint32_t fps_den;
+    std::uint32_t audio_channels;
+    std::uint32_t audio_sample_rate;
+    std::uint32_t reserved;
+    std::uint64_t frame_count;
+    std::uint64_t frame_stride;
+    std::uint64_t video_offset;
+    std::uint64_t audio_offset;
+    std::uint64_t audio_samples;
+};
+
+static const char          RAW_MAGIC[8]    = {'C', 'A', 'S', 'P', 'R', 'A', 'W', '\0'};
+static const std::uint32_t RAW_VERSION     = 1;
+static const std::uint64_t RAW_PAGE_SIZE   = 4096;
+static const wchar_t       RAW_EXTENSION[] = L".ccr";
+
+inline bool is_valid(const raw_header& header)
+{
+    return std::memcmp(header.magic, RAW_MAGIC, sizeof(RAW_MAGIC)) == 0 && header.version == RAW_VERSION &&
+           header.width > 0 && header.height > 0 && header.fps_num > 0 && header.fps_den > 0 &&
+           header.frame_stride >= static_cast<std::uint64_t>(header.width) * header.height * 4;
+}
+
+inline std::uint64_t align_page(std::uint64_t size)
+{
+    return (size + RAW_PAGE_SIZE - 1) / RAW_PAGE_SIZE * RAW_PAGE_SIZE;
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snappy.h"
+
+#include <cstring>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// The length is a little endian base 128 varint of at most 32 bits.
+const std::uint8_t* read_varint(const std::uint8_t* ptr, const std::uint8_t* end, std::size_t& value)
+{
+    value = 0;
+    for (auto shift = 0; shift < 35 && ptr < end; shift += 7) {
+        const auto byte = *ptr++;
+        value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return ptr;
+        }
+    }
+    return nullptr;
+}
+
+std::uint32_t read_le(const std::uint8_t* ptr, int count)
+{
+    std::uint32_t value = 0;
+    for (auto n = 0; n < count; ++n) {
+        value |= static_cast<std::uint32_t>(ptr[n]) << (8 * n);
+    }
+    return value;
+}
+
+} // namespace
+
+bool snappy_uncompressed_length(const std::uint8_t* src, std::size_t size, std::size_t& length)
+{
+    return read_varint(src, src + size, length) != nullptr;
+}
+
+bool snappy_uncompress(const std::uint8_t* src, std::size_t size, std::uint8_t* dst, std::size_t length)
+{
+    const auto end = src + size;
+
+    std::size_t expected = 0;
+    src                  = read_varint(src, end, expected);
+    if (!src || expected != length) {
+        return false;
+    }
+
+    std::size_t pos = 0;
+    while (src < end) {
+        const auto tag = *src++;
+
+        std::size_t len    = 0;
+        std::size_t offset = 0;
+        switch (tag & 0x03) {
+            case 0: { // literal, lengths above 60 follow in 1 to 4 bytes
+                len = tag >> 2;
+                if (len >= 60) {
+                    const auto count = static_cast<int>(len) - 59;
+                    if (end - src < count) {
+                        return false;
+                    }
+                    len = read_le(src, count);
+                    src += count;
+                }
+                len += 1;
+                if (static_cast<std::size_t>(end - src) < len || length - pos < len) {
+                    return false;
+                }
+                std::memcpy(dst + pos, src, len);
+                src += len;
+                pos += len;
+                continue;
+            }
+            case 1: // copy of 4 to 11 bytes with an 11 bit offset
+                if (end - src < 1) {
+                    return false;
+                }
+                len    = ((tag >> 2) & 0x07) + 4;
+                offset = static_cast<std::size_t>(tag >> 5) << 8 | *src++;
+                break;
+            case 2: // copy with a 16 bit offset
+                if (end - src < 2) {
+                    return false;
+                }
+                len    = (tag >> 2) + 1;
+                offset = read_le(src, 2);
+                src += 2;
+                break;
+            default: // copy with a 32 bit offset
+                if (end - src < 4) {
+                    return false;
+                }
+                len    = (tag >> 2) + 1;
+                offset = read_le(src, 4);
+                src += 4;
+                break;
+        }
+
+        if (offset == 0 || offset > pos || length - pos < len) {
+            return false;
+        }
+
+        // Copies may overlap their own output, e.g. to repeat a run of bytes.
+        if (offset >= len) {
+            std::memcpy(dst + pos, dst + pos - offset, len);
+        } else {
+            for (std::size_t n = 0; n < len; ++n) {
+                dst[pos + n] = dst[pos + n - offset];
+            }
+        }
+        pos += len;
+    }
+
+    return pos == length;
+}
+
+}} // namespace caspar::ffmpeg
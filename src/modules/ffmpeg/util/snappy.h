@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caspar { namespace ffmpeg {
+
+// Decompression of the raw snappy format (without the framing of the snappy stream format), as used by HAP.
+
+// Reads the uncompressed length from the start of src.
+bool snappy_uncompressed_length(const std::uint8_t* src, std::size_t size, std::size_t& length);
+
+// Decompresses src into the length bytes at dst. Returns false if src is corrupt or doesn't fill dst exactly.
+bool snappy_uncompress(const std::uint8_t* src, std::size_t size, std::uint8_t* dst, std::size_t length);
+
+}} // namespace caspar::ffmpeg
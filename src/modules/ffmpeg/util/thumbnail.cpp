@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnail.h"
+
+#include "av_util.h"
+
+#include <common/scope_exit.h>
+
+#include <algorithm>
+#include <memory>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+std::shared_ptr<AVCodecContext> alloc_context(const AVCodec* codec)
+{
+    return std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                           [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+}
+
+std::shared_ptr<AVFrame> decode_frame(AVFormatContext* ic, int index)
+{
+    auto stream = ic->streams[index];
+    auto codec  = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        return nullptr;
+    }
+
+    auto ctx = alloc_context(codec);
+    if (!ctx || avcodec_parameters_to_context(ctx.get(), stream->codecpar) < 0) {
+        return nullptr;
+    }
+    ctx->pkt_timebase = stream->time_base;
+    if (avcodec_open2(ctx.get(), codec, nullptr) < 0) {
+        return nullptr;
+    }
+
+    if (ic->duration != AV_NOPTS_VALUE && ic->duration > 0) {
+        auto ts = ic->duration / 10;
+        if (ic->start_time != AV_NOPTS_VALUE) {
+            ts += ic->start_time;
+        }
+        avformat_seek_file(ic, -1, INT64_MIN, ts, ts, 0);
+    }
+
+    auto packet = alloc_packet();
+    auto frame  = alloc_frame();
+    auto eof    = false;
+    while (true) {
+        auto ret = avcodec_receive_frame(ctx.get(), frame.get());
+        if (ret == 0) {
+            return frame;
+        }
+        if (ret != AVERROR(EAGAIN) || eof) {
+            return nullptr;
+        }
+
+        ret = av_read_frame(ic, packet.get());
+        if (ret == AVERROR_EOF) {
+            eof = true;
+            avcodec_send_packet(ctx.get(), nullptr);
+            continue;
+        }
+        if (ret < 0) {
+            return nullptr;
+        }
+        CASPAR_SCOPE_EXIT { av_packet_unref(packet.get()); };
+
+        if (packet->stream_index == index && avcodec_send_packet(ctx.get(), packet.get()) < 0) {
+            return nullptr;
+        }
+    }
+}
+
+std::string encode_png(const AVFrame& frame, int width)
+{
+    auto aspect = static_cast<double>(frame.width) / static_cast<double>(frame.height);
+    if (frame.sample_aspect_ratio.num > 0 && frame.sample_aspect_ratio.den > 0) {
+        aspect *= av_q2d(frame.sample_aspect_ratio);
+    }
+    const auto height = std::max(static_cast<int>(width / aspect + 0.5), 1);
+
+    auto sws = std::shared_ptr<SwsContext>(sws_getContext(frame.width,
+                                                          frame.height,
+                                                          static_cast<AVPixelFormat>(frame.format),
+                                                          width,
+                                                          height,
+                                                          AV_PIX_FMT_RGB24,
+                                                          SWS_BICUBIC,
+                                                          nullptr,
+                                                          nullptr,
+                                                          nullptr),
+                                           [](SwsContext* ptr) { sws_freeContext(ptr); });
+    if (!sws) {
+        return {};
+    }
+
+    auto scaled    = alloc_frame();
+    scaled->format = AV_PIX_FMT_RGB24;
+    scaled->width  = width;
+    scaled->height = height;
+    if (av_frame_get_buffer(scaled.get(), 32) < 0) {
+        return {};
+    }
+    sws_scale(sws.get(), frame.data, frame.linesize, 0, frame.height, scaled->data, scaled->linesize);
+
+    auto codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        return {};
+    }
+    auto ctx = alloc_context(codec);
+    if (!ctx) {
+        return {};
+    }
+    ctx->width     = width;
+    ctx->height    = height;
+    ctx->pix_fmt   = AV_PIX_FMT_RGB24;
+    ctx->time_base = AVRational{1, 25};
+    if (avcodec_open2(ctx.get(), codec, nullptr) < 0 || avcodec_send_frame(ctx.get(), scaled.get()) < 0) {
+        return {};
+    }
+
+    auto packet = alloc_packet();
+    if (avcodec_receive_packet(ctx.get(), packet.get()) < 0) {
+        return {};
+    }
+    CASPAR_SCOPE_EXIT { av_packet_unref(packet.get()); };
+
+    return std::string(reinterpret_cast<const char*>(packet->data), packet->size);
+}
+
+} // namespace
+
+std::string make_thumbnail(const std::string& filename, int width)
+{
+    AVFormatContext* ic = nullptr;
+    if (avformat_open_input(&ic, filename.c_str(), nullptr, nullptr) < 0) {
+        return {};
+    }
+    CASPAR_SCOPE_EXIT { avformat_close_input(&ic); };
+
+    if (avformat_find_stream_info(ic, nullptr) < 0) {
+        return {};
+    }
+
+    const auto index = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (index < 0) {
+        return {};
+    }
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        ic->streams[n]->discard = static_cast<int>(n) == index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    auto frame = decode_frame(ic, index);
+    if (!frame || frame->width <= 0 || frame->height <= 0) {
+        return {};
+    }
+
+    return encode_png(*frame, width);
+}
+
+}} // namespace caspar::ffmpeg
@@ -181,7 +181,7 @@ class flash_renderer
 
     CComObject<caspar::flash::FlashAxContainer>* ax_ = nullptr;
     core::draw_frame                             head_;
-    bitmap                                       bmp_{width_, height_};
+    std::vector<std::shared_ptr<bitmap>>         bitmaps_;
     prec_timer                                   timer_;
     caspar::timer                                tick_timer_;
 
@@ -197,7 +197,6 @@ class flash_renderer
         , width_(width)
         , height_(height)
         , frame_factory_(frame_factory)
-        , bmp_(width, height)
         , graph_(graph)
     {
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
@@ -290,13 +289,15 @@ class flash_renderer
         if (ax_->InvalidRect()) {
             core::pixel_format_desc desc = core::pixel_format::bgra;
             desc.planes.push_back(core::pixel_format_desc::plane(width_, height_, 4));
-            auto frame = frame_factory_->create_frame(this, desc);
 
-            std::memset(bmp_.data(), 0, width_ * height_ * 4);
-            ax_->DrawControl(bmp_);
+            auto bmp = take_bitmap();
+            std::memset(bmp->data(), 0, width_ * height_ * 4);
+            ax_->DrawControl(*bmp);
 
-            std::memcpy(frame.image_data(0).begin(), bmp_.data(), width_ * height_ * 4);
-            head_ = core::draw_frame(std::move(frame));
+            // The bitmap is the frame, it returns to the pool once the frame has been uploaded and released.
+            std::vector<array<std::uint8_t>> image_data;
+            image_data.emplace_back(bmp->data(), static_cast<std::size_t>(desc.planes[0].size), bmp);
+            head_ = core::draw_frame(core::mutable_frame(this, std::move(image_data), array<std::int32_t>{}, desc));
         }
 
         MSG msg;
@@ -317,6 +318,18 @@ class flash_renderer
         return head_;
     }
 
+    // Returns a bitmap that no frame refers to anymore, or a new one if all of them are still in flight.
+    std::shared_ptr<bitmap> take_bitmap()
+    {
+        for (auto& bmp : bitmaps_) {
+            if (bmp.use_count() == 1) {
+                return bmp;
+            }
+        }
+        bitmaps_.push_back(std::make_shared<bitmap>(width_, height_));
+        return bitmaps_.back();
+    }
+
     bool is_empty() const { return ax_->IsEmpty(); }
 
     double fps() const { return ax_->GetFPS(); }
@@ -95,6 +95,36 @@ class remove_handler : public CefV8Handler
     IMPLEMENT_REFCOUNTING(remove_handler);
 };
 
+// Tells the browser process that the page waits for an animation frame, so that it keeps ticking when paced on
+// demand.
+class animation_frame_handler : public CefV8Handler
+{
+    CefRefPtr<CefBrowser> browser_;
+
+  public:
+    explicit animation_frame_handler(const CefRefPtr<CefBrowser>& browser)
+        : browser_(browser)
+    {
+    }
+
+    bool Execute(const CefString&       name,
+                 CefRefPtr<CefV8Value>  object,
+                 const CefV8ValueList&  arguments,
+                 CefRefPtr<CefV8Value>& retval,
+                 CefString&             exception) override
+    {
+        if (!CefCurrentlyOn(TID_RENDERER)) {
+            return false;
+        }
+
+        browser_->SendProcessMessage(PID_BROWSER, CefProcessMessage::Create(ANIMATION_FRAME_MESSAGE_NAME));
+
+        return true;
+    }
+
+    IMPLEMENT_REFCOUNTING(animation_frame_handler);
+};
+
 class renderer_application
     : public CefApp
     , CefRenderProcessHandler
@@ -122,17 +152,49 @@ class renderer_application
 
         window->SetValue(
             "remove", CefV8Value::CreateFunction("remove", new remove_handler(browser)), V8_PROPERTY_ATTRIBUTE_NONE);
+        window->SetValue("casparAnimationFrameRequested",
+                         CefV8Value::CreateFunction("casparAnimationFrameRequested",
+                                                    new animation_frame_handler(browser)),
+                         V8_PROPERTY_ATTRIBUTE_DONTENUM);
 
         CefRefPtr<CefV8Value>     ret;
         CefRefPtr<CefV8Exception> exception;
         bool                      injected = context->Eval(R"(
 			var requestedAnimationFrames	= {};
 			var currentAnimationFrameId		= 0;
+			var animationFrameRequested		= false;
+
+            window.caspar = { data: {} };
+
+			function casparMergePatch(target, patch) {
+				if (patch === null || typeof patch !== 'object' || Array.isArray(patch))
+					return patch;
+				if (target === null || typeof target !== 'object' || Array.isArray(target))
+					target = {};
+				for (var key in patch) {
+					if (!patch.hasOwnProperty(key))
+						continue;
+					if (patch[key] === null)
+						delete target[key];
+					else
+						target[key] = casparMergePatch(target[key], patch[key]);
+				}
+				return target;
+			}
 
-            window.caspar = {};
+			function casparData(json) {
+				var patch = JSON.parse(json);
+				window.caspar.data = casparMergePatch(window.caspar.data, patch);
+				if (typeof window.caspar.ondata === 'function')
+					window.caspar.ondata(window.caspar.data, patch);
+			}
 
 			window.requestAnimationFrame = function(callback) {
 				requestedAnimationFrames[++currentAnimationFrameId] = callback;
+				if (!animationFrameRequested) {
+					animationFrameRequested = true;
+					window.casparAnimationFrameRequested();
+				}
 				return currentAnimationFrameId;
 			}
 
@@ -144,6 +206,7 @@ class renderer_application
 				var requestedFrames = requestedAnimationFrames;
 				var timestamp = performance.now();
 				requestedAnimationFrames = {};
+				animationFrameRequested = false;
 
 				for (var animationFrameId in requestedFrames)
 					if (requestedFrames.hasOwnProperty(animationFrameId))
@@ -212,6 +275,22 @@ class renderer_application
 
             return true;
         }
+        if (message->GetName().ToString() == DATA_MESSAGE_NAME) {
+            // Handed to the page as it is, without building and evaluating a script for it.
+            auto data = message->GetArgumentList()->GetString(0);
+            for (auto& context : contexts_) {
+                if (!context->Enter()) {
+                    continue;
+                }
+                auto function = context->GetGlobal()->GetValue("casparData");
+                if (function != nullptr && function->IsFunction()) {
+                    function->ExecuteFunction(nullptr, {CefV8Value::CreateString(data)});
+                }
+                context->Exit();
+            }
+
+            return true;
+        }
         return false;
     }
 
@@ -276,6 +355,7 @@ void init(core::module_dependencies dependencies)
 
 void uninit()
 {
+    clear_browser_pool();
     invoke([] { CefQuitMessageLoop(); });
     g_cef_executor->begin_invoke([&] { CefShutdown(); });
     g_cef_executor.reset();
@@ -29,9 +29,11 @@
 
 namespace caspar { namespace html {
 
-const std::string TICK_MESSAGE_NAME   = "CasparCGTick";
-const std::string REMOVE_MESSAGE_NAME = "CasparCGRemove";
-const std::string LOG_MESSAGE_NAME    = "CasparCGLog";
+const std::string TICK_MESSAGE_NAME            = "CasparCGTick";
+const std::string REMOVE_MESSAGE_NAME          = "CasparCGRemove";
+const std::string LOG_MESSAGE_NAME             = "CasparCGLog";
+const std::string ANIMATION_FRAME_MESSAGE_NAME = "CasparCGAnimationFrame";
+const std::string DATA_MESSAGE_NAME            = "CasparCGData";
 
 bool              intercept_command_line(int argc, char** argv);
 void              init(core::module_dependencies dependencies);
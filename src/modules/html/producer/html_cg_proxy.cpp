@@ -80,4 +80,8 @@ std::wstring html_cg_proxy::invoke(int layer, const std::wstring& label)
     return impl_->producer->call({javascript}).get();
 }
 
+void html_cg_proxy::begin_batch() { impl_->producer->call({L"[BATCH]", L"BEGIN"}); }
+
+void html_cg_proxy::commit_batch() { impl_->producer->call({L"[BATCH]", L"COMMIT"}); }
+
 }} // namespace caspar::html
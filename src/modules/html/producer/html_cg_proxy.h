@@ -44,6 +44,10 @@ class html_cg_proxy : public core::cg_proxy
     void         next(int layer) override;
     void         update(int layer, const std::wstring& data) override;
     std::wstring invoke(int layer, const std::wstring& label) override;
+    void         begin_batch() override;
+    void         commit_batch() override;
+    void         begin_batch() override;
+    void         commit_batch() override;
 
   private:
     struct impl;
@@ -21,6 +21,8 @@
 
 #include "html_producer.h"
 
+#include <core/diagnostics/call_context.h>
+#include <core/diagnostics/memory.h>
 #include <core/video_format.h>
 
 #include <core/frame/draw_frame.h>
@@ -40,11 +42,14 @@
 #include <common/os/filesystem.h>
 #include <common/timer.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <boost/range/algorithm/find_if.hpp>
 #include <boost/regex.hpp>
 
 #include <tbb/concurrent_queue.h>
@@ -59,8 +64,13 @@
 #include <include/cef_render_handler.h>
 #pragma warning(pop)
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <list>
 #include <queue>
 #include <utility>
+#include <vector>
 
 #include "../html.h"
 
@@ -91,14 +101,38 @@ class html_client
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
     bool                                 shared_texture_enable_;
+    const bool                           adaptive_frame_rate_;
     tbb::concurrent_queue<std::wstring>  javascript_before_load_;
+    tbb::concurrent_queue<std::wstring>  data_before_load_;
     std::atomic<bool>                    loaded_;
+
+    // Javascript called since the last tick, executed in one go by the next one, or held back until the batch of
+    // CG BATCH is committed. An update() replaces those queued before it, so only the last data reaches the template.
+    const bool                batch_javascript_ = env::properties().get(L"configuration.html.batch-javascript", true);
+    std::vector<std::wstring> javascript_batch_;
+    bool                      javascript_held_ = false;
+    std::mutex                javascript_batch_mutex_;
+
     std::queue<core::draw_frame>         frames_;
+    caspar::timer                        taken_timer_;
     mutable std::mutex                   frames_mutex_;
+    const std::int64_t                   buffer_budget_ =
+        env::properties().get(L"configuration.html.buffer-budget", std::int64_t(256)) * 1024 * 1024;
+
+    // Paints are charged to the layer that loaded the page, only touched on the UI thread.
+    core::diagnostics::call_context                    owner_;
+    std::shared_ptr<core::diagnostics::memory_account> memory_;
 
     core::draw_frame   last_frame_;
     mutable std::mutex last_frame_mutex_;
 
+    core::const_frame last_paint_;
+
+    // With an adaptive frame rate the page is only ticked while it shows activity, and polled about once a second
+    // while idle, to pick up changes that don't request animation frames, e.g. timers.
+    std::atomic<int> active_ticks_{0};
+    int              idle_ticks_ = 0;
+
     CefRefPtr<CefBrowser> browser_;
 
 #ifdef WIN32
@@ -113,12 +147,17 @@ class html_client
                 const spl::shared_ptr<diagnostics::graph>& graph,
                 core::video_format_desc                    format_desc,
                 bool                                       shared_texture_enable,
-                std::wstring                               url)
+                bool                                       adaptive_frame_rate,
+                std::wstring                               url,
+                const core::diagnostics::call_context&     owner)
         : url_(std::move(url))
         , graph_(graph)
         , frame_factory_(std::move(frame_factory))
         , format_desc_(std::move(format_desc))
         , shared_texture_enable_(shared_texture_enable)
+        , adaptive_frame_rate_(adaptive_frame_rate)
+        , owner_(owner)
+        , memory_(core::diagnostics::memory_account::for_owner(owner))
 #ifdef WIN32
         , d3d_device_(accelerator::d3d::d3d_device::get_device())
 #endif
@@ -152,6 +191,48 @@ class html_client
         });
     }
 
+    // Loads url in the browser of a pooled client, which then paints into frame_factory. Must be called on the ui
+    // thread, returns false if the browser has been closed in the meantime.
+    bool load(const spl::shared_ptr<core::frame_factory>& frame_factory,
+              const std::wstring&                         url,
+              const core::diagnostics::call_context&      owner)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        if (browser_ == nullptr) {
+            return false;
+        }
+
+        frame_factory_ = frame_factory;
+        url_           = url;
+        owner_         = owner;
+        memory_        = core::diagnostics::memory_account::for_owner(owner);
+        reset();
+        graph_->set_text(print());
+
+        browser_->GetMainFrame()->LoadURL(url_);
+        return true;
+    }
+
+    // Clears the page so that the client can be pooled, returns false if there is no browser to keep.
+    bool unload()
+    {
+        auto result = false;
+        html::invoke([&] {
+            if (browser_ == nullptr) {
+                return;
+            }
+
+            url_ = L"about:blank";
+            reset();
+            graph_->set_text(print());
+
+            browser_->GetMainFrame()->LoadURL(url_);
+            result = true;
+        });
+        return result;
+    }
+
     core::draw_frame receive()
     {
         auto frame = last_frame();
@@ -167,14 +248,46 @@ class html_client
 
     void execute_javascript(const std::wstring& javascript)
     {
+        set_active();
+
         if (!loaded_) {
             javascript_before_load_.push(javascript);
+        } else {
+            std::lock_guard<std::mutex> lock(javascript_batch_mutex_);
+            if (!batch_javascript_ && !javascript_held_) {
+                execute_queued_javascript();
+                do_execute_javascript(javascript);
+                return;
+            }
+            if (is_update(javascript)) {
+                javascript_batch_.erase(
+                    std::remove_if(javascript_batch_.begin(), javascript_batch_.end(), &html_client::is_update),
+                    javascript_batch_.end());
+            }
+            javascript_batch_.push_back(javascript);
+        }
+    }
+
+    // Hands data of the DATA protocol to window.caspar of the page, with a process message instead of javascript.
+    void send_data(const std::wstring& data)
+    {
+        set_active();
+
+        if (!loaded_) {
+            data_before_load_.push(data);
         } else {
             execute_queued_javascript();
-            do_execute_javascript(javascript);
+            do_send_data(data);
         }
     }
 
+    // Holds javascript back until it is called again with false, which commits the batch.
+    void hold_javascript(bool hold)
+    {
+        std::lock_guard<std::mutex> lock(javascript_batch_mutex_);
+        javascript_held_ = hold;
+    }
+
     bool OnBeforePopup(CefRefPtr<CefBrowser>   browser,
                        CefRefPtr<CefFrame>     frame,
                        const CefString&        target_url,
@@ -200,6 +313,32 @@ class html_client
     }
 
   private:
+    void reset()
+    {
+        loaded_     = false;
+        last_paint_ = core::const_frame{};
+
+        std::wstring javascript;
+        while (javascript_before_load_.try_pop(javascript)) {
+        }
+        while (data_before_load_.try_pop(javascript)) {
+        }
+        {
+            std::lock_guard<std::mutex> lock(javascript_batch_mutex_);
+            javascript_batch_.clear();
+            javascript_held_ = false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(frames_mutex_);
+            frames_ = std::queue<core::draw_frame>();
+        }
+        {
+            std::lock_guard<std::mutex> lock(last_frame_mutex_);
+            last_frame_ = core::draw_frame{};
+        }
+    }
+
     void GetViewRect(CefRefPtr<CefBrowser> browser, CefRect& rect) override
     {
         CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
@@ -224,23 +363,53 @@ class html_client
         if (type != PET_VIEW)
             return;
 
+        set_active();
+
         core::pixel_format_desc pixel_desc;
         pixel_desc.format = core::pixel_format::bgra;
         pixel_desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
 
-        auto frame = frame_factory_->create_frame(this, pixel_desc);
-        auto src   = (char*)buffer;
-        auto dst   = reinterpret_cast<char*>(frame.image_data(0).begin());
-        std::memcpy(dst, src, width * height * 4);
-
-        {
-            std::lock_guard<std::mutex> lock(frames_mutex_);
+        // Only the dirty parts of the view are copied and uploaded, the rest is taken from the previous paint.
+        std::vector<core::image_region> dirty;
+        for (auto& rect : dirtyRects) {
+            dirty.push_back(core::image_region{rect.x, rect.y, rect.width, rect.height});
+        }
 
-            frames_.push(core::draw_frame(std::move(frame)));
-            while (frames_.size() > 8) {
-                frames_.pop();
-                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        if (!dirty.empty() || !last_paint_) {
+            core::diagnostics::scoped_call_context context(owner_.video_channel, owner_.layer);
+
+            auto frame = frame_factory_->create_frame(this, pixel_desc, last_paint_, dirty);
+            auto src   = reinterpret_cast<const char*>(buffer);
+            auto dst   = reinterpret_cast<char*>(frame.image_data(0).begin());
+            for (auto& region : dirty) {
+                tbb::parallel_for(region.y, region.y + region.height, [&](int y) {
+                    const auto offset = (static_cast<std::size_t>(y) * width + region.x) * 4;
+                    std::memcpy(dst + offset, src + offset, region.width * 4);
+                });
             }
+            last_paint_ = core::const_frame(std::move(frame));
+        }
+
+        push_frame(core::draw_frame(last_paint_));
+    }
+
+    // Keeps up to 8 paints for the ticks ahead, as many as fit the buffer budget. Only the last one is kept while
+    // the layer is over its memory cap, or under memory pressure while nothing takes them, e.g. in the background.
+    void push_frame(core::draw_frame frame)
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex_);
+
+        auto max_frames = static_cast<std::size_t>(
+            std::min(8, core::diagnostics::buffer_frames(8.0, 1.0, format_desc_.size, buffer_budget_, 1)));
+        const auto idle = taken_timer_.elapsed() > 1.0;
+        if ((memory_ && memory_->over_cap()) || (idle && core::diagnostics::memory_pressure())) {
+            max_frames = 1;
+        }
+
+        frames_.push(std::move(frame));
+        while (frames_.size() > max_frames) {
+            frames_.pop();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
         }
     }
 
@@ -261,6 +430,8 @@ class html_client
             if (type != PET_VIEW)
                 return;
 
+            set_active();
+
             if (d3d_shared_buffer_) {
                 if (shared_handle != d3d_shared_buffer_->share_handle())
                     d3d_shared_buffer_.reset();
@@ -284,15 +455,7 @@ class html_client
                 dframe.transform().image_transform.perspective.ll[1] = 0;
                 dframe.transform().image_transform.perspective.lr[1] = 0;
 
-                {
-                    std::lock_guard<std::mutex> lock(frames_mutex_);
-
-                    frames_.push(dframe);
-                    while (frames_.size() > 8) {
-                        frames_.pop();
-                        graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-                    }
-                }
+                push_frame(std::move(dframe));
             }
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
@@ -350,6 +513,12 @@ class html_client
 
     void OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, int httpStatusCode) override
     {
+        // The blank page of a pooled browser may finish loading after the next template was requested.
+        if (frame->GetURL().ToWString() == L"about:blank") {
+            return;
+        }
+
+        set_active();
         loaded_ = true;
         execute_queued_javascript();
     }
@@ -365,6 +534,11 @@ class html_client
 
             return true;
         }
+        if (name == ANIMATION_FRAME_MESSAGE_NAME) {
+            set_active();
+
+            return true;
+        }
         if (name == LOG_MESSAGE_NAME) {
             auto args     = message->GetArgumentList();
             auto severity = static_cast<boost::log::trivial::severity_level>(args->GetInt(0));
@@ -392,6 +566,7 @@ class html_client
         if (!frames_.empty()) {
             result = std::move(frames_.front());
             frames_.pop();
+            taken_timer_.restart();
 
             return true;
         }
@@ -399,9 +574,40 @@ class html_client
         return false;
     }
 
+    // A few ticks cover the paints that are still in flight when the activity ends.
+    void set_active() { active_ticks_ = 4; }
+
+    bool should_tick()
+    {
+        if (!adaptive_frame_rate_) {
+            return true;
+        }
+
+        auto active = active_ticks_.load();
+        if (active > 0) {
+            active_ticks_.compare_exchange_strong(active, active - 1);
+        } else if (++idle_ticks_ < static_cast<int>(std::ceil(format_desc_.fps))) {
+            return false;
+        }
+        idle_ticks_ = 0;
+
+        return true;
+    }
+
     void update()
     {
-        invoke_requested_animation_frames();
+        execute_javascript_batch();
+
+        if (should_tick()) {
+            invoke_requested_animation_frames();
+
+            if (adaptive_frame_rate_) {
+                html::begin_invoke([=] {
+                    if (browser_ != nullptr)
+                        browser_->GetHost()->SendExternalBeginFrame();
+                });
+            }
+        }
 
         core::draw_frame frame;
         if (try_pop(frame)) {
@@ -421,12 +627,46 @@ class html_client
         });
     }
 
+    static bool is_update(const std::wstring& javascript) { return boost::starts_with(javascript, L"update("); }
+
+    void execute_javascript_batch()
+    {
+        std::vector<std::wstring> batch;
+        {
+            std::lock_guard<std::mutex> lock(javascript_batch_mutex_);
+            if (javascript_held_) {
+                return;
+            }
+            batch.swap(javascript_batch_);
+        }
+        if (batch.empty()) {
+            return;
+        }
+
+        execute_queued_javascript();
+        do_execute_javascript(boost::join(batch, L";\n"));
+    }
+
     void execute_queued_javascript()
     {
         std::wstring javascript;
 
         while (javascript_before_load_.try_pop(javascript))
             do_execute_javascript(javascript);
+
+        std::wstring data;
+        while (data_before_load_.try_pop(data))
+            do_send_data(data);
+    }
+
+    void do_send_data(const std::wstring& data)
+    {
+        if (browser_ == nullptr)
+            return;
+
+        auto message = CefProcessMessage::Create(DATA_MESSAGE_NAME);
+        message->GetArgumentList()->SetString(0, data);
+        browser_->SendProcessMessage(CefProcessId::PID_RENDERER, message);
     }
 
     std::wstring print() const
@@ -438,11 +678,89 @@ class html_client
     IMPLEMENT_REFCOUNTING(html_client);
 };
 
+// Browsers of removed templates, kept with a blank page so that templates of the same origin and format load
+// without starting a browser and renderer process. The least recently used ones are closed beyond the pool size.
+class browser_pool
+{
+    std::mutex                                                 mutex_;
+    std::list<std::pair<std::wstring, CefRefPtr<html_client>>> idle_;
+
+  public:
+    static browser_pool& instance()
+    {
+        static browser_pool pool;
+        return pool;
+    }
+
+    static std::wstring key(const std::wstring& url, const core::video_format_desc& format_desc)
+    {
+        boost::wsmatch what;
+        const auto     origin = boost::regex_search(url, what, boost::wregex(L"^[a-zA-Z][a-zA-Z0-9+.-]*://[^/]*"))
+                                ? boost::to_lower_copy(what[0].str())
+                                : url;
+
+        return origin + L"|" + std::to_wstring(format_desc.square_width) + L"x" +
+               std::to_wstring(format_desc.square_height) + L"|" + std::to_wstring(format_desc.fps);
+    }
+
+    CefRefPtr<html_client> lease(const std::wstring& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = boost::find_if(idle_, [&](const auto& entry) { return entry.first == key; });
+        if (it == idle_.end()) {
+            return nullptr;
+        }
+        auto client = it->second;
+        idle_.erase(it);
+
+        return client;
+    }
+
+    // Returns false if client was not pooled and should be closed.
+    bool release(const std::wstring& key, const CefRefPtr<html_client>& client)
+    {
+        const auto size = env::properties().get(L"configuration.html.browser-pool-size", 0);
+        if (size <= 0 || !client->unload()) {
+            return false;
+        }
+
+        std::vector<CefRefPtr<html_client>> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            idle_.emplace_front(key, client);
+            while (static_cast<int>(idle_.size()) > size) {
+                evicted.push_back(idle_.back().second);
+                idle_.pop_back();
+            }
+        }
+        for (auto& idle : evicted) {
+            idle->close();
+        }
+
+        return true;
+    }
+
+    void clear()
+    {
+        std::list<std::pair<std::wstring, CefRefPtr<html_client>>> idle;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle.swap(idle_);
+        }
+        for (auto& entry : idle) {
+            entry.second->close();
+        }
+    }
+};
+
 class html_producer : public core::frame_producer
 {
     core::video_format_desc             format_desc_;
     core::monitor::state                state_;
     const std::wstring                  url_;
+    const std::wstring                  pool_key_;
     spl::shared_ptr<diagnostics::graph> graph_;
 
     CefRefPtr<html_client> client_;
@@ -453,22 +771,43 @@ class html_producer : public core::frame_producer
                   const std::wstring&                         url)
         : format_desc_(format_desc)
         , url_(url)
+        , pool_key_(browser_pool::key(url, format_desc))
     {
+        const auto owner = core::diagnostics::call_context::for_thread();
+
         html::invoke([&] {
+            client_ = browser_pool::instance().lease(pool_key_);
+            if (client_ != nullptr && client_->load(frame_factory, url_, owner)) {
+                return;
+            }
+
             const bool enable_gpu            = env::properties().get(L"configuration.html.enable-gpu", false);
+            const bool adaptive_frame_rate   = env::properties().get(L"configuration.html.adaptive-frame-rate", false);
             bool       shared_texture_enable = false;
 
 #ifdef WIN32
             shared_texture_enable = enable_gpu && accelerator::d3d::d3d_device::get_device();
+#else
+            // The CEF version we build against only shares textures through d3d, elsewhere the gpu renders the
+            // page and paints are read back and uploaded by dirty region.
+            static std::once_flag shared_texture_warning;
+            if (enable_gpu) {
+                std::call_once(shared_texture_warning, [] {
+                    CASPAR_LOG(info) << L"[html_producer] Shared textures are not supported on this platform, "
+                                        L"using software paints.";
+                });
+            }
 #endif
 
-            client_ = new html_client(frame_factory, graph_, format_desc, shared_texture_enable, url_);
+            client_ = new html_client(
+                frame_factory, graph_, format_desc, shared_texture_enable, adaptive_frame_rate, url_, owner);
 
             CefWindowInfo window_info;
             window_info.width                        = format_desc.square_width;
             window_info.height                       = format_desc.square_height;
             window_info.windowless_rendering_enabled = true;
             window_info.shared_texture_enabled       = shared_texture_enable;
+            window_info.external_begin_frame_enabled = adaptive_frame_rate;
 
             CefBrowserSettings browser_settings;
             browser_settings.web_security = cef_state_t::STATE_DISABLED;
@@ -482,7 +821,7 @@ class html_producer : public core::frame_producer
 
     ~html_producer() override
     {
-        if (client_ != nullptr)
+        if (client_ != nullptr && !browser_pool::instance().release(pool_key_, client_))
             client_->close();
     }
 
@@ -501,6 +840,8 @@ class html_producer : public core::frame_producer
 
     core::draw_frame first_frame() override { return receive_impl(0); }
 
+    boost::optional<boost::rational<int>> frame_rate() const override { return format_desc_.framerate; }
+
     core::draw_frame last_frame() override
     {
         if (client_ != nullptr) {
@@ -517,6 +858,16 @@ class html_producer : public core::frame_producer
 
         auto javascript = params.at(0);
 
+        if (javascript == L"[DATA]" && params.size() > 1) {
+            client_->send_data(params.at(1));
+            return make_ready_future(std::wstring());
+        }
+
+        if (javascript == L"[BATCH]" && params.size() > 1) {
+            client_->hold_javascript(boost::iequals(params.at(1), L"BEGIN"));
+            return make_ready_future(std::wstring());
+        }
+
         client_->execute_javascript(javascript);
 
         return make_ready_future(std::wstring());
@@ -542,8 +893,9 @@ spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_produ
 
     const auto url = found_filename ? L"file://" + *found_filename : param_url;
 
-    boost::optional<int> width;
-    boost::optional<int> height;
+    boost::optional<int>                  width;
+    boost::optional<int>                  height;
+    boost::optional<boost::rational<int>> framerate;
     {
         auto u8_url = u8(url);
 
@@ -555,6 +907,15 @@ spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_produ
         if (boost::regex_search(u8_url, what, boost::regex("height=([0-9]+)"))) {
             height = std::stoi(what[1].str());
         }
+
+        // e.g. fps=30 or fps=30000/1001, which the page is rendered at and received on a clock of its own.
+        if (boost::regex_search(u8_url, what, boost::regex("fps=([0-9]+)(?:/([0-9]+))?"))) {
+            const auto num = std::stoi(what[1].str());
+            const auto den = what[2].matched ? std::stoi(what[2].str()) : 1;
+            if (num > 0 && den > 0) {
+                framerate = boost::rational<int>(num, den);
+            }
+        }
     }
 
     auto format_desc = dependencies.format_desc;
@@ -564,10 +925,20 @@ spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_produ
         format_desc.height        = *height;
         format_desc.square_height = *height;
     }
+    if (framerate && *framerate != format_desc.framerate) {
+        format_desc.framerate     = *framerate;
+        format_desc.time_scale    = framerate->numerator();
+        format_desc.duration      = framerate->denominator();
+        format_desc.fps           = boost::rational_cast<double>(*framerate);
+        format_desc.field_count   = 1;
+        format_desc.audio_cadence = core::find_audio_cadence(*framerate, true);
+    }
 
     return core::create_destroy_proxy(spl::make_shared<html_producer>(dependencies.frame_factory, format_desc, url));
 }
 
+void clear_browser_pool() { browser_pool::instance().clear(); }
+
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params)
 {
@@ -33,6 +33,8 @@
 #include <common/except.h>
 #include <common/future.h>
 #include <common/log.h>
+#include <common/memshfl.h>
+#include <common/param.h>
 #include <common/utf.h>
 
 #include <core/consumer/frame_consumer.h>
@@ -41,10 +43,14 @@
 
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/exception/errinfo_file_name.hpp>
 
-#include <tbb/concurrent_queue.h>
+#include <tbb/task_arena.h>
 
 #include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
 #include <utility>
 #include <vector>
 
@@ -53,57 +59,148 @@
 
 namespace caspar { namespace image {
 
+namespace {
+
+struct image_encoder
+{
+    FREE_IMAGE_FORMAT format;
+    int               flags;
+    std::wstring      extension;
+    bool              alpha;
+};
+
+// png is FreeImage's default, png-fast trades file size for speed and tga is written uncompressed. jpg drops alpha,
+// the premultiplied colour is the frame over black.
+image_encoder get_encoder(const std::wstring& name)
+{
+    if (name.empty() || boost::iequals(name, L"png")) {
+        return {FIF_PNG, PNG_DEFAULT, L".png", true};
+    }
+    if (boost::iequals(name, L"png-fast")) {
+        return {FIF_PNG, PNG_Z_BEST_SPEED, L".png", true};
+    }
+    if (boost::iequals(name, L"tga")) {
+        return {FIF_TARGA, TARGA_DEFAULT, L".tga", true};
+    }
+    if (boost::iequals(name, L"jpg") || boost::iequals(name, L"jpeg")) {
+        return {FIF_JPEG, JPEG_QUALITYGOOD, L".jpg", false};
+    }
+    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unsupported image format: " + name));
+}
+
+// Snapshots beyond this are dropped rather than holding on to more mixer frames.
+const int MAX_PENDING_SNAPSHOTS = 32;
+
+std::atomic<int> pending_snapshots{0};
+
+tbb::task_arena& encoder_arena()
+{
+    static tbb::task_arena arena(std::max(env::properties().get(L"configuration.image.encoder-threads", 2), 1));
+    return arena;
+}
+
+void write_image(const core::const_frame& frame, const image_encoder& encoder, const std::wstring& filename)
+{
+    const auto width  = static_cast<int>(frame.width());
+    const auto height = static_cast<int>(frame.height());
+
+    // The mixer output is top down, it's flipped to FreeImage's bottom up rows while it's copied.
+    std::shared_ptr<FIBITMAP> bitmap;
+    if (encoder.alpha) {
+        bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertFromRawBits(const_cast<BYTE*>(frame.image_data(0).begin()),
+                                                                        width,
+                                                                        height,
+                                                                        width * 4,
+                                                                        32,
+                                                                        FI_RGBA_RED_MASK,
+                                                                        FI_RGBA_GREEN_MASK,
+                                                                        FI_RGBA_BLUE_MASK,
+                                                                        TRUE),
+                                           FreeImage_Unload);
+        if (!bitmap) {
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+        }
+
+        image_view<bgra_pixel> original_view(FreeImage_GetBits(bitmap.get()), width, height);
+        unmultiply(original_view);
+    } else {
+        bitmap = std::shared_ptr<FIBITMAP>(FreeImage_Allocate(width, height, 24), FreeImage_Unload);
+        if (!bitmap) {
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+        }
+
+        for (auto y = 0; y < height; ++y) {
+            bgra_to_bgr(FreeImage_GetScanLine(bitmap.get(), height - 1 - y),
+                        frame.image_data(0).begin() + static_cast<std::size_t>(y) * width * 4,
+                        width);
+        }
+    }
+
+#ifdef WIN32
+    auto saved = FreeImage_SaveU(encoder.format, bitmap.get(), filename.c_str(), encoder.flags);
+#else
+    auto saved = FreeImage_Save(encoder.format, bitmap.get(), u8(filename).c_str(), encoder.flags);
+#endif
+    if (!saved) {
+        CASPAR_THROW_EXCEPTION(file_write_error() << boost::errinfo_file_name(u8(filename)));
+    }
+}
+
+} // namespace
+
 struct image_consumer : public core::frame_consumer
 {
-    std::wstring filename_;
+    const std::wstring  filename_;
+    const image_encoder encoder_;
+    const int           frames_;
+    int                 sent_ = 0;
+    std::wstring        basename_;
 
   public:
     // frame_consumer
 
-    explicit image_consumer(std::wstring filename)
+    image_consumer(std::wstring filename, image_encoder encoder, int frames)
         : filename_(std::move(filename))
+        , encoder_(std::move(encoder))
+        , frames_(std::max(frames, 1))
     {
     }
 
     void initialize(const core::video_format_desc& /*format_desc*/, int /*channel_index*/) override {}
 
+    // Frames of a burst are numbered after the name, the consumer is removed after the last one.
     std::future<bool> send(core::const_frame frame) override
     {
-        auto filename = filename_;
-
-        std::thread async([frame, filename] {
-            try {
-                auto filename2 = filename;
-
-                if (filename2.empty())
-                    filename2 = env::media_folder() +
-                                boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) +
-                                L".png";
-                else
-                    filename2 = env::media_folder() + filename2 + L".png";
-
-                auto bitmap = std::shared_ptr<FIBITMAP>(
-                    FreeImage_Allocate(static_cast<int>(frame.width()), static_cast<int>(frame.height()), 32),
-                    FreeImage_Unload);
-                std::memcpy(FreeImage_GetBits(bitmap.get()), frame.image_data(0).begin(), frame.image_data(0).size());
-
-                image_view<bgra_pixel> original_view(
-                    FreeImage_GetBits(bitmap.get()), static_cast<int>(frame.width()), static_cast<int>(frame.height()));
-                unmultiply(original_view);
-
-                FreeImage_FlipVertical(bitmap.get());
-#ifdef WIN32
-                FreeImage_SaveU(FIF_PNG, bitmap.get(), filename2.c_str(), 0);
-#else
-                FreeImage_Save(FIF_PNG, bitmap.get(), u8(filename2).c_str(), 0);
-#endif
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-            }
-        });
-        async.detach();
-
-        return make_ready_future(false);
+        if (basename_.empty()) {
+            basename_ = env::media_folder() +
+                        (filename_.empty()
+                             ? boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time())
+                             : filename_);
+        }
+
+        auto filename = basename_;
+        if (frames_ > 1) {
+            std::wostringstream str;
+            str << L"_" << std::setw(4) << std::setfill(L'0') << sent_;
+            filename += str.str();
+        }
+        filename += encoder_.extension;
+
+        if (++pending_snapshots > MAX_PENDING_SNAPSHOTS) {
+            --pending_snapshots;
+            CASPAR_LOG(warning) << print() << L" Too many pending snapshots, skipped " << filename;
+        } else {
+            encoder_arena().enqueue([frame, encoder = encoder_, filename] {
+                try {
+                    write_image(frame, encoder, filename);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+                --pending_snapshots;
+            });
+        }
+
+        return make_ready_future(++sent_ < frames_);
     }
 
     std::wstring print() const override { return L"image[]"; }
@@ -121,10 +218,13 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     std::wstring filename;
 
-    if (params.size() > 1)
+    if (params.size() > 1 && !boost::iequals(params.at(1), L"FORMAT") && !boost::iequals(params.at(1), L"FRAMES"))
         filename = params.at(1);
 
-    return spl::make_shared<image_consumer>(filename);
+    auto encoder = get_encoder(get_param(L"FORMAT", params));
+    auto frames  = get_param(L"FRAMES", params, 1);
+
+    return spl::make_shared<image_consumer>(filename, encoder, frames);
 }
 
 }} // namespace caspar::image
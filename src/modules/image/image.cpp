@@ -26,6 +26,7 @@
 
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
+#include "util/image_cache.h"
 
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
@@ -46,6 +47,10 @@ void init(core::module_dependencies dependencies)
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
 }
 
-void uninit() { FreeImage_DeInitialise(); }
+void uninit()
+{
+    clear_image_cache();
+    FreeImage_DeInitialise();
+}
 
 }} // namespace caspar::image
@@ -28,6 +28,9 @@
 #endif
 #include <FreeImage.h>
 
+#include "image_sequence_producer.h"
+
+#include "../util/image_cache.h"
 #include "../util/image_loader.h"
 
 #include <core/video_format.h>
@@ -50,6 +53,8 @@
 #include <boost/property_tree/ptree.hpp>
 
 #include <algorithm>
+#include <chrono>
+#include <future>
 #include <set>
 #include <utility>
 
@@ -57,18 +62,25 @@ namespace caspar { namespace image {
 
 struct image_producer : public core::frame_producer
 {
-    core::monitor::state                       state_;
-    const std::wstring                         description_;
-    const spl::shared_ptr<core::frame_factory> frame_factory_;
-    const uint32_t                             length_ = 0;
-    core::draw_frame                           frame_;
+    core::monitor::state                          state_;
+    const std::wstring                            description_;
+    const spl::shared_ptr<core::frame_factory>    frame_factory_;
+    const uint32_t                                length_ = 0;
+    std::shared_future<std::shared_ptr<FIBITMAP>> bitmap_;
+    core::draw_frame                              frame_;
+
+    std::shared_future<std::shared_ptr<const compressed_image>> compressed_;
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory, std::wstring description, uint32_t length)
         : description_(std::move(description))
         , frame_factory_(frame_factory)
         , length_(length)
     {
-        load(load_image(description_));
+        if (env::properties().get(L"configuration.image.compress", false)) {
+            compressed_ = load_compressed_image_async(description_);
+        } else {
+            bitmap_ = load_image_async(description_);
+        }
 
         CASPAR_LOG(info) << print() << L" Initialized";
     }
@@ -88,9 +100,9 @@ struct image_producer : public core::frame_producer
 
     void load(const std::shared_ptr<FIBITMAP>& bitmap)
     {
-        FreeImage_FlipVertical(bitmap.get());
         core::pixel_format_desc desc;
-        desc.format = core::pixel_format::bgra;
+        desc.format    = core::pixel_format::bgra;
+        desc.bottom_up = true;
         desc.planes.push_back(
             core::pixel_format_desc::plane(FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()), 4));
         auto frame = frame_factory_->create_frame(this, desc);
@@ -99,16 +111,48 @@ struct image_producer : public core::frame_producer
         frame_ = core::draw_frame(std::move(frame));
     }
 
+    void load(const std::shared_ptr<const compressed_image>& image)
+    {
+        core::pixel_format_desc desc(core::pixel_format::dxt5);
+        desc.bottom_up = true;
+        desc.planes.push_back(core::pixel_format_desc::plane::blocks(image->width, image->height, 16));
+        auto frame = frame_factory_->create_frame(this, desc);
+
+        std::copy_n(image->blocks.begin(), frame.image_data(0).size(), frame.image_data(0).begin());
+        frame_ = core::draw_frame(std::move(frame));
+    }
+
+    template <typename T>
+    void load_ready(std::shared_future<T>& future)
+    {
+        if (future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            auto image = std::move(future);
+            try {
+                load(image.get());
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    // Nothing is shown until the bitmap has been decoded, and compressed, in the background.
+    const core::draw_frame& frame()
+    {
+        load_ready(bitmap_);
+        load_ready(compressed_);
+        return frame_;
+    }
+
     // frame_producer
 
-    core::draw_frame last_frame() override { return frame_; }
+    core::draw_frame last_frame() override { return frame(); }
 
-    core::draw_frame first_frame() override { return frame_; }
+    core::draw_frame first_frame() override { return frame(); }
 
     core::draw_frame receive_impl(int nb_samples) override
     {
         state_["file/path"] = description_;
-        return frame_;
+        return frame();
     }
 
     uint32_t nb_frames() const override { return length_; }
@@ -138,55 +182,10 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 {
     auto length = get_param(L"LENGTH", params, std::numeric_limits<uint32_t>::max());
 
-    // if (boost::iequals(params.at(0), L"[IMG_SEQUENCE]"))
-    //{
-    //	if (params.size() != 2)
-    //		return core::frame_producer::empty();
-
-    //	auto dir = boost::filesystem::path(env::media_folder() + params.at(1)).parent_path();
-    //	auto basename = boost::filesystem::basename(params.at(1));
-    //	std::set<std::wstring> files;
-    //	boost::filesystem::directory_iterator end;
-
-    //	for (boost::filesystem::directory_iterator it(dir); it != end; ++it)
-    //	{
-    //		auto name = it->path().filename().wstring();
-
-    //		if (!boost::algorithm::istarts_with(name, basename))
-    //			continue;
-
-    //		auto extension = it->path().extension().wstring();
-
-    //		if (std::find_if(supported_extensions().begin(), supported_extensions().end(), ieq(extension)) ==
-    // supported_extensions().end()) 			continue;
-
-    //		files.insert(it->path().wstring());
-    //	}
-
-    //	if (files.empty())
-    //		return core::frame_producer::empty();
-
-    //	int width = -1;
-    //	int height = -1;
-    //	std::vector<core::draw_frame> frames;
-    //	frames.reserve(files.size());
-
-    //	for (auto& file : files)
-    //	{
-    //		auto frame = load_image(dependencies.frame_factory, file);
-
-    //		if (width == -1)
-    //		{
-    //			width = static_cast<int>(frame.second.width.get());
-    //			height = static_cast<int>(frame.second.height.get());
-    //		}
-
-    //		frames.push_back(std::move(frame.first));
-    //	}
+    if (boost::iequals(params.at(0), L"[IMG_SEQUENCE]")) {
+        return create_sequence_producer(dependencies, params);
+    }
 
-    //	return core::create_const_producer(std::move(frames), width, height);
-    //}
-    // else
     // if (boost::iequals(params.at(0), L"[PNG_BASE64]")) {
     //    if (params.size() < 2)
     //        return core::frame_producer::empty();
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_sequence_producer.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include "../util/dxt.h"
+#include "../util/image_loader.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <set>
+#include <utility>
+
+namespace caspar { namespace image {
+
+namespace {
+
+tbb::task_arena& decode_arena()
+{
+    static tbb::task_arena arena;
+    return arena;
+}
+
+// Decodes filename straight into an upload buffer, the mixer flips the bottom up rows of FreeImage.
+core::draw_frame decode(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                        const void*                                 tag,
+                        const std::wstring&                         filename,
+                        bool                                        compress)
+{
+    auto bitmap = load_image(filename);
+
+    const auto width  = static_cast<int>(FreeImage_GetWidth(bitmap.get()));
+    const auto height = static_cast<int>(FreeImage_GetHeight(bitmap.get()));
+
+    core::pixel_format_desc desc;
+    desc.format    = compress ? core::pixel_format::dxt5 : core::pixel_format::bgra;
+    desc.bottom_up = true;
+    desc.planes.push_back(compress ? core::pixel_format_desc::plane::blocks(width, height, 16)
+                                   : core::pixel_format_desc::plane(width, height, 4));
+    auto frame = frame_factory->create_frame(tag, desc);
+
+    if (compress) {
+        compress_dxt5(FreeImage_GetBits(bitmap.get()), width, height, frame.image_data(0).begin());
+    } else {
+        std::copy_n(FreeImage_GetBits(bitmap.get()), frame.image_data(0).size(), frame.image_data(0).begin());
+    }
+
+    return core::draw_frame(std::move(frame));
+}
+
+} // namespace
+
+class image_sequence_producer : public core::frame_producer
+{
+    core::monitor::state                       state_;
+    const std::wstring                         description_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::vector<std::wstring>            files_;
+    const std::size_t                          read_ahead_;
+    const bool                                 compress_;
+
+    mutable std::mutex                                                mutex_;
+    bool                                                              loop_;
+    std::size_t                                                       next_;
+    std::size_t                                                       position_ = 0;
+    std::deque<std::pair<std::size_t, std::future<core::draw_frame>>> queue_;
+    core::draw_frame                                                  frame_;
+
+  public:
+    image_sequence_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                            std::wstring                                description,
+                            std::vector<std::wstring>                   files,
+                            bool                                        loop,
+                            std::size_t                                 seek)
+        : description_(std::move(description))
+        , frame_factory_(frame_factory)
+        , files_(std::move(files))
+        , read_ahead_(static_cast<std::size_t>(
+              std::max(env::properties().get(L"configuration.image.sequence-read-ahead", 8), 1)))
+        , compress_(env::properties().get(L"configuration.image.compress", false))
+        , loop_(loop)
+        , next_(std::min(seek, files_.size() - 1))
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        schedule();
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // Keeps read_ahead_ images decoding in parallel ahead of the one shown.
+    void schedule()
+    {
+        while (queue_.size() < read_ahead_ && next_ < files_.size()) {
+            auto index = next_;
+            auto task  = std::make_shared<std::packaged_task<core::draw_frame()>>(
+                [frame_factory = frame_factory_, tag = this, filename = files_[index], compress = compress_] {
+                    return decode(frame_factory, tag, filename, compress);
+                });
+            queue_.emplace_back(index, task->get_future());
+            decode_arena().enqueue([task] { (*task)(); });
+
+            next_ = index + 1;
+            if (loop_ && next_ == files_.size()) {
+                next_ = 0;
+            }
+        }
+    }
+
+    // Shows the next image if it has been decoded, otherwise the layer repeats the current one.
+    core::draw_frame next()
+    {
+        schedule();
+
+        if (queue_.empty() || queue_.front().second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return core::draw_frame{};
+        }
+
+        auto entry = std::move(queue_.front());
+        queue_.pop_front();
+        schedule();
+
+        try {
+            frame_    = entry.second.get();
+            position_ = entry.first;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << print() << L" Skipped " << files_[entry.first];
+            return core::draw_frame{};
+        }
+
+        return frame_;
+    }
+
+    // Drops the images read ahead and continues from index, which is returned clamped to the sequence.
+    std::size_t seek(std::size_t index)
+    {
+        queue_.clear();
+        next_      = std::min(index, files_.size() - 1);
+        auto first = next_;
+        schedule();
+
+        return first;
+    }
+
+    // frame_producer
+
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!frame_) {
+            next();
+        }
+        return core::draw_frame::still(frame_);
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto frame = next();
+
+        state_["file/path"]  = description_;
+        state_["file/frame"] = {static_cast<int64_t>(position_), static_cast<int64_t>(files_.size())};
+        state_["loop"]       = loop_;
+
+        return frame;
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+
+        std::wstring cmd = params.at(0);
+        std::wstring value;
+        if (params.size() > 1) {
+            value = params.at(1);
+        }
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+                seek(queue_.empty() ? next_ : queue_.front().first);
+            }
+
+            result = std::to_wstring(loop_);
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            int64_t seek_to;
+            if (boost::iequals(value, L"rel")) {
+                seek_to = static_cast<int64_t>(position_);
+            } else if (boost::iequals(value, L"end")) {
+                seek_to = static_cast<int64_t>(files_.size()) - 1;
+            } else {
+                seek_to = boost::lexical_cast<int64_t>(value);
+            }
+
+            if (params.size() > 2) {
+                seek_to += boost::lexical_cast<int64_t>(params.at(2));
+            }
+
+            result = std::to_wstring(seek(static_cast<std::size_t>(std::max<int64_t>(seek_to, 0))));
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    uint32_t frame_number() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<uint32_t>(position_);
+    }
+
+    uint32_t nb_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loop_ ? std::numeric_limits<uint32_t>::max() : static_cast<uint32_t>(files_.size());
+    }
+
+    std::wstring print() const override { return L"image_sequence_producer[" + description_ + L"]"; }
+
+    std::wstring name() const override { return L"image-sequence"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2) {
+        return core::frame_producer::empty();
+    }
+
+    auto path = boost::filesystem::path(env::media_folder() + params.at(1));
+
+    boost::filesystem::path dir;
+    std::wstring            prefix;
+    if (boost::filesystem::is_directory(path)) {
+        dir = path;
+    } else {
+        dir    = path.parent_path();
+        prefix = path.filename().wstring();
+    }
+
+    if (!boost::filesystem::is_directory(dir)) {
+        return core::frame_producer::empty();
+    }
+
+    std::set<std::wstring> files;
+    for (boost::filesystem::directory_iterator it(dir), end; it != end; ++it) {
+        if (!boost::filesystem::is_regular_file(it->path()) ||
+            !boost::algorithm::istarts_with(it->path().filename().wstring(), prefix)) {
+            continue;
+        }
+
+        auto ext = boost::to_lower_copy(it->path().extension().wstring());
+        if (supported_extensions().find(ext) == supported_extensions().end()) {
+            continue;
+        }
+
+        files.insert(it->path().wstring());
+    }
+
+    if (files.empty()) {
+        return core::frame_producer::empty();
+    }
+
+    auto loop = contains_param(L"LOOP", params);
+    auto seek = get_param(L"SEEK", params, static_cast<uint32_t>(0));
+
+    return spl::make_shared<image_sequence_producer>(dependencies.frame_factory,
+                                                     params.at(1),
+                                                     std::vector<std::wstring>(files.begin(), files.end()),
+                                                     loop,
+                                                     seek);
+}
+
+}} // namespace caspar::image
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dxt.h"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace caspar { namespace image {
+
+namespace {
+
+std::uint16_t to_565(int r, int g, int b)
+{
+    return static_cast<std::uint16_t>((r >> 3) << 11 | (g >> 2) << 5 | b >> 3);
+}
+
+void from_565(std::uint16_t c, int rgb[3])
+{
+    const auto r = c >> 11 & 0x1f;
+    const auto g = c >> 5 & 0x3f;
+    const auto b = c & 0x1f;
+    rgb[0]       = r << 3 | r >> 2;
+    rgb[1]       = g << 2 | g >> 4;
+    rgb[2]       = b << 3 | b >> 2;
+}
+
+void put_16(std::uint8_t* dst, std::uint16_t value)
+{
+    dst[0] = static_cast<std::uint8_t>(value);
+    dst[1] = static_cast<std::uint8_t>(value >> 8);
+}
+
+// Alpha endpoints are the block's range, with the eight value ramp of a0 > a1.
+void compress_alpha(const std::uint8_t src[16][4], std::uint8_t* dst)
+{
+    int lo = 255;
+    int hi = 0;
+    for (auto n = 0; n < 16; ++n) {
+        lo = std::min<int>(lo, src[n][3]);
+        hi = std::max<int>(hi, src[n][3]);
+    }
+
+    dst[0] = static_cast<std::uint8_t>(hi);
+    dst[1] = static_cast<std::uint8_t>(lo);
+
+    std::uint64_t bits = 0;
+    if (hi > lo) {
+        // Ramp position 7 is a0 (index 0), 0 is a1 (index 1) and p in between is index 8 - p.
+        for (auto n = 0; n < 16; ++n) {
+            const auto p     = ((src[n][3] - lo) * 7 + (hi - lo) / 2) / (hi - lo);
+            const auto index = p == 7 ? 0 : p == 0 ? 1 : 8 - p;
+            bits |= static_cast<std::uint64_t>(index) << (3 * n);
+        }
+    }
+    for (auto n = 0; n < 6; ++n) {
+        dst[2 + n] = static_cast<std::uint8_t>(bits >> (8 * n));
+    }
+}
+
+// Range fit: colors are projected on the axis between the 565 rounded corners of the block's bounding box.
+void compress_color(const std::uint8_t src[16][4], std::uint8_t* dst)
+{
+    int lo[3] = {255, 255, 255};
+    int hi[3] = {0, 0, 0};
+    for (auto n = 0; n < 16; ++n) {
+        for (auto c = 0; c < 3; ++c) {
+            lo[c] = std::min<int>(lo[c], src[n][2 - c]);
+            hi[c] = std::max<int>(hi[c], src[n][2 - c]);
+        }
+    }
+
+    // Insetting by 1/16 of the range moves the endpoints closer to where most of the colors are.
+    for (auto c = 0; c < 3; ++c) {
+        const auto inset = (hi[c] - lo[c]) >> 4;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    auto c0 = to_565(hi[0], hi[1], hi[2]);
+    auto c1 = to_565(lo[0], lo[1], lo[2]);
+
+    put_16(dst, c0);
+    put_16(dst + 2, c1);
+
+    std::uint32_t bits = 0;
+    if (c0 != c1) {
+        int e0[3];
+        int e1[3];
+        from_565(c0, e0);
+        from_565(c1, e1);
+
+        const int  axis[3] = {e0[0] - e1[0], e0[1] - e1[1], e0[2] - e1[2]};
+        const auto length  = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+        // Ramp position 3 is c0 (index 0), 0 is c1 (index 1), 1/3 and 2/3 are indices 3 and 2.
+        static const std::uint32_t indices[4] = {1, 3, 2, 0};
+        for (auto n = 0; n < 16; ++n) {
+            const auto dot = (src[n][2] - e1[0]) * axis[0] + (src[n][1] - e1[1]) * axis[1] +
+                             (src[n][0] - e1[2]) * axis[2];
+            const auto p = std::min(std::max((dot * 3 + length / 2) / length, 0), 3);
+            bits |= indices[p] << (2 * n);
+        }
+    }
+    for (auto n = 0; n < 4; ++n) {
+        dst[4 + n] = static_cast<std::uint8_t>(bits >> (8 * n));
+    }
+}
+
+} // namespace
+
+void compress_dxt5(const std::uint8_t* bgra, int width, int height, std::uint8_t* blocks)
+{
+    const auto columns = (width + 3) / 4;
+    const auto rows    = (height + 3) / 4;
+
+    tbb::parallel_for(0, rows, [&](int row) {
+        std::uint8_t block[16][4];
+        auto         dst = blocks + static_cast<std::size_t>(row) * columns * 16;
+
+        for (auto column = 0; column < columns; ++column, dst += 16) {
+            for (auto y = 0; y < 4; ++y) {
+                const auto line = bgra + static_cast<std::size_t>(std::min(row * 4 + y, height - 1)) * width * 4;
+                for (auto x = 0; x < 4; ++x) {
+                    std::memcpy(block[y * 4 + x], line + std::min(column * 4 + x, width - 1) * 4, 4);
+                }
+            }
+            compress_alpha(block, dst);
+            compress_color(block, dst + 8);
+        }
+    });
+}
+
+}} // namespace caspar::image
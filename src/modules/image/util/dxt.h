@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace caspar { namespace image {
+
+// Compresses a bgra image to dxt5 (bc3) blocks of 16 bytes, a row of blocks per task. Rows are
+// compressed in the order they are stored, partial blocks at the edges repeat the last column and row. blocks has
+// to hold core::pixel_format_desc::plane::blocks(width, height, 16).size bytes.
+void compress_dxt5(const std::uint8_t* bgra, int width, int height, std::uint8_t* blocks);
+
+}} // namespace caspar::image
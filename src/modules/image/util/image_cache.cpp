@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_cache.h"
+#include "dxt.h"
+#include "image_loader.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <boost/exception/errinfo_file_name.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace caspar { namespace image {
+
+namespace {
+
+struct image_cache
+{
+    struct entry
+    {
+        std::string                                   key;
+        std::uint64_t                                 id;
+        std::shared_future<std::shared_ptr<FIBITMAP>> bitmap;
+        std::size_t                                   size;
+
+        std::shared_future<std::shared_ptr<const compressed_image>> compressed;
+    };
+
+    std::mutex                                        mutex;
+    std::list<entry>                                  entries; // Most recently used first.
+    std::map<std::string, std::list<entry>::iterator> index;
+    std::size_t                                       size    = 0;
+    std::uint64_t                                     next_id = 0;
+    tbb::task_arena                                   arena;
+
+    // Bitmaps that are still decoding aren't counted and can't be evicted.
+    void evict(std::size_t budget)
+    {
+        auto it = entries.end();
+        while (size > budget && it != entries.begin()) {
+            --it;
+            if (it->size == 0) {
+                continue;
+            }
+            size -= it->size;
+            index.erase(it->key);
+            it = entries.erase(it);
+        }
+    }
+};
+
+image_cache& get_cache()
+{
+    static image_cache cache;
+    return cache;
+}
+
+std::size_t cache_budget()
+{
+    static const auto budget = env::properties().get(L"configuration.image.cache-size", 256);
+    return static_cast<std::size_t>(std::max(budget, 0)) * 1024 * 1024;
+}
+
+std::string file_signature(const std::wstring& filename)
+{
+    boost::filesystem::path path(filename);
+
+    if (!boost::filesystem::is_regular_file(path)) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename)));
+    }
+
+    std::ostringstream str;
+    str << u8(filename) << "|" << boost::filesystem::file_size(path) << "|" << boost::filesystem::last_write_time(path);
+    return str.str();
+}
+
+// Images of either kind are entries of their own, which share the budget. The size of a result is taken from it
+// once it's loaded.
+template <typename T, typename Load, typename Size>
+std::shared_future<std::shared_ptr<T>> load_async(const std::string&                                 key,
+                                                  std::shared_future<std::shared_ptr<T>> image_cache::entry::*result,
+                                                  Load                                               load,
+                                                  Size                                               size_of)
+{
+    auto& cache = get_cache();
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    auto it = cache.index.find(key);
+    if (it != cache.index.end()) {
+        cache.entries.splice(cache.entries.begin(), cache.entries, it->second);
+        return (*it->second).*result;
+    }
+
+    auto task = std::make_shared<std::packaged_task<std::shared_ptr<T>()>>(std::move(load));
+
+    const auto                             id = cache.next_id++;
+    std::shared_future<std::shared_ptr<T>> image(task->get_future());
+
+    image_cache::entry entry{key, id, {}, 0, {}};
+    entry.*result = image;
+    cache.entries.push_front(std::move(entry));
+    cache.index[key] = cache.entries.begin();
+
+    cache.arena.enqueue([&cache, task, key, id, image, size_of] {
+        (*task)();
+
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        // The entry is gone if the cache was cleared while decoding.
+        auto it = cache.index.find(key);
+        if (it == cache.index.end() || it->second->id != id) {
+            return;
+        }
+
+        try {
+            it->second->size = std::max<std::size_t>(size_of(*image.get()), 1);
+            cache.size += it->second->size;
+            cache.evict(cache_budget());
+        } catch (...) {
+            // Failures are reported to the producers waiting for them and decoded again on the next request.
+            cache.entries.erase(it->second);
+            cache.index.erase(it);
+        }
+    });
+
+    return image;
+}
+
+} // namespace
+
+std::shared_future<std::shared_ptr<FIBITMAP>> load_image_async(const std::wstring& filename)
+{
+    return load_async<FIBITMAP>(
+        file_signature(filename),
+        &image_cache::entry::bitmap,
+        [=] { return load_image(filename); },
+        [](FIBITMAP& bitmap) {
+            return static_cast<std::size_t>(FreeImage_GetPitch(&bitmap)) * FreeImage_GetHeight(&bitmap);
+        });
+}
+
+std::shared_future<std::shared_ptr<const compressed_image>> load_compressed_image_async(const std::wstring& filename)
+{
+    return load_async<const compressed_image>(
+        file_signature(filename) + "|dxt5",
+        &image_cache::entry::compressed,
+        [=] {
+            auto bitmap = load_image(filename);
+
+            auto image    = std::make_shared<compressed_image>();
+            image->width  = static_cast<int>(FreeImage_GetWidth(bitmap.get()));
+            image->height = static_cast<int>(FreeImage_GetHeight(bitmap.get()));
+            image->blocks.resize(core::pixel_format_desc::plane::blocks(image->width, image->height, 16).size);
+            compress_dxt5(FreeImage_GetBits(bitmap.get()), image->width, image->height, image->blocks.data());
+
+            return std::shared_ptr<const compressed_image>(std::move(image));
+        },
+        [](const compressed_image& image) { return image.blocks.size(); });
+}
+
+void clear_image_cache()
+{
+    auto& cache = get_cache();
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    cache.entries.clear();
+    cache.index.clear();
+    cache.size = 0;
+}
+
+}} // namespace caspar::image
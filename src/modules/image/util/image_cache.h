@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct FIBITMAP;
+
+namespace caspar { namespace image {
+
+// Returns the 32 bit bitmap of filename. Bitmaps are decoded by background tasks and
+// shared through a cache keyed by path, size and modification time, which keeps the most recently used of them
+// within image.cache-size MB.
+std::shared_future<std::shared_ptr<FIBITMAP>> load_image_async(const std::wstring& filename);
+
+// dxt5 blocks of a bitmap, in the bottom up row order of FreeImage.
+struct compressed_image
+{
+    int                       width  = 0;
+    int                       height = 0;
+    std::vector<std::uint8_t> blocks;
+};
+
+// Like load_image_async, but the cache keeps the compressed image, which is a quarter of the size of the bitmap.
+std::shared_future<std::shared_ptr<const compressed_image>> load_compressed_image_async(const std::wstring& filename);
+
+void clear_image_cache();
+
+}} // namespace caspar::image
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netroute_consumer.h"
+
+#include "../util/route_packet.h"
+
+#include <image/util/dxt.h>
+#include <st2110/util/rtp_sender.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace netroute {
+
+namespace {
+
+const std::int64_t NS_PER_SECOND = 1000000000;
+
+// Packets are sent in batches spread over this share of a frame's period, so that a frame doesn't arrive as a single
+// burst that overflows switch and receive buffers.
+const std::size_t BATCH_SIZE   = 32;
+const double      SPREAD_RATIO = 0.8;
+
+struct configuration
+{
+    std::string destination;
+    std::string interface_address;
+    int         ttl      = 16;
+    bool        compress = false;
+};
+
+struct queued_frame
+{
+    core::const_frame frame;
+    std::int64_t      time = 0;
+};
+
+void wait_until(std::int64_t ns)
+{
+    for (auto now = st2110::tai_now(); now < ns; now = st2110::tai_now()) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns - now));
+    }
+}
+
+} // namespace
+
+// Sends the mixed frames of the channel to netroute:// producers in other servers, as uncompressed bgra or as dxt5
+// blocks for a quarter of the bandwidth. Frames carry the PTP time at which the channel produced them, receivers
+// add a fixed latency to it, so that channels on servers with PTP disciplined clocks show them on the same tick.
+struct netroute_consumer : public core::frame_consumer
+{
+    const configuration config_;
+
+    std::unique_ptr<st2110::rtp_sender> sender_;
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_ = -1;
+    std::uint64_t                       frame_number_  = 0;
+
+    std::vector<std::uint8_t>              blocks_;
+    std::vector<st2110::rtp_packet>        packets_;
+    std::vector<const st2110::rtp_packet*> batch_;
+
+    spl::shared_ptr<diagnostics::graph>         graph_;
+    tbb::concurrent_bounded_queue<queued_frame> frame_buffer_;
+    std::atomic<bool>                           abort_request_{false};
+    std::thread                                 thread_;
+
+    core::monitor::state state_;
+
+  public:
+    explicit netroute_consumer(configuration config)
+        : config_(std::move(config))
+    {
+        frame_buffer_.set_capacity(2);
+
+        graph_->set_color("send-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~netroute_consumer() { stop(); }
+
+    void stop()
+    {
+        if (thread_.joinable()) {
+            abort_request_ = true;
+            frame_buffer_.clear();
+            frame_buffer_.try_push(queued_frame{});
+            thread_.join();
+        }
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        stop();
+
+        format_desc_   = format_desc;
+        channel_index_ = channel_index;
+        frame_buffer_.clear();
+
+        sender_ = std::make_unique<st2110::rtp_sender>(config_.destination, config_.interface_address, config_.ttl);
+
+        graph_->set_text(print());
+
+        abort_request_ = false;
+        thread_        = std::thread([this] {
+            try {
+                set_thread_name(L"[netroute_consumer]");
+                set_thread_role(L"network");
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized.";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        queued_frame queued;
+        queued.frame = std::move(frame);
+        queued.time  = st2110::tai_now();
+
+        if (!frame_buffer_.try_push(queued)) {
+            queued_frame oldest;
+            frame_buffer_.try_pop(oldest);
+            frame_buffer_.try_push(queued);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        state_["netroute/destination"] = u16(config_.destination);
+        state_["netroute/compress"]    = config_.compress;
+
+        return make_ready_future(true);
+    }
+
+    core::monitor::state state() const override { return state_; }
+
+    std::wstring print() const override
+    {
+        return L"netroute[" + u16(config_.destination) + L"|" + std::to_wstring(channel_index_) + L"|" +
+               format_desc_.name + L"]";
+    }
+
+    std::wstring name() const override { return L"netroute"; }
+
+    int index() const override
+    {
+        return 400000 + static_cast<int>(std::hash<std::string>{}(config_.destination) % 100000);
+    }
+
+  private:
+    void run()
+    {
+        const auto period = static_cast<std::int64_t>(format_desc_.duration) * NS_PER_SECOND / format_desc_.time_scale;
+
+        while (!abort_request_) {
+            queued_frame queued;
+            frame_buffer_.pop(queued);
+            if (abort_request_ || !queued.frame) {
+                continue;
+            }
+
+            const auto start = st2110::tai_now();
+            packetize(queued.frame, queued.time);
+
+            const auto batches = (packets_.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+            const auto spread  = static_cast<std::int64_t>(period * SPREAD_RATIO);
+            for (std::size_t n = 0; n < batches && !abort_request_; ++n) {
+                wait_until(start + static_cast<std::int64_t>(n) * spread / static_cast<std::int64_t>(batches));
+
+                const auto begin = n * BATCH_SIZE;
+                const auto end   = std::min(begin + BATCH_SIZE, packets_.size());
+                batch_.clear();
+                for (auto i = begin; i < end; ++i) {
+                    batch_.push_back(&packets_[i]);
+                }
+                sender_->send(batch_.data(), batch_.size());
+            }
+
+            graph_->set_value("send-time", static_cast<double>(st2110::tai_now() - start) / period * 0.5);
+        }
+    }
+
+    // Splits the image and audio of frame into packets, the image compressed to dxt5 if the consumer compresses.
+    void packetize(const core::const_frame& frame, std::int64_t time)
+    {
+        const auto  width  = format_desc_.width;
+        const auto  height = format_desc_.height;
+        const auto& image  = frame.image_data(0);
+        const auto& audio  = frame.audio_data();
+
+        const std::uint8_t* image_data = image.data();
+        auto                image_size = std::min(image.size(), static_cast<std::size_t>(width) * height * 4);
+        if (config_.compress) {
+            blocks_.resize(core::pixel_format_desc::plane::blocks(width, height, 16).size);
+            image::compress_dxt5(image.data(), width, height, blocks_.data());
+            image_data = blocks_.data();
+            image_size = blocks_.size();
+        }
+
+        const auto audio_size = audio.size() * sizeof(std::int32_t);
+        const auto total      = image_size + audio_size;
+
+        packet_header header{};
+        header.magic         = PACKET_MAGIC;
+        header.version       = PACKET_VERSION;
+        header.format        = static_cast<std::uint8_t>(config_.compress ? packet_format::dxt5 : packet_format::bgra);
+        header.frame         = frame_number_++;
+        header.time          = time;
+        header.width         = static_cast<std::uint32_t>(width);
+        header.height        = static_cast<std::uint32_t>(height);
+        header.image_size    = static_cast<std::uint32_t>(image_size);
+        header.audio_samples = static_cast<std::uint32_t>(audio.size());
+        header.channels      = static_cast<std::uint32_t>(format_desc_.audio_channels);
+        header.sample_rate   = static_cast<std::uint32_t>(format_desc_.audio_sample_rate);
+        header.time_scale    = static_cast<std::uint32_t>(format_desc_.time_scale);
+        header.duration      = static_cast<std::uint32_t>(format_desc_.duration);
+
+        const auto audio_data = reinterpret_cast<const std::uint8_t*>(audio.data());
+
+        packets_.resize((total + PACKET_PAYLOAD_SIZE - 1) / PACKET_PAYLOAD_SIZE);
+        for (std::size_t n = 0; n < packets_.size(); ++n) {
+            const auto offset = n * PACKET_PAYLOAD_SIZE;
+            const auto size   = std::min<std::size_t>(PACKET_PAYLOAD_SIZE, total - offset);
+
+            auto& packet  = packets_[n];
+            header.offset = static_cast<std::uint32_t>(offset);
+            std::memcpy(packet.data.data(), &header, sizeof(header));
+
+            // A packet may hold the end of the image and the start of the audio.
+            auto dest = packet.data.data() + PACKET_HEADER_SIZE;
+            if (offset < image_size) {
+                const auto part = std::min(size, image_size - offset);
+                std::memcpy(dest, image_data + offset, part);
+                if (part < size) {
+                    std::memcpy(dest + part, audio_data, size - part);
+                }
+            } else {
+                std::memcpy(dest, audio_data + offset - image_size, size);
+            }
+            packet.size = static_cast<int>(PACKET_HEADER_SIZE + size);
+        }
+    }
+};
+
+namespace {
+
+spl::shared_ptr<core::frame_consumer> make_consumer(configuration config)
+{
+    if (config.destination.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"netroute consumer needs a host:port"));
+    }
+
+    return spl::make_shared<netroute_consumer>(std::move(config));
+}
+
+} // namespace
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"NETROUTE")) {
+        return core::frame_consumer::empty();
+    }
+
+    configuration config;
+    config.destination       = u8(params.at(1));
+    config.interface_address = u8(get_param(L"INTERFACE", params, L""));
+    config.ttl               = get_param(L"TTL", params, config.ttl);
+    config.compress          = contains_param(L"COMPRESS", params);
+
+    return make_consumer(std::move(config));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
+                              const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    configuration config;
+    config.destination       = u8(ptree.get<std::wstring>(L"destination"));
+    config.interface_address = u8(ptree.get(L"interface", L""));
+    config.ttl               = ptree.get(L"ttl", config.ttl);
+    config.compress          = ptree.get(L"compress", config.compress);
+
+    return make_consumer(std::move(config));
+}
+
+}} // namespace caspar::netroute
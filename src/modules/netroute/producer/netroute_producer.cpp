@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netroute_producer.h"
+
+#include "../util/route_receiver.h"
+
+#include <st2110/util/rtp_sender.h>
+
+#include <common/array.h>
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+namespace caspar { namespace netroute {
+
+// Plays the frames that a netroute consumer on another server sends, each one latency frames of this channel after
+// the sender's channel produced it, so that servers with PTP disciplined clocks stay frame accurate with each other.
+// The last frame is shown until one is due, and audio is only kept when its layout matches the channel.
+struct netroute_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::video_format_desc              format_desc_;
+    const std::wstring                         source_;
+    const std::int64_t                         latency_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    std::unique_ptr<route_receiver>     receiver_;
+
+    mutable std::mutex mutex_;
+    core::draw_frame   frame_;
+    std::uint64_t      number_ = 0;
+
+    core::monitor::state state_;
+
+    netroute_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                      const core::video_format_desc&              format_desc,
+                      std::wstring                                source,
+                      const std::string&                          address,
+                      int                                         port,
+                      const std::string&                          interface_address,
+                      int                                         latency)
+        : frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , source_(std::move(source))
+        , latency_(static_cast<std::int64_t>(latency) * format_desc.duration * 1000000000 / format_desc.time_scale)
+    {
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        receiver_.reset(new route_receiver(address, port, interface_address, graph_));
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    core::draw_frame make_frame(const received_frame& received)
+    {
+        const auto& header = received.header;
+        const auto  dxt5   = header.format == static_cast<std::uint8_t>(packet_format::dxt5);
+        const auto  width  = static_cast<int>(header.width);
+        const auto  height = static_cast<int>(header.height);
+
+        core::pixel_format_desc desc(dxt5 ? core::pixel_format::dxt5 : core::pixel_format::bgra);
+        desc.planes.push_back(dxt5 ? core::pixel_format_desc::plane::blocks(width, height, 16)
+                                   : core::pixel_format_desc::plane(width, height, 4));
+
+        auto frame = frame_factory_->create_frame(this, desc);
+        std::memcpy(frame.image_data(0).data(),
+                    received.data.data(),
+                    std::min<std::size_t>(frame.image_data(0).size(), header.image_size));
+
+        if (static_cast<int>(header.channels) == format_desc_.audio_channels &&
+            static_cast<int>(header.sample_rate) == format_desc_.audio_sample_rate) {
+            auto audio = reinterpret_cast<const std::int32_t*>(received.data.data() + header.image_size);
+            frame.audio_data() = array<std::int32_t>(std::vector<std::int32_t>(audio, audio + header.audio_samples));
+        }
+
+        return core::draw_frame(std::move(frame));
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto received = receiver_->pop(st2110::tai_now() - latency_);
+        if (!received) {
+            if (frame_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            }
+            return core::draw_frame::still(frame_);
+        }
+
+        frame_  = make_frame(*received);
+        number_ = received->header.frame;
+
+        state_["netroute/source"] = source_;
+        state_["netroute/frame"]  = static_cast<std::int64_t>(number_);
+
+        return frame_;
+    }
+
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(frame_);
+    }
+
+    std::wstring print() const override { return L"netroute_producer[" + source_ + L"]"; }
+
+    std::wstring name() const override { return L"netroute"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static boost::wregex expr(L"netroute://((?<ADDRESS>[^:/]+):)?(?<PORT>\\d+)", boost::regex::icase);
+    boost::wsmatch       what;
+
+    if (params.empty() || !boost::regex_match(params.at(0), what, expr)) {
+        return core::frame_producer::empty();
+    }
+
+    auto latency = get_param(L"LATENCY", params, 2);
+    if (latency < 0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"netroute LATENCY can't be negative"));
+    }
+
+    return spl::make_shared<netroute_producer>(dependencies.frame_factory,
+                                               dependencies.format_desc,
+                                               params.at(0).substr(11),
+                                               u8(what["ADDRESS"].str()),
+                                               boost::lexical_cast<int>(what["PORT"].str()),
+                                               u8(get_param(L"INTERFACE", params, L"")),
+                                               latency);
+}
+
+}} // namespace caspar::netroute
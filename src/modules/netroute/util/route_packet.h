@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <st2110/util/rtp_sender.h>
+
+#include <cstdint>
+
+namespace caspar { namespace netroute {
+
+// A routed frame is sent as udp datagrams of at most st2110::MAX_PACKET_SIZE bytes. Each is a packet_header followed
+// by a part of the frame, which is the image, bgra or dxt5 blocks with the top line first, and then the interleaved
+// int32 audio. All values are little endian.
+const std::uint32_t PACKET_MAGIC        = 0x52474343; // "CCGR"
+const std::uint16_t PACKET_VERSION      = 1;
+const int           PACKET_HEADER_SIZE  = 64;
+const int           PACKET_PAYLOAD_SIZE = st2110::MAX_PACKET_SIZE - PACKET_HEADER_SIZE;
+
+enum class packet_format : std::uint8_t
+{
+    bgra = 0,
+    dxt5 = 1,
+};
+
+struct packet_header
+{
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint8_t  format;
+    std::uint8_t  reserved0;
+    std::uint64_t frame; // Counted from the first frame that the sender sent.
+    std::int64_t  time;  // ns since the PTP epoch when the sender's channel produced the frame.
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t image_size;
+    std::uint32_t audio_samples; // Over all channels.
+    std::uint32_t offset;        // Of the payload within the image and audio.
+    std::uint32_t channels;
+    std::uint32_t sample_rate;
+    std::uint32_t time_scale;
+    std::uint32_t duration;
+    std::uint32_t reserved1;
+};
+
+static_assert(sizeof(packet_header) == PACKET_HEADER_SIZE, "packet header has the wrong size");
+
+}} // namespace caspar::netroute
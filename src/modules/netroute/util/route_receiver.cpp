@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "route_receiver.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace netroute {
+
+namespace {
+
+// Larger frames than 8K bgra are refused.
+const std::size_t MAX_FRAME_SIZE = 256 * 1024 * 1024;
+
+// Frames that are being put back together, and complete ones that haven't been taken yet.
+const std::size_t MAX_PARTIAL = 4;
+const std::size_t MAX_READY   = 8;
+
+// A frame this far behind the newest complete one is a late packet, one further behind is from a sender that started
+// over.
+const std::uint64_t MAX_REORDER = 16;
+
+struct partial_frame
+{
+    std::shared_ptr<received_frame> frame;
+    std::vector<bool>               received;
+    std::size_t                     remaining;
+};
+
+} // namespace
+
+struct route_receiver::impl
+{
+    const spl::shared_ptr<diagnostics::graph> graph_;
+
+    boost::asio::io_service         service_;
+    boost::asio::ip::udp::socket    socket_{service_};
+    boost::asio::ip::udp::endpoint  sender_;
+    std::array<std::uint8_t, 65536> packet_;
+
+    std::map<std::uint64_t, partial_frame> partial_;
+    std::uint64_t                          last_     = 0;
+    bool                                   has_last_ = false;
+
+    std::mutex                                  mutex_;
+    std::deque<std::shared_ptr<received_frame>> ready_;
+
+    std::thread thread_;
+
+    impl(const std::string&                  address,
+         int                                 port,
+         const std::string&                  interface_address,
+         spl::shared_ptr<diagnostics::graph> graph)
+        : graph_(std::move(graph))
+    {
+        if (port <= 0 || port > 65535) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid netroute port " + std::to_string(port)));
+        }
+
+        const auto group = address.empty() ? boost::asio::ip::address_v4::any()
+                                           : boost::asio::ip::address_v4::from_string(address);
+
+        socket_.open(boost::asio::ip::udp::v4());
+        socket_.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+        socket_.bind({group.is_multicast() ? boost::asio::ip::address_v4::any() : group,
+                      static_cast<unsigned short>(port)});
+        if (group.is_multicast()) {
+            if (interface_address.empty()) {
+                socket_.set_option(boost::asio::ip::multicast::join_group(group));
+            } else {
+                socket_.set_option(boost::asio::ip::multicast::join_group(
+                    group, boost::asio::ip::address_v4::from_string(interface_address)));
+            }
+        }
+
+        // A frame arrives as a burst of thousands of packets, a larger receive buffer keeps the kernel from dropping
+        // them while the thread is busy.
+        boost::system::error_code ec;
+        socket_.set_option(boost::asio::socket_base::receive_buffer_size(64 * 1024 * 1024), ec);
+
+        receive();
+
+        thread_ = std::thread([this] {
+            try {
+                set_thread_name(L"[netroute::receiver]");
+                set_thread_role(L"network");
+                service_.run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        service_.stop();
+        thread_.join();
+    }
+
+    void receive()
+    {
+        socket_.async_receive_from(
+            boost::asio::buffer(packet_), sender_, [this](const boost::system::error_code& ec, std::size_t size) {
+                if (ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!ec) {
+                    on_packet(packet_.data(), size);
+                }
+                receive();
+            });
+    }
+
+    void on_packet(const std::uint8_t* data, std::size_t size)
+    {
+        if (size <= PACKET_HEADER_SIZE) {
+            return;
+        }
+
+        packet_header header;
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic != PACKET_MAGIC || header.version != PACKET_VERSION) {
+            return;
+        }
+
+        const auto payload = size - PACKET_HEADER_SIZE;
+        const auto total   = static_cast<std::size_t>(header.image_size) + header.audio_samples * sizeof(std::int32_t);
+        if (total == 0 || total > MAX_FRAME_SIZE || header.offset % PACKET_PAYLOAD_SIZE != 0 ||
+            header.offset + payload > total) {
+            return;
+        }
+
+        if (has_last_ && header.frame <= last_) {
+            if (last_ - header.frame < MAX_REORDER) {
+                return;
+            }
+            partial_.clear();
+            has_last_ = false;
+        }
+
+        auto it = partial_.find(header.frame);
+        if (it == partial_.end()) {
+            if (partial_.size() >= MAX_PARTIAL) {
+                partial_.erase(partial_.begin());
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+
+            const auto count = (total + PACKET_PAYLOAD_SIZE - 1) / PACKET_PAYLOAD_SIZE;
+
+            partial_frame partial;
+            partial.frame                = std::make_shared<received_frame>();
+            partial.frame->header        = header;
+            partial.frame->header.offset = 0;
+            partial.frame->data.resize(total);
+            partial.received.resize(count, false);
+            partial.remaining = count;
+
+            it = partial_.emplace(header.frame, std::move(partial)).first;
+        }
+
+        auto&      partial = it->second;
+        const auto index   = header.offset / PACKET_PAYLOAD_SIZE;
+        if (partial.frame->data.size() != total || partial.received[index]) {
+            return;
+        }
+        std::memcpy(partial.frame->data.data() + header.offset, data + PACKET_HEADER_SIZE, payload);
+        partial.received[index] = true;
+
+        if (--partial.remaining > 0) {
+            return;
+        }
+
+        // Frames before this one that are still missing packets won't be needed any more.
+        auto frame = std::move(partial.frame);
+        for (auto before = partial_.begin(); before != it; before = partial_.erase(before)) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+        partial_.erase(it);
+
+        last_     = header.frame;
+        has_last_ = true;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(std::move(frame));
+        if (ready_.size() > MAX_READY) {
+            ready_.pop_front();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+    }
+
+    std::shared_ptr<received_frame> pop(std::int64_t time)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::shared_ptr<received_frame> frame;
+        while (!ready_.empty() && ready_.front()->header.time <= time) {
+            if (frame) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+            frame = std::move(ready_.front());
+            ready_.pop_front();
+        }
+        return frame;
+    }
+};
+
+route_receiver::route_receiver(const std::string&                  address,
+                               int                                 port,
+                               const std::string&                  interface_address,
+                               spl::shared_ptr<diagnostics::graph> graph)
+    : impl_(new impl(address, port, interface_address, std::move(graph)))
+{
+}
+route_receiver::~route_receiver() {}
+std::shared_ptr<received_frame> route_receiver::pop(std::int64_t time) { return impl_->pop(time); }
+
+}} // namespace caspar::netroute
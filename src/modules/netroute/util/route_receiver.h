@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "route_packet.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/memory.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace netroute {
+
+struct received_frame
+{
+    packet_header             header; // Of the frame, with an offset of 0.
+    std::vector<std::uint8_t> data;   // The image followed by the audio.
+};
+
+// Receives routed frames on a thread of the network role and puts them back together. Frames that miss packets are
+// dropped once a later frame is complete, so that a lost packet never delays the frames after it.
+class route_receiver
+{
+  public:
+    // Listens on port, and joins the multicast group address from the address of interface if address is one.
+    route_receiver(const std::string&                  address,
+                   int                                 port,
+                   const std::string&                  interface_address,
+                   spl::shared_ptr<diagnostics::graph> graph);
+    ~route_receiver();
+
+    route_receiver(const route_receiver&) = delete;
+    route_receiver& operator=(const route_receiver&) = delete;
+
+    // Takes the newest complete frame that was produced by time, dropping the ones before it, or returns nullptr if
+    // there is none yet.
+    std::shared_ptr<received_frame> pop(std::int64_t time);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::netroute
@@ -26,11 +26,15 @@
 
 #include <core/consumer/frame_consumer.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/mixer/audio/audio_util.h>
+#include <core/mixer/mixer.h>
+#include <core/video_channel.h>
 #include <core/video_format.h>
 
 #include <common/assert.h>
 #include <common/diagnostics/graph.h>
+#include <common/except.h>
 #include <common/future.h>
 #include <common/param.h>
 #include <common/timer.h>
@@ -38,23 +42,69 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <array>
+#include <cstring>
+#include <vector>
+
 #include "../util/ndi.h"
 
 namespace caspar { namespace newtek {
 
+namespace {
+
+enum class ndi_pixel_format
+{
+    bgra,
+    uyvy,
+    uyva
+};
+
+ndi_pixel_format get_ndi_pixel_format(const std::wstring& str)
+{
+    if (boost::iequals(str, L"bgra")) {
+        return ndi_pixel_format::bgra;
+    }
+    if (boost::iequals(str, L"uyvy")) {
+        return ndi_pixel_format::uyvy;
+    }
+    if (boost::iequals(str, L"uyva")) {
+        return ndi_pixel_format::uyva;
+    }
+    CASPAR_THROW_EXCEPTION(user_error()
+                           << msg_info(L"Invalid NDI pixel format " + str + L", expected bgra, uyvy or uyva."));
+}
+
+// Copies lines of bytes, starting at first and then every step lines of source.
+void copy_lines(std::uint8_t* dest, const std::uint8_t* source, int bytes, int lines, int first, int step)
+{
+    for (auto y = 0; y < lines; ++y) {
+        std::memcpy(dest + y * bytes, source + (first + y * step) * bytes, bytes);
+    }
+}
+
+} // namespace
+
+// Frames are handed to NDI with the async send, which returns while the previous frame is still being compressed,
+// so every frame is held until the next one has been handed over. uyvy and uyva are rendered by the mixer, fields
+// are sent in place by striding over every other line.
 struct newtek_ndi_consumer : public core::frame_consumer
 {
     static std::atomic<int> instances_;
     const int               instance_no_;
     const std::wstring      name_;
     const bool              allow_fields_;
+    const ndi_pixel_format  pixel_format_;
+
+    std::vector<std::weak_ptr<core::video_channel>> channels_;
+    std::shared_ptr<const core::pixel_format_desc>  gpu_format_;
+    core::const_frame                               sending_;
+    std::array<std::vector<std::uint8_t>, 2>        buffers_;
 
     core::video_format_desc              format_desc_;
     int                                  channel_index_;
     NDIlib_v3*                           ndi_lib_;
     NDIlib_video_frame_v2_t              ndi_video_frame_;
     NDIlib_audio_frame_interleaved_32s_t ndi_audio_frame_;
-    std::shared_ptr<uint8_t>             field_data_;
     spl::shared_ptr<diagnostics::graph>  graph_;
     caspar::timer                        tick_timer_;
     caspar::timer                        frame_timer_;
@@ -63,13 +113,21 @@ struct newtek_ndi_consumer : public core::frame_consumer
     std::unique_ptr<NDIlib_send_instance_t, std::function<void(NDIlib_send_instance_t*)>> ndi_send_instance_;
 
   public:
-    newtek_ndi_consumer(std::wstring name, bool allow_fields)
+    newtek_ndi_consumer(std::wstring                                             name,
+                        bool                                                     allow_fields,
+                        ndi_pixel_format                                         pixel_format,
+                        const std::vector<spl::shared_ptr<core::video_channel>>& channels)
         : name_(!name.empty() ? name : default_ndi_name())
         , instance_no_(instances_++)
         , frame_no_(0)
         , allow_fields_(allow_fields)
+        , pixel_format_(pixel_format)
         , channel_index_(0)
     {
+        for (auto& channel : channels) {
+            channels_.push_back(static_cast<std::shared_ptr<core::video_channel>>(channel));
+        }
+
         ndi_lib_ = ndi::load_library();
         graph_->set_text(print());
         graph_->set_color("frame-time", diagnostics::color(0.5f, 1.0f, 0.2f));
@@ -78,7 +136,13 @@ struct newtek_ndi_consumer : public core::frame_consumer
         diagnostics::register_graph(graph_);
     }
 
-    ~newtek_ndi_consumer() {}
+    ~newtek_ndi_consumer()
+    {
+        // Waits for the frame that is being sent.
+        if (ndi_send_instance_) {
+            ndi_lib_->NDIlib_send_send_video_async_v2(*ndi_send_instance_, nullptr);
+        }
+    }
 
     // frame_consumer
 
@@ -94,6 +158,25 @@ struct newtek_ndi_consumer : public core::frame_consumer
 
         ndi_send_instance_ = {new NDIlib_send_instance_t(ndi_lib_->NDIlib_send_create(&NDI_send_create_desc)),
                               [this](auto p) { this->ndi_lib_->NDIlib_send_destroy(*p); }};
+        sending_           = core::const_frame{};
+
+        gpu_format_.reset();
+        if (pixel_format_ != ndi_pixel_format::bgra) {
+            core::pixel_format_desc desc(core::pixel_format::uyvy);
+            desc.planes.push_back(core::pixel_format_desc::plane(format_desc.width / 2, format_desc.height, 4));
+            if (pixel_format_ == ndi_pixel_format::uyva) {
+                desc.planes.push_back(core::pixel_format_desc::plane(format_desc.width, format_desc.height, 1));
+            }
+            for (auto& weak_channel : channels_) {
+                auto channel = weak_channel.lock();
+                if (channel && channel->index() == channel_index) {
+                    gpu_format_ = channel->mixer().request_format(desc);
+                }
+            }
+            if (!gpu_format_) {
+                CASPAR_LOG(warning) << print() << L" The mixer can't render uyvy, sending bgra.";
+            }
+        }
 
         ndi_video_frame_.xres                 = format_desc.width;
         ndi_video_frame_.yres                 = format_desc.height;
@@ -107,9 +190,6 @@ struct newtek_ndi_consumer : public core::frame_consumer
             ndi_video_frame_.yres /= 2;
             ndi_video_frame_.frame_rate_N /= 2;
             ndi_video_frame_.picture_aspect_ratio = format_desc.width * 1.0f / format_desc.height;
-            field_data_.reset(new uint8_t[ndi_video_frame_.line_stride_in_bytes * ndi_video_frame_.yres],
-                              std::default_delete<uint8_t[]>());
-            ndi_video_frame_.p_data = field_data_.get();
         }
 
         ndi_audio_frame_.sample_rate = format_desc_.audio_sample_rate;
@@ -132,18 +212,52 @@ struct newtek_ndi_consumer : public core::frame_consumer
         ndi_audio_frame_.no_samples = audio_data_size / format_desc_.audio_channels;
         ndi_audio_frame_.p_data     = const_cast<int*>(audio_data.data());
         ndi_lib_->NDIlib_util_send_send_audio_interleaved_32s(*ndi_send_instance_, &ndi_audio_frame_);
-        if (format_desc_.field_count == 2 && allow_fields_) {
+
+        const auto fields = format_desc_.field_count == 2 && allow_fields_;
+        const auto field  = frame_no_ % 2;
+        if (fields) {
             ndi_video_frame_.frame_format_type =
-                (frame_no_ % 2 ? NDIlib_frame_format_type_field_1 : NDIlib_frame_format_type_field_0);
-            for (auto y = 0; y < ndi_video_frame_.yres; ++y) {
-                std::memcpy(reinterpret_cast<char*>(ndi_video_frame_.p_data) + y * format_desc_.width * 4,
-                            frame.image_data(0).data() + (y * 2 + frame_no_ % 2) * format_desc_.width * 4,
-                            format_desc_.width * 4);
+                (field ? NDIlib_frame_format_type_field_1 : NDIlib_frame_format_type_field_0);
+        }
+
+        auto source = frame;
+        auto stride = format_desc_.width * 4;
+        auto fourcc = NDIlib_FourCC_type_BGRA;
+        if (gpu_format_) {
+            // Not rendered by the gpu if the frame was mixed before the format was requested.
+            auto converted = core::converted_frame(frame, gpu_format_);
+            if (converted) {
+                source = std::move(converted);
+                stride = format_desc_.width * 2;
+                fourcc = pixel_format_ == ndi_pixel_format::uyva ? NDIlib_FourCC_type_UYVA : NDIlib_FourCC_type_UYVY;
             }
+        }
+
+        ndi_video_frame_.FourCC = fourcc;
+        if (fourcc == NDIlib_FourCC_type_UYVA) {
+            // NDI expects the alpha plane right after the uyvy plane, so both are copied, one field of them if only
+            // fields are sent.
+            const auto lines  = ndi_video_frame_.yres;
+            auto&      buffer = buffers_[frame_no_ % buffers_.size()];
+            buffer.resize(static_cast<std::size_t>(lines) * stride * 3 / 2);
+            copy_lines(buffer.data(), source.image_data(0).data(), stride, lines, fields ? field : 0, fields ? 2 : 1);
+            copy_lines(buffer.data() + lines * stride,
+                       source.image_data(1).data(),
+                       stride / 2,
+                       lines,
+                       fields ? field : 0,
+                       fields ? 2 : 1);
+            ndi_video_frame_.p_data               = buffer.data();
+            ndi_video_frame_.line_stride_in_bytes = stride;
         } else {
-            ndi_video_frame_.p_data = const_cast<uint8_t*>(frame.image_data(0).begin());
+            const auto data = const_cast<uint8_t*>(source.image_data(0).begin());
+            ndi_video_frame_.p_data               = data + (fields ? field * stride : 0);
+            ndi_video_frame_.line_stride_in_bytes = fields ? stride * 2 : stride;
         }
-        ndi_lib_->NDIlib_send_send_video_v2(*ndi_send_instance_, &ndi_video_frame_);
+        ndi_lib_->NDIlib_send_send_video_async_v2(*ndi_send_instance_, &ndi_video_frame_);
+
+        // NDI is done with the previous frame once the next one has been handed over.
+        sending_ = std::move(source);
         frame_no_++;
         graph_->set_value("frame-time", frame_timer_.elapsed() * format_desc_.fps * 0.5);
 
@@ -180,7 +294,8 @@ spl::shared_ptr<core::frame_consumer> create_ndi_consumer(const std::vector<std:
         return core::frame_consumer::empty();
     std::wstring name         = get_param(L"NAME", params, L"");
     bool         allow_fields = contains_param(L"ALLOW_FIELDS", params);
-    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields);
+    auto         pixel_format = get_ndi_pixel_format(get_param(L"PIXEL_FORMAT", params, L"uyva"));
+    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields, pixel_format, channels);
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -189,7 +304,8 @@ create_preconfigured_ndi_consumer(const boost::property_tree::wptree&
 {
     auto name         = ptree.get(L"name", L"");
     bool allow_fields = ptree.get(L"allow-fields", false);
-    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields);
+    auto pixel_format = get_ndi_pixel_format(ptree.get(L"pixel-format", L"uyva"));
+    return spl::make_shared<newtek_ndi_consumer>(name, allow_fields, pixel_format, channels);
 }
 
 }} // namespace caspar::newtek
@@ -32,11 +32,11 @@
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
 
+#include <common/array.h>
 #include <common/assert.h>
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
-#include <common/executor.h>
-#include <common/future.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 #include <common/timer.h>
 #include <common/utf.h>
@@ -45,27 +45,43 @@
 #include <boost/format.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/regex.hpp>
-#include <boost/thread.hpp>
 
 #include <tbb/parallel_for.h>
 
-#include <ffmpeg/util/av_util.h>
-
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4244)
-#endif
-extern "C" {
-#include <libavformat/avformat.h>
-}
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <thread>
 
 #include "../util/ndi.h"
 
 namespace caspar { namespace newtek {
 
+namespace {
+
+// Owns the receiver and its frame sync. Captured video is handed to the mixer without copying, so frames that are
+// still queued for upload keep them alive after the producer is gone.
+struct ndi_receiver
+{
+    NDIlib_v3*                  lib       = nullptr;
+    NDIlib_recv_instance_t      recv      = nullptr;
+    NDIlib_framesync_instance_t framesync = nullptr;
+
+    ~ndi_receiver()
+    {
+        if (framesync) {
+            lib->NDIlib_framesync_destroy(framesync);
+        }
+        if (recv) {
+            lib->NDIlib_recv_destroy(recv);
+        }
+    }
+};
+
+} // namespace
+
 struct newtek_ndi_producer : public core::frame_producer
 {
     static std::atomic<int> instances_;
@@ -76,16 +92,18 @@ struct newtek_ndi_producer : public core::frame_producer
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
     NDIlib_v3*                           ndi_lib_;
-    NDIlib_framesync_instance_t          ndi_framesync_;
-    NDIlib_recv_instance_t               ndi_recv_instance_;
+    std::shared_ptr<ndi_receiver>        receiver_;
     spl::shared_ptr<diagnostics::graph>  graph_;
     timer                                tick_timer_;
     timer                                frame_timer_;
 
     std::queue<core::draw_frame> frames_;
     mutable std::mutex           frames_mutex_;
+    std::condition_variable      frames_cond_;
+    int                          requests_ = 0;
+    bool                         abort_    = false;
     core::draw_frame             last_frame_;
-    executor                     executor_;
+    std::thread                  thread_;
 
     int cadence_counter_;
     int cadence_length_;
@@ -100,7 +118,6 @@ struct newtek_ndi_producer : public core::frame_producer
         , name_(name)
         , low_bandwidth_(low_bandwidth)
         , instance_no_(instances_++)
-        , executor_(print())
         , cadence_counter_(0)
     {
         ndi_lib_ = ndi::load_library();
@@ -109,16 +126,23 @@ struct newtek_ndi_producer : public core::frame_producer
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         diagnostics::register_graph(graph_);
-        executor_.set_capacity(2);
         cadence_length_ = static_cast<int>(format_desc_.audio_cadence.size());
         initialize();
+
+        thread_ = std::thread([this] {
+            set_thread_name(print());
+            run();
+        });
     }
 
     ~newtek_ndi_producer()
     {
-        executor_.stop();
-        ndi_lib_->NDIlib_framesync_destroy(ndi_framesync_);
-        ndi_lib_->NDIlib_recv_destroy(ndi_recv_instance_);
+        {
+            std::lock_guard<std::mutex> lock(frames_mutex_);
+            abort_ = true;
+        }
+        frames_cond_.notify_all();
+        thread_.join();
     }
 
     std::wstring print() const override
@@ -132,18 +156,49 @@ struct newtek_ndi_producer : public core::frame_producer
     {
         graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
         tick_timer_.restart();
-        if (executor_.size() < 2) {
-            executor_.begin_invoke([this]() { prepare_next_frame(); });
-        }
         {
             std::lock_guard<std::mutex> lock(frames_mutex_);
+            requests_ = std::min(requests_ + 1, 2);
             if (frames_.size() > 0) {
                 last_frame_ = frames_.front();
                 frames_.pop();
             }
-            return last_frame_;
         }
+        frames_cond_.notify_one();
+        return last_frame_;
+    }
+
+    // Captures one frame per tick on its own thread, so that a slow capture never stalls the channel.
+    void run()
+    {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(frames_mutex_);
+                frames_cond_.wait(lock, [&] { return abort_ || requests_ > 0; });
+                if (abort_) {
+                    return;
+                }
+                --requests_;
+            }
+            prepare_next_frame();
+        }
+    }
+
+    // Wraps the captured video as an upload plane, or returns an empty array if its rows are padded.
+    array<std::uint8_t> wrap_video(const NDIlib_video_frame_v2_t& video_frame, const core::pixel_format_desc& desc)
+    {
+        if (video_frame.line_stride_in_bytes != desc.planes[0].linesize) {
+            return {};
+        }
+
+        auto receiver = receiver_;
+        std::shared_ptr<void> holder(video_frame.p_data, [receiver, video_frame](void*) {
+            auto frame = video_frame;
+            receiver->lib->NDIlib_framesync_free_video(receiver->framesync, &frame);
+        });
+        return array<std::uint8_t>(video_frame.p_data, desc.planes[0].size, std::move(holder));
     }
+
     bool prepare_next_frame()
     {
         try {
@@ -151,52 +206,59 @@ struct newtek_ndi_producer : public core::frame_producer
             NDIlib_video_frame_v2_t video_frame;
             NDIlib_audio_frame_v2_t audio_frame;
             ndi_lib_->NDIlib_framesync_capture_video(
-                ndi_framesync_, &video_frame, NDIlib_frame_format_type_progressive);
-            ndi_lib_->NDIlib_framesync_capture_audio(ndi_framesync_,
+                receiver_->framesync, &video_frame, NDIlib_frame_format_type_progressive);
+            ndi_lib_->NDIlib_framesync_capture_audio(receiver_->framesync,
                                                      &audio_frame,
                                                      format_desc_.audio_sample_rate,
                                                      format_desc_.audio_channels,
                                                      format_desc_.audio_cadence[++cadence_counter_ %= cadence_length_]);
-            if (video_frame.p_data != nullptr) {
-                std::shared_ptr<AVFrame> av_frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
-                std::shared_ptr<AVFrame> a_frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
-                av_frame->data[0]     = video_frame.p_data;
-                av_frame->linesize[0] = video_frame.line_stride_in_bytes;
-                switch (video_frame.FourCC) {
-                    case NDIlib_FourCC_type_BGRA:
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                    case NDIlib_FourCC_type_BGRX:
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                    case NDIlib_FourCC_type_RGBA:
-                        av_frame->format = AV_PIX_FMT_RGBA;
-                        break;
-                    case NDIlib_FourCC_type_RGBX:
-                        av_frame->format = AV_PIX_FMT_RGBA;
-                        break;
-                    default: // should never happen because library handles the conversion for us
-                        av_frame->format = AV_PIX_FMT_BGRA;
-                        break;
-                }
-                av_frame->width  = video_frame.xres;
-                av_frame->height = video_frame.yres;
+
+            std::vector<int32_t> samples;
+            if (audio_frame.p_data != nullptr) {
                 NDIlib_audio_frame_interleaved_32s_t audio_frame_32s;
-                audio_frame_32s.p_data = new int32_t[audio_frame.no_samples * audio_frame.no_channels];
-                if (audio_frame.p_data != nullptr) {
-                    audio_frame_32s.reference_level = 0;
-                    ndi_lib_->NDIlib_util_audio_to_interleaved_32s_v2(&audio_frame, &audio_frame_32s);
-                    a_frame->channels    = audio_frame_32s.no_channels;
-                    a_frame->sample_rate = audio_frame_32s.sample_rate;
-                    a_frame->nb_samples  = audio_frame_32s.no_samples;
-                    a_frame->data[0]     = reinterpret_cast<uint8_t*>(audio_frame_32s.p_data);
+                samples.resize(static_cast<std::size_t>(audio_frame.no_samples) * audio_frame.no_channels);
+                audio_frame_32s.p_data          = samples.data();
+                audio_frame_32s.reference_level = 0;
+                ndi_lib_->NDIlib_util_audio_to_interleaved_32s_v2(&audio_frame, &audio_frame_32s);
+
+                if (audio_frame.no_channels != format_desc_.audio_channels) {
+                    std::vector<int32_t> remapped(static_cast<std::size_t>(audio_frame.no_samples) *
+                                                  format_desc_.audio_channels);
+                    const auto channels = std::min(audio_frame.no_channels, format_desc_.audio_channels);
+                    for (auto n = 0; n < audio_frame.no_samples; ++n) {
+                        std::copy_n(samples.begin() + n * audio_frame.no_channels,
+                                    channels,
+                                    remapped.begin() + n * format_desc_.audio_channels);
+                    }
+                    samples = std::move(remapped);
                 }
-                ndi_lib_->NDIlib_framesync_free_audio(ndi_framesync_, &audio_frame);
-                auto mframe =
-                    ffmpeg::make_frame(this, *(frame_factory_.get()), std::move(av_frame), std::move(a_frame));
-                ndi_lib_->NDIlib_framesync_free_video(ndi_framesync_, &video_frame);
-                delete[] audio_frame_32s.p_data;
-                auto dframe = core::draw_frame(std::move(mframe));
+            }
+            ndi_lib_->NDIlib_framesync_free_audio(receiver_->framesync, &audio_frame);
+
+            if (video_frame.p_data != nullptr) {
+                // Sources without alpha arrive as UYVY and are converted on the gpu, others as BGRA or BGRX.
+                const auto uyvy = video_frame.FourCC == NDIlib_FourCC_type_UYVY;
+
+                core::pixel_format_desc desc(uyvy ? core::pixel_format::uyvy : core::pixel_format::bgra);
+                desc.planes.push_back(uyvy ? core::pixel_format_desc::plane(video_frame.xres / 2, video_frame.yres, 4)
+                                           : core::pixel_format_desc::plane(video_frame.xres, video_frame.yres, 4));
+
+                std::vector<array<std::uint8_t>> planes;
+                if (auto data = wrap_video(video_frame, desc)) {
+                    planes.push_back(std::move(data));
+                } else {
+                    auto copy = frame_factory_->create_frame(this, desc);
+                    tbb::parallel_for(0, video_frame.yres, [&](int y) {
+                        std::memcpy(copy.image_data(0).begin() + y * desc.planes[0].linesize,
+                                    video_frame.p_data + y * video_frame.line_stride_in_bytes,
+                                    desc.planes[0].linesize);
+                    });
+                    ndi_lib_->NDIlib_framesync_free_video(receiver_->framesync, &video_frame);
+                    planes.push_back(std::move(copy.image_data(0)));
+                }
+
+                auto dframe = core::draw_frame(
+                    core::mutable_frame(this, std::move(planes), array<std::int32_t>(std::move(samples)), desc));
                 {
                     std::lock_guard<std::mutex> lock(frames_mutex_);
                     frames_.push(dframe);
@@ -219,26 +281,38 @@ struct newtek_ndi_producer : public core::frame_producer
 
     void initialize()
     {
-        auto sources = ndi::get_current_sources();
+        std::string src_name = u8(name_);
 
-        NDIlib_recv_create_v3_t NDI_recv_create_desc;
-        NDI_recv_create_desc.allow_video_fields = false;
-        NDI_recv_create_desc.bandwidth = low_bandwidth_ ? NDIlib_recv_bandwidth_lowest : NDIlib_recv_bandwidth_highest;
-        NDI_recv_create_desc.color_format = NDIlib_recv_color_format_BGRX_BGRA;
-        std::string src_name              = u8(name_);
+        receiver_      = std::make_shared<ndi_receiver>();
+        receiver_->lib = ndi_lib_;
 
-        auto found_source = sources.find(src_name);
-        if (found_source != sources.end()) {
-            NDI_recv_create_desc.source_to_connect_to = found_source->second;
-        } else {
-            CASPAR_LOG(info) << print() << " Source currently not available.";
-            NDI_recv_create_desc.source_to_connect_to.p_ndi_name = src_name.c_str();
+        if (low_bandwidth_) {
+            receiver_->recv = ndi::take_receiver(src_name);
+        }
+
+        if (!receiver_->recv) {
+            NDIlib_recv_create_v3_t NDI_recv_create_desc;
+            NDI_recv_create_desc.allow_video_fields = false;
+            NDI_recv_create_desc.bandwidth =
+                low_bandwidth_ ? NDIlib_recv_bandwidth_lowest : NDIlib_recv_bandwidth_highest;
+            NDI_recv_create_desc.color_format = NDIlib_recv_color_format_UYVY_BGRA;
+
+            // With the address at hand the receiver connects right away instead of running discovery of its own.
+            auto found_source = ndi::find_source(src_name);
+            if (found_source) {
+                NDI_recv_create_desc.source_to_connect_to = found_source->get();
+            } else {
+                CASPAR_LOG(info) << print() << " Source currently not available.";
+                NDI_recv_create_desc.source_to_connect_to.p_ndi_name = src_name.c_str();
+            }
+            std::string receiver_name =
+                "CasparCG " + u8(env::version()) + " NDI Producer " + std::to_string(instance_no_);
+            NDI_recv_create_desc.p_ndi_recv_name = receiver_name.c_str();
+
+            receiver_->recv = ndi_lib_->NDIlib_recv_create_v3(&NDI_recv_create_desc);
         }
-        std::string receiver_name = "CasparCG " + u8(env::version()) + " NDI Producer " + std::to_string(instance_no_);
-        NDI_recv_create_desc.p_ndi_recv_name = receiver_name.c_str();
-        ndi_recv_instance_                   = ndi_lib_->NDIlib_recv_create_v3(&NDI_recv_create_desc);
-        ndi_framesync_                       = ndi_lib_->NDIlib_framesync_create(ndi_recv_instance_);
-        CASPAR_VERIFY(ndi_recv_instance_);
+        CASPAR_VERIFY(receiver_->recv);
+        receiver_->framesync = ndi_lib_->NDIlib_framesync_create(receiver_->recv);
     }
 
     core::draw_frame last_frame() override
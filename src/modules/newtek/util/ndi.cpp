@@ -23,8 +23,13 @@
 
 #include "ndi.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -35,8 +40,11 @@
 
 #include <common/env.h>
 #include <common/except.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
 
 #include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 namespace caspar { namespace newtek { namespace ndi {
 
@@ -47,8 +55,166 @@ const std::wstring& dll_name()
     return name;
 }
 
-static std::mutex                              find_instance_mutex;
-static std::shared_ptr<NDIlib_find_instance_t> find_instance;
+NDIlib_source_t source::get() const
+{
+    NDIlib_source_t source;
+    source.p_ndi_name    = name.c_str();
+    source.p_url_address = url.empty() ? nullptr : url.c_str();
+    return source;
+}
+
+namespace {
+
+// Keeps the list of sources on the network up to date for the lifetime of the server, so that producers don't have
+// to wait for a finder of their own. Sources listed in ndi.preconnect also get a low bandwidth receiver as soon as
+// they show up.
+class discovery
+{
+    NDIlib_v3* const             lib_;
+    const NDIlib_find_instance_t finder_;
+    std::vector<std::string>     preconnect_;
+
+    mutable std::mutex                            mutex_;
+    std::condition_variable                       cond_;
+    std::map<std::string, source>                 sources_;
+    std::map<std::string, NDIlib_recv_instance_t> receivers_;
+    bool                                          discovered_ = false;
+
+    std::atomic<bool> abort_{false};
+    std::thread       thread_;
+
+  public:
+    explicit discovery(NDIlib_v3* lib)
+        : lib_(lib)
+        , finder_(lib->NDIlib_find_create_v2(nullptr))
+    {
+        if (!finder_) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Unable to create NDI finder."));
+        }
+
+        auto preconnect = env::properties().get_child_optional(L"configuration.ndi.preconnect");
+        if (preconnect) {
+            for (auto& xml : *preconnect) {
+                if (xml.first == L"source") {
+                    preconnect_.push_back(u8(xml.second.get_value<std::wstring>()));
+                }
+            }
+        }
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[ndi::discovery]");
+            try {
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~discovery()
+    {
+        abort_ = true;
+        thread_.join();
+
+        for (auto& p : receivers_) {
+            lib_->NDIlib_recv_destroy(p.second);
+        }
+        lib_->NDIlib_find_destroy(finder_);
+    }
+
+    std::map<std::string, source> sources() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sources_;
+    }
+
+    boost::optional<source> find(const std::string& name)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::seconds(1), [&] { return discovered_; });
+
+        auto it = sources_.find(name);
+        if (it == sources_.end()) {
+            return boost::none;
+        }
+        return it->second;
+    }
+
+    NDIlib_recv_instance_t take(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = receivers_.find(name);
+        if (it == receivers_.end()) {
+            return nullptr;
+        }
+        auto recv = it->second;
+        receivers_.erase(it);
+        return recv;
+    }
+
+  private:
+    void run()
+    {
+        while (!abort_) {
+            update();
+            lib_->NDIlib_find_wait_for_sources(finder_, 500);
+        }
+    }
+
+    void update()
+    {
+        uint32_t                      no_sources = 0;
+        const NDIlib_source_t*        found      = lib_->NDIlib_find_get_current_sources(finder_, &no_sources);
+        std::map<std::string, source> sources;
+        for (uint32_t i = 0; i < no_sources; i++) {
+            source src;
+            src.name = found[i].p_ndi_name ? found[i].p_ndi_name : "";
+            src.url  = found[i].p_url_address ? found[i].p_url_address : "";
+            sources.emplace(src.name, std::move(src));
+        }
+
+        std::vector<std::pair<std::string, NDIlib_recv_instance_t>> connected;
+        for (auto& name : preconnect_) {
+            auto src = sources.find(name);
+            if (src == sources.end() || has_receiver(name)) {
+                continue;
+            }
+
+            std::string             receiver_name = "CasparCG " + u8(env::version()) + " NDI Preconnect";
+            NDIlib_recv_create_v3_t desc;
+            desc.source_to_connect_to = src->second.get();
+            desc.color_format         = NDIlib_recv_color_format_UYVY_BGRA;
+            desc.bandwidth            = NDIlib_recv_bandwidth_lowest;
+            desc.allow_video_fields   = false;
+            desc.p_ndi_recv_name      = receiver_name.c_str();
+
+            auto recv = lib_->NDIlib_recv_create_v3(&desc);
+            if (recv) {
+                CASPAR_LOG(info) << L"ndi[" << u16(name) << L"] Preconnected.";
+                connected.emplace_back(name, recv);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sources_    = std::move(sources);
+            discovered_ = true;
+            receivers_.insert(connected.begin(), connected.end());
+        }
+        cond_.notify_all();
+    }
+
+    bool has_receiver(const std::string& name) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return receivers_.find(name) != receivers_.end();
+    }
+};
+
+discovery* g_discovery = nullptr;
+
+} // namespace
 
 NDIlib_v3* load_library()
 {
@@ -102,28 +268,36 @@ NDIlib_v3* load_library()
 
 #endif
 
-    ndi_lib = (NDIlib_v3*)(NDIlib_v3_load());
+    auto lib = (NDIlib_v3*)(NDIlib_v3_load());
 
-    if (!ndi_lib->NDIlib_initialize()) {
+    if (!lib->NDIlib_initialize()) {
         not_initialized();
     }
 
-    find_instance.reset(new NDIlib_find_instance_t(ndi_lib->NDIlib_find_create_v2(nullptr)),
-                        [](NDIlib_find_instance_t* p) { ndi_lib->NDIlib_find_destroy(*p); });
+    // Destroyed before the library is unloaded.
+    static discovery instance(lib);
+    g_discovery = &instance;
+
+    ndi_lib = lib;
     return ndi_lib;
 }
 
-std::map<std::string, NDIlib_source_t> get_current_sources()
+std::map<std::string, source> get_current_sources()
+{
+    load_library();
+    return g_discovery->sources();
+}
+
+boost::optional<source> find_source(const std::string& name)
+{
+    load_library();
+    return g_discovery->find(name);
+}
+
+NDIlib_recv_instance_t take_receiver(const std::string& name)
 {
-    auto                        sources_map = std::map<std::string, NDIlib_source_t>();
-    uint32_t                    no_sources;
-    std::lock_guard<std::mutex> guard(find_instance_mutex);
-    const NDIlib_source_t*      sources =
-        load_library()->NDIlib_find_get_current_sources(*(find_instance.get()), &no_sources);
-    for (uint32_t i = 0; i < no_sources; i++) {
-        sources_map.emplace(std::string(sources[i].p_ndi_name), sources[i]);
-    }
-    return sources_map;
+    load_library();
+    return g_discovery->take(name);
 }
 
 void not_installed()
@@ -146,10 +320,9 @@ std::wstring list_command(protocol::amcp::command_context& ctx)
     }
     std::wstringstream replyString;
     replyString << L"200 NDI LIST OK\r\n";
-    uint32_t               no_sources;
-    const NDIlib_source_t* sources = ndi_lib->NDIlib_find_get_current_sources(*(find_instance.get()), &no_sources);
-    for (uint32_t i = 0; i < no_sources; i++) {
-        replyString << i + 1 << L" \"" << sources[i].p_ndi_name << L"\" " << sources[i].p_url_address << L"\r\n";
+    auto n = 0;
+    for (auto& p : get_current_sources()) {
+        replyString << ++n << L" \"" << u16(p.second.name) << L"\" " << u16(p.second.url) << L"\r\n";
     }
     replyString << L"\r\n";
     return replyString.str();
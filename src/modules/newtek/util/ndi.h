@@ -22,15 +22,35 @@
 
 #include "../interop/Processing.NDI.Lib.h"
 #include "protocol/amcp/AMCPCommand.h"
+
+#include <boost/optional.hpp>
+
+#include <map>
 #include <string>
 
 namespace caspar { namespace newtek { namespace ndi {
 
-const std::wstring&                    dll_name();
-NDIlib_v3*                             load_library();
-std::map<std::string, NDIlib_source_t> get_current_sources();
-void                                   not_initialized();
-void                                   not_installed();
+// A discovered source. Holds its own copies of the strings, which the finder only keeps until the next update.
+struct source
+{
+    std::string name;
+    std::string url;
+
+    NDIlib_source_t get() const;
+};
+
+const std::wstring&           dll_name();
+NDIlib_v3*                    load_library();
+std::map<std::string, source> get_current_sources();
+void                          not_initialized();
+void                          not_installed();
+
+// Looks name up in the sources kept by the discovery thread. Only waits while the first discovery is still running.
+boost::optional<source> find_source(const std::string& name);
+
+// Hands over the low bandwidth receiver that was connected ahead of time to name, see ndi.preconnect, or returns
+// nullptr. A new one is connected for the next caller.
+NDIlib_recv_instance_t take_receiver(const std::string& name);
 
 std::wstring list_command(protocol::amcp::command_context& ctx);
 
@@ -24,9 +24,9 @@
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/except.h>
-#include <common/executor.h>
 #include <common/future.h>
 #include <common/log.h>
+#include <common/os/thread.h>
 #include <common/param.h>
 #include <common/timer.h>
 
@@ -37,24 +37,13 @@
 
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
-#if defined(_MSC_VER)
-#pragma warning(push)
-#pragma warning(disable : 4244)
-#endif
-extern "C" {
-#define __STDC_CONSTANT_MACROS
-#define __STDC_LIMIT_MACROS
-#include <libavutil/channel_layout.h>
-#include <libavutil/samplefmt.h>
-#include <libswresample/swresample.h>
-}
-#if defined(_MSC_VER)
-#pragma warning(pop)
-#endif
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <AL/al.h>
@@ -106,191 +95,257 @@ void init_device()
     std::call_once(f, [] { instance = std::make_unique<device>(); });
 }
 
+// Interleaved stereo samples handed from the channel to the audio thread, with one writer and one reader.
+class sample_ring
+{
+    std::vector<std::int16_t> data_;
+    std::atomic<std::size_t>  read_{0};
+    std::atomic<std::size_t>  write_{0};
+
+  public:
+    explicit sample_ring(std::size_t capacity)
+        : data_(capacity)
+    {
+    }
+
+    std::size_t size() const { return write_.load(std::memory_order_acquire) - read_.load(std::memory_order_acquire); }
+
+    // Writer. Returns the number of samples that fit, the rest are dropped.
+    std::size_t push(const std::int16_t* samples, std::size_t count)
+    {
+        const auto write = write_.load(std::memory_order_relaxed);
+        const auto read  = read_.load(std::memory_order_acquire);
+
+        count = std::min(count, data_.size() - (write - read));
+        for (std::size_t n = 0; n < count; ++n) {
+            data_[(write + n) % data_.size()] = samples[n];
+        }
+        write_.store(write + count, std::memory_order_release);
+
+        return count;
+    }
+
+    // Reader. Returns the sample at offset from the oldest one, which must be less than size().
+    std::int16_t at(std::size_t offset) const
+    {
+        return data_[(read_.load(std::memory_order_relaxed) + offset) % data_.size()];
+    }
+
+    // Reader.
+    void pop(std::size_t count)
+    {
+        read_.store(read_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+};
+
+// Frames are pushed into a sample ring without blocking the channel. An audio thread refills the OpenAL buffers as
+// they are played and resamples by a ratio that keeps the ring at the configured latency, so that the drift between
+// the channel clock and the sound card never builds up into underruns or overflows.
 struct oal_consumer : public core::frame_consumer
 {
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       perf_timer_;
     int                                 channel_index_ = -1;
+    const int                           latency_;
 
     core::video_format_desc format_desc_;
 
     ALuint              source_ = 0;
     std::vector<ALuint> buffers_;
-    bool                started_  = false;
-    int                 duration_ = 1920;
+    int                 period_ = 480;
 
-    std::shared_ptr<SwrContext> swr_;
+    std::unique_ptr<sample_ring> ring_;
+    std::vector<std::int16_t>    input_;
+    std::vector<std::int16_t>    output_;
+    std::size_t                  target_   = 0;
+    double                       ratio_    = 1.0;
+    double                       position_ = 0.0;
+    bool                         primed_   = false;
 
-    executor executor_{L"oal_consumer"};
+    std::atomic<bool> abort_{false};
+    std::thread       thread_;
 
   public:
-    oal_consumer()
+    explicit oal_consumer(int latency)
+        : latency_(latency)
     {
         init_device();
 
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("buffered-audio", diagnostics::color(0.9f, 0.9f, 0.5f));
         diagnostics::register_graph(graph_);
     }
 
-    ~oal_consumer() override
-    {
-        executor_.invoke([=] {
-            if (source_ != 0u) {
-                alSourceStop(source_);
-                alDeleteSources(1, &source_);
-            }
+    ~oal_consumer() override { stop(); }
 
-            for (auto& buffer : buffers_) {
-                if (buffer != 0u)
-                    alDeleteBuffers(1, &buffer);
-            }
-        });
+    void stop()
+    {
+        abort_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        if (source_ != 0u) {
+            alSourceStop(source_);
+            alDeleteSources(1, &source_);
+            source_ = 0;
+        }
+
+        for (auto& buffer : buffers_) {
+            if (buffer != 0u)
+                alDeleteBuffers(1, &buffer);
+        }
+        buffers_.clear();
     }
 
     // frame consumer
 
     void initialize(const core::video_format_desc& format_desc, int channel_index) override
     {
+        stop();
+
         format_desc_   = format_desc;
         channel_index_ = channel_index;
         graph_->set_text(print());
 
-        executor_.begin_invoke([=] {
-            duration_ = format_desc_.audio_cadence[0];
-            buffers_.resize(8);
-            alGenBuffers(static_cast<ALsizei>(buffers_.size()), buffers_.data());
-            alGenSources(1, &source_);
-
-            alSourcei(source_, AL_LOOPING, AL_FALSE);
+        // Short periods keep the device side latency at about 40 ms, the ring holds the rest.
+        period_   = format_desc_.audio_sample_rate / 100;
+        target_   = static_cast<std::size_t>(format_desc_.audio_sample_rate) * latency_ / 1000;
+        ring_     = std::make_unique<sample_ring>((std::max<std::size_t>(target_, period_) * 4 + 48000) * 2);
+        output_   = std::vector<std::int16_t>(period_ * 2, 0);
+        ratio_    = 1.0;
+        position_ = 0.0;
+        primed_   = false;
+
+        buffers_.resize(4);
+        alGenBuffers(static_cast<ALsizei>(buffers_.size()), buffers_.data());
+        alGenSources(1, &source_);
+        alSourcei(source_, AL_LOOPING, AL_FALSE);
+
+        for (ALuint& buffer : buffers_) {
+            alBufferData(buffer,
+                         AL_FORMAT_STEREO16,
+                         output_.data(),
+                         static_cast<ALsizei>(output_.size() * sizeof(std::int16_t)),
+                         format_desc_.audio_sample_rate);
+            alSourceQueueBuffers(source_, 1, &buffer);
+        }
+        alSourcePlay(source_);
+
+        abort_  = false;
+        thread_ = std::thread([this] {
+            set_thread_name(L"[oal_consumer]");
+            try {
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
         });
     }
 
     std::future<bool> send(core::const_frame frame) override
     {
-        executor_.begin_invoke([=] {
-            auto dst            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            dst->format         = AV_SAMPLE_FMT_S16;
-            dst->sample_rate    = format_desc_.audio_sample_rate;
-            dst->channels       = 2;
-            dst->channel_layout = av_get_default_channel_layout(dst->channels);
-            dst->nb_samples     = duration_;
-            if (av_frame_get_buffer(dst.get(), 32) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
-            std::memset(dst->extended_data[0], 0, dst->linesize[0]);
-
-            if (!started_) {
-                for (ALuint& buffer : buffers_) {
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                }
+        // Only the first two channels are played, mono is played on both.
+        const auto  channels = std::max(format_desc_.audio_channels, 1);
+        const auto& audio    = frame.audio_data();
+        const auto  samples  = audio.size() / channels;
+
+        input_.resize(samples * 2);
+        for (std::size_t n = 0; n < samples; ++n) {
+            const auto left   = audio.data()[n * channels];
+            const auto right  = channels > 1 ? audio.data()[n * channels + 1] : left;
+            input_[n * 2]     = static_cast<std::int16_t>(left >> 16);
+            input_[n * 2 + 1] = static_cast<std::int16_t>(right >> 16);
+        }
+
+        if (ring_->push(input_.data(), input_.size()) < input_.size()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
+        perf_timer_.restart();
 
-                alSourcePlay(source_);
-                started_ = true;
-
-                return;
-            }
-
-            auto src            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            src->format         = AV_SAMPLE_FMT_S32;
-            src->sample_rate    = format_desc_.audio_sample_rate;
-            src->channels       = format_desc_.audio_channels;
-            src->channel_layout = av_get_default_channel_layout(src->channels);
-            src->nb_samples     = static_cast<int>(frame.audio_data().size() / src->channels);
-            src->extended_data[0] = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(frame.audio_data().data()));
-            src->linesize[0]      = static_cast<int>(frame.audio_data().size() * sizeof(int32_t));
-
-            if (!swr_) {
-                swr_.reset(swr_alloc(), [](SwrContext* ptr) { swr_free(&ptr); });
-                if (!swr_) {
-                    CASPAR_THROW_EXCEPTION(bad_alloc());
-                }
-                if (swr_config_frame(swr_.get(), dst.get(), src.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-                if (swr_init(swr_.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-            }
+        return make_ready_future(true);
+    }
 
-            if (swr_convert_frame(swr_.get(), nullptr, src.get()) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
+    void run()
+    {
+        const auto poll = std::chrono::microseconds(1000000LL * period_ / format_desc_.audio_sample_rate / 4);
 
+        while (!abort_) {
             ALint processed = 0;
-            alGetSourceiv(source_, AL_BUFFERS_PROCESSED, &processed);
-
-            auto in_duration  = swr_get_delay(swr_.get(), 48000);
-            auto out_duration = static_cast<int64_t>(processed) * duration_;
-            auto delta        = static_cast<int>(out_duration - in_duration);
-
-            ALenum state;
-            alGetSourcei(source_, AL_SOURCE_STATE, &state);
-            if (state != AL_PLAYING) {
-                while (delta > duration_) {
-                    ALuint buffer = 0;
-                    alSourceUnqueueBuffers(source_, 1, &buffer);
-                    if (buffer == 0u) {
-                        break;
-                    }
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                    delta -= duration_;
-                }
-
-                alSourcePlay(source_);
-            }
-
-            // TODO (fix)
-            // if (std::abs(delta) > duration_ && swr_set_compensation(swr_.get(), delta, 2000) < 0) {
-            //    // TODO FF error
-            //    CASPAR_THROW_EXCEPTION(invalid_argument());
-            //}
+            alGetSourcei(source_, AL_BUFFERS_PROCESSED, &processed);
 
             for (auto n = 0; n < processed; ++n) {
-                if (swr_get_delay(swr_.get(), 48000) < dst->nb_samples) {
-                    break;
-                }
-
                 ALuint buffer = 0;
                 alSourceUnqueueBuffers(source_, 1, &buffer);
                 if (buffer == 0u) {
-                    // TODO error
                     break;
                 }
 
-                if (swr_convert_frame(swr_.get(), dst.get(), nullptr) != 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-
+                fill(output_);
                 alBufferData(buffer,
                              AL_FORMAT_STEREO16,
-                             dst->extended_data[0],
-                             static_cast<ALsizei>(dst->linesize[0]),
-                             dst->sample_rate);
+                             output_.data(),
+                             static_cast<ALsizei>(output_.size() * sizeof(std::int16_t)),
+                             format_desc_.audio_sample_rate);
                 alSourceQueueBuffers(source_, 1, &buffer);
             }
 
-            graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
-            perf_timer_.restart();
-        });
+            ALint state = 0;
+            alGetSourcei(source_, AL_SOURCE_STATE, &state);
+            if (state != AL_PLAYING) {
+                alSourcePlay(source_);
+            }
 
-        return make_ready_future(true);
+            std::this_thread::sleep_for(poll);
+        }
+    }
+
+    // Reads a period from the ring, resampled by a ratio that moves the fill of the ring towards the target.
+    void fill(std::vector<std::int16_t>& output)
+    {
+        const auto available = ring_->size() / 2;
+
+        graph_->set_value("buffered-audio", static_cast<double>(available) / static_cast<double>(target_ * 2 + 1));
+
+        // Waits for the ring to reach its latency before playing, again after an underrun.
+        if (!primed_ && available < target_) {
+            std::fill(output.begin(), output.end(), 0);
+            return;
+        }
+        primed_ = true;
+
+        // A ratio of at most 0.5% off is inaudible, it is smoothed so that jitter in the fill is not.
+        const auto error = (static_cast<double>(available) - static_cast<double>(target_)) /
+                           static_cast<double>(std::max<std::size_t>(target_, period_));
+        const auto ratio = 1.0 + std::max(-0.005, std::min(0.005, error * 0.01));
+        ratio_           = ratio_ * 0.95 + ratio * 0.05;
+
+        auto n = 0;
+        for (; n < period_; ++n) {
+            const auto index = static_cast<std::size_t>(position_);
+            if (index + 1 >= available) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                primed_ = false;
+                break;
+            }
+
+            const auto frac = position_ - static_cast<double>(index);
+            for (auto c = 0; c < 2; ++c) {
+                const auto a      = ring_->at(index * 2 + c);
+                const auto b      = ring_->at(index * 2 + 2 + c);
+                output[n * 2 + c] = static_cast<std::int16_t>(a + (b - a) * frac);
+            }
+            position_ += ratio_;
+        }
+        std::fill(output.begin() + n * 2, output.end(), 0);
+
+        const auto consumed = std::min(static_cast<std::size_t>(position_), available);
+        ring_->pop(consumed * 2);
+        position_ -= static_cast<double>(consumed);
     }
 
     std::wstring print() const override
@@ -302,6 +357,8 @@ struct oal_consumer : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
+    bool needs_host_memory() const override { return false; }
+
     int index() const override { return 500; }
 };
 
@@ -311,14 +368,14 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     if (params.empty() || !boost::iequals(params.at(0), L"AUDIO"))
         return core::frame_consumer::empty();
 
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(get_param(L"LATENCY", params, 40));
 }
 
 spl::shared_ptr<core::frame_consumer>
 create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels)
 {
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(ptree.get(L"latency", 40));
 }
 
 }} // namespace caspar::oal
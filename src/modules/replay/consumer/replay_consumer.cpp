@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_consumer.h"
+
+#include "../util/replay_buffer.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstdint>
+#include <functional>
+
+namespace caspar { namespace replay {
+
+// Keeps the last frames of the channel in a replay_buffer for replay://name producers, instead of encoding them to a
+// file that is decoded again.
+struct replay_consumer : public core::frame_consumer
+{
+    const std::shared_ptr<replay_buffer> buffer_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    caspar::timer                       push_timer_;
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_ = -1;
+
+    core::monitor::state state_;
+
+  public:
+    explicit replay_consumer(std::shared_ptr<replay_buffer> buffer)
+        : buffer_(std::move(buffer))
+    {
+        graph_->set_color("push-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        diagnostics::register_graph(graph_);
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        format_desc_   = format_desc;
+        channel_index_ = channel_index;
+
+        buffer_->reset(format_desc);
+
+        graph_->set_text(print());
+
+        CASPAR_LOG(info) << print() << L" Initialized.";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        push_timer_.restart();
+        buffer_->push(frame);
+        graph_->set_value("push-time", push_timer_.elapsed() * format_desc_.fps * 0.5);
+
+        const auto begin = buffer_->begin();
+        const auto end   = buffer_->end();
+
+        state_["replay/name"]   = buffer_->name();
+        state_["replay/frames"] = end - begin;
+        state_["replay/begin"]  = begin;
+        state_["replay/end"]    = end;
+        state_["replay/bytes"]  = static_cast<std::int64_t>(buffer_->bytes());
+
+        return make_ready_future(true);
+    }
+
+    core::monitor::state state() const override { return state_; }
+
+    std::wstring print() const override
+    {
+        return L"replay[" + buffer_->name() + L"|" + std::to_wstring(channel_index_) + L"|" + format_desc_.name + L"]";
+    }
+
+    std::wstring name() const override { return L"replay"; }
+
+    // Adding a buffer of the same name again replaces it.
+    int index() const override
+    {
+        return 200000 + static_cast<int>(std::hash<std::wstring>{}(boost::to_lower_copy(buffer_->name())) % 100000);
+    }
+};
+
+namespace {
+
+spl::shared_ptr<core::frame_consumer> make_consumer(const std::wstring& name, double seconds, int memory, bool compress)
+{
+    if (name.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"replay consumer needs a name"));
+    }
+    if (seconds <= 0.0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"replay SECONDS must be positive"));
+    }
+    if (memory < 1) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"replay MEMORY must be at least 1 MB"));
+    }
+
+    const auto max_bytes = static_cast<std::size_t>(memory) * 1024 * 1024;
+
+    return spl::make_shared<replay_consumer>(create_replay_buffer(name, seconds, max_bytes, compress));
+}
+
+} // namespace
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"REPLAY")) {
+        return core::frame_consumer::empty();
+    }
+
+    auto seconds  = get_param(L"SECONDS", params, 10.0);
+    auto memory   = get_param(L"MEMORY", params, 2048);
+    auto compress = contains_param(L"COMPRESS", params);
+
+    return make_consumer(params.at(1), seconds, memory, compress);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
+                              const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    auto name     = ptree.get<std::wstring>(L"name");
+    auto seconds  = ptree.get(L"seconds", 10.0);
+    auto memory   = ptree.get(L"memory", 2048);
+    auto compress = ptree.get(L"compress", false);
+
+    return make_consumer(name, seconds, memory, compress);
+}
+
+}} // namespace caspar::replay
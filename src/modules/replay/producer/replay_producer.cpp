@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_producer.h"
+
+#include "../util/replay_buffer.h"
+
+#include <common/array.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <mutex>
+
+namespace caspar { namespace replay {
+
+const double MAX_SPEED = 2.0;
+
+// Plays a replay buffer from a cued frame at a speed of up to MAX_SPEED either way. Every frame shown is one that was
+// recorded, slow motion repeats frames and fast motion skips them, and audio is only heard at normal speed. Playback
+// holds at the newest frame and at the oldest one as it is dropped.
+struct replay_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::shared_ptr<replay_buffer>       buffer_;
+
+    mutable std::mutex mutex_;
+    double             position_;
+    double             speed_;
+    std::int64_t       shown_ = -1;
+
+    std::int64_t     number_ = -1;
+    core::draw_frame frame_;
+
+    core::monitor::state state_;
+
+    replay_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                    std::shared_ptr<replay_buffer>              buffer,
+                    std::int64_t                                seek,
+                    double                                      speed)
+        : frame_factory_(frame_factory)
+        , buffer_(std::move(buffer))
+        , speed_(speed)
+    {
+        position_ = static_cast<double>(resolve(seek));
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // Counts seek from the oldest frame, or back from the newest one if it is negative.
+    std::int64_t resolve(std::int64_t seek) const
+    {
+        return clamp(seek < 0 ? buffer_->end() + seek : buffer_->begin() + seek);
+    }
+
+    std::int64_t clamp(std::int64_t number) const
+    {
+        return std::max(buffer_->begin(), std::min(number, buffer_->end() - 1));
+    }
+
+    // The frame numbered number, or the last one drawn if it is gone. Frames that are shown again, e.g. in slow
+    // motion, are not copied and uploaded again.
+    core::draw_frame draw(std::int64_t number)
+    {
+        if (number == number_ && frame_) {
+            return frame_;
+        }
+
+        auto entry = buffer_->get(number);
+        if (!entry) {
+            return frame_;
+        }
+
+        core::pixel_format_desc desc(entry->format);
+        desc.planes.push_back(entry->format == core::pixel_format::dxt5
+                                  ? core::pixel_format_desc::plane::blocks(entry->width, entry->height, 16)
+                                  : core::pixel_format_desc::plane(entry->width, entry->height, 4));
+
+        auto frame = frame_factory_->create_frame(this, desc);
+        std::copy_n(entry->image.begin(), frame.image_data(0).size(), frame.image_data(0).begin());
+        frame.audio_data() = array<std::int32_t>(entry->audio);
+
+        number_ = number;
+        frame_  = core::draw_frame(std::move(frame));
+
+        return frame_;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto begin = buffer_->begin();
+        const auto end   = buffer_->end();
+        if (end == begin) {
+            return core::draw_frame::still(frame_);
+        }
+
+        const auto number  = clamp(static_cast<std::int64_t>(std::floor(position_)));
+        const auto audible = speed_ == 1.0 && number != shown_;
+
+        auto frame = draw(number);
+        shown_     = number;
+
+        position_ = std::max(static_cast<double>(begin), std::min(position_ + speed_, static_cast<double>(end - 1)));
+
+        state_["replay/name"]  = buffer_->name();
+        state_["replay/speed"] = speed_;
+        state_["replay/frame"] = {number - begin, end - begin};
+
+        return audible ? frame : core::draw_frame::still(frame);
+    }
+
+    core::draw_frame first_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(draw(clamp(static_cast<std::int64_t>(std::floor(position_)))));
+    }
+
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(frame_);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+
+        std::wstring cmd = params.at(0);
+        std::wstring value;
+        if (params.size() > 1) {
+            value = params.at(1);
+        }
+
+        if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                auto speed = boost::lexical_cast<double>(value);
+                if (std::abs(speed) > MAX_SPEED) {
+                    CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"replay SPEED must be between -2 and 2"));
+                }
+                speed_ = speed;
+            }
+
+            result = boost::lexical_cast<std::wstring>(speed_);
+        } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            const auto begin = buffer_->begin();
+
+            std::int64_t seek;
+            if (boost::iequals(value, L"rel")) {
+                seek = static_cast<std::int64_t>(std::floor(position_)) - begin;
+            } else if (boost::iequals(value, L"in") || boost::iequals(value, L"begin")) {
+                seek = 0;
+            } else if (boost::iequals(value, L"out") || boost::iequals(value, L"end")) {
+                seek = -1;
+            } else {
+                seek = boost::lexical_cast<std::int64_t>(value);
+            }
+
+            if (params.size() > 2) {
+                const auto offset = boost::lexical_cast<std::int64_t>(params.at(2));
+                seek = seek < 0 ? std::min<std::int64_t>(seek + offset, -1) : std::max<std::int64_t>(seek + offset, 0);
+            }
+
+            const auto number = resolve(seek);
+            position_         = static_cast<double>(number);
+
+            result = std::to_wstring(number - begin);
+        } else {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        std::promise<std::wstring> promise;
+        promise.set_value(result);
+        return promise.get_future();
+    }
+
+    std::wstring print() const override { return L"replay_producer[" + buffer_->name() + L"]"; }
+
+    std::wstring name() const override { return L"replay"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static boost::wregex expr(L"replay://(?<NAME>.+)", boost::regex::icase);
+    boost::wsmatch       what;
+
+    if (params.empty() || !boost::regex_match(params.at(0), what, expr)) {
+        return core::frame_producer::empty();
+    }
+
+    auto name   = what["NAME"].str();
+    auto buffer = find_replay_buffer(name);
+    if (!buffer) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No replay consumer records " + name));
+    }
+
+    auto seek  = get_param(L"SEEK", params, static_cast<std::int64_t>(0));
+    auto speed = get_param(L"SPEED", params, 1.0);
+    if (std::abs(speed) > MAX_SPEED) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"replay SPEED must be between -2 and 2"));
+    }
+
+    return spl::make_shared<replay_producer>(dependencies.frame_factory, std::move(buffer), seek, speed);
+}
+
+}} // namespace caspar::replay
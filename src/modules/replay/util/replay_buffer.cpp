@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_buffer.h"
+
+#include <image/util/dxt.h>
+
+#include <core/frame/frame.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace caspar { namespace replay {
+
+namespace {
+
+std::size_t size_of(const replay_buffer::frame& frame)
+{
+    return frame.image.size() + frame.audio.size() * sizeof(std::int32_t);
+}
+
+} // namespace
+
+replay_buffer::replay_buffer(std::wstring name, double seconds, std::size_t max_bytes, bool compress)
+    : name_(std::move(name))
+    , seconds_(seconds)
+    , max_bytes_(max_bytes)
+    , compress_(compress)
+{
+}
+
+void replay_buffer::reset(const core::video_format_desc& format_desc)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (format_desc != format_desc_) {
+        begin_ += static_cast<std::int64_t>(frames_.size());
+        frames_.clear();
+        bytes_ = 0;
+    }
+    format_desc_ = format_desc;
+    max_frames_  = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(seconds_ * format_desc.fps)));
+}
+
+void replay_buffer::push(const core::const_frame& source)
+{
+    if (!source || source.pixel_format_desc().format != core::pixel_format::bgra ||
+        source.pixel_format_desc().planes.empty()) {
+        return;
+    }
+
+    const auto& plane = source.pixel_format_desc().planes.at(0);
+    const auto& data  = source.image_data(0);
+    if (data.size() < static_cast<std::size_t>(plane.size)) {
+        return;
+    }
+
+    // Dropped frames that no producer holds on to are refilled rather than allocated anew.
+    std::shared_ptr<frame> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entry = std::move(spare_);
+    }
+    if (!entry) {
+        entry = std::make_shared<frame>();
+    }
+
+    entry->width  = plane.width;
+    entry->height = plane.height;
+    if (compress_) {
+        entry->format = core::pixel_format::dxt5;
+        entry->image.resize(core::pixel_format_desc::plane::blocks(plane.width, plane.height, 16).size);
+        image::compress_dxt5(data.data(), plane.width, plane.height, entry->image.data());
+    } else {
+        entry->format = core::pixel_format::bgra;
+        entry->image.assign(data.begin(), data.begin() + plane.size);
+    }
+
+    const auto& audio = source.audio_data();
+    entry->audio.assign(audio.begin(), audio.end());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bytes_ += size_of(*entry);
+    frames_.push_back(std::move(entry));
+
+    while (frames_.size() > 1 && (frames_.size() > max_frames_ || bytes_ > max_bytes_)) {
+        auto& oldest = frames_.front();
+        bytes_ -= size_of(*oldest);
+        if (oldest.use_count() == 1) {
+            spare_ = std::move(oldest);
+        }
+        frames_.pop_front();
+        ++begin_;
+    }
+}
+
+std::shared_ptr<const replay_buffer::frame> replay_buffer::get(std::int64_t number) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (number < begin_ || number >= begin_ + static_cast<std::int64_t>(frames_.size())) {
+        return nullptr;
+    }
+    return frames_[static_cast<std::size_t>(number - begin_)];
+}
+
+std::int64_t replay_buffer::begin() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return begin_;
+}
+
+std::int64_t replay_buffer::end() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return begin_ + static_cast<std::int64_t>(frames_.size());
+}
+
+std::size_t replay_buffer::bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+core::video_format_desc replay_buffer::format_desc() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return format_desc_;
+}
+
+namespace {
+
+std::mutex                                           buffers_mutex;
+std::map<std::wstring, std::weak_ptr<replay_buffer>> buffers;
+
+} // namespace
+
+std::shared_ptr<replay_buffer>
+create_replay_buffer(const std::wstring& name, double seconds, std::size_t max_bytes, bool compress)
+{
+    auto buffer = std::make_shared<replay_buffer>(name, seconds, max_bytes, compress);
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffers[boost::to_lower_copy(name)] = buffer;
+
+    return buffer;
+}
+
+std::shared_ptr<replay_buffer> find_replay_buffer(const std::wstring& name)
+{
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+
+    auto it = buffers.find(boost::to_lower_copy(name));
+    return it != buffers.end() ? it->second.lock() : nullptr;
+}
+
+}} // namespace caspar::replay
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/frame/pixel_format.h>
+#include <core/fwd.h>
+#include <core/video_format.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace replay {
+
+// The last frames of a channel, kept in host memory by a replay consumer for replay producers to read from. Frames are
+// numbered from the first one pushed, so that a position stays on the same frame while older ones are dropped. Frames
+// are kept as bgra or, compressed, as dxt5 blocks, until there is more than seconds of them or they take more than
+// max_bytes.
+class replay_buffer
+{
+  public:
+    struct frame
+    {
+        core::pixel_format        format = core::pixel_format::bgra;
+        int                       width  = 0;
+        int                       height = 0;
+        std::vector<std::uint8_t> image;
+        std::vector<std::int32_t> audio;
+    };
+
+    replay_buffer(std::wstring name, double seconds, std::size_t max_bytes, bool compress);
+
+    replay_buffer(const replay_buffer&) = delete;
+    replay_buffer& operator=(const replay_buffer&) = delete;
+
+    // Drops all frames if the format changes.
+    void reset(const core::video_format_desc& format_desc);
+
+    void push(const core::const_frame& frame);
+
+    // Returns the frame numbered number, or nullptr if it has been dropped or isn't there yet.
+    std::shared_ptr<const frame> get(std::int64_t number) const;
+
+    // The number of the oldest frame and the one after the newest.
+    std::int64_t begin() const;
+    std::int64_t end() const;
+
+    std::size_t bytes() const;
+
+    core::video_format_desc format_desc() const;
+
+    const std::wstring& name() const { return name_; }
+    bool                compress() const { return compress_; }
+
+  private:
+    const std::wstring name_;
+    const double       seconds_;
+    const std::size_t  max_bytes_;
+    const bool         compress_;
+
+    mutable std::mutex                 mutex_;
+    core::video_format_desc            format_desc_;
+    std::size_t                        max_frames_ = 0;
+    std::deque<std::shared_ptr<frame>> frames_;
+    std::int64_t                       begin_ = 0;
+    std::size_t                        bytes_ = 0;
+    std::shared_ptr<frame>             spare_;
+};
+
+// Creates the buffer that replay://name reads from, taking over the name from any earlier one.
+std::shared_ptr<replay_buffer>
+create_replay_buffer(const std::wstring& name, double seconds, std::size_t max_bytes, bool compress);
+
+// Returns the buffer named name, or nullptr while no replay consumer records under it.
+std::shared_ptr<replay_buffer> find_replay_buffer(const std::wstring& name);
+
+}} // namespace caspar::replay
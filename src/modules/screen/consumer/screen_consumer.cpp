@@ -44,9 +44,12 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -63,6 +66,7 @@
 #include "consumer_screen_fragment.h"
 #include "consumer_screen_vertex.h"
 #include <accelerator/ogl/util/shader.h>
+#include <accelerator/ogl/util/texture.h>
 
 namespace caspar { namespace screen {
 
@@ -111,6 +115,7 @@ struct configuration
     bool            borderless    = false;
     bool            always_on_top = false;
     colour_spaces   colour_space  = colour_spaces::RGB;
+    bool            gpu_texture   = true;
 };
 
 struct frame
@@ -129,6 +134,11 @@ struct screen_consumer
 
     std::vector<frame> frames_;
 
+    // Mixed textures are sampled from the context of the window, which shares objects with the mixer's. The frames
+    // of the last ticks are held so that their textures aren't reused by the mixer while they're still drawn.
+    GLuint                        sampler_ = 0;
+    std::deque<core::const_frame> shown_frames_;
+
     int screen_width_  = format_desc_.width;
     int screen_height_ = format_desc_.height;
     int square_width_  = format_desc_.square_width;
@@ -143,7 +153,10 @@ struct screen_consumer
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    // Only the newest frame is kept, so that a late screen skips frames instead of holding up the channel.
+    std::mutex              frame_mutex_;
+    std::condition_variable frame_cond_;
+    core::const_frame       next_frame_;
 
     std::unique_ptr<accelerator::ogl::shader> shader_;
     GLuint                                    vao_;
@@ -172,11 +185,10 @@ struct screen_consumer
             }
         }
 
-        frame_buffer_.set_capacity(1);
-
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
@@ -272,7 +284,19 @@ struct screen_consumer
                 shader_->set("background", 0);
                 shader_->set("window_width", screen_width_);
 
-                for (int n = 0; n < 2; ++n) {
+                // Frames are uploaded a tick ahead of display, so with three buffers the upload fence that is
+                // waited on is two ticks old and has normally signalled.
+                const auto filter = (config_.colour_space == configuration::colour_spaces::datavideo_full ||
+                                     config_.colour_space == configuration::colour_spaces::datavideo_limited)
+                                        ? GL_NEAREST
+                                        : GL_LINEAR;
+                GL(glCreateSamplers(1, &sampler_));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_MIN_FILTER, filter));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_MAG_FILTER, filter));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+                GL(glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+                for (int n = 0; n < 3; ++n) {
                     screen::frame frame;
                     auto          flags = GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_WRITE_BIT;
                     GL(glCreateBuffers(1, &frame.pbo));
@@ -324,8 +348,6 @@ struct screen_consumer
                 while (is_running_) {
                     tick();
                 }
-            } catch (tbb::user_abort&) {
-                // Do nothing
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
                 is_running_ = false;
@@ -336,6 +358,9 @@ struct screen_consumer
                 glDeleteTextures(1, &frame.tex);
             }
 
+            shown_frames_.clear();
+            glDeleteSamplers(1, &sampler_);
+
             shader_.reset();
             GL(glDeleteVertexArrays(1, &vao_));
             GL(glDeleteBuffers(1, &vbo_));
@@ -347,7 +372,7 @@ struct screen_consumer
     ~screen_consumer()
     {
         is_running_ = false;
-        frame_buffer_.abort();
+        frame_cond_.notify_all();
         thread_.join();
     }
 
@@ -370,30 +395,45 @@ struct screen_consumer
     {
         core::const_frame in_frame;
 
-        while (!frame_buffer_.try_pop(in_frame) && is_running_) {
-            // TODO (fix)
-            if (!poll()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        // Window events are still polled while the channel is paused or slow.
+        while (!in_frame && is_running_) {
+            {
+                std::unique_lock<std::mutex> lock(frame_mutex_);
+                frame_cond_.wait_for(
+                    lock, std::chrono::milliseconds(5), [&] { return static_cast<bool>(next_frame_) || !is_running_; });
+                std::swap(in_frame, next_frame_);
             }
+            poll();
         }
 
         if (!in_frame) {
             return;
         }
 
+        std::shared_ptr<accelerator::ogl::texture> texture;
+        if (config_.gpu_texture) {
+            auto textures = boost::any_cast<
+                std::shared_ptr<std::vector<std::shared_future<std::shared_ptr<accelerator::ogl::texture>>>>>(
+                &in_frame.opaque());
+            if (textures && *textures && !(*textures)->empty()) {
+                texture = (*textures)->front().get();
+            }
+        }
+
         // Upload
-        {
+        if (!texture) {
             auto& frame = frames_.front();
 
             while (frame.fence != nullptr) {
-                auto wait = glClientWaitSync(frame.fence, 0, 0);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
+                auto wait = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 5000000);
+                if (wait != GL_TIMEOUT_EXPIRED) {
+                    if (wait == GL_WAIT_FAILED) {
+                        CASPAR_LOG(warning) << print() << L" Failed to wait for upload.";
+                    }
                     glDeleteSync(frame.fence);
                     frame.fence = nullptr;
-                }
-                if (!poll()) {
-                    // TODO (fix)
-                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                } else {
+                    poll();
                 }
             }
 
@@ -409,12 +449,11 @@ struct screen_consumer
 
         // Display
         {
-            auto& frame = frames_.back();
-
             GL(glClear(GL_COLOR_BUFFER_BIT));
 
             GL(glActiveTexture(GL_TEXTURE0));
-            GL(glBindTexture(GL_TEXTURE_2D, frame.tex));
+            GL(glBindTexture(GL_TEXTURE_2D, texture ? static_cast<GLuint>(texture->id()) : frames_.back().tex));
+            GL(glBindSampler(0, sampler_));
 
             GL(glBufferData(GL_ARRAY_BUFFER,
                             static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * draw_coords_.size(),
@@ -452,22 +491,44 @@ struct screen_consumer
             GL(glDisableVertexAttribArray(vtx_loc));
             GL(glDisableVertexAttribArray(tex_loc));
 
+            GL(glBindSampler(0, 0));
             GL(glBindTexture(GL_TEXTURE_2D, 0));
         }
 
+        caspar::timer present_timer;
         window_.display();
+        graph_->set_value("frame-time", present_timer.elapsed() * format_desc_.fps * 0.5);
 
-        std::rotate(frames_.begin(), frames_.begin() + 1, frames_.end());
+        if (texture) {
+            shown_frames_.push_back(std::move(in_frame));
+            while (shown_frames_.size() > 2) {
+                shown_frames_.pop_front();
+            }
+        } else {
+            shown_frames_.clear();
+            std::rotate(frames_.begin(), frames_.begin() + 1, frames_.end());
+        }
 
-        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        // With vsync a frame is late when it missed the refresh after the one it was due for.
+        auto interval = tick_timer_.elapsed() * format_desc_.fps;
+        if (config_.vsync && interval > 1.5) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+        }
+        graph_->set_value("tick-time", interval * 0.5);
         tick_timer_.restart();
     }
 
     std::future<bool> send(const core::const_frame& frame)
     {
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        {
+            std::lock_guard<std::mutex> lock(frame_mutex_);
+            if (next_frame_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+            next_frame_ = frame;
         }
+        frame_cond_.notify_one();
+
         return make_ready_future(is_running_.load());
     }
 
@@ -592,6 +653,8 @@ struct screen_consumer_proxy : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
+    bool needs_host_memory() const override { return !config_.gpu_texture; }
+
     int index() const override { return 600 + (config_.key_only ? 10 : 0) + config_.screen_index; }
 };
 
@@ -647,6 +710,7 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     config.interactive   = ptree.get(L"interactive", config.interactive);
     config.borderless    = ptree.get(L"borderless", config.borderless);
     config.always_on_top = ptree.get(L"always-on-top", config.always_on_top);
+    config.gpu_texture   = ptree.get(L"gpu-texture", config.gpu_texture);
 
     auto colour_space_value = ptree.get(L"colour-space", L"RGB");
     config.colour_space     = configuration::colour_spaces::RGB;
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shm_consumer.h"
+
+#include "../util/frame_ring.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstdint>
+#include <functional>
+
+namespace caspar { namespace shm {
+
+// Writes the frames of the channel to a ring in shared memory with one copy each, for shm:// producers in other
+// servers and for other processes on the host. The ring is set up again when the format of the channel changes.
+struct shm_consumer : public core::frame_consumer
+{
+    const std::wstring name_;
+    const int          slot_count_;
+
+    std::unique_ptr<frame_ring_writer> writer_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    caspar::timer                       write_timer_;
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_ = -1;
+    std::int64_t                        frame_count_   = 0;
+
+    core::monitor::state state_;
+
+  public:
+    shm_consumer(std::wstring name, int slot_count)
+        : name_(std::move(name))
+        , slot_count_(slot_count)
+    {
+        graph_->set_color("write-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        diagnostics::register_graph(graph_);
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        format_desc_   = format_desc;
+        channel_index_ = channel_index;
+
+        writer_.reset();
+        writer_.reset(new frame_ring_writer(name_, format_desc, slot_count_));
+        frame_count_ = 0;
+
+        graph_->set_text(print());
+
+        CASPAR_LOG(info) << print() << L" Initialized.";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        write_timer_.restart();
+        writer_->write(frame);
+        graph_->set_value("write-time", write_timer_.elapsed() * format_desc_.fps * 0.5);
+
+        ++frame_count_;
+
+        state_["shm/name"]   = name_;
+        state_["shm/slots"]  = slot_count_;
+        state_["shm/frames"] = frame_count_;
+
+        return make_ready_future(true);
+    }
+
+    core::monitor::state state() const override { return state_; }
+
+    std::wstring print() const override
+    {
+        return L"shm[" + name_ + L"|" + std::to_wstring(channel_index_) + L"|" + format_desc_.name + L"]";
+    }
+
+    std::wstring name() const override { return L"shm"; }
+
+    // Adding a ring of the same name again replaces it.
+    int index() const override
+    {
+        return 300000 + static_cast<int>(std::hash<std::wstring>{}(boost::to_lower_copy(name_)) % 100000);
+    }
+};
+
+namespace {
+
+spl::shared_ptr<core::frame_consumer> make_consumer(const std::wstring& name, int slot_count)
+{
+    if (name.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"shm consumer needs a name"));
+    }
+    if (slot_count < 2) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"shm SLOTS must be at least 2"));
+    }
+
+    return spl::make_shared<shm_consumer>(name, slot_count);
+}
+
+} // namespace
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"SHM")) {
+        return core::frame_consumer::empty();
+    }
+
+    return make_consumer(params.at(1), get_param(L"SLOTS", params, 4));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
+                              const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    return make_consumer(ptree.get<std::wstring>(L"name"), ptree.get(L"slots", 4));
+}
+
+}} // namespace caspar::shm
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shm_producer.h"
+
+#include "../util/frame_ring.h"
+
+#include <common/array.h>
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/timer.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/regex.hpp>
+
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace shm {
+
+// A reader that is more frames behind than this skips to the newest one, so that a writer running slightly faster
+// doesn't add latency.
+const int MAX_LAG = 2;
+
+// How long a ring may go without new frames or remain missing before it is opened again, e.g. for a writer that was
+// restarted.
+const double REOPEN_INTERVAL = 1.0;
+
+// Plays the frames written by a shm consumer in this or another server, copying each from shared memory into a frame
+// once. The last frame is shown until there is a new one, and audio is only kept when its layout matches the channel.
+struct shm_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::video_format_desc              format_desc_;
+    const std::wstring                         name_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+
+    mutable std::mutex                 mutex_;
+    std::unique_ptr<frame_ring_reader> reader_;
+    caspar::timer                      reopen_timer_;
+    caspar::timer                      stale_timer_;
+    std::int64_t                       number_ = -1;
+    std::vector<std::int32_t>          audio_;
+    core::draw_frame                   frame_;
+
+    core::monitor::state state_;
+
+    shm_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                 const core::video_format_desc&              format_desc,
+                 std::wstring                                name)
+        : frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , name_(std::move(name))
+    {
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        open();
+        if (!reader_) {
+            CASPAR_LOG(info) << print() << L" Waiting for " << name_ << L".";
+        }
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    void open()
+    {
+        reopen_timer_.restart();
+        stale_timer_.restart();
+
+        const auto was_open = static_cast<bool>(reader_);
+        reader_.reset();
+
+        try {
+            reader_.reset(new frame_ring_reader(name_));
+            number_ = -1;
+
+            if (!audible()) {
+                CASPAR_LOG(warning) << print() << L" Audio layout differs from the channel, audio is left out.";
+            }
+        } catch (...) {
+            if (was_open) {
+                CASPAR_LOG(warning) << print() << L" Lost " << name_ << L".";
+            }
+        }
+    }
+
+    bool audible() const
+    {
+        const auto& format = reader_->format();
+        return format.channels == format_desc_.audio_channels && format.sample_rate == format_desc_.audio_sample_rate;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (reader_ ? reader_->closed() || stale_timer_.elapsed() > REOPEN_INTERVAL
+                    : reopen_timer_.elapsed() > REOPEN_INTERVAL) {
+            open();
+        }
+
+        if (reader_ && reader_->available()) {
+            const auto& format = reader_->format();
+
+            core::pixel_format_desc desc(core::pixel_format::bgra);
+            desc.planes.push_back(core::pixel_format_desc::plane(format.width, format.height, 4));
+
+            auto       frame  = frame_factory_->create_frame(this, desc);
+            const auto number = reader_->read(frame.image_data(0).data(), audio_, MAX_LAG);
+            if (number >= 0) {
+                if (number_ >= 0 && number > number_ + 1) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                }
+                if (audible()) {
+                    frame.audio_data() = array<std::int32_t>(audio_);
+                }
+
+                number_ = number;
+                frame_  = core::draw_frame(std::move(frame));
+                stale_timer_.restart();
+
+                state_["shm/name"]  = name_;
+                state_["shm/frame"] = number_;
+
+                return frame_;
+            }
+        }
+
+        if (reader_ && number_ >= 0) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+        }
+
+        return core::draw_frame::still(frame_);
+    }
+
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return core::draw_frame::still(frame_);
+    }
+
+    std::wstring print() const override { return L"shm_producer[" + name_ + L"]"; }
+
+    std::wstring name() const override { return L"shm"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static boost::wregex expr(L"shm://(?<NAME>.+)", boost::regex::icase);
+    boost::wsmatch       what;
+
+    if (params.empty() || !boost::regex_match(params.at(0), what, expr)) {
+        return core::frame_producer::empty();
+    }
+
+    return spl::make_shared<shm_producer>(dependencies.frame_factory, dependencies.format_desc, what["NAME"].str());
+}
+
+}} // namespace caspar::shm
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_ring.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <boost/interprocess/mapped_region.hpp>
+#ifdef _WIN32
+#include <boost/interprocess/windows_shared_memory.hpp>
+#else
+#include <boost/interprocess/shared_memory_object.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+namespace caspar { namespace shm {
+
+namespace {
+
+const std::uint32_t MAGIC   = 0x46474343; // "CCGF"
+const std::uint32_t VERSION = 1;
+
+struct header
+{
+    std::uint32_t              magic;
+    std::uint32_t              version;
+    std::uint32_t              slot_count;
+    std::uint32_t              slot_size;
+    std::uint32_t              width;
+    std::uint32_t              height;
+    std::uint32_t              stride;
+    std::uint32_t              field_count;
+    std::uint32_t              time_scale;
+    std::uint32_t              duration;
+    std::uint32_t              sample_rate;
+    std::uint32_t              channels;
+    std::uint32_t              audio_offset;
+    std::uint32_t              reserved;
+    std::atomic<std::uint64_t> write_count;
+};
+
+struct slot
+{
+    std::atomic<std::uint64_t> sequence;
+    std::uint32_t              image_size;
+    std::uint32_t              audio_samples;
+    std::int64_t               time;
+};
+
+const std::size_t HEADER_SIZE = 128;
+const std::size_t SLOT_HEADER = 64;
+
+static_assert(sizeof(header) <= HEADER_SIZE, "header doesn't fit");
+static_assert(sizeof(slot) <= SLOT_HEADER, "slot header doesn't fit");
+
+std::size_t align(std::size_t size) { return (size + 63) & ~static_cast<std::size_t>(63); }
+
+std::size_t image_size(const frame_ring_format& format)
+{
+    return static_cast<std::size_t>(format.width) * format.height * 4;
+}
+
+frame_ring_format read_format(const header& h)
+{
+    frame_ring_format format;
+    format.width         = static_cast<int>(h.width);
+    format.height        = static_cast<int>(h.height);
+    format.field_count   = static_cast<int>(h.field_count);
+    format.time_scale    = static_cast<int>(h.time_scale);
+    format.duration      = static_cast<int>(h.duration);
+    format.sample_rate   = static_cast<int>(h.sample_rate);
+    format.channels      = static_cast<int>(h.channels);
+    format.audio_samples = static_cast<int>((h.slot_size - h.audio_offset) / sizeof(std::int32_t));
+    return format;
+}
+
+#ifdef _WIN32
+using shared_memory = boost::interprocess::windows_shared_memory;
+
+// A file mapping lives for as long as a handle to it is open, so one that readers still hold on to is set up again in
+// place.
+shared_memory create_shared_memory(const std::string& name, std::size_t size)
+{
+    return shared_memory(boost::interprocess::open_or_create, name.c_str(), boost::interprocess::read_write, size);
+}
+#else
+using shared_memory = boost::interprocess::shared_memory_object;
+
+// Readers keep their mapping of a ring that is removed, and see that it has been closed.
+shared_memory create_shared_memory(const std::string& name, std::size_t size)
+{
+    shared_memory::remove(name.c_str());
+
+    shared_memory shm(boost::interprocess::create_only, name.c_str(), boost::interprocess::read_write);
+    shm.truncate(static_cast<boost::interprocess::offset_t>(size));
+    return shm;
+}
+#endif
+
+} // namespace
+
+bool frame_ring_format::operator==(const frame_ring_format& other) const
+{
+    return width == other.width && height == other.height && field_count == other.field_count &&
+           time_scale == other.time_scale && duration == other.duration && sample_rate == other.sample_rate &&
+           channels == other.channels && audio_samples == other.audio_samples;
+}
+
+struct frame_ring_writer::impl
+{
+    const std::string                  name_;
+    shared_memory                      shm_;
+    boost::interprocess::mapped_region region_;
+    header*                            header_ = nullptr;
+    frame_ring_format                  format_;
+    std::uint32_t                      slot_count_;
+    std::size_t                        slot_size_;
+    std::size_t                        audio_offset_;
+
+    impl(const std::wstring& name, const core::video_format_desc& format_desc, int slot_count)
+        : name_(u8(name))
+        , slot_count_(static_cast<std::uint32_t>(slot_count))
+    {
+        if (name.empty() || slot_count < 2) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Invalid frame ring."));
+        }
+
+        const auto cadence = *std::max_element(format_desc.audio_cadence.begin(), format_desc.audio_cadence.end());
+
+        format_.width         = format_desc.width;
+        format_.height        = format_desc.height;
+        format_.field_count   = format_desc.field_count;
+        format_.time_scale    = format_desc.time_scale;
+        format_.duration      = format_desc.duration;
+        format_.sample_rate   = format_desc.audio_sample_rate;
+        format_.channels      = format_desc.audio_channels;
+        format_.audio_samples = cadence * format_desc.audio_channels;
+
+        audio_offset_ = align(SLOT_HEADER + image_size(format_));
+        slot_size_    = align(audio_offset_ + format_.audio_samples * sizeof(std::int32_t));
+
+        const auto size = HEADER_SIZE + slot_count_ * slot_size_;
+
+        shm_    = create_shared_memory(name_, size);
+        region_ = boost::interprocess::mapped_region(shm_, boost::interprocess::read_write);
+        if (region_.get_size() < size) {
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"shm " + name + L" is still open for a smaller format elsewhere"));
+        }
+
+        header_ = static_cast<header*>(region_.get_address());
+
+        // Readers of a ring that is set up again in place see that its magic has gone before anything else changes.
+        header_->magic = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memset(static_cast<std::uint8_t*>(region_.get_address()) + sizeof(std::uint32_t),
+                    0,
+                    region_.get_size() - sizeof(std::uint32_t));
+
+        for (std::uint32_t n = 0; n < slot_count_; ++n) {
+            new (get_slot(n)) slot();
+        }
+
+        header_              = new (region_.get_address()) header();
+        header_->version      = VERSION;
+        header_->slot_count   = slot_count_;
+        header_->slot_size    = static_cast<std::uint32_t>(slot_size_);
+        header_->width        = static_cast<std::uint32_t>(format_.width);
+        header_->height       = static_cast<std::uint32_t>(format_.height);
+        header_->stride       = static_cast<std::uint32_t>(format_.width * 4);
+        header_->field_count  = static_cast<std::uint32_t>(format_.field_count);
+        header_->time_scale   = static_cast<std::uint32_t>(format_.time_scale);
+        header_->duration     = static_cast<std::uint32_t>(format_.duration);
+        header_->sample_rate  = static_cast<std::uint32_t>(format_.sample_rate);
+        header_->channels     = static_cast<std::uint32_t>(format_.channels);
+        header_->audio_offset = static_cast<std::uint32_t>(audio_offset_);
+        header_->write_count.store(0, std::memory_order_relaxed);
+        // Readers check the magic last.
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = MAGIC;
+
+        CASPAR_LOG(info) << L"[shm] Writing " << format_desc.name << L" to shared memory " << name << L".";
+    }
+
+    ~impl()
+    {
+        header_->magic = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+#ifndef _WIN32
+        shared_memory::remove(name_.c_str());
+#endif
+    }
+
+    slot* get_slot(std::uint64_t index) const
+    {
+        auto address = static_cast<std::uint8_t*>(region_.get_address());
+        return reinterpret_cast<slot*>(address + HEADER_SIZE + index % slot_count_ * slot_size_);
+    }
+
+    void write(const core::const_frame& frame)
+    {
+        const auto index = header_->write_count.load(std::memory_order_relaxed);
+        auto       s     = get_slot(index);
+
+        s->sequence.store(index * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        auto data = reinterpret_cast<std::uint8_t*>(s);
+
+        const auto& image = frame.image_data(0);
+        const auto  size  = std::min(image.size(), image_size(format_));
+        std::memcpy(data + SLOT_HEADER, image.data(), size);
+
+        const auto& audio   = frame.audio_data();
+        const auto  samples = std::min(audio.size(), static_cast<std::size_t>(format_.audio_samples));
+        std::memcpy(data + audio_offset_, audio.data(), samples * sizeof(std::int32_t));
+
+        const auto time =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+
+        s->image_size    = static_cast<std::uint32_t>(size);
+        s->audio_samples = static_cast<std::uint32_t>(samples);
+        s->time          = static_cast<std::int64_t>(time.count());
+
+        s->sequence.store(index * 2 + 2, std::memory_order_release);
+        header_->write_count.store(index + 1, std::memory_order_release);
+    }
+};
+
+frame_ring_writer::frame_ring_writer(const std::wstring& name, const core::video_format_desc& format_desc, int slots)
+    : impl_(new impl(name, format_desc, slots))
+{
+}
+frame_ring_writer::~frame_ring_writer() {}
+void                     frame_ring_writer::write(const core::const_frame& frame) { impl_->write(frame); }
+const frame_ring_format& frame_ring_writer::format() const { return impl_->format_; }
+
+struct frame_ring_reader::impl
+{
+    shared_memory                      shm_;
+    boost::interprocess::mapped_region region_;
+    const header*                      header_ = nullptr;
+    frame_ring_format                  format_;
+    std::uint32_t                      slot_count_   = 0;
+    std::size_t                        slot_size_    = 0;
+    std::size_t                        audio_offset_ = 0;
+    std::uint64_t                      next_         = 0;
+
+    explicit impl(const std::wstring& name)
+        : shm_(boost::interprocess::open_only, u8(name).c_str(), boost::interprocess::read_only)
+        , region_(shm_, boost::interprocess::read_only)
+    {
+        if (region_.get_size() < HEADER_SIZE) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"shm " + name + L" is not a frame ring"));
+        }
+
+        header_ = static_cast<const header*>(region_.get_address());
+        if (header_->magic != MAGIC) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"shm " + name + L" is not set up"));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (header_->version != VERSION) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"shm " + name + L" has an unsupported version"));
+        }
+
+        format_       = read_format(*header_);
+        slot_count_   = header_->slot_count;
+        slot_size_    = header_->slot_size;
+        audio_offset_ = header_->audio_offset;
+
+        if (slot_count_ < 1 || audio_offset_ < SLOT_HEADER + image_size(format_) || audio_offset_ > slot_size_ ||
+            region_.get_size() < HEADER_SIZE + slot_count_ * slot_size_) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"shm " + name + L" is not a frame ring"));
+        }
+
+        // Starts from the newest frame.
+        const auto count = header_->write_count.load(std::memory_order_acquire);
+        next_            = count > 0 ? count - 1 : 0;
+    }
+
+    const slot* get_slot(std::uint64_t index) const
+    {
+        auto address = static_cast<const std::uint8_t*>(region_.get_address());
+        return reinterpret_cast<const slot*>(address + HEADER_SIZE + index % slot_count_ * slot_size_);
+    }
+
+    bool closed() const
+    {
+        if (header_->magic != MAGIC) {
+            return true;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return read_format(*header_) != format_ || header_->write_count.load(std::memory_order_acquire) < next_;
+    }
+
+    bool available() const { return !closed() && header_->write_count.load(std::memory_order_acquire) > next_; }
+
+    std::int64_t read(std::uint8_t* image, std::vector<std::int32_t>& audio, int max_lag)
+    {
+        if (closed()) {
+            return -1;
+        }
+
+        const auto count = header_->write_count.load(std::memory_order_acquire);
+        if (count <= next_) {
+            return -1;
+        }
+        if (count - 1 - next_ > static_cast<std::uint64_t>(std::max(max_lag, 0))) {
+            next_ = count - 1;
+        }
+
+        const auto number   = next_++;
+        const auto s        = get_slot(number);
+        const auto sequence = number * 2 + 2;
+
+        if (s->sequence.load(std::memory_order_acquire) != sequence) {
+            return -1;
+        }
+
+        auto data = reinterpret_cast<const std::uint8_t*>(s);
+
+        std::memcpy(image, data + SLOT_HEADER, std::min<std::size_t>(s->image_size, image_size(format_)));
+
+        const auto samples = std::min<std::size_t>(s->audio_samples, format_.audio_samples);
+        const auto begin   = reinterpret_cast<const std::int32_t*>(data + audio_offset_);
+        audio.assign(begin, begin + samples);
+
+        // The slot was written again while it was being copied.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->sequence.load(std::memory_order_relaxed) != sequence) {
+            return -1;
+        }
+
+        return static_cast<std::int64_t>(number);
+    }
+};
+
+frame_ring_reader::frame_ring_reader(const std::wstring& name)
+    : impl_(new impl(name))
+{
+}
+frame_ring_reader::~frame_ring_reader() {}
+bool         frame_ring_reader::available() const { return impl_->available(); }
+std::int64_t frame_ring_reader::read(std::uint8_t* image, std::vector<std::int32_t>& audio, int max_lag)
+{
+    return impl_->read(image, audio, max_lag);
+}
+bool                     frame_ring_reader::closed() const { return impl_->closed(); }
+const frame_ring_format& frame_ring_reader::format() const { return impl_->format_; }
+
+}} // namespace caspar::shm
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/fwd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace shm {
+
+// A ring of frames in shared memory, written by a shm consumer and read by shm:// producers in other servers or by any
+// other process on the host. There is one writer, and readers never write to the ring, so that any number of them can
+// follow it without the writer waiting for them. All values are in native byte order.
+//
+// header (128 bytes): uint32 magic "CCGF", uint32 version, uint32 slot count, uint32 slot size, uint32 width,
+// uint32 height, uint32 bytes per line, uint32 field count, uint32 time scale, uint32 duration, uint32 audio sample
+// rate, uint32 audio channels, uint32 offset of the audio in a slot, uint32 reserved, atomic uint64 number of frames
+// written. The channel ticks time scale / duration times per second and the magic is set to 0 when the writer closes
+// the ring.
+// slot (slot size bytes, 64 byte aligned): atomic uint64 sequence, uint32 image size, uint32 number of audio samples
+// over all channels, int64 ns since the epoch when the frame was written, then a premultiplied bgra image, top line
+// first, at offset 64 and interleaved int32 audio at the audio offset. The slot is being written while the sequence is
+// odd, and holds frame n once it is 2 * n + 2.
+struct frame_ring_format
+{
+    int width         = 0;
+    int height        = 0;
+    int field_count   = 1;
+    int time_scale    = 0;
+    int duration      = 1;
+    int sample_rate   = 0;
+    int channels      = 0;
+    int audio_samples = 0; // The most samples a slot holds, over all channels.
+
+    bool operator==(const frame_ring_format& other) const;
+    bool operator!=(const frame_ring_format& other) const { return !(*this == other); }
+};
+
+class frame_ring_writer
+{
+  public:
+    // Creates the ring named name, replacing any one left behind by a writer that didn't close it.
+    frame_ring_writer(const std::wstring& name, const core::video_format_desc& format_desc, int slot_count);
+    ~frame_ring_writer();
+
+    frame_ring_writer(const frame_ring_writer&) = delete;
+    frame_ring_writer& operator=(const frame_ring_writer&) = delete;
+
+    void write(const core::const_frame& frame);
+
+    const frame_ring_format& format() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+class frame_ring_reader
+{
+  public:
+    // Throws if there is no ring named name or it hasn't been set up yet.
+    explicit frame_ring_reader(const std::wstring& name);
+    ~frame_ring_reader();
+
+    frame_ring_reader(const frame_ring_reader&) = delete;
+    frame_ring_reader& operator=(const frame_ring_reader&) = delete;
+
+    // Whether a frame has been written since the last one read.
+    bool available() const;
+
+    // Copies the frame after the last one read, or the newest one if the reader is more than max_lag frames behind,
+    // into image, which must hold width * height * 4 bytes, and audio. Returns the number of the frame, or -1 if there
+    // is no new frame or it was overwritten while being read.
+    std::int64_t read(std::uint8_t* image, std::vector<std::int32_t>& audio, int max_lag);
+
+    // Whether the writer has closed the ring or set it up again for another format, after which the reader has to be
+    // opened again.
+    bool closed() const;
+
+    const frame_ring_format& format() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::shm
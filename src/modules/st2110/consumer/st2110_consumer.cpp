@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "st2110_consumer.h"
+
+#include "../util/pgroup.h"
+#include "../util/rtp_sender.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/mixer.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4245)
+#include <boost/crc.hpp>
+#pragma warning(pop)
+
+#include <tbb/concurrent_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+const std::int64_t NS_PER_SECOND = 1000000000;
+const int          VIDEO_CLOCK   = 90000;
+
+// 480 pixels of a line in each video packet, 1200 bytes of pgroups after 20 bytes of RTP and RFC 4175 headers.
+const int SEGMENT_PGROUPS   = 240;
+const int VIDEO_HEADER_SIZE = 20;
+
+// Audio is sent as ST 2110-30 level A, 1 ms packets of up to 8 channels.
+const int MAX_AUDIO_CHANNELS = 8;
+const int AUDIO_HEADER_SIZE  = 12;
+
+// Packets that are due this soon are sent with those that are due now, so that they go out in batches.
+const std::int64_t SEND_SLACK_NS = 20000;
+
+struct configuration
+{
+    std::string video;
+    std::string audio;
+    std::string interface_address;
+    std::string sdp;
+    int         ttl                = 16;
+    int         video_payload_type = 96;
+    int         audio_payload_type = 97;
+};
+
+// Time in ticks of rate of tick number n of a channel running at time_scale / duration, without overflowing.
+std::int64_t tick_time(std::int64_t n, const core::video_format_desc& format_desc, std::int64_t rate)
+{
+    const auto units = n * format_desc.duration;
+    return units / format_desc.time_scale * rate + units % format_desc.time_scale * rate / format_desc.time_scale;
+}
+
+// The number of the channel tick that ns falls in.
+std::int64_t tick_number(std::int64_t ns, const core::video_format_desc& format_desc)
+{
+    const auto units = ns / NS_PER_SECOND * format_desc.time_scale +
+                       ns % NS_PER_SECOND * format_desc.time_scale / NS_PER_SECOND;
+    return units / format_desc.duration;
+}
+
+// The share of a frame's period that its active lines take, the gapped sender spreads a frame's packets over it.
+double active_ratio(int height) { return height >= 720 ? 0.96 : 0.92; }
+
+void wait_until(std::int64_t ns)
+{
+    // Sleeps are only as precise as the scheduler, the last of the wait is spun.
+    for (auto now = tai_now(); now < ns; now = tai_now()) {
+        if (ns - now > 200000) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(ns - now - 200000));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+} // namespace
+
+// Sends the channel as uncompressed ST 2110-20 video and 2110-30 audio streams. The mixer renders v210, which is
+// repacked into pgroups as the packets are built, bgra is converted on the cpu if it can't. A thread of the network
+// role sends each tick's packets spread evenly over its active period, starting on the tick's PTP time, and clocks
+// the channel when nothing else does.
+struct st2110_consumer : public core::frame_consumer
+{
+    const configuration config_;
+    const std::uint32_t ssrc_ = std::random_device{}();
+
+    std::vector<std::weak_ptr<core::video_channel>> channels_;
+    core::video_format_desc                         format_desc_;
+    int                                             channel_index_  = -1;
+    int                                             audio_channels_ = 0;
+    std::shared_ptr<const core::pixel_format_desc>  v210_format_;
+
+    std::unique_ptr<rtp_sender> video_;
+    std::unique_ptr<rtp_sender> audio_;
+
+    struct scheduled_packet
+    {
+        std::int64_t      due;
+        rtp_sender*       sender;
+        const rtp_packet* packet;
+    };
+
+    std::vector<rtp_packet>       packets_;
+    std::vector<scheduled_packet> schedule_;
+    std::vector<std::uint8_t>     line_;
+    std::vector<std::int32_t>     audio_carry_;
+    std::uint32_t                 video_sequence_  = 0;
+    std::uint16_t                 audio_sequence_  = 0;
+    std::int64_t                  audio_timestamp_ = -1;
+
+    std::mutex            tick_mutex_;
+    std::function<void()> tick_;
+
+    spl::shared_ptr<diagnostics::graph>              graph_;
+    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    std::atomic<bool>                                abort_request_{false};
+    std::thread                                      thread_;
+
+  public:
+    st2110_consumer(configuration config, std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : config_(std::move(config))
+    {
+        for (auto& channel : channels) {
+            channels_.push_back(static_cast<std::shared_ptr<core::video_channel>>(channel));
+        }
+
+        frame_buffer_.set_capacity(2);
+
+        graph_->set_color("send-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~st2110_consumer() { stop(); }
+
+    void stop()
+    {
+        if (thread_.joinable()) {
+            abort_request_ = true;
+            thread_.join();
+        }
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        stop();
+
+        format_desc_    = format_desc;
+        channel_index_  = channel_index;
+        audio_channels_ = std::min(format_desc.audio_channels, MAX_AUDIO_CHANNELS);
+        audio_carry_.clear();
+        audio_timestamp_ = -1;
+        frame_buffer_.clear();
+
+        video_ = std::make_unique<rtp_sender>(config_.video, config_.interface_address, config_.ttl);
+        audio_.reset();
+        if (!config_.audio.empty()) {
+            audio_ = std::make_unique<rtp_sender>(config_.audio, config_.interface_address, config_.ttl);
+        }
+
+        core::pixel_format_desc desc(core::pixel_format::v210);
+        desc.planes.push_back(
+            core::pixel_format_desc::plane((format_desc.width + 47) / 48 * 32, format_desc.height, 4));
+        v210_format_.reset();
+        for (auto& weak_channel : channels_) {
+            auto channel = weak_channel.lock();
+            if (channel && channel->index() == channel_index) {
+                v210_format_ = channel->mixer().request_format(desc);
+            }
+        }
+        if (!v210_format_) {
+            CASPAR_LOG(warning) << print() << L" The mixer can't render v210, converting bgra on the cpu.";
+        }
+
+        write_sdp();
+
+        graph_->set_text(print());
+
+        abort_request_ = false;
+        thread_        = std::thread([this] {
+            try {
+                set_thread_name(L"[st2110_consumer]");
+                set_thread_role(L"network");
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        if (!frame_buffer_.try_push(frame)) {
+            core::const_frame oldest;
+            frame_buffer_.try_pop(oldest);
+            frame_buffer_.try_push(frame);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+        return make_ready_future(true);
+    }
+
+    std::wstring print() const override
+    {
+        return L"st2110_consumer[" + boost::lexical_cast<std::wstring>(channel_index_) + L"|" + u16(config_.video) +
+               L"]";
+    }
+
+    std::wstring name() const override { return L"st2110"; }
+
+    int index() const override
+    {
+        boost::crc_16_type result;
+        result.process_bytes(config_.video.data(), config_.video.length());
+        return 110000 + result.checksum();
+    }
+
+    bool has_synchronization_clock() const override { return true; }
+
+    void set_frame_clock(std::function<void()> tick) override
+    {
+        std::lock_guard<std::mutex> lock(tick_mutex_);
+        tick_ = std::move(tick);
+    }
+
+  private:
+    void run()
+    {
+        core::const_frame frame;
+
+        auto tick = tick_number(tai_now(), format_desc_) + 2;
+        while (!abort_request_) {
+            const auto start  = tick_time(tick, format_desc_, NS_PER_SECOND);
+            const auto period = tick_time(tick + 1, format_desc_, NS_PER_SECOND) - start;
+
+            // A frame that isn't there in time is sent again, with silence, so that receivers don't lose lock.
+            core::const_frame next;
+            const auto        repeat = !frame_buffer_.try_pop(next);
+            if (!repeat) {
+                frame = std::move(next);
+            } else if (frame) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            }
+
+            schedule_.clear();
+            if (frame) {
+                const auto samples =
+                    repeat ? format_desc_.audio_cadence[tick % format_desc_.audio_cadence.size()]
+                           : static_cast<int>(frame.audio_data().size() / format_desc_.audio_channels);
+                packets_.resize(std::max(packets_.size(), video_packet_count() + audio_packet_count(samples)));
+                const auto active = static_cast<std::int64_t>(period * active_ratio(format_desc_.height));
+                const auto n      = packetize_video(frame, tick, start, active);
+                packetize_audio(repeat ? nullptr : frame.audio_data().data(), samples, start, n);
+            }
+
+            wait_until(start);
+            {
+                std::lock_guard<std::mutex> lock(tick_mutex_);
+                if (tick_) {
+                    tick_();
+                }
+            }
+            transmit();
+            graph_->set_value("send-time", static_cast<double>(tai_now() - start) / period * 0.5);
+
+            tick += 1;
+            if (tai_now() > tick_time(tick, format_desc_, NS_PER_SECOND)) {
+                // Fell behind, e.g. when the clock stepped, picks up again from the next tick.
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                tick             = tick_number(tai_now(), format_desc_) + 1;
+                audio_timestamp_ = -1;
+                audio_carry_.clear();
+            }
+        }
+    }
+
+    std::size_t video_packet_count() const
+    {
+        const auto lines = format_desc_.field_count == 2 ? format_desc_.height / 2 : format_desc_.height;
+        return lines * ((format_desc_.width / 2 + SEGMENT_PGROUPS - 1) / SEGMENT_PGROUPS);
+    }
+
+    std::size_t audio_packet_count(int samples) const
+    {
+        if (!audio_ || audio_channels_ == 0) {
+            return 0;
+        }
+        return (audio_carry_.size() / audio_channels_ + samples) / (format_desc_.audio_sample_rate / 1000);
+    }
+
+    // Fills packets from the first one on with the lines of a tick, one field of them if the channel is interlaced,
+    // and returns the number of the packet after them.
+    std::size_t packetize_video(const core::const_frame& frame,
+                                std::int64_t             tick,
+                                std::int64_t             start,
+                                std::int64_t             active)
+    {
+        const auto fields    = format_desc_.field_count == 2;
+        const auto field     = fields ? static_cast<int>(tick % 2) : 0;
+        const auto lines     = fields ? format_desc_.height / 2 : format_desc_.height;
+        const auto width     = format_desc_.width;
+        const auto pgroups   = width / 2;
+        const auto timestamp = static_cast<std::uint32_t>(tick_time(tick, format_desc_, VIDEO_CLOCK));
+        const auto count     = static_cast<std::int64_t>(video_packet_count());
+
+        // Not rendered by the gpu if the frame was mixed before the format was requested.
+        auto source = v210_format_ ? core::converted_frame(frame, v210_format_) : core::const_frame{};
+        const auto v210 = static_cast<bool>(source);
+        if (!v210) {
+            source = frame;
+        }
+        const auto data     = source.image_data(0).data();
+        const auto linesize = v210 ? v210_format_->planes[0].linesize : width * 4;
+
+        line_.resize(pgroup_line_bytes(width));
+
+        std::size_t n = 0;
+        for (auto line = 0; line < lines; ++line) {
+            const auto y = fields ? line * 2 + field : line;
+            if (v210) {
+                pack_v210_line(data + y * linesize, width, line_.data());
+            } else {
+                pack_bgra_line(data + y * linesize, width, line_.data());
+            }
+
+            for (auto offset = 0; offset < pgroups; offset += SEGMENT_PGROUPS, ++n) {
+                const auto segment = std::min(SEGMENT_PGROUPS, pgroups - offset);
+                const auto length  = segment * 5;
+                const auto last    = line == lines - 1 && offset + segment >= pgroups;
+
+                auto& packet = packets_[n];
+                auto  dest   = packet.data.data();
+                write_rtp_header(dest, last, config_.video_payload_type, video_sequence_, timestamp, ssrc_);
+
+                // RFC 4175 extended sequence number and a single line segment header.
+                dest[12] = static_cast<std::uint8_t>(video_sequence_ >> 24);
+                dest[13] = static_cast<std::uint8_t>(video_sequence_ >> 16);
+                dest[14] = static_cast<std::uint8_t>(length >> 8);
+                dest[15] = static_cast<std::uint8_t>(length);
+                dest[16] = static_cast<std::uint8_t>(field << 7 | (line >> 8 & 0x7f));
+                dest[17] = static_cast<std::uint8_t>(line);
+                dest[18] = static_cast<std::uint8_t>(offset * 2 >> 8 & 0x7f);
+                dest[19] = static_cast<std::uint8_t>(offset * 2);
+                std::memcpy(dest + VIDEO_HEADER_SIZE, line_.data() + offset * 5, length);
+                packet.size = VIDEO_HEADER_SIZE + length;
+
+                schedule_.push_back({start + static_cast<std::int64_t>(n) * active / count, video_.get(), &packet});
+                video_sequence_ += 1;
+            }
+        }
+
+        return n;
+    }
+
+    // Fills packets from the nth one on with 1 ms of audio each. Samples that don't fill a packet are carried over to
+    // the next tick, no samples send silence.
+    void packetize_audio(const std::int32_t* samples, int nb_samples, std::int64_t start, std::size_t n)
+    {
+        if (!audio_ || audio_channels_ == 0) {
+            return;
+        }
+
+        const auto rate    = format_desc_.audio_sample_rate;
+        const auto size    = rate / 1000;
+        const auto carried = static_cast<int>(audio_carry_.size() / audio_channels_);
+
+        if (audio_timestamp_ < 0) {
+            audio_timestamp_ = start / NS_PER_SECOND * rate + start % NS_PER_SECOND * rate / NS_PER_SECOND;
+        }
+
+        for (auto s = 0; s < nb_samples; ++s) {
+            for (auto c = 0; c < audio_channels_; ++c) {
+                audio_carry_.push_back(samples ? samples[s * format_desc_.audio_channels + c] : 0);
+            }
+        }
+
+        const auto total = carried + nb_samples;
+        auto       pos   = 0;
+        for (; total - pos >= size; pos += size, ++n) {
+            auto& packet = packets_[n];
+            auto  dest   = packet.data.data();
+            write_rtp_header(dest,
+                             false,
+                             config_.audio_payload_type,
+                             audio_sequence_++,
+                             static_cast<std::uint32_t>(audio_timestamp_),
+                             ssrc_ + 1);
+
+            // L24, the top 24 bits of the mixer's samples in network order.
+            auto sample = audio_carry_.data() + pos * audio_channels_;
+            auto out    = dest + AUDIO_HEADER_SIZE;
+            for (auto k = 0; k < size * audio_channels_; ++k, out += 3) {
+                out[0] = static_cast<std::uint8_t>(sample[k] >> 24);
+                out[1] = static_cast<std::uint8_t>(sample[k] >> 16);
+                out[2] = static_cast<std::uint8_t>(sample[k] >> 8);
+            }
+            packet.size = AUDIO_HEADER_SIZE + size * audio_channels_ * 3;
+
+            const auto due = start + std::max(0, pos + size - carried) * NS_PER_SECOND / rate;
+            schedule_.push_back({due, audio_.get(), &packet});
+            audio_timestamp_ += size;
+        }
+
+        audio_carry_.erase(audio_carry_.begin(), audio_carry_.begin() + pos * audio_channels_);
+    }
+
+    void transmit()
+    {
+        std::stable_sort(schedule_.begin(), schedule_.end(), [](const scheduled_packet& a, const scheduled_packet& b) {
+            return a.due < b.due;
+        });
+
+        std::vector<const rtp_packet*> batch;
+        for (std::size_t n = 0; n < schedule_.size() && !abort_request_;) {
+            wait_until(schedule_[n].due - SEND_SLACK_NS);
+
+            const auto now    = tai_now();
+            const auto sender = schedule_[n].sender;
+            for (; n < schedule_.size() && schedule_[n].sender == sender && schedule_[n].due <= now + SEND_SLACK_NS;
+                 ++n) {
+                batch.push_back(schedule_[n].packet);
+            }
+            sender->send(batch.data(), batch.size());
+            batch.clear();
+        }
+    }
+
+    // Receivers are set up from the session description, which is logged and written to the sdp file if there is one.
+    void write_sdp() const
+    {
+        const auto fields = format_desc_.field_count == 2;
+        const auto rate =
+            boost::rational<int>(format_desc_.time_scale, format_desc_.duration * format_desc_.field_count);
+
+        std::ostringstream sdp;
+        sdp << "v=0\r\n"
+            << "o=- " << ssrc_ << " 0 IN IP4 " << video_->source_address() << "\r\n"
+            << "s=CasparCG channel " << channel_index_ << "\r\n"
+            << "t=0 0\r\n";
+
+        sdp << "m=video " << video_->port() << " RTP/AVP " << config_.video_payload_type << "\r\n"
+            << "c=IN IP4 " << video_->address() << "/" << config_.ttl << "\r\n"
+            << "a=rtpmap:" << config_.video_payload_type << " raw/" << VIDEO_CLOCK << "\r\n"
+            << "a=fmtp:" << config_.video_payload_type << " sampling=YCbCr-4:2:2; width=" << format_desc_.width
+            << "; height=" << format_desc_.height << "; exactframerate=" << rate.numerator();
+        if (rate.denominator() != 1) {
+            sdp << "/" << rate.denominator();
+        }
+        sdp << "; depth=10; TCS=SDR; colorimetry=BT709; PM=2110GPM; SSN=ST2110-20:2017; TP=2110TPW;"
+            << (fields ? " interlace;" : "") << "\r\n"
+            << "a=ts-refclk:ptp=IEEE1588-2008:traceable\r\n"
+            << "a=mediaclk:direct=0\r\n";
+
+        if (audio_) {
+            sdp << "m=audio " << audio_->port() << " RTP/AVP " << config_.audio_payload_type << "\r\n"
+                << "c=IN IP4 " << audio_->address() << "/" << config_.ttl << "\r\n"
+                << "a=rtpmap:" << config_.audio_payload_type << " L24/" << format_desc_.audio_sample_rate << "/"
+                << audio_channels_ << "\r\n"
+                << "a=ptime:1\r\n"
+                << "a=ts-refclk:ptp=IEEE1588-2008:traceable\r\n"
+                << "a=mediaclk:direct=0\r\n";
+        }
+
+        CASPAR_LOG(info) << print() << L" Session description:\n" << u16(sdp.str());
+
+        if (!config_.sdp.empty()) {
+            std::ofstream file(config_.sdp, std::ios::trunc | std::ios::binary);
+            file << sdp.str();
+            if (!file) {
+                CASPAR_LOG(warning) << print() << L" Failed to write " << u16(config_.sdp);
+            }
+        }
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
+                                                      std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"ST2110")) {
+        return core::frame_consumer::empty();
+    }
+
+    configuration config;
+    config.video              = u8(params.at(1));
+    config.audio              = u8(get_param(L"AUDIO", params, L""));
+    config.interface_address  = u8(get_param(L"INTERFACE", params, L""));
+    config.sdp                = u8(get_param(L"SDP", params, L""));
+    config.ttl                = get_param(L"TTL", params, config.ttl);
+    config.video_payload_type = get_param(L"VIDEO_PAYLOAD_TYPE", params, config.video_payload_type);
+    config.audio_payload_type = get_param(L"AUDIO_PAYLOAD_TYPE", params, config.audio_payload_type);
+
+    return spl::make_shared<st2110_consumer>(std::move(config), std::move(channels));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    configuration config;
+    config.video              = u8(ptree.get<std::wstring>(L"video"));
+    config.audio              = u8(ptree.get(L"audio", L""));
+    config.interface_address  = u8(ptree.get(L"interface", L""));
+    config.sdp                = u8(ptree.get(L"sdp", L""));
+    config.ttl                = ptree.get(L"ttl", config.ttl);
+    config.video_payload_type = ptree.get(L"video-payload-type", config.video_payload_type);
+    config.audio_payload_type = ptree.get(L"audio-payload-type", config.audio_payload_type);
+
+    return spl::make_shared<st2110_consumer>(std::move(config), std::move(channels));
+}
+
+}} // namespace caspar::st2110
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "pgroup.h"
+
+#include <algorithm>
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+void pack(std::uint8_t* dest, int cb, int y0, int cr, int y1)
+{
+    dest[0] = static_cast<std::uint8_t>(cb >> 2);
+    dest[1] = static_cast<std::uint8_t>((cb & 0x03) << 6 | y0 >> 4);
+    dest[2] = static_cast<std::uint8_t>((y0 & 0x0f) << 4 | cr >> 6);
+    dest[3] = static_cast<std::uint8_t>((cr & 0x3f) << 2 | y1 >> 8);
+    dest[4] = static_cast<std::uint8_t>(y1);
+}
+
+std::uint32_t read_le32(const std::uint8_t* src)
+{
+    return static_cast<std::uint32_t>(src[0]) | static_cast<std::uint32_t>(src[1]) << 8 |
+           static_cast<std::uint32_t>(src[2]) << 16 | static_cast<std::uint32_t>(src[3]) << 24;
+}
+
+int clamp10(int value) { return std::max(64, std::min(940, value)); }
+
+int clamp10_chroma(int value) { return std::max(64, std::min(960, value)); }
+
+} // namespace
+
+void pack_v210_line(const std::uint8_t* v210, int width, std::uint8_t* dest)
+{
+    // Every 4 words hold 6 pixels as Cb0 Y0 Cr0 | Y1 Cb2 Y2 | Cr2 Y3 Cb4 | Y4 Cr4 Y5, 10 bits each from the lsb.
+    int samples[12];
+    for (auto x = 0; x < width; x += 6) {
+        for (auto n = 0; n < 4; ++n) {
+            const auto word    = read_le32(v210 + n * 4);
+            samples[n * 3]     = word & 0x3ff;
+            samples[n * 3 + 1] = (word >> 10) & 0x3ff;
+            samples[n * 3 + 2] = (word >> 20) & 0x3ff;
+        }
+        v210 += 16;
+
+        for (auto n = 0; n < 3 && x + n * 2 < width; ++n) {
+            pack(dest, samples[n * 4], samples[n * 4 + 1], samples[n * 4 + 2], samples[n * 4 + 3]);
+            dest += 5;
+        }
+    }
+}
+
+void pack_bgra_line(const std::uint8_t* bgra, int width, std::uint8_t* dest)
+{
+    for (auto x = 0; x + 1 < width; x += 2) {
+        int y[2];
+        int cb = 0;
+        int cr = 0;
+        for (auto n = 0; n < 2; ++n) {
+            const int b = bgra[n * 4];
+            const int g = bgra[n * 4 + 1];
+            const int r = bgra[n * 4 + 2];
+            y[n]        = clamp10(64 + ((47 * r + 157 * g + 16 * b) >> 6));
+            cb += -26 * r - 87 * g + 112 * b;
+            cr += 112 * r - 102 * g - 10 * b;
+        }
+        bgra += 8;
+
+        pack(dest, clamp10_chroma(512 + (cb >> 7)), y[0], clamp10_chroma(512 + (cr >> 7)), y[1]);
+        dest += 5;
+    }
+}
+
+}} // namespace caspar::st2110
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace caspar { namespace st2110 {
+
+// ST 2110-20 4:2:2 10 bit video is sent as RFC 4175 pgroups, 5 bytes for every 2 pixels holding Cb Y0 Cr Y1 in
+// network order.
+inline int pgroup_line_bytes(int width) { return width / 2 * 5; }
+
+// Repacks a line of v210, as rendered by the mixer, into pgroups. Both hold the samples in the same order.
+void pack_v210_line(const std::uint8_t* v210, int width, std::uint8_t* dest);
+
+// Converts a line of bgra to BT.709 limited range pgroups, for frames the mixer didn't render as v210.
+void pack_bgra_line(const std::uint8_t* bgra, int width, std::uint8_t* dest);
+
+}} // namespace caspar::st2110
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "rtp_sender.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+const std::size_t MAX_BATCH = 64;
+
+} // namespace
+
+struct rtp_sender::impl
+{
+    const std::string destination_;
+
+    boost::asio::io_service        service_;
+    boost::asio::ip::udp::socket   socket_{service_};
+    boost::asio::ip::udp::endpoint endpoint_;
+
+    impl(const std::string& destination, const std::string& interface_address, int ttl)
+        : destination_(destination)
+    {
+        const auto colon = destination.rfind(':');
+        if (colon == std::string::npos) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Expected host:port, got " + destination));
+        }
+
+        boost::asio::ip::udp::resolver resolver(service_);
+        endpoint_ = *resolver.resolve({destination.substr(0, colon), destination.substr(colon + 1)});
+        if (!endpoint_.address().is_v4()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Only ipv4 destinations are supported: " + destination));
+        }
+
+        socket_.open(boost::asio::ip::udp::v4());
+        if (!interface_address.empty()) {
+            const auto address = boost::asio::ip::address_v4::from_string(interface_address);
+            socket_.bind({address, 0});
+            if (endpoint_.address().is_multicast()) {
+                socket_.set_option(boost::asio::ip::multicast::outbound_interface(address));
+            }
+        }
+        if (endpoint_.address().is_multicast()) {
+            socket_.set_option(boost::asio::ip::multicast::hops(ttl));
+        }
+
+        // Frames go out in bursts of batches, a larger send buffer keeps the kernel from dropping them.
+        boost::system::error_code ec;
+        socket_.set_option(boost::asio::socket_base::send_buffer_size(8 * 1024 * 1024), ec);
+    }
+
+    void send(const rtp_packet* const* packets, std::size_t count)
+    {
+#ifdef __linux__
+        std::array<mmsghdr, MAX_BATCH> msgs{};
+        std::array<iovec, MAX_BATCH>   iovs{};
+        while (count > 0) {
+            const auto batch = std::min(count, MAX_BATCH);
+            for (auto n = 0U; n < batch; ++n) {
+                iovs[n].iov_base            = const_cast<std::uint8_t*>(packets[n]->data.data());
+                iovs[n].iov_len             = packets[n]->size;
+                msgs[n].msg_hdr.msg_iov     = &iovs[n];
+                msgs[n].msg_hdr.msg_iovlen  = 1;
+                msgs[n].msg_hdr.msg_name    = endpoint_.data();
+                msgs[n].msg_hdr.msg_namelen = static_cast<socklen_t>(endpoint_.size());
+            }
+
+            const auto ret = ::sendmmsg(socket_.native_handle(), msgs.data(), static_cast<unsigned>(batch), 0);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                CASPAR_LOG(warning) << "rtp_sender[" << destination_ << "] " << strerror(errno);
+                return;
+            }
+            packets += ret;
+            count -= ret;
+        }
+#else
+        for (auto n = 0U; n < count; ++n) {
+            boost::system::error_code ec;
+            socket_.send_to(boost::asio::buffer(packets[n]->data.data(), packets[n]->size), endpoint_, 0, ec);
+            if (ec) {
+                CASPAR_LOG(warning) << "rtp_sender[" << destination_ << "] " << ec.message();
+                return;
+            }
+        }
+#endif
+    }
+};
+
+rtp_sender::rtp_sender(const std::string& destination, const std::string& interface_address, int ttl)
+    : impl_(new impl(destination, interface_address, ttl))
+{
+}
+
+rtp_sender::~rtp_sender() {}
+
+void rtp_sender::send(const rtp_packet* const* packets, std::size_t count) { impl_->send(packets, count); }
+
+std::string rtp_sender::address() const { return impl_->endpoint_.address().to_string(); }
+
+int rtp_sender::port() const { return impl_->endpoint_.port(); }
+
+std::string rtp_sender::source_address() const
+{
+    boost::system::error_code ec;
+    const auto                address = impl_->socket_.local_endpoint(ec).address();
+    return !ec && !address.is_unspecified() ? address.to_string() : "0.0.0.0";
+}
+
+std::int64_t tai_now()
+{
+#ifdef __linux__
+    timespec ts;
+    clock_gettime(CLOCK_TAI, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    static const std::int64_t offset = env::properties().get(L"configuration.st2110.tai-offset", 37) * 1000000000LL;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+               .count() +
+           offset;
+#endif
+}
+
+void write_rtp_header(std::uint8_t* dest,
+                      bool          marker,
+                      int           payload_type,
+                      std::uint16_t sequence,
+                      std::uint32_t timestamp,
+                      std::uint32_t ssrc)
+{
+    dest[0]  = 0x80;
+    dest[1]  = static_cast<std::uint8_t>((marker ? 0x80 : 0) | (payload_type & 0x7f));
+    dest[2]  = static_cast<std::uint8_t>(sequence >> 8);
+    dest[3]  = static_cast<std::uint8_t>(sequence);
+    dest[4]  = static_cast<std::uint8_t>(timestamp >> 24);
+    dest[5]  = static_cast<std::uint8_t>(timestamp >> 16);
+    dest[6]  = static_cast<std::uint8_t>(timestamp >> 8);
+    dest[7]  = static_cast<std::uint8_t>(timestamp);
+    dest[8]  = static_cast<std::uint8_t>(ssrc >> 24);
+    dest[9]  = static_cast<std::uint8_t>(ssrc >> 16);
+    dest[10] = static_cast<std::uint8_t>(ssrc >> 8);
+    dest[11] = static_cast<std::uint8_t>(ssrc);
+}
+
+}} // namespace caspar::st2110
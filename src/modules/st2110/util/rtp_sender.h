@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace st2110 {
+
+// Room for an RTP packet within a standard 1500 byte MTU, after the IP and UDP headers.
+const int MAX_PACKET_SIZE = 1460;
+
+struct rtp_packet
+{
+    std::array<std::uint8_t, MAX_PACKET_SIZE> data;
+    int                                       size = 0;
+};
+
+// A udp socket sending RTP packets to one multicast or unicast host:port, optionally from the address of interface,
+// in batches with sendmmsg on linux.
+class rtp_sender
+{
+  public:
+    rtp_sender(const std::string& destination, const std::string& interface_address, int ttl);
+    ~rtp_sender();
+
+    rtp_sender(const rtp_sender&) = delete;
+    rtp_sender& operator=(const rtp_sender&) = delete;
+
+    void send(const rtp_packet* const* packets, std::size_t count);
+
+    std::string address() const;
+    int         port() const;
+    std::string source_address() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+// Nanoseconds since the PTP epoch. ST 2110 senders are timed to PTP, this assumes the system clock is disciplined to
+// it, e.g. by ptp4l and phc2sys, and is CLOCK_TAI on linux or the system clock plus the configured tai-offset.
+std::int64_t tai_now();
+
+// Writes the 12 byte RTP header with version 2.
+void write_rtp_header(std::uint8_t* dest,
+                      bool          marker,
+                      int           payload_type,
+                      std::uint16_t sequence,
+                      std::uint32_t timestamp,
+                      std::uint32_t ssrc);
+
+}} // namespace caspar::st2110
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "null_consumer.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace caspar { namespace stress {
+
+// Takes frames without sending them anywhere. With readback every frame is read from host memory, as a real output
+// would, and latency blocks each send to stand in for a slow device.
+struct null_consumer : public core::frame_consumer
+{
+    const bool                      readback_;
+    const std::chrono::milliseconds latency_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    caspar::timer                       tick_timer_;
+    core::video_format_desc             format_desc_;
+    int                                 channel_index_ = -1;
+
+    std::int64_t  frames_      = 0;
+    std::int64_t  late_frames_ = 0;
+    std::uint64_t checksum_    = 0;
+
+    core::monitor::state state_;
+
+  public:
+    null_consumer(bool readback, std::chrono::milliseconds latency)
+        : readback_(readback)
+        , latency_(latency)
+    {
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        diagnostics::register_graph(graph_);
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        format_desc_   = format_desc;
+        channel_index_ = channel_index;
+        frames_        = 0;
+        late_frames_   = 0;
+
+        graph_->set_text(print());
+
+        CASPAR_LOG(info) << print() << L" Initialized.";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        if (frames_ > 0 && tick_timer_.elapsed() > 1.5 / format_desc_.fps) {
+            ++late_frames_;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+        }
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+
+        if (readback_ && frame) {
+            // One byte per page is enough to fault in the whole buffer.
+            const auto& data = frame.image_data(0);
+            for (std::size_t n = 0; n < data.size(); n += 4096) {
+                checksum_ += data.data()[n];
+            }
+        }
+
+        if (latency_.count() > 0) {
+            std::this_thread::sleep_for(latency_);
+        }
+
+        ++frames_;
+
+        state_["frames"]      = frames_;
+        state_["late-frames"] = late_frames_;
+
+        return make_ready_future(true);
+    }
+
+    core::monitor::state state() const override { return state_; }
+
+    std::wstring print() const override
+    {
+        return L"null[" + std::to_wstring(channel_index_) + L"|" + format_desc_.name + L"]";
+    }
+
+    std::wstring name() const override { return L"null"; }
+
+    bool needs_host_memory() const override { return readback_; }
+
+    int index() const override { return 1000; }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"NULL")) {
+        return core::frame_consumer::empty();
+    }
+
+    auto readback = contains_param(L"READBACK", params);
+    auto latency  = get_param(L"LATENCY", params, 0);
+
+    return spl::make_shared<null_consumer>(readback, std::chrono::milliseconds(std::max(0, latency)));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
+                              const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    auto readback = ptree.get(L"readback", false);
+    auto latency  = ptree.get(L"latency", 0);
+
+    return spl::make_shared<null_consumer>(readback, std::chrono::milliseconds(std::max(0, latency)));
+}
+
+}} // namespace caspar::stress
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stress_producer.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/blend_modes.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace stress {
+
+// Draws count items that move every frame, at half opacity and with every other one keyed by a circular mask, so
+// each item costs a blended draw and half of them a local key. With upload the fill is created anew each frame.
+struct stress_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const int                                  count_;
+    const double                               size_;
+    const core::blend_mode                     blend_mode_;
+    const bool                                 upload_;
+
+    core::pixel_format_desc   fill_desc_;
+    std::vector<std::uint8_t> fill_pixels_;
+    core::draw_frame          fill_;
+    core::draw_frame          key_;
+    std::int64_t              frame_number_ = 0;
+
+    core::monitor::state state_;
+
+    stress_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                    const core::video_format_desc&              format_desc,
+                    int                                         count,
+                    double                                      size,
+                    core::blend_mode                            blend_mode,
+                    bool                                        upload)
+        : frame_factory_(frame_factory)
+        , count_(count)
+        , size_(size)
+        , blend_mode_(blend_mode)
+        , upload_(upload)
+        , fill_desc_(core::pixel_format::bgra)
+    {
+        const auto width  = std::max(1, static_cast<int>(format_desc.width * size_));
+        const auto height = std::max(1, static_cast<int>(format_desc.height * size_));
+
+        fill_desc_.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+        fill_pixels_.resize(static_cast<std::size_t>(width) * height * 4);
+        for (auto y = 0; y < height; ++y) {
+            for (auto x = 0; x < width; ++x) {
+                auto px = &fill_pixels_[(static_cast<std::size_t>(y) * width + x) * 4];
+                px[0]   = static_cast<std::uint8_t>(x * 255 / width);
+                px[1]   = static_cast<std::uint8_t>(y * 255 / height);
+                px[2]   = static_cast<std::uint8_t>(((x / 16 + y / 16) % 2) * 255);
+                px[3]   = 255;
+            }
+        }
+        fill_ = create_fill();
+
+        core::pixel_format_desc key_desc(core::pixel_format::gray);
+        key_desc.planes.push_back(core::pixel_format_desc::plane(width, height, 1));
+        auto key = frame_factory_->create_frame(this, key_desc);
+        for (auto y = 0; y < height; ++y) {
+            for (auto x = 0; x < width; ++x) {
+                const auto dx = (x + 0.5) / width - 0.5;
+                const auto dy = (y + 0.5) / height - 0.5;
+
+                key.image_data(0).data()[y * width + x] = dx * dx + dy * dy < 0.25 ? 255 : 0;
+            }
+        }
+        key_ = core::draw_frame(std::move(key));
+
+        state_["stress/items"] = count_;
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    core::draw_frame create_fill()
+    {
+        auto frame = frame_factory_->create_frame(this, fill_desc_);
+        std::copy(fill_pixels_.begin(), fill_pixels_.end(), frame.image_data(0).begin());
+        return core::draw_frame(std::move(frame));
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        if (upload_) {
+            fill_ = create_fill();
+        }
+
+        const auto t = static_cast<double>(frame_number_++);
+
+        std::vector<core::draw_frame> items;
+        items.reserve(count_);
+        for (auto n = 0; n < count_; ++n) {
+            auto item = core::draw_frame::push(n % 2 == 0 ? fill_ : core::draw_frame::mask(fill_, key_));
+
+            const auto speed = 0.01 * (1 + n % 7);
+            const auto x     = 0.5 + 0.5 * std::sin(t * speed + n);
+            const auto y     = 0.5 + 0.5 * std::cos(t * speed * 1.3 + n * 0.7);
+
+            auto& transform            = item.transform().image_transform;
+            transform.fill_translation = {x * (1.0 - size_), y * (1.0 - size_)};
+            transform.fill_scale       = {size_, size_};
+            transform.opacity          = 0.5;
+            transform.blend_mode       = blend_mode_;
+
+            items.push_back(std::move(item));
+        }
+
+        return core::draw_frame(std::move(items));
+    }
+
+    std::wstring print() const override { return L"stress[" + std::to_wstring(count_) + L"]"; }
+
+    std::wstring name() const override { return L"stress"; }
+
+    core::monitor::state state() const override { return state_; }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    static boost::wregex expr(L"stress://(?<COUNT>\\d+)?", boost::regex::icase);
+    boost::wsmatch       what;
+
+    if (params.empty() || !boost::regex_match(params.at(0), what, expr)) {
+        return core::frame_producer::empty();
+    }
+
+    auto count = what["COUNT"].matched ? std::stoi(what["COUNT"].str()) : 16;
+    if (count < 1 || count > 4096) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"stress item count must be between 1 and 4096"));
+    }
+
+    auto size = get_param(L"SIZE", params, 0.25);
+    if (size <= 0.0 || size > 1.0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"stress SIZE must be between 0 and 1"));
+    }
+
+    auto blend_mode = core::get_blend_mode(get_param(L"BLEND", params, std::wstring(L"normal")));
+    auto upload     = contains_param(L"UPLOAD", params);
+
+    return spl::make_shared<stress_producer>(
+        dependencies.frame_factory, dependencies.format_desc, count, size, blend_mode, upload);
+}
+
+}} // namespace caspar::stress
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "text_producer.h"
+
+#include "../util/glyph_atlas.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/color/color_producer.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace caspar { namespace text {
+
+namespace {
+
+std::wstring find_font(const std::wstring& name)
+{
+    if (name.empty()) {
+        return env::properties().get(L"configuration.text.font", L"/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
+    }
+
+    const auto in_media = boost::filesystem::path(env::media_folder()) / name;
+    return boost::filesystem::exists(in_media) ? in_media.wstring() : name;
+}
+
+} // namespace
+
+// Draws a run of text from a glyph atlas, which is uploaded once and again only when the text brings new characters.
+// The run is one frame of the atlas with a triangle mesh of a quad per glyph, drawn by the mixer in one go, and a
+// crawl only moves its fill translation, so that scrolling costs neither rendering nor uploads.
+class text_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::video_format_desc              format_desc_;
+    const std::wstring                         font_;
+    const std::uint32_t                        color_;
+    const double                               x_;
+    const double                               y_;
+    const bool                                 loop_;
+
+    glyph_atlas       atlas_;
+    std::wstring      text_;
+    double            speed_;
+    double            offset_    = 0.0; // pixels scrolled
+    double            run_width_ = 0.0; // pixels
+    core::const_frame atlas_frame_;
+    core::const_frame run_frame_;
+
+    core::monitor::state state_;
+
+  public:
+    text_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                  const core::video_format_desc&              format_desc,
+                  std::wstring                                text,
+                  const std::wstring&                         font,
+                  int                                         size,
+                  std::uint32_t                               color,
+                  double                                      x,
+                  double                                      y,
+                  double                                      speed,
+                  bool                                        loop)
+        : frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , font_(font)
+        , color_(color)
+        , x_(x)
+        , y_(y)
+        , loop_(loop)
+        , atlas_(font, size)
+        , speed_(speed)
+    {
+        set_text(std::move(text));
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    void set_text(std::wstring text)
+    {
+        // A run is a single line.
+        std::replace(text.begin(), text.end(), L'\n', L' ');
+        text_ = std::move(text);
+
+        if (atlas_.add(text_) || !atlas_frame_) {
+            upload_atlas();
+        }
+        layout();
+        update_state();
+    }
+
+    // The coverage of the atlas in the color, premultiplied.
+    void upload_atlas()
+    {
+        core::pixel_format_desc desc(core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(atlas_.width(), std::max(1, atlas_.height()), 4));
+
+        auto frame = frame_factory_->create_frame(this, desc);
+
+        const auto  a        = (color_ >> 24) & 0xFF;
+        const auto  r        = (color_ >> 16) & 0xFF;
+        const auto  g        = (color_ >> 8) & 0xFF;
+        const auto  b        = color_ & 0xFF;
+        const auto& coverage = atlas_.coverage();
+        auto        dest     = frame.image_data(0).data();
+        std::fill(dest, dest + frame.image_data(0).size(), static_cast<std::uint8_t>(0));
+        for (std::size_t n = 0; n < coverage.size(); ++n) {
+            const auto alpha = a * coverage[n] / 255;
+            dest[n * 4 + 0]  = static_cast<std::uint8_t>(b * alpha / 255);
+            dest[n * 4 + 1]  = static_cast<std::uint8_t>(g * alpha / 255);
+            dest[n * 4 + 2]  = static_cast<std::uint8_t>(r * alpha / 255);
+            dest[n * 4 + 3]  = static_cast<std::uint8_t>(alpha);
+        }
+
+        atlas_frame_ = core::const_frame(std::move(frame));
+    }
+
+    // A quad for each glyph, in fractions of the channel from the top left of the run.
+    void layout()
+    {
+        const auto width    = static_cast<double>(format_desc_.width);
+        const auto height   = static_cast<double>(format_desc_.height);
+        const auto atlas_w  = static_cast<double>(atlas_.width());
+        const auto atlas_h  = static_cast<double>(std::max(1, atlas_.height()));
+        const auto baseline = static_cast<double>(atlas_.ascender());
+
+        std::vector<core::frame_geometry::coord> coords;
+        std::vector<std::uint32_t>               indices;
+
+        double       pen      = 0.0;
+        const glyph* previous = nullptr;
+        for (auto character : text_) {
+            auto entry = atlas_.find(character);
+            if (!entry) {
+                continue;
+            }
+            if (previous) {
+                pen += atlas_.kerning(*previous, *entry);
+            }
+            previous = entry;
+
+            if (entry->width > 0 && entry->height > 0) {
+                const auto x0 = (pen + entry->bearing_x) / width;
+                const auto y0 = (baseline - entry->bearing_y) / height;
+                const auto x1 = x0 + entry->width / width;
+                const auto y1 = y0 + entry->height / height;
+                const auto u0 = entry->x / atlas_w;
+                const auto v0 = entry->y / atlas_h;
+                const auto u1 = (entry->x + entry->width) / atlas_w;
+                const auto v1 = (entry->y + entry->height) / atlas_h;
+
+                const auto base = static_cast<std::uint32_t>(coords.size());
+                coords.emplace_back(x0, y0, u0, v0);
+                coords.emplace_back(x1, y0, u1, v0);
+                coords.emplace_back(x1, y1, u1, v1);
+                coords.emplace_back(x0, y1, u0, v1);
+                for (auto index : {0u, 1u, 2u, 0u, 2u, 3u}) {
+                    indices.push_back(base + index);
+                }
+            }
+
+            pen += entry->advance;
+        }
+
+        run_width_ = pen;
+        run_frame_ = coords.empty() ? core::const_frame()
+                                    : atlas_frame_.with_geometry(core::frame_geometry(coords, indices));
+    }
+
+    core::draw_frame draw_at(double x) const
+    {
+        core::draw_frame frame(run_frame_);
+        frame.transform().image_transform.fill_translation = {x, y_};
+        return frame;
+    }
+
+    // The distance between the starts of the copies of a looping crawl, leaving a gap of a quarter of the channel.
+    double period() const { return run_width_ + format_desc_.width * 0.25; }
+
+    void update_state()
+    {
+        state_                = {};
+        state_["text/text"]   = u8(text_);
+        state_["text/font"]   = u8(font_);
+        state_["text/speed"]  = speed_;
+        state_["text/glyphs"] = static_cast<std::int64_t>(atlas_.size());
+        state_["text/atlas"]  = {atlas_.width(), atlas_.height()};
+        state_["text/offset"] = offset_;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        if (!run_frame_) {
+            return core::draw_frame::empty();
+        }
+
+        if (speed_ <= 0.0) {
+            return draw_at(x_);
+        }
+
+        // A crawl enters from the right edge, copy n of a loop starting n periods after the first.
+        const auto width   = static_cast<double>(format_desc_.width);
+        const auto period  = this->period();
+        const auto visible = width + run_width_;
+
+        std::vector<core::draw_frame> frames;
+        auto first = loop_ ? std::max(0.0, std::ceil((offset_ - visible) / period)) : 0.0;
+        auto last  = loop_ ? std::floor(offset_ / period) : 0.0;
+        for (auto n = first; n <= last; n += 1.0) {
+            const auto travelled = offset_ - n * period;
+            if (travelled < visible) {
+                frames.push_back(draw_at(1.0 - travelled / width));
+            }
+        }
+
+        offset_ += speed_;
+        state_["text/offset"] = offset_;
+
+        return core::draw_frame(std::move(frames));
+    }
+
+    uint32_t nb_frames() const override
+    {
+        if (speed_ <= 0.0 || loop_) {
+            return std::numeric_limits<uint32_t>::max();
+        }
+        return static_cast<uint32_t>(std::ceil((format_desc_.width + run_width_) / speed_));
+    }
+
+    // TEXT replaces the text, which a crawl shows from its next copy on, and SPEED the pixels crawled per frame.
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        if (params.size() >= 2 && boost::iequals(params.at(0), L"TEXT")) {
+            set_text(params.at(1));
+            return make_ready_future(std::wstring());
+        }
+        if (params.size() >= 2 && boost::iequals(params.at(0), L"SPEED")) {
+            speed_ = std::stod(params.at(1));
+            update_state();
+            return make_ready_future(std::wstring());
+        }
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Expected TEXT or SPEED"));
+    }
+
+    std::wstring print() const override { return L"text[" + text_.substr(0, 32) + L"]"; }
+
+    std::wstring name() const override { return L"text"; }
+
+    core::monitor::state state() const override { return state_; }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    // [TEXT] <text> [FONT <file>] [SIZE <pixels>] [COLOR <color>] [X <x>] [Y <y>] [CRAWL <pixels per frame> [LOOP]]
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"[TEXT]")) {
+        return core::frame_producer::empty();
+    }
+
+    std::uint32_t color     = 0xFFFFFFFF;
+    auto          color_str = get_param(L"COLOR", params, L"");
+    if (!color_str.empty() && !core::try_get_color(color_str, color)) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid text color: " + color_str));
+    }
+
+    auto size = get_param(L"SIZE", params, 48);
+    if (size < 1) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid text size: " + std::to_wstring(size)));
+    }
+
+    return spl::make_shared<text_producer>(dependencies.frame_factory,
+                                           dependencies.format_desc,
+                                           params.at(1),
+                                           find_font(get_param(L"FONT", params, L"")),
+                                           size,
+                                           color,
+                                           get_param(L"X", params, 0.0),
+                                           get_param(L"Y", params, 0.0),
+                                           get_param(L"CRAWL", params, 0.0),
+                                           contains_param(L"LOOP", params));
+}
+
+}} // namespace caspar::text
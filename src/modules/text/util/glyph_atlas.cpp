@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "glyph_atlas.h"
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace caspar { namespace text {
+
+namespace {
+
+const int ATLAS_WIDTH      = 1024;
+const int MAX_ATLAS_HEIGHT = 4096;
+
+// Between glyphs, so that filtering doesn't pick up their neighbours.
+const int PADDING = 1;
+
+} // namespace
+
+struct glyph_atlas::impl
+{
+    FT_Library library_ = nullptr;
+    FT_Face    face_    = nullptr;
+
+    std::map<wchar_t, glyph> glyphs_;
+
+    // Glyphs are packed in rows left to right, a row is as high as the highest glyph in it.
+    int                       row_x_      = PADDING;
+    int                       row_y_      = PADDING;
+    int                       row_height_ = 0;
+    int                       height_     = 0;
+    std::vector<std::uint8_t> coverage_;
+
+    impl(const std::wstring& font_file, int size)
+    {
+        if (FT_Init_FreeType(&library_) != 0) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to initialize FreeType."));
+        }
+        if (FT_New_Face(library_, u8(font_file).c_str(), 0, &face_) != 0) {
+            FT_Done_FreeType(library_);
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Failed to open font " + font_file));
+        }
+        if (FT_Set_Pixel_Sizes(face_, 0, static_cast<FT_UInt>(size)) != 0) {
+            FT_Done_Face(face_);
+            FT_Done_FreeType(library_);
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Font " + font_file + L" has no size " +
+                                                            std::to_wstring(size)));
+        }
+    }
+
+    ~impl()
+    {
+        FT_Done_Face(face_);
+        FT_Done_FreeType(library_);
+    }
+
+    bool add(const std::wstring& text)
+    {
+        auto added = false;
+        for (auto character : text) {
+            if (glyphs_.find(character) != glyphs_.end()) {
+                continue;
+            }
+
+            glyph entry;
+            entry.index = FT_Get_Char_Index(face_, static_cast<FT_ULong>(character));
+            if (FT_Load_Glyph(face_, entry.index, FT_LOAD_RENDER) != 0) {
+                continue;
+            }
+
+            const auto& slot   = *face_->glyph;
+            const auto& bitmap = slot.bitmap;
+            entry.width        = static_cast<int>(bitmap.width);
+            entry.height       = static_cast<int>(bitmap.rows);
+            entry.bearing_x    = slot.bitmap_left;
+            entry.bearing_y    = slot.bitmap_top;
+            entry.advance      = slot.advance.x / 64.0;
+
+            if (entry.width > 0 && entry.height > 0) {
+                place(entry);
+                for (int y = 0; y < entry.height; ++y) {
+                    std::memcpy(coverage_.data() + static_cast<std::size_t>(entry.y + y) * ATLAS_WIDTH + entry.x,
+                                bitmap.buffer + y * bitmap.pitch,
+                                entry.width);
+                }
+            }
+
+            glyphs_[character] = entry;
+            added              = true;
+        }
+        return added;
+    }
+
+    void place(glyph& entry)
+    {
+        if (entry.width + PADDING * 2 > ATLAS_WIDTH) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("The text size is too large for the glyph atlas."));
+        }
+
+        if (row_x_ + entry.width + PADDING > ATLAS_WIDTH) {
+            row_x_ = PADDING;
+            row_y_ += row_height_ + PADDING;
+            row_height_ = 0;
+        }
+
+        const auto bottom = row_y_ + entry.height + PADDING;
+        if (bottom > MAX_ATLAS_HEIGHT) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("The glyph atlas is full."));
+        }
+        if (bottom > height_) {
+            height_ = bottom;
+            coverage_.resize(static_cast<std::size_t>(height_) * ATLAS_WIDTH, 0);
+        }
+
+        entry.x = row_x_;
+        entry.y = row_y_;
+        row_x_ += entry.width + PADDING;
+        row_height_ = std::max(row_height_, entry.height);
+    }
+
+    const glyph* find(wchar_t character) const
+    {
+        auto it = glyphs_.find(character);
+        return it == glyphs_.end() || it->second.index == 0 ? nullptr : &it->second;
+    }
+
+    double kerning(const glyph& left, const glyph& right) const
+    {
+        if (!FT_HAS_KERNING(face_)) {
+            return 0.0;
+        }
+
+        FT_Vector delta;
+        if (FT_Get_Kerning(face_, left.index, right.index, FT_KERNING_DEFAULT, &delta) != 0) {
+            return 0.0;
+        }
+        return delta.x / 64.0;
+    }
+};
+
+glyph_atlas::glyph_atlas(const std::wstring& font_file, int size)
+    : impl_(new impl(font_file, size))
+{
+}
+glyph_atlas::~glyph_atlas() {}
+bool         glyph_atlas::add(const std::wstring& text) { return impl_->add(text); }
+const glyph* glyph_atlas::find(wchar_t character) const { return impl_->find(character); }
+double glyph_atlas::kerning(const glyph& left, const glyph& right) const { return impl_->kerning(left, right); }
+int    glyph_atlas::ascender() const { return static_cast<int>(impl_->face_->size->metrics.ascender / 64); }
+int    glyph_atlas::line_height() const { return static_cast<int>(impl_->face_->size->metrics.height / 64); }
+int    glyph_atlas::width() const { return ATLAS_WIDTH; }
+int    glyph_atlas::height() const { return impl_->height_; }
+const std::vector<std::uint8_t>& glyph_atlas::coverage() const { return impl_->coverage_; }
+std::size_t                      glyph_atlas::size() const { return impl_->glyphs_.size(); }
+
+}} // namespace caspar::text
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace text {
+
+struct glyph
+{
+    int           x         = 0; // in the atlas, in pixels
+    int           y         = 0;
+    int           width     = 0;
+    int           height    = 0;
+    int           bearing_x = 0; // from the pen to the left edge of the bitmap
+    int           bearing_y = 0; // from the baseline up to the top of the bitmap
+    double        advance   = 0.0;
+    std::uint32_t index     = 0; // in the font
+};
+
+// The glyphs of a font at one size, rasterized once each into an 8 bit coverage atlas that rows of glyphs are added to
+// as new characters are used.
+class glyph_atlas final
+{
+  public:
+    glyph_atlas(const std::wstring& font_file, int size);
+    glyph_atlas(const glyph_atlas&) = delete;
+    ~glyph_atlas();
+
+    glyph_atlas& operator=(const glyph_atlas&) = delete;
+
+    // Rasterizes the characters of text that aren't in the atlas yet. Returns whether any were.
+    bool add(const std::wstring& text);
+
+    // Null for characters that haven't been added or that the font doesn't have.
+    const glyph* find(wchar_t character) const;
+
+    // The adjustment of the pen between two glyphs, in pixels.
+    double kerning(const glyph& left, const glyph& right) const;
+
+    int ascender() const;
+    int line_height() const;
+
+    int                              width() const;
+    int                              height() const;
+    const std::vector<std::uint8_t>& coverage() const;
+    std::size_t                      size() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::text
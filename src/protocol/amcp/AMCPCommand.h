@@ -26,6 +26,7 @@
 #include <accelerator/accelerator.h>
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
 
 #include <boost/algorithm/string.hpp>
 
@@ -47,6 +48,10 @@ struct command_context
     std::string                                          proxy_port;
     std::weak_ptr<accelerator::accelerator_device>       ogl_device;
 
+    // Set for commands of a BEGIN ... COMMIT batch, mixer transforms are collected here and applied to the channel
+    // in one go once all commands of the batch have run.
+    std::shared_ptr<std::vector<core::stage::transform_tuple_t>> batch_transforms;
+
     int layer_index(int default_ = 0) const { return layer_id == -1 ? default_ : layer_id; }
 
     command_context(IO::ClientInfoPtr                                    client,
@@ -119,6 +124,8 @@ class AMCPCommand
         ctx_.client->send(std::move(replyString_));
     }
 
+    std::wstring TakeReply() { return std::move(replyString_); }
+
     std::vector<std::wstring>& parameters() { return ctx_.parameters; }
 
     IO::ClientInfoPtr client() { return ctx_.client; }
@@ -127,6 +134,11 @@ class AMCPCommand
 
     void set_request_id(std::wstring request_id) { request_id_ = std::move(request_id); }
 
+    void set_batch_transforms(std::shared_ptr<std::vector<core::stage::transform_tuple_t>> transforms)
+    {
+        ctx_.batch_transforms = std::move(transforms);
+    }
+
     void SetReplyString(const std::wstring& str)
     {
         if (request_id_.empty())
@@ -38,28 +38,70 @@ std::mutex& get_global_mutex()
     return mutex;
 }
 
-std::map<std::wstring, AMCPCommandQueue*>& get_instances()
+std::map<std::wstring, std::weak_ptr<AMCPCommandQueue>>& get_instances()
 {
-    static std::map<std::wstring, AMCPCommandQueue*> queues;
+    static std::map<std::wstring, std::weak_ptr<AMCPCommandQueue>> queues;
 
     return queues;
 }
 
+void execute(const AMCPCommand::ptr_type& pCurrentCommand)
+{
+    try {
+        caspar::timer timer;
+
+        auto print  = pCurrentCommand->print();
+        auto params = boost::join(pCurrentCommand->parameters(), L" ");
+
+        CASPAR_LOG(debug) << "Executing command: " << print;
+
+        if (pCurrentCommand->Execute())
+            CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << print;
+        else
+            CASPAR_LOG(warning) << "Failed to execute command: " << print;
+    } catch (file_not_found&) {
+        CASPAR_LOG(error) << " Turn on log level debug for stacktrace.";
+        pCurrentCommand->SetReplyString(L"404 " + pCurrentCommand->print() + L" FAILED\r\n");
+    } catch (expected_user_error&) {
+        pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
+    } catch (user_error&) {
+        CASPAR_LOG(error) << " Check syntax. Turn on log level debug for stacktrace.";
+        pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
+    } catch (std::out_of_range&) {
+        CASPAR_LOG(error) << L"Missing parameter. Check syntax. Turn on log level debug for stacktrace.";
+        pCurrentCommand->SetReplyString(L"402 " + pCurrentCommand->print() + L" FAILED\r\n");
+    } catch (boost::bad_lexical_cast&) {
+        CASPAR_LOG(error) << L"Invalid parameter. Check syntax. Turn on log level debug for stacktrace.";
+        pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        CASPAR_LOG(error) << "Failed to execute command: " << pCurrentCommand->print();
+        pCurrentCommand->SetReplyString(L"501 " + pCurrentCommand->print() + L" FAILED\r\n");
+    }
+}
+
 } // namespace
 
 AMCPCommandQueue::AMCPCommandQueue(const std::wstring& name)
     : executor_(L"AMCPCommandQueue " + name)
 {
-    std::lock_guard<std::mutex> lock(get_global_mutex());
-
-    get_instances().insert(std::make_pair(name, this));
 }
 
-AMCPCommandQueue::~AMCPCommandQueue()
+AMCPCommandQueue::~AMCPCommandQueue() {}
+
+AMCPCommandQueue::ptr_type AMCPCommandQueue::get(const std::wstring& name)
 {
     std::lock_guard<std::mutex> lock(get_global_mutex());
 
-    get_instances().erase(executor_.name());
+    auto& instance = get_instances()[name];
+
+    auto queue = instance.lock();
+    if (!queue) {
+        queue    = std::make_shared<AMCPCommandQueue>(name);
+        instance = queue;
+    }
+
+    return ptr_type(std::move(queue));
 }
 
 void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
@@ -81,41 +123,71 @@ void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
 
     executor_.begin_invoke([=] {
         try {
+            execute(pCurrentCommand);
+
+            pCurrentCommand->SendReply();
+
+            CASPAR_LOG(trace) << "Ready for a new command";
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+void AMCPCommandQueue::AddScheduledCommand(AMCPCommand::ptr_type pCurrentCommand,
+                                           core::video_channel&  channel,
+                                           uint64_t              frame)
+{
+    if (!pCurrentCommand)
+        return;
+
+    channel.schedule(frame, [=] {
+        try {
+            execute(pCurrentCommand);
+
+            pCurrentCommand->SendReply();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+void AMCPCommandQueue::AddBatch(std::vector<AMCPCommand::ptr_type>        commands,
+                                std::function<void()>                     commit,
+                                std::function<void(std::wstring&&, bool)> done)
+{
+    if (executor_.size() > 128) {
+        try {
+            CASPAR_LOG(error) << "AMCP Command Queue Overflow.";
+            CASPAR_LOG(error) << "Failed to execute batch of " << commands.size() << " commands.";
+            done(L"504 QUEUE OVERFLOW\r\n", false);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        return;
+    }
+
+    executor_.begin_invoke([=] {
+        try {
+            caspar::timer timer;
+
+            std::wstring replies;
+            for (auto& command : commands) {
+                execute(command);
+                replies += command->TakeReply();
+            }
+
+            auto committed = true;
             try {
-                caspar::timer timer;
-
-                auto print  = pCurrentCommand->print();
-                auto params = boost::join(pCurrentCommand->parameters(), L" ");
-
-                CASPAR_LOG(debug) << "Executing command: " << print;
-
-                if (pCurrentCommand->Execute())
-                    CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << print;
-                else
-                    CASPAR_LOG(warning) << "Failed to execute command: " << print;
-            } catch (file_not_found&) {
-                CASPAR_LOG(error) << " Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"404 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (expected_user_error&) {
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (user_error&) {
-                CASPAR_LOG(error) << " Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (std::out_of_range&) {
-                CASPAR_LOG(error) << L"Missing parameter. Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"402 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (boost::bad_lexical_cast&) {
-                CASPAR_LOG(error) << L"Invalid parameter. Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
+                commit();
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
-                CASPAR_LOG(error) << "Failed to execute command: " << pCurrentCommand->print();
-                pCurrentCommand->SetReplyString(L"501 " + pCurrentCommand->print() + L" FAILED\r\n");
+                committed = false;
             }
 
-            pCurrentCommand->SendReply();
+            CASPAR_LOG(debug) << "Executed batch of " << commands.size() << " commands (" << timer.elapsed() << "s)";
 
-            CASPAR_LOG(trace) << "Ready for a new command";
+            done(std::move(replies), committed);
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
         }
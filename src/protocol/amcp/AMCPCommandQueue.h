@@ -26,6 +26,13 @@
 #include <common/executor.h>
 #include <common/memory.h>
 
+#include <core/video_channel.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace amcp {
 
 class AMCPCommandQueue
@@ -39,8 +46,22 @@ class AMCPCommandQueue
     AMCPCommandQueue(const std::wstring& name);
     ~AMCPCommandQueue();
 
+    // Returns the queue of that name, shared by every AMCP server so that commands for the same channel are run in
+    // the order they arrive whichever connection they come from.
+    static ptr_type get(const std::wstring& name);
+
     void AddCommand(AMCPCommand::ptr_type pCommand);
 
+    // Runs the commands in order as a single task followed by commit, then calls done with their replies and whether
+    // commit succeeded. The batch takes one entry of the queue however many commands it holds.
+    void AddBatch(std::vector<AMCPCommand::ptr_type>        commands,
+                  std::function<void()>                     commit,
+                  std::function<void(std::wstring&&, bool)> done);
+
+    // Runs the command on the thread of channel at the start of the tick of frame instead of on the queue, and then
+    // sends its reply.
+    void AddScheduledCommand(AMCPCommand::ptr_type pCommand, core::video_channel& channel, uint64_t frame);
+
   private:
     executor executor_;
 };
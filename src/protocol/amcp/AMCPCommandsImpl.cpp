@@ -27,23 +27,28 @@
 
 #include "AMCPCommandsImpl.h"
 
+#include "../util/AsyncEventServer.h"
 #include "../util/http_request.h"
+#include "../util/tree_writer.h"
 #include "AMCPCommandQueue.h"
 #include "amcp_command_repository.h"
+#include "data_store.h"
 
 #include <common/env.h>
 
 #include <common/base64.h>
-#include <common/filesystem.h>
 #include <common/log.h>
-#include <common/os/filesystem.h>
 #include <common/param.h>
 
 #include <core/consumer/output.h>
 #include <core/diagnostics/call_context.h>
 #include <core/diagnostics/osd_graph.h>
+#include <core/diagnostics/trace.h>
 #include <core/frame/frame_transform.h>
+#include <core/mixer/audio/audio_route.h>
+#include <core/mixer/audio/loudness_meter.h>
 #include <core/mixer/mixer.h>
+#include <core/producer/async/async_producer.h>
 #include <core/producer/cg_proxy.h>
 #include <core/producer/frame_producer.h>
 #include <core/producer/stage.h>
@@ -52,27 +57,26 @@
 #include <core/video_format.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <future>
 #include <memory>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/regex.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/insert_linebreaks.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/locale.hpp>
 #include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
-#include <boost/range/adaptor/transformed.hpp>
-#include <boost/range/algorithm/copy.hpp>
-#include <boost/regex.hpp>
 
 #include <tbb/concurrent_unordered_map.h>
 
+#include <iomanip>
+
 /* Return codes
 
 102 [action]			Information that [action] has happened
@@ -120,81 +124,6 @@ std::wstring read_file_base64(const boost::filesystem::path& file)
     return std::wstring(result.begin(), result.end());
 }
 
-std::wstring read_utf8_file(const boost::filesystem::path& file)
-{
-    std::wstringstream           result;
-    boost::filesystem::wifstream filestream(file);
-
-    if (filestream) {
-        // Consume BOM first
-        filestream.get();
-        // read all data
-        result << filestream.rdbuf();
-    }
-
-    return result.str();
-}
-
-std::wstring read_latin1_file(const boost::filesystem::path& file)
-{
-    boost::locale::generator gen;
-    gen.locale_cache_enabled(true);
-    gen.categories(boost::locale::codepage_facet);
-
-    std::stringstream           result_stream;
-    boost::filesystem::ifstream filestream(file);
-    filestream.imbue(gen("en_US.ISO8859-1"));
-
-    if (filestream) {
-        // read all data
-        result_stream << filestream.rdbuf();
-    }
-
-    std::string  result = result_stream.str();
-    std::wstring widened_result;
-
-    // The first 255 codepoints in unicode is the same as in latin1
-    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
-                std::back_inserter(widened_result));
-
-    return widened_result;
-}
-
-std::wstring read_file(const boost::filesystem::path& file)
-{
-    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
-
-    if (!boost::filesystem::exists(file)) {
-        return L"";
-    }
-
-    if (boost::filesystem::file_size(file) >= 3) {
-        boost::filesystem::ifstream bom_stream(file);
-
-        char header[3];
-        bom_stream.read(header, 3);
-        bom_stream.close();
-
-        if (std::memcmp(BOM, header, 3) == 0)
-            return read_utf8_file(file);
-    }
-
-    return read_latin1_file(file);
-}
-
-std::wstring get_sub_directory(const std::wstring& base_folder, const std::wstring& sub_directory)
-{
-    if (sub_directory.empty())
-        return base_folder;
-
-    auto found = find_case_insensitive(base_folder + L"/" + sub_directory);
-
-    if (!found)
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Sub directory " + sub_directory + L" not found."));
-
-    return *found;
-}
-
 std::vector<spl::shared_ptr<core::video_channel>> get_channels(const command_context& ctx)
 {
     std::vector<spl::shared_ptr<core::video_channel>> result;
@@ -216,9 +145,8 @@ core::frame_producer_dependencies get_producer_dependencies(const std::shared_pt
 
 // Basic Commands
 
-std::wstring loadbg_command(command_context& ctx)
+spl::shared_ptr<frame_producer> create_loadbg_producer(const command_context& ctx)
 {
-    // Perform loading of the clip
     core::diagnostics::scoped_call_context save;
     core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
     core::diagnostics::call_context::for_thread().layer         = ctx.layer_index();
@@ -229,25 +157,91 @@ std::wstring loadbg_command(command_context& ctx)
     if (pFP == frame_producer::empty())
         CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters.size() > 0 ? ctx.parameters[0] : L""));
 
+    transition_info transitionInfo;
+    sting_info      stingInfo;
+
+    if (try_match_sting(ctx.parameters, stingInfo))
+        return create_sting_producer(get_producer_dependencies(channel, ctx), pFP, stingInfo);
+
+    std::wstring message;
+    for (size_t n = 0; n < ctx.parameters.size(); ++n)
+        message += boost::to_upper_copy(ctx.parameters[n]) + L" ";
+
+    // Always fallback to transition
+    try_match_transition(message, transitionInfo);
+    return create_transition_producer(pFP, transitionInfo);
+}
+
+// Removes WAIT [frames] from the parameters and returns the frames to wait, one second if no count is given.
+int consume_wait(command_context& ctx)
+{
+    auto it = std::find_if(ctx.parameters.begin(), ctx.parameters.end(), param_comparer(L"WAIT"));
+    if (it == ctx.parameters.end())
+        return 0;
+
+    auto wait   = static_cast<int>(std::ceil(ctx.channel.channel->video_format_desc().fps));
+    auto end    = std::next(it);
+    auto frames = 0;
+    if (end != ctx.parameters.end() && boost::conversion::try_lexical_convert(*end, frames)) {
+        wait = frames;
+        ++end;
+    }
+
+    ctx.parameters.erase(it, end);
+
+    return std::max(wait, 0);
+}
+
+// With ASYNC the producer is created in the background and the client is told once it is ready or has failed.
+// With wait the call returns once the background is ready to play or after that many frames.
+void loadbg(const command_context& ctx, const std::wstring& command, int wait = 0)
+{
     bool auto_play = contains_param(L"AUTO", ctx.parameters);
 
-    spl::shared_ptr<frame_producer> transition_producer = frame_producer::empty();
-    transition_info                 transitionInfo;
-    sting_info                      stingInfo;
+    auto transition_producer = frame_producer::empty();
+
+    if (contains_param(L"ASYNC", ctx.parameters)) {
+        auto spec   = std::to_wstring(ctx.channel_index + 1) + L"-" + std::to_wstring(ctx.layer_index());
+        auto client = std::weak_ptr<IO::client_connection<wchar_t>>(ctx.client);
+
+        transition_producer = create_async_producer(
+            ctx.parameters.at(0),
+            [ctx] { return create_loadbg_producer(ctx); },
+            [client, command, spec](std::exception_ptr error) {
+                if (auto connection = client.lock()) {
+                    connection->send(error ? L"404 " + command + L" " + spec + L" FAILED\r\n"
+                                           : L"202 " + command + L" " + spec + L" READY\r\n");
+                }
+            });
+    } else {
+        transition_producer = create_loadbg_producer(ctx);
+    }
 
-    if (try_match_sting(ctx.parameters, stingInfo)) {
-        transition_producer = create_sting_producer(get_producer_dependencies(channel, ctx), pFP, stingInfo);
+    // With QUEUE the producer waits behind the current background instead of replacing it.
+    if (contains_param(L"QUEUE", ctx.parameters)) {
+        if (!ctx.channel.channel->stage().queue(ctx.layer_index(), transition_producer, auto_play).get())
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"The queue of the layer is full"));
     } else {
-        std::wstring message;
-        for (size_t n = 0; n < ctx.parameters.size(); ++n)
-            message += boost::to_upper_copy(ctx.parameters[n]) + L" ";
+        ctx.channel.channel->stage().load(ctx.layer_index(), transition_producer, false, auto_play); // TODO: LOOP
+    }
 
-        // Always fallback to transition
-        try_match_transition(message, transitionInfo);
-        transition_producer = create_transition_producer(pFP, transitionInfo);
+    if (wait > 0) {
+        auto interval = std::chrono::microseconds(
+            static_cast<std::int64_t>(1000000.0 / ctx.channel.channel->video_format_desc().fps));
+
+        for (auto n = 0; n < wait && !transition_producer->ready(); ++n)
+            std::this_thread::sleep_for(interval);
+
+        if (!transition_producer->ready())
+            CASPAR_LOG(warning) << transition_producer->print() << L" Not ready after " << wait << L" frames.";
     }
+}
 
-    channel->stage().load(ctx.layer_index(), transition_producer, false, auto_play); // TODO: LOOP
+std::wstring loadbg_command(command_context& ctx)
+{
+    auto wait = consume_wait(ctx);
+
+    loadbg(ctx, L"LOADBG", wait);
 
     return L"202 LOADBG OK\r\n";
 }
@@ -268,10 +262,12 @@ std::wstring load_command(command_context& ctx)
 
 std::wstring play_command(command_context& ctx)
 {
+    auto wait = consume_wait(ctx);
+
     if (!ctx.parameters.empty())
-        loadbg_command(ctx);
+        loadbg(ctx, L"PLAY");
 
-    ctx.channel.channel->stage().play(ctx.layer_index());
+    ctx.channel.channel->stage().play(ctx.layer_index(), wait);
 
     return L"202 PLAY OK\r\n";
 }
@@ -305,6 +301,32 @@ std::wstring clear_command(command_context& ctx)
     return L"202 CLEAR OK\r\n";
 }
 
+// STING CACHE [channel] mask_filename [overlay_filename] [MASK_SCALE scale]
+std::wstring sting_cache_command(command_context& ctx)
+{
+    auto scale = get_param(L"MASK_SCALE", ctx.parameters, 1.0);
+    if (scale <= 0.0 || scale > 1.0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"MASK_SCALE must be above 0 and at most 1."));
+    }
+
+    auto dependencies = get_producer_dependencies(ctx.channel.channel, ctx);
+
+    core::cache_sting_clip(dependencies, ctx.parameters.at(0), scale);
+    if (ctx.parameters.size() > 1 && !boost::iequals(ctx.parameters.at(1), L"MASK_SCALE")) {
+        core::cache_sting_clip(dependencies, ctx.parameters.at(1));
+    }
+
+    return L"202 STING CACHE OK\r\n";
+}
+
+// STING UNCACHE [filename]
+std::wstring sting_uncache_command(command_context& ctx)
+{
+    core::uncache_sting_clip(ctx.parameters.empty() ? L"" : ctx.parameters.at(0));
+
+    return L"202 STING UNCACHE OK\r\n";
+}
+
 std::wstring call_command(command_context& ctx)
 {
     auto result = ctx.channel.channel->stage().call(ctx.layer_index(), ctx.parameters).get();
@@ -420,55 +442,34 @@ std::wstring set_command(command_context& ctx)
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video mode"));
     }
 
+    if (name == L"PRIORITY") {
+        ctx.channel.channel->stage().set_priority(ctx.layer_index(), boost::lexical_cast<int>(value)).get();
+        return L"202 SET PRIORITY OK\r\n";
+    }
+
+    if (name == L"AV-OFFSET") {
+        if (!ctx.channel.channel->output().set_av_offset(ctx.layer_index(), boost::lexical_cast<int>(value))) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No consumer " + std::to_wstring(ctx.layer_index())));
+        }
+        return L"202 SET AV-OFFSET OK\r\n";
+    }
+
     CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid channel variable"));
 }
 
-std::wstring data_store_command(command_context& ctx)
+std::wstring data_store_command(command_context& ctx, data_store& store)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
-    auto found_data_path = find_case_insensitive(data_path);
-
-    if (found_data_path)
-        data_path = *found_data_path;
-
-    if (!boost::filesystem::exists(data_path))
-        boost::filesystem::create_directories(data_path);
-
-    auto found_filename = find_case_insensitive(filename);
-
-    if (found_filename)
-        filename = *found_filename; // Overwrite case insensitive.
-
-    boost::filesystem::wofstream datafile(filename);
-    if (!datafile)
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
-
-    datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
-    datafile << ctx.parameters[1] << std::flush;
-    datafile.close();
+    store.store(ctx.parameters[0], ctx.parameters[1]);
 
     return L"202 DATA STORE OK\r\n";
 }
 
-std::wstring data_retrieve_command(command_context& ctx)
+std::wstring data_retrieve_command(command_context& ctx, data_store& store)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    std::wstring file_contents;
-
-    auto found_file = find_case_insensitive(filename);
-
-    if (found_file)
-        file_contents = read_file(boost::filesystem::path(*found_file));
+    auto file_contents = store.retrieve(ctx.parameters[0]);
 
     if (file_contents.empty())
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters[0] + L" not found"));
 
     std::wstringstream reply;
     reply << L"201 DATA RETRIEVE OK\r\n";
@@ -490,56 +491,40 @@ std::wstring data_retrieve_command(command_context& ctx)
     return reply.str();
 }
 
-std::wstring data_list_command(command_context& ctx)
+std::wstring data_list_command(command_context& ctx, data_store& store)
 {
     std::wstring sub_directory;
 
     if (!ctx.parameters.empty())
         sub_directory = ctx.parameters.at(0);
 
-    std::wstringstream replyString;
-    replyString << L"200 DATA LIST OK\r\n";
-
-    for (boost::filesystem::recursive_directory_iterator itr(get_sub_directory(env::data_folder(), sub_directory)), end;
-         itr != end;
-         ++itr) {
-        if (boost::filesystem::is_regular_file(itr->path())) {
-            if (!boost::iequals(itr->path().extension().wstring(), L".ftd"))
-                continue;
+    auto names = store.list(sub_directory);
 
-            auto relativePath = get_relative_without_extension(itr->path(), env::data_folder());
-            auto str          = relativePath.generic_wstring();
+    if (!sub_directory.empty() && names.empty())
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Sub directory " + sub_directory + L" not found."));
 
-            if (str[0] == L'\\' || str[0] == L'/')
-                str = std::wstring(str.begin() + 1, str.end());
+    std::wstringstream replyString;
+    replyString << L"200 DATA LIST OK\r\n";
 
-            replyString << str << L"\r\n";
-        }
-    }
+    for (auto& name : names)
+        replyString << name << L"\r\n";
 
     replyString << L"\r\n";
 
-    return boost::to_upper_copy(replyString.str());
+    return replyString.str();
 }
 
-std::wstring data_remove_command(command_context& ctx)
+std::wstring data_remove_command(command_context& ctx, data_store& store)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    if (!boost::filesystem::exists(filename))
-        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
-
-    if (!boost::filesystem::remove(filename))
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(filename + L" could not be removed"));
+    if (!store.remove(ctx.parameters[0]))
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(ctx.parameters[0] + L" not found"));
 
     return L"202 DATA REMOVE OK\r\n";
 }
 
 // Template Graphics Commands
 
-std::wstring cg_add_command(command_context& ctx)
+std::wstring cg_add_command(command_context& ctx, data_store& store)
 {
     // CG 1 ADD 0 "template_folder/templatename" [STARTLABEL] 0/1 [DATA]
 
@@ -566,17 +551,11 @@ std::wstring cg_add_command(command_context& ctx)
         if (dataString.at(0) == L'<' || dataString.at(0) == L'{') // the data is XML or Json
             pDataString = dataString.c_str();
         else {
-            // The data is not an XML-string, it must be a filename
-            std::wstring filename = env::data_folder();
-            filename.append(dataString);
-            filename.append(L".ftd");
-
-            auto found_file = find_case_insensitive(filename);
+            // The data is not an XML-string, it must be the name of stored data
+            dataFromFile = store.retrieve(dataString);
 
-            if (found_file) {
-                dataFromFile = read_file(boost::filesystem::path(*found_file));
-                pDataString  = dataFromFile.c_str();
-            }
+            if (!dataFromFile.empty())
+                pDataString = dataFromFile.c_str();
         }
     }
 
@@ -646,18 +625,14 @@ std::wstring cg_clear_command(command_context& ctx)
     return L"202 CG OK\r\n";
 }
 
-std::wstring cg_update_command(command_context& ctx)
+std::wstring cg_update_command(command_context& ctx, data_store& store)
 {
     int layer = std::stoi(ctx.parameters.at(0));
 
     std::wstring dataString = ctx.parameters.at(1);
     if (dataString.at(0) != L'<' && dataString.at(0) != L'{') {
-        // The data is not XML or Json, it must be a filename
-        std::wstring filename = env::data_folder();
-        filename.append(dataString);
-        filename.append(L".ftd");
-
-        dataString = read_file(boost::filesystem::path(filename));
+        // The data is not XML or Json, it must be the name of stored data
+        dataString = store.retrieve(dataString);
     }
 
     get_expected_cg_proxy(ctx)->update(layer, dataString);
@@ -676,6 +651,21 @@ std::wstring cg_invoke_command(command_context& ctx)
     return replyString.str();
 }
 
+std::wstring cg_batch_command(command_context& ctx)
+{
+    // CG 1 BATCH BEGIN|COMMIT, the calls in between reach the template together when committed.
+    auto proxy = get_expected_cg_proxy(ctx);
+
+    if (boost::iequals(ctx.parameters.at(0), L"BEGIN"))
+        proxy->begin_batch();
+    else if (boost::iequals(ctx.parameters.at(0), L"COMMIT"))
+        proxy->commit_batch();
+    else
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected BEGIN or COMMIT"));
+
+    return L"202 CG OK\r\n";
+}
+
 // Mixer Commands
 
 core::frame_transform get_current_transform(command_context& ctx)
@@ -723,7 +713,9 @@ class transforms_applier
         if (defer_) {
             auto& defer_tranforms = deferred_transforms_[ctx_.channel_index];
             defer_tranforms.insert(defer_tranforms.end(), transforms_.begin(), transforms_.end());
-        } else
+        } else if (ctx_.batch_transforms)
+            ctx_.batch_transforms->insert(ctx_.batch_transforms->end(), transforms_.begin(), transforms_.end());
+        else
             ctx_.channel.channel->stage().apply_transforms(transforms_);
     }
 };
@@ -1127,6 +1119,38 @@ std::wstring mixer_volume_command(command_context& ctx)
         [](frame_transform& t, double value) { t.audio_transform.volume = value; });
 }
 
+// Routes the audio channels of the layer as 1-based "source:destination[:gain]" pairs, RESET goes back to passing
+// every channel through as is.
+std::wstring mixer_audio_route_command(command_context& ctx)
+{
+    if (ctx.parameters.empty()) {
+        return reply_value(ctx, [](const frame_transform& t) {
+            return t.audio_transform.route ? t.audio_transform.route->print() : L"";
+        });
+    }
+
+    transforms_applier transforms(ctx);
+
+    std::shared_ptr<const audio_route> route;
+    if (!boost::iequals(ctx.parameters.at(0), L"RESET")) {
+        route = audio_route::parse(boost::join(ctx.parameters, L" "));
+        if (route->entries.empty()) {
+            route = nullptr;
+        }
+    }
+
+    transforms.add(stage::transform_tuple_t(ctx.layer_index(),
+                                            [=](frame_transform transform) -> frame_transform {
+                                                transform.audio_transform.route = route;
+                                                return transform;
+                                            },
+                                            0,
+                                            tweener(L"linear")));
+    transforms.apply();
+
+    return L"202 MIXER OK\r\n";
+}
+
 std::wstring mixer_mastervolume_command(command_context& ctx)
 {
     if (ctx.parameters.empty()) {
@@ -1140,6 +1164,23 @@ std::wstring mixer_mastervolume_command(command_context& ctx)
     return L"202 MIXER OK\r\n";
 }
 
+// Momentary, short-term and integrated loudness in LUFS and the true peak in dBTP of the channel, RESET restarts the
+// integrated loudness and the true peak.
+std::wstring mixer_loudness_command(command_context& ctx)
+{
+    if (!ctx.parameters.empty() && boost::iequals(ctx.parameters.at(0), L"RESET")) {
+        ctx.channel.channel->mixer().reset_loudness();
+        return L"202 MIXER OK\r\n";
+    }
+
+    const auto loudness = ctx.channel.channel->mixer().loudness();
+
+    std::wstringstream str;
+    str << std::fixed << std::setprecision(1) << loudness.momentary << L" " << loudness.short_term << L" "
+        << loudness.integrated << L" " << loudness.true_peak;
+    return L"201 MIXER OK\r\n" + str.str() + L"\r\n";
+}
+
 std::wstring mixer_grid_command(command_context& ctx)
 {
     transforms_applier transforms(ctx);
@@ -1208,25 +1249,22 @@ std::wstring channel_grid_command(command_context& ctx)
 
     self.channel->output().add(screen);
 
+    // The other channels are drawn from their rendered textures by a single multiview, instead of each being routed
+    // to a layer of their own and composited again.
+    std::vector<std::wstring> multiview_params = {L"[MULTIVIEW]"};
     for (auto& channel : ctx.channels) {
         if (channel.channel != self.channel) {
-            core::diagnostics::call_context::for_thread().layer = index;
-            auto producer                                       = ctx.producer_registry->create_producer(
-                get_producer_dependencies(self.channel, ctx), L"route://" + std::to_wstring(channel.channel->index()));
-            self.channel->stage().load(index, producer, false);
-            self.channel->stage().play(index);
-            index++;
+            multiview_params.push_back(std::to_wstring(channel.channel->index()));
         }
     }
 
-    auto num_channels       = ctx.channels.size() - 1;
-    int  square_side_length = std::ceil(std::sqrt(num_channels));
-
-    ctx.channel_index = self.channel->index();
-    ctx.channel       = self;
-    ctx.parameters.clear();
-    ctx.parameters.push_back(std::to_wstring(square_side_length));
-    mixer_grid_command(ctx);
+    if (multiview_params.size() > 1) {
+        core::diagnostics::call_context::for_thread().layer = index;
+        auto producer =
+            ctx.producer_registry->create_producer(get_producer_dependencies(self.channel, ctx), multiview_params);
+        self.channel->stage().load(index, producer, false);
+        self.channel->stage().play(index);
+    }
 
     return L"202 CHANNEL_GRID OK\r\n";
 }
@@ -1280,65 +1318,37 @@ std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls"
 
 std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
 
-struct param_visitor : public boost::static_visitor<void>
+// Replies are xml unless JSON is passed as the last parameter.
+bool json_reply(const command_context& ctx)
 {
-    std::wstring path;
-    pt::wptree&  o;
+    return !ctx.parameters.empty() && boost::iequals(ctx.parameters.back(), L"JSON");
+}
 
-    template <typename T>
-    param_visitor(std::string path, T& o)
-        : path(u16(path))
-        , o(o)
-    {
+std::wstring tree_reply(const command_context& ctx, std::wstring reply, const pt::wptree& tree)
+{
+    if (json_reply(ctx)) {
+        IO::write_json(reply, tree);
+    } else {
+        IO::write_xml(reply, tree);
     }
-
-    void operator()(const bool value) { o.add(path, value); }
-
-    void operator()(const int32_t value) { o.add(path, value); }
-
-    void operator()(const uint32_t value) { o.add(path, value); }
-
-    void operator()(const int64_t value) { o.add(path, value); }
-
-    void operator()(const uint64_t value) { o.add(path, value); }
-
-    void operator()(const float value) { o.add(path, value); }
-
-    void operator()(const double value) { o.add(path, value); }
-
-    void operator()(const std::string& value) { o.add(path, u16(value)); }
-
-    void operator()(const std::wstring& value) { o.add(path, value); }
-};
+    reply += L"\r\n";
+    return reply;
+}
 
 std::wstring info_channel_command(command_context& ctx)
 {
-    pt::wptree info;
-    pt::wptree channel_info;
-
-    auto state = ctx.channel.channel->state();
-    for (const auto& p : state) {
-        const auto replaced = boost::algorithm::replace_all_copy(p.first, "/", ".");
-        // avoid digit-only nodes in XML
-        const auto path = boost::algorithm::replace_all_regex_copy(
-            replaced, boost::regex("\\.(.*?)\\.([0-9]*?)\\."), std::string(".$1.$1_$2."));
-        param_visitor param_visitor(path, channel_info);
-        for (const auto& element : p.second) {
-            boost::apply_visitor(param_visitor, element);
-        }
-    }
-
-    info.add_child(L"channel", channel_info);
-
-    std::wstringstream replyString;
     // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO OK\r\n";
+    std::wstring reply = L"201 INFO OK\r\n";
 
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(replyString, info, w);
+    const auto state = ctx.channel.channel->state();
+    if (json_reply(ctx)) {
+        IO::write_json(reply, state);
+    } else {
+        IO::write_xml(reply, "channel", state);
+    }
 
-    replyString << L"\r\n";
-    return replyString.str();
+    reply += L"\r\n";
+    return reply;
 }
 
 std::wstring info_command(command_context& ctx)
@@ -1356,15 +1366,8 @@ std::wstring info_command(command_context& ctx)
 
 std::wstring info_config_command(command_context& ctx)
 {
-    std::wstringstream replyString;
     // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO CONFIG OK\r\n";
-
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(replyString, caspar::env::properties(), w);
-
-    replyString << L"\r\n";
-    return replyString.str();
+    return tree_reply(ctx, L"201 INFO CONFIG OK\r\n", caspar::env::properties());
 }
 
 std::wstring info_paths_command(command_context& ctx)
@@ -1377,15 +1380,29 @@ std::wstring info_paths_command(command_context& ctx)
     info.add(L"paths.template-path", caspar::env::template_folder());
     info.add(L"paths.initial-path", caspar::env::initial_folder() + L"/");
 
-    std::wstringstream replyString;
     // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO PATHS OK\r\n";
+    return tree_reply(ctx, L"201 INFO PATHS OK\r\n", info);
+}
 
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(replyString, info, w);
+std::wstring info_server_command(command_context& ctx)
+{
+    boost::property_tree::wptree info;
+    auto&                        connections = info.add_child(L"server.connections", boost::property_tree::wptree());
+
+    for (auto& conn : IO::get_connection_infos()) {
+        auto& connection = connections.add_child(L"connection", boost::property_tree::wptree());
+        connection.add(L"address", conn.address);
+        connection.add(L"port", conn.port);
+        connection.add(L"queued-messages", conn.queued_messages);
+        connection.add(L"queued-bytes", conn.queued_bytes);
+        connection.add(L"sent-bytes", conn.sent_bytes);
+    }
 
-    replyString << L"\r\n";
-    return replyString.str();
+    const auto log_stats = log::get_stats();
+    info.add(L"server.log.overruns", log_stats.overruns);
+    info.add(L"server.log.dropped", log_stats.dropped);
+
+    return tree_reply(ctx, L"201 INFO SERVER OK\r\n", info);
 }
 
 std::wstring diag_command(command_context& ctx)
@@ -1459,14 +1476,7 @@ std::wstring gl_info_command(command_context& ctx)
     if (!device)
         CASPAR_THROW_EXCEPTION(not_supported() << msg_info("GL command only supported with OpenGL accelerator."));
 
-    std::wstringstream result;
-    result << L"201 GL INFO OK\r\n";
-
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(result, device->info(), w);
-    result << L"\r\n";
-
-    return result.str();
+    return tree_reply(ctx, L"201 GL INFO OK\r\n", device->info());
 }
 
 std::wstring gl_gc_command(command_context& ctx)
@@ -1480,12 +1490,47 @@ std::wstring gl_gc_command(command_context& ctx)
     return L"202 GL GC OK\r\n";
 }
 
+// TRACE START [duration ms] [filename]
+std::wstring trace_start_command(command_context& ctx)
+{
+    auto duration = std::chrono::milliseconds(5000);
+    if (!ctx.parameters.empty()) {
+        duration = std::chrono::milliseconds(boost::lexical_cast<int>(ctx.parameters.at(0)));
+    }
+    if (duration <= std::chrono::milliseconds(0) || duration > std::chrono::minutes(10)) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Trace duration must be between 1 ms and 10 minutes."));
+    }
+
+    std::wstring filename;
+    if (ctx.parameters.size() > 1) {
+        filename = env::log_folder() + ctx.parameters.at(1);
+    } else {
+        filename = env::log_folder() + L"trace-" +
+                   boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) + L".json";
+    }
+
+    if (!core::diagnostics::trace::start(filename, duration)) {
+        return L"403 TRACE START FAILED\r\n";
+    }
+
+    return L"202 TRACE START OK\r\n";
+}
+
+std::wstring trace_stop_command(command_context& ctx)
+{
+    core::diagnostics::trace::stop();
+
+    return L"202 TRACE STOP OK\r\n";
+}
+
 void register_commands(amcp_command_repository& repo)
 {
     repo.register_channel_command(L"Basic Commands", L"LOADBG", loadbg_command, 1);
     repo.register_channel_command(L"Basic Commands", L"LOAD", load_command, 1);
     repo.register_channel_command(L"Basic Commands", L"PLAY", play_command, 0);
     repo.register_channel_command(L"Basic Commands", L"PAUSE", pause_command, 0);
+    repo.register_channel_command(L"Basic Commands", L"STING CACHE", sting_cache_command, 1);
+    repo.register_command(L"Basic Commands", L"STING UNCACHE", sting_uncache_command, 0);
     repo.register_channel_command(L"Basic Commands", L"RESUME", resume_command, 0);
     repo.register_channel_command(L"Basic Commands", L"STOP", stop_command, 0);
     repo.register_channel_command(L"Basic Commands", L"CLEAR", clear_command, 0);
@@ -1498,19 +1543,26 @@ void register_commands(amcp_command_repository& repo)
     repo.register_channel_command(L"Basic Commands", L"SET", set_command, 2);
     repo.register_command(L"Basic Commands", L"LOCK", lock_command, 2);
 
-    repo.register_command(L"Data Commands", L"DATA STORE", data_store_command, 2);
-    repo.register_command(L"Data Commands", L"DATA RETRIEVE", data_retrieve_command, 1);
-    repo.register_command(L"Data Commands", L"DATA LIST", data_list_command, 0);
-    repo.register_command(L"Data Commands", L"DATA REMOVE", data_remove_command, 1);
+    // Shared by the data and template commands, it lives as long as the commands do.
+    auto store = std::make_shared<data_store>(env::data_folder());
+    auto with_store = [store](std::wstring (*command)(command_context&, data_store&)) {
+        return [store, command](command_context& ctx) { return command(ctx, *store); };
+    };
+
+    repo.register_command(L"Data Commands", L"DATA STORE", with_store(data_store_command), 2);
+    repo.register_command(L"Data Commands", L"DATA RETRIEVE", with_store(data_retrieve_command), 1);
+    repo.register_command(L"Data Commands", L"DATA LIST", with_store(data_list_command), 0);
+    repo.register_command(L"Data Commands", L"DATA REMOVE", with_store(data_remove_command), 1);
 
-    repo.register_channel_command(L"Template Commands", L"CG ADD", cg_add_command, 3);
+    repo.register_channel_command(L"Template Commands", L"CG ADD", with_store(cg_add_command), 3);
     repo.register_channel_command(L"Template Commands", L"CG PLAY", cg_play_command, 1);
     repo.register_channel_command(L"Template Commands", L"CG STOP", cg_stop_command, 1);
     repo.register_channel_command(L"Template Commands", L"CG NEXT", cg_next_command, 1);
     repo.register_channel_command(L"Template Commands", L"CG REMOVE", cg_remove_command, 1);
     repo.register_channel_command(L"Template Commands", L"CG CLEAR", cg_clear_command, 0);
-    repo.register_channel_command(L"Template Commands", L"CG UPDATE", cg_update_command, 2);
+    repo.register_channel_command(L"Template Commands", L"CG UPDATE", with_store(cg_update_command), 2);
     repo.register_channel_command(L"Template Commands", L"CG INVOKE", cg_invoke_command, 2);
+    repo.register_channel_command(L"Template Commands", L"CG BATCH", cg_batch_command, 1);
 
     repo.register_channel_command(L"Mixer Commands", L"MIXER KEYER", mixer_keyer_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER INVERT", mixer_invert_command, 0);
@@ -1528,7 +1580,9 @@ void register_commands(amcp_command_repository& repo)
     repo.register_channel_command(L"Mixer Commands", L"MIXER ROTATION", mixer_rotation_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER PERSPECTIVE", mixer_perspective_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER VOLUME", mixer_volume_command, 0);
+    repo.register_channel_command(L"Mixer Commands", L"MIXER AUDIO_ROUTE", mixer_audio_route_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER MASTERVOLUME", mixer_mastervolume_command, 0);
+    repo.register_channel_command(L"Mixer Commands", L"MIXER LOUDNESS", mixer_loudness_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER GRID", mixer_grid_command, 1);
     repo.register_channel_command(L"Mixer Commands", L"MIXER COMMIT", mixer_commit_command, 0);
     repo.register_channel_command(L"Mixer Commands", L"MIXER CLEAR", mixer_clear_command, 0);
@@ -1552,8 +1606,11 @@ void register_commands(amcp_command_repository& repo)
     repo.register_command(L"Query Commands", L"INFO", info_command, 0);
     repo.register_command(L"Query Commands", L"INFO CONFIG", info_config_command, 0);
     repo.register_command(L"Query Commands", L"INFO PATHS", info_paths_command, 0);
+    repo.register_command(L"Query Commands", L"INFO SERVER", info_server_command, 0);
     repo.register_command(L"Query Commands", L"GL INFO", gl_info_command, 0);
     repo.register_command(L"Query Commands", L"GL GC", gl_gc_command, 0);
+    repo.register_command(L"Query Commands", L"TRACE START", trace_start_command, 0);
+    repo.register_command(L"Query Commands", L"TRACE STOP", trace_stop_command, 0);
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -28,10 +28,19 @@
 #include "amcp_shared.h"
 
 #include <algorithm>
-
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <cwctype>
+#include <future>
+#include <map>
+#include <mutex>
+
+#include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/trim.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/optional.hpp>
+#include <boost/rational.hpp>
 
 #if defined(_MSC_VER)
 #pragma warning(push, 1) // TODO: Legacy code, just disable warnings
@@ -41,33 +50,141 @@ namespace caspar { namespace protocol { namespace amcp {
 
 using IO::ClientInfoPtr;
 
-template <typename Out, typename In>
-bool try_lexical_cast(const In& input, Out& result)
+// Parses a number of at most 9 digits from [it, end), stopping at a '-'.
+bool parse_index(std::wstring::const_iterator& it, std::wstring::const_iterator end, int& result)
+{
+    int value  = 0;
+    int digits = 0;
+    for (; it != end && *it != L'-'; ++it, ++digits) {
+        if (*it < L'0' || *it > L'9' || digits == 9)
+            return false;
+        value = value * 10 + (*it - L'0');
+    }
+
+    if (digits == 0)
+        return false;
+
+    result = value;
+    return true;
+}
+
+// Parses "channel[-layer]" in place, the channel spec is looked for on every command.
+bool parse_channel_spec(const std::wstring& spec, int& channel_index, int& layer_index)
 {
-    Out  saved   = result;
-    bool success = boost::conversion::detail::try_lexical_convert(input, result);
+    auto begin = spec.begin();
+    auto end   = spec.end();
+    while (begin != end && std::iswspace(*begin))
+        ++begin;
+    while (end != begin && std::iswspace(*(end - 1)))
+        --end;
+
+    if (!parse_index(begin, end, channel_index))
+        return false;
+
+    if (begin != end && !parse_index(++begin, end, layer_index))
+        layer_index = -1;
+
+    return true;
+}
+
+std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pTokenVector)
+{
+    // split on whitespace but keep strings within quotationmarks
+    // treat \ as the start of an escape-sequence: the following char will indicate what to actually put in the
+    // string
+
+    std::wstring currentToken;
+
+    bool inQuote        = false;
+    bool getSpecialCode = false;
+
+    for (unsigned int charIndex = 0; charIndex < message.size(); ++charIndex) {
+        if (getSpecialCode) {
+            // insert code-handling here
+            switch (message[charIndex]) {
+                case L'\\':
+                    currentToken += L"\\";
+                    break;
+                case L'\"':
+                    currentToken += L"\"";
+                    break;
+                case L'n':
+                    currentToken += L"\n";
+                    break;
+                default:
+                    break;
+            }
+            getSpecialCode = false;
+            continue;
+        }
+
+        if (message[charIndex] == L'\\') {
+            getSpecialCode = true;
+            continue;
+        }
 
-    if (!success)
-        result = saved; // Needed because of how try_lexical_convert is implemented.
+        if (message[charIndex] == L' ' && inQuote == false) {
+            if (!currentToken.empty()) {
+                pTokenVector.push_back(currentToken);
+                currentToken.clear();
+            }
+            continue;
+        }
 
-    return success;
+        if (message[charIndex] == L'\"') {
+            inQuote = !inQuote;
+
+            if (!currentToken.empty() || !inQuote) {
+                pTokenVector.push_back(currentToken);
+                currentToken.clear();
+            }
+            continue;
+        }
+
+        currentToken += message[charIndex];
+    }
+
+    if (!currentToken.empty()) {
+        pTokenVector.push_back(currentToken);
+        currentToken.clear();
+    }
+
+    return pTokenVector.size();
 }
 
 struct AMCPProtocolStrategy::impl
 {
   private:
+    using transforms_t = std::vector<core::stage::transform_tuple_t>;
+
+    // The commands received from a client between BEGIN and COMMIT, by the index of the queue they run on.
+    struct batch
+    {
+        struct part
+        {
+            std::vector<AMCPCommand::ptr_type> commands;
+            std::shared_ptr<transforms_t>      transforms = std::make_shared<transforms_t>();
+        };
+
+        std::weak_ptr<IO::client_connection<wchar_t>> client;
+        std::map<int, part>                           parts;
+        bool                                          failed = false;
+    };
+
     std::vector<AMCPCommandQueue::ptr_type>  commandQueues_;
     spl::shared_ptr<amcp_command_repository> repo_;
 
+    std::mutex                   batches_mutex_;
+    std::map<const void*, batch> batches_;
+
   public:
     impl(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo)
         : repo_(repo)
     {
-        commandQueues_.push_back(spl::make_shared<AMCPCommandQueue>(L"General Queue for " + name));
+        commandQueues_.push_back(AMCPCommandQueue::get(L"General Queue"));
 
         for (int i = 0; i < repo_->channels().size(); ++i) {
-            commandQueues_.push_back(
-                spl::make_shared<AMCPCommandQueue>(L"Channel " + std::to_wstring(i + 1) + L" for " + name));
+            commandQueues_.push_back(AMCPCommandQueue::get(L"Channel " + std::to_wstring(i + 1)));
         }
     }
 
@@ -91,6 +208,8 @@ struct AMCPProtocolStrategy::impl
         AMCPCommand::ptr_type                       command;
         error_state                                 error = error_state::no_error;
         std::shared_ptr<AMCPCommandQueue>           queue;
+        int                                         channel_index = -1;
+        std::wstring                                schedule;
     };
 
     // The paser method expects message to be complete messages with the delimiter stripped away.
@@ -115,15 +234,22 @@ struct AMCPProtocolStrategy::impl
 
         CASPAR_LOG(info) << L"Received message from " << client->address() << ": " << message << L"\\r\\n";
 
+        if (parse_batch(tokens, client))
+            return;
+
         command_interpreter_result result;
-        if (interpret_command_string(tokens, result, client)) {
+        if (interpret_command_string(std::move(tokens), result, client)) {
             if (result.lock && !result.lock->check_access(client))
                 result.error = error_state::access_error;
-            else
+            else if (!result.schedule.empty())
+                schedule(result);
+            else if (!add_to_batch(result, client))
                 result.queue->AddCommand(result.command);
         }
 
         if (result.error != error_state::no_error) {
+            fail_batch(client);
+
             std::wstringstream answer;
 
             if (!result.request_id.empty())
@@ -155,6 +281,224 @@ struct AMCPProtocolStrategy::impl
     }
 
   private:
+    // BEGIN makes the commands that follow from the client be validated as they arrive, without being executed or
+    // replied to. COMMIT then runs the commands of each channel as one task on the queue of that channel, in parallel
+    // with the other channels, and replies to all of them at once when every channel is done. DISCARD drops them.
+    // Mixer transforms of a batch are applied with a single stage call per channel after the other commands of that
+    // channel have run. A batch with an invalid command fails on COMMIT without running anything.
+    bool parse_batch(const std::list<std::wstring>& tokens, const ClientInfoPtr& client)
+    {
+        auto         it = tokens.begin();
+        std::wstring request_id;
+
+        if (it != tokens.end() && boost::iequals(*it, L"REQ") && std::next(it) != tokens.end()) {
+            request_id = *std::next(it);
+            std::advance(it, 2);
+        }
+
+        if (it == tokens.end() || std::next(it) != tokens.end())
+            return false;
+
+        auto keyword = boost::to_upper_copy(*it);
+        if (keyword != L"BEGIN" && keyword != L"COMMIT" && keyword != L"DISCARD")
+            return false;
+
+        auto prefix = request_id.empty() ? std::wstring() : L"RES " + request_id + L" ";
+
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+
+        prune_batches();
+
+        auto it_batch = batches_.find(client.get());
+
+        if (keyword == L"BEGIN") {
+            if (it_batch != batches_.end()) {
+                client->send(prefix + L"403 BEGIN FAILED\r\n");
+                return true;
+            }
+
+            batches_[client.get()].client = client;
+            client->send(prefix + L"202 BEGIN OK\r\n");
+            return true;
+        }
+
+        if (it_batch == batches_.end()) {
+            client->send(prefix + L"403 " + keyword + L" FAILED\r\n");
+            return true;
+        }
+
+        auto current = std::move(it_batch->second);
+        batches_.erase(it_batch);
+
+        if (keyword == L"DISCARD") {
+            client->send(prefix + L"202 DISCARD OK\r\n");
+            return true;
+        }
+
+        if (current.failed) {
+            client->send(prefix + L"403 COMMIT FAILED\r\n");
+            return true;
+        }
+
+        struct commit_state
+        {
+            std::mutex                mutex;
+            std::vector<std::wstring> replies;
+            std::size_t               remaining;
+            bool                      committed = true;
+        };
+
+        auto state       = std::make_shared<commit_state>();
+        state->replies   = std::vector<std::wstring>(current.parts.size());
+        state->remaining = current.parts.size();
+
+        if (current.parts.empty()) {
+            client->send(prefix + L"202 COMMIT OK\r\n");
+            return true;
+        }
+
+        auto n = 0;
+        for (auto& part : current.parts) {
+            std::function<void()> commit = [] {};
+            if (part.first > 0) {
+                auto channel    = repo_->channels().at(part.first - 1).channel;
+                auto transforms = part.second.transforms;
+                commit          = [channel, transforms] {
+                    if (!transforms->empty())
+                        channel->stage().apply_transforms(*transforms).get();
+                };
+            }
+
+            commandQueues_.at(part.first)
+                ->AddBatch(std::move(part.second.commands),
+                           std::move(commit),
+                           [state, client, prefix, n](std::wstring&& replies, bool committed) {
+                               std::lock_guard<std::mutex> lock(state->mutex);
+
+                               state->replies[n] = std::move(replies);
+                               state->committed  = state->committed && committed;
+
+                               if (--state->remaining > 0)
+                                   return;
+
+                               std::wstring answer;
+                               for (auto& reply : state->replies)
+                                   answer += reply;
+                               answer += prefix + (state->committed ? L"202 COMMIT OK\r\n" : L"501 COMMIT FAILED\r\n");
+
+                               client->send(std::move(answer));
+                           });
+            ++n;
+        }
+
+        return true;
+    }
+
+    // Holds the command back if the client has begun a batch.
+    bool add_to_batch(const command_interpreter_result& result, const ClientInfoPtr& client)
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+
+        prune_batches();
+
+        auto it = batches_.find(client.get());
+        if (it == batches_.end())
+            return false;
+
+        auto& part = it->second.parts[result.channel_index + 1];
+
+        if (result.channel_index != -1)
+            result.command->set_batch_transforms(part.transforms);
+
+        part.commands.push_back(result.command);
+
+        return true;
+    }
+
+    void fail_batch(const ClientInfoPtr& client)
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+
+        auto it = batches_.find(client.get());
+        if (it != batches_.end())
+            it->second.failed = true;
+    }
+
+    // AT frame|+frames|hh:mm:ss:ff runs a channel command at the start of the tick of that frame of the channel,
+    // instead of when the queue gets to it. Frames are counted from the start of the channel, see frame in its state,
+    // and timecodes are times of day of the local clock, converted to a frame when the command arrives.
+    void schedule(command_interpreter_result& result)
+    {
+        if (result.channel_index == -1) {
+            result.error = error_state::parameters_error;
+            return;
+        }
+
+        auto& channel = *repo_->channels().at(result.channel_index).channel;
+        auto  frame   = resolve_frame(result.schedule, channel);
+        if (!frame) {
+            result.error = error_state::parameters_error;
+            return;
+        }
+
+        result.queue->AddScheduledCommand(result.command, channel, *frame);
+    }
+
+    static boost::optional<uint64_t> resolve_frame(const std::wstring& spec, const core::video_channel& channel)
+    {
+        try {
+            const auto current = channel.frame_number();
+
+            if (spec.find(L':') != std::wstring::npos || spec.find(L';') != std::wstring::npos) {
+                std::vector<std::wstring> fields;
+                boost::split(fields, spec, boost::is_any_of(L":;"));
+                if (fields.size() != 4) {
+                    return boost::none;
+                }
+
+                // Frames of the timecode are counted at the frame rate, the channel ticks at time_scale/duration.
+                const auto format_desc = channel.video_format_desc();
+                const auto tick_rate   = static_cast<double>(format_desc.time_scale) / format_desc.duration;
+                const auto tc_rate     = std::max(1.0, std::round(boost::rational_cast<double>(format_desc.framerate)));
+
+                const auto target = std::stoi(fields[0]) * 3600 + std::stoi(fields[1]) * 60 + std::stoi(fields[2]) +
+                                    std::stoi(fields[3]) / tc_rate;
+
+                const auto now   = std::chrono::system_clock::now();
+                const auto t     = std::chrono::system_clock::to_time_t(now);
+                const auto local = *std::localtime(&t);
+                const auto subsecond =
+                    std::chrono::duration<double>(now - std::chrono::system_clock::from_time_t(t)).count();
+                const auto of_day = local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec + subsecond;
+
+                auto ahead = target - of_day;
+                if (ahead < 0) {
+                    ahead += 24 * 3600;
+                }
+                return current + static_cast<uint64_t>(std::llround(ahead * tick_rate));
+            }
+
+            if (!spec.empty() && spec[0] == L'+') {
+                return current + std::stoull(spec.substr(1));
+            }
+
+            return std::stoull(spec);
+        } catch (...) {
+            return boost::none;
+        }
+    }
+
+    // Drops the batches of disconnected clients, so that their addresses can be reused.
+    void prune_batches()
+    {
+        for (auto it = batches_.begin(); it != batches_.end();) {
+            if (it->second.client.expired())
+                it = batches_.erase(it);
+            else
+                ++it;
+        }
+    }
+
     bool
     interpret_command_string(std::list<std::wstring> tokens, command_interpreter_result& result, ClientInfoPtr client)
     {
@@ -175,6 +519,18 @@ struct AMCPProtocolStrategy::impl
                 tokens.pop_front();
             }
 
+            if (!tokens.empty() && boost::iequals(tokens.front(), L"AT")) {
+                tokens.pop_front();
+
+                if (tokens.empty()) {
+                    result.error = error_state::parameters_error;
+                    return false;
+                }
+
+                result.schedule = tokens.front();
+                tokens.pop_front();
+            }
+
             // Fail if no more tokens.
             if (tokens.empty()) {
                 result.error = error_state::command_error;
@@ -191,18 +547,11 @@ struct AMCPProtocolStrategy::impl
             std::wstring channel_spec;
 
             if (!tokens.empty()) {
-                channel_spec                            = tokens.front();
-                std::wstring              channelid_str = boost::trim_copy(channel_spec);
-                std::vector<std::wstring> split;
-                boost::split(split, channelid_str, boost::is_any_of("-"));
+                channel_spec = tokens.front();
 
-                // Use non_throwing lexical cast to not hit exception break point all the time.
-                if (try_lexical_cast(split[0], channel_index)) {
+                if (parse_channel_spec(channel_spec, channel_index, layer_index)) {
                     --channel_index;
 
-                    if (split.size() > 1)
-                        try_lexical_cast(split[1], layer_index);
-
                     // Consume channel-spec
                     tokens.pop_front();
                 }
@@ -216,8 +565,9 @@ struct AMCPProtocolStrategy::impl
                     repo_->create_channel_command(result.command_name, client, channel_index, layer_index, tokens);
 
                 if (result.command) {
-                    result.lock  = repo_->channels().at(channel_index).lock;
-                    result.queue = commandQueues_.at(channel_index + 1);
+                    result.lock          = repo_->channels().at(channel_index).lock;
+                    result.queue         = commandQueues_.at(channel_index + 1);
+                    result.channel_index = channel_index;
                 } else // Might be a non channel command, although the first argument is numeric
                 {
                     // Restore backed up channel spec string.
@@ -257,72 +607,6 @@ struct AMCPProtocolStrategy::impl
 
         return result.error == error_state::no_error;
     }
-
-    template <typename C>
-    std::size_t tokenize(const std::wstring& message, C& pTokenVector)
-    {
-        // split on whitespace but keep strings within quotationmarks
-        // treat \ as the start of an escape-sequence: the following char will indicate what to actually put in the
-        // string
-
-        std::wstring currentToken;
-
-        bool inQuote        = false;
-        bool getSpecialCode = false;
-
-        for (unsigned int charIndex = 0; charIndex < message.size(); ++charIndex) {
-            if (getSpecialCode) {
-                // insert code-handling here
-                switch (message[charIndex]) {
-                    case L'\\':
-                        currentToken += L"\\";
-                        break;
-                    case L'\"':
-                        currentToken += L"\"";
-                        break;
-                    case L'n':
-                        currentToken += L"\n";
-                        break;
-                    default:
-                        break;
-                }
-                getSpecialCode = false;
-                continue;
-            }
-
-            if (message[charIndex] == L'\\') {
-                getSpecialCode = true;
-                continue;
-            }
-
-            if (message[charIndex] == L' ' && inQuote == false) {
-                if (!currentToken.empty()) {
-                    pTokenVector.push_back(currentToken);
-                    currentToken.clear();
-                }
-                continue;
-            }
-
-            if (message[charIndex] == L'\"') {
-                inQuote = !inQuote;
-
-                if (!currentToken.empty() || !inQuote) {
-                    pTokenVector.push_back(currentToken);
-                    currentToken.clear();
-                }
-                continue;
-            }
-
-            currentToken += message[charIndex];
-        }
-
-        if (!currentToken.empty()) {
-            pTokenVector.push_back(currentToken);
-            currentToken.clear();
-        }
-
-        return pTokenVector.size();
-    }
 };
 
 AMCPProtocolStrategy::AMCPProtocolStrategy(const std::wstring&                             name,
@@ -26,10 +26,15 @@
 #include <common/memory.h>
 
 #include <future>
+#include <list>
 #include <string>
 
 namespace caspar { namespace protocol { namespace amcp {
 
+// Splits message on spaces, except within quotes, and appends the tokens to tokens. A backslash escapes a backslash,
+// a quote or an n for a newline. Returns the number of tokens.
+std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& tokens);
+
 class AMCPProtocolStrategy : public IO::IProtocolStrategy
 {
   public:
@@ -53,6 +53,7 @@ class amcp_command_repository
 
     const std::vector<channel_context>& channels() const;
 
+    // A name that has been registered already, e.g. by a module, keeps its first command.
     void register_command(std::wstring category, std::wstring name, amcp_command_func command, int min_num_params);
     void
     register_channel_command(std::wstring category, std::wstring name, amcp_command_func command, int min_num_params);
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "data_store.h"
+
+#include <common/except.h>
+#include <common/filesystem.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/locale.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/copy.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+std::wstring read_utf8_file(const boost::filesystem::path& file)
+{
+    std::wstringstream           result;
+    boost::filesystem::wifstream filestream(file);
+
+    if (filestream) {
+        // Consume BOM first
+        filestream.get();
+        // read all data
+        result << filestream.rdbuf();
+    }
+
+    return result.str();
+}
+
+std::wstring read_latin1_file(const boost::filesystem::path& file)
+{
+    boost::locale::generator gen;
+    gen.locale_cache_enabled(true);
+    gen.categories(boost::locale::codepage_facet);
+
+    std::stringstream           result_stream;
+    boost::filesystem::ifstream filestream(file);
+    filestream.imbue(gen("en_US.ISO8859-1"));
+
+    if (filestream) {
+        // read all data
+        result_stream << filestream.rdbuf();
+    }
+
+    std::string  result = result_stream.str();
+    std::wstring widened_result;
+
+    // The first 255 codepoints in unicode is the same as in latin1
+    boost::copy(result | boost::adaptors::transformed([](char c) { return static_cast<unsigned char>(c); }),
+                std::back_inserter(widened_result));
+
+    return widened_result;
+}
+
+std::wstring read_file(const boost::filesystem::path& file)
+{
+    static const uint8_t BOM[] = {0xef, 0xbb, 0xbf};
+
+    if (!boost::filesystem::exists(file)) {
+        return L"";
+    }
+
+    if (boost::filesystem::file_size(file) >= 3) {
+        boost::filesystem::ifstream bom_stream(file);
+
+        char header[3];
+        bom_stream.read(header, 3);
+        bom_stream.close();
+
+        if (std::memcmp(BOM, header, 3) == 0)
+            return read_utf8_file(file);
+    }
+
+    return read_latin1_file(file);
+}
+
+std::wstring get_key(std::wstring name)
+{
+    boost::replace_all(name, L"\\", L"/");
+    boost::trim_left_if(name, boost::is_any_of(L"/"));
+    return boost::to_upper_copy(name);
+}
+
+} // namespace
+
+struct data_store::impl
+{
+    struct entry
+    {
+        std::wstring  name;     // As first stored, used for the file name of new data.
+        std::wstring  filename; // Empty until the data has been written.
+        std::wstring  data;
+        bool          removed = false;
+        std::uint64_t version = 0;
+    };
+
+    const std::wstring folder_;
+
+    mutable std::mutex            mutex_;
+    std::map<std::wstring, entry> data_; // By key.
+    std::set<std::wstring>        dirty_;
+    std::condition_variable       cond_;
+    bool                          abort_ = false;
+    std::thread                   thread_;
+
+    explicit impl(std::wstring folder)
+        : folder_(std::move(folder))
+    {
+        load();
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[amcp::data_store]");
+            run();
+        });
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void load()
+    {
+        boost::system::error_code ec;
+        for (boost::filesystem::recursive_directory_iterator it(folder_, ec), end; !ec && it != end;
+             it.increment(ec)) {
+            if (!boost::filesystem::is_regular_file(it->path()) ||
+                !boost::iequals(it->path().extension().wstring(), L".ftd")) {
+                continue;
+            }
+
+            try {
+                entry e;
+                e.name     = get_relative_without_extension(it->path(), folder_).generic_wstring();
+                e.filename = it->path().wstring();
+                e.data     = read_file(it->path());
+                data_.emplace(get_key(e.name), std::move(e));
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+        CASPAR_LOG(info) << L"[data_store] Loaded " << data_.size() << L" data files.";
+    }
+
+    void store(const std::wstring& name, std::wstring data)
+    {
+        const auto key = get_key(name);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto&                       e = data_[key];
+            if (e.name.empty()) {
+                e.name = name;
+            }
+            e.data    = std::move(data);
+            e.removed = false;
+            ++e.version;
+            dirty_.insert(key);
+        }
+        cond_.notify_all();
+    }
+
+    std::wstring retrieve(const std::wstring& name) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = data_.find(get_key(name));
+        return it != data_.end() && !it->second.removed ? it->second.data : L"";
+    }
+
+    bool remove(const std::wstring& name)
+    {
+        const auto key = get_key(name);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = data_.find(key);
+            if (it == data_.end() || it->second.removed) {
+                return false;
+            }
+            it->second.data.clear();
+            it->second.removed = true;
+            ++it->second.version;
+            dirty_.insert(key);
+        }
+        cond_.notify_all();
+        return true;
+    }
+
+    std::vector<std::wstring> list(const std::wstring& sub_directory) const
+    {
+        auto prefix = boost::trim_right_copy_if(get_key(sub_directory), boost::is_any_of(L"/"));
+        if (!prefix.empty()) {
+            prefix += L"/";
+        }
+
+        std::vector<std::wstring>   names;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& p : data_) {
+            if (!p.second.removed && boost::starts_with(p.first, prefix)) {
+                names.push_back(p.first);
+            }
+        }
+        return names;
+    }
+
+    // Writes one changed entry at a time without holding the lock, until everything is written and the store is
+    // destroyed.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cond_.wait(lock, [&] { return abort_ || !dirty_.empty(); });
+            if (dirty_.empty()) {
+                return;
+            }
+
+            const auto key = *dirty_.begin();
+            dirty_.erase(dirty_.begin());
+
+            auto it = data_.find(key);
+            if (it == data_.end()) {
+                continue;
+            }
+            auto e = it->second;
+
+            lock.unlock();
+            try {
+                e.filename = write(e);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            lock.lock();
+
+            it = data_.find(key);
+            if (it != data_.end()) {
+                it->second.filename = e.filename;
+                if (it->second.removed && it->second.version == e.version) {
+                    data_.erase(it);
+                }
+            }
+        }
+    }
+
+    // Returns the file name of the written data, or an empty string once it has been removed.
+    std::wstring write(const entry& e) const
+    {
+        if (e.removed) {
+            if (!e.filename.empty() && !boost::filesystem::remove(e.filename)) {
+                CASPAR_LOG(warning) << L"[data_store] " << e.filename << L" could not be removed.";
+            }
+            return L"";
+        }
+
+        auto filename = e.filename;
+        if (filename.empty()) {
+            filename = folder_ + e.name + L".ftd";
+
+            auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
+            auto found_data_path = find_case_insensitive(data_path);
+
+            if (found_data_path)
+                data_path = *found_data_path;
+
+            if (!boost::filesystem::exists(data_path))
+                boost::filesystem::create_directories(data_path);
+
+            auto found_filename = find_case_insensitive(filename);
+
+            if (found_filename)
+                filename = *found_filename; // Overwrite case insensitive.
+        }
+
+        boost::filesystem::wofstream datafile(filename);
+        if (!datafile)
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
+
+        datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
+        datafile << e.data << std::flush;
+        datafile.close();
+
+        return filename;
+    }
+};
+
+data_store::data_store(std::wstring folder)
+    : impl_(new impl(std::move(folder)))
+{
+}
+
+data_store::~data_store() {}
+
+void data_store::store(const std::wstring& name, std::wstring data) { impl_->store(name, std::move(data)); }
+
+std::wstring data_store::retrieve(const std::wstring& name) const { return impl_->retrieve(name); }
+
+bool data_store::remove(const std::wstring& name) { return impl_->remove(name); }
+
+std::vector<std::wstring> data_store::list(const std::wstring& sub_directory) const
+{
+    return impl_->list(sub_directory);
+}
+
+}}} // namespace caspar::protocol::amcp
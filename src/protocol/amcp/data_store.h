@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// The .ftd files of a folder, kept in memory by upper case name so that DATA RETRIEVE and templates reading data
+// never touch the disk. Everything is loaded up front, changes are written behind on a background thread and the
+// remaining ones are flushed on destruction. Files changed on disk by others are not picked up while running.
+class data_store
+{
+  public:
+    explicit data_store(std::wstring folder);
+    ~data_store();
+
+    data_store(const data_store&) = delete;
+    data_store& operator=(const data_store&) = delete;
+
+    // Names are paths relative to the folder, without the extension and in any case.
+    void store(const std::wstring& name, std::wstring data);
+
+    // Returns an empty string if there is no data by that name.
+    std::wstring retrieve(const std::wstring& name) const;
+
+    // Returns false if there is no data by that name.
+    bool remove(const std::wstring& name);
+
+    // Returns the upper case names of the data below sub_directory, which is empty for all of it, sorted.
+    std::vector<std::wstring> list(const std::wstring& sub_directory) const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "data_protocol_strategy.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/producer/cg_proxy.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace caspar { namespace protocol { namespace data {
+
+class data_protocol_strategy : public IO::protocol_strategy<char>
+{
+    const std::vector<spl::shared_ptr<core::video_channel>> channels_;
+
+    // The producer of each layer written to, looked up on the stage again once it has been removed, so that a
+    // stream of data doesn't queue a lookup for every line on the channel.
+    std::map<std::pair<int, int>, std::weak_ptr<core::frame_producer>> producers_;
+
+  public:
+    explicit data_protocol_strategy(std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : channels_(std::move(channels))
+    {
+    }
+
+    void parse(const std::string& data) override
+    {
+        auto line = data;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            return;
+        }
+
+        try {
+            auto space = line.find(' ');
+            if (space == std::string::npos) {
+                CASPAR_LOG(warning) << L"[data] Expected channel[-layer] and data: " << u16(line.substr(0, 64));
+                return;
+            }
+
+            auto target  = line.substr(0, space);
+            auto dash    = target.find('-');
+            auto channel = std::stoi(target.substr(0, dash));
+            auto layer   = dash != std::string::npos ? std::stoi(target.substr(dash + 1))
+                                                     : static_cast<int>(core::cg_proxy::DEFAULT_LAYER);
+
+            if (channel < 1 || channel > static_cast<int>(channels_.size())) {
+                CASPAR_LOG(warning) << L"[data] No channel " << channel;
+                return;
+            }
+
+            auto& cached   = producers_[std::make_pair(channel, layer)];
+            auto  producer = cached.lock();
+            if (!producer) {
+                producer = channels_.at(channel - 1)->stage().foreground(layer).get();
+                if (!producer || producer == core::frame_producer::empty()) {
+                    return;
+                }
+                cached = producer;
+            }
+
+            producer->call({L"[DATA]", u16(line.substr(space + 1))});
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+};
+
+data_protocol_strategy_factory::data_protocol_strategy_factory(
+    std::vector<spl::shared_ptr<core::video_channel>> channels)
+    : channels_(std::move(channels))
+{
+}
+
+IO::protocol_strategy<char>::ptr
+data_protocol_strategy_factory::create(const IO::client_connection<char>::ptr& client_connection)
+{
+    return spl::make_shared<data_protocol_strategy>(channels_);
+}
+
+}}} // namespace caspar::protocol::data
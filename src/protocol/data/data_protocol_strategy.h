@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../util/protocol_strategy.h"
+
+#include <core/video_channel.h>
+
+#include <vector>
+
+namespace caspar { namespace protocol { namespace data {
+
+// Streams data into templates without going through AMCP. Each line is "channel[-layer] payload", the payload, a
+// JSON merge patch for html templates, is handed to the producer of the layer as it is and replies aren't sent.
+class data_protocol_strategy_factory : public IO::protocol_strategy_factory<char>
+{
+    std::vector<spl::shared_ptr<core::video_channel>> channels_;
+
+  public:
+    explicit data_protocol_strategy_factory(std::vector<spl::shared_ptr<core::video_channel>> channels);
+
+    IO::protocol_strategy<char>::ptr create(const IO::client_connection<char>::ptr& client_connection) override;
+};
+
+}}} // namespace caspar::protocol::data
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "exporter.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/diagnostics/call_context.h>
+
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace metrics {
+
+namespace {
+
+// Upper bounds of the histogram buckets. Graph values are drawn from 0 to 1, and time series are scaled so that one
+// frame is 0.5, which makes the buckets above 0.5 the overruns of the frame budget.
+const std::array<double, 7> BUCKETS = {{0.1, 0.25, 0.4, 0.5, 0.6, 0.75, 1.0}};
+
+const std::array<const char*, 3> SEVERITIES = {{"warning", "info", "silent"}};
+
+std::string escape(std::string str)
+{
+    boost::replace_all(str, "\\", "\\\\");
+    boost::replace_all(str, "\"", "\\\"");
+    boost::replace_all(str, "\n", "\\n");
+    return str;
+}
+
+class sink : public diagnostics::spi::graph_sink
+{
+    struct entry
+    {
+        std::shared_ptr<const diagnostics::spi::series> series;
+        std::uint64_t                                   position = 0;
+        std::array<std::uint64_t, BUCKETS.size() + 1>   buckets{};
+        double                                          sum   = 0.0;
+        std::uint64_t                                   count = 0;
+        std::array<std::uint64_t, SEVERITIES.size()>    tags{};
+    };
+
+    const core::diagnostics::call_context context_ = core::diagnostics::call_context::for_thread();
+
+    std::mutex                                    mutex_;
+    std::string                                   text_;
+    std::vector<entry>                            entries_;
+    std::vector<diagnostics::spi::series::sample> samples_;
+
+  public:
+    void activate() override {}
+
+    void set_text(const std::wstring& value) override
+    {
+        auto                        text = escape(u8(value));
+        std::lock_guard<std::mutex> lock(mutex_);
+        text_ = std::move(text);
+    }
+
+    void add_series(const std::shared_ptr<const diagnostics::spi::series>& series) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.push_back(entry{});
+        entries_.back().series = series;
+    }
+
+    void auto_reset() override {}
+
+    void collect()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& entry : entries_) {
+            samples_.clear();
+            entry.series->read(entry.position, samples_);
+
+            for (auto& sample : samples_) {
+                if (sample.tag) {
+                    entry.tags.at(static_cast<std::size_t>(sample.severity)) += 1;
+                    continue;
+                }
+
+                auto bucket = std::lower_bound(BUCKETS.begin(), BUCKETS.end(), sample.value) - BUCKETS.begin();
+                entry.buckets[bucket] += 1;
+                entry.sum += sample.value;
+                entry.count += 1;
+            }
+        }
+    }
+
+    void write_values(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& entry : entries_) {
+            if (entry.count == 0) {
+                continue;
+            }
+
+            const auto labels = this->labels(entry);
+
+            std::uint64_t cumulative = 0;
+            for (auto n = 0U; n < BUCKETS.size(); ++n) {
+                cumulative += entry.buckets[n];
+                out << "casparcg_graph_value_bucket{" << labels << ",le=\"" << BUCKETS[n] << "\"} " << cumulative
+                    << "\n";
+            }
+            out << "casparcg_graph_value_bucket{" << labels << ",le=\"+Inf\"} " << entry.count << "\n";
+            out << "casparcg_graph_value_sum{" << labels << "} " << entry.sum << "\n";
+            out << "casparcg_graph_value_count{" << labels << "} " << entry.count << "\n";
+        }
+    }
+
+    void write_tags(std::ostream& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& entry : entries_) {
+            for (auto n = 0U; n < SEVERITIES.size(); ++n) {
+                if (entry.tags[n] > 0) {
+                    out << "casparcg_graph_tags_total{" << labels(entry) << ",severity=\"" << SEVERITIES[n] << "\"} "
+                        << entry.tags[n] << "\n";
+                }
+            }
+        }
+    }
+
+  private:
+    std::string labels(const entry& entry) const
+    {
+        std::ostringstream str;
+        str << "channel=\"" << context_.video_channel << "\",layer=\"" << context_.layer << "\",graph=\"" << text_
+            << "\",series=\"" << escape(entry.series->name()) << "\"";
+        return str.str();
+    }
+};
+
+std::mutex                       sinks_mutex;
+std::vector<std::weak_ptr<sink>> sinks;
+
+std::vector<std::shared_ptr<sink>> get_sinks()
+{
+    std::lock_guard<std::mutex> lock(sinks_mutex);
+
+    std::vector<std::shared_ptr<sink>> result;
+    auto                               it = sinks.begin();
+    while (it != sinks.end()) {
+        if (auto sink = it->lock()) {
+            result.push_back(std::move(sink));
+            ++it;
+        } else {
+            it = sinks.erase(it);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+void register_sink()
+{
+    diagnostics::spi::register_sink_factory([] {
+        auto result = spl::make_shared<sink>();
+
+        std::lock_guard<std::mutex> lock(sinks_mutex);
+        sinks.push_back(std::shared_ptr<sink>(result));
+
+        return spl::shared_ptr<diagnostics::spi::graph_sink>(result);
+    });
+}
+
+struct exporter::impl : public std::enable_shared_from_this<impl>
+{
+    using tcp = boost::asio::ip::tcp;
+
+    const std::shared_ptr<boost::asio::io_service> service_;
+    tcp::acceptor                                  acceptor_;
+    boost::asio::steady_timer                      timer_;
+    const gauges_t                                 gauges_;
+
+    impl(std::shared_ptr<boost::asio::io_service> service, unsigned short port, gauges_t gauges)
+        : service_(std::move(service))
+        , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
+        , timer_(*service_)
+        , gauges_(std::move(gauges))
+    {
+    }
+
+    void start()
+    {
+        do_accept();
+        do_collect();
+
+        CASPAR_LOG(info) << L"[metrics] Serving /metrics on port " << acceptor_.local_endpoint().port();
+    }
+
+    void stop()
+    {
+        auto self = shared_from_this();
+        service_->post([self] {
+            boost::system::error_code ignored;
+            self->acceptor_.close(ignored);
+            self->timer_.cancel(ignored);
+        });
+    }
+
+    // Takes the samples often enough that the rings of the series don't wrap between two scrapes.
+    void do_collect()
+    {
+        auto self = shared_from_this();
+
+        timer_.expires_after(std::chrono::milliseconds(100));
+        timer_.async_wait([self](const boost::system::error_code& error) {
+            if (error) {
+                return;
+            }
+            for (auto& sink : get_sinks()) {
+                sink->collect();
+            }
+            self->do_collect();
+        });
+    }
+
+    void do_accept()
+    {
+        auto self   = shared_from_this();
+        auto socket = std::make_shared<tcp::socket>(*service_);
+
+        acceptor_.async_accept(*socket, [self, socket](const boost::system::error_code& error) {
+            if (error == boost::asio::error::operation_aborted) {
+                return;
+            }
+            if (!error) {
+                self->serve(socket);
+            }
+            self->do_accept();
+        });
+    }
+
+    void serve(const std::shared_ptr<tcp::socket>& socket)
+    {
+        auto self    = shared_from_this();
+        auto request = std::make_shared<boost::asio::streambuf>(8192);
+
+        boost::asio::async_read_until(
+            *socket, *request, "\r\n\r\n", [self, socket, request](const boost::system::error_code& error, size_t) {
+                if (error) {
+                    return;
+                }
+
+                std::istream in(request.get());
+                std::string  method;
+                std::string  path;
+                in >> method >> path;
+
+                auto response = std::make_shared<std::string>(self->respond(method, path));
+                boost::asio::async_write(
+                    *socket,
+                    boost::asio::buffer(*response),
+                    [socket, response](const boost::system::error_code&, size_t) {
+                        boost::system::error_code ignored;
+                        socket->shutdown(tcp::socket::shutdown_both, ignored);
+                    });
+            });
+    }
+
+    std::string respond(const std::string& method, const std::string& path)
+    {
+        std::string status = "200 OK";
+        std::string body;
+
+        if (method != "GET") {
+            status = "405 Method Not Allowed";
+        } else if (path != "/metrics") {
+            status = "404 Not Found";
+        } else {
+            body = scrape();
+        }
+
+        std::ostringstream str;
+        str << "HTTP/1.1 " << status << "\r\n"
+            << "Content-Type: text/plain; version=0.0.4\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Connection: close\r\n\r\n"
+            << body;
+        return str.str();
+    }
+
+    std::string scrape()
+    {
+        auto current = get_sinks();
+        for (auto& sink : current) {
+            sink->collect();
+        }
+
+        std::ostringstream out;
+
+        out << "# HELP casparcg_graph_value Values of the diagnostics graphs, time series are 0.5 for one frame.\n";
+        out << "# TYPE casparcg_graph_value histogram\n";
+        for (auto& sink : current) {
+            sink->write_values(out);
+        }
+
+        out << "# HELP casparcg_graph_tags_total Tags of the diagnostics graphs, e.g. underflows and dropped frames.\n";
+        out << "# TYPE casparcg_graph_tags_total counter\n";
+        for (auto& sink : current) {
+            sink->write_tags(out);
+        }
+
+        if (gauges_) {
+            try {
+                for (auto& gauge : gauges_()) {
+                    out << "# TYPE " << gauge.first << " gauge\n" << gauge.first << " " << gauge.second << "\n";
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+
+        return out.str();
+    }
+};
+
+exporter::exporter(std::shared_ptr<boost::asio::io_service> service, unsigned short port, gauges_t gauges)
+    : impl_(std::make_shared<impl>(std::move(service), port, std::move(gauges)))
+{
+    impl_->start();
+}
+
+exporter::~exporter() { impl_->stop(); }
+
+}}} // namespace caspar::protocol::metrics
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/asio/io_service.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace metrics {
+
+// Registers a diagnostics graph sink that collects every series into a histogram and every tag into a counter. It
+// has to be registered before the graphs are created to see them.
+void register_sink();
+
+// Serves the metrics of the sink in the Prometheus text format on GET /metrics. Samples are taken from the series of
+// the graphs every 100 ms, and gauges() adds values outside of them, e.g. the ogl pools, to each scrape.
+class exporter
+{
+  public:
+    using gauges_t = std::function<std::vector<std::pair<std::string, double>>()>;
+
+    exporter(std::shared_ptr<boost::asio::io_service> service, unsigned short port, gauges_t gauges);
+    ~exporter();
+
+    exporter(const exporter&) = delete;
+    exporter& operator=(const exporter&) = delete;
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::metrics
@@ -26,17 +26,26 @@
 
 #include "oscpack/OscOutboundPacketStream.h"
 
+#include <common/diagnostics/graph.h>
 #include <common/endian.h>
+#include <common/env.h>
+#include <common/log.h>
 #include <common/utf.h>
 
 #include <core/monitor/monitor.h>
 
 #include <boost/asio.hpp>
 #include <boost/optional.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <map>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 using namespace boost::asio::ip;
@@ -64,19 +73,123 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o << u8(value).c_str(); }
 };
 
+// Size of the arguments written by param_visitor, bools are only a type tag.
+struct size_visitor : public boost::static_visitor<std::size_t>
+{
+    static std::size_t padded(std::size_t size) { return (size + 3) & ~static_cast<std::size_t>(3); }
+
+    std::size_t operator()(const bool) const { return 0; }
+    std::size_t operator()(const int32_t) const { return 4; }
+    std::size_t operator()(const int64_t) const { return 8; }
+    std::size_t operator()(const float) const { return 4; }
+    std::size_t operator()(const double) const { return 4; }
+    std::size_t operator()(const std::string& value) const { return padded(value.size() + 1); }
+    std::size_t operator()(const std::wstring& value) const { return padded(u8(value).size() + 1); }
+};
+
+std::size_t message_size(const std::string& address, const core::monitor::vector_t& values)
+{
+    // The address and the type tags, starting with ',', are null terminated and padded to 4 bytes.
+    auto size = size_visitor::padded(address.size() + 1) + size_visitor::padded(values.size() + 2);
+    for (const auto& value : values) {
+        size += boost::apply_visitor(size_visitor(), value);
+    }
+    return size;
+}
+
+// OSC time tags are NTP timestamps, with the seconds since 1900 in the upper 32 bits.
+uint64_t ntp_time(std::chrono::system_clock::time_point time)
+{
+    const uint64_t ntp_epoch = 2208988800ULL;
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    return (us / 1000000 + ntp_epoch) << 32 | (static_cast<uint64_t>(us % 1000000) << 32) / 1000000;
+}
+
+void write_bundles(const std::map<std::string, core::monitor::vector_t>& messages,
+                   uint64_t                                              time,
+                   std::size_t                                           max_packet_size,
+                   std::vector<char>&                                    buffer,
+                   const std::function<void(std::vector<char>)>&         packet)
+{
+    // "#bundle" and the time tag.
+    const std::size_t bundle_header_size = 16;
+
+    auto it = messages.begin();
+    while (it != messages.end()) {
+        ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer.data()), static_cast<unsigned long>(buffer.size()));
+
+        o << ::osc::BeginBundle(time);
+
+        auto size = bundle_header_size;
+        while (it != messages.end()) {
+            // Every element of a bundle is preceded by its size.
+            auto element_size = 4 + message_size(it->first, it->second);
+            if (size > bundle_header_size && size + element_size > max_packet_size) {
+                break;
+            }
+            size += element_size;
+
+            o << ::osc::BeginMessage(it->first.c_str());
+
+            param_visitor<decltype(o)> param_visitor(o);
+            for (const auto& element : it->second) {
+                boost::apply_visitor(param_visitor, element);
+            }
+
+            o << ::osc::EndMessage;
+
+            ++it;
+        }
+
+        o << ::osc::EndBundle;
+
+        packet(std::vector<char>(o.Data(), o.Data() + o.Size()));
+    }
+}
+
 struct client::impl : public spl::enable_shared_from_this<client::impl>
 {
+    using clock = std::chrono::steady_clock;
+
+    // What has been sent to an endpoint, and what has changed since then but is held back by the rate limit.
+    struct subscriber
+    {
+        std::unordered_map<std::string, core::monitor::vector_t> sent;
+        std::map<std::string, core::monitor::vector_t>           pending;
+        uint64_t                                                 time = 0;
+        clock::time_point                                        next_send;
+        clock::time_point                                        next_keyframe;
+    };
+
+    // Packets waiting for an endpoint, which only has one send in flight so that a slow one doesn't hold up the
+    // others.
+    struct send_queue
+    {
+        std::deque<std::vector<char>> packets;
+        bool                          sending = false;
+    };
+
     std::shared_ptr<boost::asio::io_context> service_;
     udp::socket                              socket_;
+    boost::asio::io_context::strand          strand_;
+    std::map<udp::endpoint, send_queue>      send_queues_;
     std::map<udp::endpoint, int>             reference_counts_by_endpoint_;
     std::vector<char>                        buffer_;
+    spl::shared_ptr<diagnostics::graph>      graph_;
+
+    static const std::size_t max_queued_packets = 1024;
 
-    std::mutex              mutex_;
-    std::condition_variable cond_;
-    core::monitor::state    bundle_;
-    uint64_t                bundle_time_ = 0;
+    const bool                          change_only_;
+    const clock::duration               keyframe_interval_;
+    const clock::duration               send_interval_;
+    const std::size_t                   max_packet_size_;
+    std::map<udp::endpoint, subscriber> subscribers_;
 
-    uint64_t time_ = 0;
+    static const std::size_t                              max_queued_states = 64;
+    std::mutex                                            mutex_;
+    std::condition_variable                               cond_;
+    std::deque<std::pair<core::monitor::state, uint64_t>> states_;
 
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
@@ -85,64 +198,70 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
     impl(std::shared_ptr<boost::asio::io_service> service)
         : service_(std::move(service))
         , socket_(*service_, udp::v4())
+        , strand_(*service_)
         , buffer_(1000000)
+        , change_only_(env::properties().get(L"configuration.osc.change-only", false))
+        , keyframe_interval_(
+              std::chrono::milliseconds(env::properties().get(L"configuration.osc.keyframe-interval", 1000)))
+        , send_interval_(send_interval(env::properties().get(L"configuration.osc.max-rate", 0.0)))
+        , max_packet_size_(env::properties().get(L"configuration.osc.max-packet-size", std::size_t(1472)))
     {
+        graph_->set_text(L"osc-client");
+        graph_->set_color("dropped-state", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("dropped-packet", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+
         thread_ = std::thread([=] {
             try {
                 while (!abort_request_) {
-                    core::monitor::state       bundle;
-                    uint64_t                   bundle_time;
-                    std::vector<udp::endpoint> endpoints;
+                    std::deque<std::pair<core::monitor::state, uint64_t>> states;
+                    std::vector<udp::endpoint>                            endpoints;
 
                     {
                         std::unique_lock<std::mutex> lock(mutex_);
-                        cond_.wait(lock, [&] { return bundle_time_ > 0 || abort_request_; });
+                        cond_.wait(lock, [&] { return !states_.empty() || abort_request_; });
 
                         if (abort_request_) {
                             return;
                         }
 
-                        bundle       = std::move(bundle_);
-                        bundle_time  = bundle_time_;
-                        bundle_time_ = 0;
+                        std::swap(states, states_);
 
                         for (auto& p : reference_counts_by_endpoint_) {
                             endpoints.push_back(p.first);
                         }
                     }
 
-                    if (endpoints.empty()) {
-                        continue;
+                    for (auto it = subscribers_.begin(); it != subscribers_.end();) {
+                        if (std::find(endpoints.begin(), endpoints.end(), it->first) == endpoints.end()) {
+                            it = subscribers_.erase(it);
+                        } else {
+                            ++it;
+                        }
                     }
 
-                    auto it = std::begin(bundle);
+                    const auto now = clock::now();
 
-                    while (it != std::end(bundle)) {
-                        ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
-                                                      static_cast<unsigned long>(buffer_.size()));
-
-                        o << ::osc::BeginBundle(bundle_time);
-
-                        // TODO (fix): < 2048 is a hack. Properly calculate if messages will fit.
-                        while (it != std::end(bundle) && o.Size() < 2048) {
-                            o << ::osc::BeginMessage(it->first.c_str());
-
-                            param_visitor<decltype(o)> param_visitor(o);
-                            for (const auto& element : it->second) {
-                                boost::apply_visitor(param_visitor, element);
-                            }
+                    for (const auto& endpoint : endpoints) {
+                        auto& sub = subscribers_[endpoint];
 
-                            o << ::osc::EndMessage;
+                        for (const auto& state : states) {
+                            update(sub, state.first, state.second, now);
+                        }
 
-                            ++it;
+                        if (sub.pending.empty() || now < sub.next_send) {
+                            continue;
                         }
 
-                        o << ::osc::EndBundle;
+                        send(endpoint, sub.pending, sub.time);
 
-                        boost::system::error_code ec;
-                        for (const auto& endpoint : endpoints) {
-                            socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
+                        if (change_only_) {
+                            for (auto& p : sub.pending) {
+                                sub.sent[p.first] = std::move(p.second);
+                            }
                         }
+                        sub.pending.clear();
+                        sub.next_send = now + send_interval_;
                     }
                 }
             } catch (...) {
@@ -158,6 +277,93 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_.join();
     }
 
+    static clock::duration send_interval(double max_rate)
+    {
+        if (max_rate <= 0.0) {
+            return clock::duration::zero();
+        }
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / max_rate));
+    }
+
+    // Queues the addresses of state that the endpoint doesn't have yet. In change only mode everything is sent
+    // again once per keyframe interval, so that new and lossy subscribers catch up.
+    void update(subscriber& sub, const core::monitor::state& state, uint64_t time, clock::time_point now)
+    {
+        if (change_only_ && now >= sub.next_keyframe) {
+            sub.sent.clear();
+            sub.next_keyframe = now + keyframe_interval_;
+        }
+
+        for (const auto& p : state) {
+            if (change_only_) {
+                auto it = sub.sent.find(p.first);
+                if (it != sub.sent.end() && it->second == p.second) {
+                    // Changed back before it was sent.
+                    sub.pending.erase(p.first);
+                    continue;
+                }
+            }
+            sub.pending[p.first] = p.second;
+        }
+        sub.time = time;
+    }
+
+    void send(const udp::endpoint&                                  endpoint,
+              const std::map<std::string, core::monitor::vector_t>& messages,
+              uint64_t                                              time)
+    {
+        write_bundles(messages, time, max_packet_size_, buffer_, [&](std::vector<char> packet) {
+            queue_packet(endpoint, std::move(packet));
+        });
+    }
+
+    void queue_packet(const udp::endpoint& endpoint, std::vector<char> packet)
+    {
+        // A strong reference would let the send thread destroy the client it runs on.
+        std::weak_ptr<impl> weak_self = shared_from_this();
+
+        boost::asio::post(strand_, [weak_self, endpoint, packet = std::move(packet)]() mutable {
+            auto self = weak_self.lock();
+            if (!self) {
+                return;
+            }
+
+            auto& queue = self->send_queues_[endpoint];
+            if (queue.packets.size() >= max_queued_packets) {
+                queue.packets.pop_front();
+                self->graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-packet");
+            }
+            queue.packets.push_back(std::move(packet));
+
+            if (!queue.sending) {
+                self->send_next(endpoint);
+            }
+        });
+    }
+
+    // Runs on strand_.
+    void send_next(const udp::endpoint& endpoint)
+    {
+        auto it = send_queues_.find(endpoint);
+        if (it == send_queues_.end()) {
+            return;
+        }
+        if (it->second.packets.empty()) {
+            send_queues_.erase(it);
+            return;
+        }
+
+        auto packet = std::make_shared<std::vector<char>>(std::move(it->second.packets.front()));
+        it->second.packets.pop_front();
+        it->second.sending = true;
+
+        auto self = shared_from_this();
+        auto done = [self, endpoint, packet](const boost::system::error_code&, std::size_t) {
+            self->send_next(endpoint);
+        };
+        socket_.async_send_to(boost::asio::buffer(*packet), endpoint, boost::asio::bind_executor(strand_, done));
+    }
+
     // TODO (refactor) This is wierd...
     std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
     {
@@ -185,14 +391,18 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         });
     }
 
+    // Bundles are stamped with the time the state was sent by the channel.
     void send(const core::monitor::state& state)
     {
         {
             std::lock_guard<std::mutex> lock(mutex_);
 
-            // TODO: time_++ is a hack. Use proper channel time.
-            bundle_time_ = time_++;
-            bundle_      = state;
+            // States are queued rather than replaced, since every channel sends its own.
+            if (states_.size() >= max_queued_states) {
+                states_.pop_front();
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-state");
+            }
+            states_.emplace_back(state, ntp_time(std::chrono::system_clock::now()));
         }
         cond_.notify_all();
     }
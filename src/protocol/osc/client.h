@@ -27,8 +27,23 @@
 #include <common/memory.h>
 #include <core/monitor/monitor.h>
 
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace osc {
 
+// Encodes messages as bundles with the OSC time tag time and hands each of them to packet. Bundles are split to fit in
+// max_packet_size, a message that doesn't fit on its own gets a bundle by itself. buffer is the scratch space that
+// bundles are written into.
+void write_bundles(const std::map<std::string, core::monitor::vector_t>& messages,
+                   uint64_t                                              time,
+                   std::size_t                                           max_packet_size,
+                   std::vector<char>&                                    buffer,
+                   const std::function<void(std::vector<char>)>&         packet);
+
 class client
 {
     client(const client&);
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "listener.h"
+
+#include "oscpack/OscReceivedElements.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/frame_transform.h>
+#include <core/producer/stage.h>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/asio.hpp>
+
+#include <array>
+#include <string>
+
+namespace caspar { namespace protocol { namespace osc {
+
+namespace {
+
+bool is_number(const ::osc::ReceivedMessageArgument& arg)
+{
+    return arg.IsInt32() || arg.IsFloat() || arg.IsDouble();
+}
+
+double as_number(const ::osc::ReceivedMessageArgument& arg)
+{
+    if (arg.IsInt32())
+        return arg.AsInt32();
+    if (arg.IsFloat())
+        return arg.AsFloat();
+    return arg.AsDouble();
+}
+
+} // namespace
+
+struct listener::impl : public std::enable_shared_from_this<impl>
+{
+    using udp = boost::asio::ip::udp;
+
+    const std::shared_ptr<boost::asio::io_service>          service_;
+    const std::vector<spl::shared_ptr<core::video_channel>> channels_;
+    udp::socket                                             socket_;
+    udp::endpoint                                           sender_;
+    std::array<char, 65536>                                 buffer_;
+
+    impl(std::shared_ptr<boost::asio::io_service>          service,
+         unsigned short                                    port,
+         std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : service_(std::move(service))
+        , channels_(std::move(channels))
+        , socket_(*service_, udp::endpoint(udp::v4(), port))
+    {
+    }
+
+    void start()
+    {
+        do_receive();
+
+        CASPAR_LOG(info) << L"[osc] Listening for commands on udp port " << socket_.local_endpoint().port();
+    }
+
+    void stop()
+    {
+        auto self = shared_from_this();
+        service_->post([self] {
+            boost::system::error_code ignored;
+            self->socket_.close(ignored);
+        });
+    }
+
+    void do_receive()
+    {
+        auto self = shared_from_this();
+
+        socket_.async_receive_from(
+            boost::asio::buffer(buffer_), sender_, [self](const boost::system::error_code& error, std::size_t size) {
+                if (error == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!error) {
+                    try {
+                        self->dispatch(::osc::ReceivedPacket(self->buffer_.data(), static_cast<::osc::int32>(size)));
+                    } catch (...) {
+                        CASPAR_LOG(debug) << L"[osc] Invalid packet from " << u16(self->sender_.address().to_string());
+                    }
+                }
+                self->do_receive();
+            });
+    }
+
+    void dispatch(const ::osc::ReceivedPacket& packet)
+    {
+        if (packet.IsBundle()) {
+            dispatch(::osc::ReceivedBundle(packet));
+        } else {
+            dispatch(::osc::ReceivedMessage(packet));
+        }
+    }
+
+    // Bundles are applied as they arrive, their time tags are ignored.
+    void dispatch(const ::osc::ReceivedBundle& bundle)
+    {
+        for (auto it = bundle.ElementsBegin(); it != bundle.ElementsEnd(); ++it) {
+            if (it->IsBundle()) {
+                dispatch(::osc::ReceivedBundle(*it));
+            } else {
+                dispatch(::osc::ReceivedMessage(*it));
+            }
+        }
+    }
+
+    void dispatch(const ::osc::ReceivedMessage& message)
+    {
+        std::vector<std::string> path;
+        std::string              address = message.AddressPattern();
+        boost::split(path, address, [](char c) { return c == '/'; });
+
+        // "", "channel", channel, "stage" or "mixer", "layer", layer, command
+        if (path.size() != 7 || path[1] != "channel" || path[4] != "layer") {
+            return;
+        }
+
+        auto channel = std::stoi(path[2]);
+        auto layer   = std::stoi(path[5]);
+        if (channel < 1 || channel > static_cast<int>(channels_.size())) {
+            return;
+        }
+        auto& stage   = channels_[channel - 1]->stage();
+        auto& command = path[6];
+
+        auto arg = message.ArgumentsBegin();
+        auto end = message.ArgumentsEnd();
+
+        if (path[3] == "stage") {
+            if (arg != end && ((arg->IsBool() && !arg->AsBool()) || (is_number(*arg) && as_number(*arg) == 0.0))) {
+                return;
+            }
+
+            if (command == "play") {
+                stage.play(layer);
+            } else if (command == "stop") {
+                stage.stop(layer);
+            } else if (command == "pause") {
+                stage.pause(layer);
+            } else if (command == "resume") {
+                stage.resume(layer);
+            }
+        } else if (path[3] == "mixer") {
+            if (arg == end || !is_number(*arg)) {
+                return;
+            }
+            auto value = as_number(*arg++);
+
+            unsigned int duration = 0;
+            if (arg != end && is_number(*arg)) {
+                duration = static_cast<unsigned int>(std::max(0.0, as_number(*arg++)));
+            }
+            std::wstring tween = L"linear";
+            if (arg != end && arg->IsString()) {
+                tween = u16(arg->AsString());
+            }
+
+            core::stage::transform_func_t transform;
+            if (command == "opacity") {
+                transform = [=](core::frame_transform t) {
+                    t.image_transform.opacity = value;
+                    return t;
+                };
+            } else if (command == "volume") {
+                transform = [=](core::frame_transform t) {
+                    t.audio_transform.volume = value;
+                    return t;
+                };
+            } else {
+                return;
+            }
+
+            stage.apply_transform(layer, transform, duration, tweener(tween));
+        }
+    }
+};
+
+listener::listener(std::shared_ptr<boost::asio::io_service>          service,
+                   unsigned short                                    port,
+                   std::vector<spl::shared_ptr<core::video_channel>> channels)
+    : impl_(std::make_shared<impl>(std::move(service), port, std::move(channels)))
+{
+    impl_->start();
+}
+
+listener::~listener() { impl_->stop(); }
+
+}}} // namespace caspar::protocol::osc
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/video_channel.h>
+
+#include <boost/asio/io_service.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace osc {
+
+// Takes OSC messages on a udp port and applies them to the stage of a channel as they arrive, without going through
+// the AMCP parser and command queue, for the triggers of panels and GPI boxes:
+//
+//   /channel/[1..]/stage/layer/[0..]/play|stop|pause|resume
+//   /channel/[1..]/mixer/layer/[0..]/opacity|volume value [duration frames] [tween]
+//
+// Triggers with a first argument of 0 or false, e.g. the release of a button, are ignored.
+class listener
+{
+  public:
+    listener(std::shared_ptr<boost::asio::io_service>          service,
+             unsigned short                                    port,
+             std::vector<spl::shared_ptr<core::video_channel>> channels);
+    ~listener();
+
+    listener(const listener&) = delete;
+    listener& operator=(const listener&) = delete;
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::osc
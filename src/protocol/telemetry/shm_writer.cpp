@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "shm_writer.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+namespace caspar { namespace protocol { namespace telemetry {
+
+namespace {
+
+const std::uint32_t MAGIC   = 0x54474343; // "CCGT"
+const std::uint32_t VERSION = 1;
+
+struct header
+{
+    std::uint32_t              magic;
+    std::uint32_t              version;
+    std::uint32_t              slot_count;
+    std::uint32_t              slot_size;
+    std::uint32_t              wchar_size;
+    std::uint32_t              reserved;
+    std::atomic<std::uint64_t> write_count;
+};
+
+struct slot
+{
+    std::atomic<std::uint64_t> sequence;
+    std::uint32_t              size;
+    std::uint32_t              reserved;
+};
+
+const std::size_t HEADER_SIZE = 64;
+
+static_assert(sizeof(header) <= HEADER_SIZE, "header doesn't fit");
+
+// Writes into a slot, and stops writing once the slot is full.
+class record_writer
+{
+    std::uint8_t* data_;
+    std::size_t   capacity_;
+    std::size_t   size_ = 0;
+
+  public:
+    record_writer(std::uint8_t* data, std::size_t capacity)
+        : data_(data)
+        , capacity_(capacity)
+    {
+    }
+
+    bool write(const void* data, std::size_t size)
+    {
+        if (size_ + size > capacity_) {
+            return false;
+        }
+        std::memcpy(data_ + size_, data, size);
+        size_ += size;
+        return true;
+    }
+
+    template <typename T>
+    bool write(const T& value)
+    {
+        return write(&value, sizeof(value));
+    }
+
+    std::uint8_t* at(std::size_t offset) const { return data_ + offset; }
+    std::size_t   size() const { return size_; }
+    void          rewind(std::size_t size) { size_ = size; }
+};
+
+struct value_writer : public boost::static_visitor<bool>
+{
+    record_writer& writer;
+
+    explicit value_writer(record_writer& writer)
+        : writer(writer)
+    {
+    }
+
+    template <typename T>
+    bool operator()(const T& value) const
+    {
+        return writer.write(value);
+    }
+
+    bool operator()(const bool value) const { return writer.write(static_cast<std::uint8_t>(value ? 1 : 0)); }
+
+    bool operator()(const std::string& value) const
+    {
+        return writer.write(static_cast<std::uint32_t>(value.size())) && writer.write(value.data(), value.size());
+    }
+
+    bool operator()(const std::wstring& value) const
+    {
+        return writer.write(static_cast<std::uint32_t>(value.size())) &&
+               writer.write(value.data(), value.size() * sizeof(wchar_t));
+    }
+};
+
+} // namespace
+
+struct shm_writer::impl
+{
+    const std::string                         name_;
+    boost::interprocess::shared_memory_object shm_;
+    boost::interprocess::mapped_region        region_;
+    header*                                   header_ = nullptr;
+    const std::uint32_t                       slot_count_;
+    const std::uint32_t                       slot_size_;
+
+    impl(const std::string& name, int slot_count, int slot_size)
+        : name_(name)
+        , slot_count_(static_cast<std::uint32_t>(slot_count))
+        , slot_size_(static_cast<std::uint32_t>(slot_size))
+    {
+        if (slot_count < 1 || slot_size < static_cast<int>(sizeof(slot)) + 64) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Invalid telemetry ring size."));
+        }
+
+        // A ring left behind by a server that didn't shut down cleanly is replaced.
+        boost::interprocess::shared_memory_object::remove(name_.c_str());
+
+        shm_ = boost::interprocess::shared_memory_object(
+            boost::interprocess::create_only, name_.c_str(), boost::interprocess::read_write);
+        shm_.truncate(static_cast<boost::interprocess::offset_t>(HEADER_SIZE + slot_count_ * slot_size_));
+        region_ = boost::interprocess::mapped_region(shm_, boost::interprocess::read_write);
+
+        std::memset(region_.get_address(), 0, region_.get_size());
+
+        for (std::uint32_t n = 0; n < slot_count_; ++n) {
+            new (get_slot(n)) slot();
+        }
+
+        header_             = new (region_.get_address()) header();
+        header_->slot_count = slot_count_;
+        header_->slot_size  = slot_size_;
+        header_->wchar_size = sizeof(wchar_t);
+        header_->version    = VERSION;
+        header_->write_count.store(0, std::memory_order_relaxed);
+        // Readers check the magic last.
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = MAGIC;
+
+        CASPAR_LOG(info) << L"[telemetry] Writing to shared memory " << name_.c_str() << L".";
+    }
+
+    ~impl() { boost::interprocess::shared_memory_object::remove(name_.c_str()); }
+
+    slot* get_slot(std::uint64_t index) const
+    {
+        auto address = static_cast<std::uint8_t*>(region_.get_address());
+        return reinterpret_cast<slot*>(address + HEADER_SIZE + index % slot_count_ * slot_size_);
+    }
+
+    void write(int channel, const core::monitor::state& state)
+    {
+        // Channels tick concurrently, each claims a slot of its own.
+        auto index = header_->write_count.fetch_add(1, std::memory_order_acq_rel);
+        auto s     = get_slot(index);
+
+        s->sequence.store(index * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        record_writer writer(reinterpret_cast<std::uint8_t*>(s + 1), slot_size_ - sizeof(slot));
+
+        auto time =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+        writer.write(static_cast<std::int64_t>(time.count()));
+        writer.write(static_cast<std::int32_t>(channel));
+
+        const auto    count_offset = writer.size();
+        std::uint32_t count        = 0;
+        writer.write(count);
+
+        for (const auto& entry : state) {
+            const auto offset = writer.size();
+
+            auto ok = entry.first.size() <= UINT16_MAX && entry.second.size() <= UINT8_MAX &&
+                      writer.write(static_cast<std::uint16_t>(entry.first.size())) &&
+                      writer.write(entry.first.data(), entry.first.size()) &&
+                      writer.write(static_cast<std::uint8_t>(entry.second.size()));
+            for (auto it = entry.second.begin(); ok && it != entry.second.end(); ++it) {
+                ok = writer.write(static_cast<std::uint8_t>(it->which())) &&
+                     boost::apply_visitor(value_writer(writer), *it);
+            }
+
+            if (ok) {
+                ++count;
+            } else {
+                writer.rewind(offset);
+            }
+        }
+        std::memcpy(writer.at(count_offset), &count, sizeof(count));
+
+        s->size = static_cast<std::uint32_t>(writer.size());
+        s->sequence.store(index * 2 + 2, std::memory_order_release);
+    }
+};
+
+shm_writer::shm_writer(const std::string& name, int slot_count, int slot_size)
+    : impl_(new impl(name, slot_count, slot_size))
+{
+}
+shm_writer::~shm_writer() {}
+void shm_writer::write(int channel, const core::monitor::state& state) { impl_->write(channel, state); }
+
+}}} // namespace caspar::protocol::telemetry
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace telemetry {
+
+// Publishes the state of every channel tick as binary records in a ring in shared memory, so that local tools can
+// read it at frame rate without the cost of formatting OSC. All values are in native byte order.
+//
+// header (64 bytes): uint32 magic "CCGT", uint32 version, uint32 slot count, uint32 slot size, uint32 size of
+// wchar_t, uint32 reserved, atomic uint64 number of records written.
+// slot: atomic uint64 sequence, uint32 record size, uint32 reserved, record. The slot is being written while the
+// sequence is odd, and holds record n once it is 2 * n + 2.
+// record: int64 ns since the epoch, int32 channel, uint32 entry count, entries.
+// entry: uint16 path length, path, uint8 value count, values.
+// value: uint8 index of the type in monitor::data_t, then a uint8 bool, int32, int64, float or double, or a uint32
+// length followed by utf-8 bytes or wchar_t units. Entries that don't fit in a slot are left out.
+class shm_writer
+{
+  public:
+    shm_writer(const std::string& name, int slot_count, int slot_size);
+    ~shm_writer();
+
+    shm_writer(const shm_writer&) = delete;
+    shm_writer& operator=(const shm_writer&) = delete;
+
+    void write(int channel, const core::monitor::state& state);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::telemetry
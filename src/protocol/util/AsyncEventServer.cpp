@@ -25,10 +25,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 
@@ -44,6 +47,23 @@ class connection;
 
 using connection_set = std::set<spl::shared_ptr<connection>>;
 
+namespace {
+
+// Every open connection of every server, for INFO SERVER.
+struct connection_registry
+{
+    std::mutex            mutex;
+    std::set<connection*> connections;
+};
+
+connection_registry& get_registry()
+{
+    static connection_registry registry;
+    return registry;
+}
+
+} // namespace
+
 class connection : public spl::enable_shared_from_this<connection>
 {
     using lifecycle_map_type = tbb::concurrent_hash_map<std::wstring, std::shared_ptr<void>>;
@@ -61,6 +81,13 @@ class connection : public spl::enable_shared_from_this<connection>
     send_queue              send_queue_;
     bool                    is_writing_;
 
+    // Queued messages are written together, up to this many bytes per write.
+    const std::size_t          max_write_batch_;
+    const std::wstring         remote_address_;
+    std::atomic<std::size_t>   queued_messages_{0};
+    std::atomic<std::size_t>   queued_bytes_{0};
+    std::atomic<std::uint64_t> sent_bytes_{0};
+
     class connection_holder : public client_connection<char>
     {
         std::weak_ptr<connection> connection_;
@@ -118,10 +145,11 @@ class connection : public spl::enable_shared_from_this<connection>
     static spl::shared_ptr<connection> create(std::shared_ptr<boost::asio::io_service>    service,
                                               spl::shared_ptr<tcp::socket>                socket,
                                               const protocol_strategy_factory<char>::ptr& protocol,
-                                              spl::shared_ptr<connection_set>             connection_set)
+                                              spl::shared_ptr<connection_set>             connection_set,
+                                              std::size_t                                 max_write_batch)
     {
-        spl::shared_ptr<connection> con(
-            new connection(std::move(service), std::move(socket), std::move(protocol), std::move(connection_set)));
+        spl::shared_ptr<connection> con(new connection(
+            std::move(service), std::move(socket), std::move(protocol), std::move(connection_set), max_write_batch));
         con->init();
         con->read_some();
         return con;
@@ -129,7 +157,27 @@ class connection : public spl::enable_shared_from_this<connection>
 
     void init() { protocol_ = protocol_factory_->create(spl::make_shared<connection_holder>(shared_from_this())); }
 
-    ~connection() { CASPAR_LOG(debug) << print() << L" connection destroyed."; }
+    ~connection()
+    {
+        {
+            auto&                       registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.connections.erase(this);
+        }
+
+        CASPAR_LOG(debug) << print() << L" connection destroyed.";
+    }
+
+    connection_info info() const
+    {
+        connection_info info;
+        info.address         = remote_address_;
+        info.port            = listen_port_;
+        info.queued_messages = queued_messages_;
+        info.queued_bytes    = queued_bytes_;
+        info.sent_bytes      = sent_bytes_;
+        return info;
+    }
 
     std::wstring print() const { return L"async_event_server[:" + listen_port_ + L"]"; }
 
@@ -142,6 +190,8 @@ class connection : public spl::enable_shared_from_this<connection>
 
     void send(std::string&& data)
     {
+        queued_messages_ += 1;
+        queued_bytes_ += data.size();
         send_queue_.push(std::move(data));
         auto self = shared_from_this();
         service_->dispatch([=] { self->do_write(); });
@@ -178,12 +228,31 @@ class connection : public spl::enable_shared_from_this<connection>
   private:
     void do_write() // always called from the asio-service-thread
     {
-        if (!is_writing_) {
-            std::string data;
-            if (send_queue_.try_pop(data)) {
-                write_some(std::move(data));
-            }
+        if (is_writing_)
+            return;
+
+        auto        batch = spl::make_shared<std::vector<std::string>>();
+        std::size_t size  = 0;
+        std::string data;
+        while (size < max_write_batch_ && send_queue_.try_pop(data)) {
+            size += data.size();
+            batch->push_back(std::move(data));
         }
+
+        if (batch->empty())
+            return;
+
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.reserve(batch->size());
+        for (auto& str : *batch)
+            buffers.push_back(boost::asio::buffer(str));
+
+        is_writing_ = true;
+        boost::asio::async_write(
+            *socket_,
+            buffers,
+            std::bind(
+                &connection::handle_write, shared_from_this(), batch, std::placeholders::_1, std::placeholders::_2));
     }
 
     void stop() // always called from the asio-service-thread
@@ -201,14 +270,23 @@ class connection : public spl::enable_shared_from_this<connection>
     connection(const std::shared_ptr<boost::asio::io_service>& service,
                const spl::shared_ptr<tcp::socket>&             socket,
                const protocol_strategy_factory<char>::ptr&     protocol_factory,
-               const spl::shared_ptr<connection_set>&          connection_set)
+               const spl::shared_ptr<connection_set>&          connection_set,
+               std::size_t                                     max_write_batch)
         : socket_(socket)
         , service_(service)
         , listen_port_(socket_->is_open() ? std::to_wstring(socket_->local_endpoint().port()) : L"no-port")
         , connection_set_(connection_set)
         , protocol_factory_(protocol_factory)
         , is_writing_(false)
+        , max_write_batch_(max_write_batch)
+        , remote_address_(ipv4_address())
     {
+        {
+            auto&                       registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.connections.insert(this);
+        }
+
         CASPAR_LOG(info) << print() << L" Accepted connection from " << ipv4_address() << L" ("
                          << connection_set_->size() + 1 << L" connections).";
     }
@@ -230,23 +308,17 @@ class connection : public spl::enable_shared_from_this<connection>
             stop();
     }
 
-    void handle_write(const spl::shared_ptr<std::string>& str,
-                      const boost::system::error_code&    error,
+    void handle_write(const spl::shared_ptr<std::vector<std::string>>& batch,
+                      const boost::system::error_code&                  error,
                       size_t bytes_transferred) // always called from the asio-service-thread
     {
+        queued_messages_ -= batch->size();
+        queued_bytes_ -= bytes_transferred;
+        sent_bytes_ += bytes_transferred;
+
         if (!error) {
-            if (bytes_transferred != str->size()) {
-                str->assign(str->substr(bytes_transferred));
-                socket_->async_write_some(boost::asio::buffer(str->data(), str->size()),
-                                          std::bind(&connection::handle_write,
-                                                    shared_from_this(),
-                                                    str,
-                                                    std::placeholders::_1,
-                                                    std::placeholders::_2));
-            } else {
-                is_writing_ = false;
-                do_write();
-            }
+            is_writing_ = false;
+            do_write();
         } else if (error != boost::asio::error::operation_aborted && socket_->is_open())
             stop();
     }
@@ -258,16 +330,6 @@ class connection : public spl::enable_shared_from_this<connection>
             std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
     }
 
-    void write_some(std::string&& data) // always called from the asio-service-thread
-    {
-        is_writing_ = true;
-        auto str    = spl::make_shared<std::string>(std::move(data));
-        socket_->async_write_some(
-            boost::asio::buffer(str->data(), str->size()),
-            std::bind(
-                &connection::handle_write, shared_from_this(), str, std::placeholders::_1, std::placeholders::_2));
-    }
-
     friend struct AsyncEventServer::implementation;
 };
 
@@ -279,13 +341,19 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     spl::shared_ptr<connection_set>          connection_set_;
     std::vector<lifecycle_factory_t>         lifecycle_factories_;
     tbb::mutex                               mutex_;
+    const bool                               no_delay_;
+    const std::size_t                        max_write_batch_;
 
     implementation(std::shared_ptr<boost::asio::io_service>    service,
                    const protocol_strategy_factory<char>::ptr& protocol,
-                   unsigned short                              port)
+                   unsigned short                              port,
+                   bool                                        no_delay,
+                   std::size_t                                 max_write_batch)
         : service_(std::move(service))
         , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
         , protocol_factory_(protocol)
+        , no_delay_(no_delay)
+        , max_write_batch_(std::max<std::size_t>(max_write_batch, 1))
     {
     }
 
@@ -329,7 +397,14 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
             if (ec)
                 CASPAR_LOG(warning) << print() << L" Failed to enable TCP keep-alive on socket";
 
-            auto conn = connection::create(service_, socket, protocol_factory_, connection_set_);
+            if (no_delay_) {
+                socket->set_option(tcp::no_delay(true), ec);
+
+                if (ec)
+                    CASPAR_LOG(warning) << print() << L" Failed to enable TCP_NODELAY on socket";
+            }
+
+            auto conn = connection::create(service_, socket, protocol_factory_, connection_set_, max_write_batch_);
             connection_set_->insert(conn);
 
             for (auto& lifecycle_factory : lifecycle_factories_) {
@@ -354,8 +429,10 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
 
 AsyncEventServer::AsyncEventServer(std::shared_ptr<boost::asio::io_service>    service,
                                    const protocol_strategy_factory<char>::ptr& protocol,
-                                   unsigned short                              port)
-    : impl_(new implementation(std::move(service), protocol, port))
+                                   unsigned short                              port,
+                                   bool                                        no_delay,
+                                   std::size_t                                 max_write_batch)
+    : impl_(new implementation(std::move(service), protocol, port, no_delay, max_write_batch))
 {
     impl_->start_accept();
 }
@@ -367,4 +444,15 @@ void AsyncEventServer::add_client_lifecycle_object_factory(const lifecycle_facto
     impl_->add_client_lifecycle_object_factory(factory);
 }
 
+std::vector<connection_info> get_connection_infos()
+{
+    auto&                       registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    std::vector<connection_info> infos;
+    for (auto conn : registry.connections)
+        infos.push_back(conn->info());
+    return infos;
+}
+
 }} // namespace caspar::IO
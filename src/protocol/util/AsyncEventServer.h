@@ -28,17 +28,36 @@
 
 #include <boost/asio.hpp>
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace caspar { namespace IO {
 
 using lifecycle_factory_t =
     std::function<std::pair<std::wstring, std::shared_ptr<void>>(const std::string& ipv4_address)>;
 
+struct connection_info
+{
+    std::wstring  address;
+    std::wstring  port;
+    std::size_t   queued_messages = 0;
+    std::size_t   queued_bytes    = 0;
+    std::uint64_t sent_bytes      = 0;
+};
+
+// Returns the connections of all servers with their write backlog.
+std::vector<connection_info> get_connection_infos();
+
 class AsyncEventServer
 {
   public:
+    // Replies queued for a client are written together, up to max_write_batch bytes per write.
     explicit AsyncEventServer(std::shared_ptr<boost::asio::io_service>    service,
                               const protocol_strategy_factory<char>::ptr& protocol,
-                              unsigned short                              port);
+                              unsigned short                              port,
+                              bool                                        no_delay        = false,
+                              std::size_t                                 max_write_batch = 65536);
     ~AsyncEventServer();
 
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& lifecycle_factory);
@@ -1,61 +1,147 @@
 #include "http_request.h"
 
+#include <common/env.h>
 #include <common/except.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
+#include <boost/property_tree/ptree.hpp>
+
 #include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 
 namespace caspar { namespace http {
 
-HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+namespace {
+
+using boost::asio::ip::tcp;
+namespace asio = boost::asio;
+
+// A keep-alive connection to one server. Each operation runs the io_service of the connection until it completes
+// or the timeout closes the socket.
+class connection
 {
-    using boost::asio::ip::tcp;
-    using namespace boost;
+    asio::io_service                  service_;
+    tcp::socket                       socket_{service_};
+    asio::streambuf                   buffer_;
+    const boost::posix_time::millisec timeout_;
 
-    HTTPResponse res;
+  public:
+    const std::string key;
 
-    asio::io_service io_service;
+    connection(const std::string& host, const std::string& port, int timeout)
+        : timeout_(timeout)
+        , key(host + ":" + port)
+    {
+    }
 
-    // Get a list of endpoints corresponding to the server name.
-    tcp::resolver           resolver(io_service);
-    tcp::resolver::query    query(host, port, boost::asio::ip::resolver_query_base::numeric_service);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+    boost::system::error_code connect(const std::string& host, const std::string& port)
+    {
+        tcp::resolver        resolver(service_);
+        tcp::resolver::query query(host, port, asio::ip::resolver_query_base::numeric_service);
 
-    // Try each endpoint until we successfully establish a connection.
-    tcp::socket               socket(io_service);
-    boost::system::error_code error;
-    asio::connect(socket, endpoint_iterator, error);
-    if (error == asio::error::connection_refused) {
-        res.status_code    = 503;
-        res.status_message = "Connection refused";
-        return res;
+        boost::system::error_code error;
+        auto                      endpoints = resolver.resolve(query, error);
+        if (error) {
+            return error;
+        }
+        return run([&](auto handler) { asio::async_connect(socket_, endpoints, handler); });
     }
-    if (error) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+
+    boost::system::error_code write(asio::streambuf& request)
+    {
+        return run([&](auto handler) { asio::async_write(socket_, request, handler); });
     }
 
-    // Form the request. We specify the "Connection: close" header so that the
-    // server will close the socket after transmitting the response. This will
-    // allow us to treat all data up until the EOF as the content.
-    asio::streambuf request;
-    std::ostream    request_stream(&request);
-    request_stream << "GET " << path << " HTTP/1.0\r\n";
-    request_stream << "Host: " << host << ":" << port << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    request_stream << "Connection: close\r\n\r\n";
+    boost::system::error_code read_until(const std::string& delim)
+    {
+        return run([&](auto handler) { asio::async_read_until(socket_, buffer_, delim, handler); });
+    }
+
+    boost::system::error_code read(std::size_t size)
+    {
+        if (buffer_.size() >= size) {
+            return {};
+        }
+        return run([&](auto handler) {
+            asio::async_read(socket_, buffer_, asio::transfer_exactly(size - buffer_.size()), handler);
+        });
+    }
+
+    boost::system::error_code read_some()
+    {
+        return run([&](auto handler) { asio::async_read(socket_, buffer_, asio::transfer_at_least(1), handler); });
+    }
+
+    asio::streambuf& buffer() { return buffer_; }
 
-    // Send the request.
-    asio::write(socket, request);
+  private:
+    template <typename Op>
+    boost::system::error_code run(Op&& op)
+    {
+        boost::system::error_code result = asio::error::would_block;
+        op([&](const boost::system::error_code& error, auto&&...) { result = error; });
 
-    // Read the response status line. The response streambuf will automatically
-    // grow to accommodate the entire line. The growth may be limited by passing
-    // a maximum size to the streambuf constructor.
-    asio::streambuf response;
-    asio::read_until(socket, response, "\r\n");
+        asio::deadline_timer timer(service_, timeout_);
+        timer.async_wait([&](const boost::system::error_code& error) {
+            if (!error) {
+                boost::system::error_code ignored;
+                socket_.close(ignored);
+            }
+        });
+
+        service_.reset();
+        while (result == asio::error::would_block && service_.run_one()) {
+        }
+        timer.cancel();
+        service_.run();
+
+        return result == asio::error::operation_aborted ? asio::error::timed_out : result;
+    }
+};
+
+std::mutex                                              g_pool_mutex;
+std::multimap<std::string, std::unique_ptr<connection>> g_pool;
+
+std::unique_ptr<connection> take_connection(const std::string& host, const std::string& port)
+{
+    std::lock_guard<std::mutex> lock(g_pool_mutex);
+
+    auto it = g_pool.find(host + ":" + port);
+    if (it == g_pool.end()) {
+        return nullptr;
+    }
+    auto conn = std::move(it->second);
+    g_pool.erase(it);
+    return conn;
+}
+
+void return_connection(std::unique_ptr<connection> conn)
+{
+    std::lock_guard<std::mutex> lock(g_pool_mutex);
+
+    // A few idle connections per server are enough for the commands of all clients.
+    if (g_pool.count(conn->key) < 4) {
+        auto key = conn->key;
+        g_pool.emplace(std::move(key), std::move(conn));
+    }
+}
+
+// Reads a response with a body of content length, in chunks or until the server closes the connection. Returns
+// whether the connection can be used for another request.
+bool read_response(connection& conn, HTTPResponse& res)
+{
+    auto& response = conn.buffer();
+
+    auto error = conn.read_until("\r\n\r\n");
+    if (error) {
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+    }
 
-    // Check that response is OK.
     std::istream response_stream(&response);
     std::string  http_version;
     response_stream >> http_version;
@@ -63,43 +149,130 @@ HTTPResponse request(const std::string& host, const std::string& port, const std
     std::getline(response_stream, res.status_message);
 
     if (!response_stream || http_version.substr(0, 5) != "HTTP/") {
-        // TODO
         CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
     }
 
+    std::string header;
+    while (std::getline(response_stream, header) && header != "\r") {
+        auto colon = header.find(':');
+        if (colon != std::string::npos) {
+            auto name         = boost::algorithm::to_lower_copy(header.substr(0, colon));
+            auto value        = boost::algorithm::trim_copy(header.substr(colon + 1));
+            res.headers[name] = value;
+        }
+    }
+
     if (res.status_code < 200 || res.status_code >= 300) {
-        // TODO
         CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
     }
 
-    // Read the response headers, which are terminated by a blank line.
-    asio::read_until(socket, response, "\r\n\r\n");
-
-    // Process the response headers.
-    std::string header;
-    while (std::getline(response_stream, header) && header != "\r") {
-        // TODO
-    }
+    auto keep_alive = http_version != "HTTP/1.0" && !boost::algorithm::iequals(res.headers["connection"], "close");
 
     std::stringstream body;
 
-    // Write whatever content we already have to output.
-    if (response.size() > 0) {
-        body << &response;
-    }
+    auto length = res.headers.find("content-length");
+    if (length != res.headers.end()) {
+        auto size = static_cast<std::size_t>(std::stoull(length->second));
+        error     = conn.read(size);
+        if (error) {
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+        }
+        std::string data(size, '\0');
+        response_stream.read(&data[0], size);
+        body << data;
+    } else if (boost::algorithm::iequals(res.headers["transfer-encoding"], "chunked")) {
+        while (true) {
+            error = conn.read_until("\r\n");
+            if (error) {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+            }
+            std::string line;
+            std::getline(response_stream, line);
+            auto size = static_cast<std::size_t>(std::stoull(line, nullptr, 16));
 
-    // Read until EOF, writing data to output as we go.
-    while (asio::read(socket, response, asio::transfer_at_least(1), error)) {
-        body << &response;
-    }
+            error = conn.read(size + 2);
+            if (error) {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+            }
+            std::string data(size + 2, '\0');
+            response_stream.read(&data[0], size + 2);
+            body << data.substr(0, size);
 
-    if (error != asio::error::eof) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+            if (size == 0) {
+                break;
+            }
+        }
+    } else {
+        keep_alive = false;
+        while (!(error = conn.read_some())) {
+        }
+        if (error != asio::error::eof) {
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+        }
+        body << &response;
     }
 
     res.body = body.str();
 
-    return res;
+    return keep_alive;
+}
+
+} // namespace
+
+HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+{
+    static const auto timeout = env::properties().get(L"configuration.amcp.media-server.timeout", 10000);
+
+    asio::streambuf request;
+    std::ostream    request_stream(&request);
+    request_stream << "GET " << path << " HTTP/1.1\r\n";
+    request_stream << "Host: " << host << ":" << port << "\r\n";
+    request_stream << "Accept: */*\r\n";
+    request_stream << "Connection: keep-alive\r\n\r\n";
+
+    // The server may have closed an idle connection, which shows as soon as the request is sent or the response is
+    // read. The request is then sent once more on a new connection.
+    for (auto retry = 0; retry < 2; ++retry) {
+        auto conn   = take_connection(host, port);
+        auto reused = static_cast<bool>(conn);
+
+        if (!conn) {
+            conn       = std::make_unique<connection>(host, port, timeout);
+            auto error = conn->connect(host, port);
+            if (error == asio::error::connection_refused) {
+                HTTPResponse res;
+                res.status_code    = 503;
+                res.status_message = "Connection refused";
+                return res;
+            }
+            if (error) {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+            }
+        }
+
+        asio::streambuf data;
+        asio::buffer_copy(data.prepare(request.size()), request.data());
+        data.commit(request.size());
+
+        auto error = conn->write(data);
+        if (!error) {
+            error = conn->read_until("\r\n");
+        }
+        if (error) {
+            if (reused) {
+                continue;
+            }
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+        }
+
+        HTTPResponse res;
+        if (read_response(*conn, res)) {
+            return_connection(std::move(conn));
+        }
+        return res;
+    }
+
+    CASPAR_THROW_EXCEPTION(io_error() << msg_info("Connection closed"));
 }
 
 std::string url_encode(const std::string& str)
@@ -13,6 +13,8 @@ struct HTTPResponse
     std::string                        body;
 };
 
+// Sends a GET request on a pooled keep-alive connection to host, which is kept for the next request if the server
+// allows it. Gives up after amcp.media-server.timeout milliseconds.
 HTTPResponse request(const std::string& host, const std::string& port, const std::string& path);
 
 std::string url_encode(const std::string& str);
@@ -23,26 +23,40 @@
 
 #include "strategy_adapters.h"
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/locale.hpp>
 
 namespace caspar { namespace IO {
 
+namespace {
+
+// utf_to_utf converts directly, while the codepage conversions look up a converter for every message.
+bool is_utf8(const std::string& codepage)
+{
+    return boost::iequals(codepage, "UTF-8") || boost::iequals(codepage, "UTF8");
+}
+
+} // namespace
+
 class to_unicode_adapter : public protocol_strategy<char>
 {
     std::string                     codepage_;
+    const bool                      utf8_;
     protocol_strategy<wchar_t>::ptr unicode_strategy_;
 
   public:
     to_unicode_adapter(const std::string& codepage, const protocol_strategy<wchar_t>::ptr& unicode_strategy)
         : codepage_(codepage)
+        , utf8_(is_utf8(codepage))
         , unicode_strategy_(unicode_strategy)
     {
     }
 
     void parse(const std::basic_string<char>& data) override
     {
-        auto utf_data = boost::locale::conv::to_utf<wchar_t>(data, codepage_);
+        auto utf_data = utf8_ ? boost::locale::conv::utf_to_utf<wchar_t>(data)
+                              : boost::locale::conv::to_utf<wchar_t>(data, codepage_);
 
         unicode_strategy_->parse(utf_data);
     }
@@ -52,28 +66,32 @@ class from_unicode_client_connection : public client_connection<wchar_t>
 {
     client_connection<char>::ptr client_;
     std::string                  codepage_;
+    const bool                   utf8_;
 
   public:
     from_unicode_client_connection(const client_connection<char>::ptr& client, const std::string& codepage)
         : client_(client)
         , codepage_(codepage)
+        , utf8_(is_utf8(codepage))
     {
     }
     ~from_unicode_client_connection() {}
 
     void send(std::basic_string<wchar_t>&& data, bool skip_log) override
     {
-        auto str = boost::locale::conv::from_utf<wchar_t>(data, codepage_);
+        auto str =
+            utf8_ ? boost::locale::conv::utf_to_utf<char>(data) : boost::locale::conv::from_utf<wchar_t>(data, codepage_);
 
         client_->send(std::move(str), skip_log);
 
         if (skip_log)
             return;
 
+        // The escaped copy is only made if the message is actually logged.
         if (data.length() < 512) {
-            boost::replace_all(data, L"\n", L"\\n");
-            boost::replace_all(data, L"\r", L"\\r");
-            CASPAR_LOG(info) << L"Sent message to " << client_->address() << L":" << data;
+            CASPAR_LOG(info) << L"Sent message to " << client_->address() << L":"
+                             << boost::replace_all_copy(
+                                    boost::replace_all_copy(data, L"\n", L"\\n"), L"\r", L"\\r");
         } else
             CASPAR_LOG(info) << L"Sent more than 512 bytes to " << client_->address();
     }
@@ -70,17 +70,21 @@ class delimiter_based_chunking_strategy : public protocol_strategy<CharT>
     {
     }
 
+    // Consumed messages are only erased once per call, so that a burst isn't copied once per message.
     void parse(const std::basic_string<CharT>& data) override
     {
         input_ += data;
 
-        auto delim_pos = input_.find(delimiter_);
+        std::size_t offset    = 0;
+        auto        delim_pos = input_.find(delimiter_);
         while (delim_pos != std::string::npos) {
-            strategy_->parse(input_.substr(0, delim_pos));
+            strategy_->parse(input_.substr(offset, delim_pos - offset));
 
-            input_    = std::move(input_.substr(delim_pos + delimiter_.size()));
-            delim_pos = input_.find_first_of(delimiter_);
+            offset    = delim_pos + delimiter_.size();
+            delim_pos = input_.find(delimiter_, offset);
         }
+
+        input_.erase(0, offset);
     }
 };
 
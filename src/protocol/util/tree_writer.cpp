@@ -0,0 +1,657 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "tree_writer.h"
+
+#include <common/utf.h>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/variant/apply_visitor.hpp>
+#include <boost/variant/static_visitor.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace caspar { namespace IO {
+
+namespace {
+
+const int XML_INDENT = 3;
+
+bool is_ascii(const std::string& str)
+{
+    return std::all_of(str.begin(), str.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+}
+
+void append(std::wstring& out, const std::string& str)
+{
+    if (is_ascii(str)) {
+        out.append(str.begin(), str.end());
+    } else {
+        out += u16(str);
+    }
+}
+
+void append(std::wstring& out, const std::wstring& str) { out += str; }
+
+template <typename T>
+void append_number(std::wstring& out, T value)
+{
+    char buffer[32];
+    const auto size =
+        std::snprintf(buffer, sizeof(buffer), "%.*g", std::numeric_limits<T>::max_digits10, static_cast<double>(value));
+    out.append(buffer, buffer + std::max(size, 0));
+}
+
+// Same entities as boost::property_tree, including its encoding of text that is only spaces.
+template <typename Str>
+void append_xml_text_impl(std::wstring& out, const Str& str)
+{
+    if (str.find_first_not_of(' ') == Str::npos) {
+        out += L"&#32;";
+        out.append(str.size() - 1, L' ');
+        return;
+    }
+
+    for (auto c : str) {
+        switch (c) {
+            case '<':
+                out += L"&lt;";
+                break;
+            case '>':
+                out += L"&gt;";
+                break;
+            case '&':
+                out += L"&amp;";
+                break;
+            case '"':
+                out += L"&quot;";
+                break;
+            case '\'':
+                out += L"&apos;";
+                break;
+            default:
+                out += static_cast<wchar_t>(c);
+                break;
+        }
+    }
+}
+
+void append_xml_text(std::wstring& out, const std::wstring& str)
+{
+    if (!str.empty()) {
+        append_xml_text_impl(out, str);
+    }
+}
+
+void append_xml_text(std::wstring& out, const std::string& str)
+{
+    if (str.empty()) {
+        return;
+    }
+    if (is_ascii(str)) {
+        append_xml_text_impl(out, str);
+    } else {
+        append_xml_text_impl(out, u16(str));
+    }
+}
+
+template <typename Str>
+void append_json_string_impl(std::wstring& out, const Str& str)
+{
+    out += L'"';
+    for (auto c : str) {
+        switch (c) {
+            case '"':
+                out += L"\\\"";
+                break;
+            case '\\':
+                out += L"\\\\";
+                break;
+            case '\n':
+                out += L"\\n";
+                break;
+            case '\r':
+                out += L"\\r";
+                break;
+            case '\t':
+                out += L"\\t";
+                break;
+            default:
+                if (static_cast<std::uint32_t>(c) < 0x20) {
+                    wchar_t buffer[8];
+                    std::swprintf(buffer, 8, L"\\u%04x", static_cast<unsigned>(c));
+                    out += buffer;
+                } else {
+                    out += static_cast<wchar_t>(c);
+                }
+                break;
+        }
+    }
+    out += L'"';
+}
+
+void append_json_string(std::wstring& out, const std::wstring& str) { append_json_string_impl(out, str); }
+
+void append_json_string(std::wstring& out, const std::string& str)
+{
+    if (is_ascii(str)) {
+        append_json_string_impl(out, str);
+    } else {
+        append_json_string_impl(out, u16(str));
+    }
+}
+
+struct is_empty_visitor : public boost::static_visitor<bool>
+{
+    bool operator()(const std::string& value) const { return value.empty(); }
+
+    bool operator()(const std::wstring& value) const { return value.empty(); }
+
+    template <typename T>
+    bool operator()(const T&) const
+    {
+        return false;
+    }
+};
+
+// Formats values as the stream translator of boost::property_tree does.
+struct xml_value_visitor : public boost::static_visitor<void>
+{
+    std::wstring& out;
+
+    explicit xml_value_visitor(std::wstring& out)
+        : out(out)
+    {
+    }
+
+    void operator()(const bool value) const { out += value ? L"true" : L"false"; }
+
+    void operator()(const std::int32_t value) const { out += std::to_wstring(value); }
+
+    void operator()(const std::int64_t value) const { out += std::to_wstring(value); }
+
+    void operator()(const float value) const { append_number(out, value); }
+
+    void operator()(const double value) const { append_number(out, value); }
+
+    void operator()(const std::string& value) const { append_xml_text(out, value); }
+
+    void operator()(const std::wstring& value) const { append_xml_text(out, value); }
+};
+
+struct json_value_visitor : public boost::static_visitor<void>
+{
+    std::wstring& out;
+
+    explicit json_value_visitor(std::wstring& out)
+        : out(out)
+    {
+    }
+
+    void operator()(const bool value) const { out += value ? L"true" : L"false"; }
+
+    void operator()(const std::int32_t value) const { out += std::to_wstring(value); }
+
+    void operator()(const std::int64_t value) const { out += std::to_wstring(value); }
+
+    void operator()(const float value) const { append_finite(value); }
+
+    void operator()(const double value) const { append_finite(value); }
+
+    void operator()(const std::string& value) const { append_json_string(out, value); }
+
+    void operator()(const std::wstring& value) const { append_json_string(out, value); }
+
+    template <typename T>
+    void append_finite(T value) const
+    {
+        if (std::isfinite(value)) {
+            append_number(out, value);
+        } else {
+            out += L"null";
+        }
+    }
+};
+
+// The nodes of a state, linked by index into one vector. A path resolves to the first node of each name on the way
+// down, as boost::property_tree::add does, which the index of paths finds without searching the children.
+struct node
+{
+    std::string                    name;
+    const core::monitor::data_t*   value       = nullptr;
+    const core::monitor::vector_t* values      = nullptr;
+    int                            first_child = -1;
+    int                            last_child  = -1;
+    int                            next        = -1;
+};
+
+class node_tree
+{
+    std::vector<node>                    nodes_;
+    std::unordered_map<std::string, int> paths_;
+
+  public:
+    node_tree() { nodes_.emplace_back(); }
+
+    const node& operator[](int index) const { return nodes_[index]; }
+
+    node& operator[](int index) { return nodes_[index]; }
+
+    std::size_t size() const { return nodes_.size(); }
+
+    int add(int parent, const std::string& path, const std::string& name)
+    {
+        const auto index = static_cast<int>(nodes_.size());
+        nodes_.emplace_back();
+        nodes_.back().name = name;
+
+        auto& p = nodes_[parent];
+        if (p.last_child < 0) {
+            p.first_child = index;
+        } else {
+            nodes_[p.last_child].next = index;
+        }
+        p.last_child = index;
+
+        paths_.emplace(path, index);
+        return index;
+    }
+
+    int find_or_add(int parent, const std::string& path, const std::string& name)
+    {
+        auto it = paths_.find(path);
+        return it != paths_.end() ? it->second : add(parent, path, name);
+    }
+};
+
+bool is_digits(const std::string& str)
+{
+    return std::all_of(str.begin(), str.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// Digit-only names aren't valid xml. This does what the replacement "\.(.*?)\.([0-9]*?)\." -> ".$1.$1_$2." of the
+// dotted path used to, quirks included, so that the names that clients look for stay the same.
+std::vector<std::string> xml_path(const std::string& key)
+{
+    std::vector<std::string> segments;
+    boost::split(segments, key, [](char c) { return c == '/' || c == '.'; });
+
+    std::vector<std::string> path;
+    path.reserve(segments.size() + 2);
+    path.push_back(segments[0]);
+
+    for (std::size_t n = 1; n < segments.size();) {
+        auto digits = n + 1;
+        while (digits + 1 < segments.size() && !is_digits(segments[digits])) {
+            ++digits;
+        }
+        if (digits + 1 >= segments.size()) {
+            path.insert(path.end(), segments.begin() + n, segments.end());
+            break;
+        }
+
+        path.insert(path.end(), segments.begin() + n, segments.begin() + digits);
+        path.insert(path.end(), segments.begin() + n, segments.begin() + digits - 1);
+        path.push_back(segments[digits - 1] + "_" + segments[digits]);
+        path.push_back(segments[digits + 1]);
+        n = digits + 2;
+    }
+
+    return path;
+}
+
+void write_xml_indent(std::wstring& out, int indent)
+{
+    out.append(static_cast<std::size_t>(indent) * XML_INDENT, L' ');
+}
+
+void write_xml_element(std::wstring& out, const node_tree& tree, int index, int indent)
+{
+    const auto& n            = tree[index];
+    const auto  has_data     = n.value && !boost::apply_visitor(is_empty_visitor(), *n.value);
+    const auto  has_elements = n.first_child >= 0;
+
+    write_xml_indent(out, indent);
+    out += L'<';
+    append(out, n.name);
+
+    if (!has_data && !has_elements) {
+        out += L"/>\n";
+        return;
+    }
+
+    out += L'>';
+    if (has_elements) {
+        out += L'\n';
+    }
+
+    if (has_data) {
+        if (has_elements) {
+            write_xml_indent(out, indent + 1);
+        }
+        boost::apply_visitor(xml_value_visitor(out), *n.value);
+        if (has_elements) {
+            out += L'\n';
+        }
+    }
+
+    for (auto child = n.first_child; child >= 0; child = tree[child].next) {
+        write_xml_element(out, tree, child, indent + 1);
+    }
+
+    if (has_elements) {
+        write_xml_indent(out, indent);
+    }
+    out += L"</";
+    append(out, n.name);
+    out += L">\n";
+}
+
+void write_json_values(std::wstring& out, const core::monitor::vector_t& values)
+{
+    if (values.size() == 1) {
+        boost::apply_visitor(json_value_visitor(out), values.front());
+        return;
+    }
+
+    out += L'[';
+    for (std::size_t n = 0; n < values.size(); ++n) {
+        if (n > 0) {
+            out += L',';
+        }
+        boost::apply_visitor(json_value_visitor(out), values[n]);
+    }
+    out += L']';
+}
+
+// A path that is also the parent of others, e.g. a/b next to a/b/c, keeps its value under an empty key.
+void write_json_node(std::wstring& out, const node_tree& tree, int index)
+{
+    const auto& n = tree[index];
+    if (n.first_child < 0) {
+        if (n.values) {
+            write_json_values(out, *n.values);
+        } else {
+            out += L"{}";
+        }
+        return;
+    }
+
+    out += L'{';
+    auto first = true;
+    if (n.values) {
+        out += L"\"\":";
+        write_json_values(out, *n.values);
+        first = false;
+    }
+    for (auto child = n.first_child; child >= 0; child = tree[child].next) {
+        if (!first) {
+            out += L',';
+        }
+        first = false;
+        append_json_string(out, tree[child].name);
+        out += L':';
+        write_json_node(out, tree, child);
+    }
+    out += L'}';
+}
+
+using wptree = boost::property_tree::wptree;
+
+const std::wstring XML_ATTR    = L"<xmlattr>";
+const std::wstring XML_COMMENT = L"<xmlcomment>";
+const std::wstring XML_TEXT    = L"<xmltext>";
+
+// Mirrors boost::property_tree::xml_parser::write_xml_element.
+void write_xml_element(std::wstring& out, const std::wstring& key, const wptree& pt, int indent)
+{
+    auto has_elements   = false;
+    auto has_attrs_only = pt.data().empty();
+    for (auto& child : pt) {
+        if (child.first != XML_ATTR) {
+            has_attrs_only = false;
+            if (child.first != XML_TEXT) {
+                has_elements = true;
+                break;
+            }
+        }
+    }
+
+    if (pt.data().empty() && pt.empty()) {
+        if (indent >= 0) {
+            write_xml_indent(out, indent);
+            out += L'<';
+            out += key;
+            out += L"/>\n";
+        }
+        return;
+    }
+
+    if (indent >= 0) {
+        write_xml_indent(out, indent);
+        out += L'<';
+        out += key;
+
+        auto attrs = pt.find(XML_ATTR);
+        if (attrs != pt.not_found()) {
+            for (auto& attr : attrs->second) {
+                out += L' ';
+                out += attr.first;
+                out += L"=\"";
+                append_xml_text(out, attr.second.data());
+                out += L'"';
+            }
+        }
+
+        if (has_attrs_only) {
+            out += L"/>\n";
+        } else {
+            out += L'>';
+            if (has_elements) {
+                out += L'\n';
+            }
+        }
+    }
+
+    const auto write_text = [&](const std::wstring& text) {
+        if (has_elements) {
+            write_xml_indent(out, indent + 1);
+        }
+        append_xml_text(out, text);
+        if (has_elements) {
+            out += L'\n';
+        }
+    };
+
+    if (!pt.data().empty()) {
+        write_text(pt.data());
+    }
+
+    for (auto& child : pt) {
+        if (child.first == XML_ATTR) {
+            continue;
+        }
+        if (child.first == XML_COMMENT) {
+            write_xml_indent(out, indent + 1);
+            out += L"<!--";
+            out += child.second.data();
+            out += L"-->\n";
+        } else if (child.first == XML_TEXT) {
+            write_text(child.second.data());
+        } else {
+            write_xml_element(out, child.first, child.second, indent + 1);
+        }
+    }
+
+    if (indent >= 0 && !has_attrs_only) {
+        if (has_elements) {
+            write_xml_indent(out, indent);
+        }
+        out += L"</";
+        out += key;
+        out += L">\n";
+    }
+}
+
+void write_json_tree(std::wstring& out, const wptree& pt)
+{
+    if (pt.empty()) {
+        append_json_string(out, pt.data());
+        return;
+    }
+
+    const auto is_array =
+        std::all_of(pt.begin(), pt.end(), [](const wptree::value_type& v) { return v.first.empty(); });
+    if (is_array) {
+        out += L'[';
+        for (auto it = pt.begin(); it != pt.end(); ++it) {
+            if (it != pt.begin()) {
+                out += L',';
+            }
+            write_json_tree(out, it->second);
+        }
+        out += L']';
+        return;
+    }
+
+    out += L'{';
+    auto first = true;
+    for (auto it = pt.begin(); it != pt.end(); ++it) {
+        // Children are written in order of the first of each name, the others follow it in the same array.
+        const auto range = pt.equal_range(it->first);
+        if (pt.to_iterator(range.first) != it) {
+            continue;
+        }
+
+        if (!first) {
+            out += L',';
+        }
+        first = false;
+        append_json_string(out, it->first);
+        out += L':';
+
+        if (std::next(range.first) == range.second) {
+            write_json_tree(out, it->second);
+            continue;
+        }
+
+        out += L'[';
+        for (auto child = range.first; child != range.second; ++child) {
+            if (child != range.first) {
+                out += L',';
+            }
+            write_json_tree(out, child->second);
+        }
+        out += L']';
+    }
+    out += L'}';
+}
+
+std::size_t count_nodes(const wptree& pt)
+{
+    std::size_t count = 1;
+    for (auto& child : pt) {
+        count += count_nodes(child.second);
+    }
+    return count;
+}
+
+} // namespace
+
+void write_xml(std::wstring& out, const std::string& root, const core::monitor::state& state)
+{
+    node_tree tree;
+    const auto root_index = tree.add(0, root, root);
+
+    std::string path;
+    for (auto& p : state) {
+        if (p.second.empty()) {
+            continue;
+        }
+
+        const auto segments = xml_path(p.first);
+
+        path        = root;
+        auto parent = root_index;
+        for (std::size_t n = 0; n + 1 < segments.size(); ++n) {
+            path += '.';
+            path += segments[n];
+            parent = tree.find_or_add(parent, path, segments[n]);
+        }
+        path += '.';
+        path += segments.back();
+        for (auto& element : p.second) {
+            tree[tree.add(parent, path, segments.back())].value = &element;
+        }
+    }
+
+    out.reserve(out.size() + 64 + tree.size() * 64);
+    out += L"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    write_xml_element(out, tree, root_index, 0);
+}
+
+void write_json(std::wstring& out, const core::monitor::state& state)
+{
+    node_tree tree;
+
+    std::vector<std::string> segments;
+    std::string              path;
+    for (auto& p : state) {
+        if (p.second.empty()) {
+            continue;
+        }
+
+        boost::split(segments, p.first, [](char c) { return c == '/'; });
+
+        path.clear();
+        auto index = 0;
+        for (auto& segment : segments) {
+            path += '/';
+            path += segment;
+            index = tree.find_or_add(index, path, segment);
+        }
+        tree[index].values = &p.second;
+    }
+
+    out.reserve(out.size() + tree.size() * 48);
+    write_json_node(out, tree, 0);
+}
+
+void write_xml(std::wstring& out, const boost::property_tree::wptree& tree)
+{
+    out.reserve(out.size() + 64 + count_nodes(tree) * 64);
+    out += L"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    write_xml_element(out, std::wstring(), tree, -1);
+}
+
+void write_json(std::wstring& out, const boost::property_tree::wptree& tree)
+{
+    out.reserve(out.size() + count_nodes(tree) * 48);
+    write_json_tree(out, tree);
+}
+
+}} // namespace caspar::IO
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <string>
+
+namespace caspar { namespace IO {
+
+// Serializers that append straight to a reply, without going through a stream or building a wptree first. The xml
+// is laid out as boost::property_tree::write_xml does with an indent of 3, so that existing clients see no
+// difference. Replies stay wide since they are encoded to UTF-8 once when they are sent.
+
+// Writes the state as children of an element named root. Paths are split on '/' and digit-only nodes get the name
+// of their parent as prefix, e.g. stage/layer/10 becomes <stage><layer><layer_10>.
+void write_xml(std::wstring& out, const std::string& root, const core::monitor::state& state);
+
+// Writes the state as a json object nested by path, values with more than one element become arrays.
+void write_json(std::wstring& out, const core::monitor::state& state);
+
+void write_xml(std::wstring& out, const boost::property_tree::wptree& tree);
+
+// Writes values as strings, children that share a name become an array.
+void write_json(std::wstring& out, const boost::property_tree::wptree& tree);
+
+}} // namespace caspar::IO
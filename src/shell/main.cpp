@@ -274,5 +274,7 @@ int main(int argc, char** argv)
         std::this_thread::sleep_for(std::chrono::milliseconds(4000));
     }
 
+    log::flush();
+
     return return_code;
 }
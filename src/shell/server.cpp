@@ -21,15 +21,19 @@
 #include "included_modules.h"
 
 #include "server.h"
+#include "state_snapshot.h"
 
 #include <accelerator/accelerator.h>
 
 #include <common/env.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 #include <common/ptree.h>
 #include <common/utf.h>
 
+#include <core/channel_arena.h>
+#include <core/channel_group.h>
 #include <core/consumer/output.h>
 #include <core/diagnostics/call_context.h>
 #include <core/diagnostics/osd_graph.h>
@@ -47,7 +51,11 @@
 #include <protocol/amcp/amcp_command_repository.h>
 #include <protocol/cii/CIIProtocolStrategy.h>
 #include <protocol/clk/CLKProtocolStrategy.h>
+#include <protocol/data/data_protocol_strategy.h>
+#include <protocol/metrics/exporter.h>
 #include <protocol/osc/client.h>
+#include <protocol/osc/listener.h>
+#include <protocol/telemetry/shm_writer.h>
 #include <protocol/util/AsyncEventServer.h>
 #include <protocol/util/strategy_adapters.h>
 
@@ -56,7 +64,9 @@
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
+#include <algorithm>
 #include <future>
+#include <map>
 #include <thread>
 #include <utility>
 
@@ -104,6 +114,9 @@ struct server::impl
     std::shared_ptr<IO::AsyncEventServer>              primary_amcp_server_;
     std::shared_ptr<osc::client>                       osc_client_ = std::make_shared<osc::client>(io_service_);
     std::vector<std::shared_ptr<void>>                 predefined_osc_subscriptions_;
+    std::shared_ptr<osc::listener>                     osc_listener_;
+    std::shared_ptr<telemetry::shm_writer>             telemetry_;
+    std::shared_ptr<metrics::exporter>                 metrics_;
     std::vector<spl::shared_ptr<video_channel>>        channels_;
     spl::shared_ptr<core::cg_producer_registry>        cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>     producer_registry_;
@@ -120,6 +133,9 @@ struct server::impl
         , shutdown_server_now_(std::move(shutdown_server_now))
     {
         caspar::core::diagnostics::osd::register_sink();
+        if (env::properties().get(L"configuration.metrics.port", 0) > 0) {
+            metrics::register_sink();
+        }
 
         auto ogl_device    = accelerator_.get_device();
         amcp_command_repo_ = spl::make_shared<amcp::amcp_command_repository>(
@@ -133,27 +149,50 @@ struct server::impl
 
     void start()
     {
-        setup_channels(env::properties());
+        auto consumers = setup_channels(env::properties());
         CASPAR_LOG(info) << L"Initialized channels.";
 
+        if (env::properties().get(L"configuration.state-snapshot", false)) {
+            restore_snapshot(channels_, producer_registry_, cg_registry_, snapshot_filename());
+        }
+
+        // The control ports open while the consumers are still being created.
         setup_controllers(env::properties());
         CASPAR_LOG(info) << L"Initialized controllers.";
 
+        for (auto& consumer : consumers) {
+            consumer.wait();
+        }
+        CASPAR_LOG(info) << L"Initialized consumers.";
+
         setup_osc(env::properties());
         CASPAR_LOG(info) << L"Initialized osc.";
+
+        setup_metrics(env::properties());
     }
 
     ~impl()
     {
+        if (env::properties().get(L"configuration.state-snapshot", false) && !channels_.empty()) {
+            save_snapshot(channels_, snapshot_filename());
+        }
+
         std::weak_ptr<boost::asio::io_service> weak_io_service = io_service_;
         io_service_.reset();
         osc_client_.reset();
+        osc_listener_.reset();
+        telemetry_.reset();
+        metrics_.reset();
         amcp_command_repo_.reset();
         primary_amcp_server_.reset();
         async_servers_.clear();
         destroy_producers_synchronously();
         destroy_consumers_synchronously();
+        const auto nb_channels = static_cast<int>(channels_.size());
         channels_.clear();
+        for (auto n = 1; n <= nb_channels; ++n) {
+            set_channel_arena(n, 0);
+        }
 
         while (weak_io_service.lock())
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -162,11 +201,77 @@ struct server::impl
         core::diagnostics::osd::shutdown();
     }
 
-    void setup_channels(const boost::property_tree::wptree& pt)
+    static std::wstring snapshot_filename() { return env::data_folder() + L"state-snapshot.xml"; }
+
+    void setup_telemetry(const boost::property_tree::wptree& pt)
+    {
+        if (!pt.get(L"configuration.telemetry.shared-memory", false)) {
+            return;
+        }
+
+        try {
+            telemetry_ = std::make_shared<telemetry::shm_writer>(
+                u8(pt.get(L"configuration.telemetry.name", L"casparcg-telemetry")),
+                pt.get(L"configuration.telemetry.slot-count", 64),
+                pt.get(L"configuration.telemetry.slot-size", 65536));
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    void setup_metrics(const boost::property_tree::wptree& pt)
+    {
+        auto port = pt.get(L"configuration.metrics.port", 0);
+        if (port <= 0) {
+            return;
+        }
+
+        // The summary of the pools of the ogl device, e.g. gl.summary.pooled_host_buffers.total_read_size.
+        auto weak_device = std::weak_ptr<accelerator::accelerator_device>(accelerator_.get_device());
+        auto gauges      = [weak_device] {
+            std::vector<std::pair<std::string, double>> result;
+
+            auto device = weak_device.lock();
+            if (!device) {
+                return result;
+            }
+
+            std::function<void(const std::string&, const boost::property_tree::wptree&)> add;
+            add = [&](const std::string& name, const boost::property_tree::wptree& tree) {
+                if (tree.empty()) {
+                    if (auto value = tree.get_value_optional<double>()) {
+                        result.emplace_back(name, *value);
+                    }
+                    return;
+                }
+                for (auto& child : tree) {
+                    add(name + "_" + boost::replace_all_copy(u8(child.first), "-", "_"), child.second);
+                }
+            };
+
+            auto info = device->info();
+            if (auto summary = info.get_child_optional(L"gl.summary")) {
+                add("casparcg_gl", *summary);
+            }
+            return result;
+        };
+
+        try {
+            metrics_ = std::make_shared<metrics::exporter>(io_service_, static_cast<unsigned short>(port), gauges);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    // Returns the pending creation of the consumers of each channel.
+    std::vector<std::future<void>> setup_channels(const boost::property_tree::wptree& pt)
     {
         using boost::property_tree::wptree;
 
-        std::vector<wptree> xml_channels;
+        setup_telemetry(pt);
+
+        std::vector<wptree>                                                                  xml_channels;
+        std::map<std::wstring, std::pair<std::shared_ptr<channel_group>, video_format_desc>> groups;
 
         for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
             xml_channels.push_back(xml_channel.second);
@@ -177,43 +282,127 @@ struct server::impl
             if (format_desc.format == video_format::invalid)
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
 
-            auto weak_client = std::weak_ptr<osc::client>(osc_client_);
-            auto channel_id  = static_cast<int>(channels_.size() + 1);
+            format_desc.audio_channels = xml_channel.second.get(L"audio-channels", format_desc.audio_channels);
+            if (format_desc.audio_channels < 1 || format_desc.audio_channels > 64)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid audio-channels: " +
+                                                                std::to_wstring(format_desc.audio_channels)));
+
+            auto pipeline_depth = xml_channel.second.get(L"pipeline-depth", 1);
+            if (pipeline_depth < 1)
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid pipeline-depth: " + std::to_wstring(pipeline_depth)));
+
+            auto parallel_layers = xml_channel.second.get(L"parallel-layers", false);
+
+            auto layer_deadline = xml_channel.second.get(L"layer-deadline", 0.0);
+            if (layer_deadline < 0.0)
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid layer-deadline: " + std::to_wstring(layer_deadline)));
+
+            auto frame_budget = xml_channel.second.get(L"frame-budget", 0.0);
+            if (frame_budget < 0.0)
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid frame-budget: " + std::to_wstring(frame_budget)));
+
+            auto mixer_depth = xml_channel.second.get(L"mixer-depth", 1);
+            if (mixer_depth < 0 || mixer_depth > 2)
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid mixer-depth: " + std::to_wstring(mixer_depth)));
+
+            auto mixer_precision = xml_channel.second.get(L"mixer-precision", L"8bit");
+            if (mixer_precision != L"8bit" && mixer_precision != L"half-float")
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid mixer-precision: " + mixer_precision));
+
+            auto ogl_device = xml_channel.second.get(L"ogl-device", 0);
+            if (ogl_device < 0)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid ogl-device: " + std::to_wstring(ogl_device)));
+
+            auto cpus = resolve_cpus(parse_cpu_list(xml_channel.second.get(L"cpus", L"")),
+                                     xml_channel.second.get(L"numa-node", -1));
+            set_channel_cpus(static_cast<int>(channels_.size() + 1), cpus);
+
+            auto concurrency = xml_channel.second.get(L"arena-concurrency", static_cast<int>(cpus.size()));
+            if (concurrency < 0)
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid arena-concurrency: " + std::to_wstring(concurrency)));
+            set_channel_arena(static_cast<int>(channels_.size() + 1), concurrency);
+
+            std::shared_ptr<channel_group> group;
+            auto                           group_name = xml_channel.second.get(L"sync-group", L"");
+            if (!group_name.empty()) {
+                auto& entry = groups[group_name];
+                if (!entry.first) {
+                    entry = std::make_pair(std::make_shared<channel_group>(group_name), format_desc);
+                } else if (entry.second.framerate != format_desc.framerate ||
+                           entry.second.field_count != format_desc.field_count) {
+                    CASPAR_THROW_EXCEPTION(user_error()
+                                           << msg_info(L"Channels in sync-group " + group_name +
+                                                       L" need the same frame rate, " + format_desc.name +
+                                                       L" doesn't match " + entry.second.name));
+                }
+                group = entry.first;
+            }
+
+            auto weak_client    = std::weak_ptr<osc::client>(osc_client_);
+            auto weak_telemetry = std::weak_ptr<telemetry::shm_writer>(telemetry_);
+            auto channel_id     = static_cast<int>(channels_.size() + 1);
             auto channel =
                 spl::make_shared<video_channel>(channel_id,
                                                 format_desc,
-                                                accelerator_.create_image_mixer(channel_id),
-                                                [channel_id, weak_client](core::monitor::state channel_state) {
+                                                accelerator_.create_image_mixer(
+                                                    channel_id, mixer_precision == L"half-float", ogl_device),
+                                                [channel_id, weak_client, weak_telemetry](
+                                                    core::monitor::state channel_state) {
+                                                    if (auto telemetry = weak_telemetry.lock()) {
+                                                        telemetry->write(channel_id, channel_state);
+                                                    }
                                                     monitor::state state;
                                                     state[""]["channel"][channel_id] = channel_state;
                                                     auto client                      = weak_client.lock();
                                                     if (client) {
                                                         client->send(std::move(state));
                                                     }
-                                                });
+                                                },
+                                                pipeline_depth,
+                                                parallel_layers,
+                                                mixer_depth,
+                                                layer_deadline,
+                                                frame_budget,
+                                                group);
 
             channels_.push_back(channel);
         }
 
+        // Consumers can take seconds each to open their devices, so the channels get theirs concurrently, each in the
+        // configured order.
+        std::vector<std::future<void>> consumers;
         for (auto& channel : channels_) {
-            core::diagnostics::scoped_call_context save;
-            core::diagnostics::call_context::for_thread().video_channel = channel->index();
+            auto xml_channel = xml_channels.at(channel->index() - 1);
+            if (!xml_channel.get_child_optional(L"consumers"))
+                continue;
 
-            if (xml_channels.at(channel->index() - 1).get_child_optional(L"consumers")) {
-                for (auto& xml_consumer : xml_channels.at(channel->index() - 1) | witerate_children(L"consumers") |
-                                              welement_context_iteration) {
+            consumers.push_back(std::async(std::launch::async, [this, channel, xml_channel] {
+                core::diagnostics::scoped_call_context save;
+                core::diagnostics::call_context::for_thread().video_channel = channel->index();
+
+                for (auto& xml_consumer : xml_channel | witerate_children(L"consumers") | welement_context_iteration) {
                     auto name = xml_consumer.first;
 
                     try {
-                        if (name != L"<xmlcomment>")
-                            channel->output().add(
-                                consumer_registry_->create_consumer(name, xml_consumer.second, channels_));
+                        if (name != L"<xmlcomment>") {
+                            auto consumer = consumer_registry_->create_consumer(name, xml_consumer.second, channels_);
+                            channel->output().add(consumer);
+                            if (auto offset = xml_consumer.second.get(L"av-offset", 0)) {
+                                channel->output().set_av_offset(consumer->index(), offset);
+                            }
+                        }
                     } catch (...) {
                         CASPAR_LOG_CURRENT_EXCEPTION();
                     }
                 }
-            }
+            }));
         }
+        return consumers;
     }
 
     void setup_osc(const boost::property_tree::wptree& pt)
@@ -243,6 +432,16 @@ struct server::impl
             }
         }
 
+        auto listen_port = pt.get(L"configuration.osc.listen-port", 0);
+        if (listen_port > 0) {
+            try {
+                osc_listener_ = std::make_shared<osc::listener>(
+                    io_service_, static_cast<unsigned short>(listen_port), channels_);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+
         if (!disable_send_to_amcp_clients && primary_amcp_server_)
             primary_amcp_server_->add_client_lifecycle_object_factory(
                 [=](const std::string& ipv4_address) -> std::pair<std::wstring, std::shared_ptr<void>> {
@@ -266,12 +465,16 @@ struct server::impl
 
             if (name == L"tcp") {
                 auto port              = ptree_get<unsigned int>(xml_controller.second, L"port");
+                auto no_delay          = xml_controller.second.get(L"no-delay", false);
+                auto max_write_batch   = xml_controller.second.get(L"max-write-batch", 65536);
 
                 try {
                     auto asyncbootstrapper = spl::make_shared<IO::AsyncEventServer>(
                         io_service_,
                         create_protocol(protocol, L"TCP Port " + std::to_wstring(port)),
-                        static_cast<short>(port));
+                        static_cast<short>(port),
+                        no_delay,
+                        static_cast<std::size_t>(std::max(max_write_batch, 1)));
                     async_servers_.push_back(asyncbootstrapper);
 
                     if (!primary_amcp_server_ && boost::iequals(protocol, L"AMCP"))
@@ -303,6 +506,9 @@ struct server::impl
             return spl::make_shared<to_unicode_adapter_factory>(
                 "ISO-8859-1",
                 spl::make_shared<CLK::clk_protocol_strategy_factory>(channels_, cg_registry_, producer_registry_));
+        if (boost::iequals(name, L"DATA"))
+            return spl::make_shared<delimiter_based_chunking_strategy_factory<char>>(
+                "\n", spl::make_shared<data::data_protocol_strategy_factory>(channels_));
 
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid protocol: " + name));
     }
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "state_snapshot.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/tweener.h>
+#include <common/utf.h>
+
+#include <core/frame/frame_transform.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/cg_proxy.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/producer/transition/transition_producer.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+#include <array>
+#include <cmath>
+#include <map>
+
+namespace caspar {
+
+namespace {
+
+struct layer_snapshot
+{
+    std::wstring file;
+    double       time   = 0.0;
+    bool         loop   = false;
+    bool         paused = false;
+};
+
+struct number_visitor : public boost::static_visitor<double>
+{
+    double operator()(bool value) const { return value ? 1.0 : 0.0; }
+    double operator()(const std::string&) const { return 0.0; }
+    double operator()(const std::wstring&) const { return 0.0; }
+    template <typename T>
+    double operator()(T value) const
+    {
+        return static_cast<double>(value);
+    }
+};
+
+// The layers of a channel that play a file, from the state of its stage, where e.g. the clip of layer 10 is at
+// layer/10/foreground/file/name.
+std::map<int, layer_snapshot> get_layers(const core::monitor::state& state)
+{
+    std::map<int, layer_snapshot> layers;
+    for (auto& p : state) {
+        auto& path = p.first;
+        if (path.compare(0, 6, "layer/") != 0 || p.second.empty()) {
+            continue;
+        }
+
+        const auto slash = path.find('/', 6);
+        if (slash == std::string::npos) {
+            continue;
+        }
+        const auto key   = path.substr(slash + 1);
+        auto&      value = p.second.front();
+
+        int index;
+        try {
+            index = std::stoi(path.substr(6, slash - 6));
+        } catch (...) {
+            continue;
+        }
+
+        if (key == "foreground/file/name") {
+            if (auto name = boost::get<std::string>(&value)) {
+                layers[index].file = u16(*name);
+            }
+        } else if (key == "foreground/file/time") {
+            layers[index].time = boost::apply_visitor(number_visitor{}, value);
+        } else if (key == "foreground/loop") {
+            layers[index].loop = boost::apply_visitor(number_visitor{}, value) != 0.0;
+        } else if (key == "foreground/paused") {
+            layers[index].paused = boost::apply_visitor(number_visitor{}, value) != 0.0;
+        }
+    }
+
+    for (auto it = layers.begin(); it != layers.end();) {
+        it = it->second.file.empty() ? layers.erase(it) : std::next(it);
+    }
+    return layers;
+}
+
+} // namespace
+
+void save_snapshot(const std::vector<spl::shared_ptr<core::video_channel>>& channels, const std::wstring& filename)
+{
+    try {
+        boost::property_tree::wptree tree;
+        auto&                        snapshot = tree.add_child(L"snapshot", boost::property_tree::wptree{});
+
+        for (auto& channel : channels) {
+            for (auto& p : get_layers(channel->stage().state())) {
+                auto  transform = channel->stage().get_current_transform(p.first).get();
+                auto& image     = transform.image_transform;
+                auto& layer     = snapshot.add_child(L"layer", boost::property_tree::wptree{});
+
+                layer.add(L"channel", channel->index());
+                layer.add(L"index", p.first);
+                layer.add(L"file", p.second.file);
+                layer.add(L"time", p.second.time);
+                layer.add(L"loop", p.second.loop);
+                layer.add(L"paused", p.second.paused);
+                layer.add(L"opacity", image.opacity);
+                layer.add(L"volume", transform.audio_transform.volume);
+                layer.add(L"fill-x", image.fill_translation[0]);
+                layer.add(L"fill-y", image.fill_translation[1]);
+                layer.add(L"fill-scale-x", image.fill_scale[0]);
+                layer.add(L"fill-scale-y", image.fill_scale[1]);
+            }
+        }
+
+        boost::filesystem::wofstream file(filename, std::ios::trunc);
+        boost::property_tree::write_xml(file, tree, boost::property_tree::xml_writer_settings<std::wstring>(' ', 2));
+        if (!file) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not write " + filename));
+        }
+
+        CASPAR_LOG(info) << L"[state_snapshot] Saved " << snapshot.size() << L" layers to " << filename;
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+}
+
+void restore_snapshot(const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                      const spl::shared_ptr<core::frame_producer_registry>&    producer_registry,
+                      const spl::shared_ptr<core::cg_producer_registry>&       cg_registry,
+                      const std::wstring&                                      filename)
+{
+    if (!boost::filesystem::exists(filename)) {
+        return;
+    }
+
+    boost::property_tree::wptree tree;
+    try {
+        boost::filesystem::wifstream file(filename);
+        boost::property_tree::read_xml(file, tree, boost::property_tree::xml_parser::trim_whitespace);
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        return;
+    }
+
+    auto restored = 0;
+    for (auto& p : tree.get_child(L"snapshot", boost::property_tree::wptree{})) {
+        if (p.first != L"layer") {
+            continue;
+        }
+        auto& layer = p.second;
+
+        try {
+            const auto channel_index = layer.get<int>(L"channel");
+            const auto index         = layer.get<int>(L"index");
+            if (channel_index < 1 || channel_index > static_cast<int>(channels.size())) {
+                continue;
+            }
+            auto& channel     = channels.at(channel_index - 1);
+            auto  format_desc = channel->video_format_desc();
+
+            std::vector<std::wstring> params{layer.get<std::wstring>(L"file")};
+            params.push_back(L"SEEK");
+            params.push_back(boost::lexical_cast<std::wstring>(
+                static_cast<uint32_t>(std::llround(std::max(layer.get(L"time", 0.0), 0.0) * format_desc.fps))));
+            if (layer.get(L"loop", false)) {
+                params.push_back(L"LOOP");
+            }
+
+            core::frame_producer_dependencies dependencies(
+                channel->frame_factory(), channels, format_desc, producer_registry, cg_registry);
+            auto producer = producer_registry->create_producer(dependencies, params);
+
+            const auto            opacity = layer.get(L"opacity", 1.0);
+            const auto            volume  = layer.get(L"volume", 1.0);
+            std::array<double, 2> fill    = {layer.get(L"fill-x", 0.0), layer.get(L"fill-y", 0.0)};
+            std::array<double, 2> scale   = {layer.get(L"fill-scale-x", 1.0), layer.get(L"fill-scale-y", 1.0)};
+
+            auto& stage = channel->stage();
+            stage.apply_transform(
+                index,
+                [=](core::frame_transform transform) {
+                    transform.image_transform.opacity          = opacity;
+                    transform.image_transform.fill_translation = fill;
+                    transform.image_transform.fill_scale       = scale;
+                    transform.audio_transform.volume           = volume;
+                    return transform;
+                },
+                0,
+                tweener(L"linear"));
+            stage.load(index, core::create_transition_producer(producer, core::transition_info{}));
+            stage.play(index);
+            if (layer.get(L"paused", false)) {
+                stage.pause(index);
+            }
+            ++restored;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    CASPAR_LOG(info) << L"[state_snapshot] Restored " << restored << L" layers from " << filename;
+}
+
+} // namespace caspar
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+// Restarting the server would otherwise drop everything that was playing. A snapshot records, for every layer
+// playing a file, the clip, its position, whether it loops or is paused and the main transform. Restoring it loads
+// the clips again where they were, so a planned restart only loses the time the server is down.
+void save_snapshot(const std::vector<spl::shared_ptr<core::video_channel>>& channels, const std::wstring& filename);
+
+void restore_snapshot(const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                      const spl::shared_ptr<core::frame_producer_registry>&    producer_registry,
+                      const spl::shared_ptr<core::cg_producer_registry>&       cg_registry,
+                      const std::wstring&                                      filename);
+
+} // namespace caspar